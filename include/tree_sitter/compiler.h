@@ -5,6 +5,10 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
 typedef enum {
   TSCompileErrorTypeNone,
   TSCompileErrorTypeInvalidGrammar,
@@ -19,13 +23,78 @@ typedef enum {
   TSCompileErrorTypeInvalidRuleName,
 } TSCompileErrorType;
 
+typedef struct {
+  uint64_t parse_grammar_micros;
+  uint64_t prepare_grammar_micros;
+  uint64_t build_parse_table_micros;
+  uint64_t optimize_parse_table_micros;
+  uint64_t build_lex_table_micros;
+  uint64_t generate_code_micros;
+  uint32_t item_set_count;
+  uint64_t parse_item_count;
+  uint32_t parse_state_count;
+  uint32_t lex_state_count;
+  uint32_t keyword_lex_state_count;
+  bool loaded_from_cache;
+  bool reused_parse_states;
+} TSCompileProfile;
+
 typedef struct {
   char *code;
   char *error_message;
   TSCompileErrorType error_type;
+  TSCompileProfile profile;
 } TSCompileResult;
 
+typedef struct {
+  bool use_lex_tables;
+  uint32_t thread_count;
+  bool compact_code;
+  bool specialize_table_lookups;
+  bool reorder_parse_states;
+  bool narrow_parse_table_rows;
+} TSCompileOptions;
+
+typedef void (*TSCompileWriteCallback)(void *payload, const char *text, uint32_t length);
+
 TSCompileResult ts_compile_grammar(const char *input);
+TSCompileResult ts_compile_grammar_with_options(const char *input, TSCompileOptions);
+
+// Instead of returning the code, pass it to the callback, or write it to the
+// file, in chunks as it is generated, so that it is never held in memory all
+// at once. The result's `code` is null.
+TSCompileResult ts_compile_grammar_to_writer(const char *input, TSCompileOptions,
+                                             TSCompileWriteCallback, void *payload);
+TSCompileResult ts_compile_grammar_to_file(const char *input, TSCompileOptions, FILE *);
+TSCompileResult ts_compile_grammar_binary(const char *input, uint32_t *length);
+
+// Instead of the code, return a description of every parse state that has more
+// than one action for some lookahead, which makes the parser fork at runtime.
+// Each action is listed, along with the rule that each reduction produces. The
+// states are numbered in the same way as in the code that is generated with
+// the same options, and in the state profiles of parses with that code.
+TSCompileResult ts_compile_grammar_conflict_report(const char *input, TSCompileOptions);
+
+// Compile a grammar, reusing the code that was generated for the same grammar
+// and options before, if it was stored in the given directory. Grammars are
+// identified by a hash of their JSON with the whitespace and comments
+// removed, so reformatting a grammar doesn't invalidate its code. The
+// directory must already exist. Grammars that fail to compile aren't cached.
+TSCompileResult ts_compile_grammar_cached(const char *input, TSCompileOptions,
+                                          const char *cache_directory);
+
+// A session keeps the parse states of the last grammar that it compiled. When
+// a grammar differs from the session's last one only in its tokens' patterns,
+// strings, precedences or separators, its parse states are reused, and only
+// the lex tables and the code are generated again. The parse states can't be
+// reused when tokens are added or removed, or when `reorder_parse_states`
+// changes.
+typedef struct TSCompileSession TSCompileSession;
+
+TSCompileSession *ts_compile_session_new();
+void ts_compile_session_free(TSCompileSession *);
+TSCompileResult ts_compile_session_compile(TSCompileSession *, const char *input,
+                                           TSCompileOptions);
 
 #ifdef __cplusplus
 }
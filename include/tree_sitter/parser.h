@@ -27,6 +27,9 @@ typedef struct {
   uint32_t (*get_column)(void *);
   int32_t lookahead;
   TSSymbol result_symbol;
+  void (*advance_while)(void *, const uint32_t *, bool);
+  const char *(*peek)(void *, uint32_t *);
+  void (*advance_bytes)(void *, uint32_t, bool);
 } TSLexer;
 
 typedef enum {
@@ -66,6 +69,40 @@ typedef union {
   };
 } TSParseActionEntry;
 
+typedef struct {
+  uint32_t state_count;
+  uint32_t class_count;
+  const uint16_t *accept_symbols;
+  const uint32_t *row_offsets;
+  const uint16_t *transitions;
+  const uint16_t *ascii_classes;
+  uint32_t range_count;
+  const int32_t *range_starts;
+  const uint16_t *range_classes;
+} TSLexTable;
+
+typedef struct {
+  const char *string;
+  uint32_t length;
+  TSSymbol symbol;
+} TSKeyword;
+
+typedef struct {
+  uint32_t seed;
+  uint32_t displacement_count;
+  uint32_t slot_count;
+  const uint16_t *displacements;
+  const TSKeyword *slots;
+} TSKeywordTable;
+
+// A scanner's shared data is created the first time that a parser uses the
+// language, and is then passed to every scanner that is created for it, in
+// place of calling `create`. The generated parser provides the storage for it.
+typedef struct {
+  void *data;
+  volatile uint32_t state;
+} TSExternalScannerSharedData;
+
 typedef struct TSLanguage {
   uint32_t version;
   uint32_t symbol_count;
@@ -90,7 +127,35 @@ typedef struct TSLanguage {
     bool (*scan)(void *, TSLexer *, const bool *symbol_whitelist);
     unsigned (*serialize)(void *, char *);
     void (*deserialize)(void *, const char *, unsigned);
+    bool (*equivalent)(const char *, unsigned, const char *, unsigned);
+    void *(*create_shared)();
+    void *(*create_with_shared)(const void *);
+    TSExternalScannerSharedData *shared_data;
+    // Reports whether the scanner's state has changed since it was last
+    // serialized or deserialized. Returning false lets the parser skip
+    // serializing the state after a token, and reuse the previous state.
+    bool (*state_changed)(void *);
   } external_scanner;
+  uint32_t state_count;
+  uint32_t large_state_count;
+  const uint16_t *small_parse_table;
+  const uint32_t *small_parse_table_map;
+  const TSLexTable *lex_table;
+  const TSLexTable *keyword_lex_table;
+  const TSKeywordTable *keyword_table;
+  const TSSymbol *symbols_by_name;
+  const TSStateId *parse_action_next_states;
+  const TSParseActionEntry *(*parse_actions_fn)(TSStateId, TSSymbol);
+  const uint32_t *parse_table_row_offsets;
+  const uint8_t *byte_parse_table;
+  const uint8_t *byte_small_parse_table;
+  const uint8_t *byte_lex_modes;
+  const uint32_t *error_start_characters;
+  const uint32_t *alias_sequence_offsets;
+  const uint16_t *lex_mode_ids;
+  const uint8_t *byte_lex_mode_ids;
+  const uint32_t *descendant_symbol_sets;
+  const uint16_t *descendant_symbol_set_ids;
 } TSLanguage;
 
 /*
@@ -117,6 +182,20 @@ typedef struct TSLanguage {
     goto next_state;             \
   }
 
+#define ADVANCE_WHILE(state_value, character_class)      \
+  {                                                      \
+    lexer->advance_while(lexer, character_class, false); \
+    state = state_value;                                 \
+    goto next_state;                                     \
+  }
+
+#define SKIP_WHILE(state_value, character_class)        \
+  {                                                     \
+    lexer->advance_while(lexer, character_class, true); \
+    state = state_value;                                \
+    goto next_state;                                    \
+  }
+
 #define ACCEPT_TOKEN(symbol_value)     \
   result = true;                       \
   lexer->result_symbol = symbol_value; \
@@ -124,12 +203,59 @@ typedef struct TSLanguage {
 
 #define END_STATE() return result;
 
+#define ASCII_CLASS_CONTAINS(character_class, character)               \
+  ((uint32_t)(character) < 128 &&                                      \
+   ((character_class)[(character) >> 5] & (1u << ((character) & 31))))
+
+/*
+ *  Direct-jump Lexer Macros
+ *
+ *  Lex functions written with these macros only use their `switch` to find
+ *  the initial state. Every transition jumps straight to the label of the
+ *  next state, so the state is never dispatched through the `switch` again.
+ */
+
+#define START_DIRECT_LEXER()            \
+  bool result = false;                  \
+  int32_t lookahead = lexer->lookahead;
+
+#define LEX_STATE(state_value) lex_state_##state_value:
+
+#define ADVANCE_TO(state_value)   \
+  {                               \
+    lexer->advance(lexer, false); \
+    lookahead = lexer->lookahead; \
+    goto lex_state_##state_value; \
+  }
+
+#define SKIP_TO(state_value)      \
+  {                               \
+    lexer->advance(lexer, true);  \
+    lookahead = lexer->lookahead; \
+    goto lex_state_##state_value; \
+  }
+
+#define ADVANCE_WHILE_TO(state_value, character_class)   \
+  {                                                      \
+    lexer->advance_while(lexer, character_class, false); \
+    lookahead = lexer->lookahead;                        \
+    goto lex_state_##state_value;                        \
+  }
+
+#define SKIP_WHILE_TO(state_value, character_class)     \
+  {                                                     \
+    lexer->advance_while(lexer, character_class, true); \
+    lookahead = lexer->lookahead;                       \
+    goto lex_state_##state_value;                       \
+  }
+
 /*
  *  Parse Table Macros
  */
 
 #define STATE(id) id
 #define ACTIONS(id) id
+#define SMALL_STATE(id) ((id) - LARGE_STATE_COUNT)
 
 #define SHIFT(state_value)              \
   {                                     \
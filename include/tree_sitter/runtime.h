@@ -5,15 +5,35 @@
 extern "C" {
 #endif
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
 
-#define TREE_SITTER_LANGUAGE_VERSION 8
+#define TREE_SITTER_LANGUAGE_VERSION 9
+
+// Languages that were generated for older versions, back to this one, can
+// still be used, without the faster tables that newer versions add.
+#define TREE_SITTER_MIN_COMPATIBLE_LANGUAGE_VERSION 8
+
+// The number of bytes that an input's `read` function reports when the next
+// bytes of the input aren't available yet.
+#define TS_INPUT_WOULD_BLOCK UINT32_MAX
 
 typedef unsigned short TSSymbol;
 typedef struct TSLanguage TSLanguage;
 typedef struct TSDocument TSDocument;
+typedef struct TSTreeCursor TSTreeCursor;
+typedef struct TSDocumentSnapshot TSDocumentSnapshot;
+typedef struct TSDocumentGroup TSDocumentGroup;
+typedef struct TSParser TSParser;
+typedef struct TSPatternSet TSPatternSet;
+typedef struct TSScopeIterator TSScopeIterator;
+typedef struct TSChangedNodeIterator TSChangedNodeIterator;
+typedef struct TSTokenIterator TSTokenIterator;
+typedef struct TSSymbolIterator TSSymbolIterator;
+typedef struct TSFrozenTree TSFrozenTree;
+typedef struct TSLanguageRegistry TSLanguageRegistry;
 
 typedef enum {
   TSInputEncodingUTF8,
@@ -38,6 +58,11 @@ typedef struct {
   TSInputEncoding encoding;
 } TSInput;
 
+typedef struct {
+  const char *text;
+  uint32_t length;
+} TSInputChunk;
+
 typedef enum {
   TSLogTypeParse,
   TSLogTypeLex,
@@ -57,14 +82,58 @@ typedef struct {
   TSPoint extent_added;
 } TSInputEdit;
 
+typedef enum {
+  TSTraceEventStartParse,
+  TSTraceEventProcessVersion,
+  TSTraceEventLex,
+  TSTraceEventReuse,
+  TSTraceEventShift,
+  TSTraceEventReduce,
+  TSTraceEventAccept,
+  TSTraceEventDetectError,
+  TSTraceEventRecover,
+  TSTraceEventSkipToken,
+  TSTraceEventResume,
+  TSTraceEventCondense,
+  TSTraceEventCancel,
+  TSTraceEventDone,
+} TSTraceEventType;
+
+typedef struct {
+  uint16_t type;
+  uint16_t version;
+  uint16_t state;
+  TSSymbol symbol;
+  uint32_t byte;
+  uint32_t detail;
+} TSTraceEvent;
+
 typedef struct {
   TSPoint start;
   TSPoint end;
+  uint32_t start_byte;
+  uint32_t end_byte;
 } TSRange;
 
+typedef void (*TSWriteCallback)(void *payload, const char *text, uint32_t length);
+
+typedef enum {
+  TSExportFormatJSONLines,
+  TSExportFormatBinary,
+} TSExportFormat;
+
+typedef struct {
+  const void *tree;
+  uint32_t generation;
+} TSNodeId;
+
 typedef struct {
   const void *data;
-  uint32_t offset[2];
+  const void *root;
+  const TSLanguage *language;
+  uint32_t offset[3];
+  uint32_t child_index;
+  TSSymbol alias_symbol;
 } TSNode;
 
 uint32_t ts_node_start_byte(TSNode);
@@ -74,16 +143,24 @@ TSPoint ts_node_end_point(TSNode);
 TSSymbol ts_node_symbol(TSNode);
 const char *ts_node_type(TSNode, const TSDocument *);
 char *ts_node_string(TSNode, const TSDocument *);
+void ts_node_write_string(TSNode, const TSDocument *, TSWriteCallback, void *);
+void ts_node_print_string(TSNode, const TSDocument *, FILE *);
+void ts_node_export(TSNode, TSExportFormat, TSWriteCallback, void *);
 bool ts_node_eq(TSNode, TSNode);
 bool ts_node_is_named(TSNode);
 bool ts_node_is_missing(TSNode);
+bool ts_node_is_opaque(TSNode);
 bool ts_node_has_changes(TSNode);
 bool ts_node_has_error(TSNode);
+uint64_t ts_node_fingerprint(TSNode);
+TSNodeId ts_node_id(TSNode);
 TSNode ts_node_parent(TSNode);
 TSNode ts_node_child(TSNode, uint32_t);
 TSNode ts_node_named_child(TSNode, uint32_t);
 uint32_t ts_node_child_count(TSNode);
 uint32_t ts_node_named_child_count(TSNode);
+uint32_t ts_node_children(TSNode, TSNode *, uint32_t);
+uint32_t ts_node_named_children(TSNode, TSNode *, uint32_t);
 uint32_t ts_node_child_index(TSNode);
 TSNode ts_node_next_sibling(TSNode);
 TSNode ts_node_next_named_sibling(TSNode);
@@ -96,7 +173,137 @@ TSNode ts_node_named_descendant_for_byte_range(TSNode, uint32_t, uint32_t);
 TSNode ts_node_descendant_for_point_range(TSNode, TSPoint, TSPoint);
 TSNode ts_node_named_descendant_for_point_range(TSNode, TSPoint, TSPoint);
 
+typedef enum {
+  TSNodeDiffRetained,
+  TSNodeDiffChanged,
+  TSNodeDiffInserted,
+  TSNodeDiffRemoved,
+} TSNodeDiffType;
+
+typedef struct {
+  TSNodeDiffType type;
+  TSNode old_node;
+  TSNode new_node;
+} TSNodeDiffEntry;
+
+typedef bool (*TSNodeDiffCallback)(void *payload, const TSNodeDiffEntry *);
+
+bool ts_node_diff(TSNode old_node, TSNode new_node, TSNodeDiffCallback, void *);
+
+TSTreeCursor *ts_tree_cursor_new(TSNode);
+void ts_tree_cursor_delete(TSTreeCursor *);
+bool ts_tree_cursor_goto_first_child(TSTreeCursor *);
+bool ts_tree_cursor_goto_next_sibling(TSTreeCursor *);
+bool ts_tree_cursor_goto_parent(TSTreeCursor *);
+TSNode ts_tree_cursor_current_node(const TSTreeCursor *);
+
+typedef struct {
+  TSNode node;
+  uint32_t index;
+} TSPatternCapture;
+
+typedef struct {
+  uint32_t pattern_index;
+  const TSPatternCapture *captures;
+  uint32_t capture_count;
+} TSPatternMatch;
+
+typedef bool (*TSPatternMatchCallback)(void *payload, const TSPatternMatch *);
+
+TSPatternSet *ts_pattern_set_new(const TSLanguage *, const char *, uint32_t length, uint32_t *error_offset);
+void ts_pattern_set_delete(TSPatternSet *);
+uint32_t ts_pattern_set_pattern_count(const TSPatternSet *);
+uint32_t ts_pattern_set_capture_count(const TSPatternSet *);
+const char *ts_pattern_set_capture_name(const TSPatternSet *, uint32_t);
+bool ts_pattern_set_match(const TSPatternSet *, TSNode, TSPatternMatchCallback, void *);
+bool ts_pattern_set_match_in_range(const TSPatternSet *, TSNode, uint32_t start_byte, uint32_t end_byte,
+                                   TSPatternMatchCallback, void *);
+bool ts_pattern_set_match_in_parallel(const TSPatternSet *, TSNode, uint32_t thread_count,
+                                      TSPatternMatchCallback, void *);
+
+typedef struct {
+  uint32_t start_byte;
+  uint32_t end_byte;
+  const TSSymbol *scopes;
+  uint32_t scope_count;
+} TSScopeSpan;
+
+TSScopeIterator *ts_scope_iterator_new(TSNode, uint32_t start_byte, uint32_t end_byte);
+void ts_scope_iterator_delete(TSScopeIterator *);
+void ts_scope_iterator_reset(TSScopeIterator *, uint32_t start_byte, uint32_t end_byte);
+bool ts_scope_iterator_next(TSScopeIterator *, TSScopeSpan *);
+
+typedef struct {
+  TSSymbol symbol;
+  uint32_t start_byte;
+  uint32_t end_byte;
+  bool is_extra;
+} TSToken;
+
+TSTokenIterator *ts_token_iterator_new(TSNode, uint32_t start_byte, uint32_t end_byte);
+void ts_token_iterator_delete(TSTokenIterator *);
+void ts_token_iterator_reset(TSTokenIterator *, uint32_t start_byte, uint32_t end_byte);
+bool ts_token_iterator_next(TSTokenIterator *, TSToken *);
+
+// Visit the visible nodes with any of the given symbols, in document order,
+// starting with the given node, without descending into the subtrees that
+// the language's grammar says can't contain any of them.
+TSSymbolIterator *ts_symbol_iterator_new(TSNode, const TSSymbol *, uint32_t symbol_count);
+void ts_symbol_iterator_delete(TSSymbolIterator *);
+void ts_symbol_iterator_reset(TSSymbolIterator *, TSNode);
+void ts_symbol_iterator_skip_children(TSSymbolIterator *);
+bool ts_symbol_iterator_next(TSSymbolIterator *, TSNode *);
+
+TSChangedNodeIterator *ts_changed_node_iterator_new(const TSDocument *);
+void ts_changed_node_iterator_delete(TSChangedNodeIterator *);
+void ts_changed_node_iterator_reset(TSChangedNodeIterator *);
+bool ts_changed_node_iterator_next(TSChangedNodeIterator *, TSNode *);
+
+typedef struct {
+  const TSFrozenTree *tree;
+  uint32_t index;
+} TSFrozenNode;
+
+TSFrozenTree *ts_frozen_tree_new(TSNode);
+TSFrozenTree *ts_frozen_tree_new_from_bytes(const TSLanguage *, const char *, uint32_t length);
+void ts_frozen_tree_delete(TSFrozenTree *);
+const char *ts_frozen_tree_bytes(const TSFrozenTree *, uint32_t *length);
+uint32_t ts_frozen_tree_node_count(const TSFrozenTree *);
+TSFrozenNode ts_frozen_tree_root_node(const TSFrozenTree *);
+bool ts_frozen_node_is_null(TSFrozenNode);
+TSSymbol ts_frozen_node_symbol(TSFrozenNode);
+const char *ts_frozen_node_type(TSFrozenNode);
+uint32_t ts_frozen_node_start_byte(TSFrozenNode);
+uint32_t ts_frozen_node_end_byte(TSFrozenNode);
+bool ts_frozen_node_is_named(TSFrozenNode);
+bool ts_frozen_node_is_missing(TSFrozenNode);
+bool ts_frozen_node_has_error(TSFrozenNode);
+TSFrozenNode ts_frozen_node_first_child(TSFrozenNode);
+TSFrozenNode ts_frozen_node_next_sibling(TSFrozenNode);
+uint32_t ts_frozen_node_child_count(TSFrozenNode);
+TSFrozenNode ts_frozen_node_child(TSFrozenNode, uint32_t);
+
 TSDocument *ts_document_new();
+
+// Create a document with the same language, included ranges and tree as the
+// given one, whose trees are shared with it rather than copied. After the new
+// document is given its input, and edited from the given document's text to
+// its own, its first parse is incremental. Documents that share trees also
+// share the pool that they are allocated from, so they must not be used from
+// different threads at the same time.
+TSDocument *ts_document_fork(TSDocument *);
+
+// A group of documents in the same language, which allocate their trees from
+// one pool, so that the nodes freed by any of them are reused by the others'
+// parses. Like documents that were forked from one another, the documents in
+// a group must not be used from different threads at the same time, though
+// readers on other threads can still retain and release their root nodes.
+// The group's pool is freed along with the last of the group and its
+// documents.
+TSDocumentGroup *ts_document_group_new(const TSLanguage *);
+void ts_document_group_delete(TSDocumentGroup *);
+TSDocument *ts_document_group_new_document(TSDocumentGroup *);
+const TSLanguage *ts_document_group_language(const TSDocumentGroup *);
 void ts_document_free(TSDocument *);
 const TSLanguage *ts_document_language(TSDocument *);
 void ts_document_set_language(TSDocument *, const TSLanguage *);
@@ -104,29 +311,311 @@ TSInput ts_document_input(TSDocument *);
 void ts_document_set_input(TSDocument *, TSInput);
 void ts_document_set_input_string(TSDocument *, const char *);
 void ts_document_set_input_string_with_length(TSDocument *, const char *, uint32_t);
+void ts_document_set_input_chunks(TSDocument *, const TSInputChunk *, uint32_t);
+bool ts_document_set_input_file(TSDocument *, int);
+bool ts_document_set_input_path(TSDocument *, const char *);
+
+// Byte offsets within a document are 32-bit, so files larger than 4GB are
+// parsed as a series of documents, each reading a range of the file. A
+// document's base byte is the offset of its input within the whole file, and
+// is added to the byte offsets of its nodes to find their place in the file.
+// Its rows and columns are relative to the start of the range.
+bool ts_document_set_input_file_range(TSDocument *, int, uint64_t start_byte, uint64_t length);
+void ts_document_set_base_byte(TSDocument *, uint64_t);
+uint64_t ts_document_base_byte(const TSDocument *);
+bool ts_document_set_included_ranges(TSDocument *, const TSRange *, uint32_t);
+const TSRange *ts_document_included_ranges(const TSDocument *, uint32_t *count);
+
+typedef struct {
+  TSSymbol symbol;
+  TSSymbol open_token;
+  TSSymbol close_token;
+} TSOpaqueRegion;
+
+void ts_document_set_opaque_regions(TSDocument *, const TSOpaqueRegion *, uint32_t);
+void ts_document_expand_opaque_node(TSDocument *, TSNode);
 TSLogger ts_document_logger(const TSDocument *);
 void ts_document_set_logger(TSDocument *, TSLogger);
 void ts_document_print_debugging_graphs(TSDocument *, bool);
 void ts_document_edit(TSDocument *, TSInputEdit);
+void ts_document_edit_batch(TSDocument *, const TSInputEdit *, uint32_t);
+
+// Edit the document by comparing its old text with its new text, for when the
+// edits that were made aren't known, so that the next parse can still reuse the
+// old tree. The text that the two have in common at their start and end is
+// left out of the edits, and when `compare_lines` is set, so are the lines in
+// between that weren't changed. The text is in the encoding of the document's
+// input, which still needs to be set to the new text. Returns the number of
+// edits that were made.
+uint32_t ts_document_edit_text(TSDocument *, const char *old_text, uint32_t old_length,
+                               const char *new_text, uint32_t new_length, bool compare_lines);
 void ts_document_parse(TSDocument *);
 void ts_document_parse_and_get_changed_ranges(TSDocument *, TSRange **, uint32_t *);
 
+// The events of a parse that doesn't build a tree. Each visible node is
+// reported once all of its descendants have been: a token as a shift, and
+// any other node as a reduce, along with its number of visible children.
+typedef struct {
+  void *payload;
+  void (*shift)(void *payload, TSSymbol symbol, uint32_t start_byte, uint32_t end_byte);
+  void (*reduce)(void *payload, TSSymbol symbol, uint32_t start_byte, uint32_t end_byte,
+                 uint32_t child_count);
+} TSParseEventHandler;
+
+// A tree builder constructs the caller's own representation of the tree
+// while the input is parsed. `leaf` and `node` are called for visible tokens
+// and for other visible nodes, and return an object that stands for them. A
+// node receives the objects of its visible children. Aliases aren't applied.
+// Objects that were built for interpretations of the input that the parser
+// ended up discarding are passed to `release`, which should free only the
+// object itself, not its children. When the parse finishes, `accept` receives
+// the root's object, and the caller owns it along with the objects of all of
+// its descendants.
+typedef struct {
+  void *payload;
+  void *(*leaf)(void *payload, TSSymbol symbol, uint32_t start_byte, uint32_t end_byte);
+  void *(*node)(void *payload, TSSymbol symbol, uint32_t start_byte, uint32_t end_byte,
+                void **children, uint32_t child_count);
+  void (*release)(void *payload, void *object);
+  void (*accept)(void *payload, void *root);
+} TSTreeBuilder;
+
 typedef struct {
   TSRange **changed_ranges;
   uint32_t *changed_range_count;
+  bool (*changed_range_callback)(void *payload, TSRange range);
+  void *changed_range_payload;
   bool halt_on_error;
+  uint32_t thread_count;
+  uint32_t max_version_count;
+  const volatile bool *cancellation_flag;
+  uint64_t timeout_micros;
+  uint32_t max_bytes_per_call;
+  bool enable_profiling;
+  uint32_t max_recovery_steps_per_byte;
+  size_t max_memory_bytes;
+  bool intern_leaves;
+  uint32_t max_error_cost;
+  uint32_t priority_end_byte;
+  uint32_t input_window_bytes;
+  bool enable_state_profiling;
+
+  // In append mode, the parser keeps a snapshot of its stack from near the end
+  // of the text, and the next parse in append mode, as long as the document
+  // has only been edited after the text that the snapshot depends on, resumes
+  // from it instead of starting over and reusing the old tree. This suits
+  // inputs that only grow at the end. It has no effect on a parse that
+  // streams its nodes, doesn't keep its tree, or skips opaque regions.
+  bool append_mode;
+
+  // With prefetching, the input's next chunk is read on a helper thread while
+  // the current one is lexed, so that slow reads overlap with the parse. Each
+  // chunk is copied, so the input may reuse its buffer on every read. The
+  // input is only called from one thread at a time, and never after the parse
+  // returns. It has no effect when an input window is used.
+  bool prefetch_input;
+
+  // In a streaming parse, each top-level node is passed to the callback as
+  // soon as no other interpretation of the input can change it, and is then
+  // dropped from the tree, so that the memory used by the parse is bounded by
+  // the largest top-level node rather than by the size of the input. Only the
+  // elements of a repetition in the start rule are streamed, and error
+  // recovery never wraps them in an error afterward. A node is only valid
+  // during the call. The resulting tree holds only the nodes
+  // that weren't passed to the callback, and isn't reused by the next parse.
+  void (*streamed_node_callback)(void *payload, TSNode);
+  void *streamed_node_payload;
+
+  // A parse with an event handler streams its nodes in the same way, but
+  // reports them as events instead of as nodes, and leaves the document's tree
+  // as it was.
+  TSParseEventHandler event_handler;
+
+  // A parse with a tree builder also leaves the document's tree as it was,
+  // since the caller builds their own. It doesn't stream its nodes.
+  TSTreeBuilder tree_builder;
 } TSParseOptions;
 
-void ts_document_parse_with_options(TSDocument *, TSParseOptions);
+typedef struct {
+  uint32_t peak_version_count;
+  uint32_t prune_count;
+  uint32_t pruned_version_count;
+  uint32_t reused_tree_count;
+  uint32_t reused_byte_count;
+  uint32_t changed_tree_rejection_count;
+  uint32_t fragile_tree_rejection_count;
+  uint32_t external_scanner_state_rejection_count;
+  uint32_t first_leaf_rejection_count;
+  uint32_t other_rejection_count;
+  uint32_t lexed_token_count;
+  uint32_t recovery_step_count;
+  uint32_t limited_recovery_count;
+  uint32_t max_summary_depth;
+  bool exceeded_memory_limit;
+  bool exceeded_max_error_cost;
+  bool blocked_on_input;
+} TSParseStats;
+
+typedef struct {
+  uint32_t count;
+  uint64_t micros;
+} TSParsePhaseProfile;
+
+typedef struct {
+  TSParsePhaseProfile lex;
+  TSParsePhaseProfile shift;
+  TSParsePhaseProfile reduce;
+  TSParsePhaseProfile recover;
+  TSParsePhaseProfile condense;
+
+  // The calls into the external scanner happen while lexing, so their time is
+  // also part of the time spent lexing. A scanner's calls to `get_column`
+  // rescan the current line whenever the column isn't already known.
+  TSParsePhaseProfile external_scan;
+  TSParsePhaseProfile external_serialize;
+  TSParsePhaseProfile external_deserialize;
+  uint32_t column_rescan_count;
+  uint64_t column_rescan_byte_count;
+
+  uint32_t step_count;
+  uint32_t max_version_count;
+  uint64_t total_version_count;
+} TSParseProfile;
+
+typedef struct {
+  uint32_t entry_count;
+  uint32_t split_count;
+  uint32_t reduction_count;
+} TSParseStateProfile;
+
+typedef struct {
+  const TSParseStateProfile *parse_states;
+  uint32_t parse_state_count;
+  const uint32_t *lex_state_entry_counts;
+  uint32_t lex_state_count;
+  const uint32_t *symbol_reduction_counts;
+  uint32_t symbol_count;
+} TSStateProfile;
+
+bool ts_document_parse_with_options(TSDocument *, TSParseOptions);
+bool ts_document_parse_with_parser(TSDocument *, TSParser *, TSParseOptions);
+TSParseStats ts_document_parse_stats(const TSDocument *);
+TSParseProfile ts_document_parse_profile(const TSDocument *);
+TSStateProfile ts_document_state_profile(const TSDocument *);
+void ts_document_set_trace_capacity(TSDocument *, uint32_t);
+uint32_t ts_document_drain_trace(TSDocument *, TSTraceEvent *, uint32_t, uint32_t *dropped_count);
+bool ts_document_has_unfinished_parse(const TSDocument *);
+TSNode ts_document_provisional_root_node(const TSDocument *);
+
+typedef struct {
+  size_t tree_bytes;
+  size_t free_tree_bytes;
+  size_t stack_bytes;
+} TSMemoryUsage;
+
+TSMemoryUsage ts_document_memory_usage(const TSDocument *);
+
+typedef struct {
+  uint32_t node_count;
+  uint32_t leaf_count;
+  uint32_t max_depth;
+  uint32_t error_count;
+  uint32_t missing_count;
+  uint32_t error_cost;
+  size_t external_token_state_bytes;
+  TSMemoryUsage memory_usage;
+} TSTreeStats;
+
+TSTreeStats ts_document_tree_stats(const TSDocument *);
+void ts_document_compact(TSDocument *);
+
+// Give back the memory that the document and its parser keep for later parses,
+// such as freed trees and stack nodes, and the room reserved in their arrays,
+// as when the document goes idle. Compacting the document first lets more of
+// its memory be given back.
+void ts_document_trim_memory(TSDocument *);
+void ts_document_start_background_parse(TSDocument *, TSParseOptions);
+bool ts_document_finish_background_parse(TSDocument *);
+TSNode ts_document_acquire_root_node(TSDocument *);
+void ts_document_release_root_node(TSDocument *, TSNode);
+TSDocumentSnapshot *ts_document_snapshot(TSDocument *);
+TSNode ts_document_snapshot_root_node(const TSDocumentSnapshot *);
+void ts_document_snapshot_delete(TSDocumentSnapshot *);
+char *ts_document_serialize(const TSDocument *, uint32_t *length);
+bool ts_document_deserialize(TSDocument *, const char *, uint32_t length);
+
+typedef struct {
+  void *payload;
+  const char *(*load)(void *payload, uint64_t key, uint32_t *length);
+  void (*release)(void *payload, const char *data, uint32_t length);
+  void (*store)(void *payload, uint64_t key, const char *data, uint32_t length);
+} TSParseCache;
+
+void ts_document_set_parse_cache(TSDocument *, TSParseCache);
+TSParseCache ts_parse_cache_directory_new(const char *path);
+void ts_parse_cache_directory_delete(TSParseCache);
 
 void ts_document_invalidate(TSDocument *);
 TSNode ts_document_root_node(const TSDocument *);
+TSNode ts_document_node_for_id(TSDocument *, TSNodeId);
+TSNode ts_document_node_parent(TSDocument *, TSNode);
 uint32_t ts_document_parse_count(const TSDocument *);
+TSPoint ts_document_point_for_byte(TSDocument *, uint32_t);
+uint32_t ts_document_byte_for_point(TSDocument *, TSPoint);
+bool ts_document_token_for_byte(TSDocument *, uint32_t, TSToken *);
+bool ts_document_token_for_point(TSDocument *, TSPoint, TSToken *);
+
+// Record the document's edits from now on, forgetting any recorded earlier, so
+// that positions taken before them, such as those of nodes from an older tree,
+// can be translated into positions in the current text. Translating a position
+// takes time logarithmic in the number of edited regions, and a sorted array of
+// positions can be translated in a single pass. A position inside text that was
+// removed is moved to the start of its replacement, and `false` is returned.
+void ts_document_start_edit_log(TSDocument *);
+void ts_document_stop_edit_log(TSDocument *);
+bool ts_document_translate_position(const TSDocument *, uint32_t *byte, TSPoint *point);
+void ts_document_translate_positions(const TSDocument *, uint32_t *bytes, TSPoint *points,
+                                     uint32_t count);
+
+typedef struct {
+  void *payload;
+  void *(*malloc)(void *payload, size_t size);
+  void *(*calloc)(void *payload, size_t count, size_t size);
+  void *(*realloc)(void *payload, void *buffer, size_t size);
+  void (*free)(void *payload, void *buffer);
+} TSAllocator;
+
+void ts_set_allocator(TSAllocator);
+
+TSParser *ts_parser_new();
+void ts_parser_delete(TSParser *);
+void ts_parser_trim_memory(TSParser *);
+
+typedef struct {
+  const TSLanguage *language;
+  TSInput input;
+} TSParseJob;
+
+typedef void (*TSParseJobCallback)(void *payload, uint32_t job_index, TSDocument *);
+
+uint32_t ts_parse_batch(const TSParseJob *, uint32_t, TSParseOptions, TSParseJobCallback, void *);
 
 uint32_t ts_language_symbol_count(const TSLanguage *);
 const char *ts_language_symbol_name(const TSLanguage *, TSSymbol);
+TSSymbol ts_language_symbol_for_name(const TSLanguage *, const char *, uint32_t length, bool is_named);
 TSSymbolType ts_language_symbol_type(const TSLanguage *, TSSymbol);
 uint32_t ts_language_version(const TSLanguage *);
+const TSLanguage *ts_language_load(const char *, uint32_t length);
+void ts_language_delete(const TSLanguage *);
+
+TSLanguageRegistry *ts_language_registry_new();
+void ts_language_registry_delete(TSLanguageRegistry *);
+bool ts_language_registry_add_function(TSLanguageRegistry *, const char *name, const TSLanguage *(*)(void));
+bool ts_language_registry_add_binary(TSLanguageRegistry *, const char *name, const char *, uint32_t length);
+bool ts_language_registry_add_binary_file(TSLanguageRegistry *, const char *name, const char *path);
+bool ts_language_registry_add_file_extension(TSLanguageRegistry *, const char *name, const char *extension);
+const TSLanguage *ts_language_registry_language(TSLanguageRegistry *, const char *name);
+const TSLanguage *ts_language_registry_language_for_path(TSLanguageRegistry *, const char *path);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,284 @@
+#ifndef TREE_SITTER_RUNTIME_CPP_H_
+#define TREE_SITTER_RUNTIME_CPP_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "tree_sitter/runtime.h"
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>) && __has_include(<stop_token>)
+#include <coroutine>
+#include <stop_token>
+#define TREE_SITTER_HAS_COROUTINES
+#endif
+
+namespace tree_sitter {
+
+// An owner of one of the runtime's objects, which frees the object when it is
+// destroyed. It can be moved but not copied. The object itself is available
+// through `get`, for use with the rest of the C API.
+template <typename T, void (*Delete)(T *)>
+class Handle {
+  T *pointer;
+
+ public:
+  explicit Handle(T *pointer = nullptr) : pointer(pointer) {}
+  Handle(Handle &&other) noexcept : pointer(other.release()) {}
+  Handle(const Handle &) = delete;
+  ~Handle() { reset(); }
+
+  Handle &operator=(Handle &&other) noexcept {
+    reset(other.release());
+    return *this;
+  }
+
+  Handle &operator=(const Handle &) = delete;
+  explicit operator bool() const { return pointer != nullptr; }
+  T *get() const { return pointer; }
+
+  T *release() {
+    T *result = pointer;
+    pointer = nullptr;
+    return result;
+  }
+
+  void reset(T *new_pointer = nullptr) {
+    if (pointer) Delete(pointer);
+    pointer = new_pointer;
+  }
+};
+
+class Document : public Handle<TSDocument, ts_document_free> {
+ public:
+  Document() : Handle(ts_document_new()) {}
+
+  const TSLanguage *language() const { return ts_document_language(get()); }
+  void set_language(const TSLanguage *language) { ts_document_set_language(get(), language); }
+
+  // The text isn't copied, so it must outlive the document's use of it.
+  void set_input_string(const std::string &text) {
+    ts_document_set_input_string_with_length(get(), text.data(), text.size());
+  }
+
+  void parse() { ts_document_parse(get()); }
+  bool parse(const TSParseOptions &options) { return ts_document_parse_with_options(get(), options); }
+  TSNode root_node() const { return ts_document_root_node(get()); }
+};
+
+// A parse that is spread across calls, each of which parses for a limited
+// time, so that the caller can do other work in between. Unless the options
+// limit each call's time or number of bytes, each call parses for about a
+// millisecond. The document's tree is only replaced once the parse is done.
+// A parse that is cancelled through the options' cancellation flag stops at
+// the end of its current call, and can be resumed by the document's next
+// parse, like any other cancelled parse.
+class SlicedParse {
+  TSDocument *document;
+  TSParseOptions options;
+  bool is_done;
+
+ public:
+  static const uint64_t DEFAULT_SLICE_MICROS = 1000;
+
+  explicit SlicedParse(Document &document, TSParseOptions options = TSParseOptions())
+      : document(document.get()), options(options), is_done(false) {
+    if (this->options.timeout_micros == 0 && this->options.max_bytes_per_call == 0) {
+      this->options.timeout_micros = DEFAULT_SLICE_MICROS;
+    }
+  }
+
+  // Parse one more slice, and return whether the parse is done.
+  bool step() {
+    if (!is_done && !is_cancelled()) is_done = ts_document_parse_with_options(document, options);
+    return is_done;
+  }
+
+  bool done() const { return is_done; }
+
+  bool is_cancelled() const {
+    return !is_done && options.cancellation_flag && *options.cancellation_flag;
+  }
+
+  TSParseOptions &parse_options() { return options; }
+};
+
+class Parser : public Handle<TSParser, ts_parser_delete> {
+ public:
+  Parser() : Handle(ts_parser_new()) {}
+};
+
+class TreeCursor : public Handle<TSTreeCursor, ts_tree_cursor_delete> {
+ public:
+  explicit TreeCursor(TSNode node) : Handle(ts_tree_cursor_new(node)) {}
+
+  bool goto_first_child() { return ts_tree_cursor_goto_first_child(get()); }
+  bool goto_next_sibling() { return ts_tree_cursor_goto_next_sibling(get()); }
+  bool goto_parent() { return ts_tree_cursor_goto_parent(get()); }
+  TSNode current_node() const { return ts_tree_cursor_current_node(get()); }
+};
+
+// A function to call for the nodes of one type, which is given by its name in
+// the grammar, and by whether it is named.
+template <typename Function>
+struct NodeHandler {
+  const char *type;
+  bool is_named;
+  Function function;
+};
+
+template <typename Function>
+NodeHandler<Function> on(const char *type, Function function) {
+  return {type, true, std::move(function)};
+}
+
+template <typename Function>
+NodeHandler<Function> on_anonymous(const char *type, Function function) {
+  return {type, false, std::move(function)};
+}
+
+// A visitor calls the handler for each node's type as it walks a tree. The
+// handlers are matched with the language's symbols once, when the visitor is
+// made, so visiting a node only indexes a table by its symbol, and then
+// calls through a table of functions, each of which calls its handler
+// directly. Several symbols can share a name, and all of them are matched. A
+// type that the language doesn't have is ignored, and when two handlers are
+// given for the same type, the first one is used.
+template <typename... Functions>
+class Visitor {
+  static_assert(sizeof...(Functions) > 0, "A visitor needs at least one handler");
+
+  std::tuple<Functions...> functions;
+  std::vector<uint16_t> handler_ids;
+
+  template <size_t index>
+  static void call(Visitor *self, TSNode node) {
+    std::get<index>(self->functions)(node);
+  }
+
+  template <size_t... indices>
+  void dispatch(uint16_t handler_id, TSNode node, std::index_sequence<indices...>) {
+    static void (*const calls[])(Visitor *, TSNode) = {&Visitor::call<indices>...};
+    calls[handler_id](this, node);
+  }
+
+ public:
+  Visitor(const TSLanguage *language, NodeHandler<Functions>... handlers)
+      : functions(std::move(handlers.function)...),
+        handler_ids(ts_language_symbol_count(language), 0) {
+    const char *types[] = {handlers.type...};
+    bool is_named[] = {handlers.is_named...};
+    for (TSSymbol symbol = 0; symbol < handler_ids.size(); symbol++) {
+      TSSymbolType symbol_type = ts_language_symbol_type(language, symbol);
+      if (symbol_type == TSSymbolTypeAuxiliary) continue;
+      const char *name = ts_language_symbol_name(language, symbol);
+      for (uint16_t i = 0; i < sizeof...(Functions); i++) {
+        if (is_named[i] == (symbol_type == TSSymbolTypeRegular) && std::strcmp(types[i], name) == 0) {
+          handler_ids[symbol] = i + 1;
+          break;
+        }
+      }
+    }
+  }
+
+  void visit(TSNode node) {
+    TSSymbol symbol = ts_node_symbol(node);
+    uint16_t handler_id = symbol < handler_ids.size() ? handler_ids[symbol] : 0;
+    if (handler_id) dispatch(handler_id - 1, node, std::index_sequence_for<Functions...>());
+  }
+
+  // Visit the node and each of its descendants, in the order in which they
+  // start, using a cursor rather than a node's children.
+  void walk(TSNode node) {
+    TreeCursor cursor(node);
+    for (;;) {
+      visit(cursor.current_node());
+      if (cursor.goto_first_child()) continue;
+      while (!cursor.goto_next_sibling()) {
+        if (!cursor.goto_parent()) return;
+      }
+    }
+  }
+};
+
+template <typename... Functions>
+Visitor<Functions...> make_visitor(const TSLanguage *language, NodeHandler<Functions>... handlers) {
+  return Visitor<Functions...>(language, std::move(handlers)...);
+}
+
+#ifdef TREE_SITTER_HAS_COROUTINES
+
+// Awaiting a parse runs it in slices, without blocking the awaiting
+// coroutine's thread in between. Each slice is handed to the scheduler as a
+// callable, which should run it later, for example by posting it to an
+// executor, so that other tasks get to run between the slices. The coroutine
+// is resumed from the last slice, and the result of the await is whether the
+// parse is done. Requesting a stop through the stop token cancels the parse
+// within its current slice, and the await's result is then false. The
+// awaitable refers to itself while the parse runs, so it can't be moved.
+template <typename Scheduler>
+class ParseAwaitable {
+  SlicedParse parse;
+  Scheduler scheduler;
+  std::stop_token stop_token;
+  volatile bool is_cancelled;
+
+  struct Cancel {
+    ParseAwaitable *self;
+    void operator()() { self->is_cancelled = true; }
+  };
+
+  // The stop callback is only registered while a slice runs, because resuming
+  // the coroutine can destroy the awaitable.
+  void run_slice(std::coroutine_handle<> handle) {
+    bool is_finished;
+    {
+      std::stop_callback<Cancel> stop_callback(stop_token, Cancel{this});
+      is_finished = parse.step() || parse.is_cancelled();
+    }
+    if (is_finished) {
+      handle.resume();
+    } else {
+      scheduler([this, handle]() { run_slice(handle); });
+    }
+  }
+
+ public:
+  ParseAwaitable(Document &document, Scheduler scheduler, std::stop_token stop_token,
+                 TSParseOptions options)
+      : parse(document, options),
+        scheduler(std::move(scheduler)),
+        stop_token(std::move(stop_token)),
+        is_cancelled(this->stop_token.stop_requested()) {
+    parse.parse_options().cancellation_flag = &is_cancelled;
+  }
+
+  ParseAwaitable(const ParseAwaitable &) = delete;
+  ParseAwaitable &operator=(const ParseAwaitable &) = delete;
+
+  bool await_ready() const { return parse.done() || parse.is_cancelled(); }
+
+  void await_suspend(std::coroutine_handle<> handle) {
+    scheduler([this, handle]() { run_slice(handle); });
+  }
+
+  bool await_resume() const { return parse.done(); }
+};
+
+// The options' cancellation flag is replaced by one that follows the stop
+// token.
+template <typename Scheduler>
+ParseAwaitable<Scheduler> parse_async(Document &document, Scheduler scheduler,
+                                      std::stop_token stop_token = {},
+                                      TSParseOptions options = TSParseOptions()) {
+  return ParseAwaitable<Scheduler>(document, std::move(scheduler), std::move(stop_token), options);
+}
+
+#endif
+
+}  // namespace tree_sitter
+
+#endif  // TREE_SITTER_RUNTIME_CPP_H_
@@ -20,7 +20,12 @@
         'src/compiler/build_tables/parse_table_builder.cc',
         'src/compiler/build_tables/rule_can_be_blank.cc',
         'src/compiler/compile.cc',
+        'src/compiler/compile_cache.cc',
+        'src/compiler/generate_code/binary_language.cc',
         'src/compiler/generate_code/c_code.cc',
+        'src/compiler/generate_code/conflict_report.cc',
+        'src/compiler/generate_code/keyword_table_encoding.cc',
+        'src/compiler/generate_code/lex_table_encoding.cc',
         'src/compiler/lex_table.cc',
         'src/compiler/parse_grammar.cc',
         'src/compiler/parse_table.cc',
@@ -74,6 +79,11 @@
               'CLANG_CXX_LIBRARY': 'libc++',
             },
           },
+        }],
+        ['OS != "win"', {
+          'link_settings': {
+            'libraries': [ '-lpthread' ],
+          },
         }]
       ],
     },
@@ -87,16 +97,44 @@
         'externals/utf8proc',
       ],
       'sources': [
+        'src/runtime/alloc.c',
+        'src/runtime/batch_parse.c',
+        'src/runtime/binary_language.c',
+        'src/runtime/changed_node_iterator.c',
+        'src/runtime/chunked_input.c',
         'src/runtime/document.c',
+        'src/runtime/edit_log.c',
+        'src/runtime/file_input.c',
+        'src/runtime/frozen_tree.c',
         'src/runtime/get_changed_ranges.c',
+        'src/runtime/input_prefetcher.c',
+        'src/runtime/keyword_table.c',
         'src/runtime/language.c',
+        'src/runtime/language_registry.c',
+        'src/runtime/leaf_index.c',
+        'src/runtime/lex_table.c',
         'src/runtime/lexer.c',
+        'src/runtime/line_index.c',
         'src/runtime/node.c',
+        'src/runtime/node_index.c',
+        'src/runtime/parallel_parser.c',
+        'src/runtime/parse_cache.c',
+        'src/runtime/pattern_set.c',
+        'src/runtime/scope_iterator.c',
         'src/runtime/stack.c',
         'src/runtime/parser.c',
         'src/runtime/string_input.c',
+        'src/runtime/symbol_iterator.c',
+        'src/runtime/text_diff.c',
+        'src/runtime/token_iterator.c',
         'src/runtime/tree.c',
+        'src/runtime/tree_builder.c',
+        'src/runtime/tree_cursor.c',
+        'src/runtime/tree_diff.c',
+        'src/runtime/tree_export.c',
+        'src/runtime/tree_serialization.c',
         'src/runtime/utf16.c',
+        'src/runtime/work_range.c',
         'externals/utf8proc/utf8proc.c',
       ],
       'cflags_c': [
@@ -110,6 +148,13 @@
           'include'
         ],
       },
+      'conditions': [
+        ['OS != "win"', {
+          'link_settings': {
+            'libraries': [ '-lpthread' ],
+          },
+        }]
+      ],
     },
   ],
 
@@ -134,6 +179,16 @@
           'OTHER_CPLUSPLUSFLAGS': ['-fsanitize=address'],
         },
       },
+      'TestThreads': {
+        'defines': ['TREE_SITTER_WRAP_MALLOC=true', 'TREE_SITTER_ATOMIC_REF_COUNTS'],
+        'cflags': [ '-g', '-O1', '-fsanitize=thread' ],
+        'ldflags': [ '-g', '-fsanitize=thread' ],
+        'xcode_settings': {
+          'OTHER_CFLAGS': ['-fsanitize=thread'],
+          'OTHER_LDFLAGS': ['-g', '-fsanitize=thread'],
+          'GCC_OPTIMIZATION_LEVEL': '1',
+        },
+      },
       'Fuzz': {
         'cflags': ['<!@(echo $CFLAGS)'],
         'ldflags': ['<!@(echo $CFLAGS)'],
@@ -1,9 +1,13 @@
 #include "compiler/build_tables/lex_table_builder.h"
+#include <algorithm>
+#include <atomic>
 #include <climits>
 #include <map>
 #include <set>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <cwctype>
 #include <vector>
@@ -24,6 +28,7 @@ using std::set;
 using std::string;
 using std::vector;
 using std::unordered_map;
+using std::unordered_set;
 using std::unique_ptr;
 using rules::Rule;
 using rules::Blank;
@@ -34,6 +39,8 @@ using rules::Symbol;
 using rules::Metadata;
 using rules::Seq;
 
+static const size_t MIN_STATES_PER_THREAD = 16;
+
 template <bool include_all>
 class StartOrEndCharacterAggregator {
  public:
@@ -63,6 +70,25 @@ class StartOrEndCharacterAggregator {
 using StartingCharacterAggregator = StartOrEndCharacterAggregator<false>;
 using AllCharacterAggregator = StartOrEndCharacterAggregator<true>;
 
+// Decompose a token that matches a fixed number of characters, such as a string,
+// into the set of characters that can occur at each position.
+class CharacterSequenceAggregator {
+ public:
+  bool apply(const Rule &rule) {
+    return rule.match(
+      [this](const Seq &sequence) { return apply(*sequence.left) && apply(*sequence.right); },
+      [this](const CharacterSet &rule) {
+        result.push_back(rule);
+        return true;
+      },
+      [](const Blank &) { return true; },
+      [](auto) { return false; }
+    );
+  }
+
+  vector<CharacterSet> result;
+};
+
 class LexTableBuilderImpl : public LexTableBuilder {
   LexTable main_lex_table;
   LexTable keyword_lex_table;
@@ -73,24 +99,32 @@ class LexTableBuilderImpl : public LexTableBuilder {
   CharacterSet separator_start_characters;
   vector<CharacterSet> starting_characters_by_token;
   vector<CharacterSet> following_characters_by_token;
+  vector<vector<CharacterSet>> character_sequences_by_token;
+  vector<bool> has_character_sequence_by_token;
   const vector<LookaheadSet> &coincident_tokens_by_token;
   vector<ConflictStatus> conflict_matrix;
   bool conflict_detection_mode;
   LookaheadSet keyword_symbols;
   Symbol keyword_capture_token;
+  unordered_map<LexItemSet, LexItemSet::TransitionMap> transitions_by_item_set;
+  unsigned thread_count;
 
  public:
   LexTableBuilderImpl(const SyntaxGrammar &syntax_grammar,
                       const LexicalGrammar &lexical_grammar,
                       const unordered_map<Symbol, LookaheadSet> &following_tokens_by_token,
-                      const vector<LookaheadSet> &coincident_tokens)
+                      const vector<LookaheadSet> &coincident_tokens,
+                      unsigned thread_count)
     : grammar(lexical_grammar),
       starting_characters_by_token(lexical_grammar.variables.size()),
       following_characters_by_token(lexical_grammar.variables.size()),
+      character_sequences_by_token(lexical_grammar.variables.size()),
+      has_character_sequence_by_token(lexical_grammar.variables.size()),
       coincident_tokens_by_token(coincident_tokens),
       conflict_matrix(lexical_grammar.variables.size() * lexical_grammar.variables.size(), DoesNotMatch),
       conflict_detection_mode(false),
-      keyword_capture_token(rules::NONE()) {
+      keyword_capture_token(rules::NONE()),
+      thread_count(thread_count) {
 
     // Compute the possible separator rules and the set of separator characters that can occur
     // immediately after any token.
@@ -109,6 +143,12 @@ class LexTableBuilderImpl : public LexTableBuilder {
       starting_character_aggregator.apply(grammar.variables[i].rule);
       starting_characters_by_token[i] = starting_character_aggregator.result;
 
+      CharacterSequenceAggregator sequence_aggregator;
+      if (sequence_aggregator.apply(grammar.variables[i].rule)) {
+        has_character_sequence_by_token[i] = true;
+        character_sequences_by_token[i] = move(sequence_aggregator.result);
+      }
+
       StartingCharacterAggregator following_character_aggregator;
       const auto &following_tokens = following_tokens_by_token.find(Symbol::terminal(i));
       if (following_tokens != following_tokens_by_token.end()) {
@@ -122,9 +162,11 @@ class LexTableBuilderImpl : public LexTableBuilder {
         AllCharacterAggregator aggregator;
         aggregator.apply(grammar.variables[i].rule);
         bool all_alpha = true, all_lower = true;
-        for (auto character : aggregator.result.included_chars) {
-          if (!iswalpha(character) && character != '_') all_alpha = false;
-          if (!iswlower(character)) all_lower = false;
+        for (const auto &range : aggregator.result.included_ranges()) {
+          for (uint32_t character = range.min; character <= range.max; character++) {
+            if (!iswalpha(character) && character != '_') all_alpha = false;
+            if (!iswlower(character)) all_lower = false;
+          }
         }
 
         if (all_lower) {
@@ -154,9 +196,10 @@ class LexTableBuilderImpl : public LexTableBuilder {
     conflict_detection_mode = true;
     for (Symbol::Index i = 0, n = grammar.variables.size(); i < n; i++) {
       for (Symbol::Index j = 0; j < i; j++) {
-        if (starting_characters_by_token[i].intersects(starting_characters_by_token[j]) ||
-            starting_characters_by_token[i].intersects(separator_start_characters) ||
-            starting_characters_by_token[j].intersects(separator_start_characters)) {
+        if (starting_characters_by_token[i].intersects(separator_start_characters) ||
+            starting_characters_by_token[j].intersects(separator_start_characters) ||
+            (starting_characters_by_token[i].intersects(starting_characters_by_token[j]) &&
+             !character_sequences_diverge(i, j))) {
           clear();
           add_lex_state(main_lex_table, item_set_for_terminals(LookaheadSet({
             Symbol::terminal(i),
@@ -236,17 +279,28 @@ class LexTableBuilderImpl : public LexTableBuilder {
       if (!did_merge) starting_token_sets.push_back({token_set, {&parse_state}});
     }
 
+    vector<LexItemSet> starting_item_sets;
     for (auto &pair : starting_token_sets) {
-      LexStateId state_id = add_lex_state(main_lex_table, item_set_for_terminals(pair.first, true));
-      for (ParseState *parse_state : pair.second) {
+      starting_item_sets.push_back(item_set_for_terminals(pair.first, true));
+    }
+    LexItemSet keyword_item_set = item_set_for_terminals(keyword_symbols, false);
+    starting_item_sets.push_back(keyword_item_set);
+    if (thread_count > 1) compute_transitions(starting_item_sets);
+
+    for (size_t i = 0; i < starting_token_sets.size(); i++) {
+      LexStateId state_id = add_lex_state(main_lex_table, starting_item_sets[i]);
+      for (ParseState *parse_state : starting_token_sets[i].second) {
         parse_state->lex_state_id = state_id;
       }
     }
 
-    add_lex_state(keyword_lex_table, item_set_for_terminals(keyword_symbols, false));
+    add_lex_state(keyword_lex_table, keyword_item_set);
+    transitions_by_item_set.clear();
 
     mark_fragile_tokens(parse_table);
     remove_duplicate_lex_states(main_lex_table, parse_table);
+    minimize_lex_table(main_lex_table, parse_table);
+    minimize_lex_table(keyword_lex_table, nullptr);
     return {main_lex_table, keyword_lex_table, keyword_capture_token};
   }
 
@@ -260,6 +314,68 @@ class LexTableBuilderImpl : public LexTableBuilder {
   }
 
  private:
+  // If two tokens each match a fixed sequence of characters, and the sequences
+  // differ at some position before either one ends, then neither token can
+  // match a prefix of the other, and they can't conflict.
+  bool character_sequences_diverge(Symbol::Index i, Symbol::Index j) const {
+    if (!has_character_sequence_by_token[i] || !has_character_sequence_by_token[j]) return false;
+    const vector<CharacterSet> &sequence = character_sequences_by_token[i];
+    const vector<CharacterSet> &other_sequence = character_sequences_by_token[j];
+    for (size_t k = 0, n = std::min(sequence.size(), other_sequence.size()); k < n; k++) {
+      if (!sequence[k].intersects(other_sequence[k])) return true;
+    }
+    return false;
+  }
+
+  // Computing an item set's transitions is most of the work of building a lex
+  // table, and it doesn't depend on the rest of the table. So before the
+  // states are added, the transitions of every item set that is reachable
+  // from the starting item sets are computed, one frontier at a time, possibly
+  // on several threads. The states are then added one by one as before, so
+  // they are numbered the same way regardless of the number of threads.
+  // Transitions that a state ends up not taking, because it accepts a token
+  // with a higher precedence, are still followed here. With a single thread,
+  // this would only hold every transition in memory at once, so it is skipped,
+  // and each state's transitions are computed when the state is added.
+  void compute_transitions(const vector<LexItemSet> &starting_item_sets) {
+    vector<const LexItemSet *> frontier;
+    unordered_set<LexItemSet> queued_item_sets;
+    for (const LexItemSet &item_set : starting_item_sets) {
+      if (queued_item_sets.insert(item_set).second) frontier.push_back(&item_set);
+    }
+
+    while (!frontier.empty()) {
+      vector<LexItemSet::TransitionMap> transitions(frontier.size());
+      size_t worker_count = std::min<size_t>(thread_count, frontier.size() / MIN_STATES_PER_THREAD);
+      if (worker_count <= 1) {
+        for (size_t i = 0; i < frontier.size(); i++) {
+          transitions[i] = frontier[i]->transitions();
+        }
+      } else {
+        std::atomic<size_t> next_index(0);
+        auto run_worker = [&]() {
+          for (size_t i = next_index++; i < frontier.size(); i = next_index++) {
+            transitions[i] = frontier[i]->transitions();
+          }
+        };
+        vector<std::thread> workers;
+        for (size_t i = 1; i < worker_count; i++) workers.emplace_back(run_worker);
+        run_worker();
+        for (std::thread &worker : workers) worker.join();
+      }
+
+      vector<const LexItemSet *> next_frontier;
+      for (size_t i = 0; i < frontier.size(); i++) {
+        auto insertion = transitions_by_item_set.emplace(*frontier[i], move(transitions[i]));
+        for (const auto &pair : insertion.first->second) {
+          const LexItemSet &destination = pair.second.destination;
+          if (queued_item_sets.insert(destination).second) next_frontier.push_back(&destination);
+        }
+      }
+      frontier = move(next_frontier);
+    }
+  }
+
   void record_conflict(Symbol shadowed_token, Symbol other_token, ConflictStatus status) {
     unsigned index = shadowed_token.index * grammar.variables.size() + other_token.index;
     conflict_matrix[index] = static_cast<ConflictStatus>(conflict_matrix[index] | status);
@@ -283,7 +399,16 @@ class LexTableBuilderImpl : public LexTableBuilder {
   }
 
   void add_advance_actions(LexTable &lex_table, const LexItemSet &item_set, LexStateId state_id) {
-    for (const auto &pair : item_set.transitions()) {
+    LexItemSet::TransitionMap computed_transitions;
+    const LexItemSet::TransitionMap *transitions = &computed_transitions;
+    auto cached_transitions = transitions_by_item_set.find(item_set);
+    if (cached_transitions != transitions_by_item_set.end()) {
+      transitions = &cached_transitions->second;
+    } else {
+      computed_transitions = item_set.transitions();
+    }
+
+    for (const auto &pair : *transitions) {
       const CharacterSet &characters = pair.first;
       const LexItemSet::Transition &transition = pair.second;
 
@@ -347,11 +472,8 @@ class LexTableBuilderImpl : public LexTableBuilder {
       for (auto &entry : state.terminal_entries) {
         Symbol token = entry.first;
         if (token.is_external() || token.is_built_in()) continue;
-        for (unsigned i = 0; i < grammar.variables.size(); i++) {
-          Symbol other_token = Symbol::terminal(i);
-          ConflictStatus status = get_conflict_status(token, other_token);
-          if (status != ConflictStatus::DoesNotMatch &&
-              state.terminal_entries.count(other_token)) {
+        for (const auto &other_entry : state.terminal_entries) {
+          if (get_conflict_status(token, other_entry.first) != ConflictStatus::DoesNotMatch) {
             entry.second.reusable = false;
             break;
           }
@@ -451,26 +573,100 @@ class LexTableBuilderImpl : public LexTableBuilder {
     }
   }
 
+  // Merge all of the states that accept the same tokens on the same input, by
+  // repeatedly splitting a partition of the states, which initially groups the
+  // states by the token that they accept. Precedence has already been used to
+  // choose each state's accept action, so it doesn't need to be considered
+  // here. In each round, states stay in the same group only if, for every
+  // character, they advance or skip into the same group. Unlike
+  // `remove_duplicate_lex_states`, this finds states that are equivalent
+  // because they transition into each other.
+  void minimize_lex_table(LexTable &lex_table, ParseTable *parse_table) {
+    using Signature = pair<size_t, map<pair<size_t, bool>, CharacterSet>>;
+
+    vector<size_t> group_ids;
+    map<Symbol, size_t> group_ids_by_symbol;
+    for (const LexState &state : lex_table.states) {
+      auto insertion = group_ids_by_symbol.insert({state.accept_action.symbol, group_ids_by_symbol.size()});
+      group_ids.push_back(insertion.first->second);
+    }
+
+    size_t group_count = group_ids_by_symbol.size();
+    while (true) {
+      map<Signature, size_t> group_ids_by_signature;
+      vector<size_t> new_group_ids;
+      for (LexStateId i = 0, n = lex_table.states.size(); i < n; i++) {
+        Signature signature{group_ids[i], {}};
+        for (const auto &entry : lex_table.states[i].advance_actions) {
+          if (entry.first.is_empty()) continue;
+          pair<size_t, bool> destination{group_ids[entry.second.state_index], entry.second.in_main_token};
+          signature.second[destination].add_set(entry.first);
+        }
+        auto insertion = group_ids_by_signature.insert({signature, group_ids_by_signature.size()});
+        new_group_ids.push_back(insertion.first->second);
+      }
+
+      group_ids = move(new_group_ids);
+      if (group_ids_by_signature.size() == group_count) break;
+      group_count = group_ids_by_signature.size();
+    }
+
+    if (group_count == lex_table.states.size()) return;
+
+    // Number the groups in the order of their first states, so that the
+    // first state remains the start state of the keyword lex table.
+    map<size_t, LexStateId> new_state_ids_by_group;
+    vector<LexStateId> new_state_ids;
+    vector<LexState> new_states;
+    for (LexStateId i = 0, n = lex_table.states.size(); i < n; i++) {
+      auto insertion = new_state_ids_by_group.insert({group_ids[i], new_states.size()});
+      if (insertion.second) new_states.push_back(lex_table.states[i]);
+      new_state_ids.push_back(insertion.first->second);
+    }
+
+    // Transitions on different characters that now lead to the same state
+    // are combined.
+    for (LexState &state : new_states) {
+      map<CharacterSet, AdvanceAction> advance_actions;
+      map<pair<LexStateId, bool>, CharacterSet> characters_by_destination;
+      map<pair<LexStateId, bool>, AdvanceAction> actions_by_destination;
+      for (const auto &entry : state.advance_actions) {
+        AdvanceAction action = entry.second;
+        action.state_index = new_state_ids[action.state_index];
+        pair<LexStateId, bool> destination{action.state_index, action.in_main_token};
+        characters_by_destination[destination].add_set(entry.first);
+        actions_by_destination.insert({destination, action});
+      }
+      for (const auto &entry : characters_by_destination) {
+        advance_actions.insert({entry.second, actions_by_destination[entry.first]});
+      }
+      state.advance_actions = move(advance_actions);
+    }
+    lex_table.states = move(new_states);
+
+    if (parse_table) {
+      for (ParseState &parse_state : parse_table->states) {
+        parse_state.lex_state_id = new_state_ids[parse_state.lex_state_id];
+      }
+    }
+  }
+
   LexItemSet item_set_for_terminals(const LookaheadSet &terminals, bool with_separators) {
     LexItemSet result;
     terminals.for_each([&](Symbol symbol) {
       if (symbol.is_terminal()) {
         for (auto &&rule : rules_for_symbol(symbol)) {
+          Rule main_token = Metadata::main_token(move(rule));
           if (with_separators) {
             for (const auto &separator_rule : separator_rules) {
               result.entries.insert(LexItem(
                 symbol,
-                Metadata::separator(
-                  Rule::seq({
-                    separator_rule,
-                    Metadata::main_token(move(rule))
-                  })
-                )
+                Metadata::separator(Rule::seq({separator_rule, main_token}))
               ));
             }
           } else {
-           result.entries.insert(LexItem(symbol, Metadata::main_token(move(rule))));
-         }
+            result.entries.insert(LexItem(symbol, main_token));
+          }
         }
       }
       return true;
@@ -516,12 +712,14 @@ class LexTableBuilderImpl : public LexTableBuilder {
 unique_ptr<LexTableBuilder> LexTableBuilder::create(const SyntaxGrammar &syntax_grammar,
                                                     const LexicalGrammar &lexical_grammar,
                                                     const unordered_map<Symbol, LookaheadSet> &following_tokens,
-                                                    const vector<LookaheadSet> &coincident_tokens) {
+                                                    const vector<LookaheadSet> &coincident_tokens,
+                                                    unsigned thread_count) {
   return unique_ptr<LexTableBuilder>(new LexTableBuilderImpl(
     syntax_grammar,
     lexical_grammar,
     following_tokens,
-    coincident_tokens
+    coincident_tokens,
+    thread_count
   ));
 }
 
@@ -35,7 +35,8 @@ class LexTableBuilder {
   static std::unique_ptr<LexTableBuilder> create(const SyntaxGrammar &,
                                                  const LexicalGrammar &,
                                                  const std::unordered_map<rules::Symbol, LookaheadSet> &,
-                                                 const std::vector<LookaheadSet> &);
+                                                 const std::vector<LookaheadSet> &,
+                                                 unsigned thread_count = 0);
 
   struct BuildResult {
     LexTable main_table;
@@ -43,6 +44,8 @@ class LexTableBuilder {
     rules::Symbol keyword_capture_token;
   };
 
+  virtual ~LexTableBuilder() = default;
+
   BuildResult build(ParseTable *);
 
   ConflictStatus get_conflict_status(rules::Symbol, rules::Symbol) const;
@@ -1,7 +1,6 @@
 #include "compiler/build_tables/lookahead_set.h"
-#include <set>
-#include <memory>
 #include "compiler/rule.h"
+#include "compiler/util/hash_combine.h"
 
 namespace tree_sitter {
 namespace build_tables {
@@ -9,6 +8,48 @@ namespace build_tables {
 using std::vector;
 using rules::Symbol;
 
+static unsigned count_bits(uint64_t word) {
+#ifdef _MSC_VER
+  return static_cast<unsigned>(__popcnt64(word));
+#else
+  return __builtin_popcountll(word);
+#endif
+}
+
+// Add the other words' bits to the given words, and return whether any of
+// them weren't already there.
+static bool insert_all_words(vector<uint64_t> *words, const vector<uint64_t> &other_words) {
+  if (other_words.size() > words->size()) {
+    words->resize(other_words.size());
+  }
+
+  uint64_t added_bits = 0;
+  for (size_t i = 0, n = other_words.size(); i < n; i++) {
+    added_bits |= other_words[i] & ~(*words)[i];
+    (*words)[i] |= other_words[i];
+  }
+  return added_bits != 0;
+}
+
+// Remove the other words' bits from the given words, dropping any words at the
+// end that become zero, and return whether any bits were removed.
+static bool remove_all_words(vector<uint64_t> *words, const vector<uint64_t> &other_words) {
+  uint64_t removed_bits = 0;
+  for (size_t i = 0, n = std::min(words->size(), other_words.size()); i < n; i++) {
+    removed_bits |= (*words)[i] & other_words[i];
+    (*words)[i] &= ~other_words[i];
+  }
+  while (!words->empty() && words->back() == 0) words->pop_back();
+  return removed_bits != 0;
+}
+
+static bool words_intersect(const vector<uint64_t> &words, const vector<uint64_t> &other_words) {
+  for (size_t i = 0, n = std::min(words.size(), other_words.size()); i < n; i++) {
+    if (words[i] & other_words[i]) return true;
+  }
+  return false;
+}
+
 LookaheadSet::LookaheadSet() {}
 
 LookaheadSet::LookaheadSet(const vector<Symbol> &symbols) {
@@ -16,106 +57,116 @@ LookaheadSet::LookaheadSet(const vector<Symbol> &symbols) {
 }
 
 bool LookaheadSet::empty() const {
-  return terminal_bits.empty() && external_bits.empty() && !eof;
+  return terminal_words.empty() && external_words.empty() && !eof;
 }
 
 bool LookaheadSet::operator==(const LookaheadSet &other) const {
   return
     eof == other.eof &&
-    external_bits == other.external_bits &&
-    terminal_bits == other.terminal_bits;
+    external_words == other.external_words &&
+    terminal_words == other.terminal_words;
 }
 
 bool LookaheadSet::contains(const Symbol &symbol) const {
   if (symbol == rules::END_OF_INPUT()) return eof;
-  auto &bits = symbol.is_external() ? external_bits : terminal_bits;
-  return bits.size() > static_cast<size_t>(symbol.index) && bits[symbol.index];
+  auto &words = symbol.is_external() ? external_words : terminal_words;
+  size_t word_index = symbol.index / WORD_BITS;
+  return word_index < words.size() && (words[word_index] >> (symbol.index % WORD_BITS)) & 1;
 }
 
 bool LookaheadSet::intersects(const LookaheadSet &other) const {
-  bool result = false;
-  for_each([&](Symbol symbol) {
-    if (other.contains(symbol)) {
-      result = true;
-      return false;
-    }
-    return true;
-  });
-  return result;
+  return
+    (eof && other.eof) ||
+    words_intersect(external_words, other.external_words) ||
+    words_intersect(terminal_words, other.terminal_words);
 }
 
 size_t LookaheadSet::size() const {
-  size_t result = 0;
-  for (bool bit : external_bits) if (bit) result++;
-  for (bool bit : terminal_bits) if (bit) result++;
-  if (eof) result++;
+  size_t result = eof ? 1 : 0;
+  for (Word word : external_words) result += count_bits(word);
+  for (Word word : terminal_words) result += count_bits(word);
   return result;
 }
 
 bool LookaheadSet::insert_all(const LookaheadSet &other) {
   bool result = false;
+  if (other.eof && !eof) {
+    eof = true;
+    result = true;
+  }
+  if (insert_all_words(&external_words, other.external_words)) result = true;
+  if (insert_all_words(&terminal_words, other.terminal_words)) result = true;
+  return result;
+}
 
-  if (other.eof) {
+bool LookaheadSet::insert(const Symbol &symbol) {
+  if (symbol == rules::END_OF_INPUT()) {
     if (!eof) {
       eof = true;
-      result = true;
+      return true;
     }
+    return false;
   }
 
-  if (other.external_bits.size() > external_bits.size()) {
-    external_bits.resize(other.external_bits.size());
-  }
-
-  auto iter = external_bits.begin();
-  auto other_iter = other.external_bits.begin();
-  auto other_end = other.external_bits.end();
-  while (other_iter != other_end) {
-    if (*other_iter && !*iter) {
-      result = true;
-      *iter = true;
-    }
-    ++iter;
-    ++other_iter;
+  auto &words = symbol.is_external() ? external_words : terminal_words;
+  size_t word_index = symbol.index / WORD_BITS;
+  if (words.size() <= word_index) {
+    words.resize(word_index + 1);
   }
-
-  if (other.terminal_bits.size() > terminal_bits.size()) {
-    terminal_bits.resize(other.terminal_bits.size());
+  Word bit = Word(1) << (symbol.index % WORD_BITS);
+  if (!(words[word_index] & bit)) {
+    words[word_index] |= bit;
+    return true;
   }
+  return false;
+}
 
-  iter = terminal_bits.begin();
-  other_iter = other.terminal_bits.begin();
-  other_end = other.terminal_bits.end();
-  while (other_iter != other_end) {
-    if (*other_iter && !*iter) {
-      result = true;
-      *iter = true;
-    }
-    ++iter;
-    ++other_iter;
+bool LookaheadSet::remove_all(const LookaheadSet &other) {
+  bool result = false;
+  if (other.eof && eof) {
+    eof = false;
+    result = true;
   }
-
+  if (remove_all_words(&external_words, other.external_words)) result = true;
+  if (remove_all_words(&terminal_words, other.terminal_words)) result = true;
   return result;
 }
 
-bool LookaheadSet::insert(const Symbol &symbol) {
+bool LookaheadSet::remove(const Symbol &symbol) {
   if (symbol == rules::END_OF_INPUT()) {
-    if (!eof) {
-      eof = true;
+    if (eof) {
+      eof = false;
       return true;
     }
     return false;
   }
 
-  auto &bits = symbol.is_external() ? external_bits : terminal_bits;
-  if (bits.size() <= static_cast<size_t>(symbol.index)) {
-    bits.resize(symbol.index + 1);
-  }
-  if (!bits[symbol.index]) {
-    bits[symbol.index] = true;
-    return true;
-  }
-  return false;
+  auto &words = symbol.is_external() ? external_words : terminal_words;
+  size_t word_index = symbol.index / WORD_BITS;
+  if (word_index >= words.size()) return false;
+  Word bit = Word(1) << (symbol.index % WORD_BITS);
+  if (!(words[word_index] & bit)) return false;
+  words[word_index] &= ~bit;
+  while (!words.empty() && words.back() == 0) words.pop_back();
+  return true;
 }
 
 }  // namespace build_tables
 }  // namespace tree_sitter
+
+namespace std {
+
+using tree_sitter::build_tables::LookaheadSet;
+using tree_sitter::util::hash_combine;
+
+size_t hash<LookaheadSet>::operator()(const LookaheadSet &lookahead_set) const {
+  size_t result = 0;
+  hash_combine(&result, lookahead_set.eof);
+  hash_combine(&result, lookahead_set.external_words.size());
+  for (uint64_t word : lookahead_set.external_words) hash_combine(&result, word);
+  hash_combine(&result, lookahead_set.terminal_words.size());
+  for (uint64_t word : lookahead_set.terminal_words) hash_combine(&result, word);
+  return result;
+}
+
+}  // namespace std
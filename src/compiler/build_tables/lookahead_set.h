@@ -1,16 +1,85 @@
 #ifndef COMPILER_BUILD_TABLES_LOOKAHEAD_SET_H_
 #define COMPILER_BUILD_TABLES_LOOKAHEAD_SET_H_
 
+#include <algorithm>
+#include <cstdint>
+#include <functional>
 #include <vector>
 #include "compiler/rule.h"
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 namespace tree_sitter {
 namespace build_tables {
 
+class LookaheadSet;
+
+}  // namespace build_tables
+}  // namespace tree_sitter
+
+namespace std {
+
+template <>
+struct hash<tree_sitter::build_tables::LookaheadSet> {
+  size_t operator()(const tree_sitter::build_tables::LookaheadSet &) const;
+};
+
+}  // namespace std
+
+namespace tree_sitter {
+namespace build_tables {
+
+// The terminals and the external tokens are each stored as a bitset of 64-bit
+// words. The words are only added when a symbol is inserted into them, so the
+// last word of each bitset is never zero, and two sets with the same symbols
+// have the same words.
 class LookaheadSet {
-  std::vector<bool> terminal_bits;
-  std::vector<bool> external_bits;
+  using Word = uint64_t;
+  static const unsigned WORD_BITS = 64;
+
+  std::vector<Word> terminal_words;
+  std::vector<Word> external_words;
   bool eof = false;
+  friend struct std::hash<LookaheadSet>;
+
+  static unsigned lowest_bit(Word word) {
+#ifdef _MSC_VER
+    unsigned long result;
+    _BitScanForward64(&result, word);
+    return result;
+#else
+    return __builtin_ctzll(word);
+#endif
+  }
+
+  template <typename Callback>
+  static bool for_each_bit(const std::vector<Word> &words, rules::Symbol::Type type,
+                           const Callback &callback) {
+    for (size_t i = 0, n = words.size(); i < n; i++) {
+      for (Word word = words[i]; word; word &= word - 1) {
+        rules::Symbol::Index index = i * WORD_BITS + lowest_bit(word);
+        if (!callback(rules::Symbol{index, type})) return false;
+      }
+    }
+    return true;
+  }
+
+  template <typename Callback>
+  static bool for_each_different_bit(const std::vector<Word> &words, const std::vector<Word> &other_words,
+                                     rules::Symbol::Type type, const Callback &callback) {
+    for (size_t i = 0, n = std::max(words.size(), other_words.size()); i < n; i++) {
+      Word word = i < words.size() ? words[i] : 0;
+      Word other_word = i < other_words.size() ? other_words[i] : 0;
+      for (Word difference = word ^ other_word; difference; difference &= difference - 1) {
+        unsigned bit = lowest_bit(difference);
+        rules::Symbol::Index index = i * WORD_BITS + bit;
+        if (!callback((word >> bit) & 1, rules::Symbol{index, type})) return false;
+      }
+    }
+    return true;
+  }
 
  public:
   LookaheadSet();
@@ -22,88 +91,30 @@ class LookaheadSet {
   bool contains(const rules::Symbol &) const;
   bool insert_all(const LookaheadSet &);
   bool insert(const rules::Symbol &);
+  bool remove_all(const LookaheadSet &);
+  bool remove(const rules::Symbol &);
   bool intersects(const LookaheadSet &) const;
 
   template <typename Callback>
   void for_each(const Callback &callback) const {
-    for (auto begin = external_bits.begin(),
-         end = external_bits.end(),
-         iter = begin;
-         iter != end;
-         ++iter) {
-      if (*iter) {
-        if (!callback(rules::Symbol::external(iter - begin))) return;
-      }
-    }
-
+    if (!for_each_bit(external_words, rules::Symbol::External, callback)) return;
     if (eof) {
       if (!callback(rules::END_OF_INPUT())) return;
     }
-
-    for (auto begin = terminal_bits.begin(),
-         end = terminal_bits.end(),
-         iter = begin;
-         iter != end;
-         ++iter) {
-      if (*iter) {
-        if (!callback(rules::Symbol::terminal(iter - begin))) return;
-      }
-    }
+    for_each_bit(terminal_words, rules::Symbol::Terminal, callback);
   }
 
+  // The callback is given each symbol that is in exactly one of the two sets,
+  // along with whether that set is this one.
   template <typename Callback>
   void for_each_difference(const LookaheadSet &other, const Callback &callback) const {
-    auto end = external_bits.end();
-    auto begin = external_bits.begin();
-    auto other_end = other.external_bits.end();
-    auto other_begin = other.external_bits.begin();
-    auto common_end = other.external_bits.size() < external_bits.size() ?
-      begin + other.external_bits.size() :
-      end;
-    auto iter = begin;
-    auto other_iter = other_begin;
-    for (; iter != common_end; ++iter, ++other_iter) {
-      if (*iter) {
-        if (!*other_iter && !callback(true, rules::Symbol::external(iter - begin))) return;
-      } else if (*other_iter) {
-        if (!callback(false, rules::Symbol::external(iter - begin))) return;
-      }
-    }
-    for (; iter < end; ++iter) {
-      if (*iter && !callback(true, rules::Symbol::external(iter - begin))) return;
-    }
-    for (; other_iter < other_end; ++other_iter) {
-      if (*other_iter && !callback(false, rules::Symbol::external(other_iter - other_begin))) return;
-    }
-
-    if (eof) {
-      if (!other.eof && !callback(true, rules::END_OF_INPUT())) return;
-    } else if (other.eof) {
-      if (!callback(false, rules::END_OF_INPUT())) return;
-    }
-
-    end = terminal_bits.end();
-    begin = terminal_bits.begin();
-    other_end = other.terminal_bits.end();
-    other_begin = other.terminal_bits.begin();
-    common_end = other.terminal_bits.size() < terminal_bits.size() ?
-      begin + other.terminal_bits.size() :
-      end;
-    iter = begin;
-    other_iter = other_begin;
-    for (; iter != common_end; ++iter, ++other_iter) {
-      if (*iter) {
-        if (!*other_iter && !callback(true, rules::Symbol::terminal(iter - begin))) return;
-      } else if (*other_iter) {
-        if (!callback(false, rules::Symbol::terminal(iter - begin))) return;
-      }
-    }
-    for (; iter < end; ++iter) {
-      if (*iter && !callback(true, rules::Symbol::terminal(iter - begin))) return;
+    if (!for_each_different_bit(external_words, other.external_words, rules::Symbol::External, callback)) {
+      return;
     }
-    for (; other_iter < other_end; ++other_iter) {
-      if (*other_iter && !callback(false, rules::Symbol::terminal(other_iter - other_begin))) return;
+    if (eof != other.eof) {
+      if (!callback(eof, rules::END_OF_INPUT())) return;
     }
+    for_each_different_bit(terminal_words, other.terminal_words, rules::Symbol::Terminal, callback);
   }
 };
 
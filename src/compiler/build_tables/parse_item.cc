@@ -23,9 +23,16 @@ ParseItem::ParseItem(const Symbol &lhs, const Production &production,
       production(&production),
       step_index(step_index) {}
 
+// Items are compared by the parts of their productions that can still affect
+// the parse, so that items from different productions can be merged. Almost
+// all of the items that are compared refer to the same few productions,
+// though, and two items at the same step of the same production are always
+// equal, so the productions' steps are only compared when the items refer to
+// different productions.
 bool ParseItem::operator==(const ParseItem &other) const {
   if (step_index != other.step_index) return false;
   if (variable_index != other.variable_index) return false;
+  if (production == other.production) return true;
   if (production->size() != other.production->size()) return false;
   for (size_t i = 0; i < step_index; i++) {
     if (production->at(i).alias != other.production->at(i).alias) return false;
@@ -48,6 +55,7 @@ bool ParseItem::operator<(const ParseItem &other) const {
   if (other.step_index < step_index) return false;
   if (variable_index < other.variable_index) return true;
   if (other.variable_index < variable_index) return false;
+  if (production == other.production) return false;
   if (production->size() < other.production->size()) return true;
   if (other.production->size() < production->size()) return false;
   for (size_t i = 0; i < step_index; i++) {
@@ -147,34 +155,31 @@ using tree_sitter::build_tables::ParseItem;
 using tree_sitter::build_tables::ParseItemSet;
 using tree_sitter::util::hash_combine;
 
-template <>
-struct hash<ParseItem> {
-  size_t operator()(const ParseItem &item) const {
-    size_t result = 0;
-    hash_combine(&result, item.variable_index);
-    hash_combine(&result, item.step_index);
-    hash_combine(&result, item.production->dynamic_precedence);
-    hash_combine(&result, item.production->size());
-    for (size_t i = 0; i < item.step_index; i++) {
-      hash_combine(&result, item.production->at(i).alias.value);
-      hash_combine(&result, item.production->at(i).alias.is_named);
+size_t hash<ParseItem>::operator()(const ParseItem &item) const {
+  size_t result = 0;
+  hash_combine(&result, item.variable_index);
+  hash_combine(&result, item.step_index);
+  hash_combine(&result, item.production->dynamic_precedence);
+  hash_combine(&result, item.production->size());
+  for (size_t i = 0; i < item.step_index; i++) {
+    hash_combine(&result, item.production->at(i).alias.value);
+    hash_combine(&result, item.production->at(i).alias.is_named);
+  }
+  if (item.is_done()) {
+    if (!item.production->empty()) {
+      hash_combine(&result, item.production->back().precedence);
+      hash_combine<unsigned>(&result, item.production->back().associativity);
     }
-    if (item.is_done()) {
-      if (!item.production->empty()) {
-        hash_combine(&result, item.production->back().precedence);
-        hash_combine<unsigned>(&result, item.production->back().associativity);
-      }
-    } else {
-      for (size_t i = item.step_index, n = item.production->size(); i < n; i++) {
-        auto &step = item.production->at(i);
-        hash_combine(&result, step.symbol);
-        hash_combine(&result, step.precedence);
-        hash_combine<unsigned>(&result, step.associativity);
-      }
+  } else {
+    for (size_t i = item.step_index, n = item.production->size(); i < n; i++) {
+      auto &step = item.production->at(i);
+      hash_combine(&result, step.symbol);
+      hash_combine(&result, step.precedence);
+      hash_combine<unsigned>(&result, step.associativity);
     }
-    return result;
   }
-};
+  return result;
+}
 
 size_t hash<ParseItemSet>::operator()(const ParseItemSet &item_set) const {
   size_t result = 0;
@@ -184,11 +189,7 @@ size_t hash<ParseItemSet>::operator()(const ParseItemSet &item_set) const {
     const auto &lookahead_set = pair.second;
 
     hash_combine(&result, item);
-    hash_combine(&result, lookahead_set.size());
-    lookahead_set.for_each([&result](Symbol symbol) {
-      hash_combine(&result, symbol);
-      return true;
-    });
+    hash_combine(&result, lookahead_set);
   }
   return result;
 }
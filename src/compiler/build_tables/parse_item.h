@@ -48,8 +48,14 @@ struct ParseItemSet {
 
 namespace std {
 
+using tree_sitter::build_tables::ParseItem;
 using tree_sitter::build_tables::ParseItemSet;
 
+template <>
+struct hash<tree_sitter::build_tables::ParseItem> {
+  size_t operator()(const ParseItem &item) const;
+};
+
 template <>
 struct hash<tree_sitter::build_tables::ParseItemSet> {
   size_t operator()(const ParseItemSet &item_set) const;
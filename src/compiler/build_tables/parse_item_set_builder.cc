@@ -49,18 +49,22 @@ inline void find_or_push(vector<T> &vector, const T &item) {
 ParseItemSetBuilder::ParseItemSetBuilder(
   const SyntaxGrammar &grammar,
   const LexicalGrammar &lexical_grammar
-) : grammar{grammar} {
+) : grammar{grammar},
+    terminal_count{lexical_grammar.variables.size()},
+    first_sets(grammar.variables.size() + terminal_count + grammar.external_tokens.size()),
+    last_sets(first_sets.size()),
+    transitive_closure_component_cache(grammar.variables.size()) {
 
   // Populate the FIRST and LAST set of each terminal, which just contains the terminal itself.
   for (size_t i = 0, n = lexical_grammar.variables.size(); i < n; i++) {
     Symbol symbol = Symbol::terminal(i);
-    first_sets.insert({symbol, LookaheadSet({symbol})});
-    last_sets.insert({symbol, LookaheadSet({symbol})});
+    first_sets[symbol_slot(symbol)] = LookaheadSet({symbol});
+    last_sets[symbol_slot(symbol)] = LookaheadSet({symbol});
   }
   for (size_t i = 0, n = grammar.external_tokens.size(); i < n; i++) {
     Symbol symbol = Symbol::external(i);
-    first_sets.insert({symbol, LookaheadSet({symbol})});
-    last_sets.insert({symbol, LookaheadSet({symbol})});
+    first_sets[symbol_slot(symbol)] = LookaheadSet({symbol});
+    last_sets[symbol_slot(symbol)] = LookaheadSet({symbol});
   }
 
   // Populate the FIRST and LAST set of each non-terminal by recursively expanding non-terminals.
@@ -68,8 +72,8 @@ ParseItemSetBuilder::ParseItemSetBuilder(
   set<Symbol::Index> processed_non_terminals;
   for (size_t i = 0, n = grammar.variables.size(); i < n; i++) {
     Symbol symbol = Symbol::non_terminal(i);
-    LookaheadSet &first_set = first_sets[symbol];
-    LookaheadSet &last_set = last_sets[symbol];
+    LookaheadSet &first_set = first_sets[symbol_slot(symbol)];
+    LookaheadSet &last_set = last_sets[symbol_slot(symbol)];
 
     processed_non_terminals.clear();
     symbols_to_process.assign({symbol});
@@ -140,7 +144,7 @@ ParseItemSetBuilder::ParseItemSetBuilder(
             propagates_lookaheads = queue_entry.propagates_lookaheads;
           } else {
             Symbol symbol_after_next = production.at(1).symbol;
-            next_lookaheads = first_sets.find(symbol_after_next)->second;
+            next_lookaheads = get_first_set(symbol_after_next);
             propagates_lookaheads = false;
           }
 
@@ -236,6 +240,16 @@ const vector<Production> &ParseItemSetBuilder::inline_production(const ParseItem
   return result;
 }
 
+// The inlined productions are computed the first time that they're needed,
+// possibly by several threads that are closing item sets at once. Once an
+// entry has been added to the map, it's never changed, and the map's other
+// entries stay where they are as new ones are added, so the result can be
+// used after the lock is released.
+const vector<Production> &ParseItemSetBuilder::inline_production_locked(const ParseItem &item) {
+  std::lock_guard<std::mutex> lock(inlined_productions_mutex);
+  return inline_production(item);
+}
+
 void ParseItemSetBuilder::apply_transitive_closure(ParseItemSet *item_set) {
   for (auto iter = item_set->entries.begin(), end = item_set->entries.end(); iter != end;) {
     const ParseItem &item = iter->first;
@@ -256,7 +270,7 @@ void ParseItemSetBuilder::apply_transitive_closure(ParseItemSet *item_set) {
           next_lookaheads = lookaheads;
         } else {
           Symbol symbol_after_next = item.production->at(next_step).symbol;
-          next_lookaheads = first_sets.find(symbol_after_next)->second;
+          next_lookaheads = get_first_set(symbol_after_next);
         }
 
         for (const auto &component : transitive_closure_component_cache[next_symbol.index]) {
@@ -268,7 +282,7 @@ void ParseItemSetBuilder::apply_transitive_closure(ParseItemSet *item_set) {
         }
 
         if (grammar.variables_to_inline.count(next_symbol)) {
-          for (const Production &inlined_production : inline_production(item)) {
+          for (const Production &inlined_production : inline_production_locked(item)) {
             item_set->entries.insert({
               ParseItem(item.lhs(), inlined_production, item.step_index),
               lookaheads
@@ -290,12 +304,24 @@ void ParseItemSetBuilder::apply_transitive_closure(ParseItemSet *item_set) {
   }
 }
 
-LookaheadSet ParseItemSetBuilder::get_first_set(const rules::Symbol &symbol) const {
-  return first_sets.find(symbol)->second;
+size_t ParseItemSetBuilder::symbol_slot(const rules::Symbol &symbol) const {
+  assert(!symbol.is_built_in());
+  switch (symbol.type) {
+    case Symbol::NonTerminal:
+      return symbol.index;
+    case Symbol::Terminal:
+      return grammar.variables.size() + symbol.index;
+    default:
+      return grammar.variables.size() + terminal_count + symbol.index;
+  }
+}
+
+const LookaheadSet &ParseItemSetBuilder::get_first_set(const rules::Symbol &symbol) const {
+  return first_sets[symbol_slot(symbol)];
 }
 
-LookaheadSet ParseItemSetBuilder::get_last_set(const rules::Symbol &symbol) const {
-  return last_sets.find(symbol)->second;
+const LookaheadSet &ParseItemSetBuilder::get_last_set(const rules::Symbol &symbol) const {
+  return last_sets[symbol_slot(symbol)];
 }
 
 }  // namespace build_tables
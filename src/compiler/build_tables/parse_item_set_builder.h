@@ -3,7 +3,8 @@
 
 #include "compiler/build_tables/parse_item.h"
 #include "compiler/rule.h"
-#include <map>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 namespace tree_sitter {
@@ -21,18 +22,25 @@ class ParseItemSetBuilder {
     bool operator==(const ParseItemSetComponent &) const;
   };
 
+  // The FIRST and LAST sets are stored densely, with the non-terminals first,
+  // followed by the terminals and then the external tokens.
   const SyntaxGrammar &grammar;
-  std::map<rules::Symbol, LookaheadSet> first_sets;
-  std::map<rules::Symbol, LookaheadSet> last_sets;
-  std::map<rules::Symbol::Index, std::vector<ParseItemSetComponent>> transitive_closure_component_cache;
-  std::map<ParseItem, std::vector<Production>> inlined_productions_by_original_production;
+  size_t terminal_count;
+  std::vector<LookaheadSet> first_sets;
+  std::vector<LookaheadSet> last_sets;
+  std::vector<std::vector<ParseItemSetComponent>> transitive_closure_component_cache;
+  std::unordered_map<ParseItem, std::vector<Production>> inlined_productions_by_original_production;
+  std::mutex inlined_productions_mutex;
+  size_t symbol_slot(const rules::Symbol &) const;
   const std::vector<Production> &inline_production(const ParseItem &);
+  const std::vector<Production> &inline_production_locked(const ParseItem &);
 
  public:
   ParseItemSetBuilder(const SyntaxGrammar &, const LexicalGrammar &);
+  // This can be called from several threads at once.
   void apply_transitive_closure(ParseItemSet *);
-  LookaheadSet get_first_set(const rules::Symbol &) const;
-  LookaheadSet get_last_set(const rules::Symbol &) const;
+  const LookaheadSet &get_first_set(const rules::Symbol &) const;
+  const LookaheadSet &get_last_set(const rules::Symbol &) const;
 };
 
 }  // namespace build_tables
@@ -1,10 +1,14 @@
 #include "compiler/build_tables/parse_table_builder.h"
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <map>
 #include <set>
 #include <deque>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include "compiler/parse_table.h"
 #include "compiler/build_tables/parse_item.h"
@@ -13,6 +17,7 @@
 #include "compiler/syntax_grammar.h"
 #include "compiler/rule.h"
 #include "compiler/build_tables/lex_table_builder.h"
+#include "compiler/util/hash_combine.h"
 
 namespace tree_sitter {
 namespace build_tables {
@@ -29,11 +34,30 @@ using std::string;
 using std::to_string;
 using std::unique_ptr;
 using std::unordered_map;
+using std::unordered_set;
+using std::pair;
 using rules::Associativity;
 using rules::Symbol;
 using rules::END_OF_INPUT;
+using util::hash_combine;
 
 using SymbolSequence = vector<Symbol>;
+using Clock = std::chrono::steady_clock;
+
+static const size_t MIN_STATES_PER_THREAD = 16;
+
+static uint64_t micros_since(Clock::time_point start_time) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start_time).count();
+}
+
+struct SymbolPairHash {
+  size_t operator()(const pair<Symbol, Symbol> &symbols) const {
+    size_t result = 0;
+    hash_combine(&result, symbols.first);
+    hash_combine(&result, symbols.second);
+    return result;
+  }
+};
 
 struct ParseStateQueueEntry {
   SymbolSequence preceding_symbols;
@@ -41,49 +65,74 @@ struct ParseStateQueueEntry {
   ParseStateId state_id;
 };
 
+// The item sets of the states that a state can transition to, once its own
+// item set has been closed. These are computed without touching the parse
+// table, so that the states in the queue can be expanded on several threads.
+struct ParseStateExpansion {
+  map<Symbol, ParseItemSet> terminal_successors;
+  map<Symbol::Index, ParseItemSet> nonterminal_successors;
+};
+
 class ParseTableBuilderImpl : public ParseTableBuilder {
   const SyntaxGrammar grammar;
-  const LexicalGrammar lexical_grammar;
+  LexicalGrammar lexical_grammar;
+  const Production start_production;
   unordered_map<ParseItemSet, ParseStateId> state_ids_by_item_set;
   vector<const ParseItemSet *> item_sets_by_state_id;
   deque<ParseStateQueueEntry> parse_state_queue;
   ParseTable parse_table;
+  ParseTable unoptimized_parse_table;
   ParseItemSetBuilder item_set_builder;
   unique_ptr<LexTableBuilder> lex_table_builder;
   unordered_map<Symbol, LookaheadSet> following_tokens_by_token;
+  unordered_set<pair<Symbol, Symbol>, SymbolPairHash> adjacent_symbol_pairs;
   vector<LookaheadSet> coincident_tokens_by_token;
+  TSCompileProfile profile;
+  unsigned thread_count;
+  bool reorder_states;
+  bool keep_parse_states;
+  bool has_parse_states;
 
  public:
-  ParseTableBuilderImpl(const SyntaxGrammar &syntax_grammar, const LexicalGrammar &lexical_grammar)
+  ParseTableBuilderImpl(const SyntaxGrammar &syntax_grammar, const LexicalGrammar &lexical_grammar,
+                        unsigned thread_count, bool reorder_states, bool keep_parse_states)
     : grammar(syntax_grammar),
       lexical_grammar(lexical_grammar),
-      item_set_builder(syntax_grammar, lexical_grammar),
-      coincident_tokens_by_token(lexical_grammar.variables.size()) {
+      start_production({{Symbol::non_terminal(0), 0, rules::AssociativityNone, rules::Alias{}}}, 0),
+      item_set_builder(grammar, lexical_grammar),
+      coincident_tokens_by_token(lexical_grammar.variables.size()),
+      thread_count(thread_count),
+      reorder_states(reorder_states),
+      keep_parse_states(keep_parse_states),
+      has_parse_states(false) {
+
+    LookaheadSet string_tokens;
+    for (unsigned i = 0, n = lexical_grammar.variables.size(); i < n; i++) {
+      if (lexical_grammar.variables[i].is_string) string_tokens.insert(Symbol::terminal(i));
+    }
 
+    // Every string token is coincident with every other string token.
     for (unsigned i = 0, n = lexical_grammar.variables.size(); i < n; i++) {
       coincident_tokens_by_token[i].insert(rules::END_OF_INPUT());
       if (lexical_grammar.variables[i].is_string) {
-        for (unsigned j = 0; j < i; j++) {
-          if (lexical_grammar.variables[j].is_string) {
-            coincident_tokens_by_token[i].insert(Symbol::terminal(j));
-            coincident_tokens_by_token[j].insert(Symbol::terminal(i));
-          }
-        }
+        coincident_tokens_by_token[i].insert_all(string_tokens);
+        coincident_tokens_by_token[i].remove(Symbol::terminal(i));
       }
     }
   }
 
   BuildResult build() {
+    profile = TSCompileProfile();
+    auto start_time = Clock::now();
+
     // Ensure that the empty rename sequence has index 0.
     parse_table.alias_sequences.push_back({});
 
     // Ensure that the error state has index 0.
-    ParseStateId error_state_id = add_parse_state({}, ParseItemSet{});
-
-    // Add the starting state.
-    Symbol start_symbol = Symbol::non_terminal(0);
-    Production start_production({{start_symbol, 0, rules::AssociativityNone, rules::Alias{}}}, 0);
+    add_parse_state({}, ParseItemSet{});
 
+    // Add the starting state. The parse items refer to their productions, so
+    // the start production is kept with the grammar.
     add_parse_state({}, ParseItemSet{{
       {
         ParseItem(rules::START(), start_production, 0),
@@ -92,58 +141,163 @@ class ParseTableBuilderImpl : public ParseTableBuilder {
     }});
 
     CompileError error = process_part_state_queue();
+    profile.build_parse_table_micros = micros_since(start_time);
     if (error) return {
       parse_table,
       LexTable(),
       LexTable(),
       rules::NONE(),
       error,
+      profile,
     };
 
+    if (keep_parse_states) {
+      unoptimized_parse_table = parse_table;
+      has_parse_states = true;
+    }
+    return build_lex_tables();
+  }
+
+  bool can_rebuild(const SyntaxGrammar &syntax_grammar, const LexicalGrammar &new_lexical_grammar) const {
+    if (!has_parse_states || !(syntax_grammar == grammar)) return false;
+    if (new_lexical_grammar.variables.size() != lexical_grammar.variables.size()) return false;
+    for (size_t i = 0, n = lexical_grammar.variables.size(); i < n; i++) {
+      if (new_lexical_grammar.variables[i].is_string != lexical_grammar.variables[i].is_string) return false;
+    }
+    return true;
+  }
+
+  // The item sets and the tokens that follow and coincide with each token
+  // depend only on the syntax rules and on which tokens are strings, so they
+  // are kept from the last build.
+  BuildResult rebuild(const LexicalGrammar &new_lexical_grammar) {
+    lexical_grammar = new_lexical_grammar;
+    parse_table = unoptimized_parse_table;
+    profile.build_parse_table_micros = 0;
+    profile.reused_parse_states = true;
+    return build_lex_tables();
+  }
+
+ private:
+  BuildResult build_lex_tables() {
+    // The lex table builder is needed to build the error state, but the time
+    // that it takes to create is counted as part of building the lex tables.
+    auto start_time = Clock::now();
     lex_table_builder = LexTableBuilder::create(
       grammar,
       lexical_grammar,
       following_tokens_by_token,
-      coincident_tokens_by_token
+      coincident_tokens_by_token,
+      thread_count
     );
+    profile.build_lex_table_micros = micros_since(start_time);
 
-    build_error_parse_state(error_state_id);
+    start_time = Clock::now();
+    build_error_parse_state(0);
     remove_precedence_values();
     remove_duplicate_parse_states();
     eliminate_unit_reductions();
+    remove_unreachable_parse_states();
     populate_used_terminals();
+    if (reorder_states) reorder_parse_states();
+    profile.optimize_parse_table_micros = micros_since(start_time);
+    profile.parse_state_count = parse_table.states.size();
 
+    start_time = Clock::now();
     auto lex_table_result = lex_table_builder->build(&parse_table);
+    profile.build_lex_table_micros += micros_since(start_time);
+    profile.lex_state_count = lex_table_result.main_table.states.size();
+    profile.keyword_lex_state_count = lex_table_result.keyword_table.states.size();
     return {
       parse_table,
       lex_table_result.main_table,
       lex_table_result.keyword_table,
       lex_table_result.keyword_capture_token,
-      CompileError::none()
+      CompileError::none(),
+      profile,
     };
   }
 
- private:
+  // The queue is processed one frontier at a time: every state that is in the
+  // queue is expanded, possibly on several threads, and then the actions for
+  // the states are added one by one, in the order that they were queued. Only
+  // adding actions creates new states, so the states are numbered exactly as
+  // they would be if each one were expanded just before its actions were added.
   CompileError process_part_state_queue() {
     while (!parse_state_queue.empty()) {
-      auto entry = parse_state_queue.front();
-      parse_state_queue.pop_front();
-
-      item_set_builder.apply_transitive_closure(&entry.item_set);
-      string conflict = add_actions(
-        move(entry.preceding_symbols),
-        move(entry.item_set),
-        entry.state_id
+      vector<ParseStateQueueEntry> frontier(
+        std::make_move_iterator(parse_state_queue.begin()),
+        std::make_move_iterator(parse_state_queue.end())
       );
-
-      if (!conflict.empty()) {
-        return CompileError(TSCompileErrorTypeParseConflict, conflict);
+      parse_state_queue.clear();
+
+      vector<ParseStateExpansion> expansions(frontier.size());
+      expand_parse_states(&frontier, &expansions);
+
+      for (size_t i = 0; i < frontier.size(); i++) {
+        ParseStateQueueEntry &entry = frontier[i];
+        profile.item_set_count++;
+        profile.parse_item_count += entry.item_set.entries.size();
+        string conflict = add_actions(
+          move(entry.preceding_symbols),
+          move(entry.item_set),
+          move(expansions[i]),
+          entry.state_id
+        );
+
+        if (!conflict.empty()) {
+          return CompileError(TSCompileErrorTypeParseConflict, conflict);
+        }
       }
     }
 
     return CompileError::none();
   }
 
+  // Small frontiers are expanded on the calling thread, because starting the
+  // threads would take longer than expanding the states.
+  void expand_parse_states(vector<ParseStateQueueEntry> *entries, vector<ParseStateExpansion> *expansions) {
+    size_t worker_count = std::min<size_t>(thread_count, entries->size() / MIN_STATES_PER_THREAD);
+    if (worker_count <= 1) {
+      for (size_t i = 0; i < entries->size(); i++) {
+        expand_parse_state(&(*entries)[i].item_set, &(*expansions)[i]);
+      }
+      return;
+    }
+
+    // The states are handed out one at a time, because the size of their
+    // item sets varies too much for an even split to keep the threads busy.
+    std::atomic<size_t> next_index(0);
+    auto run_worker = [&]() {
+      for (size_t i = next_index++; i < entries->size(); i = next_index++) {
+        expand_parse_state(&(*entries)[i].item_set, &(*expansions)[i]);
+      }
+    };
+
+    vector<std::thread> workers;
+    for (size_t i = 1; i < worker_count; i++) workers.emplace_back(run_worker);
+    run_worker();
+    for (std::thread &worker : workers) worker.join();
+  }
+
+  void expand_parse_state(ParseItemSet *item_set, ParseStateExpansion *expansion) {
+    item_set_builder.apply_transitive_closure(item_set);
+
+    // For each unfinished item, create a new item by advancing one symbol,
+    // and add that new item to a successor item set.
+    for (const auto &pair : item_set->entries) {
+      const ParseItem &item = pair.first;
+      if (item.is_done()) continue;
+      Symbol symbol = item.production->at(item.step_index).symbol;
+      ParseItem new_item(item.lhs(), *item.production, item.step_index + 1);
+      if (symbol.is_non_terminal()) {
+        expansion->nonterminal_successors[symbol.index].entries[new_item] = pair.second;
+      } else {
+        expansion->terminal_successors[symbol].entries[new_item] = pair.second;
+      }
+    }
+  }
+
   void build_error_parse_state(ParseStateId state_id) {
     unsigned CannotMerge = (
       MatchesShorterStringWithinSeparators |
@@ -152,39 +306,31 @@ class ParseTableBuilderImpl : public ParseTableBuilder {
 
     parse_table.states[state_id].terminal_entries.clear();
 
-    // Add all the tokens that have no conflict with other tokens.
-    LookaheadSet non_conflicting_tokens;
-    for (unsigned i = 0; i < lexical_grammar.variables.size(); i++) {
+    // For each token, find the other tokens that it can't be merged with and
+    // that never occur in the same state as it.
+    unsigned token_count = lexical_grammar.variables.size();
+    vector<LookaheadSet> conflicting_tokens_by_token(token_count);
+    for (unsigned i = 0; i < token_count; i++) {
       Symbol token = Symbol::terminal(i);
-      bool conflicts_with_other_tokens = false;
-      for (unsigned j = 0; j < lexical_grammar.variables.size(); j++) {
+      LookaheadSet &conflicting_tokens = conflicting_tokens_by_token[i];
+      for (unsigned j = 0; j < token_count; j++) {
         Symbol other_token = Symbol::terminal(j);
-        if (j != i &&
-            !coincident_tokens_by_token[token.index].contains(other_token) &&
-            (lex_table_builder->get_conflict_status(other_token, token) & CannotMerge)) {
-          conflicts_with_other_tokens = true;
-          break;
+        if (j != i && (lex_table_builder->get_conflict_status(other_token, token) & CannotMerge)) {
+          conflicting_tokens.insert(other_token);
         }
       }
-      if (!conflicts_with_other_tokens) non_conflicting_tokens.insert(token);
+      conflicting_tokens.remove_all(coincident_tokens_by_token[i]);
     }
 
-    LookaheadSet tokens;
-    for (unsigned i = 0; i < lexical_grammar.variables.size(); i++) {
-      Symbol token = Symbol::terminal(i);
-      bool conflicts_with_other_tokens = false;
-      if (!non_conflicting_tokens.contains(token)) {
-        non_conflicting_tokens.for_each([&](Symbol other_token) {
-          if (!coincident_tokens_by_token[token.index].contains(other_token) &&
-              (lex_table_builder->get_conflict_status(other_token, token) & CannotMerge)) {
-            conflicts_with_other_tokens = true;
-            return false;
-          }
-          return true;
-        });
-      }
-      if (!conflicts_with_other_tokens) {
-        parse_table.add_terminal_action(state_id, token, ParseAction::Recover());
+    // Add all the tokens that have no conflict with other tokens.
+    LookaheadSet non_conflicting_tokens;
+    for (unsigned i = 0; i < token_count; i++) {
+      if (conflicting_tokens_by_token[i].empty()) non_conflicting_tokens.insert(Symbol::terminal(i));
+    }
+
+    for (unsigned i = 0; i < token_count; i++) {
+      if (!conflicting_tokens_by_token[i].intersects(non_conflicting_tokens)) {
+        parse_table.add_terminal_action(state_id, Symbol::terminal(i), ParseAction::Recover());
       }
     }
 
@@ -197,7 +343,7 @@ class ParseTableBuilderImpl : public ParseTableBuilder {
     parse_table.add_terminal_action(state_id, END_OF_INPUT(), ParseAction::Recover());
   }
 
-  ParseStateId add_parse_state(SymbolSequence &&preceding_symbols, const ParseItemSet &item_set) {
+  ParseStateId add_parse_state(SymbolSequence &&preceding_symbols, ParseItemSet &&item_set) {
     ParseStateId new_state_id = parse_table.states.size();
     auto insertion = state_ids_by_item_set.insert({move(item_set), new_state_id});
     if (insertion.second) {
@@ -214,9 +360,8 @@ class ParseTableBuilderImpl : public ParseTableBuilder {
     }
   }
 
-  string add_actions(SymbolSequence &&sequence, ParseItemSet &&item_set, ParseStateId state_id) {
-    map<Symbol, ParseItemSet> terminal_successors;
-    map<Symbol::Index, ParseItemSet> nonterminal_successors;
+  string add_actions(SymbolSequence &&sequence, ParseItemSet &&item_set, ParseStateExpansion &&expansion,
+                     ParseStateId state_id) {
     set<Symbol> lookaheads_with_conflicts;
 
     for (const auto &pair : item_set.entries) {
@@ -261,27 +406,15 @@ class ParseTableBuilderImpl : public ParseTableBuilder {
 
           return true;
         });
-
-      // If the item is unfinished, create a new item by advancing one symbol.
-      // Add that new item to a successor item set.
-      } else {
-        Symbol symbol = item.production->at(item.step_index).symbol;
-        ParseItem new_item(item.lhs(), *item.production, item.step_index + 1);
-
-        if (symbol.is_non_terminal()) {
-          nonterminal_successors[symbol.index].entries[new_item] = lookahead_symbols;
-        } else {
-          terminal_successors[symbol].entries[new_item] = lookahead_symbols;
-        }
       }
     }
 
     // Add a Shift action for each possible successor state. Shift actions for
     // terminal lookaheads can conflict with Reduce actions added previously.
-    for (auto &pair : terminal_successors) {
+    for (auto &pair : expansion.terminal_successors) {
       Symbol lookahead = pair.first;
       ParseItemSet &next_item_set = pair.second;
-      ParseStateId next_state_id = add_parse_state(append_symbol(sequence, lookahead), next_item_set);
+      ParseStateId next_state_id = add_parse_state(append_symbol(sequence, lookahead), move(next_item_set));
 
       if (!parse_table.states[state_id].terminal_entries[lookahead].actions.empty()) {
         lookaheads_with_conflicts.insert(lookahead);
@@ -291,10 +424,10 @@ class ParseTableBuilderImpl : public ParseTableBuilder {
     }
 
     // Add a Shift action for each non-terminal transition.
-    for (auto &pair : nonterminal_successors) {
+    for (auto &pair : expansion.nonterminal_successors) {
       Symbol lookahead = Symbol::non_terminal(pair.first);
       ParseItemSet &next_item_set = pair.second;
-      ParseStateId next_state_id = add_parse_state(append_symbol(sequence, lookahead), next_item_set);
+      ParseStateId next_state_id = add_parse_state(append_symbol(sequence, lookahead), move(next_item_set));
       parse_table.set_nonterminal_action(state_id, lookahead.index, next_state_id);
     }
 
@@ -311,16 +444,19 @@ class ParseTableBuilderImpl : public ParseTableBuilder {
       }
     }
 
-    auto &terminals = state.terminal_entries;
-    for (auto iter = terminals.begin(), end = terminals.end(); iter != end; ++iter) {
-      if (iter->first.is_built_in() || iter->first.is_external()) continue;
-      for (auto other_iter = terminals.begin(); other_iter != iter; ++other_iter) {
-        if (other_iter->first.is_built_in() || other_iter->first.is_external()) continue;
-        coincident_tokens_by_token[iter->first.index].insert(other_iter->first);
-        coincident_tokens_by_token[other_iter->first.index].insert(iter->first);
-      }
+    LookaheadSet state_tokens;
+    for (const auto &entry : state.terminal_entries) {
+      if (entry.first.is_built_in() || entry.first.is_external()) continue;
+      state_tokens.insert(entry.first);
     }
 
+    // A token is never coincident with itself.
+    state_tokens.for_each([&](Symbol token) {
+      coincident_tokens_by_token[token.index].insert_all(state_tokens);
+      coincident_tokens_by_token[token.index].remove(token);
+      return true;
+    });
+
     return "";
   }
 
@@ -351,57 +487,110 @@ class ParseTableBuilderImpl : public ParseTableBuilder {
     }
   }
 
+  // Merge the states that have the same core wherever this doesn't change the
+  // parser's behavior. The states with each core start out in one group, and
+  // the groups are split until all of the states in each group can be merged
+  // together, with their actions leading to the same groups. Unlike merging
+  // states pairwise, this also merges states whose actions lead to each other.
   void remove_duplicate_parse_states() {
-    unordered_map<size_t, set<ParseStateId>> state_indices_by_signature;
-
+    size_t state_count = parse_table.states.size();
+    vector<size_t> signatures(state_count);
     for (auto &pair : state_ids_by_item_set) {
-      const ParseItemSet &item_set = pair.first;
-      ParseStateId state_id = pair.second;
-      state_indices_by_signature[item_set.unfinished_item_signature()].insert(state_id);
+      signatures[pair.second] = pair.first.unfinished_item_signature();
     }
 
-    set<ParseStateId> deleted_states;
+    // The error state is never merged with another state.
+    vector<vector<ParseStateId>> groups({{0}});
+    vector<size_t> group_ids(state_count, 0);
+    unordered_map<size_t, size_t> group_ids_by_signature;
+    for (ParseStateId i = 1; i < state_count; i++) {
+      auto insertion = group_ids_by_signature.insert({signatures[i], groups.size()});
+      if (insertion.second) groups.push_back({});
+      groups[insertion.first->second].push_back(i);
+      group_ids[i] = insertion.first->second;
+    }
 
     while (true) {
-      map<ParseStateId, ParseStateId> state_replacements;
-
-      for (auto &pair : state_indices_by_signature) {
-        auto &state_indices = pair.second;
+      vector<vector<ParseStateId>> new_groups;
+      vector<size_t> new_group_ids(state_count);
+      for (const vector<ParseStateId> &group : groups) {
+        size_t first_new_group_id = new_groups.size();
+        vector<ParseState> merged_states;
+        for (ParseStateId state_id : group) {
+          ParseState state = parse_table.states[state_id];
+          state.each_referenced_state([&group_ids](ParseStateId *state_index) {
+            *state_index = group_ids[*state_index];
+          });
 
-        for (auto i = state_indices.begin(), end = state_indices.end(); i != end;) {
-          for (ParseStateId j : state_indices) {
-            if (j == *i) {
-              ++i;
-              break;
-            }
-            if (!state_replacements.count(j) && merge_parse_state(j, *i)) {
-              state_replacements.insert({*i, j});
-              deleted_states.insert(*i);
-              i = state_indices.erase(i);
-              break;
-            }
+          size_t i = 0;
+          while (i < merged_states.size() && !merge_parse_state(merged_states[i], state)) i++;
+          if (i == merged_states.size()) {
+            merged_states.push_back(state);
+            new_groups.push_back({});
           }
+          new_groups[first_new_group_id + i].push_back(state_id);
+          new_group_ids[state_id] = first_new_group_id + i;
         }
       }
 
-      if (state_replacements.empty()) break;
+      bool done = new_groups.size() == groups.size();
+      groups = move(new_groups);
+      group_ids = move(new_group_ids);
+      if (done) break;
+    }
 
-      for (ParseStateId i = 0, n = parse_table.states.size(); i < n; i++) {
-        if (!state_replacements.count(i)) {
-          ParseState &state = parse_table.states[i];
-          state.each_referenced_state([&state_replacements](ParseStateId *state_index) {
-            auto replacement = state_replacements.find(*state_index);
-            if (replacement != state_replacements.end()) {
-              *state_index = replacement->second;
-            }
-          });
+    // Merge each group into its first state.
+    map<ParseStateId, ParseStateId> state_replacements;
+    set<ParseStateId> deleted_states;
+    for (const vector<ParseStateId> &group : groups) {
+      ParseState &merged_state = parse_table.states[group[0]];
+      for (auto i = group.begin() + 1; i != group.end(); ++i) {
+        for (const auto &entry : parse_table.states[*i].terminal_entries) {
+          merged_state.terminal_entries.insert(entry);
         }
+        state_replacements.insert({*i, group[0]});
+        deleted_states.insert(*i);
+      }
+    }
+
+    for (ParseStateId i = 0; i < state_count; i++) {
+      if (!state_replacements.count(i)) {
+        parse_table.states[i].each_referenced_state([&state_replacements](ParseStateId *state_index) {
+          auto replacement = state_replacements.find(*state_index);
+          if (replacement != state_replacements.end()) {
+            *state_index = replacement->second;
+          }
+        });
       }
     }
 
     delete_parse_states(deleted_states);
   }
 
+  // Delete the states that can't be reached from the start state or from
+  // the error state.
+  void remove_unreachable_parse_states() {
+    vector<bool> reachable(parse_table.states.size(), false);
+    vector<ParseStateId> stack({0, 1});
+    reachable[0] = reachable[1] = true;
+    while (!stack.empty()) {
+      ParseStateId state_id = stack.back();
+      stack.pop_back();
+      parse_table.states[state_id].each_referenced_state([&](ParseStateId *state_index) {
+        if (!reachable[*state_index]) {
+          reachable[*state_index] = true;
+          stack.push_back(*state_index);
+        }
+      });
+    }
+
+    set<ParseStateId> unreachable_states;
+    for (ParseStateId i = 0, n = parse_table.states.size(); i < n; i++) {
+      if (!reachable[i]) unreachable_states.insert(i);
+    }
+    if (!unreachable_states.empty()) delete_parse_states(unreachable_states);
+  }
+
   void eliminate_unit_reductions() {
     set<Symbol::Index> aliased_symbols;
     for (auto &variable : grammar.variables) {
@@ -482,6 +671,57 @@ class ParseTableBuilderImpl : public ParseTableBuilder {
     }
   }
 
+  // States are numbered in the order in which they are first discovered, which
+  // is breadth-first, so a state is usually far from the states that the parser
+  // enters right after it. This renumbers the states in depth-first order from
+  // the start state, so that each state is followed by the first state that it
+  // shifts to. The dense states are kept before the sparse ones, and the error
+  // state and the start state keep their ids.
+  void reorder_parse_states() {
+    size_t state_count = parse_table.states.size();
+    vector<bool> visited(state_count, false);
+    vector<ParseStateId> depth_first_order;
+    vector<ParseStateId> stack({0, 1});
+    while (!stack.empty()) {
+      ParseStateId state_id = stack.back();
+      stack.pop_back();
+      if (visited[state_id]) continue;
+      visited[state_id] = true;
+      depth_first_order.push_back(state_id);
+
+      vector<ParseStateId> successors;
+      parse_table.states[state_id].each_referenced_state([&](ParseStateId *state_index) {
+        if (!visited[*state_index]) successors.push_back(*state_index);
+      });
+      stack.insert(stack.end(), successors.rbegin(), successors.rend());
+    }
+
+    for (ParseStateId i = 0; i < state_count; i++) {
+      if (!visited[i]) depth_first_order.push_back(i);
+    }
+
+    vector<ParseStateId> order({0, 1});
+    for (bool is_small : {false, true}) {
+      for (ParseStateId state_id : depth_first_order) {
+        if (state_id > 1 && parse_table.is_small_state(state_id) == is_small) order.push_back(state_id);
+      }
+    }
+
+    vector<ParseStateId> new_state_ids(state_count);
+    for (ParseStateId i = 0; i < state_count; i++) new_state_ids[order[i]] = i;
+
+    vector<ParseState> states;
+    states.reserve(state_count);
+    for (ParseStateId state_id : order) {
+      ParseState &state = parse_table.states[state_id];
+      state.each_referenced_state([&new_state_ids](ParseStateId *state_index) {
+        *state_index = new_state_ids[*state_index];
+      });
+      states.push_back(move(state));
+    }
+    parse_table.states = move(states);
+  }
+
   // Does this parse state already have the given set of actions, for some lookahead token?
   static bool has_actions(const ParseState &state, const ParseTableEntry &entry) {
     for (const auto &pair : state.terminal_entries)
@@ -521,11 +761,8 @@ class ParseTableBuilderImpl : public ParseTableBuilder {
     return true;
   }
 
-  // If the parse states at the given indices are mergeable, merge the second one
-  // into the first one.
-  bool merge_parse_state(size_t left_index, size_t right_index) {
-    ParseState &left_state = parse_table.states[left_index];
-    ParseState &right_state = parse_table.states[right_index];
+  // If the given parse states are mergeable, merge the second one into the first one.
+  bool merge_parse_state(ParseState &left_state, const ParseState &right_state) {
     if (left_state.nonterminal_entries != right_state.nonterminal_entries) return false;
 
     for (auto &left_entry : left_state.terminal_entries) {
@@ -549,7 +786,7 @@ class ParseTableBuilderImpl : public ParseTableBuilder {
     }
 
     for (const Symbol &lookahead : symbols_to_merge) {
-      left_state.terminal_entries[lookahead] = right_state.terminal_entries[lookahead];
+      left_state.terminal_entries[lookahead] = right_state.terminal_entries.at(lookahead);
     }
 
     return true;
@@ -570,7 +807,7 @@ class ParseTableBuilderImpl : public ParseTableBuilder {
           conflicting_items.insert(item);
         }
       } else if (item.step_index > 0) {
-        LookaheadSet first_set = item_set_builder.get_first_set(item.next_symbol());
+        const LookaheadSet &first_set = item_set_builder.get_first_set(item.next_symbol());
         if (first_set.contains(lookahead)) {
           shift_precedence.add(item.production->at(item.step_index - 1).precedence);
           conflicting_items.insert(item);
@@ -851,8 +1088,11 @@ class ParseTableBuilderImpl : public ParseTableBuilder {
     }
   }
 
+  // The tokens that can follow each other only depend on the last symbol of
+  // the sequence and the symbol that is appended, so each pair of symbols is
+  // only considered once.
   SymbolSequence append_symbol(const SymbolSequence &sequence, const Symbol &symbol) {
-    if (!sequence.empty()) {
+    if (!sequence.empty() && adjacent_symbol_pairs.insert({sequence.back(), symbol}).second) {
       const LookaheadSet &left_tokens = item_set_builder.get_last_set(sequence.back());
       const LookaheadSet &right_tokens = item_set_builder.get_first_set(symbol);
 
@@ -880,14 +1120,32 @@ class ParseTableBuilderImpl : public ParseTableBuilder {
 
 unique_ptr<ParseTableBuilder> ParseTableBuilder::create(
   const SyntaxGrammar &syntax_grammar,
-  const LexicalGrammar &lexical_grammar
+  const LexicalGrammar &lexical_grammar,
+  unsigned thread_count,
+  bool reorder_states,
+  bool keep_parse_states
 ) {
-  return unique_ptr<ParseTableBuilder>(new ParseTableBuilderImpl(syntax_grammar, lexical_grammar));
+  return unique_ptr<ParseTableBuilder>(new ParseTableBuilderImpl(
+    syntax_grammar,
+    lexical_grammar,
+    thread_count,
+    reorder_states,
+    keep_parse_states
+  ));
 }
 
 ParseTableBuilder::BuildResult ParseTableBuilder::build() {
   return static_cast<ParseTableBuilderImpl *>(this)->build();
 }
 
+bool ParseTableBuilder::can_rebuild(const SyntaxGrammar &syntax_grammar,
+                                    const LexicalGrammar &lexical_grammar) const {
+  return static_cast<const ParseTableBuilderImpl *>(this)->can_rebuild(syntax_grammar, lexical_grammar);
+}
+
+ParseTableBuilder::BuildResult ParseTableBuilder::rebuild(const LexicalGrammar &lexical_grammar) {
+  return static_cast<ParseTableBuilderImpl *>(this)->rebuild(lexical_grammar);
+}
+
 }  // namespace build_tables
 }  // namespace tree_sitter
@@ -16,7 +16,11 @@ namespace build_tables {
 
 class ParseTableBuilder {
  public:
-  static std::unique_ptr<ParseTableBuilder> create(const SyntaxGrammar &, const LexicalGrammar &);
+  // A builder that keeps its parse states can be rebuilt for a grammar whose
+  // tokens have changed, at the cost of holding a second copy of its table.
+  static std::unique_ptr<ParseTableBuilder> create(const SyntaxGrammar &, const LexicalGrammar &,
+                                                   unsigned thread_count, bool reorder_states,
+                                                   bool keep_parse_states = false);
 
   struct BuildResult {
     ParseTable parse_table;
@@ -24,10 +28,23 @@ class ParseTableBuilder {
     LexTable keyword_lex_table;
     rules::Symbol keyword_capture_token;
     CompileError error;
+    TSCompileProfile profile;
   };
 
+  virtual ~ParseTableBuilder() = default;
+
   BuildResult build();
 
+  // Whether the given grammar can be built by calling `rebuild` after `build`.
+  // It must have the same syntax rules, and the same number of tokens, with
+  // the same ones being strings, so that the parse states are the same.
+  bool can_rebuild(const SyntaxGrammar &, const LexicalGrammar &) const;
+
+  // Build the tables again for the given tokens, reusing the parse states
+  // from the last build. Only the token conflicts, the optimizations that
+  // depend on them, and the lex tables are computed again.
+  BuildResult rebuild(const LexicalGrammar &);
+
  protected:
   ParseTableBuilder() = default;
 };
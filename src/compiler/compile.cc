@@ -1,12 +1,22 @@
 #include "tree_sitter/compiler.h"
+#include <chrono>
+#include "compiler/compile_cache.h"
 #include "compiler/prepare_grammar/prepare_grammar.h"
 #include "compiler/build_tables/parse_table_builder.h"
+#include "compiler/generate_code/binary_language.h"
 #include "compiler/generate_code/c_code.h"
+#include "compiler/generate_code/conflict_report.h"
+#include "compiler/generate_code/lex_table_encoding.h"
 #include "compiler/syntax_grammar.h"
 #include "compiler/lexical_grammar.h"
 #include "compiler/parse_grammar.h"
 #include "json.h"
 
+struct TSCompileSession {
+  std::unique_ptr<tree_sitter::build_tables::ParseTableBuilder> builder;
+  bool reorder_parse_states;
+};
+
 namespace tree_sitter {
 
 using std::move;
@@ -15,41 +25,231 @@ using std::string;
 using std::vector;
 using std::get;
 using std::make_tuple;
+using std::unique_ptr;
+using build_tables::ParseTableBuilder;
+using Clock = std::chrono::steady_clock;
 
-extern "C" TSCompileResult ts_compile_grammar(const char *input) {
+static uint64_t micros_since(Clock::time_point start_time) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start_time).count();
+}
+
+struct CompiledGrammar {
+  string name;
+  ParseTableBuilder::BuildResult tables;
+  SyntaxGrammar syntax_grammar;
+  LexicalGrammar lexical_grammar;
+  CompileError error;
+  TSCompileProfile profile;
+};
+
+// When given a session, the parse states of the session's last grammar are
+// reused if they can be, and the builder is kept for the next grammar.
+static CompiledGrammar build(const char *input, unsigned thread_count, bool reorder_parse_states,
+                             TSCompileSession *session = nullptr) {
+  CompiledGrammar result;
+  result.profile = TSCompileProfile();
+  auto start_time = Clock::now();
   ParseGrammarResult parse_result = parse_grammar(string(input));
+  result.profile.parse_grammar_micros = micros_since(start_time);
   if (!parse_result.error_message.empty()) {
-    return { nullptr, strdup(parse_result.error_message.c_str()),
-             TSCompileErrorTypeInvalidGrammar };
+    result.error = CompileError(TSCompileErrorTypeInvalidGrammar, parse_result.error_message);
+    return result;
   }
 
+  start_time = Clock::now();
   auto prepare_grammar_result = prepare_grammar::prepare_grammar(parse_result.grammar);
-  SyntaxGrammar &syntax_grammar = get<0>(prepare_grammar_result);
-  LexicalGrammar &lexical_grammar = get<1>(prepare_grammar_result);
-  CompileError error = get<2>(prepare_grammar_result);
-  if (error.type) {
-    return {nullptr, strdup(error.message.c_str()), error.type};
+  result.profile.prepare_grammar_micros = micros_since(start_time);
+  result.name = parse_result.name;
+  result.syntax_grammar = move(get<0>(prepare_grammar_result));
+  result.lexical_grammar = move(get<1>(prepare_grammar_result));
+  result.error = get<2>(prepare_grammar_result);
+  if (result.error.type) return result;
+
+  if (session && session->builder && session->reorder_parse_states == reorder_parse_states &&
+      session->builder->can_rebuild(result.syntax_grammar, result.lexical_grammar)) {
+    result.tables = session->builder->rebuild(result.lexical_grammar);
+  } else {
+    unique_ptr<ParseTableBuilder> builder = ParseTableBuilder::create(
+      result.syntax_grammar,
+      result.lexical_grammar,
+      thread_count,
+      reorder_parse_states,
+      session != nullptr
+    );
+    result.tables = builder->build();
+    if (session) {
+      session->builder = move(builder);
+      session->reorder_parse_states = reorder_parse_states;
+    }
   }
+  result.error = result.tables.error;
+
+  // The table builder only measures its own phases.
+  TSCompileProfile table_profile = result.tables.profile;
+  table_profile.parse_grammar_micros = result.profile.parse_grammar_micros;
+  table_profile.prepare_grammar_micros = result.profile.prepare_grammar_micros;
+  result.profile = table_profile;
+  return result;
+}
+
+extern "C" TSCompileResult ts_compile_grammar(const char *input) {
+  return ts_compile_grammar_with_options(input, TSCompileOptions{});
+}
 
-  auto builder = build_tables::ParseTableBuilder::create(syntax_grammar, lexical_grammar);
-  auto build_tables_result = builder->build();
-  error = build_tables_result.error;
-  if (error.type != 0) {
-    return {nullptr, strdup(error.message.c_str()), error.type};
+static TSCompileResult compile_c_code(const char *input, TSCompileOptions options,
+                                      generate_code::CodeWriter writer,
+                                      TSCompileSession *session = nullptr) {
+  CompiledGrammar build_result = build(input, options.thread_count, options.reorder_parse_states, session);
+  if (build_result.error.type != 0) {
+    return {
+      nullptr,
+      strdup(build_result.error.message.c_str()),
+      build_result.error.type,
+      build_result.profile
+    };
   }
 
+  auto start_time = Clock::now();
   string code = generate_code::c_code(
-    parse_result.name,
-    move(build_tables_result.parse_table),
-    move(build_tables_result.main_lex_table),
-    move(build_tables_result.keyword_lex_table),
-    build_tables_result.keyword_capture_token,
-    move(syntax_grammar),
-    move(lexical_grammar)
+    build_result.name,
+    move(build_result.tables.parse_table),
+    move(build_result.tables.main_lex_table),
+    move(build_result.tables.keyword_lex_table),
+    build_result.tables.keyword_capture_token,
+    move(build_result.syntax_grammar),
+    move(build_result.lexical_grammar),
+    options.use_lex_tables,
+    options.compact_code,
+    options.specialize_table_lookups,
+    options.narrow_parse_table_rows,
+    writer
   );
+  build_result.profile.generate_code_micros = micros_since(start_time);
 
-  return {
-    strdup(code.c_str()), nullptr, TSCompileErrorTypeNone };
+  return {writer ? nullptr : strdup(code.c_str()), nullptr, TSCompileErrorTypeNone, build_result.profile};
+}
+
+extern "C" TSCompileResult ts_compile_grammar_with_options(const char *input,
+                                                           TSCompileOptions options) {
+  return compile_c_code(input, options, nullptr);
+}
+
+extern "C" TSCompileResult ts_compile_grammar_to_writer(const char *input,
+                                                        TSCompileOptions options,
+                                                        TSCompileWriteCallback callback,
+                                                        void *payload) {
+  return compile_c_code(input, options, [callback, payload](const char *text, size_t length) {
+    callback(payload, text, length);
+  });
+}
+
+extern "C" TSCompileResult ts_compile_grammar_to_file(const char *input,
+                                                      TSCompileOptions options,
+                                                      FILE *file) {
+  return compile_c_code(input, options, [file](const char *text, size_t length) {
+    fwrite(text, 1, length, file);
+  });
+}
+
+extern "C" TSCompileResult ts_compile_grammar_cached(const char *input,
+                                                    TSCompileOptions options,
+                                                    const char *cache_directory) {
+  string key = compile_cache_key(input, options);
+  string code;
+  if (!key.empty() && read_compile_cache(cache_directory, key, &code)) {
+    TSCompileProfile profile = TSCompileProfile();
+    profile.loaded_from_cache = true;
+    return {strdup(code.c_str()), nullptr, TSCompileErrorTypeNone, profile};
+  }
+
+  TSCompileResult result = ts_compile_grammar_with_options(input, options);
+  if (!key.empty() && result.error_type == TSCompileErrorTypeNone) {
+    write_compile_cache(cache_directory, key, result.code);
+  }
+  return result;
+}
+
+extern "C" TSCompileSession *ts_compile_session_new() {
+  return new TSCompileSession{nullptr, false};
+}
+
+extern "C" void ts_compile_session_free(TSCompileSession *session) {
+  delete session;
+}
+
+extern "C" TSCompileResult ts_compile_session_compile(TSCompileSession *session, const char *input,
+                                                      TSCompileOptions options) {
+  return compile_c_code(input, options, nullptr, session);
+}
+
+extern "C" TSCompileResult ts_compile_grammar_binary(const char *input, uint32_t *length) {
+  *length = 0;
+  CompiledGrammar build_result = build(input, 0, false);
+  if (build_result.error.type != 0) {
+    return {
+      nullptr,
+      strdup(build_result.error.message.c_str()),
+      build_result.error.type,
+      build_result.profile
+    };
+  }
+
+  // External scanners are written in C, so they can't be part of a binary
+  // language.
+  if (!build_result.syntax_grammar.external_tokens.empty()) {
+    return {
+      nullptr,
+      strdup("Grammars with external tokens can't be compiled to binary languages"),
+      TSCompileErrorTypeInvalidExternalToken,
+      build_result.profile
+    };
+  }
+
+  if (!generate_code::can_encode_lex_table(build_result.tables.main_lex_table) ||
+      !generate_code::can_encode_lex_table(build_result.tables.keyword_lex_table)) {
+    return {
+      nullptr,
+      strdup("The grammar's lex table has too many states for a binary language"),
+      TSCompileErrorTypeLexConflict,
+      build_result.profile
+    };
+  }
+
+  auto start_time = Clock::now();
+  string data = generate_code::binary_language(
+    move(build_result.tables.parse_table),
+    move(build_result.tables.main_lex_table),
+    move(build_result.tables.keyword_lex_table),
+    build_result.tables.keyword_capture_token,
+    move(build_result.syntax_grammar),
+    move(build_result.lexical_grammar)
+  );
+
+  char *code = static_cast<char *>(malloc(data.size()));
+  memcpy(code, data.data(), data.size());
+  *length = data.size();
+  build_result.profile.generate_code_micros = micros_since(start_time);
+  return {code, nullptr, TSCompileErrorTypeNone, build_result.profile};
+}
+
+extern "C" TSCompileResult ts_compile_grammar_conflict_report(const char *input,
+                                                             TSCompileOptions options) {
+  CompiledGrammar build_result = build(input, options.thread_count, options.reorder_parse_states);
+  if (build_result.error.type != 0) {
+    return {
+      nullptr,
+      strdup(build_result.error.message.c_str()),
+      build_result.error.type,
+      build_result.profile
+    };
+  }
+
+  string report = generate_code::conflict_report(
+    build_result.tables.parse_table,
+    build_result.syntax_grammar,
+    build_result.lexical_grammar
+  );
+  return {strdup(report.c_str()), nullptr, TSCompileErrorTypeNone, build_result.profile};
 }
 
 }  // namespace tree_sitter
@@ -0,0 +1,154 @@
+#include "compiler/compile_cache.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+#include "tree_sitter/runtime.h"
+#include "json.h"
+
+namespace tree_sitter {
+
+using std::string;
+using std::to_string;
+
+// This must be incremented whenever a change to the compiler changes the code
+// that it generates, so that code which was cached by an older compiler is
+// not reused.
+static const unsigned COMPILE_CACHE_VERSION = 4;
+
+static void append_json_string(string *result, const char *chars, unsigned length) {
+  static const char hex_digits[] = "0123456789abcdef";
+  *result += '"';
+  for (unsigned i = 0; i < length; i++) {
+    unsigned char c = chars[i];
+    if (c == '"' || c == '\\') {
+      *result += '\\';
+      *result += c;
+    } else if (c < 0x20) {
+      *result += "\\u00";
+      *result += hex_digits[c >> 4];
+      *result += hex_digits[c & 0xf];
+    } else {
+      *result += c;
+    }
+  }
+  *result += '"';
+}
+
+// Write the JSON back out without whitespace or comments, so that grammars
+// which differ only in their formatting have the same key. The order of the
+// properties is kept, because the order of the rules is significant.
+static void append_json_value(string *result, const json_value *value) {
+  switch (value->type) {
+    case json_object:
+      *result += '{';
+      for (unsigned i = 0; i < value->u.object.length; i++) {
+        if (i > 0) *result += ',';
+        const json_object_entry &entry = value->u.object.values[i];
+        append_json_string(result, entry.name, entry.name_length);
+        *result += ':';
+        append_json_value(result, entry.value);
+      }
+      *result += '}';
+      break;
+    case json_array:
+      *result += '[';
+      for (unsigned i = 0; i < value->u.array.length; i++) {
+        if (i > 0) *result += ',';
+        append_json_value(result, value->u.array.values[i]);
+      }
+      *result += ']';
+      break;
+    case json_string:
+      append_json_string(result, value->u.string.ptr, value->u.string.length);
+      break;
+    case json_integer:
+      *result += to_string(value->u.integer);
+      break;
+    case json_double: {
+      char buffer[32];
+      snprintf(buffer, sizeof(buffer), "%.17g", value->u.dbl);
+      *result += buffer;
+      break;
+    }
+    case json_boolean:
+      *result += value->u.boolean ? "true" : "false";
+      break;
+    default:
+      *result += "null";
+      break;
+  }
+}
+
+// 64-bit FNV-1a, which unlike `std::hash` is the same in every build, so that
+// the keys stay valid across builds of the compiler.
+static uint64_t hash_string(const string &input) {
+  uint64_t result = 0xcbf29ce484222325ull;
+  for (unsigned char c : input) {
+    result ^= c;
+    result *= 0x100000001b3ull;
+  }
+  return result;
+}
+
+static string cache_path(const string &directory, const string &key) {
+  return directory + "/" + key + ".c";
+}
+
+// The key is empty if the grammar isn't valid JSON, in which case the grammar
+// can't be cached.
+string compile_cache_key(const string &grammar_json, const TSCompileOptions &options) {
+  json_settings settings = { 0, json_enable_comments, 0, 0, 0, 0 };
+  char parse_error[json_error_max];
+  json_value *value = json_parse_ex(&settings, grammar_json.c_str(), grammar_json.size(), parse_error);
+  if (!value) return "";
+
+  // The thread count doesn't affect the generated code, so it isn't part of
+  // the key.
+  string input =
+    to_string(COMPILE_CACHE_VERSION) + " " +
+    to_string(TREE_SITTER_LANGUAGE_VERSION) + " " +
+    to_string(options.use_lex_tables) + " " +
+    to_string(options.compact_code) + " " +
+    to_string(options.specialize_table_lookups) + " " +
+    to_string(options.reorder_parse_states) + " " +
+    to_string(options.narrow_parse_table_rows) + "\n";
+  append_json_value(&input, value);
+  json_value_free(value);
+
+  char result[17];
+  snprintf(result, sizeof(result), "%016llx", static_cast<unsigned long long>(hash_string(input)));
+  return result;
+}
+
+bool read_compile_cache(const string &directory, const string &key, string *code) {
+  std::ifstream file(cache_path(directory, key), std::ios::binary);
+  if (!file) return false;
+  std::ostringstream contents;
+  contents << file.rdbuf();
+  if (file.bad()) return false;
+  *code = contents.str();
+  return !code->empty();
+}
+
+// The code is written to a temporary file, which is then renamed, so that a
+// process that compiles the same grammar at the same time never reads a file
+// that is partly written.
+void write_compile_cache(const string &directory, const string &key, const string &code) {
+  size_t suffix = std::hash<std::thread::id>()(std::this_thread::get_id()) ^
+    static_cast<size_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+  string path = cache_path(directory, key);
+  string temporary_path = path + "." + to_string(suffix) + ".tmp";
+
+  std::ofstream file(temporary_path, std::ios::binary);
+  if (!file) return;
+  file << code;
+  file.close();
+  if (!file || std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+    std::remove(temporary_path.c_str());
+  }
+}
+
+}  // namespace tree_sitter
@@ -0,0 +1,15 @@
+#ifndef COMPILER_COMPILE_CACHE_H_
+#define COMPILER_COMPILE_CACHE_H_
+
+#include <string>
+#include "tree_sitter/compiler.h"
+
+namespace tree_sitter {
+
+std::string compile_cache_key(const std::string &grammar_json, const TSCompileOptions &);
+bool read_compile_cache(const std::string &directory, const std::string &key, std::string *code);
+void write_compile_cache(const std::string &directory, const std::string &key, const std::string &code);
+
+}  // namespace tree_sitter
+
+#endif  // COMPILER_COMPILE_CACHE_H_
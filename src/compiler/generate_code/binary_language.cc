@@ -0,0 +1,318 @@
+#include "compiler/generate_code/binary_language.h"
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include "compiler/generate_code/lex_table_encoding.h"
+#include "compiler/lex_table.h"
+#include "compiler/parse_table.h"
+#include "compiler/syntax_grammar.h"
+#include "compiler/lexical_grammar.h"
+#include "compiler/rule.h"
+#include "tree_sitter/parser.h"
+#include "tree_sitter/runtime.h"
+
+namespace tree_sitter {
+namespace generate_code {
+
+using std::map;
+using std::move;
+using std::pair;
+using std::set;
+using std::string;
+using std::vector;
+using rules::Symbol;
+using rules::Alias;
+
+static const char BINARY_LANGUAGE_MAGIC[] = "TSLB";
+static const uint32_t BINARY_LANGUAGE_FORMAT_VERSION = 1;
+
+// This writes the same tables as the C code generator, in the format that is
+// read by `ts_language_load`.
+class BinaryLanguageGenerator {
+  string buffer;
+
+  const ParseTable parse_table;
+  const LexTable main_lex_table;
+  const LexTable keyword_lex_table;
+  Symbol keyword_capture_token;
+  const SyntaxGrammar syntax_grammar;
+  const LexicalGrammar lexical_grammar;
+  map<Symbol, uint16_t> symbol_indices;
+  map<Alias, uint16_t> alias_indices;
+  vector<pair<size_t, ParseTableEntry>> parse_table_entries;
+  size_t next_parse_action_list_index;
+  size_t large_state_count;
+
+ public:
+  BinaryLanguageGenerator(ParseTable &&parse_table, LexTable &&main_lex_table,
+                          LexTable &&keyword_lex_table, Symbol keyword_capture_token,
+                          SyntaxGrammar &&syntax_grammar, LexicalGrammar &&lexical_grammar)
+      : parse_table(move(parse_table)),
+        main_lex_table(move(main_lex_table)),
+        keyword_lex_table(move(keyword_lex_table)),
+        keyword_capture_token(keyword_capture_token),
+        syntax_grammar(move(syntax_grammar)),
+        lexical_grammar(move(lexical_grammar)),
+        next_parse_action_list_index(0),
+        large_state_count(0) {}
+
+  string code() {
+    buffer = "";
+
+    size_t token_count = 0;
+    uint16_t next_index = 1;
+    for (const Symbol &symbol : parse_table.symbols) {
+      if (symbol.is_terminal()) token_count++;
+      if (symbol == rules::END_OF_INPUT()) {
+        symbol_indices[symbol] = 0;
+      } else if (!symbol.is_built_in()) {
+        symbol_indices[symbol] = next_index++;
+      }
+    }
+    for (const AliasSequence &alias_sequence : parse_table.alias_sequences) {
+      for (const Alias &alias : alias_sequence) {
+        if (!alias.value.empty()) alias_indices.insert({alias, 0});
+      }
+    }
+    for (auto &pair : alias_indices) pair.second = next_index++;
+
+    large_state_count = parse_table.large_state_count();
+
+    buffer.append(BINARY_LANGUAGE_MAGIC, 4);
+    add_u32(BINARY_LANGUAGE_FORMAT_VERSION);
+    add_u32(TREE_SITTER_LANGUAGE_VERSION);
+    add_u32(parse_table.symbols.size());
+    add_u32(alias_indices.size());
+    add_u32(token_count);
+    add_u32(0);
+    add_u32(parse_table.states.size());
+    add_u32(large_state_count);
+    add_u32(parse_table.max_alias_sequence_length);
+    add_u32(keyword_capture_token == rules::NONE() ? 0 : symbol_indices[keyword_capture_token]);
+
+    add_symbols();
+    add_parse_table();
+    add_lex_modes();
+    add_alias_sequences();
+    add_lex_table(main_lex_table);
+    add_lex_table(keyword_capture_token == rules::NONE() ? LexTable() : keyword_lex_table);
+
+    return buffer;
+  }
+
+ private:
+  void add_symbols() {
+    string names;
+    string metadata;
+    for (const Symbol &symbol : parse_table.symbols) {
+      if (symbol.is_built_in() && symbol != rules::END_OF_INPUT()) continue;
+      pair<string, VariableType> entry = entry_for_symbol(symbol);
+      names += entry.first;
+      names += '\0';
+      switch (entry.second) {
+        case VariableTypeNamed: metadata += '\3'; break;
+        case VariableTypeAnonymous: metadata += '\1'; break;
+        case VariableTypeHidden: metadata += '\2'; break;
+        case VariableTypeAuxiliary: metadata += '\0'; break;
+      }
+    }
+    for (const auto &pair : alias_indices) {
+      names += pair.first.value;
+      names += '\0';
+      metadata += pair.first.is_named ? '\3' : '\1';
+    }
+    add_section(vector<char>(names.begin(), names.end()));
+    add_section(vector<char>(metadata.begin(), metadata.end()));
+  }
+
+  void add_parse_table() {
+    add_parse_action_list_id(ParseTableEntry{ {}, false });
+
+    vector<uint16_t> large_table(large_state_count * parse_table.symbols.size(), 0);
+    for (size_t state_id = 0; state_id < large_state_count; state_id++) {
+      const ParseState &state = parse_table.states[state_id];
+      uint16_t *row = &large_table[state_id * parse_table.symbols.size()];
+      for (const auto &entry : state.nonterminal_entries) {
+        row[symbol_indices[Symbol::non_terminal(entry.first)]] = entry.second;
+      }
+      for (const auto &entry : state.terminal_entries) {
+        row[symbol_indices[entry.first]] = add_parse_action_list_id(entry.second);
+      }
+    }
+
+    // Small states are stored as groups of symbols that map to the same
+    // value, as in the generated C code.
+    vector<uint16_t> small_table;
+    vector<uint32_t> small_table_map;
+    for (size_t state_id = large_state_count; state_id < parse_table.states.size(); state_id++) {
+      const ParseState &state = parse_table.states[state_id];
+      map<pair<bool, size_t>, vector<uint16_t>> symbols_by_value;
+      for (const auto &entry : state.nonterminal_entries) {
+        symbols_by_value[{false, entry.second}].push_back(symbol_indices[Symbol::non_terminal(entry.first)]);
+      }
+      for (const auto &entry : state.terminal_entries) {
+        symbols_by_value[{true, add_parse_action_list_id(entry.second)}].push_back(symbol_indices[entry.first]);
+      }
+
+      small_table_map.push_back(small_table.size());
+      small_table.push_back(symbols_by_value.size());
+      for (const auto &pair : symbols_by_value) {
+        small_table.push_back(pair.first.second);
+        small_table.push_back(pair.second.size());
+        small_table.insert(small_table.end(), pair.second.begin(), pair.second.end());
+      }
+    }
+
+    add_section(large_table);
+    add_section(small_table);
+    add_section(small_table_map);
+    add_parse_actions();
+  }
+
+  void add_parse_actions() {
+    vector<uint16_t> fields;
+    for (const auto &pair : parse_table_entries) {
+      fields.push_back(pair.second.actions.size());
+      fields.push_back(pair.second.reusable);
+      fields.push_back(0);
+      fields.push_back(0);
+
+      for (const ParseAction &action : pair.second.actions) {
+        uint16_t action_fields[4] = {0, 0, 0, 0};
+        switch (action.type) {
+          case ParseActionTypeShift:
+            action_fields[0] = TSParseActionTypeShift;
+            if (action.extra) {
+              action_fields[2] = 1;
+            } else {
+              action_fields[1] = action.state_index;
+              action_fields[2] = action.repetition ? 2 : 0;
+            }
+            break;
+          case ParseActionTypeReduce:
+            action_fields[0] = TSParseActionTypeReduce;
+            action_fields[1] = symbol_indices[action.symbol];
+            action_fields[2] = static_cast<uint16_t>(static_cast<int16_t>(action.dynamic_precedence));
+            action_fields[3] = action.consumed_symbol_count | (action.alias_sequence_id << 8);
+            break;
+          case ParseActionTypeAccept:
+            action_fields[0] = TSParseActionTypeAccept;
+            break;
+          case ParseActionTypeRecover:
+            action_fields[0] = TSParseActionTypeRecover;
+            break;
+          default:
+            break;
+        }
+        fields.insert(fields.end(), action_fields, action_fields + 4);
+      }
+    }
+    add_section(fields);
+  }
+
+  void add_lex_modes() {
+    vector<uint16_t> lex_modes;
+    for (const ParseState &state : parse_table.states) {
+      lex_modes.push_back(state.lex_state_id);
+      lex_modes.push_back(0);
+    }
+    add_section(lex_modes);
+  }
+
+  void add_alias_sequences() {
+    vector<uint16_t> alias_sequences;
+    if (parse_table.alias_sequences.size() > 1) {
+      for (const AliasSequence &sequence : parse_table.alias_sequences) {
+        for (unsigned i = 0; i < parse_table.max_alias_sequence_length; i++) {
+          if (i < sequence.size() && !sequence[i].value.empty()) {
+            alias_sequences.push_back(alias_indices[sequence[i]]);
+          } else {
+            alias_sequences.push_back(0);
+          }
+        }
+      }
+    }
+    add_section(alias_sequences);
+  }
+
+  void add_lex_table(const LexTable &lex_table) {
+    EncodedLexTable table = encode_lex_table(lex_table, [&](const Symbol &symbol) {
+      return symbol_indices[symbol];
+    });
+    if (lex_table.states.empty()) table = EncodedLexTable{0, 0, {}, {}, {}, {}, {}, {}};
+    add_section(vector<uint32_t>{table.state_count, table.class_count});
+    add_section(table.accept_symbols);
+    add_section(table.row_offsets);
+    add_section(table.transitions);
+    add_section(table.ascii_classes);
+    add_section(table.range_starts);
+    add_section(table.range_classes);
+  }
+
+  size_t add_parse_action_list_id(const ParseTableEntry &entry) {
+    for (const auto &pair : parse_table_entries) {
+      if (pair.second == entry) {
+        return pair.first;
+      }
+    }
+
+    size_t result = next_parse_action_list_index;
+    parse_table_entries.push_back({ next_parse_action_list_index, entry });
+    next_parse_action_list_index += 1 + entry.actions.size();
+    return result;
+  }
+
+  pair<string, VariableType> entry_for_symbol(const Symbol &symbol) {
+    if (symbol == rules::END_OF_INPUT()) return { "END", VariableTypeHidden };
+    switch (symbol.type) {
+      case Symbol::NonTerminal: {
+        const SyntaxVariable &variable = syntax_grammar.variables[symbol.index];
+        return { variable.name, variable.type };
+      }
+      case Symbol::Terminal: {
+        const LexicalVariable &variable = lexical_grammar.variables[symbol.index];
+        return { variable.name, variable.type };
+      }
+      case Symbol::External:
+      default: {
+        const ExternalToken &token = syntax_grammar.external_tokens[symbol.index];
+        return { token.name, token.type };
+      }
+    }
+  }
+
+  // Integers are written in little-endian order, regardless of the host's.
+  void add_u32(uint32_t value) {
+    for (unsigned i = 0; i < 4; i++) buffer += static_cast<char>((value >> (8 * i)) & 0xFF);
+  }
+
+  template <typename T>
+  void add_section(const vector<T> &elements) {
+    add_u32(elements.size() * sizeof(T));
+    for (T element : elements) {
+      for (unsigned i = 0; i < sizeof(T); i++) {
+        buffer += static_cast<char>((static_cast<uint32_t>(element) >> (8 * i)) & 0xFF);
+      }
+    }
+    while (buffer.size() % 4 != 0) buffer += '\0';
+  }
+};
+
+string binary_language(ParseTable &&parse_table, LexTable &&lex_table,
+                       LexTable &&keyword_lex_table, Symbol keyword_capture_token,
+                       SyntaxGrammar &&syntax_grammar, LexicalGrammar &&lexical_grammar) {
+  return BinaryLanguageGenerator(
+    move(parse_table),
+    move(lex_table),
+    move(keyword_lex_table),
+    keyword_capture_token,
+    move(syntax_grammar),
+    move(lexical_grammar)
+  ).code();
+}
+
+}  // namespace generate_code
+}  // namespace tree_sitter
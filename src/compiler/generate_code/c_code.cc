@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <functional>
 #include <map>
 #include <set>
@@ -5,6 +6,8 @@
 #include <utility>
 #include <vector>
 #include "compiler/generate_code/c_code.h"
+#include "compiler/generate_code/keyword_table_encoding.h"
+#include "compiler/generate_code/lex_table_encoding.h"
 #include "compiler/lex_table.h"
 #include "compiler/parse_table.h"
 #include "compiler/syntax_grammar.h"
@@ -18,6 +21,7 @@ namespace generate_code {
 
 using std::function;
 using std::map;
+using std::max;
 using std::move;
 using std::pair;
 using std::set;
@@ -25,9 +29,14 @@ using std::string;
 using std::to_string;
 using std::vector;
 using util::escape_char;
+using util::escape_string;
 using rules::Symbol;
 using rules::Alias;
 
+static const uint32_t CHARACTER_CLASS_SIZE = 128;
+static const size_t ASCII_CLASS_MIN_RANGE_COUNT = 3;
+static const size_t OUTPUT_CHUNK_SIZE = 64 * 1024;
+
 static const map<char, string> REPLACEMENTS({
   { '~', "TILDE" },
   { '`', "BQUOTE" },
@@ -68,6 +77,7 @@ static const map<char, string> REPLACEMENTS({
 class CCodeGenerator {
   string buffer;
   size_t indent_level;
+  CodeWriter writer;
 
   const string name;
   const ParseTable parse_table;
@@ -80,13 +90,33 @@ class CCodeGenerator {
   vector<pair<size_t, ParseTableEntry>> parse_table_entries;
   vector<set<Symbol::Index>> external_scanner_states;
   size_t next_parse_action_list_index;
+  size_t large_state_count;
   set<Alias> unique_aliases;
+  map<Symbol, uint16_t> symbol_indices;
+  map<Alias, uint16_t> alias_indices;
+  size_t token_count;
+  bool use_lex_tables;
+  bool use_keyword_table;
+  bool compact_code;
+  bool specialize_table_lookups;
+  bool narrow_parse_table_rows;
+  bool use_byte_parse_table;
+  bool use_byte_lex_modes;
+  bool use_lex_mode_ids;
+  bool use_byte_lex_mode_ids;
+  bool use_error_start_characters;
+  bool use_alias_sequence_offsets;
+  set<LexStateId> lex_jump_targets;
+  map<vector<uint32_t>, string> ascii_class_names;
 
  public:
   CCodeGenerator(string name, ParseTable &&parse_table, LexTable &&main_lex_table,
                  LexTable &&keyword_lex_table, Symbol keyword_capture_token,
-                 SyntaxGrammar &&syntax_grammar, LexicalGrammar &&lexical_grammar)
+                 SyntaxGrammar &&syntax_grammar, LexicalGrammar &&lexical_grammar,
+                 bool use_lex_tables, bool compact_code, bool specialize_table_lookups,
+                 bool narrow_parse_table_rows, CodeWriter writer)
       : indent_level(0),
+        writer(writer),
         name(name),
         parse_table(move(parse_table)),
         main_lex_table(move(main_lex_table)),
@@ -94,7 +124,20 @@ class CCodeGenerator {
         keyword_capture_token(keyword_capture_token),
         syntax_grammar(move(syntax_grammar)),
         lexical_grammar(move(lexical_grammar)),
-        next_parse_action_list_index(0) {}
+        next_parse_action_list_index(0),
+        large_state_count(0),
+        token_count(0),
+        use_lex_tables(use_lex_tables),
+        use_keyword_table(false),
+        compact_code(compact_code),
+        specialize_table_lookups(specialize_table_lookups),
+        narrow_parse_table_rows(narrow_parse_table_rows),
+        use_byte_parse_table(false),
+        use_byte_lex_modes(false),
+        use_lex_mode_ids(false),
+        use_byte_lex_mode_ids(false),
+        use_error_start_characters(false),
+        use_alias_sequence_offsets(false) {}
 
   string code() {
     buffer = "";
@@ -105,18 +148,36 @@ class CCodeGenerator {
     add_symbol_enum();
     add_symbol_names_list();
     add_symbol_metadata_list();
+    add_symbols_by_name_list();
 
     if (parse_table.alias_sequences.size() > 1) {
       add_alias_sequences();
     }
 
-    add_lex_function("ts_lex", main_lex_table);
+    // Lex tables are only used if every state fits in their transitions.
+    use_lex_tables =
+      use_lex_tables &&
+      can_encode_lex_table(main_lex_table) &&
+      can_encode_lex_table(keyword_lex_table);
+
+    if (use_lex_tables) {
+      add_lex_table("ts_lex_table", main_lex_table);
+    } else {
+      add_lex_function("ts_lex", main_lex_table);
+    }
 
     if (keyword_capture_token != rules::NONE()) {
-      add_lex_function("ts_lex_keywords", keyword_lex_table);
+      if (use_lex_tables) {
+        add_lex_table("ts_keyword_lex_table", keyword_lex_table);
+      } else {
+        add_lex_function("ts_lex_keywords", keyword_lex_table);
+      }
+      add_keyword_table();
     }
 
     add_lex_modes_list();
+    add_error_start_characters();
+    add_descendant_symbol_sets();
 
     if (!syntax_grammar.external_tokens.empty()) {
       add_external_token_enum();
@@ -127,6 +188,10 @@ class CCodeGenerator {
     add_parse_table();
     add_parser_export();
 
+    if (writer) {
+      writer(buffer.data(), buffer.size());
+      buffer.clear();
+    }
     return buffer;
   }
 
@@ -145,7 +210,6 @@ class CCodeGenerator {
   }
 
   void add_stats() {
-    size_t token_count = 0;
     for (const Symbol &symbol : parse_table.symbols) {
       if (symbol.is_terminal()) {
         token_count++;
@@ -165,8 +229,11 @@ class CCodeGenerator {
       }
     }
 
+    large_state_count = parse_table.large_state_count();
+
     line("#define LANGUAGE_VERSION " + to_string(TREE_SITTER_LANGUAGE_VERSION));
     line("#define STATE_COUNT " + to_string(parse_table.states.size()));
+    line("#define LARGE_STATE_COUNT " + to_string(large_state_count));
     line("#define SYMBOL_COUNT " + to_string(parse_table.symbols.size()));
     line("#define ALIAS_COUNT " + to_string(unique_aliases.size()));
     line("#define TOKEN_COUNT " + to_string(token_count));
@@ -175,19 +242,57 @@ class CCodeGenerator {
     line();
   }
 
+  // When the rows of the parse table are narrowed, the terminals and the
+  // nonterminals are each numbered by how many of the large states use them,
+  // most first, so that each row can end after fewer columns. External tokens
+  // keep their numbers, and every token is still numbered before every
+  // nonterminal.
+  vector<Symbol> symbols_in_numbering_order() {
+    vector<Symbol> result(parse_table.symbols.begin(), parse_table.symbols.end());
+    if (!narrow_parse_table_rows) return result;
+
+    map<Symbol, size_t> state_counts;
+    for (size_t state_id = 0; state_id < large_state_count; state_id++) {
+      const ParseState &state = parse_table.states[state_id];
+      for (const auto &entry : state.nonterminal_entries) {
+        state_counts[Symbol::non_terminal(entry.first)]++;
+      }
+      for (const auto &entry : state.terminal_entries) {
+        state_counts[entry.first]++;
+      }
+    }
+
+    auto is_more_used = [&](const Symbol &left, const Symbol &right) {
+      return state_counts[left] > state_counts[right];
+    };
+    auto terminals_begin = find_if(result.begin(), result.end(), [](const Symbol &symbol) {
+      return !symbol.is_external();
+    });
+    auto nonterminals_begin = find_if(terminals_begin, result.end(), [](const Symbol &symbol) {
+      return symbol.is_non_terminal();
+    });
+    stable_sort(terminals_begin, nonterminals_begin, is_more_used);
+    stable_sort(nonterminals_begin, result.end(), is_more_used);
+    return result;
+  }
+
   void add_symbol_enum() {
     line("enum {");
     indent([&]() {
       size_t i = 1;
-      for (const Symbol &symbol : parse_table.symbols) {
-        if (!symbol.is_built_in()) {
+      for (const Symbol &symbol : symbols_in_numbering_order()) {
+        if (symbol == rules::END_OF_INPUT()) {
+          symbol_indices[symbol] = 0;
+        } else if (!symbol.is_built_in()) {
           line(symbol_id(symbol) + " = " + to_string(i) + ",");
+          symbol_indices[symbol] = i;
           i++;
         }
       }
 
       for (const Alias &alias : unique_aliases) {
         line(alias_id(alias) + " = " + to_string(i) + ",");
+        alias_indices[alias] = i;
         i++;
       }
     });
@@ -216,7 +321,79 @@ class CCodeGenerator {
     line();
   }
 
+  // The runtime finds symbols by name with a binary search of this list, so
+  // it is sorted in the same order as the names' bytes. Symbols with the same
+  // name are sorted by number.
+  void add_symbols_by_name_list() {
+    vector<pair<pair<string, size_t>, string>> entries;
+    size_t next_index = 0;
+    for (const Symbol &symbol : parse_table.symbols) {
+      size_t index = symbol_indices[symbol];
+      entries.push_back({{symbol_name(symbol), index}, symbol_id(symbol)});
+      if (index >= next_index) next_index = index + 1;
+    }
+    for (const Alias &alias : unique_aliases) {
+      entries.push_back({{alias.value, next_index++}, alias_id(alias)});
+    }
+    std::sort(entries.begin(), entries.end());
+
+    line("static const TSSymbol ts_symbols_by_name[] = {");
+    indent([&]() {
+      for (const auto &entry : entries) {
+        line(entry.second + ",");
+      }
+    });
+    line("};");
+    line();
+  }
+
   void add_alias_sequences() {
+    // When most sequences are shorter than the longest one, each sequence is
+    // stored without its trailing unaliased children, and the sequences are
+    // found through a list of offsets.
+    vector<size_t> lengths;
+    size_t total_length = 0;
+    for (const AliasSequence &sequence : parse_table.alias_sequences) {
+      size_t length = sequence.size();
+      while (length > 0 && sequence[length - 1].value.empty()) length--;
+      lengths.push_back(length);
+      total_length += length;
+    }
+    size_t dense_size = parse_table.alias_sequences.size() *
+      parse_table.max_alias_sequence_length * sizeof(uint16_t);
+    size_t ragged_size = total_length * sizeof(uint16_t) +
+      (parse_table.alias_sequences.size() + 1) * sizeof(uint32_t);
+    if (total_length > 0 && ragged_size < dense_size) {
+      use_alias_sequence_offsets = true;
+      line("static TSSymbol ts_alias_sequences[] = {");
+      indent([&]() {
+        for (unsigned i = 1, n = parse_table.alias_sequences.size(); i < n; i++) {
+          const AliasSequence &sequence = parse_table.alias_sequences[i];
+          string row;
+          for (unsigned j = 0; j < lengths[i]; j++) {
+            if (j > 0) row += " ";
+            row += (sequence[j].value.empty() ? "0" : alias_id(sequence[j])) + ",";
+          }
+          if (!row.empty()) line(row);
+        }
+      });
+      line("};");
+      line();
+
+      line("static const uint32_t ts_alias_sequence_offsets[] = {");
+      indent([&]() {
+        size_t offset = 0;
+        for (size_t length : lengths) {
+          line(to_string(offset) + ",");
+          offset += length;
+        }
+        line(to_string(offset) + ",");
+      });
+      line("};");
+      line();
+      return;
+    }
+
     line(
       "static TSSymbol ts_alias_sequences[" +
       to_string(parse_table.alias_sequences.size()) +
@@ -284,13 +461,55 @@ class CCodeGenerator {
   }
 
   void add_lex_function(string name, const LexTable &lex_table) {
+    bool has_character_classes = false;
+    for (size_t i = 0; i < lex_table.states.size(); i++) {
+      auto character_class = self_loop_character_class(lex_table.states[i], i);
+      if (!character_class.empty()) {
+        add_character_class(name + "_character_class_" + to_string(i), character_class);
+        has_character_classes = true;
+      }
+    }
+    for (const LexState &state : lex_table.states) {
+      rules::CharacterSet ruled_out_characters;
+      for (const auto &pair : state.advance_actions) {
+        if (pair.first.is_empty()) continue;
+        vector<uint32_t> ascii_class = ascii_class_for_condition(pair.first, ruled_out_characters);
+        if (!ascii_class.empty() && !ascii_class_names.count(ascii_class)) {
+          string class_name = "ts_ascii_class_" + to_string(ascii_class_names.size());
+          ascii_class_names.insert({ascii_class, class_name});
+          add_character_class(class_name, ascii_class);
+          has_character_classes = true;
+        }
+        if (!pair.first.includes_all) ruled_out_characters.add_set(pair.first);
+      }
+    }
+    if (has_character_classes) line();
+
+    // The switch is only used to find the initial state. Each transition
+    // jumps straight to the label of the state that it leads to, so only
+    // those states need labels.
+    lex_jump_targets.clear();
+    for (const LexState &state : lex_table.states) {
+      for (const auto &pair : state.advance_actions) {
+        if (!pair.first.is_empty()) lex_jump_targets.insert(pair.second.state_index);
+      }
+    }
+
     line("static bool " + name + "(TSLexer *lexer, TSStateId state) {");
     indent([&]() {
-      line("START_LEXER();");
+      line("START_DIRECT_LEXER();");
       _switch("state", [&]() {
-        size_t i = 0;
-        for (const LexState &state : lex_table.states) {
-          _case(to_string(i++), [&]() { add_lex_state(state); });
+        if (compact_code) {
+          add_deduplicated_lex_states(name, lex_table);
+        } else {
+          for (size_t i = 0; i < lex_table.states.size(); i++) {
+            line("case " + to_string(i) + ":");
+            add_lex_state_label(i);
+            indent([&]() {
+              add_lex_state(lex_table.states[i], i, name + "_character_class_" + to_string(i));
+            });
+            flush();
+          }
         }
         _default([&]() { line("return false;"); });
       });
@@ -299,6 +518,266 @@ class CCodeGenerator {
     line();
   }
 
+  // States whose code is the same share a single case, with a label for each
+  // of them.
+  void add_deduplicated_lex_states(const string &name, const LexTable &lex_table) {
+    vector<string> bodies;
+    vector<vector<size_t>> state_ids_by_body;
+    map<string, size_t> body_indices;
+    for (size_t i = 0; i < lex_table.states.size(); i++) {
+      string enclosing_buffer = move(buffer);
+      buffer = "";
+      indent([&]() {
+        add_lex_state(lex_table.states[i], i, name + "_character_class_" + to_string(i));
+      });
+      auto insertion = body_indices.insert({buffer, bodies.size()});
+      if (insertion.second) {
+        bodies.push_back(move(buffer));
+        state_ids_by_body.push_back({});
+      }
+      state_ids_by_body[insertion.first->second].push_back(i);
+      buffer = move(enclosing_buffer);
+    }
+
+    for (size_t i = 0; i < bodies.size(); i++) {
+      for (size_t state_id : state_ids_by_body[i]) {
+        line("case " + to_string(state_id) + ":");
+      }
+      for (size_t state_id : state_ids_by_body[i]) {
+        add_lex_state_label(state_id);
+      }
+      add(bodies[i]);
+      flush();
+    }
+  }
+
+  void add_lex_state_label(LexStateId state_id) {
+    if (lex_jump_targets.count(state_id)) {
+      line("LEX_STATE(" + to_string(state_id) + ")");
+    }
+  }
+
+  // Instead of a function with a case for each state, write the arrays of a
+  // `TSLexTable`, which the runtime interprets with a single loop.
+  void add_lex_table(string name, const LexTable &lex_table) {
+    EncodedLexTable table = encode_lex_table(lex_table, [](const Symbol &) { return 0; });
+
+    line("static const uint16_t " + name + "_accept_symbols[" + to_string(table.state_count) + "] = {");
+    indent([&]() {
+      for (size_t i = 0; i < lex_table.states.size(); i++) {
+        const AcceptTokenAction &accept_action = lex_table.states[i].accept_action;
+        if (accept_action.is_present()) {
+          line("[" + to_string(i) + "] = " + symbol_id(accept_action.symbol) + " + 1,");
+        }
+      }
+    });
+    line("};");
+    line();
+
+    add_integer_list("static const uint32_t " + name + "_row_offsets[]", table.row_offsets);
+    add_integer_list("static const uint16_t " + name + "_transitions[]", table.transitions);
+    add_integer_list("static const uint16_t " + name + "_ascii_classes[]", table.ascii_classes);
+
+    table.range_starts.erase(table.range_starts.begin());
+    line("static const int32_t " + name + "_range_starts[] = {");
+    indent([&]() {
+      line("INT32_MIN,");
+      add_integers(table.range_starts);
+    });
+    line("};");
+    line();
+    add_integer_list("static const uint16_t " + name + "_range_classes[]", table.range_classes);
+
+    line("static const TSLexTable " + name + " = {");
+    indent([&]() {
+      line(".state_count = " + to_string(table.state_count) + ",");
+      line(".class_count = " + to_string(table.class_count) + ",");
+      line(".accept_symbols = " + name + "_accept_symbols,");
+      line(".row_offsets = " + name + "_row_offsets,");
+      line(".transitions = " + name + "_transitions,");
+      line(".ascii_classes = " + name + "_ascii_classes,");
+      line(".range_count = " + to_string(table.range_classes.size()) + ",");
+      line(".range_starts = " + name + "_range_starts,");
+      line(".range_classes = " + name + "_range_classes,");
+    });
+    line("};");
+    line();
+  }
+
+  // The keyword lex function is still needed for input that isn't UTF-8, and
+  // for keywords that span chunks of the input.
+  void add_keyword_table() {
+    EncodedKeywordTable table;
+    use_keyword_table = encode_keyword_table(lexical_grammar, keyword_lex_table, &table);
+    if (!use_keyword_table) return;
+
+    add_integer_list("static const uint16_t ts_keyword_table_displacements[]", table.displacements);
+
+    line("static const TSKeyword ts_keyword_table_slots[" + to_string(table.slots.size()) + "] = {");
+    indent([&]() {
+      for (size_t i = 0; i < table.slots.size(); i++) {
+        const auto &slot = table.slots[i];
+        if (slot.second == rules::NONE()) continue;
+        line(
+          "[" + to_string(i) + "] = {\"" + escape_string(slot.first) + "\", " +
+          to_string(slot.first.size()) + ", " + symbol_id(slot.second) + "},"
+        );
+      }
+    });
+    line("};");
+    line();
+
+    line("static const TSKeywordTable ts_keyword_table = {");
+    indent([&]() {
+      line(".seed = " + to_string(table.seed) + ",");
+      line(".displacement_count = " + to_string(table.displacements.size()) + ",");
+      line(".slot_count = " + to_string(table.slots.size()) + ",");
+      line(".displacements = ts_keyword_table_displacements,");
+      line(".slots = ts_keyword_table_slots,");
+    });
+    line("};");
+    line();
+  }
+
+  template <typename T>
+  void add_integer_list(const string &declaration, const vector<T> &values) {
+    line(declaration + " = {");
+    indent([&]() { add_integers(values); });
+    line("};");
+    line();
+  }
+
+  template <typename T>
+  void add_integers(const vector<T> &values) {
+    for (size_t i = 0; i < values.size(); i++) {
+      if (i % 16 == 0) {
+        flush();
+        line(to_string(values[i]) + ",");
+      } else {
+        add(" " + to_string(values[i]) + ",");
+      }
+    }
+  }
+
+  // In the error state, the lexer skips characters one at a time until a
+  // token can be lexed. The ASCII characters that can begin a token or a
+  // separator in that state's lex state are listed, so that the others can be
+  // skipped without trying to lex at each of them.
+  void add_error_start_characters() {
+    const LexState &lex_state = main_lex_table.states[parse_table.states[0].lex_state_id];
+    if (lex_state.accept_action.is_present()) return;
+
+    vector<uint32_t> words(CHARACTER_CLASS_SIZE / 32, 0);
+    for (uint32_t c = 0; c < CHARACTER_CLASS_SIZE; c++) {
+      for (const auto &pair : lex_state.advance_actions) {
+        if (pair.first.contains(c)) {
+          words[c / 32] |= 1u << (c % 32);
+          break;
+        }
+      }
+    }
+
+    for (uint32_t word : words) {
+      if (word != UINT32_MAX) {
+        use_error_start_characters = true;
+        add_character_class("ts_error_start_characters", words);
+        line();
+        line();
+        return;
+      }
+    }
+  }
+
+  // For each nonterminal, the symbols that can appear beneath its nodes, as a
+  // set of bits indexed by symbol, including the aliases. These are the
+  // symbols and aliases in its productions, and in those of the nonterminals
+  // that they contain, along with the extras, which can appear anywhere. A
+  // tree with errors can contain anything, so the runtime only consults these
+  // sets for trees without errors. Many nonterminals have the same set, so
+  // the distinct sets are stored once, and each nonterminal stores the index
+  // of its set.
+  void add_descendant_symbol_sets() {
+    size_t word_count = (parse_table.symbols.size() + unique_aliases.size() + 31) / 32;
+    size_t variable_count = syntax_grammar.variables.size();
+    vector<vector<uint32_t>> sets(variable_count, vector<uint32_t>(word_count, 0));
+    vector<set<Symbol::Index>> child_variables(variable_count);
+
+    auto add_symbol = [&](vector<uint32_t> &words, const Symbol &symbol) {
+      auto entry = symbol_indices.find(symbol);
+      if (entry != symbol_indices.end()) words[entry->second / 32] |= 1u << (entry->second % 32);
+      if (symbol.is_external()) {
+        Symbol internal_token = syntax_grammar.external_tokens[symbol.index].corresponding_internal_token;
+        if (internal_token != rules::NONE()) {
+          entry = symbol_indices.find(internal_token);
+          if (entry != symbol_indices.end()) words[entry->second / 32] |= 1u << (entry->second % 32);
+        }
+      }
+    };
+
+    for (size_t i = 0; i < variable_count; i++) {
+      for (const Production &production : syntax_grammar.variables[i].productions) {
+        for (const ProductionStep &step : production) {
+          add_symbol(sets[i], step.symbol);
+          if (step.symbol.is_non_terminal()) child_variables[i].insert(step.symbol.index);
+          if (!step.alias.value.empty()) {
+            uint16_t index = alias_indices[step.alias];
+            sets[i][index / 32] |= 1u << (index % 32);
+          }
+        }
+      }
+      for (const Symbol &extra : syntax_grammar.extra_tokens) {
+        add_symbol(sets[i], extra);
+        if (extra.is_non_terminal()) child_variables[i].insert(extra.index);
+      }
+    }
+
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (size_t i = 0; i < variable_count; i++) {
+        for (Symbol::Index child : child_variables[i]) {
+          for (size_t j = 0; j < word_count; j++) {
+            uint32_t words = sets[i][j] | sets[child][j];
+            if (words != sets[i][j]) {
+              sets[i][j] = words;
+              changed = true;
+            }
+          }
+        }
+      }
+    }
+
+    map<vector<uint32_t>, size_t> set_ids;
+    vector<uint32_t> unique_set_words;
+    vector<size_t> symbol_set_ids(parse_table.symbols.size() - token_count, 0);
+    for (size_t i = 0; i < variable_count; i++) {
+      auto entry = symbol_indices.find(Symbol::non_terminal(i));
+      if (entry == symbol_indices.end()) continue;
+      auto insertion = set_ids.insert({sets[i], set_ids.size()});
+      if (insertion.second) {
+        unique_set_words.insert(unique_set_words.end(), sets[i].begin(), sets[i].end());
+      }
+      symbol_set_ids[entry->second - token_count] = insertion.first->second;
+    }
+
+    line("static const uint32_t ts_descendant_symbol_sets[] = {");
+    indent([&]() {
+      for (size_t i = 0; i < unique_set_words.size(); i += word_count) {
+        string row;
+        for (size_t j = i; j < i + word_count; j++) {
+          row += (j > i ? " " : "") + to_string(unique_set_words[j]) + "u,";
+        }
+        line(row);
+      }
+    });
+    line("};");
+    line();
+    add_integer_list(
+      "static const uint16_t ts_descendant_symbol_set_ids[SYMBOL_COUNT - TOKEN_COUNT]",
+      symbol_set_ids
+    );
+  }
+
   void add_lex_modes_list() {
     add_external_scanner_state({});
 
@@ -313,32 +792,95 @@ class CCodeGenerator {
       }
     }
 
-    line("static TSLexMode ts_lex_modes[STATE_COUNT] = {");
-    indent([&]() {
-      size_t state_id = 0;
-
-      for (const auto &state : parse_table.states) {
-        line("[" + to_string(state_id++) + "] = {.lex_state = ");
-        add(to_string(state.lex_state_id));
-
-        set<Symbol::Index> external_token_indices;
-        for (const auto &pair : state.terminal_entries) {
-          Symbol symbol = pair.first;
-          if (symbol.is_external()) {
-            external_token_indices.insert(symbol.index);
-          } else if (symbol.is_terminal()) {
-            auto corresponding_external_token =
-              external_tokens_by_corresponding_internal_token.find(symbol.index);
-            if (corresponding_external_token != external_tokens_by_corresponding_internal_token.end()) {
-              external_token_indices.insert(corresponding_external_token->second);
-            }
+    vector<string> external_lex_states;
+    LexStateId max_lex_state_id = 0;
+    for (const auto &state : parse_table.states) {
+      set<Symbol::Index> external_token_indices;
+      for (const auto &pair : state.terminal_entries) {
+        Symbol symbol = pair.first;
+        if (symbol.is_external()) {
+          external_token_indices.insert(symbol.index);
+        } else if (symbol.is_terminal()) {
+          auto corresponding_external_token =
+            external_tokens_by_corresponding_internal_token.find(symbol.index);
+          if (corresponding_external_token != external_tokens_by_corresponding_internal_token.end()) {
+            external_token_indices.insert(corresponding_external_token->second);
+          }
+        }
+      }
+
+      external_lex_states.push_back(
+        external_token_indices.empty() ? "" : add_external_scanner_state(external_token_indices)
+      );
+      max_lex_state_id = max(max_lex_state_id, state.lex_state_id);
+    }
+
+    // Many states share the same lex mode, so the distinct modes can be
+    // stored once, with each state storing the index of its mode. This is
+    // used whenever it is smaller than storing each state's mode.
+    map<pair<LexStateId, string>, size_t> lex_mode_ids;
+    vector<pair<LexStateId, string>> unique_lex_modes;
+    vector<size_t> state_lex_mode_ids;
+    for (size_t state_id = 0, n = parse_table.states.size(); state_id < n; state_id++) {
+      pair<LexStateId, string> lex_mode(parse_table.states[state_id].lex_state_id, external_lex_states[state_id]);
+      auto insertion = lex_mode_ids.insert({lex_mode, unique_lex_modes.size()});
+      if (insertion.second) unique_lex_modes.push_back(lex_mode);
+      state_lex_mode_ids.push_back(insertion.first->second);
+    }
+
+    bool use_byte_pairs =
+      max_lex_state_id <= UINT8_MAX && external_scanner_states.size() <= UINT8_MAX + 1;
+    bool use_byte_ids = unique_lex_modes.size() <= UINT8_MAX + 1;
+    size_t direct_size = parse_table.states.size() * (use_byte_pairs ? 2 : 4);
+    size_t indexed_size =
+      parse_table.states.size() * (use_byte_ids ? 1 : 2) + unique_lex_modes.size() * 4;
+    if (indexed_size < direct_size) {
+      use_lex_mode_ids = !use_byte_ids;
+      use_byte_lex_mode_ids = use_byte_ids;
+      line("static TSLexMode ts_lex_modes[" + to_string(unique_lex_modes.size()) + "] = {");
+      indent([&]() {
+        for (size_t i = 0, n = unique_lex_modes.size(); i < n; i++) {
+          line("[" + to_string(i) + "] = {.lex_state = " + to_string(unique_lex_modes[i].first));
+          if (!unique_lex_modes[i].second.empty()) {
+            add(", .external_lex_state = " + unique_lex_modes[i].second);
           }
+          add("},");
         }
+      });
+      line("};");
+      line();
+      add_integer_list(
+        string(use_byte_ids ? "static uint8_t" : "static uint16_t") + " ts_lex_mode_ids[STATE_COUNT]",
+        state_lex_mode_ids
+      );
+      return;
+    }
 
-        if (!external_token_indices.empty()) {
-          add(", .external_lex_state = " + add_external_scanner_state(external_token_indices));
+    // When every lex state and external scanner state fits in a byte, each
+    // lex mode is stored as a pair of bytes.
+    if (use_byte_pairs) {
+      use_byte_lex_modes = true;
+      line("static uint8_t ts_lex_modes[STATE_COUNT][2] = {");
+      indent([&]() {
+        for (size_t state_id = 0, n = parse_table.states.size(); state_id < n; state_id++) {
+          const string &external_lex_state = external_lex_states[state_id];
+          line("[" + to_string(state_id) + "] = {" + to_string(parse_table.states[state_id].lex_state_id));
+          if (!external_lex_state.empty()) add(", " + external_lex_state);
+          add("},");
         }
+      });
+      line("};");
+      line();
+      return;
+    }
 
+    line("static TSLexMode ts_lex_modes[STATE_COUNT] = {");
+    indent([&]() {
+      for (size_t state_id = 0, n = parse_table.states.size(); state_id < n; state_id++) {
+        const string &external_lex_state = external_lex_states[state_id];
+        line("[" + to_string(state_id) + "] = {.lex_state = ");
+        add(to_string(parse_table.states[state_id].lex_state_id));
+        if (!external_lex_state.empty()) add(", .external_lex_state = " + external_lex_state);
         add("},");
       }
     });
@@ -401,12 +943,49 @@ class CCodeGenerator {
   void add_parse_table() {
     add_parse_action_list_id(ParseTableEntry{ {}, false });
 
-    size_t state_id = 0;
-    line("static uint16_t ts_parse_table[STATE_COUNT][SYMBOL_COUNT] = {");
+    // Number every list of actions up front, in the same order in which the
+    // tables refer to them, to find out whether every value in the tables
+    // fits in a byte. The small table also stores symbols and their counts.
+    size_t max_value = max(parse_table.states.size() - 1, parse_table.symbols.size());
+    for (const ParseState &state : parse_table.states) {
+      for (const auto &entry : state.terminal_entries) {
+        max_value = max(max_value, add_parse_action_list_id(entry.second));
+      }
+    }
+    use_byte_parse_table = max_value <= UINT8_MAX;
 
+    if (narrow_parse_table_rows) {
+      add_narrow_parse_table();
+    } else {
+      add_dense_parse_table();
+    }
+
+    if (large_state_count < parse_table.states.size()) {
+      if (compact_code) {
+        add_compact_small_parse_table();
+      } else {
+        add_small_parse_table();
+      }
+    }
+
+    add_parse_action_list();
+    line();
+    add_parse_action_next_state_list();
+    if (specialize_table_lookups) add_parse_actions_function();
+  }
+
+  void add_dense_parse_table() {
+    line("static " + parse_table_cell_type() + " ts_parse_table[LARGE_STATE_COUNT][SYMBOL_COUNT] = {");
     indent([&]() {
-      for (const auto &state : parse_table.states) {
-        line("[" + to_string(state_id++) + "] = {");
+      for (size_t state_id = 0; state_id < large_state_count; state_id++) {
+        const ParseState &state = parse_table.states[state_id];
+        flush();
+        if (compact_code) {
+          add_dense_parse_table_row(state);
+          continue;
+        }
+
+        line("[" + to_string(state_id) + "] = {");
         indent([&]() {
           for (const auto &entry : state.nonterminal_entries) {
             line("[" + symbol_id(Symbol::non_terminal(entry.first)) + "] = STATE(");
@@ -422,11 +1001,150 @@ class CCodeGenerator {
         line("},");
       }
     });
+    line("};");
+    line();
+  }
+
+  // Narrow rows are written one after another, each without its trailing
+  // zeros, followed by the offset at which each row starts. The runtime treats
+  // the symbols past the end of a row as having no entry.
+  void add_narrow_parse_table() {
+    vector<uint32_t> row_offsets;
+    uint32_t offset = 0;
 
+    line("static " + parse_table_cell_type() + " ts_parse_table[] = {");
+    indent([&]() {
+      for (size_t state_id = 0; state_id < large_state_count; state_id++) {
+        vector<uint16_t> row = parse_table_row(parse_table.states[state_id]);
+        row_offsets.push_back(offset);
+        offset += row.size();
+        flush();
+        add_integers(row);
+      }
+      if (offset == 0) line("0,");
+    });
     line("};");
     line();
-    add_parse_action_list();
+
+    row_offsets.push_back(offset);
+    line("static uint32_t ts_parse_table_row_offsets[LARGE_STATE_COUNT + 1] = {");
+    indent([&]() { add_integers(row_offsets); });
+    line("};");
+    line();
+  }
+
+  void add_small_parse_table() {
+    vector<size_t> small_state_indices;
+    size_t index = 0;
+
+    line("static " + parse_table_cell_type() + " ts_small_parse_table[] = {");
+    indent([&]() {
+      for (size_t state_id = large_state_count, n = parse_table.states.size(); state_id < n; state_id++) {
+        const ParseState &state = parse_table.states[state_id];
+
+        // Group the symbols by the value that they map to, so that each
+        // value is only stored once per state.
+        map<string, vector<Symbol>> symbols_by_value;
+        for (const auto &entry : state.nonterminal_entries) {
+          string value = "STATE(" + to_string(entry.second) + ")";
+          symbols_by_value[value].push_back(Symbol::non_terminal(entry.first));
+        }
+        for (const auto &entry : state.terminal_entries) {
+          string value = "ACTIONS(" + to_string(add_parse_action_list_id(entry.second)) + ")";
+          symbols_by_value[value].push_back(entry.first);
+        }
+
+        flush();
+        small_state_indices.push_back(index);
+        line("[" + to_string(index) + "] = " + to_string(symbols_by_value.size()) + ",");
+        index++;
+        indent([&]() {
+          for (const auto &pair : symbols_by_value) {
+            line(pair.first + ", " + to_string(pair.second.size()) + ",");
+            index += 2;
+            indent([&]() {
+              for (const Symbol &symbol : pair.second) {
+                line(symbol_id(symbol) + ",");
+                index++;
+              }
+            });
+          }
+        });
+      }
+    });
+    line("};");
     line();
+
+    line("static uint32_t ts_small_parse_table_map[] = {");
+    indent([&]() {
+      size_t state_id = large_state_count;
+      for (size_t index : small_state_indices) {
+        line("[SMALL_STATE(" + to_string(state_id++) + ")] = " + to_string(index) + ",");
+      }
+    });
+    line("};");
+    line();
+  }
+
+  // In compact code, the rows of the parse table are written as plain numbers,
+  // without the trailing zeros, so that there are no macros or designators
+  // for the C compiler to process.
+  void add_dense_parse_table_row(const ParseState &state) {
+    vector<uint16_t> row = parse_table_row(state);
+    line("{");
+    indent([&]() { add_integers(row); });
+    line("},");
+  }
+
+  vector<uint16_t> parse_table_row(const ParseState &state) {
+    vector<uint16_t> row(parse_table.symbols.size(), 0);
+    for (const auto &entry : state.nonterminal_entries) {
+      row[symbol_indices[Symbol::non_terminal(entry.first)]] = entry.second;
+    }
+    for (const auto &entry : state.terminal_entries) {
+      row[symbol_indices[entry.first]] = add_parse_action_list_id(entry.second);
+    }
+    while (!row.empty() && row.back() == 0) row.pop_back();
+    return row;
+  }
+
+  // This is the same table as `add_small_parse_table` writes, with the symbols
+  // grouped by the number that they map to, whether that is a state or a list
+  // of actions. States with the same groups share their entry in the table.
+  void add_compact_small_parse_table() {
+    vector<uint16_t> table;
+    vector<uint32_t> table_map;
+    map<vector<uint16_t>, uint32_t> state_indices;
+
+    for (size_t state_id = large_state_count, n = parse_table.states.size(); state_id < n; state_id++) {
+      const ParseState &state = parse_table.states[state_id];
+      map<uint16_t, vector<uint16_t>> symbols_by_value;
+      for (const auto &entry : state.nonterminal_entries) {
+        symbols_by_value[entry.second].push_back(symbol_indices[Symbol::non_terminal(entry.first)]);
+      }
+      for (const auto &entry : state.terminal_entries) {
+        symbols_by_value[add_parse_action_list_id(entry.second)].push_back(symbol_indices[entry.first]);
+      }
+
+      vector<uint16_t> groups;
+      groups.push_back(symbols_by_value.size());
+      for (const auto &pair : symbols_by_value) {
+        groups.push_back(pair.first);
+        groups.push_back(pair.second.size());
+        groups.insert(groups.end(), pair.second.begin(), pair.second.end());
+      }
+
+      auto insertion = state_indices.insert({groups, table.size()});
+      if (insertion.second) table.insert(table.end(), groups.begin(), groups.end());
+      table_map.push_back(insertion.first->second);
+    }
+
+    add_integer_list("static " + parse_table_cell_type() + " ts_small_parse_table[]", table);
+    add_integer_list("static uint32_t ts_small_parse_table_map[]", table_map);
+  }
+
+  string parse_table_cell_type() {
+    return use_byte_parse_table ? "uint8_t" : "uint16_t";
   }
 
   void add_parser_export() {
@@ -434,11 +1152,25 @@ class CCodeGenerator {
     string external_scanner_name = language_function_name + "_external_scanner";
 
     if (!syntax_grammar.external_tokens.empty()) {
-      line("void *" + external_scanner_name + "_create();");
+      if (!syntax_grammar.has_shared_external_scanner_data) {
+        line("void *" + external_scanner_name + "_create();");
+      }
       line("void " + external_scanner_name + "_destroy(void *);");
       line("bool " + external_scanner_name + "_scan(void *, TSLexer *, const bool *);");
       line("unsigned " + external_scanner_name + "_serialize(void *, char *);");
       line("void " + external_scanner_name + "_deserialize(void *, const char *, unsigned);");
+      if (syntax_grammar.has_external_state_equivalence) {
+        line("bool " + external_scanner_name + "_equivalent(const char *, unsigned, const char *, unsigned);");
+      }
+      if (syntax_grammar.has_shared_external_scanner_data) {
+        line("void *" + external_scanner_name + "_create_shared();");
+        line("void *" + external_scanner_name + "_create_with_shared(const void *);");
+        line();
+        line("static TSExternalScannerSharedData ts_external_scanner_shared_data;");
+      }
+      if (syntax_grammar.has_external_state_change_tracking) {
+        line("bool " + external_scanner_name + "_state_changed(void *);");
+      }
       line();
     }
 
@@ -455,21 +1187,73 @@ class CCodeGenerator {
         line(".symbol_count = SYMBOL_COUNT,");
         line(".alias_count = ALIAS_COUNT,");
         line(".token_count = TOKEN_COUNT,");
+        line(".state_count = STATE_COUNT,");
+        line(".large_state_count = LARGE_STATE_COUNT,");
         line(".symbol_metadata = ts_symbol_metadata,");
-        line(".parse_table = (const unsigned short *)ts_parse_table,");
+        if (use_byte_parse_table) {
+          line(".byte_parse_table = (const uint8_t *)ts_parse_table,");
+        } else {
+          line(".parse_table = (const unsigned short *)ts_parse_table,");
+        }
+        if (narrow_parse_table_rows) {
+          line(".parse_table_row_offsets = ts_parse_table_row_offsets,");
+        }
+
+        if (large_state_count < parse_table.states.size()) {
+          if (use_byte_parse_table) {
+            line(".byte_small_parse_table = (const uint8_t *)ts_small_parse_table,");
+          } else {
+            line(".small_parse_table = (const uint16_t *)ts_small_parse_table,");
+          }
+          line(".small_parse_table_map = (const uint32_t *)ts_small_parse_table_map,");
+        }
+
         line(".parse_actions = ts_parse_actions,");
-        line(".lex_modes = ts_lex_modes,");
+        line(".parse_action_next_states = ts_parse_action_next_states,");
+        if (specialize_table_lookups) {
+          line(".parse_actions_fn = ts_parse_actions_for,");
+        }
+        if (use_byte_lex_modes) {
+          line(".byte_lex_modes = (const uint8_t *)ts_lex_modes,");
+        } else {
+          line(".lex_modes = ts_lex_modes,");
+        }
+        if (use_byte_lex_mode_ids) {
+          line(".byte_lex_mode_ids = ts_lex_mode_ids,");
+        } else if (use_lex_mode_ids) {
+          line(".lex_mode_ids = ts_lex_mode_ids,");
+        }
+        if (use_error_start_characters) {
+          line(".error_start_characters = ts_error_start_characters,");
+        }
+        line(".descendant_symbol_sets = ts_descendant_symbol_sets,");
+        line(".descendant_symbol_set_ids = ts_descendant_symbol_set_ids,");
         line(".symbol_names = ts_symbol_names,");
+        line(".symbols_by_name = ts_symbols_by_name,");
 
         if (parse_table.alias_sequences.size() > 1) {
           line(".alias_sequences = (const TSSymbol *)ts_alias_sequences,");
+          if (use_alias_sequence_offsets) {
+            line(".alias_sequence_offsets = ts_alias_sequence_offsets,");
+          }
         }
 
         line(".max_alias_sequence_length = MAX_ALIAS_SEQUENCE_LENGTH,");
-        line(".lex_fn = ts_lex,");
+        if (use_lex_tables) {
+          line(".lex_table = &ts_lex_table,");
+        } else {
+          line(".lex_fn = ts_lex,");
+        }
 
         if (keyword_capture_token != rules::NONE()) {
-          line(".keyword_lex_fn = ts_lex_keywords,");
+          if (use_lex_tables) {
+            line(".keyword_lex_table = &ts_keyword_lex_table,");
+          } else {
+            line(".keyword_lex_fn = ts_lex_keywords,");
+          }
+          if (use_keyword_table) {
+            line(".keyword_table = &ts_keyword_table,");
+          }
           line(".keyword_capture_token = " + symbol_id(keyword_capture_token) + ",");
         }
 
@@ -480,11 +1264,35 @@ class CCodeGenerator {
           indent([&]() {
             line("(const bool *)ts_external_scanner_states,");
             line("ts_external_scanner_symbol_map,");
-            line(external_scanner_name + "_create,");
+            if (syntax_grammar.has_shared_external_scanner_data) {
+              line("NULL,");
+            } else {
+              line(external_scanner_name + "_create,");
+            }
             line(external_scanner_name + "_destroy,");
             line(external_scanner_name + "_scan,");
             line(external_scanner_name + "_serialize,");
             line(external_scanner_name + "_deserialize,");
+            bool has_later_functions =
+              syntax_grammar.has_shared_external_scanner_data ||
+              syntax_grammar.has_external_state_change_tracking;
+            if (syntax_grammar.has_external_state_equivalence) {
+              line(external_scanner_name + "_equivalent,");
+            } else if (has_later_functions) {
+              line("NULL,");
+            }
+            if (syntax_grammar.has_shared_external_scanner_data) {
+              line(external_scanner_name + "_create_shared,");
+              line(external_scanner_name + "_create_with_shared,");
+              line("&ts_external_scanner_shared_data,");
+            } else if (syntax_grammar.has_external_state_change_tracking) {
+              line("NULL,");
+              line("NULL,");
+              line("NULL,");
+            }
+            if (syntax_grammar.has_external_state_change_tracking) {
+              line(external_scanner_name + "_state_changed,");
+            }
           });
           line("},");
         }
@@ -497,12 +1305,66 @@ class CCodeGenerator {
     line();
   }
 
-  void add_lex_state(const LexState &lex_state) {
+  // Find the ASCII characters on which a lex state transitions back to
+  // itself, so that runs of them can be consumed with a single call.
+  set<uint32_t> self_loop_character_class(const LexState &lex_state, LexStateId state_id) {
+    set<uint32_t> result;
+    rules::CharacterSet ruled_out_characters;
+    for (const auto &pair : lex_state.advance_actions) {
+      if (pair.first.is_empty()) continue;
+      if (pair.second.state_index == state_id) {
+        for (uint32_t c = 1; c < CHARACTER_CLASS_SIZE; c++) {
+          if (pair.first.contains(c) && !ruled_out_characters.contains(c)) result.insert(c);
+        }
+        return result;
+      }
+      if (pair.first.includes_all) break;
+      ruled_out_characters.add_set(pair.first);
+    }
+    return result;
+  }
+
+  // The ASCII characters that a transition's condition accepts, as the words
+  // of a character class, or nothing if its ASCII portion only takes a few
+  // comparisons to test.
+  vector<uint32_t> ascii_class_for_condition(const rules::CharacterSet &rule,
+                                             const rules::CharacterSet &ruled_out_characters) {
+    const auto &ranges = rule.includes_all ? rule.excluded_ranges() : rule.included_ranges();
+    size_t ascii_range_count = 0;
+    for (const auto &range : ranges) {
+      if (range.min >= CHARACTER_CLASS_SIZE) break;
+      uint32_t max = std::min(range.max, CHARACTER_CLASS_SIZE - 1);
+      if (!ruled_out_characters.contains(range.min, max)) ascii_range_count++;
+    }
+    if (ascii_range_count < ASCII_CLASS_MIN_RANGE_COUNT) return {};
+
+    vector<uint32_t> words(CHARACTER_CLASS_SIZE / 32, 0);
+    for (uint32_t c = 0; c < CHARACTER_CLASS_SIZE; c++) {
+      if (rule.contains(c) && !ruled_out_characters.contains(c)) words[c / 32] |= 1u << (c % 32);
+    }
+    return words;
+  }
+
+  void add_character_class(const string &name, const set<uint32_t> &characters) {
+    vector<uint32_t> words(CHARACTER_CLASS_SIZE / 32, 0);
+    for (uint32_t c : characters) words[c / 32] |= 1u << (c % 32);
+    add_character_class(name, words);
+  }
+
+  void add_character_class(const string &name, const vector<uint32_t> &words) {
+    line("static const uint32_t " + name + "[] = {");
+    for (uint32_t word : words) add(" " + to_string(word) + "u,");
+    add(" };");
+  }
+
+  void add_lex_state(const LexState &lex_state, LexStateId state_id, const string &character_class_name) {
     if (lex_state.accept_action.is_present()) {
       add_accept_token_action(lex_state.accept_action);
     }
 
-    set<uint32_t> ruled_out_characters;
+    bool has_character_class = !self_loop_character_class(lex_state, state_id).empty();
+
+    rules::CharacterSet ruled_out_characters;
     for (const auto &pair : lex_state.advance_actions) {
       if (pair.first.is_empty()) continue;
 
@@ -511,8 +1373,14 @@ class CCodeGenerator {
       line("if (");
       if (add_character_set_condition(pair.first, ruled_out_characters)) {
         add(")");
-        indent([&]() { add_advance_action(pair.second); });
-        ruled_out_characters.insert(pair.first.included_chars.begin(), pair.first.included_chars.end());
+        indent([&]() {
+          if (has_character_class && pair.second.state_index == state_id) {
+            add_advance_while_action(pair.second, character_class_name);
+          } else {
+            add_advance_action(pair.second);
+          }
+        });
+        if (!pair.first.includes_all) ruled_out_characters.add_set(pair.first);
       } else {
         buffer.resize(current_length);
         add_advance_action(pair.second);
@@ -522,7 +1390,14 @@ class CCodeGenerator {
     line("END_STATE();");
   }
 
-  bool add_character_set_condition(const rules::CharacterSet &rule, const set<uint32_t> &ruled_out_characters) {
+  bool add_character_set_condition(const rules::CharacterSet &rule,
+                                   const rules::CharacterSet &ruled_out_characters) {
+    vector<uint32_t> ascii_class = ascii_class_for_condition(rule, ruled_out_characters);
+    if (!ascii_class.empty()) {
+      add_ascii_class_condition(rule, ruled_out_characters, ascii_class_names[ascii_class]);
+      return true;
+    }
+
     if (rule.includes_all) {
       return add_character_range_conditions(rule.excluded_ranges(), ruled_out_characters, true);
     } else {
@@ -530,35 +1405,56 @@ class CCodeGenerator {
     }
   }
 
+  // The ASCII characters are tested with a single lookup in a character class,
+  // and only the rest of the set's ranges are compared with the lookahead.
+  void add_ascii_class_condition(const rules::CharacterSet &rule,
+                                 const rules::CharacterSet &ruled_out_characters,
+                                 const string &class_name) {
+    vector<rules::CharacterRange> non_ascii_ranges;
+    for (auto range : rule.includes_all ? rule.excluded_ranges() : rule.included_ranges()) {
+      if (range.max < CHARACTER_CLASS_SIZE) continue;
+      range.min = std::max(range.min, CHARACTER_CLASS_SIZE);
+      non_ascii_ranges.push_back(range);
+    }
+
+    add("ASCII_CLASS_CONTAINS(" + class_name + ", lookahead)");
+    if (rule.includes_all) {
+      add(" ||");
+      line("    ((uint32_t)lookahead >= " + to_string(CHARACTER_CLASS_SIZE));
+      size_t current_length = buffer.size();
+      add(" &&");
+      line("    ");
+      if (!add_character_range_conditions(non_ascii_ranges, ruled_out_characters, true)) {
+        buffer.resize(current_length);
+      }
+      add(")");
+    } else {
+      size_t current_length = buffer.size();
+      add(" ||");
+      line("    ");
+      if (!add_character_range_conditions(non_ascii_ranges, ruled_out_characters, false)) {
+        buffer.resize(current_length);
+      }
+    }
+  }
+
   bool add_character_range_conditions(const vector<rules::CharacterRange> &ranges,
-                                      const set<uint32_t> &ruled_out_characters,
+                                      const rules::CharacterSet &ruled_out_characters,
                                       bool is_negated) {
     bool first = true;
     for (auto iter = ranges.begin(), end = ranges.end(); iter != end;) {
       auto range = *iter;
 
-      bool range_is_ruled_out = true;
-      for (uint32_t c = range.min; c <= range.max; c++) {
-        if (!ruled_out_characters.count(c)) {
-          range_is_ruled_out = false;
-          break;
-        }
-      }
-
-      if (range_is_ruled_out) {
+      if (ruled_out_characters.contains(range.min, range.max)) {
         ++iter;
         continue;
       }
 
       auto next_iter = iter + 1;
       while (next_iter != end) {
-        bool can_join_ranges = true;
-        for (uint32_t character = range.max + 1; character < next_iter->min; character++) {
-          if (!ruled_out_characters.count(character)) {
-            can_join_ranges = false;
-            break;
-          }
-        }
+        bool can_join_ranges =
+          range.max + 1 == next_iter->min ||
+          ruled_out_characters.contains(range.max + 1, next_iter->min - 1);
 
         if (can_join_ranges) {
           range.max = next_iter->max;
@@ -607,9 +1503,17 @@ class CCodeGenerator {
 
   void add_advance_action(const AdvanceAction &action) {
     if (action.in_main_token) {
-      line("ADVANCE(" + to_string(action.state_index) + ");");
+      line("ADVANCE_TO(" + to_string(action.state_index) + ");");
+    } else {
+      line("SKIP_TO(" + to_string(action.state_index) + ");");
+    }
+  }
+
+  void add_advance_while_action(const AdvanceAction &action, const string &character_class_name) {
+    if (action.in_main_token) {
+      line("ADVANCE_WHILE_TO(" + to_string(action.state_index) + ", " + character_class_name + ");");
     } else {
-      line("SKIP(" + to_string(action.state_index) + ");");
+      line("SKIP_WHILE_TO(" + to_string(action.state_index) + ", " + character_class_name + ");");
     }
   }
 
@@ -622,6 +1526,7 @@ class CCodeGenerator {
 
     indent([&]() {
       for (const auto &pair : parse_table_entries) {
+        flush();
         size_t index = pair.first;
         line(
           "[" + to_string(index) + "] = {"
@@ -676,6 +1581,76 @@ class CCodeGenerator {
     line("};");
   }
 
+  // For each list of parse actions, the state that its last action shifts to,
+  // so that the runtime can find the state after a terminal symbol without
+  // decoding the actions.
+  void add_parse_action_next_state_list() {
+    vector<ParseStateId> next_states(next_parse_action_list_index, 0);
+    for (const auto &pair : parse_table_entries) {
+      if (pair.second.actions.empty()) continue;
+      const ParseAction &action = pair.second.actions.back();
+      if (action.type == ParseActionTypeShift && !action.extra) {
+        next_states[pair.first] = action.state_index;
+      }
+    }
+    add_integer_list("static TSStateId ts_parse_action_next_states[]", next_states);
+  }
+
+  // A function that finds the parse actions for a terminal symbol in a given
+  // state, which the runtime calls instead of reading the tables itself. The
+  // table's dimensions are constants, and the actions for the small states are
+  // resolved by nested switch statements rather than by scanning their rows,
+  // so the C compiler can specialize the lookup for this grammar.
+  void add_parse_actions_function() {
+    line("static const TSParseActionEntry *ts_parse_actions_for(TSStateId state, TSSymbol symbol) {");
+    indent([&]() {
+      if (large_state_count < parse_table.states.size()) {
+        line("switch (state) {");
+        indent([&]() {
+          for (size_t state_id = large_state_count; state_id < parse_table.states.size(); state_id++) {
+            const ParseState &state = parse_table.states[state_id];
+            map<size_t, vector<Symbol>> symbols_by_action_list_id;
+            for (const auto &entry : state.terminal_entries) {
+              symbols_by_action_list_id[add_parse_action_list_id(entry.second)].push_back(entry.first);
+            }
+            if (symbols_by_action_list_id.empty()) continue;
+
+            line("case " + to_string(state_id) + ":");
+            indent([&]() {
+              line("switch (symbol) {");
+              indent([&]() {
+                for (const auto &pair : symbols_by_action_list_id) {
+                  for (const Symbol &symbol : pair.second) {
+                    line("case " + symbol_id(symbol) + ":");
+                  }
+                  indent([&]() {
+                    line("return &ts_parse_actions[" + to_string(pair.first) + "];");
+                  });
+                }
+                line("default:");
+                indent([&]() { line("return &ts_parse_actions[0];"); });
+              });
+              line("}");
+            });
+          }
+          line("default:");
+          indent([&]() { line("break;"); });
+        });
+        line("}");
+        line("if (state >= LARGE_STATE_COUNT) return &ts_parse_actions[0];");
+      }
+      if (narrow_parse_table_rows) {
+        line("uint32_t offset = ts_parse_table_row_offsets[state];");
+        line("if (symbol >= ts_parse_table_row_offsets[state + 1] - offset) return &ts_parse_actions[0];");
+        line("return &ts_parse_actions[ts_parse_table[offset + symbol]];");
+      } else {
+        line("return &ts_parse_actions[ts_parse_table[state][symbol]];");
+      }
+    });
+    line("}");
+    line();
+  }
+
   size_t add_parse_action_list_id(const ParseTableEntry &entry) {
     for (const auto &pair : parse_table_entries) {
       if (pair.second == entry) {
@@ -848,11 +1823,22 @@ class CCodeGenerator {
   void add(string input) {
     buffer += input;
   }
+
+  // When the code is being written as it is generated, the buffer is only
+  // written out at points where none of it will be revised.
+  void flush() {
+    if (writer && buffer.size() >= OUTPUT_CHUNK_SIZE) {
+      writer(buffer.data(), buffer.size());
+      buffer.clear();
+    }
+  }
 };
 
 string c_code(string name, ParseTable &&parse_table, LexTable &&lex_table,
               LexTable &&keyword_lex_table, Symbol keyword_capture_token,
-              SyntaxGrammar &&syntax_grammar, LexicalGrammar &&lexical_grammar) {
+              SyntaxGrammar &&syntax_grammar, LexicalGrammar &&lexical_grammar,
+              bool use_lex_tables, bool compact_code, bool specialize_table_lookups,
+              bool narrow_parse_table_rows, CodeWriter writer) {
   return CCodeGenerator(
     name,
     move(parse_table),
@@ -860,7 +1846,12 @@ string c_code(string name, ParseTable &&parse_table, LexTable &&lex_table,
     move(keyword_lex_table),
     keyword_capture_token,
     move(syntax_grammar),
-    move(lexical_grammar)
+    move(lexical_grammar),
+    use_lex_tables,
+    compact_code,
+    specialize_table_lookups,
+    narrow_parse_table_rows,
+    writer
   ).code();
 }
 
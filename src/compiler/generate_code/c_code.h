@@ -1,6 +1,7 @@
 #ifndef COMPILER_GENERATE_CODE_C_CODE_H_
 #define COMPILER_GENERATE_CODE_C_CODE_H_
 
+#include <functional>
 #include <string>
 #include "compiler/rule.h"
 
@@ -13,6 +14,10 @@ struct ParseTable;
 
 namespace generate_code {
 
+using CodeWriter = std::function<void(const char *, size_t)>;
+
+// If a writer is given, the code is passed to it in chunks as it is generated,
+// and the returned string is empty.
 std::string c_code(
   std::string,
   ParseTable &&,
@@ -20,7 +25,12 @@ std::string c_code(
   LexTable &&,
   rules::Symbol,
   SyntaxGrammar &&,
-  LexicalGrammar &&
+  LexicalGrammar &&,
+  bool use_lex_tables,
+  bool compact_code,
+  bool specialize_table_lookups,
+  bool narrow_parse_table_rows,
+  CodeWriter writer = nullptr
 );
 
 }  // namespace generate_code
@@ -0,0 +1,117 @@
+#include "compiler/generate_code/conflict_report.h"
+#include <string>
+#include <vector>
+#include "compiler/parse_table.h"
+#include "compiler/syntax_grammar.h"
+#include "compiler/lexical_grammar.h"
+#include "compiler/rule.h"
+
+namespace tree_sitter {
+namespace generate_code {
+
+using std::string;
+using std::to_string;
+using std::vector;
+using rules::Symbol;
+
+// The report describes the parse table as it is generated, so its state ids
+// are the ones that the runtime uses, including in state profiles. Static
+// precedence and associativity have already been used to resolve conflicts
+// by this point, so only the dynamic precedence of the remaining reductions
+// is shown.
+class ConflictReportGenerator {
+  const ParseTable &parse_table;
+  const SyntaxGrammar &syntax_grammar;
+  const LexicalGrammar &lexical_grammar;
+
+ public:
+  ConflictReportGenerator(const ParseTable &parse_table, const SyntaxGrammar &syntax_grammar,
+                          const LexicalGrammar &lexical_grammar)
+    : parse_table(parse_table),
+      syntax_grammar(syntax_grammar),
+      lexical_grammar(lexical_grammar) {}
+
+  string generate() {
+    size_t state_count = 0;
+    size_t entry_count = 0;
+    string entries;
+    for (size_t i = 0; i < parse_table.states.size(); i++) {
+      bool state_has_conflicts = false;
+      for (const auto &pair : parse_table.states[i].terminal_entries) {
+        vector<ParseAction> actions = forking_actions(pair.second);
+        if (actions.size() < 2) continue;
+        state_has_conflicts = true;
+        entry_count++;
+        entries += "\nState " + to_string(i) + ", lookahead " + symbol_name(pair.first) + ":\n";
+        for (const ParseAction &action : actions) {
+          entries += "  " + action_description(action) + "\n";
+        }
+      }
+      if (state_has_conflicts) state_count++;
+    }
+
+    return
+      "Parse states with more than one action: " + to_string(state_count) + "\n" +
+      "Lookaheads with more than one action: " + to_string(entry_count) + "\n" +
+      entries;
+  }
+
+ private:
+  // The runtime doesn't fork for the shifts that continue repetitions, since
+  // they are only taken once the repetition's reductions have been tried.
+  vector<ParseAction> forking_actions(const ParseTableEntry &entry) {
+    vector<ParseAction> result;
+    for (const ParseAction &action : entry.actions) {
+      if (action.type == ParseActionTypeShift && action.repetition) continue;
+      result.push_back(action);
+    }
+    return result;
+  }
+
+  string action_description(const ParseAction &action) {
+    switch (action.type) {
+      case ParseActionTypeShift:
+        if (action.extra) return "shift extra";
+        return "shift to state " + to_string(action.state_index);
+      case ParseActionTypeReduce: {
+        string result = "reduce " + symbol_name(action.symbol) + " (" +
+          to_string(action.consumed_symbol_count) +
+          (action.consumed_symbol_count == 1 ? " child" : " children");
+        if (action.dynamic_precedence != 0) {
+          result += ", dynamic precedence " + to_string(action.dynamic_precedence);
+        }
+        return result + ")";
+      }
+      case ParseActionTypeAccept:
+        return "accept";
+      case ParseActionTypeRecover:
+        return "recover";
+      default:
+        return "error";
+    }
+  }
+
+  string symbol_name(const Symbol &symbol) {
+    if (symbol == rules::END_OF_INPUT()) return "END";
+    switch (symbol.type) {
+      case Symbol::NonTerminal:
+        return syntax_grammar.variables[symbol.index].name;
+      case Symbol::Terminal: {
+        const LexicalVariable &variable = lexical_grammar.variables[symbol.index];
+        if (variable.type == VariableTypeNamed) return variable.name;
+        return "'" + variable.name + "'";
+      }
+      case Symbol::External:
+      default:
+        return syntax_grammar.external_tokens[symbol.index].name;
+    }
+  }
+};
+
+string conflict_report(const ParseTable &parse_table, const SyntaxGrammar &syntax_grammar,
+                       const LexicalGrammar &lexical_grammar) {
+  return ConflictReportGenerator(parse_table, syntax_grammar, lexical_grammar).generate();
+}
+
+}  // namespace generate_code
+}  // namespace tree_sitter
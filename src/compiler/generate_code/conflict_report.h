@@ -0,0 +1,19 @@
+#ifndef COMPILER_GENERATE_CODE_CONFLICT_REPORT_H_
+#define COMPILER_GENERATE_CODE_CONFLICT_REPORT_H_
+
+#include <string>
+
+namespace tree_sitter {
+
+struct LexicalGrammar;
+struct SyntaxGrammar;
+struct ParseTable;
+
+namespace generate_code {
+
+std::string conflict_report(const ParseTable &, const SyntaxGrammar &, const LexicalGrammar &);
+
+}  // namespace generate_code
+}  // namespace tree_sitter
+
+#endif  // COMPILER_GENERATE_CODE_CONFLICT_REPORT_H_
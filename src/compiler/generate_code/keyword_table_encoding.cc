@@ -0,0 +1,152 @@
+#include "compiler/generate_code/keyword_table_encoding.h"
+#include <algorithm>
+#include <set>
+#include "compiler/lex_table.h"
+#include "compiler/lexical_grammar.h"
+#include "runtime/keyword_table.h"
+
+namespace tree_sitter {
+namespace generate_code {
+
+using std::pair;
+using std::set;
+using std::string;
+using std::vector;
+using rules::CharacterSet;
+using rules::Metadata;
+using rules::Rule;
+using rules::Seq;
+using rules::Symbol;
+
+static const uint32_t MAX_SEED_COUNT = 256;
+
+static void append_utf8(uint32_t character, string *result) {
+  if (character < 0x80) {
+    result->push_back(character);
+  } else if (character < 0x800) {
+    result->push_back(0xC0 | (character >> 6));
+    result->push_back(0x80 | (character & 0x3F));
+  } else if (character < 0x10000) {
+    result->push_back(0xE0 | (character >> 12));
+    result->push_back(0x80 | ((character >> 6) & 0x3F));
+    result->push_back(0x80 | (character & 0x3F));
+  } else {
+    result->push_back(0xF0 | (character >> 18));
+    result->push_back(0x80 | ((character >> 12) & 0x3F));
+    result->push_back(0x80 | ((character >> 6) & 0x3F));
+    result->push_back(0x80 | (character & 0x3F));
+  }
+}
+
+// Keywords can only be stored in the table if they match exactly one string.
+static bool get_keyword_string(const Rule &rule, string *result) {
+  return rule.match(
+    [result](const Seq &sequence) {
+      return get_keyword_string(*sequence.left, result) &&
+        get_keyword_string(*sequence.right, result);
+    },
+
+    [result](const Metadata &rule) { return get_keyword_string(*rule.rule, result); },
+
+    [result](const CharacterSet &rule) {
+      const auto &ranges = rule.included_ranges();
+      if (rule.includes_all || ranges.size() != 1 || ranges[0].min != ranges[0].max) return false;
+      append_utf8(ranges[0].min, result);
+      return true;
+    },
+
+    [](auto) { return false; }
+  );
+}
+
+static uint32_t next_power_of_two(uint32_t value) {
+  uint32_t result = 1;
+  while (result < value) result *= 2;
+  return result;
+}
+
+// Find a displacement for each group of keywords whose hashes have the same
+// low bits, handling the largest groups first, so that every keyword ends up
+// in a different slot.
+static bool place_keywords(const vector<pair<string, Symbol>> &keywords, uint32_t seed,
+                           EncodedKeywordTable *result) {
+  TSKeywordTable table;
+  table.seed = seed;
+  table.displacement_count = result->displacements.size();
+  table.slot_count = result->slots.size();
+  table.displacements = result->displacements.data();
+
+  vector<vector<size_t>> groups(table.displacement_count);
+  vector<uint32_t> hashes;
+  for (size_t i = 0; i < keywords.size(); i++) {
+    const string &keyword = keywords[i].first;
+    uint32_t hash = ts_keyword_table_hash(seed, keyword.data(), keyword.size());
+    hashes.push_back(hash);
+    groups[hash & (table.displacement_count - 1)].push_back(i);
+  }
+
+  vector<size_t> group_order;
+  for (size_t i = 0; i < groups.size(); i++) group_order.push_back(i);
+  std::stable_sort(group_order.begin(), group_order.end(), [&groups](size_t left, size_t right) {
+    return groups[left].size() > groups[right].size();
+  });
+
+  vector<bool> used_slots(table.slot_count, false);
+  for (size_t group_index : group_order) {
+    const vector<size_t> &group = groups[group_index];
+    if (group.empty()) break;
+
+    bool placed = false;
+    for (uint32_t displacement = 0; displacement < table.slot_count && !placed; displacement++) {
+      result->displacements[group_index] = displacement;
+      set<uint32_t> slots;
+      for (size_t keyword_index : group) {
+        uint32_t slot = ts_keyword_table_slot(&table, hashes[keyword_index]);
+        if (used_slots[slot] || !slots.insert(slot).second) break;
+      }
+      placed = slots.size() == group.size();
+    }
+    if (!placed) return false;
+
+    for (size_t keyword_index : group) {
+      uint32_t slot = ts_keyword_table_slot(&table, hashes[keyword_index]);
+      used_slots[slot] = true;
+      result->slots[slot] = keywords[keyword_index];
+    }
+  }
+
+  result->seed = seed;
+  return true;
+}
+
+bool encode_keyword_table(const LexicalGrammar &lexical_grammar, const LexTable &keyword_lex_table,
+                          EncodedKeywordTable *result) {
+  set<Symbol> keyword_symbols;
+  for (const LexState &state : keyword_lex_table.states) {
+    if (state.accept_action.is_present()) keyword_symbols.insert(state.accept_action.symbol);
+  }
+
+  vector<pair<string, Symbol>> keywords;
+  for (const Symbol &symbol : keyword_symbols) {
+    string keyword;
+    if (!get_keyword_string(lexical_grammar.variables[symbol.index].rule, &keyword)) return false;
+    if (keyword.empty()) return false;
+    keywords.push_back({keyword, symbol});
+  }
+  if (keywords.empty()) return false;
+
+  uint32_t slot_count = next_power_of_two(keywords.size() * 2);
+  while (slot_count <= 0x10000) {
+    for (uint32_t seed = 0; seed < MAX_SEED_COUNT; seed++) {
+      result->displacements.assign(next_power_of_two((keywords.size() + 1) / 2), 0);
+      result->slots.assign(slot_count, {"", rules::NONE()});
+      if (place_keywords(keywords, seed, result)) return true;
+    }
+    slot_count *= 2;
+  }
+
+  return false;
+}
+
+}  // namespace generate_code
+}  // namespace tree_sitter
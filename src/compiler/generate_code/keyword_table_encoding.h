@@ -0,0 +1,31 @@
+#ifndef COMPILER_GENERATE_CODE_KEYWORD_TABLE_ENCODING_H_
+#define COMPILER_GENERATE_CODE_KEYWORD_TABLE_ENCODING_H_
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "compiler/rule.h"
+
+namespace tree_sitter {
+
+struct LexTable;
+struct LexicalGrammar;
+
+namespace generate_code {
+
+// The arrays of a `TSKeywordTable`, as interpreted by `ts_keyword_table_lookup`.
+// Empty slots have an empty string and no symbol.
+struct EncodedKeywordTable {
+  uint32_t seed;
+  std::vector<uint16_t> displacements;
+  std::vector<std::pair<std::string, rules::Symbol>> slots;
+};
+
+bool encode_keyword_table(const LexicalGrammar &, const LexTable &keyword_lex_table,
+                          EncodedKeywordTable *);
+
+}  // namespace generate_code
+}  // namespace tree_sitter
+
+#endif  // COMPILER_GENERATE_CODE_KEYWORD_TABLE_ENCODING_H_
@@ -0,0 +1,128 @@
+#include "compiler/generate_code/lex_table_encoding.h"
+#include <climits>
+#include <map>
+#include <set>
+#include "compiler/lex_table.h"
+#include "runtime/lex_table.h"
+
+namespace tree_sitter {
+namespace generate_code {
+
+using std::function;
+using std::map;
+using std::set;
+using std::vector;
+using rules::CharacterRange;
+using rules::CharacterSet;
+using rules::Symbol;
+
+// A character set in the form in which the generated lex functions test it:
+// either as the ranges that it includes, or as the ranges that it excludes.
+struct RangeCondition {
+  vector<CharacterRange> ranges;
+  bool is_negated;
+  uint16_t entry;
+
+  bool matches(int64_t character) const {
+    bool is_in_ranges = false;
+    for (const CharacterRange &range : ranges) {
+      if (range.min <= character && character <= range.max) {
+        is_in_ranges = true;
+        break;
+      }
+    }
+    return is_in_ranges != is_negated;
+  }
+};
+
+bool can_encode_lex_table(const LexTable &lex_table) {
+  return lex_table.states.size() <= TS_LEX_TABLE_MAX_STATE_COUNT;
+}
+
+EncodedLexTable encode_lex_table(const LexTable &lex_table,
+                                 function<uint16_t(const Symbol &)> symbol_index) {
+  EncodedLexTable result;
+  result.state_count = lex_table.states.size();
+
+  // Split the characters into the intervals between every boundary of every
+  // character set in the table. Each state treats all of the characters in an
+  // interval in the same way.
+  vector<vector<RangeCondition>> conditions_by_state;
+  set<int64_t> interval_starts{INT32_MIN};
+  for (const LexState &state : lex_table.states) {
+    vector<RangeCondition> conditions;
+    for (const auto &pair : state.advance_actions) {
+      const CharacterSet &character_set = pair.first;
+      if (character_set.is_empty()) continue;
+      RangeCondition condition{
+        character_set.includes_all ? character_set.excluded_ranges() : character_set.included_ranges(),
+        character_set.includes_all,
+        TS_LEX_TABLE_ENTRY(pair.second.state_index, !pair.second.in_main_token),
+      };
+      for (const CharacterRange &range : condition.ranges) {
+        interval_starts.insert(range.min);
+        interval_starts.insert(static_cast<int64_t>(range.max) + 1);
+      }
+      conditions.push_back(condition);
+    }
+    conditions_by_state.push_back(conditions);
+  }
+
+  // Intervals on which every state has the same transition form a class.
+  map<vector<uint16_t>, uint16_t> classes_by_column;
+  vector<const vector<uint16_t> *> columns;
+  vector<uint16_t> interval_classes;
+  for (int64_t start : interval_starts) {
+    vector<uint16_t> column;
+    for (const vector<RangeCondition> &conditions : conditions_by_state) {
+      uint16_t entry = 0;
+      for (const RangeCondition &condition : conditions) {
+        if (condition.matches(start)) {
+          entry = condition.entry;
+          break;
+        }
+      }
+      column.push_back(entry);
+    }
+
+    auto insertion = classes_by_column.insert({column, columns.size()});
+    if (insertion.second) columns.push_back(&insertion.first->first);
+    interval_classes.push_back(insertion.first->second);
+  }
+  result.class_count = columns.size();
+
+  size_t i = 0;
+  for (int64_t start : interval_starts) {
+    uint16_t character_class = interval_classes[i++];
+    if (result.range_classes.empty() || result.range_classes.back() != character_class) {
+      result.range_starts.push_back(start);
+      result.range_classes.push_back(character_class);
+    }
+  }
+
+  for (int32_t character = 0, j = 0; character < 128; character++) {
+    while (j + 1 < static_cast<int32_t>(result.range_starts.size()) &&
+           result.range_starts[j + 1] <= character) j++;
+    result.ascii_classes.push_back(result.range_classes[j]);
+  }
+
+  // States with identical rows share them.
+  map<vector<uint16_t>, uint32_t> row_offsets_by_row;
+  for (size_t state_id = 0; state_id < lex_table.states.size(); state_id++) {
+    const AcceptTokenAction &accept_action = lex_table.states[state_id].accept_action;
+    result.accept_symbols.push_back(
+      accept_action.is_present() ? symbol_index(accept_action.symbol) + 1 : 0
+    );
+
+    vector<uint16_t> row;
+    for (const vector<uint16_t> *column : columns) row.push_back((*column)[state_id]);
+    auto insertion = row_offsets_by_row.insert({row, result.transitions.size()});
+    if (insertion.second) result.transitions.insert(result.transitions.end(), row.begin(), row.end());
+    result.row_offsets.push_back(insertion.first->second);
+  }
+
+  return result;
+}
+
+}  // namespace generate_code
+}  // namespace tree_sitter
@@ -0,0 +1,33 @@
+#ifndef COMPILER_GENERATE_CODE_LEX_TABLE_ENCODING_H_
+#define COMPILER_GENERATE_CODE_LEX_TABLE_ENCODING_H_
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "compiler/rule.h"
+
+namespace tree_sitter {
+
+struct LexTable;
+
+namespace generate_code {
+
+// The arrays of a `TSLexTable`, as interpreted by `ts_lex_table_lex`.
+struct EncodedLexTable {
+  uint32_t state_count;
+  uint32_t class_count;
+  std::vector<uint16_t> accept_symbols;
+  std::vector<uint32_t> row_offsets;
+  std::vector<uint16_t> transitions;
+  std::vector<uint16_t> ascii_classes;
+  std::vector<int32_t> range_starts;
+  std::vector<uint16_t> range_classes;
+};
+
+bool can_encode_lex_table(const LexTable &);
+EncodedLexTable encode_lex_table(const LexTable &, std::function<uint16_t(const rules::Symbol &)>);
+
+}  // namespace generate_code
+}  // namespace tree_sitter
+
+#endif  // COMPILER_GENERATE_CODE_LEX_TABLE_ENCODING_H_
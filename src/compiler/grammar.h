@@ -32,6 +32,10 @@ struct InputGrammar {
   std::vector<std::unordered_set<rules::NamedSymbol>> expected_conflicts;
   std::vector<rules::Rule> external_tokens;
   std::unordered_set<rules::NamedSymbol> variables_to_inline;
+  bool has_external_state_equivalence = false;
+  bool has_shared_external_scanner_data = false;
+  bool has_external_state_change_tracking = false;
+  bool inline_hidden_rules = false;
 };
 
 }  // namespace tree_sitter
@@ -230,6 +230,8 @@ ParseGrammarResult parse_grammar(const string &input) {
   string name;
   InputGrammar grammar;
   json_value name_json, rules_json, extras_json, conflicts_json, external_tokens_json, inline_rules_json;
+  json_value external_state_equivalence_json, shared_external_scanner_data_json;
+  json_value external_state_change_tracking_json, inline_hidden_rules_json;
 
   json_settings settings = { 0, json_enable_comments, 0, 0, 0, 0 };
   char parse_error[json_error_max];
@@ -359,6 +361,54 @@ ParseGrammarResult parse_grammar(const string &input) {
     }
   }
 
+  external_state_equivalence_json = grammar_json->operator[]("external_state_equivalence");
+  if (external_state_equivalence_json.type != json_none) {
+    if (external_state_equivalence_json.type != json_boolean) {
+      error_message = "External state equivalence must be a boolean";
+      goto error;
+    }
+    if (external_state_equivalence_json.u.boolean && grammar.external_tokens.empty()) {
+      error_message = "External state equivalence requires external tokens";
+      goto error;
+    }
+    grammar.has_external_state_equivalence = external_state_equivalence_json.u.boolean;
+  }
+
+  shared_external_scanner_data_json = grammar_json->operator[]("shared_external_scanner_data");
+  if (shared_external_scanner_data_json.type != json_none) {
+    if (shared_external_scanner_data_json.type != json_boolean) {
+      error_message = "Shared external scanner data must be a boolean";
+      goto error;
+    }
+    if (shared_external_scanner_data_json.u.boolean && grammar.external_tokens.empty()) {
+      error_message = "Shared external scanner data requires external tokens";
+      goto error;
+    }
+    grammar.has_shared_external_scanner_data = shared_external_scanner_data_json.u.boolean;
+  }
+
+  external_state_change_tracking_json = grammar_json->operator[]("external_state_change_tracking");
+  if (external_state_change_tracking_json.type != json_none) {
+    if (external_state_change_tracking_json.type != json_boolean) {
+      error_message = "External state change tracking must be a boolean";
+      goto error;
+    }
+    if (external_state_change_tracking_json.u.boolean && grammar.external_tokens.empty()) {
+      error_message = "External state change tracking requires external tokens";
+      goto error;
+    }
+    grammar.has_external_state_change_tracking = external_state_change_tracking_json.u.boolean;
+  }
+
+  inline_hidden_rules_json = grammar_json->operator[]("inline_hidden_rules");
+  if (inline_hidden_rules_json.type != json_none) {
+    if (inline_hidden_rules_json.type != json_boolean) {
+      error_message = "Inline hidden rules must be a boolean";
+      goto error;
+    }
+    grammar.inline_hidden_rules = inline_hidden_rules_json.u.boolean;
+  }
+
   json_value_free(grammar_json);
   return { name, grammar, "" };
 
@@ -1,4 +1,5 @@
 #include "compiler/parse_table.h"
+#include <algorithm>
 #include <string>
 #include "compiler/precedence_range.h"
 #include "compiler/rule.h"
@@ -152,4 +153,22 @@ void ParseTable::set_nonterminal_action(ParseStateId state_id,
   states[state_id].nonterminal_entries[lookahead] = next_state_id;
 }
 
+static const size_t SMALL_STATE_THRESHOLD = 64;
+
+// States with few entries are stored in a sparse table instead of as rows of
+// the dense parse table.
+bool ParseTable::is_small_state(ParseStateId state_id) const {
+  const ParseState &state = states[state_id];
+  size_t entry_count = state.terminal_entries.size() + state.nonterminal_entries.size();
+  return entry_count <= std::min(SMALL_STATE_THRESHOLD, symbols.size() / 2);
+}
+
+// The dense states come first, so the sparse table starts at the first small
+// state. The first two states are always dense.
+size_t ParseTable::large_state_count() const {
+  size_t result = 0;
+  while (result < states.size() && (result < 2 || !is_small_state(result))) result++;
+  return result;
+}
+
 }  // namespace tree_sitter
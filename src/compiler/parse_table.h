@@ -76,6 +76,8 @@ using AliasSequence = std::vector<rules::Alias>;
 struct ParseTable {
   ParseAction &add_terminal_action(ParseStateId state_id, rules::Symbol, ParseAction);
   void set_nonterminal_action(ParseStateId, rules::Symbol::Index, ParseStateId);
+  bool is_small_state(ParseStateId) const;
+  size_t large_state_count() const;
 
   std::vector<ParseState> states;
   std::set<rules::Symbol> symbols;
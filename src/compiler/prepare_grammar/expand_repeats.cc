@@ -1,6 +1,8 @@
 #include "compiler/prepare_grammar/expand_repeats.h"
 #include <vector>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <cassert>
 #include "compiler/grammar.h"
@@ -13,14 +15,75 @@ using std::string;
 using std::vector;
 using std::pair;
 using std::to_string;
+using std::unordered_map;
+using std::unordered_set;
 using rules::Rule;
 using rules::Symbol;
 
+static bool rules_are_equivalent(const Rule &left, const Rule &right);
+
+static bool choice_includes(const vector<Rule> &elements, const vector<Rule> &other_elements) {
+  for (const Rule &other_element : other_elements) {
+    bool found = false;
+    for (const Rule &element : elements) {
+      if (rules_are_equivalent(element, other_element)) {
+        found = true;
+        break;
+      }
+    }
+    if (!found) return false;
+  }
+  return true;
+}
+
+// Two repeated rules match the same input and produce the same trees when
+// they only differ in the order of the alternatives in their choices, so
+// choices are compared as sets. This agrees with the hash of a choice, which
+// doesn't depend on the order of its elements. Each set must include the
+// other, because a choice's elements can be equivalent to each other.
+static bool rules_are_equivalent(const Rule &left, const Rule &right) {
+  if (left.type != right.type) return false;
+  switch (left.type) {
+    case Rule::ChoiceType: {
+      const auto &left_elements = left.get_unchecked<rules::Choice>().elements;
+      const auto &right_elements = right.get_unchecked<rules::Choice>().elements;
+      return left_elements.size() == right_elements.size() &&
+        choice_includes(left_elements, right_elements) &&
+        choice_includes(right_elements, left_elements);
+    }
+    case Rule::SeqType: {
+      const auto &left_seq = left.get_unchecked<rules::Seq>();
+      const auto &right_seq = right.get_unchecked<rules::Seq>();
+      return rules_are_equivalent(*left_seq.left, *right_seq.left) &&
+        rules_are_equivalent(*left_seq.right, *right_seq.right);
+    }
+    case Rule::MetadataType: {
+      const auto &left_metadata = left.get_unchecked<rules::Metadata>();
+      const auto &right_metadata = right.get_unchecked<rules::Metadata>();
+      return left_metadata.params == right_metadata.params &&
+        rules_are_equivalent(*left_metadata.rule, *right_metadata.rule);
+    }
+    default:
+      return left == right;
+  }
+}
+
+struct RulesAreEquivalent {
+  bool operator()(const Rule &left, const Rule &right) const {
+    return rules_are_equivalent(left, right);
+  }
+};
+
 class ExpandRepeats {
   string rule_name;
   size_t offset;
   size_t repeat_count;
-  vector<pair<Rule, Symbol>> existing_repeats;
+
+  // The repeats are looked up by their content after it has been expanded,
+  // so that repeats of the same content share one auxiliary rule throughout
+  // the grammar.
+  unordered_map<Rule, Symbol, std::hash<Rule>, RulesAreEquivalent> existing_repeats;
+  unordered_set<Symbol> repeat_symbols;
 
   Rule apply(Rule rule) {
     return rule.match(
@@ -36,29 +99,33 @@ class ExpandRepeats {
       },
 
       [&](const rules::Seq &sequence) {
-        auto left = apply(*sequence.left);
-        auto right = apply(*sequence.right);
-        return rules::Seq{left, right};
+        return rules::Seq{apply(*sequence.left), apply(*sequence.right)};
       },
 
       [&](const rules::Repeat &repeat) {
-        for (const auto pair : existing_repeats) {
-          if (pair.first == rule) {
-            return pair.second;
-          }
+        Rule inner_rule = apply(*repeat.rule);
+
+        // A repeat of a repeat matches the same input as the inner repeat.
+        if (inner_rule.is<Symbol>() && repeat_symbols.count(inner_rule.get_unchecked<Symbol>())) {
+          return inner_rule.get_unchecked<Symbol>();
+        }
+
+        auto existing_repeat = existing_repeats.find(inner_rule);
+        if (existing_repeat != existing_repeats.end()) {
+          return existing_repeat->second;
         }
 
-        Rule inner_rule = apply(*repeat.rule);
         size_t index = aux_rules.size();
         string helper_rule_name = rule_name + "_repeat" + to_string(++repeat_count);
         Symbol repeat_symbol = Symbol::non_terminal(offset + index);
-        existing_repeats.push_back({repeat, repeat_symbol});
+        existing_repeats.insert({inner_rule, repeat_symbol});
+        repeat_symbols.insert(repeat_symbol);
         aux_rules.push_back({
           helper_rule_name,
           VariableTypeAuxiliary,
           rules::Choice{{
             rules::Seq{repeat_symbol, repeat_symbol},
-            inner_rule,
+            std::move(inner_rule),
           }}
         });
         return repeat_symbol;
@@ -87,26 +154,21 @@ class ExpandRepeats {
   vector<Variable> aux_rules;
 };
 
-InitialSyntaxGrammar expand_repeats(const InitialSyntaxGrammar &grammar) {
-  InitialSyntaxGrammar result;
-  result.variables = grammar.variables;
-  result.extra_tokens = grammar.extra_tokens;
-  result.expected_conflicts = grammar.expected_conflicts;
-  result.external_tokens = grammar.external_tokens;
-  result.variables_to_inline = grammar.variables_to_inline;
-
-  ExpandRepeats expander(result.variables.size());
-  for (auto &variable : result.variables) {
+// The grammar is expanded in place, since it's usually passed in by the
+// previous stage, which has no further use for it.
+InitialSyntaxGrammar expand_repeats(InitialSyntaxGrammar grammar) {
+  ExpandRepeats expander(grammar.variables.size());
+  for (auto &variable : grammar.variables) {
     variable.rule = expander.expand(variable.rule, variable.name);
   }
 
-  result.variables.insert(
-    result.variables.end(),
-    expander.aux_rules.begin(),
-    expander.aux_rules.end()
+  grammar.variables.insert(
+    grammar.variables.end(),
+    std::make_move_iterator(expander.aux_rules.begin()),
+    std::make_move_iterator(expander.aux_rules.end())
   );
 
-  return result;
+  return grammar;
 }
 
 }  // namespace prepare_grammar
@@ -6,7 +6,7 @@
 namespace tree_sitter {
 namespace prepare_grammar {
 
-InitialSyntaxGrammar expand_repeats(const InitialSyntaxGrammar &);
+InitialSyntaxGrammar expand_repeats(InitialSyntaxGrammar);
 
 }  // namespace prepare_grammar
 }  // namespace tree_sitter
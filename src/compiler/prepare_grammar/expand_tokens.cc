@@ -14,7 +14,7 @@ using std::string;
 using std::vector;
 using rules::Rule;
 
-ExpandTokenResult expand_token(const rules::Rule &rule) {
+ExpandTokenResult expand_token(const rules::Rule &rule, PatternExpansionCache *cache) {
   return rule.match(
     [](const rules::Blank &blank) -> ExpandTokenResult { return Rule(blank); },
 
@@ -36,36 +36,43 @@ ExpandTokenResult expand_token(const rules::Rule &rule) {
       return Rule::seq(elements);
     },
 
-    [](const rules::Pattern &pattern) -> ExpandTokenResult {
-      auto result = parse_regex(pattern.value);
-      if (result.second) return result.second;
-      return result.first;
+    [cache](const rules::Pattern &pattern) -> ExpandTokenResult {
+      if (cache) {
+        auto entry = cache->find(pattern.value);
+        if (entry != cache->end()) return entry->second;
+      }
+      auto parse_result = parse_regex(pattern.value);
+      ExpandTokenResult result = parse_result.second
+        ? ExpandTokenResult(parse_result.second)
+        : ExpandTokenResult(parse_result.first);
+      if (cache) cache->emplace(pattern.value, result);
+      return result;
     },
 
-    [](const rules::Repeat &rule) -> ExpandTokenResult {
-      auto result = expand_token(*rule.rule);
+    [cache](const rules::Repeat &rule) -> ExpandTokenResult {
+      auto result = expand_token(*rule.rule, cache);
       if (result.error) return result.error;
       return Rule::repeat(result.rule);
     },
 
-    [](const rules::Metadata &rule) -> ExpandTokenResult {
-      auto result = expand_token(*rule.rule);
+    [cache](const rules::Metadata &rule) -> ExpandTokenResult {
+      auto result = expand_token(*rule.rule, cache);
       if (result.error) return result.error;
       return Rule(rules::Metadata{result.rule, rule.params});
     },
 
-    [](const rules::Seq &rule) -> ExpandTokenResult {
-      auto left_result = expand_token(*rule.left);
+    [cache](const rules::Seq &rule) -> ExpandTokenResult {
+      auto left_result = expand_token(*rule.left, cache);
       if (left_result.error) return left_result.error;
-      auto right_result = expand_token(*rule.right);
+      auto right_result = expand_token(*rule.right, cache);
       if (right_result.error) return right_result.error;
       return Rule(rules::Seq{left_result.rule, right_result.rule});
     },
 
-    [](const rules::Choice &rule) -> ExpandTokenResult {
+    [cache](const rules::Choice &rule) -> ExpandTokenResult {
       std::vector<Rule> elements;
       for (const auto &element : rule.elements) {
-        auto result = expand_token(element);
+        auto result = expand_token(element, cache);
         if (result.error) return result.error;
         elements.push_back(result.rule);
       }
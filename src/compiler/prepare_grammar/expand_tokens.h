@@ -1,6 +1,8 @@
 #ifndef COMPILER_PREPARE_GRAMMAR_EXPAND_TOKENS_H_
 #define COMPILER_PREPARE_GRAMMAR_EXPAND_TOKENS_H_
 
+#include <string>
+#include <unordered_map>
 #include <utility>
 #include "compiler/rule.h"
 #include "compiler/compile_error.h"
@@ -16,7 +18,12 @@ struct ExpandTokenResult {
   ExpandTokenResult(const CompileError &error) : error(error) {}
 };
 
-ExpandTokenResult expand_token(const rules::Rule &);
+// The expansions of the patterns that have been parsed so far, by their
+// source, so that a pattern that appears many times in a grammar is only
+// parsed once.
+typedef std::unordered_map<std::string, ExpandTokenResult> PatternExpansionCache;
+
+ExpandTokenResult expand_token(const rules::Rule &, PatternExpansionCache *cache = nullptr);
 
 }  // namespace prepare_grammar
 }  // namespace tree_sitter
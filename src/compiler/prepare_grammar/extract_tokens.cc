@@ -87,7 +87,87 @@ class SymbolReplacer {
   }
 };
 
+static void flatten_seq(const Rule &rule, vector<Rule> *elements);
+
+// An expanded token rule in a form where tokens that match the same text are
+// likely to be equal, even when they were written differently. The
+// characters that a choice can match are merged into one set, so that
+// `[ab]` and `a|b` agree, sequences are flattened, so that the way that they
+// were nested doesn't matter, a rule followed by any number of repetitions
+// of itself becomes a repeat, so that `a+` and `aa*` agree, and a repeat of
+// a repeat becomes a single repeat.
+static Rule canonical_token_rule(const Rule &rule) {
+  return rule.match(
+    [](const rules::Choice &choice) {
+      vector<Rule> elements;
+      rules::CharacterSet characters;
+      size_t characters_index = 0;
+      bool has_characters = false;
+      for (const auto &element : choice.elements) {
+        Rule canonical_element = canonical_token_rule(element);
+        if (canonical_element.is<rules::CharacterSet>()) {
+          if (!has_characters) {
+            characters_index = elements.size();
+            elements.push_back(rules::Blank{});
+            has_characters = true;
+          }
+          characters.add_set(canonical_element.get_unchecked<rules::CharacterSet>());
+        } else {
+          elements.push_back(canonical_element);
+        }
+      }
+      if (has_characters) elements[characters_index] = characters;
+      return Rule::choice(elements);
+    },
+
+    [](const rules::Seq &sequence) {
+      vector<Rule> flattened_elements, elements;
+      flatten_seq(sequence, &flattened_elements);
+      for (const Rule &element : flattened_elements) {
+        if (!elements.empty()) {
+          Rule repeat = Rule::repeat(elements.back());
+          if (element == Rule::choice({repeat, rules::Blank{}})) {
+            elements.back() = repeat;
+            continue;
+          }
+        }
+        elements.push_back(element);
+      }
+      return Rule::seq(elements);
+    },
+
+    [](const rules::Repeat &repeat) {
+      return Rule::repeat(canonical_token_rule(*repeat.rule));
+    },
+
+    [](const rules::Metadata &metadata) -> Rule {
+      return rules::Metadata{canonical_token_rule(*metadata.rule), metadata.params};
+    },
+
+    [&rule](auto) {
+      return rule;
+    }
+  );
+}
+
+static void flatten_seq(const Rule &rule, vector<Rule> *elements) {
+  rule.match(
+    [&](const rules::Seq &sequence) {
+      flatten_seq(*sequence.left, elements);
+      flatten_seq(*sequence.right, elements);
+    },
+
+    [&](auto) {
+      elements->push_back(canonical_token_rule(rule));
+    }
+  );
+}
+
 class TokenExtractor {
+  // Besides the tokens that are written the same way, tokens of the same type
+  // whose expansions have the same canonical form are merged. A string and a
+  // pattern that match the same text are kept apart, since strings are
+  // anonymous nodes in the tree and patterns are hidden.
   Symbol extract_token(const rules::Rule &input, VariableType entry_type) {
     for (size_t i = 0; i < tokens.size(); i++) {
       if (tokens[i].rule == input) {
@@ -96,17 +176,30 @@ class TokenExtractor {
       }
     }
 
+    ExpandTokenResult expansion = expand_token(input, &pattern_expansions);
+    Rule canonical_rule = expansion.error ? input : canonical_token_rule(expansion.rule);
+    for (size_t i = 0; i < tokens.size(); i++) {
+      if (tokens[i].type == entry_type && canonical_rules[i] == canonical_rule) {
+        token_usage_counts[i]++;
+        return Symbol::terminal(i);
+      }
+    }
+
     size_t index = tokens.size();
     tokens.push_back({
       token_description(input),
       entry_type,
       input
     });
+    expansions.push_back(std::move(expansion));
+    canonical_rules.push_back(std::move(canonical_rule));
     token_usage_counts.push_back(1);
 
     return Symbol::terminal(index);
   }
 
+  vector<Rule> canonical_rules;
+
  public:
   Rule apply(const rules::Rule &rule) {
     return rule.match(
@@ -163,6 +256,8 @@ class TokenExtractor {
 
   vector<size_t> token_usage_counts;
   vector<Variable> tokens;
+  vector<ExpandTokenResult> expansions;
+  PatternExpansionCache pattern_expansions;
 };
 
 tuple<InitialSyntaxGrammar, LexicalGrammar, CompileError> extract_tokens(
@@ -192,8 +287,9 @@ tuple<InitialSyntaxGrammar, LexicalGrammar, CompileError> extract_tokens(
     });
   }
 
-  for (const auto &extracted_token : extractor.tokens) {
-    auto expansion = expand_token(extracted_token.rule);
+  for (size_t i = 0; i < extractor.tokens.size(); i++) {
+    const Variable &extracted_token = extractor.tokens[i];
+    const ExpandTokenResult &expansion = extractor.expansions[i];
     if (expansion.error) return make_tuple(
       syntax_grammar,
       lexical_grammar,
@@ -214,7 +310,7 @@ tuple<InitialSyntaxGrammar, LexicalGrammar, CompileError> extract_tokens(
   // variable in the lexical grammar. Symbols that pointed to later variables
   // will need to have their indices decremented.
   size_t i = -1;
-  for (const auto &variable : processed_variables) {
+  for (auto &variable : processed_variables) {
     i++;
     if (i > 0 && variable.rule.is<Symbol>()) {
       auto symbol = variable.rule.get_unchecked<Symbol>();
@@ -225,7 +321,7 @@ tuple<InitialSyntaxGrammar, LexicalGrammar, CompileError> extract_tokens(
         continue;
       }
     }
-    syntax_grammar.variables.push_back(variable);
+    syntax_grammar.variables.push_back(std::move(variable));
   }
 
   // Perform any replacements of symbols needed based on the previous step.
@@ -244,6 +340,10 @@ tuple<InitialSyntaxGrammar, LexicalGrammar, CompileError> extract_tokens(
   for (const Symbol &symbol : grammar.variables_to_inline) {
     syntax_grammar.variables_to_inline.insert(symbol_replacer.replace_symbol(symbol));
   }
+  syntax_grammar.has_external_state_equivalence = grammar.has_external_state_equivalence;
+  syntax_grammar.has_shared_external_scanner_data = grammar.has_shared_external_scanner_data;
+  syntax_grammar.has_external_state_change_tracking = grammar.has_external_state_change_tracking;
+  syntax_grammar.inline_hidden_rules = grammar.inline_hidden_rules;
 
   // The grammar's extra tokens can be either token rules or symbols
   // pointing to token rules. If they are symbols, then they'll be handled by
@@ -266,7 +366,7 @@ tuple<InitialSyntaxGrammar, LexicalGrammar, CompileError> extract_tokens(
       },
 
       [&](auto non_symbol) {
-        auto expansion = expand_token(non_symbol);
+        auto expansion = expand_token(non_symbol, &extractor.pattern_expansions);
         if (expansion.error) return CompileError(
           TSCompileErrorTypeInvalidExtraToken,
           "Non-token rule expression can't be used as an extra token"
@@ -329,7 +429,7 @@ tuple<InitialSyntaxGrammar, LexicalGrammar, CompileError> extract_tokens(
     }
   }
 
-  return make_tuple(syntax_grammar, lexical_grammar, CompileError::none());
+  return make_tuple(std::move(syntax_grammar), std::move(lexical_grammar), CompileError::none());
 }
 
 }  // namespace prepare_grammar
@@ -103,11 +103,11 @@ SyntaxVariable flatten_rule(const Variable &variable) {
     Production production = FlattenRule().flatten(rule_component);
     auto end = productions.end();
     if (find(productions.begin(), end, production) == end) {
-      productions.push_back(production);
+      productions.push_back(std::move(production));
     }
   }
 
-  return SyntaxVariable{variable.name, variable.type, productions};
+  return SyntaxVariable{variable.name, variable.type, std::move(productions)};
 }
 
 static bool variable_is_used(const SyntaxGrammar &grammar, Symbol::Index symbol_index) {
@@ -123,10 +123,78 @@ static bool variable_is_used(const SyntaxGrammar &grammar, Symbol::Index symbol_
   return false;
 }
 
+// When a grammar asks for its hidden rules to be inlined, each hidden rule is
+// inlined unless inlining it would change the trees, or couldn't finish. The
+// start rule is kept, along with rules that are aliased, which would give the
+// alias to each of their steps instead, rules with dynamic precedence, which
+// would be lost, and rules that are named in conflicts. Rules that can reach
+// themselves through other rules that would be inlined are kept too, since
+// inlining them would never end.
+static void add_hidden_variables_to_inline(SyntaxGrammar *grammar) {
+  vector<bool> can_inline(grammar->variables.size(), false);
+  for (size_t i = 1; i < grammar->variables.size(); i++) {
+    const SyntaxVariable &variable = grammar->variables[i];
+    if (variable.type != VariableTypeHidden) continue;
+    can_inline[i] = true;
+    for (const Production &production : variable.productions) {
+      if (production.dynamic_precedence != 0) can_inline[i] = false;
+    }
+  }
+
+  for (const SyntaxVariable &variable : grammar->variables) {
+    for (const Production &production : variable.productions) {
+      for (const ProductionStep &step : production) {
+        if (step.symbol.is_non_terminal() && !step.alias.value.empty()) {
+          can_inline[step.symbol.index] = false;
+        }
+      }
+    }
+  }
+
+  for (const auto &expected_conflict : grammar->expected_conflicts) {
+    for (const Symbol &symbol : expected_conflict) {
+      if (symbol.is_non_terminal()) can_inline[symbol.index] = false;
+    }
+  }
+
+  auto reaches_itself = [&](Symbol::Index index) {
+    vector<bool> visited(grammar->variables.size(), false);
+    vector<Symbol::Index> stack({index});
+    while (!stack.empty()) {
+      Symbol::Index current = stack.back();
+      stack.pop_back();
+      for (const Production &production : grammar->variables[current].productions) {
+        for (const ProductionStep &step : production) {
+          if (!step.symbol.is_non_terminal() || !can_inline[step.symbol.index]) continue;
+          if (step.symbol.index == index) return true;
+          if (!visited[step.symbol.index]) {
+            visited[step.symbol.index] = true;
+            stack.push_back(step.symbol.index);
+          }
+        }
+      }
+    }
+    return false;
+  };
+
+  vector<Symbol::Index> recursive_variables;
+  for (size_t i = 0; i < grammar->variables.size(); i++) {
+    if (can_inline[i] && reaches_itself(i)) recursive_variables.push_back(i);
+  }
+  for (Symbol::Index index : recursive_variables) can_inline[index] = false;
+
+  for (size_t i = 0; i < grammar->variables.size(); i++) {
+    if (can_inline[i]) grammar->variables_to_inline.insert(Symbol::non_terminal(i));
+  }
+}
+
 pair<SyntaxGrammar, CompileError> flatten_grammar(const InitialSyntaxGrammar &grammar) {
   SyntaxGrammar result;
   result.external_tokens = grammar.external_tokens;
   result.variables_to_inline = grammar.variables_to_inline;
+  result.has_external_state_equivalence = grammar.has_external_state_equivalence;
+  result.has_shared_external_scanner_data = grammar.has_shared_external_scanner_data;
+  result.has_external_state_change_tracking = grammar.has_external_state_change_tracking;
 
   for (const auto &expected_conflict : grammar.expected_conflicts) {
     result.expected_conflicts.insert({
@@ -148,7 +216,7 @@ pair<SyntaxGrammar, CompileError> flatten_grammar(const InitialSyntaxGrammar &gr
     for (const Production &production : variable.productions) {
       if (production.empty() && variable_is_used(result, i)) {
         return {
-          result,
+          std::move(result),
           CompileError(
             TSCompileErrorTypeEpsilonRule,
             "The rule `" + variable.name + "` matches the empty string.\n\n" +
@@ -161,7 +229,9 @@ pair<SyntaxGrammar, CompileError> flatten_grammar(const InitialSyntaxGrammar &gr
     i++;
   }
 
-  return {result, CompileError::none()};
+  if (grammar.inline_hidden_rules) add_hidden_variables_to_inline(&result);
+
+  return {std::move(result), CompileError::none()};
 }
 
 }  // namespace prepare_grammar
@@ -3,6 +3,7 @@
 #include <vector>
 #include <cassert>
 #include <set>
+#include <unordered_map>
 #include "tree_sitter/compiler.h"
 #include "compiler/grammar.h"
 #include "compiler/rule.h"
@@ -14,6 +15,7 @@ using std::string;
 using std::vector;
 using std::set;
 using std::pair;
+using std::unordered_map;
 using rules::Symbol;
 using rules::Rule;
 
@@ -42,7 +44,7 @@ class SymbolInterner {
         for (const auto &element : choice.elements) {
           elements.push_back(apply(element));
         }
-        return rules::Choice{elements};
+        return rules::Choice{std::move(elements)};
       },
 
       [&](const rules::Seq &sequence) {
@@ -64,11 +66,10 @@ class SymbolInterner {
     );
   }
 
-  Symbol intern_symbol(rules::NamedSymbol named_symbol) {
-    for (size_t i = 0; i < grammar.variables.size(); i++) {
-      if (grammar.variables[i].name == named_symbol.value) {
-        return Symbol::non_terminal(i);
-      }
+  Symbol intern_symbol(const rules::NamedSymbol &named_symbol) {
+    auto entry = variable_indices.find(named_symbol.value);
+    if (entry != variable_indices.end()) {
+      return Symbol::non_terminal(entry->second);
     }
 
     for (size_t i = 0; i < grammar.external_tokens.size(); i++) {
@@ -81,8 +82,15 @@ class SymbolInterner {
     return rules::NONE();
   }
 
-  explicit SymbolInterner(const InputGrammar &grammar) : grammar(grammar) {}
+  // If several variables have the same name, the first one is used.
+  explicit SymbolInterner(const InputGrammar &grammar) : grammar(grammar) {
+    for (size_t i = 0; i < grammar.variables.size(); i++) {
+      variable_indices.emplace(grammar.variables[i].name, i);
+    }
+  }
+
   const InputGrammar &grammar;
+  unordered_map<string, size_t> variable_indices;
   string missing_rule_name;
 };
 
@@ -119,7 +127,7 @@ pair<InternedGrammar, CompileError> intern_symbols(const InputGrammar &grammar)
     result.external_tokens.push_back(Variable{
       external_token_name,
       external_token_type,
-      new_rule,
+      std::move(new_rule),
     });
   }
 
@@ -136,7 +144,7 @@ pair<InternedGrammar, CompileError> intern_symbols(const InputGrammar &grammar)
     result.variables.push_back(Variable{
       variable.name,
       variable.name[0] == '_' ? VariableTypeHidden : VariableTypeNamed,
-      new_rule
+      std::move(new_rule)
     });
   }
 
@@ -145,7 +153,7 @@ pair<InternedGrammar, CompileError> intern_symbols(const InputGrammar &grammar)
     if (!interner.missing_rule_name.empty()) {
       return { result, missing_rule_error(interner.missing_rule_name) };
     }
-    result.extra_tokens.push_back(new_rule);
+    result.extra_tokens.push_back(std::move(new_rule));
   }
 
   for (auto &expected_conflict : grammar.expected_conflicts) {
@@ -156,7 +164,7 @@ pair<InternedGrammar, CompileError> intern_symbols(const InputGrammar &grammar)
         entry.insert(symbol);
       }
     }
-    result.expected_conflicts.insert(entry);
+    result.expected_conflicts.insert(std::move(entry));
   }
 
   for (auto &named_symbol : grammar.variables_to_inline) {
@@ -166,7 +174,12 @@ pair<InternedGrammar, CompileError> intern_symbols(const InputGrammar &grammar)
     }
   }
 
-  return {result, CompileError::none()};
+  result.has_external_state_equivalence = grammar.has_external_state_equivalence;
+  result.has_shared_external_scanner_data = grammar.has_shared_external_scanner_data;
+  result.has_external_state_change_tracking = grammar.has_external_state_change_tracking;
+  result.inline_hidden_rules = grammar.inline_hidden_rules;
+
+  return {std::move(result), CompileError::none()};
 }
 
 }  // namespace prepare_grammar
@@ -17,6 +17,10 @@ struct InternedGrammar {
   std::vector<Variable> external_tokens;
   std::set<rules::Symbol> blank_external_tokens;
   std::set<rules::Symbol> variables_to_inline;
+  bool has_external_state_equivalence = false;
+  bool has_shared_external_scanner_data = false;
+  bool has_external_state_change_tracking = false;
+  bool inline_hidden_rules = false;
 };
 
 }  // namespace prepare_grammar
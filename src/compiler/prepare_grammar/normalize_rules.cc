@@ -7,14 +7,12 @@ namespace prepare_grammar {
 using std::vector;
 using rules::Rule;
 
-LexicalGrammar normalize_rules(const LexicalGrammar &input_grammar) {
-  LexicalGrammar result(input_grammar);
-
-  for (LexicalVariable &variable : result.variables) {
+LexicalGrammar normalize_rules(LexicalGrammar grammar) {
+  for (LexicalVariable &variable : grammar.variables) {
     variable.rule = Rule::choice(extract_choices(variable.rule));
   }
 
-  return result;
+  return grammar;
 }
 
 }  // namespace prepare_grammar
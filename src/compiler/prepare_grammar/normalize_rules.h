@@ -6,7 +6,7 @@
 namespace tree_sitter {
 namespace prepare_grammar {
 
-LexicalGrammar normalize_rules(const LexicalGrammar &);
+LexicalGrammar normalize_rules(LexicalGrammar);
 
 }  // namespace prepare_grammar
 }  // namespace tree_sitter
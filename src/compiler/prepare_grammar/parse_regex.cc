@@ -16,6 +16,13 @@ using rules::CharacterSet;
 using rules::Blank;
 using rules::Rule;
 
+static bool is_single_character(const CharacterSet &characters, uint32_t *result) {
+  const auto &ranges = characters.included_ranges();
+  if (characters.includes_all || ranges.size() != 1 || ranges[0].min != ranges[0].max) return false;
+  *result = ranges[0].min;
+  return true;
+}
+
 class PatternParser {
  public:
   explicit PatternParser(const string &input)
@@ -155,13 +162,11 @@ class PatternParser {
 
       if (peek() == '-') {
         next();
-        if (!characters.includes_all && characters.included_chars.size() == 1 && peek() != ']') {
+        uint32_t min, max;
+        if (is_single_character(characters, &min) && peek() != ']') {
           auto next_characters = single_char();
-          if (!next_characters.includes_all && next_characters.included_chars.size() == 1) {
-            characters.include(
-              *characters.included_chars.begin(),
-              *next_characters.included_chars.begin()
-            );
+          if (is_single_character(next_characters, &max)) {
+            characters.include(min, max);
           } else {
             characters.include('-');
             characters.add_set(next_characters);
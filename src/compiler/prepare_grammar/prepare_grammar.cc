@@ -15,9 +15,15 @@ namespace prepare_grammar {
 using std::tuple;
 using std::get;
 using std::make_tuple;
+using std::move;
 
 tuple<SyntaxGrammar, LexicalGrammar, CompileError> prepare_grammar(
   const InputGrammar &input_grammar) {
+  /*
+   * Each stage's result is moved into the next stage, so that the rules are
+   * transformed in place where possible, rather than copied.
+   */
+
   /*
    * Convert all string-based `NamedSymbols` into numerical `Symbols`
    */
@@ -38,12 +44,12 @@ tuple<SyntaxGrammar, LexicalGrammar, CompileError> prepare_grammar(
   /*
    * Replace `Repeat` rules with pairs of recursive rules
    */
-  InitialSyntaxGrammar syntax_grammar1 = expand_repeats(get<0>(extract_result));
+  InitialSyntaxGrammar syntax_grammar1 = expand_repeats(move(get<0>(extract_result)));
 
   /*
    * Expand `String` and `Pattern` rules into full rule trees
    */
-  LexicalGrammar lex_grammar = get<1>(extract_result);
+  LexicalGrammar lex_grammar = move(get<1>(extract_result));
   // auto expand_tokens_result = expand_tokens(get<1>(extract_result));
   // LexicalGrammar lex_grammar = expand_tokens_result.first;
   // error = expand_tokens_result.second;
@@ -54,7 +60,7 @@ tuple<SyntaxGrammar, LexicalGrammar, CompileError> prepare_grammar(
    * Flatten syntax rules into lists of productions.
    */
   auto flatten_result = flatten_grammar(syntax_grammar1);
-  SyntaxGrammar syntax_grammar = flatten_result.first;
+  SyntaxGrammar syntax_grammar = move(flatten_result.first);
   error = flatten_result.second;
   if (error.type)
     return make_tuple(SyntaxGrammar(), LexicalGrammar(), error);
@@ -62,9 +68,9 @@ tuple<SyntaxGrammar, LexicalGrammar, CompileError> prepare_grammar(
   /*
    * Ensure all lexical rules are in a consistent format.
    */
-  lex_grammar = normalize_rules(lex_grammar);
+  lex_grammar = normalize_rules(move(lex_grammar));
 
-  return make_tuple(syntax_grammar, lex_grammar, CompileError::none());
+  return make_tuple(move(syntax_grammar), move(lex_grammar), CompileError::none());
 }
 
 }  // namespace prepare_grammar
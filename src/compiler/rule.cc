@@ -141,12 +141,24 @@ bool Rule::is<Repeat>() const { return type == RepeatType; }
 template <>
 bool Rule::is<Metadata>() const { return type == MetadataType; }
 
+template <>
+bool Rule::is<CharacterSet>() const { return type == CharacterSetType; }
+
 template <>
 const Symbol & Rule::get_unchecked<Symbol>() const { return symbol_; }
 
 template <>
 const Metadata & Rule::get_unchecked<Metadata>() const { return metadata_; }
 
+template <>
+const Choice & Rule::get_unchecked<Choice>() const { return choice_; }
+
+template <>
+const CharacterSet & Rule::get_unchecked<CharacterSet>() const { return character_set_; }
+
+template <>
+const Seq & Rule::get_unchecked<Seq>() const { return seq_; }
+
 static inline void add_choice_element(std::vector<Rule> *elements, const Rule &new_rule) {
   new_rule.match(
     [elements](Choice choice) {
@@ -224,13 +236,15 @@ size_t hash<String>::operator()(const String &symbol) const {
 size_t hash<CharacterSet>::operator()(const CharacterSet &character_set) const {
   size_t result = 0;
   hash_combine(&result, character_set.includes_all);
-  hash_combine(&result, character_set.included_chars.size());
-  for (uint32_t c : character_set.included_chars) {
-    hash_combine(&result, c);
+  hash_combine(&result, character_set.included_ranges().size());
+  for (const CharacterRange &range : character_set.included_ranges()) {
+    hash_combine(&result, range.min);
+    hash_combine(&result, range.max);
   }
-  hash_combine(&result, character_set.excluded_chars.size());
-  for (uint32_t c : character_set.excluded_chars) {
-    hash_combine(&result, c);
+  hash_combine(&result, character_set.excluded_ranges().size());
+  for (const CharacterRange &range : character_set.excluded_ranges()) {
+    hash_combine(&result, range.min);
+    hash_combine(&result, range.max);
   }
   return result;
 }
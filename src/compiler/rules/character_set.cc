@@ -1,4 +1,5 @@
 #include "compiler/rules/character_set.h"
+#include <algorithm>
 
 using std::set;
 using std::vector;
@@ -6,53 +7,126 @@ using std::vector;
 namespace tree_sitter {
 namespace rules {
 
-static void add_range(set<uint32_t> *characters, uint32_t min, uint32_t max) {
-  for (uint32_t c = min; c <= max; c++) {
-    characters->insert(c);
+using Ranges = vector<CharacterRange>;
+
+static uint64_t range_size(const CharacterRange &range) {
+  return static_cast<uint64_t>(range.max) - range.min + 1;
+}
+
+static uint64_t total_size(const Ranges &ranges) {
+  uint64_t result = 0;
+  for (const CharacterRange &range : ranges) result += range_size(range);
+  return result;
+}
+
+// Append a range that starts no earlier than the last one, merging it into the
+// last one if they overlap or touch.
+static void append_range(Ranges *ranges, uint32_t min, uint32_t max) {
+  if (!ranges->empty() && static_cast<uint64_t>(ranges->back().max) + 1 >= min) {
+    ranges->back().max = std::max(ranges->back().max, max);
+  } else {
+    ranges->push_back(CharacterRange{min, max});
   }
 }
 
-static void remove_range(set<uint32_t> *characters, uint32_t min, uint32_t max) {
-  for (uint32_t c = min; c <= max; c++) {
-    characters->erase(c);
+static Ranges range_union(const Ranges &left, const Ranges &right) {
+  Ranges result;
+  result.reserve(left.size() + right.size());
+  auto left_iter = left.begin(), right_iter = right.begin();
+  while (left_iter != left.end() || right_iter != right.end()) {
+    if (right_iter == right.end() || (left_iter != left.end() && left_iter->min <= right_iter->min)) {
+      append_range(&result, left_iter->min, left_iter->max);
+      ++left_iter;
+    } else {
+      append_range(&result, right_iter->min, right_iter->max);
+      ++right_iter;
+    }
   }
+  return result;
 }
 
-static set<uint32_t> remove_chars(set<uint32_t> *left, const set<uint32_t> &right) {
-  set<uint32_t> result;
-  for (uint32_t c : right) {
-    if (left->erase(c)) {
-      result.insert(c);
+static Ranges range_intersection(const Ranges &left, const Ranges &right) {
+  Ranges result;
+  auto left_iter = left.begin(), right_iter = right.begin();
+  while (left_iter != left.end() && right_iter != right.end()) {
+    uint32_t min = std::max(left_iter->min, right_iter->min);
+    uint32_t max = std::min(left_iter->max, right_iter->max);
+    if (min <= max) result.push_back(CharacterRange{min, max});
+    if (left_iter->max < right_iter->max) {
+      ++left_iter;
+    } else {
+      ++right_iter;
     }
   }
   return result;
 }
 
-static set<uint32_t> add_chars(set<uint32_t> *left, const set<uint32_t> &right) {
-  set<uint32_t> result;
-  for (uint32_t c : right) {
-    if (left->insert(c).second) {
-      result.insert(c);
+static Ranges range_difference(const Ranges &left, const Ranges &right) {
+  Ranges result;
+  auto right_iter = right.begin();
+  for (const CharacterRange &range : left) {
+    while (right_iter != right.end() && right_iter->max < range.min) ++right_iter;
+    uint64_t min = range.min;
+    for (auto iter = right_iter; iter != right.end() && iter->min <= range.max; ++iter) {
+      if (iter->min > min) result.push_back(CharacterRange(min, iter->min - 1));
+      min = static_cast<uint64_t>(iter->max) + 1;
+      if (min > range.max) break;
     }
+    if (min <= range.max) result.push_back(CharacterRange(min, range.max));
   }
   return result;
 }
 
-static vector<CharacterRange> consolidate_ranges(const set<uint32_t> &characters) {
-  vector<CharacterRange> result;
-  for (uint32_t c : characters) {
-    if (!result.empty() && result.back().max == c - 1) {
-      result.back().max = c;
+static bool ranges_intersect(const Ranges &left, const Ranges &right) {
+  auto left_iter = left.begin(), right_iter = right.begin();
+  while (left_iter != left.end() && right_iter != right.end()) {
+    if (left_iter->max < right_iter->min) {
+      ++left_iter;
+    } else if (right_iter->max < left_iter->min) {
+      ++right_iter;
     } else {
-      result.push_back(CharacterRange(c));
+      return true;
     }
   }
-  return result;
+  return false;
+}
+
+// Find the range that ends at or after the given character.
+static Ranges::const_iterator find_range(const Ranges &ranges, uint32_t c) {
+  return std::lower_bound(ranges.begin(), ranges.end(), c, [](const CharacterRange &range, uint32_t c) {
+    return range.max < c;
+  });
+}
+
+// Compare the two sorted sequences of characters that the ranges contain,
+// a range at a time.
+static bool ranges_precede(const Ranges &left, const Ranges &right) {
+  auto left_iter = left.begin(), right_iter = right.begin();
+  uint64_t left_min = 0, right_min = 0;
+  if (left_iter != left.end()) left_min = left_iter->min;
+  if (right_iter != right.end()) right_min = right_iter->min;
+  while (left_iter != left.end() && right_iter != right.end()) {
+    if (left_min != right_min) return left_min < right_min;
+    uint64_t max = std::min(left_iter->max, right_iter->max);
+    if (max == left_iter->max && ++left_iter != left.end()) {
+      left_min = left_iter->min;
+    } else {
+      left_min = max + 1;
+    }
+    if (max == right_iter->max && ++right_iter != right.end()) {
+      right_min = right_iter->min;
+    } else {
+      right_min = max + 1;
+    }
+  }
+  return left_iter == left.end() && right_iter != right.end();
 }
 
 CharacterSet::CharacterSet() : includes_all(false) {}
 
-CharacterSet::CharacterSet(const set<uint32_t> &chars) : included_chars(chars), includes_all(false) {}
+CharacterSet::CharacterSet(const set<uint32_t> &chars) : includes_all(false) {
+  for (uint32_t c : chars) append_range(&included_chars, c, c);
+}
 
 bool CharacterSet::operator==(const CharacterSet &other) const {
   return includes_all == other.includes_all &&
@@ -64,36 +138,38 @@ bool CharacterSet::operator<(const CharacterSet &other) const {
   if (!includes_all && other.includes_all) return true;
   if (includes_all && !other.includes_all) return false;
   if (includes_all) {
-    if (excluded_chars.size() > other.excluded_chars.size()) return true;
-    if (excluded_chars.size() < other.excluded_chars.size()) return false;
-    return excluded_chars < other.excluded_chars;
+    uint64_t size = total_size(excluded_chars), other_size = total_size(other.excluded_chars);
+    if (size > other_size) return true;
+    if (size < other_size) return false;
+    return ranges_precede(excluded_chars, other.excluded_chars);
   } else {
-    if (included_chars.size() < other.included_chars.size()) return true;
-    if (included_chars.size() > other.included_chars.size()) return false;
-    return included_chars < other.included_chars;
+    uint64_t size = total_size(included_chars), other_size = total_size(other.included_chars);
+    if (size < other_size) return true;
+    if (size > other_size) return false;
+    return ranges_precede(included_chars, other.included_chars);
   }
 }
 
 CharacterSet &CharacterSet::include_all() {
   includes_all = true;
   included_chars = {};
-  excluded_chars = { 0 };
+  excluded_chars = { CharacterRange(0) };
   return *this;
 }
 
 CharacterSet &CharacterSet::include(uint32_t min, uint32_t max) {
   if (includes_all)
-    remove_range(&excluded_chars, min, max);
+    excluded_chars = range_difference(excluded_chars, { CharacterRange(min, max) });
   else
-    add_range(&included_chars, min, max);
+    included_chars = range_union(included_chars, { CharacterRange(min, max) });
   return *this;
 }
 
 CharacterSet &CharacterSet::exclude(uint32_t min, uint32_t max) {
   if (includes_all)
-    add_range(&excluded_chars, min, max);
+    excluded_chars = range_union(excluded_chars, { CharacterRange(min, max) });
   else
-    remove_range(&included_chars, min, max);
+    included_chars = range_difference(included_chars, { CharacterRange(min, max) });
   return *this;
 }
 
@@ -109,22 +185,35 @@ bool CharacterSet::is_empty() const {
   return !includes_all && included_chars.empty();
 }
 
+bool CharacterSet::contains(uint32_t c) const {
+  return contains(c, c);
+}
+
+// Whether every character from `min` to `max` is in the set.
+bool CharacterSet::contains(uint32_t min, uint32_t max) const {
+  if (includes_all) {
+    auto iter = find_range(excluded_chars, min);
+    return iter == excluded_chars.end() || iter->min > max;
+  } else {
+    auto iter = find_range(included_chars, min);
+    return iter != included_chars.end() && iter->min <= min && max <= iter->max;
+  }
+}
+
 void CharacterSet::add_set(const CharacterSet &other) {
   if (includes_all) {
     if (other.includes_all) {
-      excluded_chars = remove_chars(&excluded_chars, other.excluded_chars);
+      excluded_chars = range_intersection(excluded_chars, other.excluded_chars);
     } else {
-      remove_chars(&excluded_chars, other.included_chars);
+      excluded_chars = range_difference(excluded_chars, other.included_chars);
     }
   } else {
     if (other.includes_all) {
       includes_all = true;
-      for (uint32_t c : other.excluded_chars)
-        if (!included_chars.count(c))
-          excluded_chars.insert(c);
+      excluded_chars = range_difference(other.excluded_chars, included_chars);
       included_chars.clear();
     } else {
-      included_chars.insert(other.included_chars.begin(), other.included_chars.end());
+      included_chars = range_union(included_chars, other.included_chars);
     }
   }
 }
@@ -134,37 +223,42 @@ CharacterSet CharacterSet::remove_set(const CharacterSet &other) {
   if (includes_all) {
     if (other.includes_all) {
       result.includes_all = true;
-      result.excluded_chars = excluded_chars;
-      included_chars = add_chars(&result.excluded_chars, other.excluded_chars);
+      result.excluded_chars = range_union(excluded_chars, other.excluded_chars);
+      included_chars = range_difference(other.excluded_chars, excluded_chars);
       excluded_chars = {};
       includes_all = false;
     } else {
-      result.included_chars = add_chars(&excluded_chars, other.included_chars);
+      result.included_chars = range_difference(other.included_chars, excluded_chars);
+      excluded_chars = range_union(excluded_chars, other.included_chars);
     }
   } else {
     if (other.includes_all) {
-      result.included_chars = included_chars;
-      included_chars =
-        remove_chars(&result.included_chars, other.excluded_chars);
+      result.included_chars = range_difference(included_chars, other.excluded_chars);
+      included_chars = range_intersection(included_chars, other.excluded_chars);
     } else {
-      result.included_chars =
-        remove_chars(&included_chars, other.included_chars);
+      result.included_chars = range_intersection(included_chars, other.included_chars);
+      included_chars = range_difference(included_chars, other.included_chars);
     }
   }
   return result;
 }
 
 bool CharacterSet::intersects(const CharacterSet &other) const {
-  CharacterSet copy(*this);
-  return !copy.remove_set(other).is_empty();
+  if (includes_all) {
+    if (other.includes_all) return true;
+    return !range_difference(other.included_chars, excluded_chars).empty();
+  } else {
+    if (other.includes_all) return !range_difference(included_chars, other.excluded_chars).empty();
+    return ranges_intersect(included_chars, other.included_chars);
+  }
 }
 
-vector<CharacterRange> CharacterSet::included_ranges() const {
-  return consolidate_ranges(included_chars);
+const vector<CharacterRange> &CharacterSet::included_ranges() const {
+  return included_chars;
 }
 
-vector<CharacterRange> CharacterSet::excluded_ranges() const {
-  return consolidate_ranges(excluded_chars);
+const vector<CharacterRange> &CharacterSet::excluded_ranges() const {
+  return excluded_chars;
 }
 
 }  // namespace rules
@@ -20,6 +20,9 @@ struct CharacterRange {
   }
 };
 
+// The characters are stored as sorted, disjoint, non-adjacent ranges, so that
+// large classes like the unicode categories stay small, and two sets with the
+// same characters have the same ranges.
 struct CharacterSet {
   CharacterSet();
   CharacterSet(const std::set<uint32_t> &);
@@ -37,13 +40,17 @@ struct CharacterSet {
   CharacterSet remove_set(const CharacterSet &other);
   bool intersects(const CharacterSet &other) const;
   bool is_empty() const;
+  bool contains(uint32_t c) const;
+  bool contains(uint32_t min, uint32_t max) const;
 
-  std::vector<CharacterRange> included_ranges() const;
-  std::vector<CharacterRange> excluded_ranges() const;
+  const std::vector<CharacterRange> &included_ranges() const;
+  const std::vector<CharacterRange> &excluded_ranges() const;
 
-  std::set<uint32_t> included_chars;
-  std::set<uint32_t> excluded_chars;
   bool includes_all;
+
+ private:
+  std::vector<CharacterRange> included_chars;
+  std::vector<CharacterRange> excluded_chars;
 };
 
 }  // namespace rules
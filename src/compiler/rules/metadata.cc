@@ -26,6 +26,9 @@ bool Alias::operator<(const Alias &other) const {
 Metadata::Metadata(const Rule &rule, MetadataParams params) :
   rule(std::make_shared<Rule>(rule)), params(params) {}
 
+Metadata::Metadata(Rule &&rule, MetadataParams params) :
+  rule(std::make_shared<Rule>(std::move(rule))), params(params) {}
+
 bool Metadata::operator==(const Metadata &other) const {
   return rule->operator==(*other.rule) && params == other.params;
 }
@@ -61,6 +61,7 @@ struct Metadata {
   MetadataParams params;
 
   Metadata(const Rule &rule, MetadataParams params);
+  Metadata(Rule &&rule, MetadataParams params);
 
   static Metadata merge(Rule &&rule, MetadataParams params);
   static Metadata token(Rule &&rule);
@@ -7,6 +7,9 @@ namespace rules {
 Repeat::Repeat(const Rule &rule) :
   rule(std::make_shared<Rule>(rule)) {}
 
+Repeat::Repeat(Rule &&rule) :
+  rule(std::make_shared<Rule>(std::move(rule))) {}
+
 bool Repeat::operator==(const Repeat &other) const {
   return rule->operator==(*other.rule);
 }
@@ -12,6 +12,7 @@ struct Repeat {
   std::shared_ptr<Rule> rule;
 
   explicit Repeat(const Rule &rule);
+  explicit Repeat(Rule &&rule);
   bool operator==(const Repeat &other) const;
 };
 
@@ -8,6 +8,10 @@ Seq::Seq(const Rule &left, const Rule &right) :
   left(std::make_shared<Rule>(left)),
   right(std::make_shared<Rule>(right)) {}
 
+Seq::Seq(Rule &&left, Rule &&right) :
+  left(std::make_shared<Rule>(std::move(left))),
+  right(std::make_shared<Rule>(std::move(right))) {}
+
 bool Seq::operator==(const Seq &other) const {
   return left->operator==(*other.left) && right->operator==(*other.right);
 }
@@ -14,6 +14,7 @@ struct Seq {
   std::shared_ptr<Rule> right;
 
   Seq(const Rule &left, const Rule &right);
+  Seq(Rule &&left, Rule &&right);
   bool operator==(const Seq &other) const;
 };
 
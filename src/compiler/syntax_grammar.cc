@@ -27,10 +27,25 @@ bool Production::operator==(const Production &other) const {
   return steps == other.steps && dynamic_precedence == other.dynamic_precedence;
 }
 
+bool SyntaxVariable::operator==(const SyntaxVariable &other) const {
+  return name == other.name && type == other.type && productions == other.productions;
+}
+
 bool ExternalToken::operator==(const ExternalToken &other) const {
   return name == other.name &&
     type == other.type &&
     corresponding_internal_token == other.corresponding_internal_token;
 }
 
+bool SyntaxGrammar::operator==(const SyntaxGrammar &other) const {
+  return variables == other.variables &&
+    extra_tokens == other.extra_tokens &&
+    expected_conflicts == other.expected_conflicts &&
+    external_tokens == other.external_tokens &&
+    variables_to_inline == other.variables_to_inline &&
+    has_external_state_equivalence == other.has_external_state_equivalence &&
+    has_shared_external_scanner_data == other.has_shared_external_scanner_data &&
+    has_external_state_change_tracking == other.has_external_state_change_tracking;
+}
+
 }  // namespace tree_sitter
@@ -44,6 +44,8 @@ struct SyntaxVariable {
   std::string name;
   VariableType type;
   std::vector<Production> productions;
+
+  bool operator==(const SyntaxVariable &) const;
 };
 
 struct ExternalToken {
@@ -60,6 +62,11 @@ struct SyntaxGrammar {
   std::set<std::set<rules::Symbol>> expected_conflicts;
   std::vector<ExternalToken> external_tokens;
   std::set<rules::Symbol> variables_to_inline;
+  bool has_external_state_equivalence = false;
+  bool has_shared_external_scanner_data = false;
+  bool has_external_state_change_tracking = false;
+
+  bool operator==(const SyntaxGrammar &) const;
 };
 
 }  // namespace tree_sitter
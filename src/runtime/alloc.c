@@ -0,0 +1,40 @@
+#include "tree_sitter/runtime.h"
+#include "runtime/alloc.h"
+
+// The allocator is global, so it should be installed before anything else is
+// allocated, and left in place until everything that was allocated with it has
+// been freed. An allocator that is missing any of its functions is ignored,
+// and the C library's functions are used instead.
+
+static TSAllocator ts_current_allocator;
+
+void ts_set_allocator(TSAllocator allocator) {
+  if (allocator.malloc && allocator.calloc && allocator.realloc && allocator.free) {
+    ts_current_allocator = allocator;
+  } else {
+    ts_current_allocator = (TSAllocator){0};
+  }
+}
+
+void *ts_allocator_malloc(size_t size) {
+  if (!ts_current_allocator.malloc) return malloc(size);
+  return ts_current_allocator.malloc(ts_current_allocator.payload, size);
+}
+
+void *ts_allocator_calloc(size_t count, size_t size) {
+  if (!ts_current_allocator.calloc) return calloc(count, size);
+  return ts_current_allocator.calloc(ts_current_allocator.payload, count, size);
+}
+
+void *ts_allocator_realloc(void *buffer, size_t size) {
+  if (!ts_current_allocator.realloc) return realloc(buffer, size);
+  return ts_current_allocator.realloc(ts_current_allocator.payload, buffer, size);
+}
+
+void ts_allocator_free(void *buffer) {
+  if (!ts_current_allocator.free) {
+    free(buffer);
+  } else {
+    ts_current_allocator.free(ts_current_allocator.payload, buffer);
+  }
+}
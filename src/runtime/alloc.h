@@ -9,6 +9,14 @@ extern "C" {
 #include <stdbool.h>
 #include <stdio.h>
 
+// The functions that the runtime's allocations are ultimately made with. Unless
+// an allocator has been installed with `ts_set_allocator`, these are the ones
+// from the C library.
+void *ts_allocator_malloc(size_t);
+void *ts_allocator_calloc(size_t, size_t);
+void *ts_allocator_realloc(void *, size_t);
+void ts_allocator_free(void *);
+
 #if defined(TREE_SITTER_WRAP_MALLOC)
 
 void *ts_record_malloc(size_t);
@@ -39,14 +47,12 @@ static inline bool ts_toggle_allocation_recording(bool value) {
 
 #else
 
-#include <stdlib.h>
-
 static inline bool ts_toggle_allocation_recording(bool value) {
   return false;
 }
 
 static inline void *ts_malloc(size_t size) {
-  void *result = malloc(size);
+  void *result = ts_allocator_malloc(size);
   if (size > 0 && !result) {
     fprintf(stderr, "tree-sitter failed to allocate %lu bytes", size);
     exit(1);
@@ -55,7 +61,7 @@ static inline void *ts_malloc(size_t size) {
 }
 
 static inline void *ts_calloc(size_t count, size_t size) {
-  void *result = calloc(count, size);
+  void *result = ts_allocator_calloc(count, size);
   if (count > 0 && !result) {
     fprintf(stderr, "tree-sitter failed to allocate %lu bytes", count * size);
     exit(1);
@@ -64,7 +70,7 @@ static inline void *ts_calloc(size_t count, size_t size) {
 }
 
 static inline void *ts_realloc(void *buffer, size_t size) {
-  void *result = realloc(buffer, size);
+  void *result = ts_allocator_realloc(buffer, size);
   if (size > 0 && !result) {
     fprintf(stderr, "tree-sitter failed to reallocate %lu bytes", size);
     exit(1);
@@ -73,7 +79,7 @@ static inline void *ts_realloc(void *buffer, size_t size) {
 }
 
 static inline void ts_free(void *buffer) {
-  free(buffer);
+  ts_allocator_free(buffer);
 }
 
 #endif
@@ -37,6 +37,9 @@ extern "C" {
 #define array_reserve(self, new_capacity) \
   array__reserve((VoidArray *)(self), array__elem_size(self), new_capacity)
 
+#define array_shrink(self) \
+  array__shrink((VoidArray *)(self), array__elem_size(self))
+
 #define array_erase(self, index) \
   array__erase((VoidArray *)(self), array__elem_size(self), index)
 
@@ -91,6 +94,17 @@ static inline void array__reserve(VoidArray *self, size_t element_size, uint32_t
   }
 }
 
+// Give back the memory reserved beyond the array's size, freeing the array's
+// contents entirely if it is empty.
+static inline void array__shrink(VoidArray *self, size_t element_size) {
+  if (self->size == 0) {
+    array__delete(self);
+  } else if (self->size < self->capacity) {
+    self->contents = ts_realloc(self->contents, self->size * element_size);
+    self->capacity = self->size;
+  }
+}
+
 static inline void array__grow(VoidArray *self, size_t element_size) {
   if (self->size == self->capacity) {
     size_t new_capacity = self->capacity * 2;
@@ -0,0 +1,74 @@
+#ifndef RUNTIME_ATOMIC_H_
+#define RUNTIME_ATOMIC_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef _MSC_VER
+
+#include <windows.h>
+
+static inline void *atomic_load_pointer(void *const volatile *p) {
+  return InterlockedCompareExchangePointer((PVOID volatile *)p, NULL, NULL);
+}
+
+static inline bool atomic_compare_and_swap_pointer(void *volatile *p, void *expected, void *desired) {
+  return InterlockedCompareExchangePointer(p, desired, expected) == expected;
+}
+
+static inline void *atomic_exchange_pointer(void *volatile *p, void *desired) {
+  return InterlockedExchangePointer(p, desired);
+}
+
+static inline uint32_t atomic_load(const volatile uint32_t *p) {
+  return InterlockedCompareExchange((long volatile *)p, 0, 0);
+}
+
+static inline bool atomic_compare_and_swap(volatile uint32_t *p, uint32_t expected, uint32_t desired) {
+  return (uint32_t)InterlockedCompareExchange((long volatile *)p, desired, expected) == expected;
+}
+
+static inline uint32_t atomic_inc(volatile uint32_t *p) {
+  return InterlockedIncrement((long volatile *)p);
+}
+
+static inline uint32_t atomic_dec(volatile uint32_t *p) {
+  return InterlockedDecrement((long volatile *)p);
+}
+
+#else
+
+static inline void *atomic_load_pointer(void *const volatile *p) {
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline bool atomic_compare_and_swap_pointer(void *volatile *p, void *expected, void *desired) {
+  return __atomic_compare_exchange_n(p, &expected, desired, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+static inline void *atomic_exchange_pointer(void *volatile *p, void *desired) {
+  return __atomic_exchange_n(p, desired, __ATOMIC_ACQUIRE);
+}
+
+static inline uint32_t atomic_load(const volatile uint32_t *p) {
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline bool atomic_compare_and_swap(volatile uint32_t *p, uint32_t expected, uint32_t desired) {
+  return __atomic_compare_exchange_n(p, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+// References are taken from ones that are already held, so taking one doesn't
+// need to be ordered with anything else. Dropping one must be ordered after the
+// holder's last use of the tree, and before the tree is freed.
+static inline uint32_t atomic_inc(volatile uint32_t *p) {
+  return __atomic_add_fetch(p, 1u, __ATOMIC_RELAXED);
+}
+
+static inline uint32_t atomic_dec(volatile uint32_t *p) {
+  return __atomic_sub_fetch(p, 1u, __ATOMIC_ACQ_REL);
+}
+
+#endif
+
+#endif  // RUNTIME_ATOMIC_H_
@@ -0,0 +1,138 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "tree_sitter/runtime.h"
+#include "runtime/alloc.h"
+#include "runtime/document.h"
+#include "runtime/tree.h"
+#include "runtime/work_range.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+// A batch of jobs is parsed by a fixed set of workers, each of which owns one
+// parser and one document, and reuses them for every job that it takes. The
+// jobs are dealt out to the workers as work ranges, which workers that run out
+// of jobs steal from, so that workers that are given small files don't sit
+// idle while others work through large ones.
+
+typedef struct {
+  const TSParseJob *jobs;
+  TSParseOptions options;
+  TSParseJobCallback callback;
+  void *payload;
+  WorkRange *ranges;
+  uint32_t worker_count;
+} Batch;
+
+typedef struct {
+  Batch *batch;
+  WorkRange *range;
+  TSParser *parser;
+  TSDocument *document;
+  uint32_t parsed_count;
+#ifndef _WIN32
+  pthread_t thread;
+#endif
+} BatchWorker;
+
+// The previous job's tree is released before the next job is parsed, so that
+// its nodes are recycled by the pool rather than held until the new tree is
+// finished.
+static void batch_worker__run_job(BatchWorker *self, uint32_t job_index) {
+  Batch *batch = self->batch;
+  const TSParseJob *job = &batch->jobs[job_index];
+  TSDocument *document = self->document;
+
+  if (document->tree) {
+    ts_tree_release(document->tree_pool, document->tree);
+    document->tree = NULL;
+  }
+  if (!job->language) return;
+  if (job->language != ts_document_language(document)) {
+    ts_document_set_language(document, job->language);
+    if (ts_document_language(document) != job->language) return;
+  }
+  ts_document_invalidate(document);
+  ts_document_set_input(document, job->input);
+
+  if (ts_document_parse_with_parser(document, self->parser, batch->options) && document->tree) {
+    self->parsed_count++;
+    batch->callback(batch->payload, job_index, document);
+  }
+}
+
+static void *batch_worker__run(void *payload) {
+  BatchWorker *self = payload;
+  uint32_t job_index;
+  for (;;) {
+    if (work_range_take(self->range, &job_index)) {
+      batch_worker__run_job(self, job_index);
+    } else if (!work_range_steal(self->range, self->batch->ranges, self->batch->worker_count)) {
+      break;
+    }
+  }
+  return NULL;
+}
+
+// The jobs are parsed by `options.thread_count` workers, each document being
+// parsed serially by one of them. The callback is invoked on the worker's
+// thread for each job that is parsed successfully, and may be running on
+// several threads at once. The document that it is given is only valid until
+// it returns, because the worker reuses it for its next job. The jobs' inputs
+// remain owned by the caller. This returns the number of jobs that were
+// parsed.
+uint32_t ts_parse_batch(const TSParseJob *jobs, uint32_t job_count, TSParseOptions options,
+                        TSParseJobCallback callback, void *payload) {
+  uint32_t worker_count = options.thread_count > 1 ? options.thread_count : 1;
+  if (worker_count > job_count) worker_count = job_count;
+  if (worker_count == 0) return 0;
+  options.thread_count = 0;
+  options.changed_ranges = NULL;
+  options.changed_range_count = NULL;
+  options.changed_range_callback = NULL;
+
+  Batch batch = {jobs, options, callback, payload, NULL, worker_count};
+  batch.ranges = ts_calloc(worker_count, sizeof(WorkRange));
+  BatchWorker *workers = ts_calloc(worker_count, sizeof(BatchWorker));
+  for (uint32_t i = 0; i < worker_count; i++) {
+    BatchWorker *worker = &workers[i];
+    worker->batch = &batch;
+    worker->range = &batch.ranges[i];
+    worker->parser = ts_parser_new();
+    worker->document = ts_document_new();
+    work_range_init(
+      worker->range,
+      (uint32_t)((uint64_t)job_count * i / worker_count),
+      (uint32_t)((uint64_t)job_count * (i + 1) / worker_count)
+    );
+  }
+
+  // The first worker runs on the calling thread. If a thread can't be created,
+  // its jobs are left to be stolen by the workers that are running.
+#ifndef _WIN32
+  bool *started = ts_calloc(worker_count, sizeof(bool));
+  for (uint32_t i = 1; i < worker_count; i++) {
+    started[i] = pthread_create(&workers[i].thread, NULL, batch_worker__run, &workers[i]) == 0;
+  }
+  batch_worker__run(&workers[0]);
+  for (uint32_t i = 1; i < worker_count; i++) {
+    if (started[i]) pthread_join(workers[i].thread, NULL);
+  }
+  ts_free(started);
+#else
+  batch_worker__run(&workers[0]);
+#endif
+
+  uint32_t result = 0;
+  for (uint32_t i = 0; i < worker_count; i++) {
+    BatchWorker *worker = &workers[i];
+    result += worker->parsed_count;
+    ts_document_free(worker->document);
+    ts_parser_delete(worker->parser);
+    work_range_delete(worker->range);
+  }
+  ts_free(workers);
+  ts_free(batch.ranges);
+  return result;
+}
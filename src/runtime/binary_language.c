@@ -0,0 +1,363 @@
+#include "tree_sitter/runtime.h"
+#include "runtime/alloc.h"
+#include "runtime/language.h"
+#include "runtime/lex_table.h"
+#include <string.h>
+
+// A binary language starts with a header of 32-bit fields, followed by a
+// sequence of sections, each of which is an array of little-endian integers
+// preceded by its length in bytes and padded to a multiple of four bytes.
+// The integer arrays are used in place, so the data must stay alive and
+// unchanged for as long as the language is in use. Only the parse actions,
+// symbol names and symbol metadata, whose runtime layouts depend on the
+// compiler, are decoded into separate arrays, along with the next states that
+// are derived from the parse actions.
+
+static const char BINARY_LANGUAGE_MAGIC[4] = {'T', 'S', 'L', 'B'};
+static const uint32_t BINARY_LANGUAGE_FORMAT_VERSION = 1;
+
+typedef struct {
+  TSLanguage language;
+  TSLexTable lex_table;
+  TSLexTable keyword_lex_table;
+} BinaryLanguage;
+
+typedef struct {
+  const char *cursor;
+  const char *end;
+  bool has_error;
+} BinaryLanguageReader;
+
+typedef struct {
+  const void *contents;
+  uint32_t size;
+} BinaryLanguageSection;
+
+static uint32_t binary_language__read_u32(BinaryLanguageReader *self) {
+  if (self->end - self->cursor < 4) {
+    self->has_error = true;
+    return 0;
+  }
+  uint32_t result;
+  memcpy(&result, self->cursor, 4);
+  self->cursor += 4;
+  return result;
+}
+
+// Read a section whose length is a multiple of the given element size.
+static BinaryLanguageSection binary_language__read_section(BinaryLanguageReader *self,
+                                                            uint32_t element_size) {
+  BinaryLanguageSection result = {NULL, 0};
+  uint32_t byte_count = binary_language__read_u32(self);
+  uint32_t padded_byte_count = (byte_count + 3) & ~3u;
+  if (self->has_error || padded_byte_count < byte_count ||
+      (uint64_t)(self->end - self->cursor) < padded_byte_count ||
+      byte_count % element_size != 0) {
+    self->has_error = true;
+    return result;
+  }
+  result.contents = self->cursor;
+  result.size = byte_count / element_size;
+  self->cursor += padded_byte_count;
+  return result;
+}
+
+static bool binary_language__read_lex_table(BinaryLanguageReader *self, TSLexTable *table,
+                                            uint32_t symbol_count) {
+  BinaryLanguageSection counts = binary_language__read_section(self, sizeof(uint32_t));
+  BinaryLanguageSection accept_symbols = binary_language__read_section(self, sizeof(uint16_t));
+  BinaryLanguageSection row_offsets = binary_language__read_section(self, sizeof(uint32_t));
+  BinaryLanguageSection transitions = binary_language__read_section(self, sizeof(uint16_t));
+  BinaryLanguageSection ascii_classes = binary_language__read_section(self, sizeof(uint16_t));
+  BinaryLanguageSection range_starts = binary_language__read_section(self, sizeof(int32_t));
+  BinaryLanguageSection range_classes = binary_language__read_section(self, sizeof(uint16_t));
+  if (self->has_error || counts.size != 2) return false;
+
+  table->state_count = ((const uint32_t *)counts.contents)[0];
+  table->class_count = ((const uint32_t *)counts.contents)[1];
+  table->accept_symbols = accept_symbols.contents;
+  table->row_offsets = row_offsets.contents;
+  table->transitions = transitions.contents;
+  table->ascii_classes = ascii_classes.contents;
+  table->range_count = range_starts.size;
+  table->range_starts = range_starts.contents;
+  table->range_classes = range_classes.contents;
+  if (table->state_count == 0) return true;
+
+  if (table->state_count > TS_LEX_TABLE_MAX_STATE_COUNT || table->class_count == 0 ||
+      accept_symbols.size != table->state_count || row_offsets.size != table->state_count ||
+      ascii_classes.size != 128 || range_classes.size != range_starts.size ||
+      table->range_count == 0 || table->range_starts[0] != INT32_MIN) return false;
+
+  for (uint32_t i = 0; i < table->state_count; i++) {
+    if (table->accept_symbols[i] > symbol_count) return false;
+    if (table->row_offsets[i] > transitions.size ||
+        transitions.size - table->row_offsets[i] < table->class_count) return false;
+  }
+  for (uint32_t i = 0; i < transitions.size; i++) {
+    uint16_t entry = table->transitions[i];
+    if (entry != 0 && (entry >> 1) > table->state_count) return false;
+  }
+  for (uint32_t i = 0; i < 128; i++) {
+    if (table->ascii_classes[i] >= table->class_count) return false;
+  }
+  for (uint32_t i = 0; i < table->range_count; i++) {
+    if (table->range_classes[i] >= table->class_count) return false;
+    if (i > 0 && table->range_starts[i] <= table->range_starts[i - 1]) return false;
+  }
+  return true;
+}
+
+// Each parse action entry is stored as four 16-bit fields. A list of actions
+// starts with an entry that contains the number of actions and whether they
+// are reusable, and is followed by the actions themselves.
+static TSParseActionEntry *binary_language__read_parse_actions(BinaryLanguageSection section,
+                                                               const TSLanguage *language,
+                                                               bool *is_list_start,
+                                                               uint32_t alias_sequence_count) {
+  const uint16_t *fields = section.contents;
+  uint32_t entry_count = section.size;
+  TSParseActionEntry *result = ts_calloc(entry_count ? entry_count : 1, sizeof(TSParseActionEntry));
+
+  for (uint32_t i = 0; i < entry_count;) {
+    const uint16_t *entry = &fields[i * 4];
+    uint32_t action_count = entry[0];
+    if (action_count > entry_count - i - 1) goto error;
+    is_list_start[i] = true;
+    result[i].count = action_count;
+    result[i].reusable = entry[1];
+    i++;
+
+    for (uint32_t j = 0; j < action_count; j++, i++) {
+      const uint16_t *action = &fields[i * 4];
+      TSParseAction *result_action = &result[i].action;
+      switch (action[0]) {
+        case TSParseActionTypeShift:
+          result_action->type = TSParseActionTypeShift;
+          result_action->params.state = action[1];
+          result_action->params.extra = action[2] & 1;
+          result_action->params.repetition = (action[2] & 2) != 0;
+          if (!result_action->params.extra && action[1] >= language->state_count) goto error;
+          break;
+        case TSParseActionTypeReduce:
+          result_action->type = TSParseActionTypeReduce;
+          result_action->params.symbol = action[1];
+          result_action->params.dynamic_precedence = (int16_t)action[2];
+          result_action->params.child_count = action[3] & 0xFF;
+          result_action->params.alias_sequence_id = action[3] >> 8;
+          if (action[1] >= language->symbol_count) goto error;
+          if (result_action->params.alias_sequence_id >= alias_sequence_count &&
+              result_action->params.alias_sequence_id != 0) goto error;
+          break;
+        case TSParseActionTypeAccept:
+        case TSParseActionTypeRecover:
+          result_action->type = action[0];
+          break;
+        default:
+          goto error;
+      }
+    }
+  }
+  return result;
+
+error:
+  ts_free(result);
+  return NULL;
+}
+
+static bool binary_language__is_valid_table_value(const TSLanguage *language, TSSymbol symbol,
+                                                  uint16_t value, const bool *is_list_start,
+                                                  uint32_t entry_count) {
+  if (symbol < language->token_count) {
+    return value < entry_count && is_list_start[value];
+  } else {
+    return value < language->state_count;
+  }
+}
+
+static bool binary_language__validate_parse_table(const TSLanguage *language,
+                                                  uint32_t small_parse_table_size,
+                                                  const bool *is_list_start,
+                                                  uint32_t entry_count) {
+  for (uint32_t state = 0; state < language->large_state_count; state++) {
+    for (TSSymbol symbol = 0; symbol < language->symbol_count; symbol++) {
+      uint16_t value = language->parse_table[state * language->symbol_count + symbol];
+      if (!binary_language__is_valid_table_value(language, symbol, value, is_list_start, entry_count)) {
+        return false;
+      }
+    }
+  }
+
+  for (uint32_t state = language->large_state_count; state < language->state_count; state++) {
+    uint32_t index = language->small_parse_table_map[state - language->large_state_count];
+    if (index >= small_parse_table_size) return false;
+    uint16_t group_count = language->small_parse_table[index++];
+    for (uint32_t i = 0; i < group_count; i++) {
+      if (small_parse_table_size - index < 2) return false;
+      uint16_t value = language->small_parse_table[index++];
+      uint16_t symbol_count = language->small_parse_table[index++];
+      if (small_parse_table_size - index < symbol_count) return false;
+      for (uint32_t j = 0; j < symbol_count; j++) {
+        TSSymbol symbol = language->small_parse_table[index++];
+        if (symbol >= language->symbol_count) return false;
+        if (!binary_language__is_valid_table_value(language, symbol, value, is_list_start, entry_count)) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+static bool binary_language__read_symbols(BinaryLanguageSection names, BinaryLanguageSection metadata,
+                                          TSLanguage *language) {
+  uint32_t count = language->symbol_count + language->alias_count;
+  if (metadata.size != count) return false;
+
+  const char **symbol_names = ts_calloc(count ? count : 1, sizeof(const char *));
+  TSSymbolMetadata *symbol_metadata = ts_calloc(count ? count : 1, sizeof(TSSymbolMetadata));
+  language->symbol_names = symbol_names;
+  language->symbol_metadata = symbol_metadata;
+
+  const char *name = names.contents;
+  const char *names_end = name + names.size;
+  for (uint32_t i = 0; i < count; i++) {
+    const char *name_end = memchr(name, '\0', names_end - name);
+    if (!name_end) return false;
+    symbol_names[i] = name;
+    name = name_end + 1;
+
+    uint8_t flags = ((const uint8_t *)metadata.contents)[i];
+    symbol_metadata[i].visible = flags & 1;
+    symbol_metadata[i].named = (flags & 2) != 0;
+  }
+  return name == names_end;
+}
+
+// The state that each list of parse actions shifts to isn't stored in the
+// file, since it can be derived from the list's last action.
+static TSStateId *binary_language__derive_next_states(const TSParseActionEntry *entries,
+                                                      uint32_t entry_count) {
+  TSStateId *result = ts_calloc(entry_count ? entry_count : 1, sizeof(TSStateId));
+  for (uint32_t i = 0; i < entry_count; i += 1 + entries[i].count) {
+    if (entries[i].count == 0) continue;
+    TSParseAction action = entries[i + entries[i].count].action;
+    if (action.type == TSParseActionTypeShift || action.type == TSParseActionTypeRecover) {
+      result[i] = action.params.state;
+    }
+  }
+  return result;
+}
+
+const TSLanguage *ts_language_load(const char *data, uint32_t length) {
+  uint16_t byte_order_probe = 1;
+  if (*(const uint8_t *)&byte_order_probe != 1) return NULL;
+  if ((uintptr_t)data % 4 != 0 || length < sizeof(BINARY_LANGUAGE_MAGIC)) return NULL;
+  if (memcmp(data, BINARY_LANGUAGE_MAGIC, sizeof(BINARY_LANGUAGE_MAGIC)) != 0) return NULL;
+
+  BinaryLanguageReader reader = {data + sizeof(BINARY_LANGUAGE_MAGIC), data + length, false};
+  if (binary_language__read_u32(&reader) != BINARY_LANGUAGE_FORMAT_VERSION) return NULL;
+
+  BinaryLanguage *self = ts_calloc(1, sizeof(BinaryLanguage));
+  TSLanguage *language = &self->language;
+  // The struct is always built with the runtime's own layout, whichever
+  // compatible version the tables were written for.
+  language->version = binary_language__read_u32(&reader);
+  if (!ts_language_is_compatible(language)) goto error;
+  language->version = TREE_SITTER_LANGUAGE_VERSION;
+  language->symbol_count = binary_language__read_u32(&reader);
+  language->alias_count = binary_language__read_u32(&reader);
+  language->token_count = binary_language__read_u32(&reader);
+  language->external_token_count = binary_language__read_u32(&reader);
+  language->state_count = binary_language__read_u32(&reader);
+  language->large_state_count = binary_language__read_u32(&reader);
+  uint32_t max_alias_sequence_length = binary_language__read_u32(&reader);
+  language->max_alias_sequence_length = max_alias_sequence_length;
+  language->keyword_capture_token = binary_language__read_u32(&reader);
+
+  BinaryLanguageSection symbol_names = binary_language__read_section(&reader, 1);
+  BinaryLanguageSection symbol_metadata = binary_language__read_section(&reader, 1);
+  BinaryLanguageSection parse_table = binary_language__read_section(&reader, sizeof(uint16_t));
+  BinaryLanguageSection small_parse_table = binary_language__read_section(&reader, sizeof(uint16_t));
+  BinaryLanguageSection small_parse_table_map = binary_language__read_section(&reader, sizeof(uint32_t));
+  BinaryLanguageSection parse_actions = binary_language__read_section(&reader, 4 * sizeof(uint16_t));
+  BinaryLanguageSection lex_modes = binary_language__read_section(&reader, sizeof(TSLexMode));
+  BinaryLanguageSection alias_sequences = binary_language__read_section(&reader, sizeof(TSSymbol));
+  bool is_valid =
+    !reader.has_error &&
+    binary_language__read_lex_table(&reader, &self->lex_table, language->symbol_count) &&
+    binary_language__read_lex_table(&reader, &self->keyword_lex_table, language->symbol_count);
+  if (!is_valid || reader.cursor != reader.end) goto error;
+  if (!binary_language__read_symbols(symbol_names, symbol_metadata, language)) goto error;
+
+  // Languages with external tokens depend on a scanner written in C, so they
+  // can't be loaded from a binary file.
+  if (language->external_token_count != 0) goto error;
+
+  // The counts are bounded by the types that hold states and symbols, and the
+  // sizes that are derived from them are computed in 64 bits, so that a
+  // corrupted count can't wrap around to match the size of a section.
+  if (language->state_count == 0 || language->state_count > UINT16_MAX ||
+      language->large_state_count == 0 ||
+      language->large_state_count > language->state_count ||
+      language->token_count > language->symbol_count ||
+      (uint64_t)language->symbol_count + language->alias_count > ts_builtin_sym_error - 1 ||
+      max_alias_sequence_length > UINT16_MAX ||
+      language->keyword_capture_token >= language->symbol_count) goto error;
+  if (parse_table.size != (uint64_t)language->large_state_count * language->symbol_count ||
+      small_parse_table_map.size != language->state_count - language->large_state_count ||
+      lex_modes.size != language->state_count ||
+      self->lex_table.state_count == 0) goto error;
+  if (language->keyword_capture_token != 0 && self->keyword_lex_table.state_count == 0) goto error;
+
+  uint32_t alias_sequence_count = 0;
+  if (language->max_alias_sequence_length > 0) {
+    if (alias_sequences.size % language->max_alias_sequence_length != 0) goto error;
+    alias_sequence_count = alias_sequences.size / language->max_alias_sequence_length;
+  } else if (alias_sequences.size != 0) {
+    goto error;
+  }
+  for (uint32_t i = 0; i < alias_sequences.size; i++) {
+    if (((const TSSymbol *)alias_sequences.contents)[i] >= language->symbol_count + language->alias_count) goto error;
+  }
+
+  language->parse_table = parse_table.contents;
+  language->small_parse_table = small_parse_table_map.size ? small_parse_table.contents : NULL;
+  language->small_parse_table_map = small_parse_table_map.size ? small_parse_table_map.contents : NULL;
+  language->lex_modes = lex_modes.contents;
+  language->alias_sequences = alias_sequence_count > 1 ? alias_sequences.contents : NULL;
+  language->lex_table = &self->lex_table;
+  if (language->keyword_capture_token != 0) language->keyword_lex_table = &self->keyword_lex_table;
+
+  for (uint32_t i = 0; i < language->state_count; i++) {
+    if (language->lex_modes[i].lex_state >= self->lex_table.state_count ||
+        language->lex_modes[i].external_lex_state != 0) goto error;
+  }
+
+  uint32_t entry_count = parse_actions.size;
+  bool *is_list_start = ts_calloc(entry_count ? entry_count : 1, sizeof(bool));
+  language->parse_actions = binary_language__read_parse_actions(
+    parse_actions, language, is_list_start, alias_sequence_count
+  );
+  is_valid =
+    language->parse_actions &&
+    binary_language__validate_parse_table(language, small_parse_table.size, is_list_start, entry_count);
+  ts_free(is_list_start);
+  if (!is_valid) goto error;
+
+  language->parse_action_next_states = binary_language__derive_next_states(language->parse_actions, entry_count);
+  return language;
+
+error:
+  ts_language_delete(language);
+  return NULL;
+}
+
+void ts_language_delete(const TSLanguage *language) {
+  if (!language) return;
+  if (language->symbol_names) ts_free((void *)language->symbol_names);
+  if (language->symbol_metadata) ts_free((void *)language->symbol_metadata);
+  if (language->parse_actions) ts_free((void *)language->parse_actions);
+  if (language->parse_action_next_states) ts_free((void *)language->parse_action_next_states);
+  ts_free((void *)language);
+}
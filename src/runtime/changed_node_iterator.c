@@ -0,0 +1,98 @@
+#include "tree_sitter/runtime.h"
+#include "runtime/alloc.h"
+#include "runtime/array.h"
+#include "runtime/document.h"
+#include "runtime/language.h"
+#include "runtime/node.h"
+
+// A changed node iterator visits the visible nodes of a document's tree that
+// were created by its most recent parse, or, once the document has been edited,
+// the nodes that contain the edits. Every tree records the generation of the
+// pool that created it, and each parse and each edit starts a new generation,
+// so a tree from an earlier generation that has no changes was left alone as a
+// whole, and is skipped along with its descendants.
+// The cost of iterating is therefore proportional to the number of changed
+// trees and their children, rather than to the size of the tree.
+//
+// The trees that remain to be visited are kept on a stack, in reverse
+// document order, so that nodes are visited before their descendants.
+
+typedef struct {
+  const Tree *tree;
+  Length position;
+  TSSymbol alias_symbol;
+} ChangedNodeEntry;
+
+struct TSChangedNodeIterator {
+  Array(ChangedNodeEntry) stack;
+  const Tree *root;
+  const TSLanguage *language;
+  uint32_t generation;
+};
+
+static inline bool ts_changed_node_iterator__is_changed(const TSChangedNodeIterator *self,
+                                                        const Tree *tree) {
+  return tree->generation >= self->generation || tree->has_changes;
+}
+
+static void ts_changed_node_iterator__push_children(TSChangedNodeIterator *self,
+                                                    const ChangedNodeEntry *entry) {
+  const Tree *tree = entry->tree;
+  uint32_t start = self->stack.size;
+  uint32_t structural_child_index = 0;
+  Length position = entry->position;
+  for (uint32_t i = 0; i < tree->children.size; i++) {
+    const Tree *child = tree->children.contents[i];
+    if (ts_changed_node_iterator__is_changed(self, child)) {
+      TSSymbol alias_symbol = 0;
+      if (!child->extra) {
+        alias_symbol = ts_language_alias_at(self->language, tree->alias_sequence_id, structural_child_index);
+      }
+      array_push(&self->stack, ((ChangedNodeEntry){child, position, alias_symbol}));
+    }
+    if (!child->extra) structural_child_index++;
+    position = length_add(position, ts_tree_total_size(child));
+  }
+
+  for (uint32_t i = start, j = self->stack.size; i + 1 < j; i++) {
+    j--;
+    ChangedNodeEntry swap = self->stack.contents[i];
+    self->stack.contents[i] = self->stack.contents[j];
+    self->stack.contents[j] = swap;
+  }
+}
+
+TSChangedNodeIterator *ts_changed_node_iterator_new(const TSDocument *document) {
+  TSChangedNodeIterator *self = ts_malloc(sizeof(TSChangedNodeIterator));
+  array_init(&self->stack);
+  self->root = document->tree;
+  self->language = document->language;
+  self->generation = document->tree_pool->generation;
+  ts_changed_node_iterator_reset(self);
+  return self;
+}
+
+void ts_changed_node_iterator_delete(TSChangedNodeIterator *self) {
+  array_delete(&self->stack);
+  ts_free(self);
+}
+
+// Start over from the root, keeping the iterator's memory.
+void ts_changed_node_iterator_reset(TSChangedNodeIterator *self) {
+  array_clear(&self->stack);
+  if (self->root && ts_changed_node_iterator__is_changed(self, self->root)) {
+    array_push(&self->stack, ((ChangedNodeEntry){self->root, length_zero(), 0}));
+  }
+}
+
+bool ts_changed_node_iterator_next(TSChangedNodeIterator *self, TSNode *node) {
+  while (self->stack.size > 0) {
+    ChangedNodeEntry entry = array_pop(&self->stack);
+    ts_changed_node_iterator__push_children(self, &entry);
+    if (entry.tree->visible || entry.alias_symbol) {
+      *node = ts_node_make(entry.tree, entry.position, entry.alias_symbol, self->root, self->language);
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,98 @@
+#include "runtime/chunked_input.h"
+#include "runtime/array.h"
+
+typedef struct {
+  const char *text;
+  uint32_t start;
+  uint32_t length;
+} Chunk;
+
+typedef struct {
+  Array(Chunk) chunks;
+  uint32_t chunk_index;
+  uint32_t position;
+  uint32_t length;
+} TSChunkedInput;
+
+static const char *ts_chunked_input__read(void *payload, uint32_t *bytes_read) {
+  TSChunkedInput *input = (TSChunkedInput *)payload;
+  if (input->position >= input->length) {
+    *bytes_read = 0;
+    return "";
+  }
+
+  Chunk *chunk = &input->chunks.contents[input->chunk_index];
+  uint32_t offset = input->position - chunk->start;
+  *bytes_read = chunk->length - offset;
+  input->position = chunk->start + chunk->length;
+  input->chunk_index++;
+  return chunk->text + offset;
+}
+
+// Sequential seeks land in the current or the next chunk. Any other seek
+// uses a binary search over the chunks' starting offsets.
+static int ts_chunked_input__seek(void *payload, uint32_t byte, TSPoint _) {
+  TSChunkedInput *input = (TSChunkedInput *)payload;
+  input->position = byte;
+  if (byte >= input->length) {
+    input->chunk_index = input->chunks.size;
+    return 0;
+  }
+
+  uint32_t index = input->chunk_index;
+  if (index < input->chunks.size) {
+    Chunk *chunk = &input->chunks.contents[index];
+    if (chunk->start <= byte && byte < chunk->start + chunk->length) return 1;
+    if (byte >= chunk->start + chunk->length && index + 1 < input->chunks.size) {
+      Chunk *next_chunk = chunk + 1;
+      if (byte < next_chunk->start + next_chunk->length) {
+        input->chunk_index = index + 1;
+        return 1;
+      }
+    }
+  }
+
+  uint32_t low = 0, high = input->chunks.size;
+  while (high - low > 1) {
+    uint32_t middle = low + (high - low) / 2;
+    if (input->chunks.contents[middle].start <= byte) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+  input->chunk_index = low;
+  return 1;
+}
+
+TSInput ts_chunked_input_make(const TSInputChunk *chunks, uint32_t count) {
+  TSChunkedInput *input = ts_malloc(sizeof(TSChunkedInput));
+  array_init(&input->chunks);
+  array_reserve(&input->chunks, count);
+  input->chunk_index = 0;
+  input->position = 0;
+  input->length = 0;
+
+  for (uint32_t i = 0; i < count; i++) {
+    if (chunks[i].length == 0) continue;
+    array_push(&input->chunks, ((Chunk){
+      .text = chunks[i].text,
+      .start = input->length,
+      .length = chunks[i].length,
+    }));
+    input->length += chunks[i].length;
+  }
+
+  return (TSInput){
+    .payload = input,
+    .read = ts_chunked_input__read,
+    .seek = ts_chunked_input__seek,
+    .encoding = TSInputEncodingUTF8,
+  };
+}
+
+void ts_chunked_input_delete(void *payload) {
+  TSChunkedInput *input = (TSChunkedInput *)payload;
+  array_delete(&input->chunks);
+  ts_free(input);
+}
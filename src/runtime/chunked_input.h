@@ -0,0 +1,17 @@
+#ifndef RUNTIME_CHUNKED_INPUT_H_
+#define RUNTIME_CHUNKED_INPUT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "tree_sitter/runtime.h"
+
+TSInput ts_chunked_input_make(const TSInputChunk *, uint32_t);
+void ts_chunked_input_delete(void *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // RUNTIME_CHUNKED_INPUT_H_
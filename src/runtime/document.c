@@ -1,61 +1,222 @@
+#define _POSIX_C_SOURCE 200112L
+
 #include "runtime/alloc.h"
 #include "runtime/node.h"
 #include "runtime/tree.h"
 #include "runtime/parser.h"
+#include "runtime/parallel_parser.h"
 #include "runtime/string_input.h"
+#include "runtime/file_input.h"
+#include "runtime/chunked_input.h"
 #include "runtime/document.h"
+#include "runtime/text_diff.h"
 #include "runtime/get_changed_ranges.h"
+#include "runtime/language.h"
+#include "runtime/tree_serialization.h"
 
-#define LOG(...)                                                                                                   \
-  snprintf(self->parser.lexer.debug_buffer, TREE_SITTER_SERIALIZATION_BUFFER_SIZE, __VA_ARGS__);                   \
-  self->parser.lexer.logger.log(self->parser.lexer.logger.payload, TSLogTypeLex, self->parser.lexer.debug_buffer); \
+#define LOG(...)                                                                     \
+  snprintf(self->debug_buffer, TREE_SITTER_SERIALIZATION_BUFFER_SIZE, __VA_ARGS__);  \
+  self->logger.log(self->logger.payload, TSLogTypeLex, self->debug_buffer);          \
 
-TSDocument *ts_document_new() {
+#ifndef _WIN32
+#define document__lock(self) pthread_mutex_lock(&(self)->lock)
+#define document__unlock(self) pthread_mutex_unlock(&(self)->lock)
+#else
+#define document__lock(self)
+#define document__unlock(self)
+#endif
+
+// The document's own parser is created the first time it's needed.
+static Parser *document__own_parser(TSDocument *self) {
+  if (!self->parser) {
+    self->parser = ts_calloc(1, sizeof(Parser));
+    parser_init(self->parser);
+    parser_set_tree_pool(self->parser, self->tree_pool);
+  }
+  return self->parser;
+}
+
+static void document__set_provisional_tree(TSDocument *self, Tree *tree) {
+  if (tree) ts_tree_resolve_child_counts(tree, &self->tree_pool->tree_stack, self->language);
+  if (self->provisional_tree) ts_tree_release(self->tree_pool, self->provisional_tree);
+  self->provisional_tree = tree;
+}
+
+static void document__reset_parser(TSDocument *self) {
+  if (self->parser) parser_reset(self->parser);
+  document__set_provisional_tree(self, NULL);
+}
+
+static TSDocument *document__new(DocumentTreePool *shared_tree_pool) {
   TSDocument *self = ts_calloc(1, sizeof(TSDocument));
-  parser_init(&self->parser);
+  shared_tree_pool->document_count++;
+  self->shared_tree_pool = shared_tree_pool;
+  self->tree_pool = &shared_tree_pool->tree_pool;
   array_init(&self->tree_path1);
   array_init(&self->tree_path2);
+  array_init(&self->expanded_opaque_bytes);
+  line_index_init(&self->line_index);
+  leaf_index_init(&self->leaf_index);
+  node_index_init(&self->node_index);
+  edit_log_init(&self->edit_log);
+  array_init(&self->append_snapshot.stack.entries);
+  self->background_parse_result = true;
+#ifndef _WIN32
+  pthread_mutex_init(&self->lock, NULL);
+#endif
   return self;
 }
 
+static DocumentTreePool *document_tree_pool__new() {
+  DocumentTreePool *self = ts_malloc(sizeof(DocumentTreePool));
+  ts_tree_pool_init(&self->tree_pool);
+  self->document_count = 0;
+  return self;
+}
+
+static void document_tree_pool__release(DocumentTreePool *self) {
+  if (--self->document_count == 0) {
+    ts_tree_pool_delete(&self->tree_pool);
+    ts_free(self);
+  }
+}
+
+TSDocument *ts_document_new() {
+  return document__new(document_tree_pool__new());
+}
+
+// Drop the references that readers on other threads have handed back. This
+// must only be called by the thread that parses the document, since it can
+// return trees to the document's pool. The lock is held because readers may be
+// retaining the current tree at the same time.
+static void document__drain_released_trees(TSDocument *self) {
+  document__lock(self);
+  ts_tree_pool_drain_remote_releases(self->tree_pool);
+  document__unlock(self);
+}
+
+// Replace the document's tree. The lock is held while the previous tree is
+// released, because readers may be retaining it at the same time.
+static void document__set_tree(TSDocument *self, Tree *tree) {
+  if (tree) ts_tree_resolve_child_counts(tree, &self->tree_pool->tree_stack, self->language);
+  document__lock(self);
+  Tree *old_tree = self->tree;
+  self->tree = tree;
+  if (old_tree) ts_tree_release(self->tree_pool, old_tree);
+  node_index_invalidate(&self->node_index);
+  document__unlock(self);
+}
+
 void ts_document_free(TSDocument *self) {
-  if (self->tree) ts_tree_release(&self->parser.tree_pool, self->tree);
+  ts_document_finish_background_parse(self);
+#ifndef _WIN32
+  pthread_mutex_destroy(&self->lock);
+#endif
+  if (self->tree) ts_tree_release(self->tree_pool, self->tree);
+  document__set_provisional_tree(self, NULL);
   if (self->tree_path1.contents) array_delete(&self->tree_path1);
   if (self->tree_path2.contents) array_delete(&self->tree_path2);
-  parser_destroy(&self->parser);
+  ts_free(self->included_ranges);
+  ts_free(self->opaque_regions);
+  array_delete(&self->expanded_opaque_bytes);
+  state_profile_delete(&self->state_profile);
+  line_index_delete(&self->line_index);
+  leaf_index_delete(&self->leaf_index);
+  node_index_delete(&self->node_index);
+  edit_log_delete(&self->edit_log);
+  parse_snapshot_delete(&self->append_snapshot, self->tree_pool);
+  if (self->parser) {
+    parser_destroy(self->parser);
+    ts_free(self->parser);
+    self->parser = NULL;
+  }
   ts_document_set_input(self, (TSInput){
     NULL,
     NULL,
     NULL,
     TSInputEncodingUTF8,
   });
+  document_tree_pool__release(self->shared_tree_pool);
+  ts_free(self->upgraded_language);
   ts_free(self);
 }
 
+// The fork's tree is the source's tree, retained rather than copied, so that
+// its subtrees are reused by the fork's first parse after it is edited to
+// match its own text.
+TSDocument *ts_document_fork(TSDocument *source) {
+  ts_document_finish_background_parse(source);
+  TSDocument *self = document__new(source->shared_tree_pool);
+  if (!source->language) return self;
+  ts_document_set_language(self, source->given_language);
+  ts_document_set_included_ranges(self, source->included_ranges, source->included_range_count);
+  if (source->tree) {
+    ts_tree_retain(source->tree);
+    document__set_tree(self, source->tree);
+    self->tree_is_streamed = source->tree_is_streamed;
+    self->valid = source->valid;
+  }
+  return self;
+}
+
+TSDocumentGroup *ts_document_group_new(const TSLanguage *language) {
+  if (!ts_language_is_compatible(language)) return NULL;
+  TSDocumentGroup *self = ts_malloc(sizeof(TSDocumentGroup));
+  self->shared_tree_pool = document_tree_pool__new();
+  self->shared_tree_pool->document_count++;
+  self->language = language;
+  return self;
+}
+
+// The group's documents may outlive it, along with the pool that they share.
+void ts_document_group_delete(TSDocumentGroup *self) {
+  document_tree_pool__release(self->shared_tree_pool);
+  ts_free(self);
+}
+
+TSDocument *ts_document_group_new_document(TSDocumentGroup *self) {
+  TSDocument *document = document__new(self->shared_tree_pool);
+  ts_document_set_language(document, self->language);
+  return document;
+}
+
+const TSLanguage *ts_document_group_language(const TSDocumentGroup *self) {
+  return self->language;
+}
+
 const TSLanguage *ts_document_language(TSDocument *self) {
-  return self->parser.language;
+  return self->given_language;
 }
 
+// Parsers keep their own upgraded copy of the language, so the document's copy
+// can be freed while a parser that it used still refers to the given language.
 void ts_document_set_language(TSDocument *self, const TSLanguage *language) {
-  if (language->version != TREE_SITTER_LANGUAGE_VERSION) return;
+  if (!ts_language_is_compatible(language)) return;
   ts_document_invalidate(self);
-  parser_set_language(&self->parser, language);
-  if (self->tree) {
-    ts_tree_release(&self->parser.tree_pool, self->tree);
-    self->tree = NULL;
+
+  ts_free(self->upgraded_language);
+  self->upgraded_language = NULL;
+  self->given_language = language;
+  if (language->version == TREE_SITTER_LANGUAGE_VERSION) {
+    self->language = language;
+  } else {
+    self->upgraded_language = ts_malloc(sizeof(TSLanguage));
+    self->language = ts_language_upgrade(language, self->upgraded_language);
   }
+  document__set_tree(self, NULL);
+  leaf_index_invalidate(&self->leaf_index);
 }
 
 TSLogger ts_document_logger(const TSDocument *self) {
-  return self->parser.lexer.logger;
+  return self->logger;
 }
 
 void ts_document_set_logger(TSDocument *self, TSLogger logger) {
-  self->parser.lexer.logger = logger;
+  self->logger = logger;
 }
 
 void ts_document_print_debugging_graphs(TSDocument *self, bool should_print) {
-  self->parser.print_debugging_graphs = should_print;
+  self->print_debugging_graphs = should_print;
 }
 
 TSInput ts_document_input(TSDocument *self) {
@@ -63,10 +224,12 @@ TSInput ts_document_input(TSDocument *self) {
 }
 
 void ts_document_set_input(TSDocument *self, TSInput input) {
-  if (self->owns_input)
-    ts_free(self->input.payload);
+  document__reset_parser(self);
+  line_index_invalidate(&self->line_index);
+  if (self->free_input)
+    self->free_input(self->input.payload);
   self->input = input;
-  self->owns_input = false;
+  self->free_input = NULL;
 }
 
 void ts_document_set_input_string(TSDocument *self, const char *text) {
@@ -74,7 +237,7 @@ void ts_document_set_input_string(TSDocument *self, const char *text) {
   TSInput input = ts_string_input_make(text);
   ts_document_set_input(self, input);
   if (input.payload) {
-    self->owns_input = true;
+    self->free_input = ts_free;
   }
 }
 
@@ -83,25 +246,218 @@ void ts_document_set_input_string_with_length(TSDocument *self, const char *text
   TSInput input = ts_string_input_make_with_length(text, length);
   ts_document_set_input(self, input);
   if (input.payload) {
-    self->owns_input = true;
+    self->free_input = ts_free;
+  }
+}
+
+void ts_document_set_input_chunks(TSDocument *self, const TSInputChunk *chunks, uint32_t count) {
+  ts_document_set_input(self, ts_chunked_input_make(chunks, count));
+  self->free_input = ts_chunked_input_delete;
+}
+
+bool ts_document_set_input_file(TSDocument *self, int fd) {
+  TSInput input = ts_file_input_make(fd);
+  if (!input.payload) return false;
+  ts_document_invalidate(self);
+  ts_document_set_input(self, input);
+  self->free_input = ts_file_input_delete;
+  return true;
+}
+
+bool ts_document_set_input_file_range(TSDocument *self, int fd, uint64_t start_byte, uint64_t length) {
+  TSInput input = ts_file_input_make_range(fd, start_byte, length);
+  if (!input.payload) return false;
+  ts_document_invalidate(self);
+  ts_document_set_input(self, input);
+  self->free_input = ts_file_input_delete;
+  self->base_byte = start_byte;
+  return true;
+}
+
+// The base byte belongs to the document rather than to its input, so that it
+// is kept when the input is replaced after an edit.
+void ts_document_set_base_byte(TSDocument *self, uint64_t base_byte) {
+  self->base_byte = base_byte;
+}
+
+uint64_t ts_document_base_byte(const TSDocument *self) {
+  return self->base_byte;
+}
+
+bool ts_document_set_input_path(TSDocument *self, const char *path) {
+  TSInput input = ts_file_input_make_with_path(path);
+  if (!input.payload) return false;
+  ts_document_invalidate(self);
+  ts_document_set_input(self, input);
+  self->free_input = ts_file_input_delete;
+  return true;
+}
+
+// Only the text within the given ranges is parsed, as though the text between
+// them weren't there, but the tree's positions still refer to the whole input.
+// The ranges must be in order and must not overlap. With no ranges, the whole
+// input is parsed. Changing the ranges means that the next parse starts over.
+bool ts_document_set_included_ranges(TSDocument *self, const TSRange *ranges, uint32_t count) {
+  for (uint32_t i = 0; i < count; i++) {
+    if (ranges[i].end_byte < ranges[i].start_byte) return false;
+    if (i > 0 && ranges[i].start_byte < ranges[i - 1].end_byte) return false;
+  }
+
+  if (count == self->included_range_count &&
+      (count == 0 || memcmp(ranges, self->included_ranges, count * sizeof(TSRange)) == 0)) return true;
+
+  ts_document_invalidate(self);
+  ts_free(self->included_ranges);
+  self->included_ranges = NULL;
+  self->included_range_count = count;
+  if (count > 0) {
+    self->included_ranges = ts_malloc(count * sizeof(TSRange));
+    memcpy(self->included_ranges, ranges, count * sizeof(TSRange));
+  }
+  return true;
+}
+
+const TSRange *ts_document_included_ranges(const TSDocument *self, uint32_t *count) {
+  *count = self->included_range_count;
+  return self->included_ranges;
+}
+
+// Regions that start with one of the given opening tokens, where the given
+// symbol can occur, are skipped when parsing, up to the matching closing token,
+// and are represented by a single opaque node with no children. Changing the
+// regions means that the next parse starts over.
+void ts_document_set_opaque_regions(TSDocument *self, const TSOpaqueRegion *regions, uint32_t count) {
+  if (count == self->opaque_region_count &&
+      (count == 0 || memcmp(regions, self->opaque_regions, count * sizeof(TSOpaqueRegion)) == 0)) return;
+
+  ts_document_invalidate(self);
+  ts_free(self->opaque_regions);
+  self->opaque_regions = NULL;
+  self->opaque_region_count = count;
+  if (count > 0) {
+    self->opaque_regions = ts_malloc(count * sizeof(TSOpaqueRegion));
+    memcpy(self->opaque_regions, regions, count * sizeof(TSOpaqueRegion));
+  }
+  array_clear(&self->expanded_opaque_bytes);
+}
+
+// The node's region is parsed in full by the next parse. It is marked as though
+// its text had been replaced, so that the nodes that contain it aren't reused.
+void ts_document_expand_opaque_node(TSDocument *self, TSNode node) {
+  if (!ts_node_is_opaque(node)) return;
+  uint32_t start_byte = ts_node_start_byte(node);
+  TSPoint start_point = ts_node_start_point(node);
+  TSPoint end_point = ts_node_end_point(node);
+  uint32_t size = ts_node_end_byte(node) - start_byte;
+  TSPoint extent = point_sub(end_point, start_point);
+  ts_document_edit(self, (TSInputEdit){
+    .start_byte = start_byte,
+    .bytes_removed = size,
+    .bytes_added = size,
+    .start_point = start_point,
+    .extent_removed = extent,
+    .extent_added = extent,
+  });
+
+  uint32_t index = 0;
+  while (index < self->expanded_opaque_bytes.size &&
+         self->expanded_opaque_bytes.contents[index] < start_byte) index++;
+  if (index == self->expanded_opaque_bytes.size ||
+      self->expanded_opaque_bytes.contents[index] != start_byte) {
+    array_insert(&self->expanded_opaque_bytes, index, start_byte);
   }
 }
 
+// An expanded region whose opening token is removed by an edit is forgotten.
+static void document__edit_expanded_opaque_bytes(TSDocument *self, const TSInputEdit *edit) {
+  uint32_t old_end_byte = edit->start_byte + edit->bytes_removed;
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < self->expanded_opaque_bytes.size; i++) {
+    uint32_t byte = self->expanded_opaque_bytes.contents[i];
+    if (byte >= old_end_byte) {
+      byte = byte - edit->bytes_removed + edit->bytes_added;
+    } else if (byte >= edit->start_byte) {
+      continue;
+    }
+    self->expanded_opaque_bytes.contents[count++] = byte;
+  }
+  self->expanded_opaque_bytes.size = count;
+}
+
+// Edits that start past the end of the document are ignored, and edits that
+// extend past its end are truncated.
+static bool document__clamp_edit(TSInputEdit *edit, uint32_t *total_bytes) {
+  if (edit->start_byte > *total_bytes)
+    return false;
+  if (edit->bytes_removed > *total_bytes - edit->start_byte)
+    edit->bytes_removed = *total_bytes - edit->start_byte;
+  *total_bytes = *total_bytes - edit->bytes_removed + edit->bytes_added;
+  return true;
+}
+
 void ts_document_edit(TSDocument *self, TSInputEdit edit) {
-  if (!self->tree)
-    return;
+  ts_document_edit_batch(self, &edit, 1);
+}
 
-  uint32_t max_bytes = ts_tree_total_bytes(self->tree);
-  if (edit.start_byte > max_bytes)
+void ts_document_edit_batch(TSDocument *self, const TSInputEdit *edits, uint32_t count) {
+  document__reset_parser(self);
+  if (!self->tree) {
+    line_index_invalidate(&self->line_index);
+    leaf_index_invalidate(&self->leaf_index);
+    ts_stack_snapshot_clear(&self->append_snapshot.stack, self->tree_pool);
+    for (uint32_t i = 0; i < count; i++) edit_log_edit(&self->edit_log, &edits[i]);
     return;
-  if (edit.bytes_removed > max_bytes - edit.start_byte)
-    edit.bytes_removed = max_bytes - edit.start_byte;
+  }
+
+  TSInputEdit single_edit;
+  TSInputEdit *clamped_edits = count > 1 ? ts_calloc(count, sizeof(TSInputEdit)) : &single_edit;
+  uint32_t clamped_edit_count = 0;
+  uint32_t total_bytes = ts_tree_total_bytes(self->tree);
+  for (uint32_t i = 0; i < count; i++) {
+    TSInputEdit edit = edits[i];
+    if (document__clamp_edit(&edit, &total_bytes)) {
+      clamped_edits[clamped_edit_count++] = edit;
+      if (edit.start_byte < self->append_snapshot.dependency_end_byte) {
+        ts_stack_snapshot_clear(&self->append_snapshot.stack, self->tree_pool);
+      }
+      line_index_edit(&self->line_index, &edit);
+      edit_log_edit(&self->edit_log, &edit);
+      leaf_index_edit(&self->leaf_index, &edit);
+      document__edit_expanded_opaque_bytes(self, &edit);
+    }
+  }
 
-  ts_tree_edit(self->tree, &edit);
+  if (clamped_edit_count > 0) {
+    document__drain_released_trees(self);
+    document__lock(self);
 
-  if (self->parser.print_debugging_graphs) {
-    ts_tree_print_dot_graph(self->tree, self->parser.language, stderr);
+    // Parsing leaves long repetitions as unbalanced spines, which are only
+    // rotated into balanced trees once the tree is edited, so that trees that
+    // are never edited don't pay for it. A tree that readers are retaining
+    // is left alone, since they may be traversing it.
+    ts_tree_balance(self->tree, self->tree_pool, self->language);
+    self->tree_pool->generation++;
+    self->tree = ts_tree_edit_batch(self->tree_pool, self->tree, clamped_edits, clamped_edit_count);
+    node_index_invalidate(&self->node_index);
+    document__unlock(self);
+
+    if (self->print_debugging_graphs) {
+      ts_tree_print_dot_graph(self->tree, self->language, stderr);
+    }
   }
+
+  if (clamped_edits != &single_edit) ts_free(clamped_edits);
+}
+
+uint32_t ts_document_edit_text(TSDocument *self, const char *old_text, uint32_t old_length,
+                               const char *new_text, uint32_t new_length, bool compare_lines) {
+  InputEditArray edits = array_new();
+  text_diff_compute(old_text, old_length, new_text, new_length, self->input.encoding,
+                    compare_lines, &edits);
+  uint32_t result = edits.size;
+  if (edits.size > 0) ts_document_edit_batch(self, edits.contents, edits.size);
+  array_delete(&edits);
+  return result;
 }
 
 void ts_document_parse(TSDocument *self) {
@@ -121,57 +477,585 @@ void ts_document_parse_and_get_changed_ranges(TSDocument *self, TSRange **ranges
   });
 }
 
-void ts_document_parse_with_options(TSDocument *self, TSParseOptions options) {
+// Trees are cached under a hash of the language and of the input's full
+// text, so that the same file is only parsed once, no matter which document
+// parses it. The language's counts and symbol names stand in for its
+// identity, because the same grammar is loaded at a different address in
+// every process.
+static uint64_t document__hash(uint64_t hash, const void *data, size_t length) {
+  const unsigned char *bytes = data;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+static uint64_t document__parse_cache_key(TSDocument *self, uint32_t *input_length) {
+  const TSLanguage *language = self->language;
+  uint32_t counts[] = {
+    language->version,
+    language->symbol_count,
+    language->alias_count,
+    language->token_count,
+    language->external_token_count,
+    language->state_count,
+    self->input.encoding,
+  };
+  uint64_t hash = document__hash(0xcbf29ce484222325ULL, counts, sizeof(counts));
+  for (uint32_t i = 0; i < language->symbol_count + language->alias_count; i++) {
+    const char *name = language->symbol_names[i];
+    hash = document__hash(hash, name, strlen(name) + 1);
+  }
+
+  *input_length = 0;
+  self->input.seek(self->input.payload, 0, (TSPoint){0, 0});
+  for (;;) {
+    uint32_t bytes_read;
+    const char *chunk = self->input.read(self->input.payload, &bytes_read);
+    if (bytes_read == TS_INPUT_WOULD_BLOCK) {
+      *input_length = UINT32_MAX;
+      break;
+    }
+    if (bytes_read == 0) break;
+    hash = document__hash(hash, chunk, bytes_read);
+    *input_length += bytes_read;
+  }
+  return hash;
+}
+
+// A cached tree that can't be read, or that doesn't span the whole input, is
+// ignored, and the input is parsed as though it had never been cached.
+static Tree *document__load_cached_tree(TSDocument *self, uint64_t key, uint32_t input_length) {
+  uint32_t length;
+  const char *data = self->parse_cache.load(self->parse_cache.payload, key, &length);
+  if (!data) return NULL;
+  Tree *tree = ts_tree_deserialize(self->tree_pool, data, length, self->language);
+  if (self->parse_cache.release) self->parse_cache.release(self->parse_cache.payload, data, length);
+  if (tree && ts_tree_total_bytes(tree) != input_length) {
+    ts_tree_release(self->tree_pool, tree);
+    return NULL;
+  }
+  return tree;
+}
+
+static void document__store_cached_tree(TSDocument *self, uint64_t key, const Tree *tree) {
+  uint32_t length;
+  char *data = ts_tree_serialize(tree, self->language, &length);
+  self->parse_cache.store(self->parse_cache.payload, key, data, length);
+  ts_free(data);
+}
+
+typedef struct {
+  TSDocument *document;
+  const TSParseOptions *options;
+} ChangedRangeReport;
+
+static bool document__report_changed_range(void *payload, TSRange range) {
+  ChangedRangeReport *report = payload;
+  TSDocument *self = report->document;
+  if (self->logger.log) {
+    LOG(
+      "changed_range start:[%u %u], end:[%u %u], bytes:[%u %u]",
+      range.start.row, range.start.column,
+      range.end.row, range.end.column,
+      range.start_byte, range.end_byte
+    );
+  }
+  return report->options->changed_range_callback(report->options->changed_range_payload, range);
+}
+
+static bool document__parse(TSDocument *self, Parser *parser, TSParseOptions options) {
   if (options.changed_ranges && options.changed_range_count) {
     *options.changed_ranges = NULL;
     *options.changed_range_count = 0;
   }
 
-  if (!self->input.read || !self->parser.language)
-    return;
+  if (!self->input.read || !self->language)
+    return true;
 
-  Tree *reusable_tree = self->valid ? self->tree : NULL;
+  document__drain_released_trees(self);
+
+  bool has_tree_builder = options.tree_builder.leaf || options.tree_builder.node;
+  if (has_tree_builder) {
+    options.streamed_node_callback = NULL;
+    options.event_handler = (TSParseEventHandler){NULL, NULL, NULL};
+    options.intern_leaves = false;
+  }
+  bool has_event_handler = options.event_handler.shift || options.event_handler.reduce;
+  bool is_streaming = options.streamed_node_callback || has_event_handler;
+  bool keeps_tree = !has_event_handler && !has_tree_builder;
+  Tree *reusable_tree =
+    self->valid && !self->tree_is_streamed && !is_streaming && keeps_tree ? self->tree : NULL;
   if (reusable_tree && !reusable_tree->has_changes)
-    return;
+    return true;
+
+  // The trees created by a parse or by an edit belong to a new generation, so
+  // that they can be told apart from the ones that were there before.
+  if (!parser->has_partial_parse) self->tree_pool->generation++;
+
+  if (parser->given_language != self->given_language) parser_set_language(parser, self->given_language);
+  parser->lexer.logger = self->logger;
+  ts_lexer_set_included_ranges(&parser->lexer, self->included_ranges, self->included_range_count);
+  ts_lexer_set_window_size(&parser->lexer, options.input_window_bytes);
+  ts_lexer_set_prefetch(&parser->lexer, options.prefetch_input);
+  parser->opaque_regions = self->opaque_regions;
+  parser->opaque_region_count = self->opaque_region_count;
+  parser->expanded_opaque_bytes = self->expanded_opaque_bytes.contents;
+  parser->expanded_opaque_byte_count = self->expanded_opaque_bytes.size;
+  parser->print_debugging_graphs = self->print_debugging_graphs;
+  parser->max_version_count = options.max_version_count;
+  parser->cancellation_flag = options.cancellation_flag;
+  parser->timeout_micros = options.timeout_micros;
+  parser->max_bytes_per_call = options.max_bytes_per_call;
+  parser->priority_end_byte = options.priority_end_byte;
+  parser->is_profiling = options.enable_profiling;
+  parser->is_profiling_states = options.enable_state_profiling;
+  parser->max_recovery_steps_per_byte = options.max_recovery_steps_per_byte;
+  parser->max_memory_bytes = options.max_memory_bytes;
+  parser->max_error_cost = options.max_error_cost;
+  parser->intern_leaves = options.intern_leaves;
+  parser->streamed_node_callback = options.streamed_node_callback;
+  parser->streamed_node_payload = options.streamed_node_payload;
+  parser->event_handler = options.event_handler;
+  parser->tree_builder.callbacks = options.tree_builder;
+
+  // Only full parses use the cache. A parse that halts on errors, or once its
+  // error cost is over a limit, produces a different tree than an ordinary
+  // one, so its result isn't cached, and neither is one that only covers some
+  // ranges of the input, that skips opaque regions, that streams its nodes, or
+  // that doesn't keep its tree.
+  bool uses_parse_cache =
+    !reusable_tree && !options.halt_on_error && options.max_error_cost == 0 && !is_streaming &&
+    keeps_tree &&
+    self->included_range_count == 0 && self->opaque_region_count == 0 &&
+    self->parse_cache.load && self->parse_cache.store;
+
+  // Computing the key reads the whole input, which would move the lexer of a
+  // parse that is being resumed, so a resumed parse computes its key once it
+  // has finished, and only a fresh parse looks its tree up.
+  uint64_t cache_key = 0;
+  bool has_cache_key = false;
+  Tree *tree = NULL;
+  if (uses_parse_cache && !parser->has_partial_parse) {
+    uint32_t input_length;
+    cache_key = document__parse_cache_key(self, &input_length);
+
+    // An input that isn't all available yet can't be looked up.
+    if (input_length == UINT32_MAX) {
+      uses_parse_cache = false;
+    } else {
+      has_cache_key = true;
+      tree = document__load_cached_tree(self, cache_key, input_length);
+    }
+  }
 
-  Tree *tree = parser_parse(&self->parser, self->input, reusable_tree, options.halt_on_error);
+  // A cancelled parse is resumed on the same parser, rather than restarted.
+  // Parses that are meant to be spread across several calls are done serially,
+  // because a parallel parse can't be resumed. The input is only split into
+  // chunks when all of it is included and no regions are skipped.
+  bool was_parsed = !tree;
+  bool records_snapshots = false;
+  if (was_parsed) {
+    bool is_time_sliced =
+      options.timeout_micros > 0 || options.max_bytes_per_call > 0 || options.priority_end_byte > 0;
+    if (!reusable_tree && options.thread_count > 1 && !is_time_sliced && !is_streaming && keeps_tree &&
+        !parser->has_partial_parse &&
+        self->included_range_count == 0 && self->opaque_region_count == 0) {
+      tree = parser_parse_in_parallel(parser, self->input, options.thread_count, options.halt_on_error);
+    } else {
+      // Only a serial parse whose tree replaces the document's tree records
+      // snapshots of its stack, and only one that reuses that tree resumes
+      // from one.
+      records_snapshots =
+        options.append_mode && !is_streaming && keeps_tree && self->opaque_region_count == 0;
+      parser->records_snapshots = records_snapshots;
+      if (records_snapshots && reusable_tree && self->append_snapshot.stack.entries.size > 0) {
+        parser->resume_snapshot = &self->append_snapshot;
+      }
+      tree = parser_parse(parser, self->input, reusable_tree, options.halt_on_error);
+      parser->records_snapshots = false;
+      parser->resume_snapshot = NULL;
+    }
+    ts_lexer_stop_prefetch(&parser->lexer);
+    self->stats = parser->stats;
+    self->profile = parser->profile;
+    if (parser->is_profiling) {
+      self->profile.column_rescan_count = parser->lexer.column_rescan_count;
+      self->profile.column_rescan_byte_count = parser->lexer.column_rescan_byte_count;
+    }
+    state_profile_assign(&self->state_profile, &parser->state_profile);
+
+    // A parse that stops at the end of its priority range publishes the text
+    // parsed so far, so that the range can be read before the parse finishes.
+    if (!tree) {
+      if (options.priority_end_byte > 0 && parser == self->parser && parser->has_partial_parse) {
+        document__set_provisional_tree(self, parser_provisional_tree(parser));
+      }
+      return false;
+    }
+    document__set_provisional_tree(self, NULL);
+    if (uses_parse_cache && !has_cache_key) {
+      uint32_t input_length;
+      cache_key = document__parse_cache_key(self, &input_length);
+      has_cache_key = input_length != UINT32_MAX;
+    }
+    if (uses_parse_cache && has_cache_key) document__store_cached_tree(self, cache_key, tree);
+  }
+
+  if (records_snapshots) {
+    parser_take_snapshot(parser, tree, &self->append_snapshot);
+  } else if (keeps_tree) {
+    ts_stack_snapshot_clear(&self->append_snapshot.stack, self->tree_pool);
+  }
 
-  if (self->tree) {
-    Tree *old_tree = self->tree;
-    self->tree = tree;
+  // The events have already been reported, or the caller has built their own
+  // tree, so this one isn't needed.
+  if (!keeps_tree) {
+    ts_tree_release(self->tree_pool, tree);
+    return true;
+  }
 
-    if (options.changed_ranges && options.changed_range_count) {
+  Tree *old_tree = self->tree;
+  if (old_tree && !self->tree_is_streamed && !is_streaming) {
+    if (options.changed_range_callback) {
+      ChangedRangeReport report = {self, &options};
+      ts_tree_each_changed_range(
+        old_tree, tree, &self->tree_path1, &self->tree_path2,
+        self->language, document__report_changed_range, &report
+      );
+    } else if (options.changed_ranges && options.changed_range_count) {
       *options.changed_range_count = ts_tree_get_changed_ranges(
         old_tree, tree, &self->tree_path1, &self->tree_path2,
-        self->parser.language, options.changed_ranges
+        self->language, options.changed_ranges
       );
 
-      if (self->parser.lexer.logger.log) {
+      if (self->logger.log) {
         for (unsigned i = 0; i < *options.changed_range_count; i++) {
           TSRange range = (*options.changed_ranges)[i];
           LOG(
-            "changed_range start:[%u %u], end:[%u %u]",
+            "changed_range start:[%u %u], end:[%u %u], bytes:[%u %u]",
             range.start.row, range.start.column,
-            range.end.row, range.end.column
+            range.end.row, range.end.column,
+            range.start_byte, range.end_byte
           );
         }
       }
     }
+  }
 
-    ts_tree_release(&self->parser.tree_pool, old_tree);
+  self->tree_is_streamed = is_streaming;
+  document__set_tree(self, tree);
+
+  // Only the tokens of an incremental parse can be updated in place.
+  if (reusable_tree && was_parsed) {
+    leaf_index_mark_parsed(&self->leaf_index, tree, self->tree_pool->generation);
+  } else {
+    leaf_index_invalidate(&self->leaf_index);
   }
+  if (was_parsed) self->parse_count++;
+  self->valid = true;
+  return true;
+}
 
-  self->tree = tree;
-  self->parse_count++;
+bool ts_document_parse_with_options(TSDocument *self, TSParseOptions options) {
+  return document__parse(self, document__own_parser(self), options);
+}
+
+// A parser that is shared between documents borrows this document's pool for
+// the length of the parse, and gives it back before returning, so that the
+// parser can take the next job from any document. An unfinished parse can't
+// outlive the job, so a parse that is cancelled, or that runs out of time or
+// of bytes, is discarded, and the next call starts over.
+bool ts_document_parse_with_parser(TSDocument *self, TSParser *parser, TSParseOptions options) {
+  if (!parser || parser == self->parser) return ts_document_parse_with_options(self, options);
+  document__reset_parser(self);
+  parser_set_tree_pool(parser, self->tree_pool);
+  bool result = document__parse(self, parser, options);
+  parser_set_tree_pool(parser, &parser->own_tree_pool);
+  return result;
+}
+
+static void *document__parse_in_background(void *payload) {
+  TSDocument *self = payload;
+  self->background_parse_result = ts_document_parse_with_options(self, self->background_parse_options);
+  return NULL;
+}
+
+// The parse runs on a new thread, which publishes the new tree as soon as it
+// is finished. If the thread can't be created, the parse is done before this
+// returns. Until the parse is finished, the only document functions that may
+// be called are the ones that acquire and release root nodes.
+void ts_document_start_background_parse(TSDocument *self, TSParseOptions options) {
+  ts_document_finish_background_parse(self);
+  self->background_parse_options = options;
+#ifndef _WIN32
+  if (pthread_create(&self->background_parse_thread, NULL, document__parse_in_background, self) == 0) {
+    self->is_parsing_in_background = true;
+    return;
+  }
+#endif
+  document__parse_in_background(self);
+}
+
+bool ts_document_finish_background_parse(TSDocument *self) {
+#ifndef _WIN32
+  if (self->is_parsing_in_background) {
+    pthread_join(self->background_parse_thread, NULL);
+    self->is_parsing_in_background = false;
+  }
+#endif
+  return self->background_parse_result;
+}
+
+// Readers on other threads acquire the root node of the current tree, which
+// then remains valid and unchanged until it is released, even if the document
+// is edited or re-parsed in the meantime. Each reader holds a reference to the
+// tree, so edits copy the nodes they change instead of modifying them. Trees
+// can only be returned to the document's pool by the thread that parses the
+// document, so releasing a node hands its reference back without taking the
+// lock, and the reference is dropped by the next edit or parse.
+TSNode ts_document_acquire_root_node(TSDocument *self) {
+  document__lock(self);
+  TSNode result = ts_node_make_root(self->tree, self->language);
+  if (self->tree) ts_tree_retain(self->tree);
+  document__unlock(self);
+  return result;
+}
+
+void ts_document_release_root_node(TSDocument *self, TSNode node) {
+  if (node.root) ts_tree_pool_release_remotely(self->tree_pool, (Tree *)node.root);
+}
+
+TSDocumentSnapshot *ts_document_snapshot(TSDocument *self) {
+  TSDocumentSnapshot *result = ts_malloc(sizeof(TSDocumentSnapshot));
+  result->document = self;
+  result->root = ts_document_acquire_root_node(self);
+  return result;
+}
+
+TSNode ts_document_snapshot_root_node(const TSDocumentSnapshot *self) {
+  return self->root;
+}
+
+void ts_document_snapshot_delete(TSDocumentSnapshot *self) {
+  ts_document_release_root_node(self->document, self->root);
+  ts_free(self);
+}
+
+char *ts_document_serialize(const TSDocument *self, uint32_t *length) {
+  if (!self->tree) {
+    *length = 0;
+    return NULL;
+  }
+  return ts_tree_serialize(self->tree, self->language, length);
+}
+
+// The document's input is expected to be the text from which the tree was
+// parsed, so the tree is treated as valid, and is reused by the next parse
+// after an edit.
+bool ts_document_deserialize(TSDocument *self, const char *data, uint32_t length) {
+  if (!self->language) return false;
+  Tree *tree = ts_tree_deserialize(self->tree_pool, data, length, self->language);
+  if (!tree) return false;
+  document__reset_parser(self);
+  document__set_tree(self, tree);
+  leaf_index_invalidate(&self->leaf_index);
   self->valid = true;
+  return true;
+}
+
+void ts_document_set_parse_cache(TSDocument *self, TSParseCache cache) {
+  self->parse_cache = cache;
 }
 
 void ts_document_invalidate(TSDocument *self) {
+  document__reset_parser(self);
+  line_index_invalidate(&self->line_index);
+  ts_stack_snapshot_clear(&self->append_snapshot.stack, self->tree_pool);
   self->valid = false;
 }
 
 TSNode ts_document_root_node(const TSDocument *self) {
-  return ts_node_make(self->tree, 0, 0);
+  return ts_node_make_root(self->tree, self->language);
+}
+
+// A tree that was freed may have been replaced by a new one at the same
+// address, so the generation in the id has to match as well.
+TSNode ts_document_node_for_id(TSDocument *self, TSNodeId id) {
+  node_index_update(&self->node_index, self->tree, self->language);
+  const NodeIndexEntry *entry = id.tree ? node_index_find(&self->node_index, id.tree) : NULL;
+  if (!entry || entry->tree->generation != id.generation) {
+    return ts_node_make(NULL, length_zero(), 0, NULL, self->language);
+  }
+  return ts_node_make(entry->tree, entry->position, entry->alias_symbol, self->tree, self->language);
+}
+
+// The same as `ts_node_parent`, but the parent is looked up in the document's
+// node index, rather than found by descending from the root, so that repeated
+// calls don't each pass through the invisible nodes above the given one. A
+// node from another tree, or one whose tree occurs in several places, is
+// handled by `ts_node_parent`.
+TSNode ts_document_node_parent(TSDocument *self, TSNode node) {
+  if (!node.data || node.data == self->tree || node.root != self->tree) return ts_node_parent(node);
+
+  node_index_update(&self->node_index, self->tree, self->language);
+  const NodeIndexEntry *entry = node_index_find(&self->node_index, node.data);
+  if (!entry || entry->is_shared || !entry->parent || entry->position.bytes != node.offset[0]) {
+    return ts_node_parent(node);
+  }
+  return ts_node_make(
+    entry->parent,
+    entry->parent_position,
+    entry->parent_alias_symbol,
+    self->tree,
+    self->language
+  );
+}
+
+// The line index is kept up to date through edits, but the text that they
+// insert is only scanned for newlines when positions are next converted. Reading
+// the input invalidates the chunk of it that an unfinished parse is holding.
+static void document__update_line_index(TSDocument *self) {
+  if (!self->input.read) return;
+  if (self->parser && self->parser->has_partial_parse) ts_lexer_set_input(&self->parser->lexer, self->input);
+  line_index_update(&self->line_index, self->input);
+}
+
+TSPoint ts_document_point_for_byte(TSDocument *self, uint32_t byte) {
+  document__update_line_index(self);
+  return line_index_point_for_byte(&self->line_index, byte);
+}
+
+uint32_t ts_document_byte_for_point(TSDocument *self, TSPoint point) {
+  document__update_line_index(self);
+  return line_index_byte_for_point(&self->line_index, point);
+}
+
+void ts_document_start_edit_log(TSDocument *self) {
+  edit_log_start(&self->edit_log);
+}
+
+void ts_document_stop_edit_log(TSDocument *self) {
+  edit_log_stop(&self->edit_log);
+}
+
+bool ts_document_translate_position(const TSDocument *self, uint32_t *byte, TSPoint *point) {
+  return edit_log_translate(&self->edit_log, byte, point);
+}
+
+void ts_document_translate_positions(const TSDocument *self, uint32_t *bytes, TSPoint *points,
+                                     uint32_t count) {
+  edit_log_translate_sorted(&self->edit_log, bytes, points, count);
+}
+
+// The token index is built the first time a token is looked up, and after
+// that, edits and parses only mark the ranges in which it must be updated.
+bool ts_document_token_for_byte(TSDocument *self, uint32_t byte, TSToken *token) {
+  bool is_final = !self->tree || !self->tree->has_changes;
+  leaf_index_update(&self->leaf_index, ts_document_root_node(self), is_final);
+  const TSToken *result = leaf_index_token_for_byte(&self->leaf_index, byte);
+  if (!result) return false;
+  *token = *result;
+  return true;
+}
+
+bool ts_document_token_for_point(TSDocument *self, TSPoint point, TSToken *token) {
+  return ts_document_token_for_byte(self, ts_document_byte_for_point(self, point), token);
+}
+
+TSParseStats ts_document_parse_stats(const TSDocument *self) {
+  return self->stats;
+}
+
+TSParseProfile ts_document_parse_profile(const TSDocument *self) {
+  return self->profile;
+}
+
+// The counts from the most recent parse, which are empty unless that parse had
+// state profiling enabled. They are indexed by parse state, lex state and
+// symbol, and stay valid until the document is parsed again. Reductions can be
+// traced back to the grammar's rules through the names of their symbols.
+TSStateProfile ts_document_state_profile(const TSDocument *self) {
+  return (TSStateProfile){
+    .parse_states = self->state_profile.parse_states.contents,
+    .parse_state_count = self->state_profile.parse_states.size,
+    .lex_state_entry_counts = self->state_profile.lex_states.contents,
+    .lex_state_count = self->state_profile.lex_states.size,
+    .symbol_reduction_counts = self->state_profile.symbol_reductions.contents,
+    .symbol_count = self->state_profile.symbol_reductions.size,
+  };
+}
+
+void ts_document_set_trace_capacity(TSDocument *self, uint32_t capacity) {
+  trace_buffer_set_capacity(&document__own_parser(self)->trace, capacity);
+}
+
+uint32_t ts_document_drain_trace(TSDocument *self, TSTraceEvent *events, uint32_t count,
+                                 uint32_t *dropped_count) {
+  if (!self->parser) {
+    if (dropped_count) *dropped_count = 0;
+    return 0;
+  }
+  TraceBuffer *trace = &self->parser->trace;
+  if (dropped_count) *dropped_count = trace->dropped_count;
+  trace->dropped_count = 0;
+  return trace_buffer_drain(trace, events, count);
+}
+
+bool ts_document_has_unfinished_parse(const TSDocument *self) {
+  return self->parser && self->parser->has_partial_parse;
+}
+
+// Until the unfinished parse is done, the provisional tree is only accurate up
+// to the end of the priority range. Beyond that, it's made of the old tree's
+// subtrees, positioned according to the edits.
+TSNode ts_document_provisional_root_node(const TSDocument *self) {
+  return ts_node_make_root(self->provisional_tree ? self->provisional_tree : self->tree, self->language);
+}
+
+// The tree bytes are measured by walking the current tree, so they don't include
+// trees that readers are still retaining, except where those share subtrees with
+// the current one.
+TSMemoryUsage ts_document_memory_usage(const TSDocument *self) {
+  return (TSMemoryUsage){
+    .tree_bytes =
+      (self->tree ? ts_tree_memory_usage(self->tree) : 0) +
+      ts_tree_pool_interned_bytes(self->tree_pool),
+    .free_tree_bytes = ts_tree_pool_free_bytes(self->tree_pool),
+    .stack_bytes = self->parser ? ts_stack_allocated_bytes(self->parser->stack) : 0,
+  };
+}
+
+// The shape of the document's current tree, along with the document's memory
+// usage. Computing these visits every tree, so it takes time in proportion to
+// the size of the tree.
+TSTreeStats ts_document_tree_stats(const TSDocument *self) {
+  TSTreeStats result = {0};
+  if (self->tree) ts_tree_get_stats(self->tree, &result);
+  result.memory_usage = ts_document_memory_usage(self);
+  return result;
+}
+
+// Lay out the document's tree contiguously, in depth-first order. This moves
+// the tree's nodes, so it invalidates any nodes, node ids and changed node
+// iterators that were obtained from the document before. Any background parse
+// is finished first, and nothing is moved while readers retain the tree.
+void ts_document_compact(TSDocument *self) {
+  ts_document_finish_background_parse(self);
+  if (!self->tree) return;
+  document__drain_released_trees(self);
+  document__lock(self);
+  self->tree = ts_tree_compact(self->tree_pool, self->tree);
+  node_index_invalidate(&self->node_index);
+  document__unlock(self);
+}
+
+void ts_document_trim_memory(TSDocument *self) {
+  ts_document_finish_background_parse(self);
+  document__drain_released_trees(self);
+  ts_tree_pool_trim(self->tree_pool);
+  if (self->parser) parser_trim(self->parser);
 }
 
 uint32_t ts_document_parse_count(const TSDocument *self) {
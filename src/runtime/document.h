@@ -3,18 +3,97 @@
 
 #include "runtime/parser.h"
 #include "runtime/tree.h"
+#include "runtime/edit_log.h"
 #include "runtime/get_changed_ranges.h"
+#include "runtime/leaf_index.h"
+#include "runtime/line_index.h"
+#include "runtime/node_index.h"
 #include <stdbool.h>
 
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+// A pool that is shared by a document and the documents forked from it, so
+// that they can share trees, or by the documents in a group. It is freed along
+// with the last of them, counting the group as one of them.
+typedef struct {
+  TreePool tree_pool;
+  uint32_t document_count;
+} DocumentTreePool;
+
+// A document only creates a parser of its own when it is parsed without being
+// given one. Its trees are always allocated from its own pool, whichever parser
+// produces them.
 struct TSDocument {
-  Parser parser;
+  Parser *parser;
+  DocumentTreePool *shared_tree_pool;
+  TreePool *tree_pool;
+  const TSLanguage *language;
+
+  // The language as it was given. If it was generated for an older version,
+  // `language` points to an upgraded copy of it, which the document owns.
+  const TSLanguage *given_language;
+  TSLanguage *upgraded_language;
+  TSLogger logger;
+  char debug_buffer[TREE_SITTER_SERIALIZATION_BUFFER_SIZE];
+  bool print_debugging_graphs;
+  TSParseStats stats;
+  TSParseProfile profile;
+  StateProfile state_profile;
   TSInput input;
+  uint64_t base_byte;
+
+  // Whether the tree came from a streaming parse, and so lacks the nodes that
+  // were streamed.
+  bool tree_is_streamed;
+  TSRange *included_ranges;
+  uint32_t included_range_count;
+  TSOpaqueRegion *opaque_regions;
+  uint32_t opaque_region_count;
+
+  // The start bytes of the opaque nodes that have been expanded. They are
+  // kept in order, and are moved by edits.
+  Array(uint32_t) expanded_opaque_bytes;
   Tree *tree;
+
+  // While a parse that stopped at its priority range is unfinished, the trees
+  // parsed so far, followed by the rest of the old tree.
+  Tree *provisional_tree;
   TreePath tree_path1;
   TreePath tree_path2;
   size_t parse_count;
   bool valid;
-  bool owns_input;
+  void (*free_input)(void *);
+  TSParseCache parse_cache;
+  LineIndex line_index;
+  LeafIndex leaf_index;
+  NodeIndex node_index;
+  EditLog edit_log;
+
+  // The snapshot of the parser's stack from the last parse in append mode.
+  ParseSnapshot append_snapshot;
+  TSParseOptions background_parse_options;
+  bool background_parse_result;
+  bool is_parsing_in_background;
+#ifndef _WIN32
+  pthread_mutex_t lock;
+  pthread_t background_parse_thread;
+#endif
+};
+
+// A group holds a reference to its documents' pool, in the same way as each of
+// them, so that the pool outlives whichever of them is freed last.
+struct TSDocumentGroup {
+  DocumentTreePool *shared_tree_pool;
+  const TSLanguage *language;
+};
+
+// A snapshot pins the document's tree as it was when the snapshot was taken,
+// in the same way as a reader that acquires the root node.
+struct TSDocumentSnapshot {
+  TSDocument *document;
+  TSNode root;
 };
 
 #endif
@@ -0,0 +1,136 @@
+#include "runtime/edit_log.h"
+
+void edit_log_init(EditLog *self) {
+  array_init(&self->ranges);
+  self->is_active = false;
+}
+
+void edit_log_delete(EditLog *self) {
+  if (self->ranges.contents) array_delete(&self->ranges);
+}
+
+void edit_log_start(EditLog *self) {
+  array_clear(&self->ranges);
+  self->is_active = true;
+}
+
+void edit_log_stop(EditLog *self) {
+  edit_log_delete(self);
+  self->is_active = false;
+}
+
+// The text between two ranges is unchanged, so a position within it is as far
+// from the end of the previous range in the old text as in the new one.
+static inline Length edit_log__shift(Length position, Length from, Length to) {
+  return length_add(to, length_sub(position, from));
+}
+
+// A position in the current text that isn't inside any range, translated back
+// to the old text through the range at the given index, which precedes it.
+static inline Length edit_log__old_position(const EditLog *self, uint32_t index, Length position) {
+  if (index == 0) return position;
+  const EditLogRange *range = &self->ranges.contents[index - 1];
+  return edit_log__shift(position, range->new_end, range->old_end);
+}
+
+// The edit is given in terms of the current text, so the ranges that it
+// overlaps or touches are combined with it into a single range, and the ranges
+// after it are moved by the difference in length.
+void edit_log_edit(EditLog *self, const TSInputEdit *edit) {
+  if (!self->is_active) return;
+  if (edit->bytes_removed == 0 && edit->bytes_added == 0) return;
+
+  Length start = {edit->start_byte, edit->start_point};
+  Length old_end = length_add(start, (Length){edit->bytes_removed, edit->extent_removed});
+  Length new_end = length_add(start, (Length){edit->bytes_added, edit->extent_added});
+
+  uint32_t first = 0, end = self->ranges.size;
+  while (first < end) {
+    uint32_t mid = first + (end - first) / 2;
+    if (self->ranges.contents[mid].new_end.bytes < start.bytes) {
+      first = mid + 1;
+    } else {
+      end = mid;
+    }
+  }
+  uint32_t last = first;
+  while (last < self->ranges.size && self->ranges.contents[last].new_start.bytes <= old_end.bytes) {
+    last++;
+  }
+
+  EditLogRange range;
+  Length current_end = old_end;
+  if (last > first && self->ranges.contents[first].new_start.bytes <= start.bytes) {
+    range.old_start = self->ranges.contents[first].old_start;
+    range.new_start = self->ranges.contents[first].new_start;
+  } else {
+    range.old_start = edit_log__old_position(self, first, start);
+    range.new_start = start;
+  }
+  if (last > first && self->ranges.contents[last - 1].new_end.bytes >= old_end.bytes) {
+    range.old_end = self->ranges.contents[last - 1].old_end;
+    current_end = self->ranges.contents[last - 1].new_end;
+  } else {
+    range.old_end = edit_log__old_position(self, last, old_end);
+  }
+  range.new_end = edit_log__shift(current_end, old_end, new_end);
+
+  for (uint32_t i = last; i < self->ranges.size; i++) {
+    EditLogRange *later = &self->ranges.contents[i];
+    later->new_start = edit_log__shift(later->new_start, old_end, new_end);
+    later->new_end = edit_log__shift(later->new_end, old_end, new_end);
+  }
+
+  if (last > first) {
+    self->ranges.contents[first] = range;
+    array__splice((VoidArray *)&self->ranges, sizeof(EditLogRange), first + 1, last - first - 1, 0, NULL);
+  } else {
+    array_insert(&self->ranges, first, range);
+  }
+}
+
+// A position at which text was inserted stays before that text. A position
+// inside text that was removed is moved to the start of what replaced it, and
+// false is returned.
+static inline bool edit_log__translate_from(const EditLog *self, uint32_t index, Length *position) {
+  if (index == 0) return true;
+  const EditLogRange *range = &self->ranges.contents[index - 1];
+  if (position->bytes < range->old_end.bytes) {
+    *position = range->new_start;
+    return false;
+  }
+  *position = edit_log__shift(*position, range->old_end, range->new_end);
+  return true;
+}
+
+bool edit_log_translate(const EditLog *self, uint32_t *byte, TSPoint *point) {
+  uint32_t low = 0, high = self->ranges.size;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if (self->ranges.contents[mid].old_start.bytes < *byte) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  Length position = {*byte, *point};
+  bool result = edit_log__translate_from(self, low, &position);
+  *byte = position.bytes;
+  *point = position.extent;
+  return result;
+}
+
+// Positions that are in order can be translated in a single pass over the
+// ranges, rather than searching them for each one.
+void edit_log_translate_sorted(const EditLog *self, uint32_t *bytes, TSPoint *points, uint32_t count) {
+  uint32_t index = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    while (index < self->ranges.size && self->ranges.contents[index].old_start.bytes < bytes[i]) {
+      index++;
+    }
+    Length position = {bytes[i], points[i]};
+    edit_log__translate_from(self, index, &position);
+    bytes[i] = position.bytes;
+    points[i] = position.extent;
+  }
+}
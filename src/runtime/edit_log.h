@@ -0,0 +1,43 @@
+#ifndef RUNTIME_EDIT_LOG_H_
+#define RUNTIME_EDIT_LOG_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include "tree_sitter/runtime.h"
+#include "runtime/array.h"
+#include "runtime/length.h"
+
+// A range of the text as it was when the log was started, and the range of
+// the current text that replaced it.
+typedef struct {
+  Length old_start;
+  Length old_end;
+  Length new_start;
+  Length new_end;
+} EditLogRange;
+
+// The edits made to a document since the log was started, combined into the
+// ranges of the text that they changed, which are kept in order and don't
+// touch each other. The text between the ranges is unchanged, so a position
+// in the old text is translated by finding the range before it.
+typedef struct {
+  Array(EditLogRange) ranges;
+  bool is_active;
+} EditLog;
+
+void edit_log_init(EditLog *);
+void edit_log_delete(EditLog *);
+void edit_log_start(EditLog *);
+void edit_log_stop(EditLog *);
+void edit_log_edit(EditLog *, const TSInputEdit *);
+bool edit_log_translate(const EditLog *, uint32_t *byte, TSPoint *point);
+void edit_log_translate_sorted(const EditLog *, uint32_t *bytes, TSPoint *points, uint32_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // RUNTIME_EDIT_LOG_H_
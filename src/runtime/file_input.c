@@ -0,0 +1,109 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "runtime/file_input.h"
+#include "runtime/alloc.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+typedef struct {
+  const char *contents;
+  uint32_t position;
+  uint32_t length;
+  void *mapping;
+  size_t mapping_length;
+} TSFileInput;
+
+static const char *ts_file_input__read(void *payload, uint32_t *bytes_read) {
+  TSFileInput *input = (TSFileInput *)payload;
+  if (input->position >= input->length) {
+    *bytes_read = 0;
+    return "";
+  }
+  uint32_t previous_position = input->position;
+  input->position = input->length;
+  *bytes_read = input->position - previous_position;
+  return input->contents + previous_position;
+}
+
+static int ts_file_input__seek(void *payload, uint32_t byte, TSPoint _) {
+  TSFileInput *input = (TSFileInput *)payload;
+  input->position = byte;
+  return (byte < input->length);
+}
+
+// Map the file's contents directly, so that the lexer reads them from the
+// page cache without copying them into a separate buffer.
+TSInput ts_file_input_make(int fd) {
+  return ts_file_input_make_range(fd, 0, UINT64_MAX);
+}
+
+// Map only the given range of the file, which may start anywhere in a file
+// of any size, as long as the range itself is shorter than 4GB. The range is
+// cut off at the end of the file. The mapping has to start at a page
+// boundary, so it includes the part of the page before the range.
+TSInput ts_file_input_make_range(int fd, uint64_t start_byte, uint64_t length) {
+  TSInput result = {
+    .payload = NULL,
+    .read = ts_file_input__read,
+    .seek = ts_file_input__seek,
+    .encoding = TSInputEncodingUTF8,
+  };
+
+#ifndef _WIN32
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) return result;
+  uint64_t file_size = file_stat.st_size;
+  if (start_byte > file_size) return result;
+  if (length > file_size - start_byte) length = file_size - start_byte;
+  if (length > UINT32_MAX) return result;
+
+  const char *contents = NULL;
+  void *mapping = NULL;
+  size_t mapping_length = 0;
+  if (length > 0) {
+    uint64_t page_size = sysconf(_SC_PAGESIZE);
+    uint64_t mapping_start = start_byte - start_byte % page_size;
+    mapping_length = length + (start_byte - mapping_start);
+    mapping = mmap(NULL, mapping_length, PROT_READ, MAP_PRIVATE, fd, mapping_start);
+    if (mapping == MAP_FAILED) return result;
+    posix_madvise(mapping, mapping_length, POSIX_MADV_SEQUENTIAL);
+    contents = (const char *)mapping + (start_byte - mapping_start);
+  }
+
+  TSFileInput *input = ts_malloc(sizeof(TSFileInput));
+  input->contents = contents;
+  input->position = 0;
+  input->length = length;
+  input->mapping = mapping;
+  input->mapping_length = mapping_length;
+  result.payload = input;
+#endif
+
+  return result;
+}
+
+TSInput ts_file_input_make_with_path(const char *path) {
+#ifndef _WIN32
+  int fd = open(path, O_RDONLY);
+  if (fd >= 0) {
+    TSInput result = ts_file_input_make(fd);
+    close(fd);
+    return result;
+  }
+#endif
+
+  return ts_file_input_make(-1);
+}
+
+void ts_file_input_delete(void *payload) {
+  TSFileInput *input = (TSFileInput *)payload;
+#ifndef _WIN32
+  if (input->mapping) munmap(input->mapping, input->mapping_length);
+#endif
+  ts_free(input);
+}
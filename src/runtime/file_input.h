@@ -0,0 +1,19 @@
+#ifndef RUNTIME_FILE_INPUT_H_
+#define RUNTIME_FILE_INPUT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "tree_sitter/runtime.h"
+
+TSInput ts_file_input_make(int);
+TSInput ts_file_input_make_range(int, uint64_t, uint64_t);
+TSInput ts_file_input_make_with_path(const char *);
+void ts_file_input_delete(void *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // RUNTIME_FILE_INPUT_H_
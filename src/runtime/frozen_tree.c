@@ -0,0 +1,242 @@
+#include <string.h>
+#include "tree_sitter/runtime.h"
+#include "runtime/alloc.h"
+#include "runtime/array.h"
+#include "runtime/language.h"
+
+// A frozen tree is a read-only copy of a tree's visible nodes, stored in one
+// buffer that can be written to a file and mapped back into memory. The buffer
+// starts with a header, followed by a fixed-size record for each node, in
+// pre-order. A node's first child, if it has any, is the record that follows
+// it, and each record holds the index of the node's next sibling, so that no
+// other links are needed. Records are written in the byte order of the machine
+// that froze the tree. A frozen tree records only byte ranges, not points.
+
+static const char FROZEN_TREE_MAGIC[4] = {'T', 'S', 'F', 'T'};
+static const uint32_t FROZEN_TREE_FORMAT_VERSION = 1;
+
+enum {
+  FrozenNodeIsNamed = 1 << 0,
+  FrozenNodeIsMissing = 1 << 1,
+  FrozenNodeHasError = 1 << 2,
+  FrozenNodeHasChildren = 1 << 3,
+};
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t symbol_count;
+  uint32_t node_count;
+} FrozenTreeHeader;
+
+// The root is never anyone's sibling, so a next sibling index of zero means
+// that there isn't one.
+typedef struct {
+  uint32_t start_byte;
+  uint32_t end_byte;
+  uint32_t next_sibling;
+  TSSymbol symbol;
+  uint16_t flags;
+} FrozenNode;
+
+struct TSFrozenTree {
+  const TSLanguage *language;
+  const char *data;
+  uint32_t length;
+  bool owns_data;
+};
+
+static inline const FrozenNode *ts_frozen_tree__nodes(const TSFrozenTree *self) {
+  return (const FrozenNode *)(self->data + sizeof(FrozenTreeHeader));
+}
+
+static inline uint32_t ts_frozen_tree__node_count(const TSFrozenTree *self) {
+  return ((const FrozenTreeHeader *)self->data)->node_count;
+}
+
+static inline const FrozenNode *ts_frozen_node__record(TSFrozenNode self) {
+  return &ts_frozen_tree__nodes(self.tree)[self.index];
+}
+
+static inline TSFrozenNode ts_frozen_node__null() {
+  return (TSFrozenNode){NULL, 0};
+}
+
+TSFrozenTree *ts_frozen_tree_new(TSNode root) {
+  if (!root.data) return NULL;
+
+  Array(FrozenNode) nodes = array_new();
+  Array(uint32_t) previous_siblings = array_new();
+  array_push(&previous_siblings, 0);
+
+  TSTreeCursor *cursor = ts_tree_cursor_new(root);
+  bool is_done = false;
+  while (!is_done) {
+    TSNode node = ts_tree_cursor_current_node(cursor);
+    uint32_t index = nodes.size;
+    uint16_t flags = 0;
+    if (ts_node_is_named(node)) flags |= FrozenNodeIsNamed;
+    if (ts_node_is_missing(node)) flags |= FrozenNodeIsMissing;
+    if (ts_node_has_error(node)) flags |= FrozenNodeHasError;
+    if (ts_node_child_count(node) > 0) flags |= FrozenNodeHasChildren;
+    array_push(&nodes, ((FrozenNode){
+      .start_byte = ts_node_start_byte(node),
+      .end_byte = ts_node_end_byte(node),
+      .next_sibling = 0,
+      .symbol = ts_node_symbol(node),
+      .flags = flags,
+    }));
+
+    uint32_t *previous_sibling = array_back(&previous_siblings);
+    if (*previous_sibling > 0) nodes.contents[*previous_sibling].next_sibling = index;
+    *previous_sibling = index;
+
+    if (ts_tree_cursor_goto_first_child(cursor)) {
+      array_push(&previous_siblings, 0);
+      continue;
+    }
+    while (!ts_tree_cursor_goto_next_sibling(cursor)) {
+      if (!ts_tree_cursor_goto_parent(cursor)) {
+        is_done = true;
+        break;
+      }
+      previous_siblings.size--;
+    }
+  }
+  ts_tree_cursor_delete(cursor);
+
+  FrozenTreeHeader header;
+  memcpy(header.magic, FROZEN_TREE_MAGIC, sizeof(header.magic));
+  header.version = FROZEN_TREE_FORMAT_VERSION;
+  header.symbol_count = root.language->symbol_count;
+  header.node_count = nodes.size;
+
+  uint32_t length = sizeof(header) + nodes.size * sizeof(FrozenNode);
+  char *data = ts_malloc(length);
+  memcpy(data, &header, sizeof(header));
+  memcpy(data + sizeof(header), nodes.contents, nodes.size * sizeof(FrozenNode));
+  array_delete(&nodes);
+  array_delete(&previous_siblings);
+
+  TSFrozenTree *self = ts_malloc(sizeof(TSFrozenTree));
+  self->language = root.language;
+  self->data = data;
+  self->length = length;
+  self->owns_data = true;
+  return self;
+}
+
+// Wrap data that was produced by `ts_frozen_tree_bytes`, without copying it,
+// so the data must outlive the frozen tree. It must be aligned to four bytes,
+// as it is when it is mapped from a file. Returns NULL if the data is malformed
+// or was written for a different language.
+TSFrozenTree *ts_frozen_tree_new_from_bytes(const TSLanguage *language, const char *data, uint32_t length) {
+  if (length < sizeof(FrozenTreeHeader) || (uintptr_t)data % sizeof(uint32_t) != 0) return NULL;
+  const FrozenTreeHeader *header = (const FrozenTreeHeader *)data;
+  if (memcmp(header->magic, FROZEN_TREE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != FROZEN_TREE_FORMAT_VERSION ||
+      header->symbol_count != language->symbol_count ||
+      header->node_count == 0 ||
+      header->node_count > (length - sizeof(FrozenTreeHeader)) / sizeof(FrozenNode)) {
+    return NULL;
+  }
+
+  // Every link must point forward, within the tree, so that traversals end,
+  // and every symbol must be one that the language can name.
+  const FrozenNode *nodes = (const FrozenNode *)(data + sizeof(FrozenTreeHeader));
+  uint32_t symbol_count = language->symbol_count + language->alias_count;
+  for (uint32_t i = 0; i < header->node_count; i++) {
+    TSSymbol symbol = nodes[i].symbol;
+    if (symbol >= symbol_count &&
+        symbol != ts_builtin_sym_error &&
+        symbol != ts_builtin_sym_error_repeat) return NULL;
+    uint32_t next_sibling = nodes[i].next_sibling;
+    if (next_sibling != 0 && (next_sibling <= i || next_sibling >= header->node_count)) return NULL;
+    if ((nodes[i].flags & FrozenNodeHasChildren) && i + 1 >= header->node_count) return NULL;
+  }
+
+  TSFrozenTree *self = ts_malloc(sizeof(TSFrozenTree));
+  self->language = language;
+  self->data = data;
+  self->length = sizeof(FrozenTreeHeader) + header->node_count * sizeof(FrozenNode);
+  self->owns_data = false;
+  return self;
+}
+
+void ts_frozen_tree_delete(TSFrozenTree *self) {
+  if (self->owns_data) ts_free((char *)self->data);
+  ts_free(self);
+}
+
+const char *ts_frozen_tree_bytes(const TSFrozenTree *self, uint32_t *length) {
+  *length = self->length;
+  return self->data;
+}
+
+uint32_t ts_frozen_tree_node_count(const TSFrozenTree *self) {
+  return ts_frozen_tree__node_count(self);
+}
+
+TSFrozenNode ts_frozen_tree_root_node(const TSFrozenTree *self) {
+  return (TSFrozenNode){self, 0};
+}
+
+bool ts_frozen_node_is_null(TSFrozenNode self) {
+  return !self.tree;
+}
+
+TSSymbol ts_frozen_node_symbol(TSFrozenNode self) {
+  return ts_frozen_node__record(self)->symbol;
+}
+
+const char *ts_frozen_node_type(TSFrozenNode self) {
+  return ts_language_symbol_name(self.tree->language, ts_frozen_node_symbol(self));
+}
+
+uint32_t ts_frozen_node_start_byte(TSFrozenNode self) {
+  return ts_frozen_node__record(self)->start_byte;
+}
+
+uint32_t ts_frozen_node_end_byte(TSFrozenNode self) {
+  return ts_frozen_node__record(self)->end_byte;
+}
+
+bool ts_frozen_node_is_named(TSFrozenNode self) {
+  return ts_frozen_node__record(self)->flags & FrozenNodeIsNamed;
+}
+
+bool ts_frozen_node_is_missing(TSFrozenNode self) {
+  return ts_frozen_node__record(self)->flags & FrozenNodeIsMissing;
+}
+
+bool ts_frozen_node_has_error(TSFrozenNode self) {
+  return ts_frozen_node__record(self)->flags & FrozenNodeHasError;
+}
+
+TSFrozenNode ts_frozen_node_first_child(TSFrozenNode self) {
+  if (!(ts_frozen_node__record(self)->flags & FrozenNodeHasChildren)) return ts_frozen_node__null();
+  return (TSFrozenNode){self.tree, self.index + 1};
+}
+
+TSFrozenNode ts_frozen_node_next_sibling(TSFrozenNode self) {
+  uint32_t next_sibling = ts_frozen_node__record(self)->next_sibling;
+  if (next_sibling == 0) return ts_frozen_node__null();
+  return (TSFrozenNode){self.tree, next_sibling};
+}
+
+uint32_t ts_frozen_node_child_count(TSFrozenNode self) {
+  uint32_t result = 0;
+  for (TSFrozenNode child = ts_frozen_node_first_child(self); child.tree;
+       child = ts_frozen_node_next_sibling(child)) {
+    result++;
+  }
+  return result;
+}
+
+TSFrozenNode ts_frozen_node_child(TSFrozenNode self, uint32_t child_index) {
+  TSFrozenNode child = ts_frozen_node_first_child(self);
+  for (uint32_t i = 0; i < child_index && child.tree; i++) {
+    child = ts_frozen_node_next_sibling(child);
+  }
+  return child;
+}
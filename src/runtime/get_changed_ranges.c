@@ -8,19 +8,43 @@
 
 typedef Array(TSRange) RangeArray;
 
-static void range_array_add(RangeArray *results, TSPoint start, TSPoint end) {
-  if (results->size > 0) {
-    TSRange *last_range = array_back(results);
-    if (point_lte(start, last_range->end)) {
-      last_range->end = end;
-      return;
+// Adjacent ranges are merged, so each range is held back until a range is
+// found that doesn't touch it. The callback can return false to stop the
+// comparison early.
+typedef struct {
+  ChangedRangeCallback callback;
+  void *payload;
+  TSRange pending_range;
+  bool has_pending_range;
+  bool is_stopped;
+} RangeOutput;
+
+static void range_output_add(RangeOutput *self, Length start, Length end) {
+  if (self->has_pending_range && start.bytes <= self->pending_range.end_byte) {
+    self->pending_range.end = end.extent;
+    self->pending_range.end_byte = end.bytes;
+    return;
+  }
+
+  if (start.bytes < end.bytes) {
+    if (self->has_pending_range && !self->callback(self->payload, self->pending_range)) {
+      self->is_stopped = true;
     }
+    self->pending_range = (TSRange){ start.extent, end.extent, start.bytes, end.bytes };
+    self->has_pending_range = true;
   }
+}
 
-  if (point_lt(start, end)) {
-    TSRange range = { start, end };
-    array_push(results, range);
+static void range_output_flush(RangeOutput *self) {
+  if (self->has_pending_range && !self->is_stopped) {
+    self->callback(self->payload, self->pending_range);
   }
+  self->has_pending_range = false;
+}
+
+static bool range_array__push(void *payload, TSRange range) {
+  array_push((RangeArray *)payload, range);
+  return true;
 }
 
 typedef struct {
@@ -74,8 +98,7 @@ static bool iterator_tree_is_visible(const Iterator *self) {
   if (entry.tree->visible) return true;
   if (self->path.size > 1) {
     Tree *parent = self->path.contents[self->path.size - 2].tree;
-    const TSSymbol *alias_sequence = ts_language_alias_sequence(self->language, parent->alias_sequence_id);
-    return alias_sequence && alias_sequence[entry.structural_child_index] != 0;
+    return ts_language_alias_at(self->language, parent->alias_sequence_id, entry.structural_child_index) != 0;
   }
   return false;
 }
@@ -94,12 +117,12 @@ static void iterator_get_visible_state(const Iterator *self, Tree **tree,
 
     if (i > 0) {
       Tree *parent = self->path.contents[i - 1].tree;
-      const TSSymbol *alias_sequence = ts_language_alias_sequence(
-        self->language,
-        parent->alias_sequence_id
-      );
-      if (alias_sequence) {
-        *alias_symbol = alias_sequence[entry.structural_child_index];
+      if (parent->alias_sequence_id) {
+        *alias_symbol = ts_language_alias_at(
+          self->language,
+          parent->alias_sequence_id,
+          entry.structural_child_index
+        );
       }
     }
 
@@ -224,12 +247,21 @@ IteratorComparison iterator_compare(const Iterator *old_iter, const Iterator *ne
 
   if (old_alias_symbol == new_alias_symbol) {
     if (old_start == new_start) {
+      // A subtree that the parser reused from the old tree is the same object
+      // in both trees, so its contents can't have changed.
+      if (old_tree == new_tree && !old_tree->has_changes &&
+          old_iter->in_padding == new_iter->in_padding) {
+        return IteratorMatches;
+      }
+
       if (!old_tree->has_changes &&
           old_tree->symbol == new_tree->symbol &&
           old_tree->symbol != ts_builtin_sym_error &&
           old_tree->size.bytes == new_tree->size.bytes &&
           old_tree->parse_state != TS_TREE_STATE_NONE &&
           new_tree->parse_state != TS_TREE_STATE_NONE &&
+          !old_tree->fragile_left && !old_tree->fragile_right &&
+          !new_tree->fragile_left && !new_tree->fragile_right &&
           (old_tree->parse_state == ERROR_STATE) ==
           (new_tree->parse_state == ERROR_STATE)) {
         return IteratorMatches;
@@ -260,10 +292,16 @@ static inline void iterator_print_state(Iterator *self) {
 }
 #endif
 
-unsigned ts_tree_get_changed_ranges(Tree *old_tree, Tree *new_tree,
-                                    TreePath *path1, TreePath *path2,
-                                    const TSLanguage *language, TSRange **ranges) {
-  RangeArray results = array_new();
+void ts_tree_each_changed_range(Tree *old_tree, Tree *new_tree,
+                                TreePath *path1, TreePath *path2,
+                                const TSLanguage *language,
+                                ChangedRangeCallback callback, void *payload) {
+  RangeOutput results = {
+    .callback = callback,
+    .payload = payload,
+    .has_pending_range = false,
+    .is_stopped = false,
+  };
 
   Iterator old_iter = iterator_new(path1, old_tree, language);
   Iterator new_iter = iterator_new(path2, new_tree, language);
@@ -271,10 +309,10 @@ unsigned ts_tree_get_changed_ranges(Tree *old_tree, Tree *new_tree,
   Length position = iterator_start_position(&old_iter);
   Length next_position = iterator_start_position(&new_iter);
   if (position.bytes < next_position.bytes) {
-    range_array_add(&results, position.extent, next_position.extent);
+    range_output_add(&results, position, next_position);
     position = next_position;
   } else if (position.bytes > next_position.bytes) {
-    range_array_add(&results, next_position.extent, position.extent);
+    range_output_add(&results, next_position, position);
     next_position = position;
   }
 
@@ -342,14 +380,23 @@ unsigned ts_tree_get_changed_ranges(Tree *old_tree, Tree *new_tree,
       );
       #endif
 
-      range_array_add(&results, position.extent, next_position.extent);
+      range_output_add(&results, position, next_position);
     }
 
     position = next_position;
-  } while (!iterator_done(&old_iter) && !iterator_done(&new_iter));
+  } while (!iterator_done(&old_iter) && !iterator_done(&new_iter) && !results.is_stopped);
 
+  range_output_flush(&results);
   *path1 = old_iter.path;
   *path2 = new_iter.path;
+}
+
+unsigned ts_tree_get_changed_ranges(Tree *old_tree, Tree *new_tree,
+                                    TreePath *path1, TreePath *path2,
+                                    const TSLanguage *language, TSRange **ranges) {
+  RangeArray results = array_new();
+  ts_tree_each_changed_range(old_tree, new_tree, path1, path2, language,
+                             range_array__push, &results);
   *ranges = results.contents;
   return results.size;
 }
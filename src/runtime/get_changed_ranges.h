@@ -1,6 +1,10 @@
 #ifndef RUNTIME_GET_CHANGED_RANGES_H_
 #define RUNTIME_GET_CHANGED_RANGES_H_
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #include "runtime/tree.h"
 
 typedef struct {
@@ -12,9 +16,20 @@ typedef struct {
 
 typedef Array(TreePathEntry) TreePath;
 
+typedef bool (*ChangedRangeCallback)(void *payload, TSRange range);
+
+void ts_tree_each_changed_range(
+  Tree *old_tree, Tree *new_tree, TreePath *path1, TreePath *path2,
+  const TSLanguage *language, ChangedRangeCallback callback, void *payload
+);
+
 unsigned ts_tree_get_changed_ranges(
   Tree *old_tree, Tree *new_tree, TreePath *path1, TreePath *path2,
   const TSLanguage *language, TSRange **ranges
 );
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif  // RUNTIME_GET_CHANGED_RANGES_H_
@@ -0,0 +1,155 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <string.h>
+#include "runtime/input_prefetcher.h"
+#include "runtime/alloc.h"
+#include "runtime/array.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+// A prefetcher reads an input's chunks on a helper thread, so that a slow
+// read overlaps with the lexing of the chunk before it. Each chunk is copied
+// into one of two buffers, which are used in turn. The input is then free to
+// reuse its own buffer on the next read, while the chunk that was returned
+// before stays valid until the read after that one is finished. Only one read
+// is in flight at a time, and the caller doesn't touch the input while it is.
+
+#ifndef _WIN32
+
+struct InputPrefetcher {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t condition;
+  TSInput input;
+  Array(char) buffers[2];
+  unsigned next_buffer;
+  uint32_t size;
+  bool is_requested;
+  bool is_done;
+  bool is_pending;
+  bool should_exit;
+};
+
+static void *input_prefetcher__run(void *payload) {
+  InputPrefetcher *self = payload;
+  pthread_mutex_lock(&self->lock);
+  for (;;) {
+    while (!self->is_requested && !self->should_exit) {
+      pthread_cond_wait(&self->condition, &self->lock);
+    }
+    if (self->should_exit) break;
+    self->is_requested = false;
+    TSInput input = self->input;
+    pthread_mutex_unlock(&self->lock);
+
+    uint32_t size;
+    const char *text = input.read(input.payload, &size);
+    if (size != TS_INPUT_WOULD_BLOCK) {
+      unsigned index = self->next_buffer;
+      array_clear(&self->buffers[index]);
+      if (size > 0) array__splice((VoidArray *)&self->buffers[index], 1, 0, 0, size, (void *)text);
+    }
+
+    pthread_mutex_lock(&self->lock);
+    self->size = size;
+    self->is_done = true;
+    pthread_cond_broadcast(&self->condition);
+  }
+  pthread_mutex_unlock(&self->lock);
+  return NULL;
+}
+
+// Returns NULL if the helper thread can't be created, in which case the
+// caller reads the input itself.
+InputPrefetcher *input_prefetcher_new() {
+  InputPrefetcher *self = ts_calloc(1, sizeof(InputPrefetcher));
+  pthread_mutex_init(&self->lock, NULL);
+  pthread_cond_init(&self->condition, NULL);
+  if (pthread_create(&self->thread, NULL, input_prefetcher__run, self) != 0) {
+    pthread_cond_destroy(&self->condition);
+    pthread_mutex_destroy(&self->lock);
+    ts_free(self);
+    return NULL;
+  }
+  return self;
+}
+
+void input_prefetcher_delete(InputPrefetcher *self) {
+  if (!self) return;
+  input_prefetcher_discard(self);
+  pthread_mutex_lock(&self->lock);
+  self->should_exit = true;
+  pthread_cond_broadcast(&self->condition);
+  pthread_mutex_unlock(&self->lock);
+  pthread_join(self->thread, NULL);
+  pthread_cond_destroy(&self->condition);
+  pthread_mutex_destroy(&self->lock);
+  array_delete(&self->buffers[0]);
+  array_delete(&self->buffers[1]);
+  ts_free(self);
+}
+
+// Begin reading the input's next chunk.
+void input_prefetcher_start(InputPrefetcher *self, TSInput input) {
+  pthread_mutex_lock(&self->lock);
+  self->input = input;
+  self->is_requested = true;
+  self->is_done = false;
+  self->is_pending = true;
+  pthread_cond_broadcast(&self->condition);
+  pthread_mutex_unlock(&self->lock);
+}
+
+static uint32_t input_prefetcher__wait(InputPrefetcher *self) {
+  pthread_mutex_lock(&self->lock);
+  while (!self->is_done) pthread_cond_wait(&self->condition, &self->lock);
+  uint32_t result = self->size;
+  pthread_mutex_unlock(&self->lock);
+  self->is_pending = false;
+  return result;
+}
+
+// Wait for the read that was started, and return its text, which stays valid
+// until the next read is finished.
+const char *input_prefetcher_finish(InputPrefetcher *self, uint32_t *size) {
+  *size = input_prefetcher__wait(self);
+  if (*size == TS_INPUT_WOULD_BLOCK || *size == 0) return NULL;
+  const char *result = self->buffers[self->next_buffer].contents;
+  self->next_buffer = 1 - self->next_buffer;
+  return result;
+}
+
+// Wait for the read that was started, if any, and drop its text, leaving the
+// text that was returned before intact.
+void input_prefetcher_discard(InputPrefetcher *self) {
+  if (self->is_pending) input_prefetcher__wait(self);
+}
+
+bool input_prefetcher_is_pending(const InputPrefetcher *self) {
+  return self->is_pending;
+}
+
+#else
+
+InputPrefetcher *input_prefetcher_new() {
+  return NULL;
+}
+
+void input_prefetcher_delete(InputPrefetcher *self) {}
+
+void input_prefetcher_start(InputPrefetcher *self, TSInput input) {}
+
+const char *input_prefetcher_finish(InputPrefetcher *self, uint32_t *size) {
+  *size = 0;
+  return NULL;
+}
+
+void input_prefetcher_discard(InputPrefetcher *self) {}
+
+bool input_prefetcher_is_pending(const InputPrefetcher *self) {
+  return false;
+}
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef RUNTIME_INPUT_PREFETCHER_H_
+#define RUNTIME_INPUT_PREFETCHER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include "tree_sitter/runtime.h"
+
+typedef struct InputPrefetcher InputPrefetcher;
+
+InputPrefetcher *input_prefetcher_new();
+void input_prefetcher_delete(InputPrefetcher *);
+void input_prefetcher_start(InputPrefetcher *, TSInput);
+const char *input_prefetcher_finish(InputPrefetcher *, uint32_t *size);
+void input_prefetcher_discard(InputPrefetcher *);
+bool input_prefetcher_is_pending(const InputPrefetcher *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // RUNTIME_INPUT_PREFETCHER_H_
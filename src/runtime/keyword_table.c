@@ -0,0 +1,12 @@
+#include "runtime/keyword_table.h"
+#include <string.h>
+
+// Return the keyword with exactly the given text, or zero if there is none.
+TSSymbol ts_keyword_table_lookup(const TSKeywordTable *self, const char *string, uint32_t length) {
+  uint32_t hash = ts_keyword_table_hash(self->seed, string, length);
+  const TSKeyword *keyword = &self->slots[ts_keyword_table_slot(self, hash)];
+  if (keyword->symbol && keyword->length == length && memcmp(keyword->string, string, length) == 0) {
+    return keyword->symbol;
+  }
+  return 0;
+}
@@ -0,0 +1,37 @@
+#ifndef RUNTIME_KEYWORD_TABLE_H_
+#define RUNTIME_KEYWORD_TABLE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "tree_sitter/parser.h"
+
+// Keywords are looked up by hashing their UTF-8 text. The low bits of the
+// hash select a displacement, which is combined with the high bits of the
+// hash to find the slot where the keyword is stored. The displacements are
+// chosen when the table is generated, so that no two keywords share a slot.
+static inline uint32_t ts_keyword_table_hash(uint32_t seed, const char *string, uint32_t length) {
+  uint32_t hash = 2166136261u ^ seed;
+  for (uint32_t i = 0; i < length; i++) {
+    hash ^= (uint8_t)string[i];
+    hash *= 16777619u;
+  }
+  hash ^= hash >> 15;
+  hash *= 0x2c1b3c6du;
+  hash ^= hash >> 12;
+  return hash;
+}
+
+static inline uint32_t ts_keyword_table_slot(const TSKeywordTable *self, uint32_t hash) {
+  uint32_t displacement = self->displacements[hash & (self->displacement_count - 1)];
+  return ((hash >> 16) ^ displacement) & (self->slot_count - 1);
+}
+
+TSSymbol ts_keyword_table_lookup(const TSKeywordTable *, const char *, uint32_t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // RUNTIME_KEYWORD_TABLE_H_
@@ -1,6 +1,15 @@
 #include "runtime/language.h"
 #include "runtime/tree.h"
 #include "runtime/error_costs.h"
+#include "runtime/atomic.h"
+#include <stddef.h>
+#include <string.h>
+
+// Version 8 of the language ABI ended with the external scanner's
+// `deserialize` function. Every field that has been added since then is
+// optional, and is left zeroed when an older language is upgraded, so that the
+// runtime uses its general paths for that language.
+static const size_t LANGUAGE_VERSION_8_SIZE = offsetof(TSLanguage, external_scanner.equivalent);
 
 void ts_language_table_entry(const TSLanguage *self, TSStateId state,
                              TSSymbol symbol, TableEntry *result) {
@@ -10,8 +19,9 @@ void ts_language_table_entry(const TSLanguage *self, TSStateId state,
     result->actions = NULL;
   } else {
     assert(symbol < self->token_count);
-    uint32_t action_index = self->parse_table[state * self->symbol_count + symbol];
-    const TSParseActionEntry *entry = &self->parse_actions[action_index];
+    const TSParseActionEntry *entry = self->parse_actions_fn
+      ? self->parse_actions_fn(state, symbol)
+      : &self->parse_actions[ts_language_lookup(self, state, symbol)];
     result->action_count = entry->count;
     result->is_reusable = entry->reusable;
     result->actions = (const TSParseAction *)(entry + 1);
@@ -26,6 +36,44 @@ uint32_t ts_language_version(const TSLanguage *language) {
   return language->version;
 }
 
+bool ts_language_is_compatible(const TSLanguage *self) {
+  return
+    self->version >= TREE_SITTER_MIN_COMPATIBLE_LANGUAGE_VERSION &&
+    self->version <= TREE_SITTER_LANGUAGE_VERSION;
+}
+
+// Return the language itself if it has the current layout. Otherwise, copy the
+// fields that it has into the given struct, zero the rest, and return that.
+const TSLanguage *ts_language_upgrade(const TSLanguage *self, TSLanguage *result) {
+  if (self->version == TREE_SITTER_LANGUAGE_VERSION) return self;
+  memset(result, 0, sizeof(TSLanguage));
+  memcpy(result, self, LANGUAGE_VERSION_8_SIZE);
+  return result;
+}
+
+// The scanner's shared data is created by whichever thread first claims it.
+// Any others that need it in the meantime wait until it has been stored.
+static const void *ts_language__external_scanner_shared_data(const TSLanguage *self) {
+  TSExternalScannerSharedData *shared_data = self->external_scanner.shared_data;
+  if (atomic_compare_and_swap(&shared_data->state, 0, 1)) {
+    shared_data->data = self->external_scanner.create_shared();
+    atomic_compare_and_swap(&shared_data->state, 1, 2);
+  } else {
+    while (atomic_load(&shared_data->state) != 2) {}
+  }
+  return shared_data->data;
+}
+
+void *ts_language_create_external_scanner(const TSLanguage *self) {
+  if (self->external_scanner.create_with_shared) {
+    return self->external_scanner.create_with_shared(
+      ts_language__external_scanner_shared_data(self)
+    );
+  }
+  if (self->external_scanner.create) return self->external_scanner.create();
+  return NULL;
+}
+
 TSSymbolMetadata ts_language_symbol_metadata(const TSLanguage *language, TSSymbol symbol) {
   if (symbol == ts_builtin_sym_error)  {
     return (TSSymbolMetadata){.visible = true, .named = true};
@@ -46,6 +94,58 @@ const char *ts_language_symbol_name(const TSLanguage *language, TSSymbol symbol)
   }
 }
 
+// Compare a symbol's name to a string that isn't null-terminated.
+static inline int ts_language__compare_name(const char *symbol_name, const char *name,
+                                            uint32_t length) {
+  int result = strncmp(symbol_name, name, length);
+  if (result == 0 && symbol_name[length] != '\0') return 1;
+  return result;
+}
+
+static inline bool ts_language__is_symbol_for_name(const TSLanguage *self, TSSymbol symbol,
+                                                   bool is_named) {
+  TSSymbolMetadata metadata = ts_language_symbol_metadata(self, symbol);
+  return metadata.visible && metadata.named == is_named;
+}
+
+// Find the visible symbol with the given name and kind. If several symbols
+// match, such as a rule and an alias with the rule's name, the one with the
+// lowest number is returned. Generated languages list their symbols sorted by
+// name, and then by number, so that they can be searched; for other languages,
+// every symbol is checked. Returns zero if there is no such symbol.
+TSSymbol ts_language_symbol_for_name(const TSLanguage *self, const char *name,
+                                     uint32_t length, bool is_named) {
+  if (is_named && length == 5 && strncmp(name, "ERROR", 5) == 0) return ts_builtin_sym_error;
+
+  uint32_t count = ts_language_symbol_count(self);
+  if (self->version >= 9 && self->symbols_by_name) {
+    uint32_t start = 0, end = count;
+    while (start < end) {
+      uint32_t middle = start + (end - start) / 2;
+      TSSymbol symbol = self->symbols_by_name[middle];
+      if (ts_language__compare_name(self->symbol_names[symbol], name, length) < 0) {
+        start = middle + 1;
+      } else {
+        end = middle;
+      }
+    }
+
+    for (uint32_t i = start; i < count; i++) {
+      TSSymbol symbol = self->symbols_by_name[i];
+      if (ts_language__compare_name(self->symbol_names[symbol], name, length) != 0) break;
+      if (ts_language__is_symbol_for_name(self, symbol, is_named)) return symbol;
+    }
+    return 0;
+  }
+
+  for (uint32_t symbol = 0; symbol < count; symbol++) {
+    if (self->symbol_names[symbol] &&
+        ts_language__compare_name(self->symbol_names[symbol], name, length) == 0 &&
+        ts_language__is_symbol_for_name(self, symbol, is_named)) return symbol;
+  }
+  return 0;
+}
+
 TSSymbolType ts_language_symbol_type(const TSLanguage *language, TSSymbol symbol) {
   TSSymbolMetadata metadata = ts_language_symbol_metadata(language, symbol);
   if (metadata.named) {
@@ -7,6 +7,7 @@ extern "C" {
 
 #include "tree_sitter/parser.h"
 #include "runtime/tree.h"
+#include "runtime/lex_table.h"
 
 #define ts_builtin_sym_error_repeat (ts_builtin_sym_error - 1)
 
@@ -17,9 +18,100 @@ typedef struct {
 } TableEntry;
 
 void ts_language_table_entry(const TSLanguage *, TSStateId, TSSymbol, TableEntry *);
+bool ts_language_is_compatible(const TSLanguage *);
+const TSLanguage *ts_language_upgrade(const TSLanguage *, TSLanguage *);
+void *ts_language_create_external_scanner(const TSLanguage *);
+
+// Languages whose table values all fit in a byte store their parse tables
+// as bytes, in the same layout.
+static inline uint16_t ts_language__parse_table_cell(const TSLanguage *self, uint32_t index) {
+  if (self->byte_parse_table) return self->byte_parse_table[index];
+  return self->parse_table[index];
+}
+
+static inline uint16_t ts_language__small_parse_table_cell(const TSLanguage *self, uint32_t index) {
+  if (self->byte_small_parse_table) return self->byte_small_parse_table[index];
+  return self->small_parse_table[index];
+}
+
+static inline uint16_t ts_language_lookup(const TSLanguage *self,
+                                          TSStateId state,
+                                          TSSymbol symbol) {
+  if (state < self->large_state_count ||
+      (!self->small_parse_table && !self->byte_small_parse_table)) {
+    if (!self->parse_table_row_offsets) {
+      return ts_language__parse_table_cell(self, state * self->symbol_count + symbol);
+    }
+
+    // Narrow rows are stored one after another, each ending after the last
+    // symbol that the state uses.
+    uint32_t offset = self->parse_table_row_offsets[state];
+    if (symbol >= self->parse_table_row_offsets[state + 1] - offset) return 0;
+    return ts_language__parse_table_cell(self, offset + symbol);
+  }
+
+  // Small states are stored as a list of groups, each of which is a value
+  // followed by the symbols that map to that value.
+  uint32_t index = self->small_parse_table_map[state - self->large_state_count];
+  uint16_t group_count = ts_language__small_parse_table_cell(self, index++);
+  for (unsigned i = 0; i < group_count; i++) {
+    uint16_t value = ts_language__small_parse_table_cell(self, index++);
+    uint16_t symbol_count = ts_language__small_parse_table_cell(self, index++);
+    for (unsigned j = 0; j < symbol_count; j++) {
+      if (ts_language__small_parse_table_cell(self, index++) == symbol) return value;
+    }
+  }
+  return 0;
+}
 
 TSSymbolMetadata ts_language_symbol_metadata(const TSLanguage *, TSSymbol);
 
+// Languages whose states share few lex modes store each distinct mode once,
+// along with the index of each state's mode.
+static inline TSLexMode ts_language_lex_mode(const TSLanguage *self, TSStateId state) {
+  if (self->byte_lex_mode_ids) return self->lex_modes[self->byte_lex_mode_ids[state]];
+  if (self->lex_mode_ids) return self->lex_modes[self->lex_mode_ids[state]];
+  if (self->byte_lex_modes) {
+    return (TSLexMode){
+      .lex_state = self->byte_lex_modes[2 * state],
+      .external_lex_state = self->byte_lex_modes[2 * state + 1],
+    };
+  }
+  return self->lex_modes[state];
+}
+
+// Whether a token or a separator can begin with the given character in the
+// error state. Without a list of those characters, any character can.
+static inline bool ts_language_can_start_error_token(const TSLanguage *self, int32_t character) {
+  if (!self->error_start_characters || (uint32_t)character >= 128) return true;
+  return self->error_start_characters[character >> 5] & (1u << (character & 31));
+}
+
+// The set of symbols and aliases that can appear beneath a tree of the given
+// nonterminal symbol when the tree has no errors, with one bit per symbol.
+// Without the generated sets, or for trees that aren't of a nonterminal in the
+// grammar, such as errors, this returns NULL, because anything can.
+static inline const uint32_t *ts_language_descendant_symbols(const TSLanguage *self, TSSymbol symbol) {
+  if (!self->descendant_symbol_sets || symbol < self->token_count || symbol >= self->symbol_count) {
+    return NULL;
+  }
+  uint32_t word_count = (self->symbol_count + self->alias_count + 31) / 32;
+  return self->descendant_symbol_sets +
+    self->descendant_symbol_set_ids[symbol - self->token_count] * word_count;
+}
+
+// Languages that were loaded from a binary file have lex tables instead of
+// lex functions.
+static inline bool ts_language_lex(const TSLanguage *self, TSLexer *lexer, TSStateId state) {
+  if (self->lex_fn) return self->lex_fn(lexer, state);
+  return ts_lex_table_lex(self->lex_table, lexer, state);
+}
+
+static inline bool ts_language_lex_keyword(const TSLanguage *self, TSLexer *lexer) {
+  if (self->keyword_lex_fn) return self->keyword_lex_fn(lexer, 0);
+  return ts_lex_table_lex(self->keyword_lex_table, lexer, 0);
+}
+
 static inline bool ts_language_is_symbol_external(const TSLanguage *self, TSSymbol symbol) {
   return 0 < symbol && symbol < self->external_token_count + 1;
 }
@@ -56,6 +148,9 @@ static inline TSStateId ts_language_next_state(const TSLanguage *self,
   if (symbol == ts_builtin_sym_error || symbol == ts_builtin_sym_error_repeat) {
     return 0;
   } else if (symbol < self->token_count) {
+    if (self->parse_action_next_states) {
+      return self->parse_action_next_states[ts_language_lookup(self, state, symbol)];
+    }
     uint32_t count;
     const TSParseAction *actions = ts_language_actions(self, state, symbol, &count);
     if (count > 0) {
@@ -66,7 +161,7 @@ static inline TSStateId ts_language_next_state(const TSLanguage *self,
     }
     return 0;
   } else {
-    return self->parse_table[state * self->symbol_count + symbol];
+    return ts_language_lookup(self, state, symbol);
   }
 }
 
@@ -80,11 +175,18 @@ ts_language_enabled_external_tokens(const TSLanguage *self,
   }
 }
 
-static inline const TSSymbol *
-ts_language_alias_sequence(const TSLanguage *self, unsigned id) {
-  return id > 0 ?
-    self->alias_sequences + id * self->max_alias_sequence_length :
-    NULL;
+// Alias sequences are stored either as rows of `max_alias_sequence_length`
+// symbols, or as rows of their own lengths, one after another, each ending
+// after the sequence's last aliased child.
+static inline TSSymbol ts_language_alias_at(const TSLanguage *self, unsigned id, unsigned index) {
+  if (id == 0) return 0;
+  if (self->alias_sequence_offsets) {
+    uint32_t offset = self->alias_sequence_offsets[id];
+    if (index >= self->alias_sequence_offsets[id + 1] - offset) return 0;
+    return self->alias_sequences[offset + index];
+  }
+  if (index >= self->max_alias_sequence_length) return 0;
+  return self->alias_sequences[id * self->max_alias_sequence_length + index];
 }
 
 #ifdef __cplusplus
@@ -0,0 +1,240 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <string.h>
+#include "tree_sitter/runtime.h"
+#include "runtime/alloc.h"
+#include "runtime/array.h"
+#include "runtime/atomic.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A registry maps the names of languages, and the extensions of the files
+// that are written in them, to the ways in which the languages are loaded.
+// Nothing is loaded when a language is registered. Each language is loaded
+// the first time that it is looked up, by whichever thread looks it up first,
+// while any others that look it up in the meantime wait for it. The loaded
+// language is then shared by every later lookup. Binary languages that are
+// registered by path are mapped into memory rather than read, so that only
+// the pages of their tables that are used are loaded, and so that they are
+// shared with other processes that map the same files.
+
+typedef enum {
+  LanguageSourceFunction,
+  LanguageSourceBinary,
+  LanguageSourceBinaryFile,
+} LanguageSource;
+
+typedef struct {
+  char *name;
+  LanguageSource source;
+  const TSLanguage *(*function)(void);
+  const char *data;
+  uint32_t length;
+  char *path;
+  void *mapping;
+  size_t mapping_length;
+  const TSLanguage *language;
+  volatile uint32_t state;
+} LanguageRegistryEntry;
+
+typedef struct {
+  char *extension;
+  uint32_t entry_index;
+} LanguageRegistryExtension;
+
+struct TSLanguageRegistry {
+  Array(LanguageRegistryEntry) entries;
+  Array(LanguageRegistryExtension) extensions;
+};
+
+static char *language_registry__copy_string(const char *string) {
+  size_t length = strlen(string);
+  char *result = ts_malloc(length + 1);
+  memcpy(result, string, length + 1);
+  return result;
+}
+
+static LanguageRegistryEntry *language_registry__find(const TSLanguageRegistry *self,
+                                                      const char *name) {
+  for (uint32_t i = 0; i < self->entries.size; i++) {
+    LanguageRegistryEntry *entry = &self->entries.contents[i];
+    if (strcmp(entry->name, name) == 0) return entry;
+  }
+  return NULL;
+}
+
+static bool language_registry__add(TSLanguageRegistry *self, const char *name,
+                                   LanguageRegistryEntry entry) {
+  if (language_registry__find(self, name)) return false;
+  entry.name = language_registry__copy_string(name);
+  array_push(&self->entries, entry);
+  return true;
+}
+
+TSLanguageRegistry *ts_language_registry_new() {
+  TSLanguageRegistry *self = ts_malloc(sizeof(TSLanguageRegistry));
+  array_init(&self->entries);
+  array_init(&self->extensions);
+  return self;
+}
+
+void ts_language_registry_delete(TSLanguageRegistry *self) {
+  for (uint32_t i = 0; i < self->entries.size; i++) {
+    LanguageRegistryEntry *entry = &self->entries.contents[i];
+    if (entry->source != LanguageSourceFunction && entry->language) {
+      ts_language_delete(entry->language);
+    }
+#ifndef _WIN32
+    if (entry->mapping) munmap(entry->mapping, entry->mapping_length);
+#else
+    if (entry->mapping) ts_free(entry->mapping);
+#endif
+    if (entry->path) ts_free(entry->path);
+    ts_free(entry->name);
+  }
+  for (uint32_t i = 0; i < self->extensions.size; i++) {
+    ts_free(self->extensions.contents[i].extension);
+  }
+  array_delete(&self->entries);
+  array_delete(&self->extensions);
+  ts_free(self);
+}
+
+// Each of these returns false if a language with the same name has already
+// been registered. Languages are registered before the registry is shared
+// between threads.
+bool ts_language_registry_add_function(TSLanguageRegistry *self, const char *name,
+                                       const TSLanguage *(*function)(void)) {
+  return language_registry__add(self, name, (LanguageRegistryEntry){
+    .source = LanguageSourceFunction,
+    .function = function,
+  });
+}
+
+// The data isn't copied, so it must outlive the registry.
+bool ts_language_registry_add_binary(TSLanguageRegistry *self, const char *name,
+                                     const char *data, uint32_t length) {
+  return language_registry__add(self, name, (LanguageRegistryEntry){
+    .source = LanguageSourceBinary,
+    .data = data,
+    .length = length,
+  });
+}
+
+bool ts_language_registry_add_binary_file(TSLanguageRegistry *self, const char *name,
+                                          const char *path) {
+  return language_registry__add(self, name, (LanguageRegistryEntry){
+    .source = LanguageSourceBinaryFile,
+    .path = language_registry__copy_string(path),
+  });
+}
+
+// The extension is given without its leading dot. Returns false if the
+// language hasn't been registered.
+bool ts_language_registry_add_file_extension(TSLanguageRegistry *self, const char *name,
+                                             const char *extension) {
+  LanguageRegistryEntry *entry = language_registry__find(self, name);
+  if (!entry) return false;
+  array_push(&self->extensions, ((LanguageRegistryExtension){
+    .extension = language_registry__copy_string(extension),
+    .entry_index = entry - self->entries.contents,
+  }));
+  return true;
+}
+
+// The file's contents are used in place by the language, so the mapping is
+// kept until the registry is deleted. Languages are loaded from aligned
+// memory, which a mapping always is.
+static const TSLanguage *language_registry__load_file(LanguageRegistryEntry *entry) {
+#ifndef _WIN32
+  int fd = open(entry->path, O_RDONLY);
+  if (fd < 0) return NULL;
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0 || file_stat.st_size > UINT32_MAX) {
+    close(fd);
+    return NULL;
+  }
+  size_t length = file_stat.st_size;
+  void *mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) return NULL;
+#else
+  FILE *file = fopen(entry->path, "rb");
+  if (!file) return NULL;
+  fseek(file, 0, SEEK_END);
+  long file_size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  if (file_size <= 0 || (unsigned long)file_size > UINT32_MAX) {
+    fclose(file);
+    return NULL;
+  }
+  size_t length = file_size;
+  void *mapping = ts_malloc(length);
+  size_t read_length = fread(mapping, 1, length, file);
+  fclose(file);
+  if (read_length != length) {
+    ts_free(mapping);
+    return NULL;
+  }
+#endif
+
+  entry->mapping = mapping;
+  entry->mapping_length = length;
+  return ts_language_load(mapping, length);
+}
+
+static const TSLanguage *language_registry__load(LanguageRegistryEntry *entry) {
+  switch (entry->source) {
+    case LanguageSourceFunction:
+      return entry->function();
+    case LanguageSourceBinary:
+      return ts_language_load(entry->data, entry->length);
+    case LanguageSourceBinaryFile:
+      return language_registry__load_file(entry);
+  }
+  return NULL;
+}
+
+// Returns NULL if the language isn't registered, or if it couldn't be loaded,
+// in which case it isn't tried again.
+const TSLanguage *ts_language_registry_language(TSLanguageRegistry *self, const char *name) {
+  LanguageRegistryEntry *entry = language_registry__find(self, name);
+  if (!entry) return NULL;
+  if (atomic_load(&entry->state) == 2) return entry->language;
+  if (atomic_compare_and_swap(&entry->state, 0, 1)) {
+    entry->language = language_registry__load(entry);
+    atomic_compare_and_swap(&entry->state, 1, 2);
+  } else {
+    while (atomic_load(&entry->state) != 2) {}
+  }
+  return entry->language;
+}
+
+// The language is chosen by the extension of the path's last component, with
+// either forward or backward slashes separating the components. When several
+// languages have the same extension, the one that was registered for it first
+// is used.
+const TSLanguage *ts_language_registry_language_for_path(TSLanguageRegistry *self,
+                                                         const char *path) {
+  const char *file_name = strrchr(path, '/');
+  const char *backslash = strrchr(path, '\\');
+  if (backslash && (!file_name || backslash > file_name)) file_name = backslash;
+  file_name = file_name ? file_name + 1 : path;
+  const char *extension = strrchr(file_name, '.');
+  if (!extension) return NULL;
+  extension++;
+
+  for (uint32_t i = 0; i < self->extensions.size; i++) {
+    LanguageRegistryExtension *entry = &self->extensions.contents[i];
+    if (strcmp(entry->extension, extension) == 0) {
+      return ts_language_registry_language(self, self->entries.contents[entry->entry_index].name);
+    }
+  }
+  return NULL;
+}
@@ -0,0 +1,168 @@
+#include "runtime/leaf_index.h"
+
+void leaf_index_init(LeafIndex *self) {
+  array_init(&self->tokens);
+  self->has_dirty_range = false;
+  self->is_valid = false;
+}
+
+void leaf_index_delete(LeafIndex *self) {
+  if (self->tokens.contents) array_delete(&self->tokens);
+}
+
+void leaf_index_invalidate(LeafIndex *self) {
+  array_clear(&self->tokens);
+  self->has_dirty_range = false;
+  self->is_valid = false;
+}
+
+static void leaf_index__add_dirty_range(LeafIndex *self, uint32_t start, uint32_t end) {
+  if (self->has_dirty_range) {
+    if (start < self->dirty_start) self->dirty_start = start;
+    if (end > self->dirty_end) self->dirty_end = end;
+  } else {
+    self->dirty_start = start;
+    self->dirty_end = end;
+    self->has_dirty_range = true;
+  }
+}
+
+// The number of tokens that end at or before the given byte. Tokens don't
+// overlap, so their ends are in order, just like their starts.
+static uint32_t leaf_index__count_ending_before(const LeafIndex *self, uint32_t byte) {
+  uint32_t low = 0, high = self->tokens.size;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if (self->tokens.contents[mid].end_byte <= byte) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+static uint32_t leaf_index__count_starting_before(const LeafIndex *self, uint32_t byte) {
+  uint32_t low = 0, high = self->tokens.size;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if (self->tokens.contents[mid].start_byte < byte) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+// Positions inside the removed text are moved to the given position.
+static inline uint32_t leaf_index__map_position(uint32_t position, const TSInputEdit *edit,
+                                                uint32_t position_if_removed) {
+  uint32_t old_end = edit->start_byte + edit->bytes_removed;
+  if (position <= edit->start_byte) return position;
+  if (position >= old_end) return position - old_end + edit->start_byte + edit->bytes_added;
+  return position_if_removed;
+}
+
+// The tokens that overlap the edit are moved to its edges, which keeps the
+// tokens in order, and are replaced once the dirty range is walked again.
+void leaf_index_edit(LeafIndex *self, const TSInputEdit *edit) {
+  if (!self->is_valid) return;
+
+  uint32_t start_byte = edit->start_byte;
+  uint32_t inserted_end = start_byte + edit->bytes_added;
+  for (uint32_t i = leaf_index__count_ending_before(self, start_byte); i < self->tokens.size; i++) {
+    TSToken *token = &self->tokens.contents[i];
+    token->start_byte = leaf_index__map_position(token->start_byte, edit, start_byte);
+    token->end_byte = leaf_index__map_position(token->end_byte, edit, inserted_end);
+  }
+
+  if (self->has_dirty_range) {
+    self->dirty_start = leaf_index__map_position(self->dirty_start, edit, start_byte);
+    if (self->dirty_end != UINT32_MAX) {
+      self->dirty_end = leaf_index__map_position(self->dirty_end, edit, inserted_end);
+    }
+  }
+  leaf_index__add_dirty_range(self, start_byte, inserted_end);
+}
+
+// A parse that reused the previous tree creates new trees only where the
+// input changed, and those trees belong to the parse's generation. The
+// tokens among them are found by descending only into the trees of that
+// generation.
+void leaf_index_mark_parsed(LeafIndex *self, const Tree *root, uint32_t generation) {
+  if (!self->is_valid || !root) return;
+
+  typedef struct {
+    const Tree *tree;
+    uint32_t position;
+  } Entry;
+
+  Array(Entry) stack = array_new();
+  array_push(&stack, ((Entry){root, 0}));
+  while (stack.size > 0) {
+    Entry entry = array_pop(&stack);
+    const Tree *tree = entry.tree;
+    if (tree->generation < generation) continue;
+    if (tree->children.size == 0) {
+      uint32_t start_byte = entry.position + tree->padding.bytes;
+      leaf_index__add_dirty_range(self, start_byte, start_byte + tree->size.bytes);
+      continue;
+    }
+
+    uint32_t position = entry.position;
+    for (uint32_t i = 0; i < tree->children.size; i++) {
+      const Tree *child = tree->children.contents[i];
+      array_push(&stack, ((Entry){child, position}));
+      position += ts_tree_total_bytes(child);
+    }
+  }
+  array_delete(&stack);
+}
+
+// Replace the tokens that overlap the dirty range, along with the tokens of
+// the tree that lie between the closest tokens that are kept. While the tree
+// still has edits that haven't been parsed, the range stays dirty, so that
+// the tokens are replaced again once they have been.
+void leaf_index_update(LeafIndex *self, TSNode root, bool is_final) {
+  if (self->is_valid && !self->has_dirty_range) return;
+
+  uint32_t first_replaced = 0, first_kept = 0;
+  uint32_t start_byte = 0, end_byte = UINT32_MAX;
+  if (self->is_valid) {
+    first_replaced = leaf_index__count_ending_before(self, self->dirty_start);
+    first_kept = leaf_index__count_starting_before(self, self->dirty_end);
+    if (first_kept < first_replaced) first_kept = first_replaced;
+    if (first_replaced > 0) start_byte = self->tokens.contents[first_replaced - 1].end_byte;
+    if (first_kept < self->tokens.size) end_byte = self->tokens.contents[first_kept].start_byte;
+  } else {
+    array_clear(&self->tokens);
+  }
+
+  Array(TSToken) tokens = array_new();
+  if (root.data) {
+    TSTokenIterator *iterator = ts_token_iterator_new(root, start_byte, end_byte);
+    TSToken token;
+    while (ts_token_iterator_next(iterator, &token)) {
+      if (token.start_byte < start_byte) continue;
+      if (token.start_byte == end_byte && token.end_byte == end_byte) break;
+      array_push(&tokens, token);
+    }
+    ts_token_iterator_delete(iterator);
+  }
+  array_splice(&self->tokens, first_replaced, first_kept - first_replaced, &tokens);
+  array_delete(&tokens);
+
+  self->is_valid = true;
+  if (is_final) self->has_dirty_range = false;
+}
+
+// The token that contains the given byte, or a missing token that is empty
+// and lies at the byte.
+const TSToken *leaf_index_token_for_byte(const LeafIndex *self, uint32_t byte) {
+  uint32_t index = leaf_index__count_ending_before(self, byte);
+  if (index == self->tokens.size) return NULL;
+  const TSToken *token = &self->tokens.contents[index];
+  if (token->start_byte > byte) return NULL;
+  return token;
+}
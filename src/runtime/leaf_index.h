@@ -0,0 +1,38 @@
+#ifndef RUNTIME_LEAF_INDEX_H_
+#define RUNTIME_LEAF_INDEX_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include "tree_sitter/runtime.h"
+#include "runtime/array.h"
+#include "runtime/tree.h"
+
+// The tokens of a document's tree, in document order, for finding the token
+// at a position with a binary search. Like the line index, it is only built
+// when it is first used. Edits shift the tokens after them, and mark the text
+// around them as dirty, as does each parse, for the tokens that it created.
+// The next lookup walks the tree again only within the dirty range.
+typedef struct {
+  Array(TSToken) tokens;
+  uint32_t dirty_start;
+  uint32_t dirty_end;
+  bool has_dirty_range;
+  bool is_valid;
+} LeafIndex;
+
+void leaf_index_init(LeafIndex *);
+void leaf_index_delete(LeafIndex *);
+void leaf_index_invalidate(LeafIndex *);
+void leaf_index_edit(LeafIndex *, const TSInputEdit *);
+void leaf_index_mark_parsed(LeafIndex *, const Tree *, uint32_t generation);
+void leaf_index_update(LeafIndex *, TSNode root, bool is_final);
+const TSToken *leaf_index_token_for_byte(const LeafIndex *, uint32_t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // RUNTIME_LEAF_INDEX_H_
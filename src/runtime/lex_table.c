@@ -0,0 +1,41 @@
+#include "runtime/lex_table.h"
+
+// Characters are first mapped to classes of characters on which every lex
+// state behaves the same way. ASCII characters are looked up directly, and
+// all others are found by a binary search of the ranges of characters that
+// belong to the same class. The first range starts at INT32_MIN.
+static inline uint16_t ts_lex_table__character_class(const TSLexTable *self, int32_t lookahead) {
+  if (lookahead >= 0 && lookahead < 128) return self->ascii_classes[lookahead];
+  uint32_t start = 0, end = self->range_count;
+  while (end - start > 1) {
+    uint32_t middle = start + (end - start) / 2;
+    if (self->range_starts[middle] <= lookahead) {
+      start = middle;
+    } else {
+      end = middle;
+    }
+  }
+  return self->range_classes[start];
+}
+
+// This is the same state machine as the one in a generated lex function, with
+// each state's transitions stored as a row of the table, indexed by class.
+bool ts_lex_table_lex(const TSLexTable *self, TSLexer *lexer, TSStateId state) {
+  if (state >= self->state_count) return false;
+
+  bool result = false;
+  for (;;) {
+    uint16_t accept_symbol = self->accept_symbols[state];
+    if (accept_symbol) {
+      result = true;
+      lexer->result_symbol = accept_symbol - 1;
+      lexer->mark_end(lexer);
+    }
+
+    uint16_t character_class = ts_lex_table__character_class(self, lexer->lookahead);
+    uint16_t entry = self->transitions[self->row_offsets[state] + character_class];
+    if (!entry) return result;
+    lexer->advance(lexer, entry & 1);
+    state = (entry >> 1) - 1;
+  }
+}
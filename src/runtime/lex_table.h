@@ -0,0 +1,22 @@
+#ifndef RUNTIME_LEX_TABLE_H_
+#define RUNTIME_LEX_TABLE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "tree_sitter/parser.h"
+
+// Each entry of a lex table's transition rows is either zero, for no
+// transition, or the next state plus one, shifted left by one bit, with the
+// low bit set if the character is skipped rather than added to the token.
+#define TS_LEX_TABLE_ENTRY(state, skip) ((uint16_t)((((state) + 1) << 1) | ((skip) ? 1 : 0)))
+#define TS_LEX_TABLE_MAX_STATE_COUNT 0x7FFE
+
+bool ts_lex_table_lex(const TSLexTable *, TSLexer *, TSStateId);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // RUNTIME_LEX_TABLE_H_
@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <string.h>
+#include "runtime/alloc.h"
 #include "runtime/lexer.h"
 #include "runtime/tree.h"
 #include "runtime/length.h"
@@ -15,23 +17,223 @@
   LOG(character < 255 ? message " character:'%c'" : message " character:%d", character)
 
 static const char empty_chunk[2] = { 0, 0 };
+static const uint32_t RUN_BLOCK_SIZE = 256;
+static const uint64_t TEXT_HASH_SEED = 0xcbf29ce484222325ull;
+
+static TSRange WHOLE_DOCUMENT_RANGE = {
+  .start = {0, 0},
+  .end = {UINT32_MAX, UINT32_MAX},
+  .start_byte = 0,
+  .end_byte = UINT32_MAX,
+};
+
+// Find the first included range that ends after the given byte. The ranges
+// are sorted and don't overlap, so their ends are sorted as well.
+static uint32_t ts_lexer__find_included_range(const Lexer *self, uint32_t byte) {
+  uint32_t low = 0, high = self->included_range_count;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if (self->included_ranges[mid].end_byte <= byte) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+// Move a position that has reached the end of an included range, or that is
+// in a gap between two ranges, to the start of the next range, so that the
+// text in the gaps is never read. Return whether the position was moved.
+static bool ts_lexer__skip_gaps(const Lexer *self, uint32_t *range_index, Length *position) {
+  bool moved = false;
+  while (*range_index < self->included_range_count) {
+    const TSRange *range = &self->included_ranges[*range_index];
+    if (position->bytes >= range->end_byte) {
+      (*range_index)++;
+    } else if (position->bytes < range->start_byte) {
+      *position = (Length){range->start_byte, range->start};
+      moved = true;
+    } else {
+      break;
+    }
+  }
+  return moved;
+}
+
+// With an input window, the text that the lexer reads is copied into a buffer
+// that holds up to the window size of the text before the end of the most
+// recent chunk, and the whole buffer is used as the lexer's chunk. Resets to
+// positions within the window then don't call back into the input, so neither
+// do the re-lexes of the stack versions that lag behind, nor the re-lexes that
+// happen during error recovery, even when the input's chunks are small.
+static void ts_lexer__fill_window(Lexer *self) {
+  TSInput input = self->input;
+  uint32_t position = self->current_position.bytes;
+  uint32_t window_end = self->window_start + self->window.size;
+
+  if (position < self->window_start || position >= window_end) {
+    if (self->window.size > 0 && position == window_end) {
+      uint32_t kept_size = self->window.size;
+      if (kept_size > self->max_window_size) kept_size = self->max_window_size;
+      memmove(self->window.contents, self->window.contents + self->window.size - kept_size, kept_size);
+      self->window.size = kept_size;
+      self->window_start = position - kept_size;
+    } else {
+      input.seek(input.payload, position, self->current_position.extent);
+      array_clear(&self->window);
+      self->window_start = position;
+    }
+
+    uint32_t size;
+    const char *chunk = input.read(input.payload, &size);
+    if (size == TS_INPUT_WOULD_BLOCK) {
+      self->did_block = true;
+    } else if (size > 0) {
+      array__splice((VoidArray *)&self->window, 1, self->window.size, 0, size, (void *)chunk);
+    }
+  }
+
+  if (self->window_start + self->window.size > position) {
+    self->chunk_start = self->window_start;
+    self->chunk = self->window.contents;
+    self->chunk_size = self->window.size;
+  } else {
+    self->chunk_start = position;
+    self->chunk = empty_chunk;
+    self->chunk_size = 0;
+  }
+  self->run_start = position;
+  self->run_end = position;
+}
+
+// With prefetching, the chunk after the current one is read on a helper
+// thread while the current one is lexed. When the lexer needs some other
+// chunk, the read that is in flight is dropped, and the input is read again
+// from the lexer's position. The input's own position is tracked, so that it
+// is only sought when it isn't already there.
+static void ts_lexer__get_prefetched_chunk(Lexer *self) {
+  TSInput input = self->input;
+  uint32_t position = self->current_position.bytes;
+  if (!input_prefetcher_is_pending(self->prefetcher) || self->prefetch_byte != position) {
+    if (input_prefetcher_is_pending(self->prefetcher)) {
+      input_prefetcher_discard(self->prefetcher);
+      self->input_byte = UINT32_MAX;
+    }
+    if (self->input_byte != position) {
+      input.seek(input.payload, position, self->current_position.extent);
+    }
+    self->prefetch_byte = position;
+    input_prefetcher_start(self->prefetcher, input);
+  }
+
+  self->chunk_start = position;
+  self->chunk = input_prefetcher_finish(self->prefetcher, &self->chunk_size);
+  if (self->chunk_size == TS_INPUT_WOULD_BLOCK) {
+    self->did_block = true;
+    self->chunk_size = 0;
+  }
+  self->input_byte = position + self->chunk_size;
+  if (self->chunk_size) {
+    self->prefetch_byte = self->input_byte;
+    input_prefetcher_start(self->prefetcher, input);
+  } else {
+    self->chunk = empty_chunk;
+  }
+  self->run_start = self->chunk_start;
+  self->run_end = self->chunk_start;
+}
 
 static void ts_lexer__get_chunk(Lexer *self) {
   TSInput input = self->input;
+  if (self->current_included_range_index >= self->included_range_count) {
+    self->chunk_start = self->current_position.bytes;
+    self->chunk = empty_chunk;
+    self->chunk_size = 0;
+    self->run_start = self->chunk_start;
+    self->run_end = self->chunk_start;
+    return;
+  }
+
+  if (self->max_window_size > 0) {
+    ts_lexer__fill_window(self);
+    return;
+  }
+
+  if (self->prefetcher) {
+    ts_lexer__get_prefetched_chunk(self);
+    return;
+  }
+
   if (!self->chunk ||
       self->current_position.bytes != self->chunk_start + self->chunk_size) {
     input.seek(input.payload, self->current_position.bytes, self->current_position.extent);
   }
 
+  // Input that isn't available yet is read as the end of the input, and the
+  // lexer remembers that it was cut short, so that the parser can discard the
+  // token and resume later.
   self->chunk_start = self->current_position.bytes;
   self->chunk = input.read(input.payload, &self->chunk_size);
+  if (self->chunk_size == TS_INPUT_WOULD_BLOCK) {
+    self->did_block = true;
+    self->chunk_size = 0;
+  }
   if (!self->chunk_size) self->chunk = empty_chunk;
+  self->run_start = self->chunk_start;
+  self->run_end = self->chunk_start;
+}
+
+static inline uint32_t ts_lexer__unit_size(const Lexer *self) {
+  return self->input.encoding == TSInputEncodingUTF8 ? 1 : 2;
+}
+
+static inline int32_t ts_lexer__read_unit(const Lexer *self, const uint8_t *chunk) {
+  if (self->input.encoding == TSInputEncodingUTF8) return *chunk;
+  uint16_t unit;
+  memcpy(&unit, chunk, sizeof(unit));
+  return unit;
+}
+
+// Find how many of the upcoming bytes in the chunk consist of characters that
+// are a single code unit - plain ASCII in UTF-8, or anything other than a
+// surrogate pair in UTF-16 - so that they can be read without being decoded.
+static void ts_lexer__scan_run(Lexer *self, const uint8_t *chunk, uint32_t size) {
+  uint32_t limit = size < RUN_BLOCK_SIZE ? size : RUN_BLOCK_SIZE;
+  uint32_t i = 0;
+  if (self->input.encoding == TSInputEncodingUTF8) {
+    while (i + sizeof(uint64_t) <= limit) {
+      uint64_t word;
+      memcpy(&word, chunk + i, sizeof(word));
+      if (word & 0x8080808080808080ull) break;
+      i += sizeof(word);
+    }
+    while (i < limit && chunk[i] < 0x80) i++;
+  } else {
+    i = utf16_scan_non_surrogates(chunk, limit);
+  }
+  self->run_start = self->current_position.bytes;
+  self->run_end = self->current_position.bytes + i;
 }
 
 static void ts_lexer__get_lookahead(Lexer *self) {
   uint32_t position_in_chunk = self->current_position.bytes - self->chunk_start;
   const uint8_t *chunk = (const uint8_t *)self->chunk + position_in_chunk;
+
+  if (self->current_position.bytes < self->run_end) {
+    self->lookahead_size = ts_lexer__unit_size(self);
+    self->data.lookahead = ts_lexer__read_unit(self, chunk);
+    return;
+  }
+
+  // Characters are never read past the end of the current included range.
   uint32_t size = self->chunk_size - position_in_chunk;
+  if (self->current_included_range_index < self->included_range_count) {
+    uint32_t end_byte = self->included_ranges[self->current_included_range_index].end_byte;
+    if (end_byte - self->current_position.bytes < size) size = end_byte - self->current_position.bytes;
+  } else {
+    size = 0;
+  }
 
   if (size == 0) {
     self->lookahead_size = 1;
@@ -39,6 +241,13 @@ static void ts_lexer__get_lookahead(Lexer *self) {
     return;
   }
 
+  ts_lexer__scan_run(self, chunk, size);
+  if (self->current_position.bytes < self->run_end) {
+    self->lookahead_size = ts_lexer__unit_size(self);
+    self->data.lookahead = ts_lexer__read_unit(self, chunk);
+    return;
+  }
+
   if (self->input.encoding == TSInputEncodingUTF8) {
     int64_t lookahead_size = utf8proc_iterate(chunk, size, &self->data.lookahead);
     if (lookahead_size < 0) {
@@ -52,29 +261,200 @@ static void ts_lexer__get_lookahead(Lexer *self) {
   }
 }
 
+// The column isn't known after skipping a gap, unless the next range starts
+// at the beginning of a line.
+static inline void ts_lexer__skip_gap_if_needed(Lexer *self) {
+  uint32_t range_index = self->current_included_range_index;
+  if (range_index < self->included_range_count &&
+      self->current_position.bytes < self->included_ranges[range_index].end_byte) return;
+  if (ts_lexer__skip_gaps(self, &self->current_included_range_index, &self->current_position)) {
+    self->column = 0;
+    self->column_is_valid = self->current_position.extent.column == 0;
+  }
+}
+
+// The characters of the current token are hashed as they are consumed, and
+// the hash is recorded along with the token's end, for the token's fingerprint.
+static inline uint64_t ts_lexer__hash_character(uint64_t hash, int32_t character) {
+  return (hash ^ (uint32_t)character) * 0x100000001b3ull;
+}
+
 static void ts_lexer__advance(void *payload, bool skip) {
   Lexer *self = (Lexer *)payload;
   if (self->chunk == empty_chunk)
     return;
 
   if (self->lookahead_size) {
+    self->text_hash = ts_lexer__hash_character(self->text_hash, self->data.lookahead);
     self->current_position.bytes += self->lookahead_size;
     if (self->data.lookahead == '\n') {
       self->current_position.extent.row++;
       self->current_position.extent.column = 0;
+      self->column = 0;
+      self->column_is_valid = true;
     } else {
       self->current_position.extent.column += self->lookahead_size;
+      self->column++;
     }
   }
 
+  ts_lexer__skip_gap_if_needed(self);
+
   if (skip) {
     LOG_CHARACTER("skip", self->data.lookahead);
     self->token_start_position = self->current_position;
+    self->text_hash = TEXT_HASH_SEED;
   } else {
     LOG_CHARACTER("consume", self->data.lookahead);
   }
 
-  if (self->current_position.bytes >= self->chunk_start + self->chunk_size)
+  if (self->current_included_range_index >= self->included_range_count ||
+      self->current_position.bytes >= self->chunk_start + self->chunk_size)
+    ts_lexer__get_chunk(self);
+
+  ts_lexer__get_lookahead(self);
+}
+
+static inline bool ts_lexer__in_class(const uint32_t *character_class, int32_t c) {
+  return c > 0 && c < 128 && (character_class[c >> 5] & (1u << (c & 31)));
+}
+
+// Advance past the lookahead character and every following character that
+// belongs to the given ASCII character class. Within a run of single-unit
+// characters, the characters are consumed directly from the chunk.
+static void ts_lexer__advance_while(void *payload, const uint32_t *character_class, bool skip) {
+  Lexer *self = (Lexer *)payload;
+  ts_lexer__advance(self, skip);
+
+  while (ts_lexer__in_class(character_class, self->data.lookahead)) {
+    if (self->logger.log || self->current_position.bytes >= self->run_end) {
+      ts_lexer__advance(self, skip);
+      continue;
+    }
+
+    uint32_t position_in_chunk = self->current_position.bytes - self->chunk_start;
+    const uint8_t *chunk = (const uint8_t *)self->chunk + position_in_chunk;
+    uint32_t size = self->run_end - self->current_position.bytes;
+    uint32_t unit_size = ts_lexer__unit_size(self);
+    Length position = self->current_position;
+    uint32_t column = self->column;
+    bool column_is_valid = self->column_is_valid;
+    uint64_t text_hash = self->text_hash;
+
+    uint32_t i = 0;
+    while (i < size) {
+      int32_t unit = ts_lexer__read_unit(self, chunk + i);
+      if (!ts_lexer__in_class(character_class, unit)) break;
+      if (unit == '\n') {
+        position.extent.row++;
+        position.extent.column = 0;
+        column = 0;
+        column_is_valid = true;
+      } else {
+        position.extent.column += unit_size;
+        column++;
+      }
+      text_hash = ts_lexer__hash_character(text_hash, unit);
+      i += unit_size;
+    }
+
+    position.bytes += i;
+    self->current_position = position;
+    self->column = column;
+    self->column_is_valid = column_is_valid;
+    self->text_hash = skip ? TEXT_HASH_SEED : text_hash;
+    ts_lexer__skip_gap_if_needed(self);
+    if (skip) self->token_start_position = self->current_position;
+
+    if (self->current_included_range_index >= self->included_range_count ||
+        self->current_position.bytes >= self->chunk_start + self->chunk_size)
+      ts_lexer__get_chunk(self);
+
+    ts_lexer__get_lookahead(self);
+  }
+}
+
+// The rest of the text that can be read without calling back into the input:
+// the remainder of the current chunk, up to the end of the current included
+// range. The first character is the lookahead character.
+static const char *ts_lexer__peek(void *payload, uint32_t *length) {
+  Lexer *self = (Lexer *)payload;
+  *length = 0;
+  if (!self->chunk || self->chunk == empty_chunk ||
+      self->current_included_range_index >= self->included_range_count) return empty_chunk;
+
+  uint32_t position_in_chunk = self->current_position.bytes - self->chunk_start;
+  if (position_in_chunk >= self->chunk_size) return empty_chunk;
+  uint32_t size = self->chunk_size - position_in_chunk;
+  uint32_t end_byte = self->included_ranges[self->current_included_range_index].end_byte;
+  if (end_byte - self->current_position.bytes < size) size = end_byte - self->current_position.bytes;
+  *length = size;
+  return self->chunk + position_in_chunk;
+}
+
+// Advance past the given number of bytes, which must be within the text that
+// `peek` returns and must end on a character boundary. The characters are
+// decoded and counted in a single pass over the chunk, rather than with a call
+// to `advance` for each of them.
+static void ts_lexer__advance_bytes(void *payload, uint32_t count, bool skip) {
+  Lexer *self = (Lexer *)payload;
+  uint32_t end_byte = self->current_position.bytes + count;
+  if (self->logger.log) {
+    while (self->current_position.bytes < end_byte && self->chunk != empty_chunk) {
+      ts_lexer__advance(self, skip);
+    }
+    return;
+  }
+
+  uint32_t length;
+  const uint8_t *chunk = (const uint8_t *)ts_lexer__peek(self, &length);
+  if (count > length) count = length;
+  if (count == 0) return;
+
+  Length position = self->current_position;
+  uint32_t column = self->column;
+  bool column_is_valid = self->column_is_valid;
+  uint64_t text_hash = self->text_hash;
+
+  uint32_t i = 0;
+  while (i < count) {
+    int32_t character;
+    uint32_t size;
+    if (self->input.encoding == TSInputEncodingUTF8) {
+      if (chunk[i] < 0x80) {
+        character = chunk[i];
+        size = 1;
+      } else {
+        int64_t result = utf8proc_iterate(chunk + i, count - i, &character);
+        size = result < 0 ? 1 : result;
+      }
+    } else {
+      size = utf16_iterate(chunk + i, count - i, &character);
+    }
+
+    if (character == '\n') {
+      position.extent.row++;
+      position.extent.column = 0;
+      column = 0;
+      column_is_valid = true;
+    } else {
+      position.extent.column += size;
+      column++;
+    }
+    text_hash = ts_lexer__hash_character(text_hash, character);
+    i += size;
+  }
+
+  position.bytes += i;
+  self->current_position = position;
+  self->column = column;
+  self->column_is_valid = column_is_valid;
+  self->text_hash = skip ? TEXT_HASH_SEED : text_hash;
+  ts_lexer__skip_gap_if_needed(self);
+  if (skip) self->token_start_position = self->current_position;
+
+  if (self->current_included_range_index >= self->included_range_count ||
+      self->current_position.bytes >= self->chunk_start + self->chunk_size)
     ts_lexer__get_chunk(self);
 
   ts_lexer__get_lookahead(self);
@@ -83,31 +463,57 @@ static void ts_lexer__advance(void *payload, bool skip) {
 static void ts_lexer__mark_end(void *payload) {
   Lexer *self = (Lexer *)payload;
   self->token_end_position = self->current_position;
+  self->token_end_text_hash = self->text_hash;
 }
 
 static uint32_t ts_lexer__get_column(void *payload) {
   Lexer *self = (Lexer *)payload;
+  if (self->column_is_valid) return self->column;
+
+  // The column counts all of the characters since the start of the line,
+  // including any that are in the gaps between the included ranges, so the
+  // ranges are set aside while the line is rescanned.
+  TSRange *included_ranges = self->included_ranges;
+  uint32_t included_range_count = self->included_range_count;
+  uint32_t current_included_range_index = self->current_included_range_index;
+  self->included_ranges = &WHOLE_DOCUMENT_RANGE;
+  self->included_range_count = 1;
+  self->current_included_range_index = 0;
+
   uint32_t goal_byte = self->current_position.bytes;
+  self->column_rescan_count++;
+  self->column_rescan_byte_count += self->current_position.extent.column;
 
   self->current_position.bytes -= self->current_position.extent.column;
   self->current_position.extent.column = 0;
+  self->run_start = self->current_position.bytes;
+  self->run_end = self->current_position.bytes;
 
   if (self->current_position.bytes < self->chunk_start) {
     ts_lexer__get_chunk(self);
   }
+  ts_lexer__get_lookahead(self);
 
-  uint32_t result = 0;
+  self->column = 0;
+  self->column_is_valid = true;
   while (self->current_position.bytes < goal_byte) {
     ts_lexer__advance(self, false);
-    result++;
   }
 
-  return result;
+  self->included_ranges = included_ranges;
+  self->included_range_count = included_range_count;
+  self->current_included_range_index = current_included_range_index;
+  self->run_start = self->current_position.bytes;
+  self->run_end = self->current_position.bytes;
+  if (current_included_range_index >= included_range_count) ts_lexer__get_chunk(self);
+  ts_lexer__get_lookahead(self);
+
+  return self->column;
 }
 
 /*
- *  The lexer's advance method is stored as a struct field so that generated
- *  parsers can call it without needing to be linked against this library.
+ *  The lexer's advance methods are stored as struct fields so that generated
+ *  parsers can call them without needing to be linked against this library.
  */
 
 void ts_lexer_init(Lexer *self) {
@@ -118,6 +524,9 @@ void ts_lexer_init(Lexer *self) {
       .get_column = ts_lexer__get_column,
       .lookahead = 0,
       .result_symbol = 0,
+      .advance_while = ts_lexer__advance_while,
+      .peek = ts_lexer__peek,
+      .advance_bytes = ts_lexer__advance_bytes,
     },
     .chunk = NULL,
     .chunk_start = 0,
@@ -125,34 +534,138 @@ void ts_lexer_init(Lexer *self) {
       .payload = NULL,
       .log = NULL
     },
+    .included_ranges = NULL,
+    .included_range_count = 0,
   };
-  ts_lexer_reset(self, length_zero());
+  ts_lexer_set_included_ranges(self, NULL, 0);
+}
+
+void ts_lexer_delete(Lexer *self) {
+  input_prefetcher_delete(self->prefetcher);
+  self->prefetcher = NULL;
+  array_delete(&self->window);
+  ts_free(self->included_ranges);
+  self->included_ranges = NULL;
+  self->included_range_count = 0;
+}
+
+// The lexer is often reset to the position where it last started lexing: once
+// for each stack version at that position, and again after a failed external
+// scan or when switching to the error state's lex mode. As long as the chunk
+// still covers that position, the lookahead that was decoded there is reused.
+static inline bool ts_lexer__restore_start_state(Lexer *self, Length position) {
+  const LexerStartState *state = &self->start_state;
+  if (!state->is_valid || position.bytes != state->byte || !self->chunk ||
+      position.bytes < self->chunk_start ||
+      position.bytes >= self->chunk_start + self->chunk_size) return false;
+
+  self->current_included_range_index = state->included_range_index;
+  self->column = state->column;
+  self->column_is_valid = state->column_is_valid;
+  self->token_start_position = position;
+  self->token_end_position = LENGTH_UNDEFINED;
+  self->current_position = position;
+  if (position.bytes < self->run_start || position.bytes >= self->run_end) {
+    self->run_start = position.bytes;
+    self->run_end = position.bytes;
+  }
+  self->lookahead_size = state->lookahead_size;
+  self->data.lookahead = state->lookahead;
+  return true;
 }
 
 static inline void ts_lexer__reset(Lexer *self, Length position) {
+  if (ts_lexer__restore_start_state(self, position)) return;
+
+  self->current_included_range_index = ts_lexer__find_included_range(self, position.bytes);
+  ts_lexer__skip_gaps(self, &self->current_included_range_index, &position);
+
+  // The column is known without rescanning if the position is at the start
+  // of a line, or if the whole line up to the position is known to consist of
+  // single-unit characters.
+  uint32_t line_start = position.bytes - position.extent.column;
+  if (position.extent.column == 0) {
+    self->column = 0;
+    self->column_is_valid = true;
+  } else if (line_start >= self->run_start && position.bytes <= self->run_end) {
+    self->column = position.extent.column / ts_lexer__unit_size(self);
+    self->column_is_valid = true;
+  } else {
+    self->column_is_valid = false;
+  }
+
   self->token_start_position = position;
   self->token_end_position = LENGTH_UNDEFINED;
   self->current_position = position;
 
   if (self->chunk && (position.bytes < self->chunk_start ||
-                      position.bytes >= self->chunk_start + self->chunk_size)) {
+                      position.bytes >= self->chunk_start + self->chunk_size ||
+                      self->current_included_range_index >= self->included_range_count)) {
     self->chunk = 0;
     self->chunk_start = 0;
     self->chunk_size = 0;
   }
 
+  if (position.bytes < self->run_start || position.bytes >= self->run_end) {
+    self->run_start = position.bytes;
+    self->run_end = position.bytes;
+  }
+
   self->lookahead_size = 0;
   self->data.lookahead = 0;
 }
 
 void ts_lexer_set_input(Lexer *self, TSInput input) {
+  ts_lexer_stop_prefetch(self);
   self->input = input;
+  self->did_block = false;
+  self->start_state.is_valid = false;
+  array_clear(&self->window);
+  self->window_start = 0;
   self->chunk = 0;
   self->chunk_start = 0;
   self->chunk_size = 0;
+  self->run_start = 0;
+  self->run_end = 0;
   ts_lexer__reset(self, length_zero());
 }
 
+// With no ranges, the whole document is included. The ranges must be sorted
+// and must not overlap.
+void ts_lexer_set_included_ranges(Lexer *self, const TSRange *ranges, uint32_t count) {
+  if (count == 0) {
+    ranges = &WHOLE_DOCUMENT_RANGE;
+    count = 1;
+  }
+  if (count == self->included_range_count &&
+      memcmp(ranges, self->included_ranges, count * sizeof(TSRange)) == 0) return;
+
+  self->included_ranges = ts_realloc(self->included_ranges, count * sizeof(TSRange));
+  memcpy(self->included_ranges, ranges, count * sizeof(TSRange));
+  self->included_range_count = count;
+  ts_lexer_set_input(self, self->input);
+}
+
+// Changing the window size discards the window, so that the lexer reads the
+// input again from its current position.
+void ts_lexer_set_window_size(Lexer *self, uint32_t size) {
+  if (size == self->max_window_size) return;
+  self->max_window_size = size;
+  array_clear(&self->window);
+  self->window_start = 0;
+  self->chunk = 0;
+  self->chunk_start = 0;
+  self->chunk_size = 0;
+  self->lookahead_size = 0;
+}
+
+bool ts_lexer_range_is_contiguous(const Lexer *self, uint32_t start_byte, uint32_t end_byte) {
+  uint32_t range_index = ts_lexer__find_included_range(self, start_byte);
+  if (range_index >= self->included_range_count) return false;
+  const TSRange *range = &self->included_ranges[range_index];
+  return range->start_byte <= start_byte && end_byte <= range->end_byte;
+}
+
 void ts_lexer_reset(Lexer *self, Length position) {
   if (position.bytes != self->current_position.bytes) {
     ts_lexer__reset(self, position);
@@ -162,14 +675,54 @@ void ts_lexer_reset(Lexer *self, Length position) {
 void ts_lexer_start(Lexer *self) {
   self->token_start_position = self->current_position;
   self->token_end_position = LENGTH_UNDEFINED;
+  self->text_hash = TEXT_HASH_SEED;
+  self->token_end_text_hash = TEXT_HASH_SEED;
   self->data.result_symbol = 0;
 
   if (!self->chunk)
     ts_lexer__get_chunk(self);
   if (!self->lookahead_size)
     ts_lexer__get_lookahead(self);
+
+  self->start_state = (LexerStartState){
+    .byte = self->current_position.bytes,
+    .lookahead = self->data.lookahead,
+    .lookahead_size = self->lookahead_size,
+    .column = self->column,
+    .included_range_index = self->current_included_range_index,
+    .column_is_valid = self->column_is_valid,
+    .is_valid = true,
+  };
 }
 
 void ts_lexer_advance_to_end(Lexer *self) {
   while (self->data.lookahead != 0) ts_lexer__advance(self, false);
 }
+
+// The input may have been read by others since the last parse, so its
+// position is looked up again. Turning prefetching off discards the chunk,
+// whose text belongs to the prefetcher. Without threads, the input is read
+// directly.
+void ts_lexer_set_prefetch(Lexer *self, bool enabled) {
+  self->input_byte = UINT32_MAX;
+  if (enabled == (self->prefetcher != NULL)) return;
+  if (enabled) {
+    self->prefetcher = input_prefetcher_new();
+  } else {
+    input_prefetcher_delete(self->prefetcher);
+    self->prefetcher = NULL;
+    self->chunk = 0;
+    self->chunk_start = 0;
+    self->chunk_size = 0;
+    self->lookahead_size = 0;
+  }
+}
+
+// A read must not be in flight once the parse returns, since the input may be
+// changed or freed before the next one.
+void ts_lexer_stop_prefetch(Lexer *self) {
+  if (self->prefetcher && input_prefetcher_is_pending(self->prefetcher)) {
+    input_prefetcher_discard(self->prefetcher);
+    self->input_byte = UINT32_MAX;
+  }
+}
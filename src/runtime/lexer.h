@@ -7,19 +7,53 @@ extern "C" {
 
 #include "tree_sitter/parser.h"
 #include "tree_sitter/runtime.h"
+#include "runtime/array.h"
+#include "runtime/input_prefetcher.h"
 #include "runtime/length.h"
 #include "runtime/tree.h"
 
+typedef struct {
+  uint32_t byte;
+  int32_t lookahead;
+  uint32_t lookahead_size;
+  uint32_t column;
+  uint32_t included_range_index;
+  bool column_is_valid;
+  bool is_valid;
+} LexerStartState;
+
 typedef struct {
   TSLexer data;
   Length current_position;
   Length token_start_position;
   Length token_end_position;
+  uint64_t text_hash;
+  uint64_t token_end_text_hash;
 
   const char *chunk;
   uint32_t chunk_start;
   uint32_t chunk_size;
   uint32_t lookahead_size;
+  uint32_t run_start;
+  uint32_t run_end;
+  uint32_t column;
+  bool column_is_valid;
+  bool did_block;
+  uint32_t column_rescan_count;
+  uint64_t column_rescan_byte_count;
+  LexerStartState start_state;
+
+  TSRange *included_ranges;
+  uint32_t included_range_count;
+  uint32_t current_included_range_index;
+
+  Array(char) window;
+  uint32_t window_start;
+  uint32_t max_window_size;
+
+  InputPrefetcher *prefetcher;
+  uint32_t prefetch_byte;
+  uint32_t input_byte;
 
   TSInput input;
   TSLogger logger;
@@ -27,7 +61,13 @@ typedef struct {
 } Lexer;
 
 void ts_lexer_init(Lexer *);
+void ts_lexer_delete(Lexer *);
 void ts_lexer_set_input(Lexer *, TSInput);
+void ts_lexer_set_included_ranges(Lexer *, const TSRange *, uint32_t);
+void ts_lexer_set_window_size(Lexer *, uint32_t size);
+void ts_lexer_set_prefetch(Lexer *, bool);
+void ts_lexer_stop_prefetch(Lexer *);
+bool ts_lexer_range_is_contiguous(const Lexer *, uint32_t start_byte, uint32_t end_byte);
 void ts_lexer_reset(Lexer *, Length);
 void ts_lexer_start(Lexer *);
 void ts_lexer_advance_to_end(Lexer *);
@@ -0,0 +1,182 @@
+#include <string.h>
+#include "runtime/line_index.h"
+
+typedef Array(uint32_t) LineStartArray;
+
+void line_index_init(LineIndex *self) {
+  array_init(&self->line_starts);
+  self->total_bytes = 0;
+  self->newline_size = 1;
+  self->has_dirty_range = false;
+  self->is_valid = false;
+}
+
+void line_index_delete(LineIndex *self) {
+  if (self->line_starts.contents) array_delete(&self->line_starts);
+}
+
+void line_index_invalidate(LineIndex *self) {
+  array_clear(&self->line_starts);
+  self->has_dirty_range = false;
+  self->is_valid = false;
+}
+
+// The number of lines that start at or before the given byte.
+static uint32_t line_index__line_count_before(const LineIndex *self, uint32_t byte) {
+  uint32_t low = 0, high = self->line_starts.size;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if (self->line_starts.contents[mid] <= byte) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+// Positions inside the removed text are moved to the given position.
+static inline uint32_t line_index__map_position(uint32_t position, const TSInputEdit *edit,
+                                                uint32_t position_if_removed) {
+  uint32_t old_end = edit->start_byte + edit->bytes_removed;
+  if (position <= edit->start_byte) return position;
+  if (position >= old_end) return position - old_end + edit->start_byte + edit->bytes_added;
+  return position_if_removed;
+}
+
+void line_index_edit(LineIndex *self, const TSInputEdit *edit) {
+  if (!self->is_valid) return;
+
+  // A line starts just after each newline, so the lines whose newlines were
+  // removed are the ones that start within (start_byte, old_end].
+  uint32_t start_byte = edit->start_byte;
+  uint32_t old_end = start_byte + edit->bytes_removed;
+  uint32_t first_removed = line_index__line_count_before(self, start_byte);
+  uint32_t first_kept = line_index__line_count_before(self, old_end);
+  uint32_t *line_starts = self->line_starts.contents;
+  for (uint32_t i = first_kept; i < self->line_starts.size; i++) {
+    line_starts[i] = line_starts[i] - old_end + start_byte + edit->bytes_added;
+  }
+  if (first_kept > first_removed) {
+    memmove(
+      &line_starts[first_removed],
+      &line_starts[first_kept],
+      (self->line_starts.size - first_kept) * sizeof(uint32_t)
+    );
+    self->line_starts.size -= first_kept - first_removed;
+  }
+
+  uint32_t inserted_end = start_byte + edit->bytes_added;
+  if (self->has_dirty_range) {
+    uint32_t dirty_start = line_index__map_position(self->dirty_start, edit, start_byte);
+    uint32_t dirty_end = self->dirty_end == UINT32_MAX
+      ? UINT32_MAX
+      : line_index__map_position(self->dirty_end, edit, inserted_end);
+    self->dirty_start = dirty_start < start_byte ? dirty_start : start_byte;
+    self->dirty_end = dirty_end > inserted_end ? dirty_end : inserted_end;
+  } else {
+    self->dirty_start = start_byte;
+    self->dirty_end = inserted_end;
+    self->has_dirty_range = true;
+  }
+
+  self->total_bytes = self->total_bytes - edit->bytes_removed + edit->bytes_added;
+}
+
+// Record the start of every line that begins after a newline in the given
+// text, which starts at the given byte offset. In UTF16, a newline is a code
+// unit at an even offset, whose bytes may be split between two chunks.
+static void line_index__scan(LineStartArray *line_starts, const char *text, uint32_t length,
+                             uint32_t offset, TSInputEncoding encoding, int *pending_byte) {
+  if (encoding == TSInputEncodingUTF8) {
+    const char *cursor = text, *end = text + length;
+    while ((cursor = memchr(cursor, '\n', end - cursor))) {
+      cursor++;
+      array_push(line_starts, offset + (uint32_t)(cursor - text));
+    }
+    return;
+  }
+
+  for (uint32_t i = 0; i < length; i++) {
+    uint32_t position = offset + i;
+    if (position % 2 == 0) {
+      *pending_byte = (unsigned char)text[i];
+    } else if (*pending_byte >= 0) {
+      char bytes[2] = {(char)*pending_byte, text[i]};
+      uint16_t unit;
+      memcpy(&unit, bytes, sizeof(unit));
+      if (unit == '\n') array_push(line_starts, position + 1);
+      *pending_byte = -1;
+    }
+  }
+}
+
+void line_index_update(LineIndex *self, TSInput input) {
+  if (self->is_valid && !self->has_dirty_range) return;
+
+  uint32_t start = 0, end = UINT32_MAX;
+  if (self->is_valid) {
+    start = self->dirty_start;
+    end = self->dirty_end;
+  } else {
+    array_clear(&self->line_starts);
+    array_push(&self->line_starts, 0);
+  }
+
+  LineStartArray line_starts = array_new();
+  int pending_byte = -1;
+  uint32_t position = start;
+  input.seek(input.payload, start, line_index_point_for_byte(self, start));
+  bool did_block = false;
+  while (position < end) {
+    uint32_t length;
+    const char *chunk = input.read(input.payload, &length);
+    if (length == TS_INPUT_WOULD_BLOCK) {
+      did_block = true;
+      break;
+    }
+    if (length == 0) break;
+    if (length > end - position) length = end - position;
+    line_index__scan(&line_starts, chunk, length, position, input.encoding, &pending_byte);
+    position += length;
+  }
+
+  // The lines that were recorded before within the rescanned text are replaced
+  // with the ones that were just found.
+  uint32_t first_replaced = line_index__line_count_before(self, start);
+  uint32_t first_kept = line_index__line_count_before(self, end);
+  array_splice(&self->line_starts, first_replaced, first_kept - first_replaced, &line_starts);
+  array_delete(&line_starts);
+
+  if (!self->is_valid || did_block) self->total_bytes = position;
+  self->newline_size = input.encoding == TSInputEncodingUTF8 ? 1 : 2;
+  self->has_dirty_range = false;
+  self->is_valid = true;
+
+  // The text that isn't available yet is scanned by the next update.
+  if (did_block) {
+    self->dirty_start = position;
+    self->dirty_end = UINT32_MAX;
+    self->has_dirty_range = true;
+  }
+}
+
+TSPoint line_index_point_for_byte(const LineIndex *self, uint32_t byte) {
+  if (!self->is_valid) return (TSPoint){0, 0};
+  if (byte > self->total_bytes) byte = self->total_bytes;
+  uint32_t row = line_index__line_count_before(self, byte) - 1;
+  return (TSPoint){row, byte - self->line_starts.contents[row]};
+}
+
+// Columns past the end of a line are clamped to the position of its newline,
+// and rows past the end of the text to the end of the text.
+uint32_t line_index_byte_for_point(const LineIndex *self, TSPoint point) {
+  if (!self->is_valid) return 0;
+  if (point.row >= self->line_starts.size) return self->total_bytes;
+  uint32_t line_start = self->line_starts.contents[point.row];
+  uint32_t line_end = self->total_bytes;
+  if (point.row + 1 < self->line_starts.size) {
+    line_end = self->line_starts.contents[point.row + 1] - self->newline_size;
+  }
+  return point.column < line_end - line_start ? line_start + point.column : line_end;
+}
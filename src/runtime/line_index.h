@@ -0,0 +1,38 @@
+#ifndef RUNTIME_LINE_INDEX_H_
+#define RUNTIME_LINE_INDEX_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include "tree_sitter/runtime.h"
+#include "runtime/array.h"
+
+// The byte offset at which each line of a document's text starts. Edits shift
+// the lines after them, and mark the text that they insert as needing to be
+// scanned for newlines the next time the index is updated from the input. An
+// index that has never been updated treats the text as empty.
+typedef struct {
+  Array(uint32_t) line_starts;
+  uint32_t total_bytes;
+  uint32_t newline_size;
+  uint32_t dirty_start;
+  uint32_t dirty_end;
+  bool has_dirty_range;
+  bool is_valid;
+} LineIndex;
+
+void line_index_init(LineIndex *);
+void line_index_delete(LineIndex *);
+void line_index_invalidate(LineIndex *);
+void line_index_edit(LineIndex *, const TSInputEdit *);
+void line_index_update(LineIndex *, TSInput);
+TSPoint line_index_point_for_byte(const LineIndex *, uint32_t);
+uint32_t line_index_byte_for_point(const LineIndex *, TSPoint);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // RUNTIME_LINE_INDEX_H_
@@ -2,37 +2,151 @@
 #include "runtime/node.h"
 #include "runtime/tree.h"
 #include "runtime/document.h"
+#include "runtime/language.h"
 
-TSNode ts_node_make(const Tree *tree, uint32_t byte, uint32_t row) {
-  return (TSNode){.data = tree, .offset = { byte, row } };
+TSNode ts_node_make(const Tree *tree, Length position, TSSymbol alias_symbol,
+                    const Tree *root, const TSLanguage *language) {
+  return (TSNode){
+    .data = tree,
+    .root = root,
+    .language = language,
+    .offset = { position.bytes, position.extent.row, position.extent.column },
+    .child_index = TS_NODE_CHILD_INDEX_UNKNOWN,
+    .alias_symbol = alias_symbol,
+  };
+}
+
+TSNode ts_node_make_root(const Tree *tree, const TSLanguage *language) {
+  return ts_node_make(tree, length_zero(), 0, tree, language);
 }
 
 /*
  *  Private
  */
 
+// Trees don't store their parents, their positions or their aliases, since a
+// tree can be shared by several parents. Instead, nodes carry this
+// information, and the children of a node are created as it is iterated.
+// Nodes also carry their index among the visible children of their visible
+// parent. An invisible node carries the index of its first visible
+// descendant, so that the indices of its children can be derived from it.
+typedef struct {
+  TSNode parent;
+  uint16_t alias_sequence_id;
+  Length position;
+  uint32_t child_index;
+  uint32_t structural_child_index;
+  uint32_t visible_child_index;
+} ChildIterator;
+
 static inline TSNode ts_node__null() {
-  return ts_node_make(NULL, 0, 0);
+  return ts_node_make(NULL, length_zero(), 0, NULL, NULL);
 }
 
 static inline const Tree *ts_node__tree(TSNode self) {
   return self.data;
 }
 
-static inline uint32_t ts_node__offset_byte(TSNode self) {
-  return self.offset[0];
+static inline Length ts_node__position(TSNode self) {
+  return (Length){ self.offset[0], { self.offset[1], self.offset[2] } };
 }
 
-static inline uint32_t ts_node__offset_row(TSNode self) {
-  return self.offset[1];
+// The number of positions that a child takes up among the visible children
+// of its visible parent.
+static inline uint32_t ts_node__visible_width(const Tree *tree, TSSymbol alias_symbol) {
+  if (tree->visible || alias_symbol) return 1;
+  return tree->children.size > 0 ? tree->visible_child_count : 0;
+}
+
+static inline ChildIterator ts_node__iterate_children(TSNode self) {
+  const Tree *tree = ts_node__tree(self);
+  bool is_visible = tree->visible || self.alias_symbol || self.data == self.root;
+  return (ChildIterator){
+    .parent = self,
+    .alias_sequence_id = tree->alias_sequence_id,
+    .position = ts_node__position(self),
+    .child_index = 0,
+    .structural_child_index = 0,
+    .visible_child_index = is_visible ? 0 : self.child_index,
+  };
+}
+
+static inline bool ts_node__next_child(ChildIterator *self, TSNode *result) {
+  const Tree *parent = ts_node__tree(self->parent);
+  if (self->child_index == parent->children.size) return false;
+
+  const Tree *child = parent->children.contents[self->child_index];
+  TSSymbol alias_symbol = 0;
+  if (!child->extra) {
+    alias_symbol = ts_language_alias_at(
+      self->parent.language, self->alias_sequence_id, self->structural_child_index
+    );
+    self->structural_child_index++;
+  }
+
+  *result = ts_node_make(child, self->position, alias_symbol, self->parent.root, self->parent.language);
+  result->child_index = self->visible_child_index;
+  if (self->visible_child_index != TS_NODE_CHILD_INDEX_UNKNOWN) {
+    self->visible_child_index += ts_node__visible_width(child, alias_symbol);
+  }
+  self->position = length_add(self->position, ts_tree_total_size(child));
+  self->child_index++;
+  return true;
+}
+
+// The offset table doesn't record how many visible children precede each
+// child, so the children that follow skipped ones have unknown indices.
+static inline void ts_node__skip_children(ChildIterator *self, const TreeChildPosition *position) {
+  if (position->index <= self->child_index) return;
+  self->visible_child_index = TS_NODE_CHILD_INDEX_UNKNOWN;
+  self->child_index = position->index;
+  self->structural_child_index = position->structural_index;
+  self->position = length_add(ts_node__position(self->parent), position->offset);
+}
+
+// Skip the children that end at or before the given byte or point. Nodes with
+// many children have a table of their children's offsets, which lets these be
+// found by binary search.
+static inline void ts_node__seek_child_for_byte(ChildIterator *self, uint32_t goal) {
+  TreeChildPosition position;
+  const Tree *parent = ts_node__tree(self->parent);
+  if (ts_tree_seek_child_for_byte(parent, ts_node__position(self->parent), goal, &position)) {
+    ts_node__skip_children(self, &position);
+  }
+}
+
+static inline void ts_node__seek_child_for_point(ChildIterator *self, TSPoint goal) {
+  TreeChildPosition position;
+  const Tree *parent = ts_node__tree(self->parent);
+  if (ts_tree_seek_child_for_point(parent, ts_node__position(self->parent), goal, &position)) {
+    ts_node__skip_children(self, &position);
+  }
+}
+
+static inline bool point_gt(TSPoint a, TSPoint b) {
+  return a.row > b.row || (a.row == b.row && a.column > b.column);
+}
+
+static inline bool ts_node__is(TSNode self, TSNode other) {
+  return self.data == other.data && self.offset[0] == other.offset[0];
+}
+
+static inline bool ts_node__contains(TSNode self, TSNode other) {
+  uint32_t start_byte = self.offset[0];
+  uint32_t end_byte = start_byte + ts_tree_total_bytes(ts_node__tree(self));
+  uint32_t other_start_byte = other.offset[0];
+  uint32_t other_end_byte = other_start_byte + ts_tree_total_bytes(ts_node__tree(other));
+  return start_byte <= other_start_byte && other_end_byte <= end_byte;
 }
 
 static inline bool ts_node__is_relevant(TSNode self, bool include_anonymous) {
   const Tree *tree = ts_node__tree(self);
   if (include_anonymous) {
-    return tree->context.alias_symbol || tree->visible;
+    return self.alias_symbol || tree->visible;
   } else {
-    return tree->context.alias_is_named || (tree->visible && tree->named);
+    bool alias_is_named = self.alias_symbol &&
+      ts_language_symbol_metadata(self.language, self.alias_symbol).named;
+    return alias_is_named || (tree->visible && tree->named);
   }
 }
 
@@ -50,25 +164,6 @@ static inline uint32_t ts_node__relevant_child_count(TSNode self,
   }
 }
 
-static inline TSNode ts_node__direct_parent(TSNode self, uint32_t *index) {
-  const Tree *tree = ts_node__tree(self);
-  *index = tree->context.index;
-  return ts_node_make(
-    tree->context.parent,
-    ts_node__offset_byte(self) - tree->context.offset.bytes,
-    ts_node__offset_row(self) - tree->context.offset.extent.row
-  );
-}
-
-static inline TSNode ts_node__direct_child(TSNode self, uint32_t i) {
-  const Tree *child_tree = ts_node__tree(self)->children.contents[i];
-  return ts_node_make(
-    child_tree,
-    ts_node__offset_byte(self) + child_tree->context.offset.bytes,
-    ts_node__offset_row(self) + child_tree->context.offset.extent.row
-  );
-}
-
 static inline TSNode ts_node__child(TSNode self, uint32_t child_index,
                                     bool include_anonymous) {
   TSNode result = self;
@@ -77,9 +172,10 @@ static inline TSNode ts_node__child(TSNode self, uint32_t child_index,
   while (did_descend) {
     did_descend = false;
 
+    TSNode child;
     uint32_t index = 0;
-    for (uint32_t i = 0; i < ts_node__tree(result)->children.size; i++) {
-      TSNode child = ts_node__direct_child(result, i);
+    ChildIterator iterator = ts_node__iterate_children(result);
+    while (ts_node__next_child(&iterator, &child)) {
       if (ts_node__is_relevant(child, include_anonymous)) {
         if (index == child_index)
           return child;
@@ -102,54 +198,150 @@ static inline TSNode ts_node__child(TSNode self, uint32_t child_index,
   return ts_node__null();
 }
 
-static inline TSNode ts_node__prev_sibling(TSNode self, bool include_anonymous) {
-  TSNode result = self;
-
-  do {
-    uint32_t index;
-    result = ts_node__direct_parent(result, &index);
-    if (!result.data)
-      break;
-
-    for (uint32_t i = index - 1; i + 1 > 0; i--) {
-      TSNode child = ts_node__direct_child(result, i);
-      if (ts_node__is_relevant(child, include_anonymous))
-        return child;
-      uint32_t grandchild_count =
-        ts_node__relevant_child_count(child, include_anonymous);
-      if (grandchild_count > 0)
-        return ts_node__child(child, grandchild_count - 1, include_anonymous);
+// Append the relevant children of the given node to the buffer, descending
+// into any irrelevant children that contain relevant nodes, until the buffer
+// is full.
+static uint32_t ts_node__children(TSNode self, TSNode *buffer, uint32_t buffer_size,
+                                  uint32_t count, bool include_anonymous) {
+  TSNode child;
+  ChildIterator iterator = ts_node__iterate_children(self);
+  while (count < buffer_size && ts_node__next_child(&iterator, &child)) {
+    if (ts_node__is_relevant(child, include_anonymous)) {
+      buffer[count++] = child;
+    } else if (ts_node__relevant_child_count(child, include_anonymous) > 0) {
+      count = ts_node__children(child, buffer, buffer_size, count, include_anonymous);
+    }
+  }
+  return count;
+}
+
+// Find the closest visible ancestor of the target by descending from the
+// given node. Several children can contain an empty target, so the search
+// backtracks if the target isn't found within a child.
+static bool ts_node__find_parent(TSNode self, TSNode visible_ancestor, TSNode target,
+                                 TSNode *result) {
+  if (ts_node__is_relevant(self, true)) visible_ancestor = self;
+
+  TSNode child;
+  ChildIterator iterator = ts_node__iterate_children(self);
+  while (ts_node__next_child(&iterator, &child)) {
+    if (ts_node__is(child, target)) {
+      *result = visible_ancestor;
+      return true;
     }
-  } while (!ts_node__tree(result)->visible);
+    if (ts_node__contains(child, target) &&
+        ts_node__find_parent(child, visible_ancestor, target, result)) {
+      return true;
+    }
+  }
 
-  return ts_node__null();
+  return false;
 }
 
-static inline TSNode ts_node__next_sibling(TSNode self, bool include_anonymous) {
-  TSNode result = self;
+// The siblings of a node are the descendants of its visible parent that
+// are reached without descending into another visible node. The search
+// below only descends into the invisible nodes that contain the target.
+static inline bool ts_node__descends_toward(TSNode self, TSNode target) {
+  return !ts_node__is_relevant(self, true) && ts_node__contains(self, target);
+}
 
-  do {
-    uint32_t index;
-    result = ts_node__direct_parent(result, &index);
-    if (!result.data)
-      break;
-
-    for (uint32_t i = index + 1; i < ts_node__tree(result)->children.size; i++) {
-      TSNode child = ts_node__direct_child(result, i);
-      if (ts_node__is_relevant(child, include_anonymous))
-        return child;
-      uint32_t grandchild_count =
-        ts_node__relevant_child_count(child, include_anonymous);
-      if (grandchild_count > 0)
-        return ts_node__child(child, 0, include_anonymous);
+static bool ts_node__find_next_sibling(TSNode self, TSNode target, bool include_anonymous,
+                                       bool *found_target, TSNode *result) {
+  TSNode child;
+  ChildIterator iterator = ts_node__iterate_children(self);
+  while (ts_node__next_child(&iterator, &child)) {
+    if (*found_target) {
+      if (ts_node__is_relevant(child, include_anonymous)) {
+        *result = child;
+        return true;
+      }
+      if (ts_node__relevant_child_count(child, include_anonymous) > 0) {
+        *result = ts_node__child(child, 0, include_anonymous);
+        return true;
+      }
+    } else if (ts_node__is(child, target)) {
+      *found_target = true;
+    } else if (ts_node__descends_toward(child, target)) {
+      if (ts_node__find_next_sibling(child, target, include_anonymous, found_target, result)) {
+        return true;
+      }
     }
-  } while (!ts_node__tree(result)->visible);
+  }
 
-  return ts_node__null();
+  return false;
 }
 
-static inline bool point_gt(TSPoint a, TSPoint b) {
-  return a.row > b.row || (a.row == b.row && a.column > b.column);
+static bool ts_node__find_prev_sibling(TSNode self, TSNode target, bool include_anonymous,
+                                       TSNode *result, bool *result_is_container) {
+  TSNode child;
+  ChildIterator iterator = ts_node__iterate_children(self);
+  while (ts_node__next_child(&iterator, &child)) {
+    if (ts_node__is(child, target)) {
+      return true;
+    } else if (ts_node__descends_toward(child, target)) {
+      if (ts_node__find_prev_sibling(child, target, include_anonymous, result, result_is_container)) {
+        return true;
+      }
+    } else if (ts_node__is_relevant(child, include_anonymous)) {
+      *result = child;
+      *result_is_container = false;
+    } else if (ts_node__relevant_child_count(child, include_anonymous) > 0) {
+      *result = child;
+      *result_is_container = true;
+    }
+  }
+
+  return false;
+}
+
+static inline TSNode ts_node__visible_parent_or_root(TSNode self) {
+  TSNode parent = ts_node_parent(self);
+  if (parent.data) return parent;
+  if (!self.root || self.data == self.root) return ts_node__null();
+  return ts_node_make_root(self.root, self.language);
+}
+
+static inline TSNode ts_node__prev_sibling(TSNode self, bool include_anonymous) {
+  TSNode parent = ts_node__visible_parent_or_root(self);
+  if (!parent.data) return ts_node__null();
+
+  TSNode result = ts_node__null();
+  bool result_is_container = false;
+  if (!ts_node__find_prev_sibling(parent, self, include_anonymous, &result, &result_is_container) ||
+      !result.data) {
+    return ts_node__null();
+  }
+
+  if (result_is_container) {
+    uint32_t count = ts_node__relevant_child_count(result, include_anonymous);
+    return ts_node__child(result, count - 1, include_anonymous);
+  }
+  return result;
+}
+
+static inline TSNode ts_node__next_sibling(TSNode self, bool include_anonymous) {
+  TSNode parent = ts_node__visible_parent_or_root(self);
+  if (!parent.data) return ts_node__null();
+
+  TSNode result = ts_node__null();
+  bool found_target = false;
+  ts_node__find_next_sibling(parent, self, include_anonymous, &found_target, &result);
+  return result;
+}
+
+static bool ts_node__find_child_index(TSNode self, TSNode target, uint32_t *index) {
+  TSNode child;
+  ChildIterator iterator = ts_node__iterate_children(self);
+  while (ts_node__next_child(&iterator, &child)) {
+    if (ts_node__is(child, target)) return true;
+    if (ts_node__descends_toward(child, target)) {
+      uint32_t previous_index = *index;
+      if (ts_node__find_child_index(child, target, index)) return true;
+      *index = previous_index;
+    }
+    *index += ts_node__is_relevant(child, true) ? 1 : ts_node__relevant_child_count(child, true);
+  }
+  return false;
 }
 
 static inline TSNode ts_node__first_child_for_byte(TSNode self, uint32_t goal,
@@ -160,8 +352,10 @@ static inline TSNode ts_node__first_child_for_byte(TSNode self, uint32_t goal,
   while (did_descend) {
     did_descend = false;
 
-    for (uint32_t i = 0; i < ts_node__tree(node)->children.size; i++) {
-      TSNode child = ts_node__direct_child(node, i);
+    TSNode child;
+    ChildIterator iterator = ts_node__iterate_children(node);
+    ts_node__seek_child_for_byte(&iterator, goal);
+    while (ts_node__next_child(&iterator, &child)) {
       if (ts_node_end_byte(child) > goal) {
         if (ts_node__is_relevant(child, include_anonymous)) {
           return child;
@@ -187,8 +381,10 @@ static inline TSNode ts_node__descendant_for_byte_range(TSNode self, uint32_t mi
   while (did_descend) {
     did_descend = false;
 
-    for (uint32_t i = 0, n = ts_node__tree(node)->children.size; i < n; i++) {
-      TSNode child = ts_node__direct_child(node, i);
+    TSNode child;
+    ChildIterator iterator = ts_node__iterate_children(node);
+    ts_node__seek_child_for_byte(&iterator, max);
+    while (ts_node__next_child(&iterator, &child)) {
       if (ts_node_end_byte(child) > max) {
         if (ts_node_start_byte(child) > min) break;
         node = child;
@@ -207,26 +403,22 @@ static inline TSNode ts_node__descendant_for_point_range(TSNode self, TSPoint mi
                                                          bool include_anonymous) {
   TSNode node = self;
   TSNode last_visible_node = self;
-  TSPoint start_position = ts_node_start_point(self);
-  TSPoint end_position = ts_node_end_point(self);
 
   bool did_descend = true;
   while (did_descend) {
     did_descend = false;
 
-    for (uint32_t i = 0, n = ts_node__tree(node)->children.size; i < n; i++) {
-      TSNode child = ts_node__direct_child(node, i);
-      const Tree *child_tree = ts_node__tree(child);
-      if (i > 0) start_position = point_add(start_position, child_tree->padding.extent);
-      end_position = point_add(start_position, child_tree->size.extent);
-      if (point_gt(end_position, max)) {
-        if (point_gt(start_position, min)) break;
+    TSNode child;
+    ChildIterator iterator = ts_node__iterate_children(node);
+    ts_node__seek_child_for_point(&iterator, max);
+    while (ts_node__next_child(&iterator, &child)) {
+      if (point_gt(ts_node_end_point(child), max)) {
+        if (point_gt(ts_node_start_point(child), min)) break;
         node = child;
         if (ts_node__is_relevant(node, include_anonymous)) last_visible_node = node;
         did_descend = true;
         break;
       }
-      start_position = end_position;
     }
   }
 
@@ -238,7 +430,7 @@ static inline TSNode ts_node__descendant_for_point_range(TSNode self, TSPoint mi
  */
 
 uint32_t ts_node_start_byte(TSNode self) {
-  return ts_node__offset_byte(self) + ts_node__tree(self)->padding.bytes;
+  return self.offset[0] + ts_node__tree(self)->padding.bytes;
 }
 
 uint32_t ts_node_end_byte(TSNode self) {
@@ -246,29 +438,36 @@ uint32_t ts_node_end_byte(TSNode self) {
 }
 
 TSPoint ts_node_start_point(TSNode self) {
-  const Tree *tree = ts_node__tree(self);
-  return (TSPoint){ ts_node__offset_row(self) + tree->padding.extent.row,
-                    ts_tree_start_column(tree) };
+  return point_add(ts_node__position(self).extent, ts_node__tree(self)->padding.extent);
 }
 
 TSPoint ts_node_end_point(TSNode self) {
-  const Tree *tree = ts_node__tree(self);
-  return (TSPoint){ ts_node__offset_row(self) + tree->padding.extent.row +
-                      tree->size.extent.row,
-                    ts_tree_end_column(tree) };
+  return point_add(ts_node_start_point(self), ts_node__tree(self)->size.extent);
 }
 
 TSSymbol ts_node_symbol(TSNode self) {
-  const Tree *tree = ts_node__tree(self);
-  return tree->context.alias_symbol ? tree->context.alias_symbol : tree->symbol;
+  return self.alias_symbol ? self.alias_symbol : ts_node__tree(self)->symbol;
 }
 
 const char *ts_node_type(TSNode self, const TSDocument *document) {
-  return ts_language_symbol_name(document->parser.language, ts_node_symbol(self));
+  return ts_language_symbol_name(document->language, ts_node_symbol(self));
 }
 
 char *ts_node_string(TSNode self, const TSDocument *document) {
-  return ts_tree_string(ts_node__tree(self), document->parser.language, false);
+  return ts_tree_string(ts_node__tree(self), self.alias_symbol, document->language, false);
+}
+
+void ts_node_write_string(TSNode self, const TSDocument *document, TSWriteCallback callback,
+                          void *payload) {
+  ts_tree_write_string(ts_node__tree(self), self.alias_symbol, document->language, false, callback, payload);
+}
+
+static void ts_node__write_to_file(void *payload, const char *text, uint32_t length) {
+  fwrite(text, 1, length, payload);
+}
+
+void ts_node_print_string(TSNode self, const TSDocument *document, FILE *file) {
+  ts_node_write_string(self, document, ts_node__write_to_file, file);
 }
 
 bool ts_node_eq(TSNode self, TSNode other) {
@@ -279,8 +478,9 @@ bool ts_node_eq(TSNode self, TSNode other) {
 }
 
 bool ts_node_is_named(TSNode self) {
-  const Tree *tree = ts_node__tree(self);
-  return tree->context.alias_symbol ? tree->context.alias_is_named : tree->named;
+  return self.alias_symbol ?
+    ts_language_symbol_metadata(self.language, self.alias_symbol).named :
+    ts_node__tree(self)->named;
 }
 
 bool ts_node_is_missing(TSNode self) {
@@ -288,6 +488,12 @@ bool ts_node_is_missing(TSNode self) {
   return tree->is_missing;
 }
 
+// An opaque node stands in for a region whose contents were skipped, and has
+// no children until the document expands it.
+bool ts_node_is_opaque(TSNode self) {
+  return ts_node__tree(self)->is_opaque;
+}
+
 bool ts_node_has_changes(TSNode self) {
   return ts_node__tree(self)->has_changes;
 }
@@ -296,35 +502,40 @@ bool ts_node_has_error(TSNode self) {
   return ts_node__tree(self)->error_cost > 0;
 }
 
-TSNode ts_node_parent(TSNode self) {
-  TSNode result = self;
-  uint32_t index;
+// Nodes that are aliased take their alias symbol into account, since the same
+// tree can appear under different names.
+uint64_t ts_node_fingerprint(TSNode self) {
+  uint64_t result = ts_node__tree(self)->fingerprint;
+  if (self.alias_symbol) {
+    result = ts_tree_fingerprint_mix(result ^ ts_tree_node_fingerprint(self.alias_symbol, 0));
+  }
+  return result;
+}
+
+// A node keeps its id for as long as later parses reuse its tree.
+TSNodeId ts_node_id(TSNode self) {
+  const Tree *tree = ts_node__tree(self);
+  return (TSNodeId){tree, tree ? tree->generation : 0};
+}
 
-  do {
-    result = ts_node__direct_parent(result, &index);
-    if (!result.data)
-      return ts_node__null();
-  } while (!ts_node__tree(result)->visible);
+TSNode ts_node_parent(TSNode self) {
+  if (!self.root || self.data == self.root) return ts_node__null();
 
+  TSNode result = ts_node__null();
+  TSNode root = ts_node_make_root(self.root, self.language);
+  if (!ts_node__find_parent(root, ts_node__null(), self, &result)) return ts_node__null();
   return result;
 }
 
 uint32_t ts_node_child_index(TSNode self) {
-  const Tree *tree = ts_node__tree(self);
-  uint32_t result = 0;
+  if (!self.root || self.data == self.root) return UINT32_MAX;
+  if (self.child_index != TS_NODE_CHILD_INDEX_UNKNOWN) return self.child_index;
 
-  for (;;) {
-    const Tree *parent = tree->context.parent;
-    uint32_t index = tree->context.index;
-    if (!parent) return UINT32_MAX;
-    for (uint32_t i = 0; i < index; i++) {
-      Tree *child = parent->children.contents[i];
-      result += child->visible ? 1 : child->visible_child_count;
-    }
-    if (parent->visible) break;
-    tree = parent;
-  }
+  TSNode parent = ts_node_parent(self);
+  if (!parent.data) return UINT32_MAX;
 
+  uint32_t result = 0;
+  ts_node__find_child_index(parent, self, &result);
   return result;
 }
 
@@ -336,6 +547,14 @@ TSNode ts_node_named_child(TSNode self, uint32_t child_index) {
   return ts_node__child(self, child_index, false);
 }
 
+uint32_t ts_node_children(TSNode self, TSNode *buffer, uint32_t buffer_size) {
+  return ts_node__children(self, buffer, buffer_size, 0, true);
+}
+
+uint32_t ts_node_named_children(TSNode self, TSNode *buffer, uint32_t buffer_size) {
+  return ts_node__children(self, buffer, buffer_size, 0, false);
+}
+
 uint32_t ts_node_child_count(TSNode self) {
   const Tree *tree = ts_node__tree(self);
   if (tree->children.size > 0) {
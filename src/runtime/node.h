@@ -1,8 +1,21 @@
 #ifndef RUNTIME_NODE_H_
 #define RUNTIME_NODE_H_
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #include "runtime/tree.h"
 
-TSNode ts_node_make(const Tree *, uint32_t byte, uint32_t row);
+// The child index of nodes that were not reached from their visible parent.
+static const uint32_t TS_NODE_CHILD_INDEX_UNKNOWN = UINT32_MAX;
+
+TSNode ts_node_make(const Tree *, Length position, TSSymbol alias_symbol,
+                    const Tree *root, const TSLanguage *);
+TSNode ts_node_make_root(const Tree *, const TSLanguage *);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
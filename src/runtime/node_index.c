@@ -0,0 +1,102 @@
+#include <stdint.h>
+#include <string.h>
+#include "runtime/node_index.h"
+#include "runtime/alloc.h"
+#include "runtime/language.h"
+
+static inline uint32_t node_index__hash(const Tree *tree) {
+  uint64_t value = (uintptr_t)tree;
+  return (uint32_t)((value >> 4) * 0x9e3779b97f4a7c15ull >> 32);
+}
+
+static NodeIndexEntry *node_index__slot(const NodeIndex *self, const Tree *tree) {
+  uint32_t mask = self->capacity - 1;
+  uint32_t index = node_index__hash(tree) & mask;
+  while (self->entries[index].tree && self->entries[index].tree != tree) {
+    index = (index + 1) & mask;
+  }
+  return &self->entries[index];
+}
+
+void node_index_init(NodeIndex *self) {
+  self->entries = NULL;
+  self->capacity = 0;
+  self->size = 0;
+  array_init(&self->stack);
+  self->is_valid = false;
+}
+
+void node_index_delete(NodeIndex *self) {
+  if (self->entries) ts_free(self->entries);
+  if (self->stack.contents) array_delete(&self->stack);
+}
+
+void node_index_invalidate(NodeIndex *self) {
+  self->is_valid = false;
+}
+
+// The table is sized for all of the tree's nodes, so that it is at most half
+// full, and the tree is walked with an explicit stack.
+void node_index_update(NodeIndex *self, const Tree *root, const TSLanguage *language) {
+  if (self->is_valid) return;
+  self->is_valid = true;
+  self->size = 0;
+  if (!root) return;
+
+  uint32_t capacity = 64;
+  while (capacity < 2 * (ts_tree_node_count(root) + 1)) capacity *= 2;
+  if (capacity != self->capacity) {
+    if (self->entries) ts_free(self->entries);
+    self->entries = ts_calloc(capacity, sizeof(NodeIndexEntry));
+    self->capacity = capacity;
+  } else {
+    memset(self->entries, 0, capacity * sizeof(NodeIndexEntry));
+  }
+
+  array_clear(&self->stack);
+  array_push(&self->stack, ((NodeIndexEntry){.tree = root, .position = length_zero()}));
+  while (self->stack.size > 0) {
+    NodeIndexEntry entry = array_pop(&self->stack);
+    const Tree *tree = entry.tree;
+
+    // The children's visible parent is this node if it is visible, and
+    // otherwise the same as this node's.
+    NodeIndexEntry child_entry = entry;
+    if (tree->visible || entry.alias_symbol) {
+      NodeIndexEntry *slot = node_index__slot(self, tree);
+      if (!slot->tree) {
+        *slot = entry;
+        self->size++;
+      } else {
+        slot->is_shared = true;
+      }
+      child_entry.parent = tree;
+      child_entry.parent_position = entry.position;
+      child_entry.parent_alias_symbol = entry.alias_symbol;
+    }
+
+    uint32_t structural_child_index = 0;
+    Length position = entry.position;
+    for (uint32_t i = 0; i < tree->children.size; i++) {
+      const Tree *child = tree->children.contents[i];
+      TSSymbol alias_symbol = 0;
+      if (!child->extra) {
+        alias_symbol = ts_language_alias_at(language, tree->alias_sequence_id, structural_child_index);
+      }
+      if (child->visible || alias_symbol || child->children.size > 0) {
+        child_entry.tree = child;
+        child_entry.position = position;
+        child_entry.alias_symbol = alias_symbol;
+        array_push(&self->stack, child_entry);
+      }
+      if (!child->extra) structural_child_index++;
+      position = length_add(position, ts_tree_total_size(child));
+    }
+  }
+}
+
+const NodeIndexEntry *node_index_find(const NodeIndex *self, const Tree *tree) {
+  if (self->size == 0) return NULL;
+  NodeIndexEntry *slot = node_index__slot(self, tree);
+  return slot->tree ? slot : NULL;
+}
@@ -0,0 +1,44 @@
+#ifndef RUNTIME_NODE_INDEX_H_
+#define RUNTIME_NODE_INDEX_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include "runtime/tree.h"
+
+typedef struct {
+  const Tree *tree;
+  Length position;
+  TSSymbol alias_symbol;
+  bool is_shared;
+  const Tree *parent;
+  Length parent_position;
+  TSSymbol parent_alias_symbol;
+} NodeIndexEntry;
+
+// The positions of the visible nodes in a document's tree, keyed by their
+// trees, for finding the node that has a given id, along with their visible
+// parents. The index is only built when a node is looked up, and is built
+// again after the tree changes. A leaf that occurs at several positions,
+// because it was interned, is found at one of them, and is marked as shared.
+typedef struct {
+  NodeIndexEntry *entries;
+  uint32_t capacity;
+  uint32_t size;
+  Array(NodeIndexEntry) stack;
+  bool is_valid;
+} NodeIndex;
+
+void node_index_init(NodeIndex *);
+void node_index_delete(NodeIndex *);
+void node_index_invalidate(NodeIndex *);
+void node_index_update(NodeIndex *, const Tree *, const TSLanguage *);
+const NodeIndexEntry *node_index_find(const NodeIndex *, const Tree *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // RUNTIME_NODE_INDEX_H_
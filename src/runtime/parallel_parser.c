@@ -0,0 +1,238 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "runtime/parallel_parser.h"
+#include "runtime/alloc.h"
+#include "runtime/array.h"
+#include "runtime/length.h"
+#include "runtime/string_input.h"
+#include "runtime/tree.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+// Parsing a large document in parallel works in three steps. The text is
+// split into chunks at lines that look like the start of a new top-level
+// construct, and the chunks are parsed concurrently, each by its own parser.
+// The resulting trees are then stitched together under a single root, and
+// that root is used as the previous tree for an ordinary incremental parse of
+// the whole document, with every chunk boundary treated as an edit. This
+// final pass reuses the chunks' subtrees wherever their parse states agree
+// with a serial parse, and re-parses the rest. Chunks that contain errors,
+// which usually means that a boundary was guessed wrong, are invalidated
+// entirely and re-parsed serially.
+
+#ifndef _WIN32
+
+// Chunks smaller than this are not worth parsing on a separate thread.
+static const uint32_t MIN_CHUNK_SIZE = 4096;
+
+typedef struct {
+  Parser parser;
+  const char *text;
+  uint32_t length;
+  Tree *tree;
+} ParseChunk;
+
+static char *parallel_parser__read_input(TSInput input, uint32_t *length) {
+  Array(char) text = array_new();
+  input.seek(input.payload, 0, (TSPoint){0, 0});
+  for (;;) {
+    uint32_t bytes_read;
+    const char *chunk = input.read(input.payload, &bytes_read);
+    if (bytes_read == 0 || bytes_read == TS_INPUT_WOULD_BLOCK) break;
+    if (text.size + bytes_read > text.capacity) {
+      uint32_t capacity = text.capacity * 2;
+      if (capacity < text.size + bytes_read) capacity = text.size + bytes_read;
+      array_reserve(&text, capacity);
+    }
+    memcpy(text.contents + text.size, chunk, bytes_read);
+    text.size += bytes_read;
+  }
+  *length = text.size;
+  return text.contents;
+}
+
+static inline bool parallel_parser__is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Find the first line at or after the given position that starts with
+// something other than whitespace or a closing delimiter. The split is placed
+// right after the last non-whitespace character before that line, so that
+// the whitespace in between becomes the padding of the next chunk's first
+// token, just as it would in a serial parse.
+static uint32_t parallel_parser__find_split(const char *text, uint32_t length,
+                                            uint32_t position, uint32_t previous_split) {
+  for (uint32_t i = position; i + 1 < length; i++) {
+    if (text[i] != '\n') continue;
+    char next = text[i + 1];
+    if (parallel_parser__is_space(next) || next == '}' || next == ')' || next == ']') continue;
+
+    uint32_t split = i;
+    while (split > previous_split && parallel_parser__is_space(text[split - 1])) split--;
+    if (split > previous_split) return split;
+  }
+  return length;
+}
+
+static void *parallel_parser__parse_chunk(void *payload) {
+  ParseChunk *chunk = payload;
+  TSInput input = ts_string_input_make_with_length(chunk->text, chunk->length);
+  chunk->tree = parser_parse(&chunk->parser, input, NULL, false);
+  ts_free(input.payload);
+  return NULL;
+}
+
+static Tree *parallel_parser__stitch(Parser *self, ParseChunk *chunks, uint32_t chunk_count) {
+  TSSymbol symbol = ts_builtin_sym_error;
+  for (uint32_t i = 0; i < chunk_count; i++) {
+    if (chunks[i].tree->symbol != ts_builtin_sym_error) {
+      symbol = chunks[i].tree->symbol;
+      break;
+    }
+  }
+  if (symbol == ts_builtin_sym_error) return NULL;
+
+  // The end-of-input token of every chunk but the last is dropped. Because of
+  // where the splits are placed, it is normally empty; if it isn't, the
+  // chunks can't be stitched together without changing the document's size.
+  TreeArray children = array_new();
+  for (uint32_t i = 0; i < chunk_count; i++) {
+    Tree *root = chunks[i].tree;
+    for (uint32_t j = 0; j < root->children.size; j++) {
+      Tree *child = root->children.contents[j];
+      if (i + 1 < chunk_count && j + 1 == root->children.size && child->symbol == ts_builtin_sym_end) {
+        if (ts_tree_total_bytes(child) > 0) {
+          ts_tree_array_delete(self->tree_pool, &children);
+          return NULL;
+        }
+        continue;
+      }
+      ts_tree_retain(child);
+      array_push(&children, child);
+    }
+  }
+
+  Tree *result = ts_tree_make_node(self->tree_pool, symbol, &children, 0, self->language);
+
+  Length chunk_start = length_zero();
+  for (uint32_t i = 0; i < chunk_count; i++) {
+    Length chunk_size = ts_tree_total_size(chunks[i].tree);
+    TSInputEdit edit = {
+      .start_byte = chunk_start.bytes,
+      .bytes_removed = 0,
+      .bytes_added = 0,
+      .start_point = chunk_start.extent,
+      .extent_removed = {0, 0},
+      .extent_added = {0, 0},
+    };
+    if (chunks[i].tree->error_cost > 0) {
+      edit.bytes_removed = edit.bytes_added = chunk_size.bytes;
+      edit.extent_removed = edit.extent_added = chunk_size.extent;
+      result = ts_tree_edit(self->tree_pool, result, &edit);
+    } else if (i > 0) {
+      result = ts_tree_edit(self->tree_pool, result, &edit);
+    }
+    chunk_start = length_add(chunk_start, chunk_size);
+  }
+
+  return result;
+}
+
+static Tree *parallel_parser__parse_chunks(Parser *self, TSInput input, uint32_t thread_count) {
+  uint32_t length;
+  char *text = parallel_parser__read_input(input, &length);
+
+  uint32_t chunk_count = length / MIN_CHUNK_SIZE;
+  if (chunk_count > thread_count) chunk_count = thread_count;
+
+  Array(uint32_t) splits = array_new();
+  array_push(&splits, 0);
+  for (uint32_t i = 1; i < chunk_count; i++) {
+    uint32_t previous_split = *array_back(&splits);
+    uint32_t position = (uint32_t)((uint64_t)length * i / chunk_count);
+    if (position < previous_split) position = previous_split;
+    uint32_t split = parallel_parser__find_split(text, length, position, previous_split);
+    if (split >= length) break;
+    array_push(&splits, split);
+  }
+  array_push(&splits, length);
+  chunk_count = splits.size - 1;
+
+  Tree *result = NULL;
+  if (chunk_count > 1) {
+    ParseChunk *chunks = ts_calloc(chunk_count, sizeof(ParseChunk));
+    pthread_t *threads = ts_calloc(chunk_count, sizeof(pthread_t));
+    bool *started = ts_calloc(chunk_count, sizeof(bool));
+
+    for (uint32_t i = 0; i < chunk_count; i++) {
+      parser_init(&chunks[i].parser);
+      chunks[i].parser.tree_pool->generation = self->tree_pool->generation;
+      parser_set_language(&chunks[i].parser, self->given_language);
+      chunks[i].parser.max_version_count = self->max_version_count;
+      chunks[i].parser.cancellation_flag = self->cancellation_flag;
+      chunks[i].parser.timeout_micros = self->timeout_micros;
+      chunks[i].parser.max_recovery_steps_per_byte = self->max_recovery_steps_per_byte;
+      chunks[i].parser.max_memory_bytes = self->max_memory_bytes;
+      chunks[i].text = text + splits.contents[i];
+      chunks[i].length = splits.contents[i + 1] - splits.contents[i];
+    }
+
+    // The first chunk is parsed on the calling thread. If a thread can't be
+    // created, its chunk is parsed there too, once the others are running.
+    for (uint32_t i = 1; i < chunk_count; i++) {
+      started[i] = pthread_create(&threads[i], NULL, parallel_parser__parse_chunk, &chunks[i]) == 0;
+    }
+    for (uint32_t i = 0; i < chunk_count; i++) {
+      if (!started[i]) parallel_parser__parse_chunk(&chunks[i]);
+    }
+    for (uint32_t i = 1; i < chunk_count; i++) {
+      if (started[i]) pthread_join(threads[i], NULL);
+    }
+
+    // The chunks' trees are moved into this parser's pool, so that they can
+    // be released once the chunks' parsers are gone. A chunk whose parse was
+    // cancelled first discards its unfinished parse, which refers to trees in
+    // its own pool.
+    bool was_cancelled = false;
+    for (uint32_t i = 0; i < chunk_count; i++) {
+      if (!chunks[i].tree) was_cancelled = true;
+      parser_reset(&chunks[i].parser);
+      ts_tree_pool_adopt(self->tree_pool, chunks[i].parser.tree_pool);
+      parser_destroy(&chunks[i].parser);
+    }
+
+    if (!was_cancelled) result = parallel_parser__stitch(self, chunks, chunk_count);
+
+    for (uint32_t i = 0; i < chunk_count; i++) {
+      if (chunks[i].tree) ts_tree_release(self->tree_pool, chunks[i].tree);
+    }
+    ts_free(started);
+    ts_free(threads);
+    ts_free(chunks);
+  }
+
+  array_delete(&splits);
+  ts_free(text);
+  return result;
+}
+
+#endif
+
+Tree *parser_parse_in_parallel(Parser *self, TSInput input, uint32_t thread_count, bool halt_on_error) {
+  Tree *tree = NULL;
+
+#ifndef _WIN32
+  if (thread_count > 1 && input.encoding == TSInputEncodingUTF8) {
+    tree = parallel_parser__parse_chunks(self, input, thread_count);
+  }
+#endif
+
+  // If this parse is cancelled, it can't be resumed, because its unfinished
+  // state refers to the stitched tree.
+  Tree *result = parser_parse(self, input, tree, halt_on_error);
+  if (!result && tree) parser_reset(self);
+  if (tree) ts_tree_release(self->tree_pool, tree);
+  return result;
+}
@@ -0,0 +1,16 @@
+#ifndef RUNTIME_PARALLEL_PARSER_H_
+#define RUNTIME_PARALLEL_PARSER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "runtime/parser.h"
+
+Tree *parser_parse_in_parallel(Parser *, TSInput, uint32_t thread_count, bool halt_on_error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // RUNTIME_PARALLEL_PARSER_H_
@@ -0,0 +1,113 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "tree_sitter/runtime.h"
+#include "runtime/alloc.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A parse cache that keeps each tree in its own file, named after its key.
+// Entries are mapped directly rather than read, and are written under a
+// temporary name that is unique to the writer and then renamed, so that the
+// processes and threads that share a directory never see a partially written
+// entry, even when they store the same key at once.
+
+typedef struct {
+  char *path;
+} TSParseCacheDirectory;
+
+static void ts_parse_cache_directory__entry_path(TSParseCacheDirectory *self, uint64_t key,
+                                                 const char *suffix, char *buffer, size_t size) {
+  snprintf(buffer, size, "%s/%016llx%s", self->path, (unsigned long long)key, suffix);
+}
+
+static const char *ts_parse_cache_directory__load(void *payload, uint64_t key, uint32_t *length) {
+#ifndef _WIN32
+  TSParseCacheDirectory *self = payload;
+  size_t path_size = strlen(self->path) + 32;
+  char *path = ts_malloc(path_size);
+  ts_parse_cache_directory__entry_path(self, key, "", path, path_size);
+  int fd = open(path, O_RDONLY);
+  ts_free(path);
+  if (fd < 0) return NULL;
+
+  const char *result = NULL;
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0 && (uint64_t)file_stat.st_size <= UINT32_MAX) {
+    void *mapping = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping != MAP_FAILED) {
+      result = mapping;
+      *length = file_stat.st_size;
+    }
+  }
+  close(fd);
+  return result;
+#else
+  return NULL;
+#endif
+}
+
+static void ts_parse_cache_directory__release(void *payload, const char *data, uint32_t length) {
+#ifndef _WIN32
+  munmap((void *)data, length);
+#endif
+}
+
+static void ts_parse_cache_directory__store(void *payload, uint64_t key, const char *data,
+                                            uint32_t length) {
+#ifndef _WIN32
+  TSParseCacheDirectory *self = payload;
+  size_t path_size = strlen(self->path) + 64;
+  char *path = ts_malloc(path_size);
+  char *temporary_path = ts_malloc(path_size);
+  ts_parse_cache_directory__entry_path(self, key, "", path, path_size);
+  ts_parse_cache_directory__entry_path(self, key, ".tmp.XXXXXX", temporary_path, path_size);
+
+  // `mkstemp` creates files that only their owner can read, and the entry
+  // would keep that mode once it is renamed.
+  int fd = mkstemp(temporary_path);
+  if (fd >= 0) {
+    fchmod(fd, 0644);
+    uint32_t position = 0;
+    while (position < length) {
+      ssize_t written = write(fd, data + position, length - position);
+      if (written <= 0) break;
+      position += written;
+    }
+    bool succeeded = close(fd) == 0 && position == length;
+    if (!succeeded || rename(temporary_path, path) != 0) unlink(temporary_path);
+  }
+
+  ts_free(temporary_path);
+  ts_free(path);
+#endif
+}
+
+// The directory is created if it doesn't exist yet.
+TSParseCache ts_parse_cache_directory_new(const char *path) {
+#ifndef _WIN32
+  mkdir(path, 0777);
+#endif
+  TSParseCacheDirectory *self = ts_malloc(sizeof(TSParseCacheDirectory));
+  size_t path_length = strlen(path);
+  self->path = ts_malloc(path_length + 1);
+  memcpy(self->path, path, path_length + 1);
+  return (TSParseCache){
+    .payload = self,
+    .load = ts_parse_cache_directory__load,
+    .release = ts_parse_cache_directory__release,
+    .store = ts_parse_cache_directory__store,
+  };
+}
+
+void ts_parse_cache_directory_delete(TSParseCache cache) {
+  TSParseCacheDirectory *self = cache.payload;
+  ts_free(self->path);
+  ts_free(self);
+}
@@ -3,12 +3,15 @@
 #include <stdio.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <time.h>
 #include "tree_sitter/runtime.h"
 #include "runtime/tree.h"
 #include "runtime/lexer.h"
 #include "runtime/length.h"
 #include "runtime/array.h"
 #include "runtime/language.h"
+#include "runtime/keyword_table.h"
+#include "runtime/node.h"
 #include "runtime/alloc.h"
 #include "runtime/reduce_action.h"
 #include "runtime/error_costs.h"
@@ -31,18 +34,27 @@
     fputs("\n", stderr);                                                  \
   }
 
+// Unlike the text log, trace events are fixed-size records that are copied
+// into the trace buffer as they happen, so tracing is cheap enough to leave
+// enabled.
+#define TRACE(type, version, state, symbol, byte, detail)                              \
+  if (self->trace.capacity > 0) {                                                     \
+    trace_buffer_push(&self->trace, (TSTraceEvent){                                   \
+      type, (uint16_t)(version), (TSStateId)(state), (TSSymbol)(symbol), byte, detail \
+    });                                                                               \
+  }
+
 #define SYM_NAME(symbol) ts_language_symbol_name(self->language, symbol)
 
-static const unsigned MAX_VERSION_COUNT = 6;
-static const unsigned MAX_SUMMARY_DEPTH = 16;
+static const unsigned DEFAULT_MAX_VERSION_COUNT = 6;
+static const unsigned MIN_SUMMARY_DEPTH = 8;
+static const unsigned DEFAULT_SUMMARY_DEPTH = 16;
+static const unsigned MAX_SUMMARY_DEPTH = 64;
+static const unsigned SHALLOW_RECOVERY_COUNT_PER_SHRINK = 8;
 static const unsigned MAX_COST_DIFFERENCE = 16 * ERROR_COST_PER_SKIPPED_TREE;
-
-typedef struct {
-  unsigned cost;
-  unsigned node_count;
-  int dynamic_precedence;
-  bool is_in_error;
-} ErrorStatus;
+static const unsigned OP_COUNT_PER_TIMEOUT_CHECK = 100;
+static const unsigned MIN_COMPACT_ERROR_NODE_COUNT = 256;
+static const unsigned MAX_SNAPSHOT_DEPTH = 8;
 
 typedef enum {
   ErrorComparisonTakeLeft,
@@ -52,6 +64,120 @@ typedef enum {
   ErrorComparisonTakeRight,
 } ErrorComparison;
 
+// When profiling is enabled, the time spent in each phase of the parse is
+// measured around the calls made from the main loop, so that nested phases,
+// like the reductions performed during error recovery, aren't counted twice.
+static inline clock_t parser__start_phase(Parser *self) {
+  return self->is_profiling ? clock() : 0;
+}
+
+static inline uint64_t parser__phase_micros(clock_t start) {
+  return (uint64_t)(clock() - start) * 1000000 / CLOCKS_PER_SEC;
+}
+
+static inline void parser__end_phase(Parser *self, TSParsePhaseProfile *phase, clock_t start) {
+  if (self->is_profiling) {
+    phase->count++;
+    phase->micros += parser__phase_micros(start);
+  }
+}
+
+// The counts for every parse state and symbol are allocated up front, when the
+// parse starts, while the lex states, whose number the language doesn't
+// record, are added as they are entered.
+static void parser__reset_state_profile(Parser *self) {
+  StateProfile *profile = &self->state_profile;
+  array_clear(&profile->parse_states);
+  array_clear(&profile->lex_states);
+  array_clear(&profile->symbol_reductions);
+  if (!self->is_profiling_states) return;
+  array_reserve(&profile->parse_states, self->language->state_count);
+  memset(profile->parse_states.contents, 0, self->language->state_count * sizeof(TSParseStateProfile));
+  profile->parse_states.size = self->language->state_count;
+  array_reserve(&profile->symbol_reductions, self->language->symbol_count);
+  memset(profile->symbol_reductions.contents, 0, self->language->symbol_count * sizeof(uint32_t));
+  profile->symbol_reductions.size = self->language->symbol_count;
+}
+
+static inline void parser__profile_parse_state(Parser *self, TSStateId state, bool is_split) {
+  if (self->is_profiling_states && state < self->state_profile.parse_states.size) {
+    TSParseStateProfile *profile = &self->state_profile.parse_states.contents[state];
+    profile->entry_count++;
+    if (is_split) profile->split_count++;
+  }
+}
+
+static inline void parser__profile_reduction(Parser *self, TSStateId state, TSSymbol symbol) {
+  if (self->is_profiling_states) {
+    if (state < self->state_profile.parse_states.size) {
+      self->state_profile.parse_states.contents[state].reduction_count++;
+    }
+    if (symbol < self->state_profile.symbol_reductions.size) {
+      self->state_profile.symbol_reductions.contents[symbol]++;
+    }
+  }
+}
+
+static inline void parser__profile_lex_state(Parser *self, uint16_t lex_state) {
+  if (self->is_profiling_states) {
+    while (self->state_profile.lex_states.size <= lex_state) array_push(&self->state_profile.lex_states, 0);
+    self->state_profile.lex_states.contents[lex_state]++;
+  }
+}
+
+// Error recovery explores stack states and summary entries, and on inputs that
+// are mostly errors, such as binary files, this can dominate the parse. If a
+// budget is set, the recovery steps taken so far can't exceed that many steps
+// for every byte parsed so far. Once they do, errors are handled by skipping
+// tokens, without searching for a better way to recover, until the position
+// has advanced far enough to pay for more steps.
+static inline bool parser__can_afford_recovery(Parser *self, uint32_t byte) {
+  if (self->max_recovery_steps_per_byte == 0) return true;
+  if (self->stats.recovery_step_count <= (uint64_t)self->max_recovery_steps_per_byte * (byte + 1)) {
+    return true;
+  }
+  self->stats.limited_recovery_count++;
+  return false;
+}
+
+// The depth of the stack summaries that error recovery searches adapts to the
+// recoveries made so far in the parse. It doubles when a recovery needed most
+// of it, or when no recovery was found in a summary that reached it, and is
+// halved after a run of recoveries that stayed near the top of the stack. With
+// a budget of recovery steps, it is also halved while it exceeds the steps that
+// remain. It only takes a few values, because the stack can only reuse its
+// last summary when the depth hasn't changed.
+static unsigned parser__summary_depth(Parser *self, uint32_t byte) {
+  unsigned depth = self->summary_depth;
+  if (self->max_recovery_steps_per_byte > 0) {
+    uint64_t budget = (uint64_t)self->max_recovery_steps_per_byte * (byte + 1);
+    uint64_t remaining_step_count =
+      budget > self->stats.recovery_step_count ? budget - self->stats.recovery_step_count : 0;
+    while (depth > MIN_SUMMARY_DEPTH && depth > remaining_step_count) depth /= 2;
+  }
+  return depth;
+}
+
+static void parser__record_recovery_depth(Parser *self, bool did_recover, unsigned depth) {
+  if (did_recover && depth * 4 <= self->summary_depth) {
+    if (++self->shallow_recovery_count >= SHALLOW_RECOVERY_COUNT_PER_SHRINK) {
+      self->shallow_recovery_count = 0;
+      if (self->summary_depth > MIN_SUMMARY_DEPTH) self->summary_depth /= 2;
+    }
+    return;
+  }
+
+  self->shallow_recovery_count = 0;
+  if (depth * 2 > self->summary_depth && self->summary_depth < MAX_SUMMARY_DEPTH) {
+    self->summary_depth *= 2;
+  }
+}
+
+// A budget of zero means that the default budget is used.
+static inline unsigned parser__max_version_count(Parser *self) {
+  return self->max_version_count > 0 ? self->max_version_count : DEFAULT_MAX_VERSION_COUNT;
+}
+
 static void parser__log(Parser *self) {
   if (self->lexer.logger.log) {
     self->lexer.logger.log(
@@ -105,7 +231,7 @@ static bool parser__breakdown_top_of_stack(Parser *self, StackVersion version) {
         ts_stack_push(self->stack, slice.version, tree, false, state);
       }
 
-      ts_tree_release(&self->tree_pool, parent);
+      ts_tree_release(self->tree_pool, parent);
       array_delete(&slice.trees);
 
       LOG("breakdown_top_of_stack tree:%s", SYM_NAME(parent->symbol));
@@ -120,15 +246,16 @@ static void parser__breakdown_lookahead(Parser *self, Tree **lookahead,
                                         TSStateId state,
                                         ReusableNode *reusable_node) {
   bool did_break_down = false;
-  while (reusable_node->tree->children.size > 0 && reusable_node->tree->parse_state != state) {
-    LOG("state_mismatch sym:%s", SYM_NAME(reusable_node->tree->symbol));
+  while (reusable_node_tree(reusable_node)->children.size > 0 &&
+         reusable_node_tree(reusable_node)->parse_state != state) {
+    LOG("state_mismatch sym:%s", SYM_NAME(reusable_node_tree(reusable_node)->symbol));
     reusable_node_breakdown(reusable_node);
     did_break_down = true;
   }
 
   if (did_break_down) {
-    ts_tree_release(&self->tree_pool, *lookahead);
-    ts_tree_retain(*lookahead = reusable_node->tree);
+    ts_tree_release(self->tree_pool, *lookahead);
+    ts_tree_retain(*lookahead = reusable_node_tree(reusable_node));
   }
 }
 
@@ -212,7 +339,24 @@ static bool parser__better_version_exists(Parser *self, StackVersion version,
   return false;
 }
 
+// Record that the external scanner's state is now the one that was stored with
+// the given token, so that it doesn't need to be deserialized again.
+static void parser__set_external_scanner_state_token(Parser *self, Tree *external_token) {
+  if (external_token) ts_tree_retain(external_token);
+  if (self->external_scanner_state_token) {
+    ts_tree_release(self->tree_pool, self->external_scanner_state_token);
+  }
+  self->external_scanner_state_token = external_token;
+  self->external_scanner_state_is_current = true;
+}
+
 static void parser__restore_external_scanner(Parser *self, Tree *external_token) {
+  if (
+    self->external_scanner_state_is_current &&
+    ts_tree_external_token_state_eq(self->external_scanner_state_token, external_token)
+  ) return;
+
+  clock_t phase_start = parser__start_phase(self);
   if (external_token) {
     self->language->external_scanner.deserialize(
       self->external_scanner_payload,
@@ -222,16 +366,41 @@ static void parser__restore_external_scanner(Parser *self, Tree *external_token)
   } else {
     self->language->external_scanner.deserialize(self->external_scanner_payload, NULL, 0);
   }
+  parser__end_phase(self, &self->profile.external_deserialize, phase_start);
+  parser__set_external_scanner_state_token(self, external_token);
+}
+
+// A scanner can declare that two different serialized states are equivalent,
+// meaning that it would produce the same tokens when resumed from either one.
+// Subtrees that were parsed after one of the states can then be reused after
+// the other.
+static bool parser__external_scanner_states_match(Parser *self, const Tree *reusable_token,
+                                                  const Tree *external_token) {
+  if (ts_tree_external_token_state_eq(reusable_token, external_token)) return true;
+  if (!self->language->external_scanner.equivalent) return false;
+
+  const char *reusable_data = NULL, *data = NULL;
+  unsigned reusable_length = 0, length = 0;
+  if (reusable_token && reusable_token->has_external_tokens) {
+    reusable_data = ts_external_token_state_data(&reusable_token->external_token_state);
+    reusable_length = reusable_token->external_token_state.length;
+  }
+  if (external_token && external_token->has_external_tokens) {
+    data = ts_external_token_state_data(&external_token->external_token_state);
+    length = external_token->external_token_state.length;
+  }
+  return self->language->external_scanner.equivalent(reusable_data, reusable_length, data, length);
 }
 
 static Tree *parser__lex(Parser *self, StackVersion version, TSStateId parse_state) {
   Length start_position = ts_stack_position(self->stack, version);
   Tree *external_token = ts_stack_last_external_token(self->stack, version);
-  TSLexMode lex_mode = self->language->lex_modes[parse_state];
+  TSLexMode lex_mode = ts_language_lex_mode(self->language, parse_state);
   const bool *valid_external_tokens = ts_language_enabled_external_tokens(
     self->language,
     lex_mode.external_lex_state
   );
+  parser__profile_lex_state(self, lex_mode.lex_state);
 
   bool found_external_token = false;
   bool error_mode = parse_state == ERROR_STATE;
@@ -254,11 +423,15 @@ static Tree *parser__lex(Parser *self, StackVersion version, TSStateId parse_sta
       );
       ts_lexer_start(&self->lexer);
       parser__restore_external_scanner(self, external_token);
-      if (self->language->external_scanner.scan(
+      self->external_scanner_state_is_current = false;
+      clock_t phase_start = parser__start_phase(self);
+      bool found_token = self->language->external_scanner.scan(
         self->external_scanner_payload,
         &self->lexer.data,
         valid_external_tokens
-      )) {
+      );
+      parser__end_phase(self, &self->profile.external_scan, phase_start);
+      if (found_token) {
         if (length_is_undefined(self->lexer.token_end_position)) {
           self->lexer.token_end_position = self->lexer.current_position;
         }
@@ -282,13 +455,13 @@ static Tree *parser__lex(Parser *self, StackVersion version, TSStateId parse_sta
       current_position.extent.column
     );
     ts_lexer_start(&self->lexer);
-    if (self->language->lex_fn(&self->lexer.data, lex_mode.lex_state)) {
+    if (ts_language_lex(self->language, &self->lexer.data, lex_mode.lex_state)) {
       break;
     }
 
     if (!error_mode) {
       error_mode = true;
-      lex_mode = self->language->lex_modes[ERROR_STATE];
+      lex_mode = ts_language_lex_mode(self->language, ERROR_STATE);
       valid_external_tokens = ts_language_enabled_external_tokens(
         self->language,
         lex_mode.external_lex_state
@@ -314,6 +487,17 @@ static Tree *parser__lex(Parser *self, StackVersion version, TSStateId parse_sta
         break;
       }
       self->lexer.data.advance(&self->lexer, false);
+
+      // Skip the characters that can't begin a token without trying to lex
+      // at each of them, unless the external scanner has to be tried too.
+      if (!valid_external_tokens) {
+        while (
+          self->lexer.data.lookahead != 0 &&
+          !ts_language_can_start_error_token(self->language, self->lexer.data.lookahead)
+        ) {
+          self->lexer.data.advance(&self->lexer, false);
+        }
+      }
     }
 
     error_end_position = self->lexer.current_position;
@@ -327,7 +511,7 @@ static Tree *parser__lex(Parser *self, StackVersion version, TSStateId parse_sta
   if (skipped_error) {
     Length padding = length_sub(error_start_position, start_position);
     Length size = length_sub(error_end_position, error_start_position);
-    result = ts_tree_make_error(&self->tree_pool, size, padding, first_error_character, self->language);
+    result = ts_tree_make_error(self->tree_pool, size, padding, first_error_character, self->language);
   } else {
     if (self->lexer.token_end_position.bytes < self->lexer.token_start_position.bytes) {
       self->lexer.token_start_position = self->lexer.token_end_position;
@@ -336,69 +520,133 @@ static Tree *parser__lex(Parser *self, StackVersion version, TSStateId parse_sta
     TSSymbol symbol = self->lexer.data.result_symbol;
     Length padding = length_sub(self->lexer.token_start_position, start_position);
     Length size = length_sub(self->lexer.token_end_position, self->lexer.token_start_position);
+    uint64_t text_hash = self->lexer.token_end_text_hash;
 
     if (found_external_token) {
       symbol = self->language->external_scanner.symbol_map[symbol];
     } else if (symbol == self->language->keyword_capture_token && symbol != 0) {
+      uint32_t start_byte = self->lexer.token_start_position.bytes;
       uint32_t end_byte = self->lexer.token_end_position.bytes;
-      ts_lexer_reset(&self->lexer, self->lexer.token_start_position);
-      ts_lexer_start(&self->lexer);
       if (
-        self->language->keyword_lex_fn(&self->lexer.data, 0) &&
-        self->lexer.token_end_position.bytes == end_byte &&
-        ts_language_has_actions(self->language, parse_state, self->lexer.data.result_symbol)
+        self->language->keyword_table &&
+        self->lexer.input.encoding == TSInputEncodingUTF8 &&
+        start_byte >= self->lexer.chunk_start &&
+        end_byte <= self->lexer.chunk_start + self->lexer.chunk_size &&
+        ts_lexer_range_is_contiguous(&self->lexer, start_byte, end_byte)
       ) {
-        symbol = self->lexer.data.result_symbol;
+        TSSymbol keyword = ts_keyword_table_lookup(
+          self->language->keyword_table,
+          self->lexer.chunk + (start_byte - self->lexer.chunk_start),
+          end_byte - start_byte
+        );
+        if (keyword && ts_language_has_actions(self->language, parse_state, keyword)) {
+          symbol = keyword;
+        }
+      } else {
+        ts_lexer_reset(&self->lexer, self->lexer.token_start_position);
+        ts_lexer_start(&self->lexer);
+        if (
+          ts_language_lex_keyword(self->language, &self->lexer.data) &&
+          self->lexer.token_end_position.bytes == end_byte &&
+          ts_language_has_actions(self->language, parse_state, self->lexer.data.result_symbol)
+        ) {
+          symbol = self->lexer.data.result_symbol;
+        }
       }
     }
 
-    result = ts_tree_make_leaf(&self->tree_pool, symbol, padding, size, self->language);
-
-    if (found_external_token) {
+    result = ts_tree_make_leaf(self->tree_pool, symbol, padding, size, self->language);
+    result->fingerprint = ts_tree_leaf_fingerprint(symbol, size.bytes, text_hash);
+
+    // The scanner was restored to the previous external token's state before
+    // it scanned, so if it reports that its state hasn't changed since then,
+    // the new token shares that token's state without it being serialized.
+    if (
+      found_external_token &&
+      self->language->external_scanner.state_changed &&
+      !self->language->external_scanner.state_changed(self->external_scanner_payload)
+    ) {
       result->has_external_tokens = true;
+      if (external_token) {
+        ts_external_token_state_copy(&result->external_token_state, &external_token->external_token_state);
+      } else {
+        ts_external_token_state_init(&result->external_token_state, "", 0);
+      }
+      parser__set_external_scanner_state_token(self, result);
+    } else if (found_external_token) {
+      result->has_external_tokens = true;
+      clock_t phase_start = parser__start_phase(self);
       unsigned length = self->language->external_scanner.serialize(
         self->external_scanner_payload,
         self->lexer.debug_buffer
       );
-      ts_external_token_state_init(&result->external_token_state, self->lexer.debug_buffer, length);
+      parser__end_phase(self, &self->profile.external_serialize, phase_start);
+      ts_external_token_state_intern(
+        &result->external_token_state,
+        self->lexer.debug_buffer,
+        length,
+        external_token ? &external_token->external_token_state : NULL
+      );
+      parser__set_external_scanner_state_token(self, result);
     }
   }
 
   result->bytes_scanned = last_byte_scanned - start_position.bytes + 1;
   result->parse_state = parse_state;
   result->first_leaf.lex_mode = lex_mode;
+  if (self->intern_leaves) result = ts_tree_pool_intern_leaf(self->tree_pool, result);
 
   LOG("lexed_lookahead sym:%s, size:%u", SYM_NAME(result->symbol), result->size.bytes);
+  TRACE(TSTraceEventLex, version, parse_state, result->symbol, start_position.bytes, result->size.bytes);
   return result;
 }
 
-static Tree *parser__get_cached_token(Parser *self, size_t byte_index, Tree *last_external_token) {
+static void parser__clear_cached_tokens(Parser *self) {
   TokenCache *cache = &self->token_cache;
-  if (cache->token &&
-      cache->byte_index == byte_index &&
-      ts_tree_external_token_state_eq(cache->last_external_token, last_external_token)) {
-    return cache->token;
-  } else {
-    return NULL;
+  for (unsigned i = 0; i < TOKEN_CACHE_SIZE; i++) {
+    TokenCacheEntry *entry = &cache->entries[i];
+    if (entry->token) ts_tree_release(self->tree_pool, entry->token);
+    if (entry->last_external_token) ts_tree_release(self->tree_pool, entry->last_external_token);
+    *entry = (TokenCacheEntry){NULL, NULL, 0};
   }
+  cache->next_index = 0;
 }
 
 static void parser__set_cached_token(Parser *self, size_t byte_index, Tree *last_external_token,
                                      Tree *token) {
   TokenCache *cache = &self->token_cache;
-  if (token) ts_tree_retain(token);
+
+  // Replace any token lexed at the same position in the same lex mode. Otherwise,
+  // evict the oldest entry.
+  TokenCacheEntry *entry = &cache->entries[cache->next_index];
+  for (unsigned i = 0; i < TOKEN_CACHE_SIZE; i++) {
+    TokenCacheEntry *existing_entry = &cache->entries[i];
+    if (existing_entry->token &&
+        existing_entry->byte_index == byte_index &&
+        existing_entry->token->first_leaf.lex_mode.lex_state == token->first_leaf.lex_mode.lex_state &&
+        existing_entry->token->first_leaf.lex_mode.external_lex_state == token->first_leaf.lex_mode.external_lex_state &&
+        ts_tree_external_token_state_eq(existing_entry->last_external_token, last_external_token)) {
+      entry = existing_entry;
+      break;
+    }
+  }
+
+  if (entry == &cache->entries[cache->next_index]) {
+    cache->next_index = (cache->next_index + 1) % TOKEN_CACHE_SIZE;
+  }
+
+  ts_tree_retain(token);
   if (last_external_token) ts_tree_retain(last_external_token);
-  if (cache->token) ts_tree_release(&self->tree_pool, cache->token);
-  if (cache->last_external_token) ts_tree_release(&self->tree_pool, cache->last_external_token);
-  cache->token = token;
-  cache->byte_index = byte_index;
-  cache->last_external_token = last_external_token;
+  if (entry->token) ts_tree_release(self->tree_pool, entry->token);
+  if (entry->last_external_token) ts_tree_release(self->tree_pool, entry->last_external_token);
+  entry->token = token;
+  entry->byte_index = byte_index;
+  entry->last_external_token = last_external_token;
 }
 
 static bool parser__can_reuse_first_leaf(Parser *self, TSStateId state, Tree *tree,
-                                         TableEntry *table_entry,
-                                         ReusableNode *next_reusable_node) {
-  TSLexMode current_lex_mode = self->language->lex_modes[state];
+                                         TableEntry *table_entry) {
+  TSLexMode current_lex_mode = ts_language_lex_mode(self->language, state);
 
   // If the token was created in a state with the same set of lookaheads, it is reusable.
   if (tree->first_leaf.lex_mode.lex_state == current_lex_mode.lex_state &&
@@ -414,44 +662,80 @@ static bool parser__can_reuse_first_leaf(Parser *self, TSStateId state, Tree *tr
   return current_lex_mode.external_lex_state == 0 && table_entry->is_reusable;
 }
 
+static Tree *parser__get_cached_token(Parser *self, TSStateId state, size_t byte_index,
+                                      Tree *last_external_token, TableEntry *table_entry) {
+  TokenCache *cache = &self->token_cache;
+  for (unsigned i = 0; i < TOKEN_CACHE_SIZE; i++) {
+    TokenCacheEntry *entry = &cache->entries[i];
+    if (entry->token &&
+        entry->byte_index == byte_index &&
+        ts_tree_external_token_state_eq(entry->last_external_token, last_external_token)) {
+      ts_language_table_entry(self->language, state, entry->token->first_leaf.symbol, table_entry);
+      if (parser__can_reuse_first_leaf(self, state, entry->token, table_entry)) {
+        cache->hit_count++;
+        return entry->token;
+      }
+    }
+  }
+
+  cache->miss_count++;
+  return NULL;
+}
+
 static Tree *parser__get_lookahead(Parser *self, StackVersion version, TSStateId *state,
                                    ReusableNode *reusable_node, TableEntry *table_entry) {
   Length position = ts_stack_position(self->stack, version);
   Tree *last_external_token = ts_stack_last_external_token(self->stack, version);
 
   Tree *result;
-  while ((result = reusable_node->tree)) {
-    if (reusable_node->byte_index > position.bytes) {
+  while ((result = reusable_node_tree(reusable_node))) {
+    uint32_t byte_offset = reusable_node_byte_offset(reusable_node);
+    if (byte_offset > position.bytes) {
       LOG("before_reusable_node symbol:%s", SYM_NAME(result->symbol));
       break;
     }
 
-    if (reusable_node->byte_index < position.bytes) {
+    if (byte_offset < position.bytes) {
       LOG("past_reusable_node symbol:%s", SYM_NAME(result->symbol));
       reusable_node_pop(reusable_node);
       continue;
     }
 
-    if (!ts_tree_external_token_state_eq(reusable_node->last_external_token, last_external_token)) {
+    if (!parser__external_scanner_states_match(self, reusable_node->last_external_token, last_external_token)) {
       LOG("reusable_node_has_different_external_scanner_state symbol:%s", SYM_NAME(result->symbol));
+      self->stats.external_scanner_state_rejection_count++;
       reusable_node_pop(reusable_node);
       continue;
     }
 
     const char *reason = NULL;
+    uint32_t *rejection_count = &self->stats.other_rejection_count;
     if (result->has_changes) {
       reason = "has_changes";
+      rejection_count = &self->stats.changed_tree_rejection_count;
     } else if (result->symbol == ts_builtin_sym_error) {
       reason = "is_error";
     } else if (result->is_missing) {
       reason = "is_missing";
-    } else if (result->fragile_left || result->fragile_right) {
+    } else if (result->is_opaque) {
+      reason = "is_opaque";
+    } else if ((result->fragile_left || result->fragile_right) &&
+               (result->parse_state != *state || result->error_cost > 0)) {
       reason = "is_fragile";
-    } else if (self->in_ambiguity && result->children.size) {
+      rejection_count = &self->stats.fragile_tree_rejection_count;
+    } else if (self->in_ambiguity && result->children.size && result->parse_state != *state) {
+      // While there are several stack versions, a subtree can only be reused
+      // by a version that is already in the state from which the subtree was
+      // originally shifted, since any reductions that the version performs
+      // first could depend on which of the versions ends up being chosen. Each
+      // version advances with its own copy of the reusable node, so breaking
+      // the subtree down here doesn't prevent the other versions from reusing
+      // it.
       reason = "in_ambiguity";
     }
 
     if (reason) {
+      (*rejection_count)++;
       LOG("cant_reuse_node_%s tree:%s", reason, SYM_NAME(result->symbol));
       if (!reusable_node_breakdown(reusable_node)) {
         reusable_node_pop(reusable_node);
@@ -462,31 +746,35 @@ static Tree *parser__get_lookahead(Parser *self, StackVersion version, TSStateId
     }
 
     ts_language_table_entry(self->language, *state, result->first_leaf.symbol, table_entry);
-    ReusableNode next_reusable_node = reusable_node_after_leaf(reusable_node);
-    if (!parser__can_reuse_first_leaf(self, *state, result, table_entry, &next_reusable_node)) {
+    if (!parser__can_reuse_first_leaf(self, *state, result, table_entry)) {
       LOG(
         "cant_reuse_node symbol:%s, first_leaf_symbol:%s",
         SYM_NAME(result->symbol),
         SYM_NAME(result->first_leaf.symbol)
       );
-      *reusable_node = next_reusable_node;
+      self->stats.first_leaf_rejection_count++;
+      reusable_node_pop_leaf(reusable_node);
       break;
     }
 
     LOG("reuse_node symbol:%s", SYM_NAME(result->symbol));
+    TRACE(TSTraceEventReuse, version, *state, result->symbol, byte_offset, ts_tree_total_bytes(result));
+    self->stats.reused_tree_count++;
+    self->stats.reused_byte_count += ts_tree_total_bytes(result);
     ts_tree_retain(result);
     return result;
   }
 
-  if ((result = parser__get_cached_token(self, position.bytes, last_external_token))) {
-    ts_language_table_entry(self->language, *state, result->first_leaf.symbol, table_entry);
-    if (parser__can_reuse_first_leaf(self, *state, result, table_entry, NULL)) {
-      ts_tree_retain(result);
-      return result;
-    }
+  if ((result = parser__get_cached_token(self, *state, position.bytes, last_external_token, table_entry))) {
+    ts_tree_retain(result);
+    return result;
   }
 
+  clock_t phase_start = parser__start_phase(self);
   result = parser__lex(self, version, *state);
+  parser__end_phase(self, &self->profile.lex, phase_start);
+  self->stats.lexed_token_count++;
+  if (self->lexer.did_block) return result;
   parser__set_cached_token(self, position.bytes, last_external_token, result);
   ts_language_table_entry(self->language, *state, result->symbol, table_entry);
   return result;
@@ -542,11 +830,30 @@ static bool parser__select_tree(Parser *self, Tree *left, Tree *right) {
   }
 }
 
+// The text that the parser has examined so far ends at the furthest byte that
+// any of its lookaheads scanned. A reused subtree's parse actions only depend
+// on its first leaf, so until the subtree is shifted, only the text that its
+// first leaf scanned has been examined. Once it is shifted, all of the text
+// that it scanned has been. Fragile nodes and snapshots depend on this text.
+static void parser__extend_scanned_end_byte(Parser *self, uint32_t start_byte, uint32_t bytes_scanned) {
+  uint32_t scanned_end_byte = start_byte + bytes_scanned;
+  if (scanned_end_byte > self->scanned_end_byte) self->scanned_end_byte = scanned_end_byte;
+}
+
+static uint32_t parser__first_leaf_bytes_scanned(const Tree *tree) {
+  while (tree->children.size > 0) tree = tree->children.contents[0];
+  return tree->bytes_scanned;
+}
+
 static void parser__shift(Parser *self, StackVersion version, TSStateId state,
                           Tree *lookahead, bool extra) {
+  if (lookahead->children.size > 0) {
+    parser__extend_scanned_end_byte(self, ts_stack_position(self->stack, version).bytes, lookahead->bytes_scanned);
+  }
+
   if (extra != lookahead->extra) {
-    if (ts_stack_version_count(self->stack) > 1) {
-      lookahead = ts_tree_make_copy(&self->tree_pool, lookahead);
+    if (ts_stack_version_count(self->stack) > 1 || lookahead->is_interned) {
+      lookahead = ts_tree_make_copy(self->tree_pool, lookahead);
     } else {
       ts_tree_retain(lookahead);
     }
@@ -564,24 +871,301 @@ static void parser__shift(Parser *self, StackVersion version, TSStateId state,
   }
 }
 
+static bool parser__opaque_region_is_expanded(Parser *self, uint32_t byte) {
+  uint32_t low = 0, high = self->expanded_opaque_byte_count;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if (self->expanded_opaque_bytes[mid] == byte) return true;
+    if (self->expanded_opaque_bytes[mid] < byte) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return false;
+}
+
+// Find the end of the region that the given opening token starts, by lexing
+// the tokens that follow it in the error state, where any token can occur, and
+// counting the opening and closing tokens. Nothing is parsed, so this is much
+// faster than parsing the region. Return whether a matching closing token was
+// found. The hashes of the tokens' text, and their end offsets within the
+// region, are combined into the given hash, for the region's fingerprint.
+static bool parser__find_opaque_region_end(Parser *self, const TSOpaqueRegion *region,
+                                           Length position, Length *end_position,
+                                           uint64_t *text_hash) {
+  TSStateId lex_state = ts_language_lex_mode(self->language, ERROR_STATE).lex_state;
+  TSSymbol keyword_capture_token = self->language->keyword_capture_token;
+  uint32_t start_byte = position.bytes;
+  uint32_t depth = 1;
+
+  for (;;) {
+    ts_lexer_reset(&self->lexer, position);
+    ts_lexer_start(&self->lexer);
+    if (!ts_language_lex(self->language, &self->lexer.data, lex_state)) {
+      if (self->lexer.data.lookahead == 0) return false;
+      ts_lexer_reset(&self->lexer, position);
+      ts_lexer_start(&self->lexer);
+      self->lexer.data.advance(&self->lexer, false);
+      position = self->lexer.current_position;
+      continue;
+    }
+
+    if (length_is_undefined(self->lexer.token_end_position)) {
+      self->lexer.token_end_position = self->lexer.current_position;
+    }
+    Length token_end_position = self->lexer.token_end_position;
+    if (token_end_position.bytes <= position.bytes) {
+      if (self->lexer.data.lookahead == 0) return false;
+      self->lexer.data.advance(&self->lexer, false);
+      position = self->lexer.current_position;
+      continue;
+    }
+    *text_hash =
+      (*text_hash ^ self->lexer.token_end_text_hash) * 0x100000001b3ull +
+      (token_end_position.bytes - start_byte);
+
+    TSSymbol symbol = self->lexer.data.result_symbol;
+    if (symbol == keyword_capture_token && symbol != 0) {
+      ts_lexer_reset(&self->lexer, self->lexer.token_start_position);
+      ts_lexer_start(&self->lexer);
+      if (ts_language_lex_keyword(self->language, &self->lexer.data) &&
+          self->lexer.token_end_position.bytes == token_end_position.bytes) {
+        symbol = self->lexer.data.result_symbol;
+      }
+    }
+
+    if (symbol == region->open_token) {
+      depth++;
+    } else if (symbol == region->close_token && --depth == 0) {
+      *end_position = token_end_position;
+      return true;
+    }
+    position = token_end_position;
+  }
+}
+
+// When a token that opens an opaque region is about to be shifted in a state
+// where the region's symbol can occur, the whole region is pushed as a single
+// childless node of that symbol, unless the document has expanded the region.
+static bool parser__skip_opaque_region(Parser *self, StackVersion version, TSStateId state,
+                                       Tree *lookahead) {
+  const TSOpaqueRegion *region = NULL;
+  TSStateId next_state = 0;
+  for (uint32_t i = 0; i < self->opaque_region_count; i++) {
+    if (self->opaque_regions[i].open_token == lookahead->symbol) {
+      next_state = ts_language_next_state(self->language, state, self->opaque_regions[i].symbol);
+      if (next_state != 0) {
+        region = &self->opaque_regions[i];
+        break;
+      }
+    }
+  }
+  if (!region) return false;
+
+  Length position = ts_stack_position(self->stack, version);
+  Length start_position = length_add(position, lookahead->padding);
+  if (parser__opaque_region_is_expanded(self, start_position.bytes)) return false;
+
+  Length end_position;
+  uint64_t text_hash = lookahead->fingerprint;
+  if (!parser__find_opaque_region_end(self, region, length_add(start_position, lookahead->size),
+                                      &end_position, &text_hash)) return false;
+
+  Length size = length_sub(end_position, start_position);
+  Tree *tree = ts_tree_make_leaf(self->tree_pool, region->symbol, lookahead->padding, size, self->language);
+  tree->fingerprint = ts_tree_leaf_fingerprint(region->symbol, size.bytes, text_hash);
+  tree->is_opaque = true;
+  tree->first_leaf = lookahead->first_leaf;
+  tree->parse_state = state;
+  tree->bytes_scanned = self->lexer.current_position.bytes - position.bytes + 1;
+
+  LOG("skip_opaque_region sym:%s, size:%u", SYM_NAME(region->symbol), tree->size.bytes);
+  TRACE(TSTraceEventShift, version, next_state, region->symbol, position.bytes, 0);
+  ts_stack_push(self->stack, version, tree, false, next_state);
+  return true;
+}
+
 static bool parser__replace_children(Parser *self, Tree *tree, TreeArray *children) {
   self->scratch_tree = *tree;
   self->scratch_tree.children.size = 0;
   ts_tree_set_children(&self->scratch_tree, children, self->language);
   if (parser__select_tree(self, tree, &self->scratch_tree)) {
-    *tree = self->scratch_tree;
+    ts_tree_replace_children(self->tree_pool, tree, &self->scratch_tree);
     return true;
   } else {
     return false;
   }
 }
 
+// A fragile node can only be reused in the state in which it was parsed, and
+// only if none of the text that the parser examined before deciding how to
+// parse it has changed. That text is included in the node's scanned bytes, so
+// that editing it invalidates the node.
+static void parser__extend_bytes_scanned(Parser *self, Tree *tree, uint32_t start_byte) {
+  if (self->scanned_end_byte > start_byte && self->scanned_end_byte - start_byte > tree->bytes_scanned) {
+    tree->bytes_scanned = self->scanned_end_byte - start_byte;
+  }
+}
+
+static void parser__release_ambiguous_trees(Parser *self, bool should_extend) {
+  for (uint32_t i = 0; i < self->ambiguous_trees.size; i++) {
+    AmbiguousTree *entry = &self->ambiguous_trees.contents[i];
+    if (should_extend) parser__extend_bytes_scanned(self, entry->tree, entry->start_byte);
+    ts_tree_release(self->tree_pool, entry->tree);
+  }
+  array_clear(&self->ambiguous_trees);
+}
+
+static inline bool parser__has_event_handler(const Parser *self) {
+  return self->event_handler.shift || self->event_handler.reduce;
+}
+
+// Report the events for a tree's visible nodes, in post-order, and return the
+// number of visible nodes that the tree contributes to its parent's children.
+// The leaf that has replaced the trees streamed so far stands for the nodes
+// that were reported along with them.
+static uint32_t parser__report_parse_events(Parser *self, const Tree *tree, Length position,
+                                            TSSymbol alias_symbol) {
+  if (tree == self->streamed_leaf) return self->streamed_leaf_node_count;
+
+  uint32_t child_count = 0;
+  uint32_t structural_child_index = 0;
+  Length child_position = position;
+  for (uint32_t i = 0; i < tree->children.size; i++) {
+    const Tree *child = tree->children.contents[i];
+    TSSymbol child_alias_symbol = 0;
+    if (!child->extra) {
+      child_alias_symbol = ts_language_alias_at(self->language, tree->alias_sequence_id, structural_child_index);
+      structural_child_index++;
+    }
+    child_count += parser__report_parse_events(self, child, child_position, child_alias_symbol);
+    child_position = length_add(child_position, ts_tree_total_size(child));
+  }
+
+  if (!tree->visible && !alias_symbol) return child_count;
+
+  TSSymbol symbol = alias_symbol ? alias_symbol : tree->symbol;
+  uint32_t start_byte = position.bytes + tree->padding.bytes;
+  uint32_t end_byte = start_byte + tree->size.bytes;
+  if (tree->children.size == 0) {
+    if (self->event_handler.shift) {
+      self->event_handler.shift(self->event_handler.payload, symbol, start_byte, end_byte);
+    }
+  } else if (self->event_handler.reduce) {
+    self->event_handler.reduce(self->event_handler.payload, symbol, start_byte, end_byte, child_count);
+  }
+  return 1;
+}
+
+static void parser__stream_tree(Parser *self, Tree *tree, Length position) {
+  if (tree->visible) {
+    ts_tree_resolve_child_counts(tree, &self->tree_pool->tree_stack, self->language);
+    self->streamed_node_callback(
+      self->streamed_node_payload,
+      ts_node_make(tree, position, 0, tree, self->language)
+    );
+    return;
+  }
+
+  for (uint32_t i = 0; i < tree->children.size; i++) {
+    Tree *child = tree->children.contents[i];
+    parser__stream_tree(self, child, position);
+    position = length_add(position, ts_tree_total_size(child));
+  }
+}
+
+// Whether a tree of the given symbol, at the bottom of the stack, is the start
+// rule's repetition. That is an auxiliary repetition which leads from the
+// start state to a state that reduces to the start rule at the end of the
+// input. Such a tree can only be reduced into a larger repetition or into the
+// root, so its elements are the root's children.
+static bool parser__is_top_level_repetition(Parser *self, TSSymbol symbol) {
+  TSSymbolMetadata metadata = ts_language_symbol_metadata(self->language, symbol);
+  if (symbol < self->language->token_count || metadata.visible || metadata.named) return false;
+  TSStateId state = ts_language_next_state(self->language, 1, symbol);
+  if (state == 0) return false;
+
+  uint32_t count;
+  const TSParseAction *actions = ts_language_actions(self->language, state, ts_builtin_sym_end, &count);
+  for (uint32_t i = 0; i < count; i++) {
+    if (actions[i].type != TSParseActionTypeReduce) continue;
+    TSStateId root_state = ts_language_next_state(self->language, 1, actions[i].params.symbol);
+    if (root_state == 0) continue;
+    uint32_t root_action_count;
+    const TSParseAction *root_actions = ts_language_actions(
+      self->language, root_state, ts_builtin_sym_end, &root_action_count
+    );
+    for (uint32_t j = 0; j < root_action_count; j++) {
+      if (root_actions[j].type == TSParseActionTypeAccept) return true;
+    }
+  }
+  return false;
+}
+
+// In a streaming parse, once the stack has a single version and the tree at
+// the bottom of its stack is the start rule's repetition, that tree's elements
+// are complete top-level nodes. They are passed to the callback, and the tree
+// is replaced by a hidden leaf of the same size, so that the memory it used
+// can be reused. The leaves that have replaced earlier trees have nothing
+// left to visit. Error recovery doesn't recover to the start state once
+// anything has been streamed, so that the streamed nodes are never wrapped
+// in an error.
+static void parser__stream_completed_trees(Parser *self) {
+  Tree **bottom_tree = ts_stack_bottom_tree(self->stack, 0);
+  if (!bottom_tree) return;
+  Tree *tree = *bottom_tree;
+  if (tree->children.size == 0 || !parser__is_top_level_repetition(self, tree->symbol)) return;
+
+  uint32_t node_count = 0;
+  if (parser__has_event_handler(self)) {
+    node_count = parser__report_parse_events(self, tree, length_zero(), 0);
+  } else {
+    parser__stream_tree(self, tree, length_zero());
+  }
+
+  Tree *leaf = ts_tree_make_leaf(self->tree_pool, tree->symbol, tree->padding, tree->size, self->language);
+  leaf->visible = false;
+  leaf->named = false;
+  leaf->extra = tree->extra;
+  leaf->fragile_left = true;
+  leaf->fragile_right = true;
+  leaf->parse_state = tree->parse_state;
+  leaf->error_cost = tree->error_cost;
+  leaf->dynamic_precedence = tree->dynamic_precedence;
+  leaf->bytes_scanned = tree->bytes_scanned;
+  leaf->first_leaf = tree->first_leaf;
+  *bottom_tree = leaf;
+  self->streamed_leaf = leaf;
+  self->streamed_leaf_node_count = node_count;
+  ts_tree_release(self->tree_pool, tree);
+}
+
 static StackSliceArray parser__reduce(Parser *self, StackVersion version, TSSymbol symbol,
                                      uint32_t count, int dynamic_precedence,
-                                     uint16_t alias_sequence_id, bool fragile) {
+                                     uint16_t alias_sequence_id, bool fragile,
+                                     bool is_only_action) {
   uint32_t initial_version_count = ts_stack_version_count(self->stack);
 
-  StackSliceArray pop = ts_stack_pop_count(self->stack, version, count);
+  // A repetition that is reduced along with its next element can absorb the element,
+  // rather than becoming the child of a new node, as long as nothing else can observe
+  // it: no other version may share the popped entries, and this version must not be
+  // used again once it has been reduced.
+  bool can_extend_repetition =
+    is_only_action && count == 2 && dynamic_precedence == 0 && alias_sequence_id == 0 &&
+    ts_stack_top_is_exclusive(self->stack, version, count);
+
+  // Unless the popped trees may be absorbed into a repetition, the parent node
+  // is allocated first, so that the stack can write a short run of children
+  // directly into its child slots.
+  Tree *new_parent = NULL;
+  TreeArray child_storage = array_new();
+  if (!can_extend_repetition) {
+    new_parent = ts_tree_pool_allocate_node(self->tree_pool);
+    child_storage = ts_tree_child_slots(new_parent);
+  }
+
+  StackSliceArray pop = ts_stack_pop_count_into(self->stack, version, count, child_storage);
 
   for (uint32_t i = 0; i < pop.size; i++) {
     StackSlice slice = pop.contents[i];
@@ -590,14 +1174,25 @@ static StackSliceArray parser__reduce(Parser *self, StackVersion version, TSSymb
     // node. They will be re-pushed onto the stack after the parent node is
     // created and pushed.
     TreeArray children = slice.trees;
-    while (children.size > 0 && children.contents[children.size - 1]->extra) {
-      children.size--;
+    TreeArray trailing_extras = ts_tree_array_remove_trailing_extras(&children);
+
+    Tree *parent;
+    if (can_extend_repetition && pop.size == 1 && children.size == 2 &&
+        children.contents[0]->symbol == symbol && children.contents[0]->ref_count == 2 &&
+        ts_tree_push_repetition(self->tree_pool, children.contents[0], children.contents[1], self->language)) {
+      parent = children.contents[0];
+      array_delete(&children);
+    } else if (new_parent) {
+      parent = ts_tree_init_node(self->tree_pool,
+        new_parent, symbol, &children, alias_sequence_id, self->language
+      );
+      new_parent = NULL;
+    } else {
+      parent = ts_tree_make_node(self->tree_pool,
+        symbol, &children, alias_sequence_id, self->language
+      );
     }
 
-    Tree *parent = ts_tree_make_node(&self->tree_pool,
-      symbol, &children, alias_sequence_id, self->language
-    );
-
     // This pop operation may have caused multiple stack versions to collapse
     // into one, because they all diverged from a common state. In that case,
     // choose one of the arrays of trees to be the parent node's children, and
@@ -608,15 +1203,15 @@ static StackSliceArray parser__reduce(Parser *self, StackVersion version, TSSymb
       i++;
 
       TreeArray children = next_slice.trees;
-      while (children.size > 0 && children.contents[children.size - 1]->extra) {
-        children.size--;
-      }
+      TreeArray next_trailing_extras = ts_tree_array_remove_trailing_extras(&children);
 
       if (parser__replace_children(self, parent, &children)) {
-        ts_tree_array_delete(&self->tree_pool, &slice.trees);
+        ts_tree_array_delete(self->tree_pool, &trailing_extras);
+        trailing_extras = next_trailing_extras;
         slice = next_slice;
       } else {
-        ts_tree_array_delete(&self->tree_pool, &next_slice.trees);
+        ts_tree_array_delete(self->tree_pool, &children);
+        ts_tree_array_delete(self->tree_pool, &next_trailing_extras);
       }
     }
 
@@ -628,33 +1223,53 @@ static StackSliceArray parser__reduce(Parser *self, StackVersion version, TSSymb
     if (fragile || self->in_ambiguity || pop.size > 1 || initial_version_count > 1) {
       parent->fragile_left = true;
       parent->fragile_right = true;
-      parent->parse_state = TS_TREE_STATE_NONE;
-    } else {
-      parent->parse_state = state;
+      uint32_t start_byte = ts_stack_position(self->stack, slice.version).bytes;
+      parser__extend_bytes_scanned(self, parent, start_byte);
+      if (ts_stack_version_count(self->stack) > 1) {
+        ts_tree_retain(parent);
+        array_push(&self->ambiguous_trees, ((AmbiguousTree){parent, start_byte}));
+      }
+    }
+    parent->parse_state = state;
+    if (tree_builder_is_active(&self->tree_builder) && parent->visible) {
+      tree_builder_build(
+        &self->tree_builder, parent,
+        ts_stack_position(self->stack, slice.version).bytes
+      );
     }
 
     // Push the parent node onto the stack, along with any extra tokens that
     // were previously on top of the stack.
     ts_stack_push(self->stack, slice.version, parent, false, next_state);
-    for (uint32_t j = parent->children.size; j < slice.trees.size; j++) {
-      ts_stack_push(self->stack, slice.version, slice.trees.contents[j], false, next_state);
+    for (uint32_t j = 0; j < trailing_extras.size; j++) {
+      ts_stack_push(self->stack, slice.version, trailing_extras.contents[j], false, next_state);
     }
+    array_delete(&trailing_extras);
 
-    if (ts_stack_version_count(self->stack) > MAX_VERSION_COUNT) {
+    if (ts_stack_version_count(self->stack) > parser__max_version_count(self)) {
+      uint32_t pruned_version_count = 0;
       i++;
       while (i < pop.size) {
         StackSlice slice = pop.contents[i];
-        ts_tree_array_delete(&self->tree_pool, &slice.trees);
+        ts_tree_array_delete(self->tree_pool, &slice.trees);
         ts_stack_halt(self->stack, slice.version);
+        pruned_version_count++;
         i++;
       }
       while (ts_stack_version_count(self->stack) > slice.version + 1) {
         ts_stack_remove_version(self->stack, slice.version + 1);
+        pruned_version_count++;
+      }
+      if (pruned_version_count > 0) {
+        self->stats.prune_count++;
+        self->stats.pruned_version_count += pruned_version_count;
       }
       break;
     }
   }
 
+  if (new_parent) ts_tree_pool_free(self->tree_pool, new_parent);
+
   for (StackVersion i = initial_version_count; i < ts_stack_version_count(self->stack); i++) {
     for (StackVersion j = initial_version_count; j < i; j++) {
       if (ts_stack_merge(self->stack, j, i)) {
@@ -667,23 +1282,85 @@ static StackSliceArray parser__reduce(Parser *self, StackVersion version, TSSymb
   return pop;
 }
 
+static void parser__record_tree_pool_capacity(Parser *self) {
+  TreePoolCapacity capacity = ts_tree_pool_capacity(self->tree_pool);
+  TreePoolCapacity *max = &self->tree_pool_capacity;
+  if (capacity.free_leaf_count > max->free_leaf_count) max->free_leaf_count = capacity.free_leaf_count;
+  if (capacity.free_node_count > max->free_node_count) max->free_node_count = capacity.free_node_count;
+  if (capacity.tree_stack_size > max->tree_stack_size) max->tree_stack_size = capacity.tree_stack_size;
+}
+
+static void parser__clear_snapshots(Parser *self) {
+  ts_stack_snapshot_clear(&self->confirmed_snapshot.stack, self->tree_pool);
+  ts_stack_snapshot_clear(&self->pending_snapshot.stack, self->tree_pool);
+}
+
+// A snapshot is taken whenever the stack is shallow enough to be copied
+// cheaply. The latest snapshot may depend on the end of the input, as when its
+// last token could be extended by appended text, so it is only confirmed once
+// the parser has moved past all of the text that it depends on.
+static void parser__record_snapshot(Parser *self) {
+  if (!ts_stack_is_active(self->stack, 0) || ts_stack_state(self->stack, 0) == ERROR_STATE ||
+      ts_stack_error_cost(self->stack, 0) > 0) return;
+
+  uint32_t byte = ts_stack_position(self->stack, 0).bytes;
+  ParseSnapshot *pending = &self->pending_snapshot;
+  bool has_pending = pending->stack.entries.size > 0;
+  if (has_pending && byte <= pending->byte) return;
+
+  bool confirms_pending = has_pending && byte >= pending->dependency_end_byte;
+  ParseSnapshot *snapshot = confirms_pending ? &self->confirmed_snapshot : pending;
+  if (!ts_stack_take_snapshot(self->stack, 0, MAX_SNAPSHOT_DEPTH, &snapshot->stack)) return;
+  snapshot->byte = byte;
+  snapshot->dependency_end_byte = self->scanned_end_byte;
+  if (confirms_pending) {
+    ParseSnapshot confirmed = *pending;
+    *pending = self->confirmed_snapshot;
+    self->confirmed_snapshot = confirmed;
+  }
+}
+
 static void parser__start(Parser *self, TSInput input, Tree *previous_tree) {
   if (previous_tree) {
     LOG("parse_after_edit");
   } else {
     LOG("new_parse");
   }
+  TRACE(TSTraceEventStartParse, 0, 0, 0, 0, previous_tree != NULL);
 
   if (self->language->external_scanner.deserialize) {
     self->language->external_scanner.deserialize(self->external_scanner_payload, NULL, 0);
+    parser__set_external_scanner_state_token(self, NULL);
   }
 
   ts_lexer_set_input(&self->lexer, input);
   ts_stack_clear(self->stack);
-  self->reusable_node = reusable_node_new(previous_tree);
+  reusable_node_reset(&self->reusable_node, previous_tree);
   self->finished_tree = NULL;
   self->accept_count = 0;
   self->in_ambiguity = false;
+  parser__release_ambiguous_trees(self, false);
+  self->scanned_end_byte = 0;
+  parser__clear_snapshots(self);
+
+  // A parse that resumes from a snapshot doesn't reuse the previous tree,
+  // because the text that follows the snapshot is meant to be short.
+  if (previous_tree && self->resume_snapshot) {
+    LOG("resume_from_snapshot byte:%u", self->resume_snapshot->byte);
+    ts_stack_restore_snapshot(self->stack, &self->resume_snapshot->stack);
+    reusable_node_reset(&self->reusable_node, NULL);
+    self->scanned_end_byte = self->resume_snapshot->dependency_end_byte;
+  }
+  self->token_cache.hit_count = 0;
+  self->token_cache.miss_count = 0;
+  self->stats = (TSParseStats){0};
+  self->profile = (TSParseProfile){0};
+  self->lexer.column_rescan_count = 0;
+  self->lexer.column_rescan_byte_count = 0;
+  parser__reset_state_profile(self);
+  ts_tree_pool_prune_interned_leaves(self->tree_pool);
+  parser__record_tree_pool_capacity(self);
+  ts_tree_pool_reserve(self->tree_pool, self->tree_pool_capacity);
 }
 
 static void parser__accept(Parser *self, StackVersion version, Tree *lookahead) {
@@ -705,10 +1382,10 @@ static void parser__accept(Parser *self, StackVersion version, Tree *lookahead)
         }
         array_splice(&trees, j, 1, &child->children);
         root = ts_tree_make_node(
-          &self->tree_pool, child->symbol, &trees,
+          self->tree_pool, child->symbol, &trees,
           child->alias_sequence_id, self->language
         );
-        ts_tree_release(&self->tree_pool, child);
+        ts_tree_release(self->tree_pool, child);
         break;
       }
     }
@@ -718,10 +1395,10 @@ static void parser__accept(Parser *self, StackVersion version, Tree *lookahead)
 
     if (self->finished_tree) {
       if (parser__select_tree(self, self->finished_tree, root)) {
-        ts_tree_release(&self->tree_pool, self->finished_tree);
+        ts_tree_release(self->tree_pool, self->finished_tree);
         self->finished_tree = root;
       } else {
-        ts_tree_release(&self->tree_pool, root);
+        ts_tree_release(self->tree_pool, root);
       }
     } else {
       self->finished_tree = root;
@@ -742,6 +1419,7 @@ static bool parser__do_all_potential_reductions(Parser *self, StackVersion start
     uint32_t version_count = ts_stack_version_count(self->stack);
     if (version >= version_count) break;
 
+    self->stats.recovery_step_count++;
     bool merged = false;
     for (StackVersion i = initial_version_count; i < version; i++) {
       if (ts_stack_merge(self->stack, i, version)) {
@@ -753,7 +1431,7 @@ static bool parser__do_all_potential_reductions(Parser *self, StackVersion start
 
     TSStateId state = ts_stack_state(self->stack, version);
     bool has_shift_action = false;
-    array_clear(&self->reduce_actions);
+    ts_reduce_action_set_clear(&self->reduce_actions);
 
     TSSymbol first_symbol, end_symbol;
     if (lookahead_symbol != 0) {
@@ -788,19 +1466,19 @@ static bool parser__do_all_potential_reductions(Parser *self, StackVersion start
       }
     }
 
-    for (uint32_t i = 0; i < self->reduce_actions.size; i++) {
-      ReduceAction action = self->reduce_actions.contents[i];
+    for (uint32_t i = 0; i < self->reduce_actions.actions.size; i++) {
+      ReduceAction action = self->reduce_actions.actions.contents[i];
 
       parser__reduce(
         self, version, action.symbol, action.count,
         action.dynamic_precedence, action.alias_sequence_id,
-        true
+        true, false
       );
     }
 
     if (has_shift_action) {
       can_shift_lookahead_symbol = true;
-    } else if (self->reduce_actions.size > 0 && i < MAX_VERSION_COUNT) {
+    } else if (self->reduce_actions.actions.size > 0 && i < parser__max_version_count(self)) {
       ts_stack_renumber_version(self->stack, version_count, version);
       continue;
     } else if (lookahead_symbol != 0) {
@@ -818,6 +1496,13 @@ static bool parser__do_all_potential_reductions(Parser *self, StackVersion start
 }
 
 static void parser__handle_error(Parser *self, StackVersion version, TSSymbol lookahead_symbol) {
+  if (!parser__can_afford_recovery(self, ts_stack_position(self->stack, version).bytes)) {
+    LOG("skip_error_handling");
+    ts_stack_push(self->stack, version, NULL, false, ERROR_STATE);
+    ts_stack_record_summary(self->stack, version, MIN_SUMMARY_DEPTH);
+    return;
+  }
+
   // Perform any reductions that could have happened in this state, regardless of the lookahead.
   uint32_t previous_version_count = ts_stack_version_count(self->stack);
   parser__do_all_potential_reductions(self, version, 0);
@@ -843,7 +1528,7 @@ static void parser__handle_error(Parser *self, StackVersion version, TSSymbol lo
           lookahead_symbol
         )) {
           StackVersion version_with_missing_tree = ts_stack_copy_version(self->stack, v);
-          Tree *missing_tree = ts_tree_make_missing_leaf(&self->tree_pool, missing_symbol, self->language);
+          Tree *missing_tree = ts_tree_make_missing_leaf(self->tree_pool, missing_symbol, self->language);
           ts_stack_push(
             self->stack, version_with_missing_tree,
             missing_tree, false,
@@ -874,7 +1559,10 @@ static void parser__handle_error(Parser *self, StackVersion version, TSSymbol lo
     assert(ts_stack_merge(self->stack, version, previous_version_count));
   }
 
-  ts_stack_record_summary(self->stack, version, MAX_SUMMARY_DEPTH);
+  unsigned summary_depth = parser__summary_depth(self, ts_stack_position(self->stack, version).bytes);
+  if (summary_depth > self->stats.max_summary_depth) self->stats.max_summary_depth = summary_depth;
+  ts_stack_record_summary(self->stack, version, summary_depth);
+  self->stats.recovery_step_count += ts_stack_get_summary(self->stack, version)->size;
   LOG_STACK();
 }
 
@@ -888,17 +1576,17 @@ static void parser__halt_parse(Parser *self) {
     ts_stack_position(self->stack, 0)
   );
 
-  Tree *filler_node = ts_tree_make_error(&self->tree_pool, remaining_length, length_zero(), 0, self->language);
+  Tree *filler_node = ts_tree_make_error(self->tree_pool, remaining_length, length_zero(), 0, self->language);
   filler_node->visible = false;
   ts_stack_push(self->stack, 0, filler_node, false, 0);
 
   TreeArray children = array_new();
-  Tree *root_error = ts_tree_make_error_node(&self->tree_pool, &children, self->language);
+  Tree *root_error = ts_tree_make_error_node(self->tree_pool, &children, self->language);
   ts_stack_push(self->stack, 0, root_error, false, 0);
 
-  Tree *eof = ts_tree_make_leaf(&self->tree_pool, ts_builtin_sym_end, length_zero(), length_zero(), self->language);
+  Tree *eof = ts_tree_make_leaf(self->tree_pool, ts_builtin_sym_end, length_zero(), length_zero(), self->language);
   parser__accept(self, 0, eof);
-  ts_tree_release(&self->tree_pool, eof);
+  ts_tree_release(self->tree_pool, eof);
 }
 
 static bool parser__recover_to_state(Parser *self, StackVersion version, unsigned depth,
@@ -910,14 +1598,14 @@ static bool parser__recover_to_state(Parser *self, StackVersion version, unsigne
     StackSlice slice = pop.contents[i];
 
     if (slice.version == previous_version) {
-      ts_tree_array_delete(&self->tree_pool, &slice.trees);
+      ts_tree_array_delete(self->tree_pool, &slice.trees);
       array_erase(&pop, i--);
       continue;
     }
 
     if (ts_stack_state(self->stack, slice.version) != goal_state) {
       ts_stack_halt(self->stack, slice.version);
-      ts_tree_array_delete(&self->tree_pool, &slice.trees);
+      ts_tree_array_delete(self->tree_pool, &slice.trees);
       array_erase(&pop, i--);
       continue;
     }
@@ -929,13 +1617,13 @@ static bool parser__recover_to_state(Parser *self, StackVersion version, unsigne
       for (unsigned j = 0; j < error_trees.contents[0]->children.size; j++) {
         ts_tree_retain(slice.trees.contents[j]);
       }
-      ts_tree_array_delete(&self->tree_pool, &error_trees);
+      ts_tree_array_delete(self->tree_pool, &error_trees);
     }
 
     TreeArray trailing_extras = ts_tree_array_remove_trailing_extras(&slice.trees);
 
     if (slice.trees.size > 0) {
-      Tree *error = ts_tree_make_error_node(&self->tree_pool, &slice.trees, self->language);
+      Tree *error = ts_tree_make_error_node(self->tree_pool, &slice.trees, self->language);
       error->extra = true;
       ts_stack_push(self->stack, slice.version, error, false, goal_state);
     } else {
@@ -954,6 +1642,41 @@ static bool parser__recover_to_state(Parser *self, StackVersion version, unsigne
   return previous_version != STACK_VERSION_NONE;
 }
 
+// Long runs of skipped tokens, such as those in a binary blob or in text
+// written in a different language, are collapsed into a single error leaf
+// that spans all of their text, so that the cost of skipping each further
+// token doesn't depend on the number of tokens that were skipped before it.
+// The leaf's error cost is the cost of skipping each of the trees that it
+// replaced, so that the version's total error cost is unchanged.
+static inline bool parser__is_compact_error_repeat(const Tree *tree) {
+  return
+    tree->symbol == ts_builtin_sym_error_repeat &&
+    tree->children.size == 1 &&
+    tree->children.contents[0]->is_compact_error;
+}
+
+static inline unsigned parser__skipped_tree_cost(const Tree *error_repeat) {
+  return error_repeat->error_cost - (
+    ERROR_COST_PER_RECOVERY +
+    ERROR_COST_PER_SKIPPED_CHAR * error_repeat->size.bytes +
+    ERROR_COST_PER_SKIPPED_LINE * error_repeat->size.extent.row
+  );
+}
+
+static Tree *parser__compact_error_repeat(Parser *self, Tree *error_repeat) {
+  Tree *leaf = ts_tree_make_error(self->tree_pool, error_repeat->size, error_repeat->padding, 0, self->language);
+  leaf->is_compact_error = true;
+  leaf->fingerprint = ts_tree_leaf_fingerprint(ts_builtin_sym_error, leaf->size.bytes, error_repeat->fingerprint);
+  leaf->bytes_scanned = error_repeat->bytes_scanned;
+  leaf->error_cost = parser__skipped_tree_cost(error_repeat);
+  ts_tree_release(self->tree_pool, error_repeat);
+
+  TreeArray children = array_new();
+  array_reserve(&children, 1);
+  array_push(&children, leaf);
+  return ts_tree_make_node(self->tree_pool, ts_builtin_sym_error_repeat, &children, 0, self->language);
+}
+
 static void parser__recover(Parser *self, StackVersion version, Tree *lookahead) {
   bool did_recover = false;
   unsigned previous_version_count = ts_stack_version_count(self->stack);
@@ -962,12 +1685,17 @@ static void parser__recover(Parser *self, StackVersion version, Tree *lookahead)
   unsigned node_count_since_error = ts_stack_node_count_since_error(self->stack, version);
   unsigned current_error_cost = ts_stack_error_cost(self->stack, version);
 
-  if (summary && lookahead->symbol != ts_builtin_sym_error) {
+  if (summary && lookahead->symbol != ts_builtin_sym_error &&
+      parser__can_afford_recovery(self, position.bytes)) {
+    unsigned searched_depth = 0;
     for (unsigned i = 0; i < summary->size; i++) {
       StackSummaryEntry entry = summary->contents[i];
+      self->stats.recovery_step_count++;
+      if (entry.depth > searched_depth) searched_depth = entry.depth;
 
       if (entry.state == ERROR_STATE) continue;
       if (entry.position.bytes == position.bytes) continue;
+      if (self->streamed_leaf && entry.position.bytes == 0) continue;
       unsigned depth = entry.depth;
       if (node_count_since_error > 0) depth++;
 
@@ -994,12 +1722,15 @@ static void parser__recover(Parser *self, StackVersion version, Tree *lookahead)
       if (ts_language_has_actions(self->language, entry.state, lookahead->symbol)) {
         if (parser__recover_to_state(self, version, depth, entry.state)) {
           did_recover = true;
+          searched_depth = entry.depth;
           LOG("recover_to_previous state:%u, depth:%u", entry.state, depth);
+          TRACE(TSTraceEventRecover, version, entry.state, lookahead->symbol, position.bytes, depth);
           LOG_STACK();
           break;
         }
       }
     }
+    parser__record_recovery_depth(self, did_recover, searched_depth);
   }
 
   for (unsigned i = previous_version_count; i < ts_stack_version_count(self->stack); i++) {
@@ -1008,7 +1739,9 @@ static void parser__recover(Parser *self, StackVersion version, Tree *lookahead)
     }
   }
 
-  if (did_recover && ts_stack_version_count(self->stack) > MAX_VERSION_COUNT) {
+  if (did_recover && ts_stack_version_count(self->stack) > parser__max_version_count(self)) {
+    self->stats.prune_count++;
+    self->stats.pruned_version_count++;
     ts_stack_halt(self->stack, version);
     return;
   }
@@ -1016,7 +1749,7 @@ static void parser__recover(Parser *self, StackVersion version, Tree *lookahead)
   if (lookahead->symbol == ts_builtin_sym_end) {
     LOG("recover_eof");
     TreeArray children = array_new();
-    Tree *parent = ts_tree_make_error_node(&self->tree_pool, &children, self->language);
+    Tree *parent = ts_tree_make_error_node(self->tree_pool, &children, self->language);
     ts_stack_push(self->stack, version, parent, false, 1);
     parser__accept(self, version, lookahead);
     return;
@@ -1034,17 +1767,24 @@ static void parser__recover(Parser *self, StackVersion version, Tree *lookahead)
 
   unsigned n;
   const TSParseAction *actions = ts_language_actions(self->language, 1, lookahead->symbol, &n);
-  if (n > 0 && actions[n - 1].type == TSParseActionTypeShift && actions[n - 1].params.extra) {
-    lookahead->extra = true;
+  bool is_extra = n > 0 && actions[n - 1].type == TSParseActionTypeShift && actions[n - 1].params.extra;
+  if (is_extra && lookahead->is_interned) {
+    lookahead = ts_tree_make_copy(self->tree_pool, lookahead);
+  } else {
+    ts_tree_retain(lookahead);
   }
+  if (is_extra) lookahead->extra = true;
 
   LOG("skip_token symbol:%s", SYM_NAME(lookahead->symbol));
-  ts_tree_retain(lookahead);
+  TRACE(TSTraceEventSkipToken, version, ERROR_STATE, lookahead->symbol, position.bytes, ts_tree_total_bytes(lookahead));
+  if (lookahead->children.size > 0) {
+    parser__extend_scanned_end_byte(self, position.bytes, lookahead->bytes_scanned);
+  }
   TreeArray children = array_new();
   array_reserve(&children, 1);
   array_push(&children, lookahead);
   Tree *error_repeat = ts_tree_make_node(
-    &self->tree_pool,
+    self->tree_pool,
     ts_builtin_sym_error_repeat,
     &children,
     0,
@@ -1056,14 +1796,21 @@ static void parser__recover(Parser *self, StackVersion version, Tree *lookahead)
     assert(pop.size == 1);
     assert(pop.contents[0].trees.size == 1);
     ts_stack_renumber_version(self->stack, pop.contents[0].version, version);
+    bool is_compact = parser__is_compact_error_repeat(pop.contents[0].trees.contents[0]);
     array_push(&pop.contents[0].trees, error_repeat);
     error_repeat = ts_tree_make_node(
-      &self->tree_pool,
+      self->tree_pool,
       ts_builtin_sym_error_repeat,
       &pop.contents[0].trees,
       0,
       self->language
     );
+
+    if (!error_repeat->has_external_tokens &&
+        (is_compact || ts_tree_node_count(error_repeat) >= MIN_COMPACT_ERROR_NODE_COUNT)) {
+      LOG("compact_error size:%u", ts_tree_total_bytes(error_repeat));
+      error_repeat = parser__compact_error_repeat(self, error_repeat);
+    }
   }
 
   ts_stack_push(self->stack, version, error_repeat, false, ERROR_STATE);
@@ -1080,9 +1827,30 @@ static void parser__advance(Parser *self, StackVersion version, ReusableNode *re
   TableEntry table_entry;
   Tree *lookahead = parser__get_lookahead(self, version, &state, reusable_node, &table_entry);
 
+  // A token that was cut short by input that isn't available yet is discarded.
+  if (self->lexer.did_block) {
+    ts_tree_release(self->tree_pool, lookahead);
+    return;
+  }
+
+  parser__extend_scanned_end_byte(
+    self,
+    ts_stack_position(self->stack, version).bytes,
+    parser__first_leaf_bytes_scanned(lookahead)
+  );
+
   for (;;) {
     StackVersion last_reduction_version = STACK_VERSION_NONE;
 
+    // Repetition shifts are skipped below, so if there is only one other action,
+    // nothing else is done with this version once it has been reduced.
+    uint32_t effective_action_count = 0;
+    for (uint32_t i = 0; i < table_entry.action_count; i++) {
+      TSParseAction action = table_entry.actions[i];
+      if (action.type != TSParseActionTypeShift || !action.params.repetition) effective_action_count++;
+    }
+    parser__profile_parse_state(self, state, effective_action_count > 1);
+
     for (uint32_t i = 0; i < table_entry.action_count; i++) {
       TSParseAction action = table_entry.actions[i];
 
@@ -1092,7 +1860,7 @@ static void parser__advance(Parser *self, StackVersion version, ReusableNode *re
           TSStateId next_state;
           if (action.params.extra) {
 
-            // TODO remove when TREE_SITTER_LANGUAGE_VERSION 9 is out.
+            // TODO remove when languages from version 8 are no longer supported.
             if (state == ERROR_STATE) continue;
 
             next_state = state;
@@ -1107,20 +1875,40 @@ static void parser__advance(Parser *self, StackVersion version, ReusableNode *re
             next_state = ts_language_next_state(self->language, state, lookahead->symbol);
           }
 
+          if (self->opaque_region_count > 0 && !action.params.extra &&
+              parser__skip_opaque_region(self, version, state, lookahead)) {
+            if (lookahead == reusable_node_tree(reusable_node)) reusable_node_pop(reusable_node);
+            ts_tree_release(self->tree_pool, lookahead);
+            return;
+          }
+
+          TRACE(
+            TSTraceEventShift, version, next_state, lookahead->symbol,
+            ts_stack_position(self->stack, version).bytes, action.params.extra
+          );
+          clock_t phase_start = parser__start_phase(self);
           parser__shift(self, version, next_state, lookahead, action.params.extra);
-          if (lookahead == reusable_node->tree) reusable_node_pop(reusable_node);
-          ts_tree_release(&self->tree_pool, lookahead);
+          parser__end_phase(self, &self->profile.shift, phase_start);
+          if (lookahead == reusable_node_tree(reusable_node)) reusable_node_pop(reusable_node);
+          ts_tree_release(self->tree_pool, lookahead);
           return;
         }
 
         case TSParseActionTypeReduce: {
           bool is_fragile = table_entry.action_count > 1;
           LOG("reduce sym:%s, child_count:%u", SYM_NAME(action.params.symbol), action.params.child_count);
+          TRACE(
+            TSTraceEventReduce, version, state, action.params.symbol,
+            ts_stack_position(self->stack, version).bytes, action.params.child_count
+          );
+          parser__profile_reduction(self, state, action.params.symbol);
+          clock_t phase_start = parser__start_phase(self);
           StackSliceArray reduction = parser__reduce(
             self, version, action.params.symbol, action.params.child_count,
             action.params.dynamic_precedence, action.params.alias_sequence_id,
-            is_fragile
+            is_fragile, effective_action_count == 1
           );
+          parser__end_phase(self, &self->profile.reduce, phase_start);
           StackSlice slice = *array_front(&reduction);
           last_reduction_version = slice.version;
           break;
@@ -1128,8 +1916,9 @@ static void parser__advance(Parser *self, StackVersion version, ReusableNode *re
 
         case TSParseActionTypeAccept: {
           LOG("accept");
+          TRACE(TSTraceEventAccept, version, state, lookahead->symbol, ts_stack_position(self->stack, version).bytes, 0);
           parser__accept(self, version, lookahead);
-          ts_tree_release(&self->tree_pool, lookahead);
+          ts_tree_release(self->tree_pool, lookahead);
           return;
         }
 
@@ -1137,9 +1926,11 @@ static void parser__advance(Parser *self, StackVersion version, ReusableNode *re
           while (lookahead->children.size > 0) {
             parser__breakdown_lookahead(self, &lookahead, state, reusable_node);
           }
+          clock_t phase_start = parser__start_phase(self);
           parser__recover(self, version, lookahead);
-          if (lookahead == reusable_node->tree) reusable_node_pop(reusable_node);
-          ts_tree_release(&self->tree_pool, lookahead);
+          parser__end_phase(self, &self->profile.recover, phase_start);
+          if (lookahead == reusable_node_tree(reusable_node)) reusable_node_pop(reusable_node);
+          ts_tree_release(self->tree_pool, lookahead);
           return;
         }
       }
@@ -1149,13 +1940,19 @@ static void parser__advance(Parser *self, StackVersion version, ReusableNode *re
       ts_stack_renumber_version(self->stack, last_reduction_version, version);
       LOG_STACK();
     } else if (state == ERROR_STATE) {
+      clock_t phase_start = parser__start_phase(self);
       parser__recover(self, version, lookahead);
-      ts_tree_release(&self->tree_pool, lookahead);
+      parser__end_phase(self, &self->profile.recover, phase_start);
+      ts_tree_release(self->tree_pool, lookahead);
       return;
     } else if (!parser__breakdown_top_of_stack(self, version)) {
       LOG("detect_error");
+      TRACE(
+        TSTraceEventDetectError, version, state, lookahead->first_leaf.symbol,
+        ts_stack_position(self->stack, version).bytes, 0
+      );
       ts_stack_pause(self->stack, version, lookahead->first_leaf.symbol);
-      ts_tree_release(&self->tree_pool, lookahead);
+      ts_tree_release(self->tree_pool, lookahead);
       return;
     }
 
@@ -1164,51 +1961,112 @@ static void parser__advance(Parser *self, StackVersion version, ReusableNode *re
   }
 }
 
+// When there are more stack versions than the budget allows, the versions
+// with the highest error cost are discarded first. Among versions with the
+// same error cost, those with the lowest dynamic precedence are discarded
+// first, and after that, the versions that come last.
+static StackVersion parser__worst_version(Parser *self) {
+  StackVersion result = 0;
+  unsigned result_cost = ts_stack_error_cost(self->stack, 0);
+  int result_precedence = ts_stack_dynamic_precedence(self->stack, 0);
+  for (StackVersion i = 1, n = ts_stack_version_count(self->stack); i < n; i++) {
+    unsigned cost = ts_stack_error_cost(self->stack, i);
+    int precedence = ts_stack_dynamic_precedence(self->stack, i);
+    if (cost > result_cost || (cost == result_cost && precedence <= result_precedence)) {
+      result = i;
+      result_cost = cost;
+      result_precedence = precedence;
+    }
+  }
+  return result;
+}
+
+static CondensedVersion parser__condensed_version(Parser *self, StackVersion version) {
+  return (CondensedVersion) {
+    .status = parser__version_status(self, version),
+    .state = ts_stack_state(self->stack, version),
+    .byte = ts_stack_position(self->stack, version).bytes,
+  };
+}
+
+// Only versions with the same state and position can be merged, so merges are
+// only attempted between those. Every pair of versions is still compared,
+// because versions in different states can replace one another.
 static unsigned parser__condense_stack(Parser *self) {
   bool made_changes = false;
   unsigned min_error_cost = UINT_MAX;
+  if (ts_stack_version_count(self->stack) > self->stats.peak_version_count) {
+    self->stats.peak_version_count = ts_stack_version_count(self->stack);
+  }
+
+  // When the parse is deterministic, there is a single active version, and
+  // there is nothing to compare, merge, prune or resume.
+  if (ts_stack_version_count(self->stack) == 1 &&
+      ts_stack_is_active(self->stack, 0)) {
+    if (ts_stack_state(self->stack, 0) == ERROR_STATE) return UINT_MAX;
+    return ts_stack_error_cost(self->stack, 0);
+  }
+
+  array_clear(&self->condensed_versions);
+  for (StackVersion i = 0, n = ts_stack_version_count(self->stack); i < n; i++) {
+    array_push(&self->condensed_versions, parser__condensed_version(self, i));
+  }
+  CondensedVersion *versions;
+
   for (StackVersion i = 0; i < ts_stack_version_count(self->stack); i++) {
     if (ts_stack_is_halted(self->stack, i)) {
       ts_stack_remove_version(self->stack, i);
+      array_erase(&self->condensed_versions, i);
       i--;
       continue;
     }
 
-    ErrorStatus status_i = parser__version_status(self, i);
+    versions = self->condensed_versions.contents;
+    ErrorStatus status_i = versions[i].status;
     if (!status_i.is_in_error && status_i.cost < min_error_cost) {
       min_error_cost = status_i.cost;
     }
 
     for (StackVersion j = 0; j < i; j++) {
-      ErrorStatus status_j = parser__version_status(self, j);
+      versions = self->condensed_versions.contents;
+      bool can_merge = versions[j].state == versions[i].state && versions[j].byte == versions[i].byte;
 
-      switch (parser__compare_versions(self, status_j, status_i)) {
+      switch (parser__compare_versions(self, versions[j].status, status_i)) {
         case ErrorComparisonTakeLeft:
           made_changes = true;
           ts_stack_remove_version(self->stack, i);
+          array_erase(&self->condensed_versions, i);
           i--;
           j = i;
           break;
         case ErrorComparisonPreferLeft:
         case ErrorComparisonNone:
-          if (ts_stack_merge(self->stack, j, i)) {
+          if (can_merge && ts_stack_merge(self->stack, j, i)) {
             made_changes = true;
+            array_erase(&self->condensed_versions, i);
+            self->condensed_versions.contents[j] = parser__condensed_version(self, j);
             i--;
             j = i;
           }
           break;
         case ErrorComparisonPreferRight:
           made_changes = true;
-          if (ts_stack_merge(self->stack, j, i)) {
+          if (can_merge && ts_stack_merge(self->stack, j, i)) {
+            array_erase(&self->condensed_versions, i);
+            self->condensed_versions.contents[j] = parser__condensed_version(self, j);
             i--;
             j = i;
           } else {
             ts_stack_swap_versions(self->stack, i, j);
+            CondensedVersion version_i = versions[i];
+            versions[i] = versions[j];
+            versions[j] = version_i;
           }
           break;
         case ErrorComparisonTakeRight:
           made_changes = true;
           ts_stack_remove_version(self->stack, j);
+          array_erase(&self->condensed_versions, j);
           i--;
           j--;
           break;
@@ -1216,8 +2074,12 @@ static unsigned parser__condense_stack(Parser *self) {
     }
   }
 
-  while (ts_stack_version_count(self->stack) > MAX_VERSION_COUNT) {
-    ts_stack_remove_version(self->stack, MAX_VERSION_COUNT);
+  if (ts_stack_version_count(self->stack) > parser__max_version_count(self)) {
+    self->stats.prune_count++;
+    do {
+      ts_stack_remove_version(self->stack, parser__worst_version(self));
+      self->stats.pruned_version_count++;
+    } while (ts_stack_version_count(self->stack) > parser__max_version_count(self));
     made_changes = true;
   }
 
@@ -1225,11 +2087,17 @@ static unsigned parser__condense_stack(Parser *self) {
     bool has_unpaused_version = false;
     for (StackVersion i = 0, n = ts_stack_version_count(self->stack); i < n; i++) {
       if (ts_stack_is_paused(self->stack, i)) {
-        if (!has_unpaused_version && self->accept_count < MAX_VERSION_COUNT) {
+        if (!has_unpaused_version && self->accept_count < parser__max_version_count(self)) {
           LOG("resume version:%u", i);
           min_error_cost = ts_stack_error_cost(self->stack, i);
           TSSymbol lookahead_symbol = ts_stack_resume(self->stack, i);
+          TRACE(
+            TSTraceEventResume, i, ts_stack_state(self->stack, i), lookahead_symbol,
+            ts_stack_position(self->stack, i).bytes, 0
+          );
+          clock_t phase_start = parser__start_phase(self);
           parser__handle_error(self, i, lookahead_symbol);
+          parser__end_phase(self, &self->profile.recover, phase_start);
           has_unpaused_version = true;
         } else {
           ts_stack_remove_version(self->stack, i);
@@ -1244,6 +2112,7 @@ static unsigned parser__condense_stack(Parser *self) {
 
   if (made_changes) {
     LOG("condense");
+    TRACE(TSTraceEventCondense, 0, 0, 0, 0, ts_stack_version_count(self->stack));
     LOG_STACK();
   }
 
@@ -1252,12 +2121,52 @@ static unsigned parser__condense_stack(Parser *self) {
 
 bool parser_init(Parser *self) {
   ts_lexer_init(&self->lexer);
-  array_init(&self->reduce_actions);
-  array_reserve(&self->reduce_actions, 4);
-  ts_tree_pool_init(&self->tree_pool);
-  self->stack = ts_stack_new(&self->tree_pool);
+  ts_reduce_action_set_init(&self->reduce_actions);
+  ts_tree_pool_init(&self->own_tree_pool);
+  self->tree_pool = &self->own_tree_pool;
+  self->stack = ts_stack_new(self->tree_pool);
+  self->reusable_node = reusable_node_new();
+  self->max_version_count = 0;
+  self->is_profiling = false;
+  trace_buffer_init(&self->trace);
+  array_init(&self->condensed_versions);
+  array_init(&self->ambiguous_trees);
+  array_init(&self->state_profile.parse_states);
+  array_init(&self->state_profile.lex_states);
+  array_init(&self->state_profile.symbol_reductions);
+  self->scanned_end_byte = 0;
+  self->cancellation_flag = NULL;
+  self->timeout_micros = 0;
+  self->max_bytes_per_call = 0;
+  self->priority_end_byte = 0;
+  self->max_recovery_steps_per_byte = 0;
+  self->intern_leaves = false;
+  self->streamed_node_callback = NULL;
+  self->streamed_node_payload = NULL;
+  self->event_handler = (TSParseEventHandler){NULL, NULL, NULL};
+  self->streamed_leaf = NULL;
+  self->streamed_leaf_node_count = 0;
+  tree_builder_init(&self->tree_builder);
+  self->summary_depth = DEFAULT_SUMMARY_DEPTH;
+  self->shallow_recovery_count = 0;
+  self->opaque_regions = NULL;
+  self->opaque_region_count = 0;
+  self->expanded_opaque_bytes = NULL;
+  self->expanded_opaque_byte_count = 0;
+  self->max_memory_bytes = 0;
+  self->max_error_cost = 0;
+  self->operation_count = 0;
+  self->last_position = 0;
+  self->has_partial_parse = false;
+  self->records_snapshots = false;
+  self->resume_snapshot = NULL;
+  self->confirmed_snapshot = (ParseSnapshot){{array_new(), NULL}, 0, 0};
+  self->pending_snapshot = (ParseSnapshot){{array_new(), NULL}, 0, 0};
+  self->tree_pool_capacity = (TreePoolCapacity){0, 0, 0};
   self->finished_tree = NULL;
-  parser__set_cached_token(self, 0, NULL, NULL);
+  self->external_scanner_state_token = NULL;
+  self->external_scanner_state_is_current = false;
+  parser__clear_cached_tokens(self);
   return true;
 }
 
@@ -1265,33 +2174,242 @@ void parser_set_language(Parser *self, const TSLanguage *language) {
   if (self->external_scanner_payload && self->language->external_scanner.destroy)
     self->language->external_scanner.destroy(self->external_scanner_payload);
 
-  if (language && language->external_scanner.create)
-    self->external_scanner_payload = language->external_scanner.create();
+  self->given_language = language;
+  if (language)
+    language = ts_language_upgrade(language, &self->upgraded_language);
+
+  if (language)
+    self->external_scanner_payload = ts_language_create_external_scanner(language);
   else
     self->external_scanner_payload = NULL;
 
+  parser__set_external_scanner_state_token(self, NULL);
+  self->external_scanner_state_is_current = false;
+
   self->language = language;
 }
 
+// Trees must be released into the pool that they were allocated from, so the
+// trees that the parser holds on to between parses are released before it
+// switches pools. This discards any unfinished parse.
+void parser_set_tree_pool(Parser *self, TreePool *tree_pool) {
+  if (tree_pool == self->tree_pool) return;
+  parser_reset(self);
+  parser__record_tree_pool_capacity(self);
+  parser__set_external_scanner_state_token(self, NULL);
+  self->external_scanner_state_is_current = false;
+  self->tree_pool = tree_pool;
+  ts_stack_set_tree_pool(self->stack, tree_pool);
+}
+
+void parser_reset(Parser *self) {
+  if (!self->has_partial_parse) return;
+  ts_stack_clear(self->stack);
+  parser__clear_cached_tokens(self);
+  reusable_node_reset(&self->reusable_node, NULL);
+  parser__release_ambiguous_trees(self, false);
+  if (self->finished_tree) {
+    ts_tree_release(self->tree_pool, self->finished_tree);
+    self->finished_tree = NULL;
+  }
+  tree_builder_clear(&self->tree_builder, self->tree_pool);
+  parser__clear_snapshots(self);
+  self->has_partial_parse = false;
+}
+
+void parser_take_snapshot(Parser *self, Tree *tree, ParseSnapshot *snapshot) {
+  ts_stack_snapshot_clear(&snapshot->stack, self->tree_pool);
+  ParseSnapshot *result = NULL;
+  uint32_t total_bytes = ts_tree_total_bytes(tree);
+  if (self->pending_snapshot.stack.entries.size > 0 &&
+      self->pending_snapshot.dependency_end_byte <= total_bytes) {
+    result = &self->pending_snapshot;
+  } else if (self->confirmed_snapshot.stack.entries.size > 0) {
+    result = &self->confirmed_snapshot;
+  }
+
+  if (result) {
+    ParseSnapshot empty_snapshot = *snapshot;
+    *snapshot = *result;
+    *result = empty_snapshot;
+  }
+  parser__clear_snapshots(self);
+}
+
 void parser_destroy(Parser *self) {
-  if (self->stack)
+  if (self->stack) {
+    parser_reset(self);
     ts_stack_delete(self->stack);
-  if (self->reduce_actions.contents)
-    array_delete(&self->reduce_actions);
-  ts_tree_pool_delete(&self->tree_pool);
+  }
+  tree_builder_delete(&self->tree_builder, self->tree_pool);
+  ts_reduce_action_set_delete(&self->reduce_actions);
+  if (self->reusable_node.stack.contents)
+    reusable_node_delete(&self->reusable_node);
+  parse_snapshot_delete(&self->confirmed_snapshot, self->tree_pool);
+  parse_snapshot_delete(&self->pending_snapshot, self->tree_pool);
+  parser__set_external_scanner_state_token(self, NULL);
+  ts_tree_pool_delete(&self->own_tree_pool);
+  trace_buffer_delete(&self->trace);
+  array_delete(&self->condensed_versions);
+  array_delete(&self->ambiguous_trees);
+  state_profile_delete(&self->state_profile);
   parser_set_language(self, NULL);
+  ts_lexer_delete(&self->lexer);
+}
+
+void parser_trim(Parser *self) {
+  ts_stack_trim(self->stack);
+  ts_tree_pool_trim(&self->own_tree_pool);
+  array_shrink(&self->condensed_versions);
+  array_shrink(&self->ambiguous_trees);
+  if (!self->has_partial_parse) {
+    ts_reduce_action_set_delete(&self->reduce_actions);
+    ts_reduce_action_set_init(&self->reduce_actions);
+    array_shrink(&self->reusable_node.stack);
+  }
+  self->tree_pool_capacity = (TreePoolCapacity){0, 0, 0};
+}
+
+TSParser *ts_parser_new() {
+  Parser *self = ts_calloc(1, sizeof(Parser));
+  parser_init(self);
+  return self;
+}
+
+void ts_parser_delete(TSParser *self) {
+  parser_destroy(self);
+  ts_free(self);
+}
+
+void ts_parser_trim_memory(TSParser *self) {
+  parser_trim(self);
+}
+
+// The parse is interrupted, between two steps of the main loop, if the
+// cancellation flag has been set, the timeout has elapsed, or the parse has
+// advanced past the end of this call's byte budget. The clock is only
+// consulted every few steps.
+static bool parser__should_cancel(Parser *self, clock_t end_clock,
+                                  uint32_t position, uint32_t end_position) {
+  if (self->cancellation_flag && *self->cancellation_flag) return true;
+  if (position >= end_position) return true;
+  if (self->timeout_micros > 0 && ++self->operation_count >= OP_COUNT_PER_TIMEOUT_CHECK) {
+    self->operation_count = 0;
+    if (clock() >= end_clock) return true;
+  }
+  return false;
+}
+
+// The memory limit applies to the slabs that the parser's tree pool and stack
+// have allocated, which can be measured without walking any trees. The pool
+// may also hold the previous tree, and the trees of other parses that share it.
+static bool parser__exceeds_memory_limit(Parser *self) {
+  if (self->max_memory_bytes == 0) return false;
+  size_t allocated_bytes = ts_tree_pool_allocated_bytes(self->tree_pool) + ts_stack_allocated_bytes(self->stack);
+  return allocated_bytes > self->max_memory_bytes;
+}
+
+// A parse is abandoned once every version's error cost is over the limit,
+// because none of them can produce a tree that costs less.
+static bool parser__exceeds_max_error_cost(Parser *self) {
+  if (self->max_error_cost == 0) return false;
+  if (ts_stack_version_count(self->stack) == 0) return false;
+  for (StackVersion i = 0, n = ts_stack_version_count(self->stack); i < n; i++) {
+    if (ts_stack_error_cost(self->stack, i) <= self->max_error_cost) return false;
+  }
+  return true;
+}
+
+// The subtrees of the old tree that lie entirely after the given position are
+// appended in order. The text of any leaves that span the position is covered
+// by an invisible error, like the rest of the text in a halted parse.
+static void parser__append_subtrees_after(Parser *self, Tree *tree, Length offset,
+                                          Length *end, TreeArray *trees) {
+  for (uint32_t i = 0; i < tree->children.size; i++) {
+    Tree *child = tree->children.contents[i];
+    Length child_end = length_add(offset, ts_tree_total_size(child));
+    if (child_end.bytes > end->bytes) {
+      if (offset.bytes >= end->bytes) {
+        if (offset.bytes > end->bytes) {
+          Tree *filler_node = ts_tree_make_error(self->tree_pool, length_sub(offset, *end), length_zero(), 0, self->language);
+          filler_node->visible = false;
+          array_push(trees, filler_node);
+        }
+        ts_tree_retain(child);
+        array_push(trees, child);
+        *end = child_end;
+      } else {
+        parser__append_subtrees_after(self, child, offset, end, trees);
+      }
+    }
+    offset = child_end;
+  }
+}
+
+// The first version's trees are taken from a copy of it, so that the
+// unfinished parse can still be resumed.
+Tree *parser_provisional_tree(Parser *self) {
+  if (!self->has_partial_parse || self->reusable_node.stack.size == 0) return NULL;
+  Tree *old_tree = self->reusable_node.stack.contents[0].tree;
+
+  StackVersion version_count = ts_stack_version_count(self->stack);
+  Length end = ts_stack_position(self->stack, 0);
+  StackSliceArray pop = ts_stack_pop_all(self->stack, ts_stack_copy_version(self->stack, 0));
+  TreeArray trees = pop.contents[0].trees;
+  for (uint32_t i = 1; i < pop.size; i++) {
+    ts_tree_array_delete(self->tree_pool, &pop.contents[i].trees);
+  }
+  while (ts_stack_version_count(self->stack) > version_count) {
+    ts_stack_remove_version(self->stack, ts_stack_version_count(self->stack) - 1);
+  }
+
+  parser__append_subtrees_after(self, old_tree, length_zero(), &end, &trees);
+  return ts_tree_make_node(self->tree_pool, old_tree->symbol, &trees, 0, self->language);
 }
 
 Tree *parser_parse(Parser *self, TSInput input, Tree *old_tree, bool halt_on_error) {
-  parser__start(self, input, old_tree);
+  if (self->has_partial_parse) {
+    LOG("resume_parse");
+    self->has_partial_parse = false;
+    self->stats.blocked_on_input = false;
+    if (self->lexer.did_block) ts_lexer_set_input(&self->lexer, self->lexer.input);
+  } else {
+    parser__start(self, input, old_tree);
+    self->last_position = 0;
+    self->streamed_leaf = NULL;
+    self->streamed_leaf_node_count = 0;
+    self->summary_depth = DEFAULT_SUMMARY_DEPTH;
+    self->shallow_recovery_count = 0;
+  }
+
+  clock_t end_clock = 0;
+  if (self->timeout_micros > 0) {
+    end_clock = clock() + (clock_t)(self->timeout_micros * CLOCKS_PER_SEC / 1000000);
+    self->operation_count = 0;
+  }
+
+  uint32_t end_position = UINT32_MAX;
+  if (self->max_bytes_per_call > 0 && self->last_position < UINT32_MAX - self->max_bytes_per_call) {
+    end_position = self->last_position + self->max_bytes_per_call;
+  }
+  if (self->priority_end_byte > self->last_position && self->priority_end_byte < end_position) {
+    end_position = self->priority_end_byte;
+  }
 
   StackVersion version = STACK_VERSION_NONE;
-  uint32_t position = 0, last_position = 0;
-  ReusableNode reusable_node;
+  uint32_t position = 0, last_position = self->last_position;
+  ReusableNode reusable_node = reusable_node_new();
+
+  // Each version advances from the position that the reusable node had at the
+  // start of the round, using its own copy of it. The copy that the last
+  // version leaves behind becomes the next round's starting point, so the first
+  // version of that round can keep using it without copying it back.
+  bool reusable_node_is_current = false;
 
   do {
     for (version = 0; version < ts_stack_version_count(self->stack); version++) {
-      reusable_node = self->reusable_node;
+      if (!reusable_node_is_current) reusable_node_assign(&reusable_node, &self->reusable_node);
+      reusable_node_is_current = false;
 
       while (ts_stack_is_active(self->stack, version)) {
         LOG("process version:%d, version_count:%u, state:%d, row:%u, col:%u",
@@ -1299,8 +2417,13 @@ Tree *parser_parse(Parser *self, TSInput input, Tree *old_tree, bool halt_on_err
             ts_stack_state(self->stack, version),
             ts_stack_position(self->stack, version).extent.row,
             ts_stack_position(self->stack, version).extent.column);
+        TRACE(
+          TSTraceEventProcessVersion, version, ts_stack_state(self->stack, version), 0,
+          ts_stack_position(self->stack, version).bytes, ts_stack_version_count(self->stack)
+        );
 
         parser__advance(self, version, &reusable_node);
+        if (self->lexer.did_block) break;
         LOG_STACK();
 
         position = ts_stack_position(self->stack, version).bytes;
@@ -1309,26 +2432,102 @@ Tree *parser_parse(Parser *self, TSInput input, Tree *old_tree, bool halt_on_err
           break;
         }
       }
+      if (self->lexer.did_block) break;
     }
 
-    self->reusable_node = reusable_node;
+    reusable_node_assign(&self->reusable_node, &reusable_node);
+    reusable_node_is_current = true;
+
+    // When the input isn't available, the parse stops before the stack is
+    // condensed, and the next call starts the round over, once more of the
+    // input has arrived.
+    if (self->lexer.did_block) {
+      LOG("input_would_block");
+      TRACE(TSTraceEventCancel, 0, 0, 0, last_position, 0);
+      self->stats.blocked_on_input = true;
+      self->has_partial_parse = true;
+      self->last_position = last_position;
+      reusable_node_delete(&reusable_node);
+      return NULL;
+    }
 
+    // The time spent handling errors while condensing the stack is counted
+    // only as recovery.
+    uint64_t recover_micros = self->profile.recover.micros;
+    uint32_t version_count = ts_stack_version_count(self->stack);
+    clock_t phase_start = parser__start_phase(self);
     unsigned min_error_cost = parser__condense_stack(self);
+    if (self->is_profiling) {
+      uint64_t condense_micros = parser__phase_micros(phase_start);
+      uint64_t nested_micros = self->profile.recover.micros - recover_micros;
+      self->profile.condense.count++;
+      if (condense_micros > nested_micros) self->profile.condense.micros += condense_micros - nested_micros;
+      self->profile.step_count++;
+      self->profile.total_version_count += version_count;
+      if (version_count > self->profile.max_version_count) {
+        self->profile.max_version_count = version_count;
+      }
+    }
     if (self->finished_tree && self->finished_tree->error_cost < min_error_cost) {
       break;
     } else if (halt_on_error && min_error_cost > 0) {
       parser__halt_parse(self);
       break;
+    } else if (parser__exceeds_max_error_cost(self)) {
+      LOG("exceed_max_error_cost");
+      self->stats.exceeded_max_error_cost = true;
+      parser__halt_parse(self);
+      break;
     }
 
     self->in_ambiguity = version > 1;
+    if (!self->in_ambiguity) parser__release_ambiguous_trees(self, true);
+    if ((self->streamed_node_callback || parser__has_event_handler(self)) &&
+        ts_stack_version_count(self->stack) == 1) {
+      parser__stream_completed_trees(self);
+    }
+    if (self->records_snapshots && ts_stack_version_count(self->stack) == 1) {
+      parser__record_snapshot(self);
+    }
+
+    // The parser's stack and reusable node are kept, so that the parse can be
+    // resumed by the next call with the same input.
+    if (version != 0 && parser__should_cancel(self, end_clock, last_position, end_position)) {
+      LOG("cancel_parse");
+      TRACE(TSTraceEventCancel, 0, 0, 0, last_position, 0);
+      self->has_partial_parse = true;
+      self->last_position = last_position;
+      reusable_node_delete(&reusable_node);
+      return NULL;
+    }
+
+    // A parse that exceeds its memory limit is discarded, because resuming it
+    // would only exceed the limit again.
+    if (version != 0 && parser__exceeds_memory_limit(self)) {
+      LOG("exceed_memory_limit");
+      self->stats.exceeded_memory_limit = true;
+      self->has_partial_parse = true;
+      reusable_node_delete(&reusable_node);
+      parser_reset(self);
+      return NULL;
+    }
   } while (version != 0);
 
   ts_stack_clear(self->stack);
-  parser__set_cached_token(self, 0, NULL, NULL);
-  ts_tree_assign_parents(self->finished_tree, &self->tree_pool, self->language);
+  parser__clear_cached_tokens(self);
+  parser__release_ambiguous_trees(self, true);
+  reusable_node_delete(&reusable_node);
+  reusable_node_reset(&self->reusable_node, NULL);
 
   LOG("done");
+  TRACE(TSTraceEventDone, 0, 0, self->finished_tree->symbol, 0, ts_tree_total_bytes(self->finished_tree));
   LOG_TREE();
+  if (parser__has_event_handler(self)) {
+    parser__report_parse_events(self, self->finished_tree, length_zero(), 0);
+    self->streamed_leaf = NULL;
+  }
+  if (tree_builder_is_active(&self->tree_builder)) {
+    tree_builder_accept(&self->tree_builder, self->tree_pool, self->finished_tree);
+  }
   return self->finished_tree;
 }
@@ -10,34 +10,194 @@ extern "C" {
 #include "runtime/lexer.h"
 #include "runtime/reusable_node.h"
 #include "runtime/reduce_action.h"
+#include "runtime/trace_buffer.h"
 #include "runtime/tree.h"
+#include "runtime/tree_builder.h"
+
+#define TOKEN_CACHE_SIZE 8
 
 typedef struct {
   Tree *token;
   Tree *last_external_token;
   uint32_t byte_index;
+} TokenCacheEntry;
+
+typedef struct {
+  TokenCacheEntry entries[TOKEN_CACHE_SIZE];
+  unsigned next_index;
+  unsigned hit_count;
+  unsigned miss_count;
 } TokenCache;
 
 typedef struct {
+  unsigned cost;
+  unsigned node_count;
+  int dynamic_precedence;
+  bool is_in_error;
+} ErrorStatus;
+
+// While the stack is condensed, the error status of each version is computed
+// once and kept in step with the versions as they are removed, merged and
+// swapped, along with the state and position that versions must share in
+// order to be merged.
+typedef struct {
+  ErrorStatus status;
+  TSStateId state;
+  uint32_t byte;
+} CondensedVersion;
+
+// A node that is reduced while there are several stack versions depends on
+// all of the text that the parser examines until only one version remains, so
+// the range of bytes that it depends on is extended once that happens.
+typedef struct {
+  Tree *tree;
+  uint32_t start_byte;
+} AmbiguousTree;
+
+// When state profiling is enabled, the parser counts how many times each parse
+// state and lex state is entered, how many of the entries into a parse state
+// split the stack, and how many reductions are performed in each parse state
+// and of each symbol.
+typedef struct {
+  Array(TSParseStateProfile) parse_states;
+  Array(uint32_t) lex_states;
+  Array(uint32_t) symbol_reductions;
+} StateProfile;
+
+static inline void state_profile_assign(StateProfile *self, const StateProfile *other) {
+  array_clear(&self->parse_states);
+  array_clear(&self->lex_states);
+  array_clear(&self->symbol_reductions);
+  array_push_all(&self->parse_states, &other->parse_states);
+  array_push_all(&self->lex_states, &other->lex_states);
+  array_push_all(&self->symbol_reductions, &other->symbol_reductions);
+}
+
+static inline void state_profile_delete(StateProfile *self) {
+  array_delete(&self->parse_states);
+  array_delete(&self->lex_states);
+  array_delete(&self->symbol_reductions);
+}
+
+// A snapshot of the parser's stack, taken while the stack had a single version
+// with no errors, along with the position of that version and the end of the
+// text that the parse had examined by then. A later parse of the same text,
+// edited only at or after that end, reaches the same stack, and so can resume
+// from the snapshot.
+typedef struct {
+  StackSnapshot stack;
+  uint32_t byte;
+  uint32_t dependency_end_byte;
+} ParseSnapshot;
+
+static inline void parse_snapshot_delete(ParseSnapshot *self, TreePool *tree_pool) {
+  ts_stack_snapshot_clear(&self->stack, tree_pool);
+  array_delete(&self->stack.entries);
+}
+
+// The pool from which the parser allocates trees is normally its own, but a
+// parser that is shared between documents uses each document's pool while it
+// parses that document, so that the document's trees can outlive the job.
+typedef struct TSParser {
   Lexer lexer;
   Stack *stack;
-  TreePool tree_pool;
+  TreePool *tree_pool;
+  TreePool own_tree_pool;
   const TSLanguage *language;
+
+  // The language as it was given. If it was generated for an older version,
+  // `language` points to the parser's own upgraded copy of it, so that the
+  // parser never refers to a copy that a document has freed.
+  const TSLanguage *given_language;
+  TSLanguage upgraded_language;
   ReduceActionSet reduce_actions;
   Tree *finished_tree;
   Tree scratch_tree;
   TokenCache token_cache;
   ReusableNode reusable_node;
   void *external_scanner_payload;
+  Tree *external_scanner_state_token;
+  bool external_scanner_state_is_current;
   bool in_ambiguity;
+  Array(AmbiguousTree) ambiguous_trees;
+  uint32_t scanned_end_byte;
   bool print_debugging_graphs;
   unsigned accept_count;
+  unsigned max_version_count;
+  TSParseStats stats;
+  TSParseProfile profile;
+  bool is_profiling;
+  bool is_profiling_states;
+  StateProfile state_profile;
+  TraceBuffer trace;
+  Array(CondensedVersion) condensed_versions;
+  const volatile bool *cancellation_flag;
+  uint64_t timeout_micros;
+  uint32_t max_bytes_per_call;
+  uint32_t priority_end_byte;
+  uint32_t max_recovery_steps_per_byte;
+  unsigned summary_depth;
+  unsigned shallow_recovery_count;
+  size_t max_memory_bytes;
+  unsigned max_error_cost;
+  bool intern_leaves;
+  void (*streamed_node_callback)(void *, TSNode);
+  void *streamed_node_payload;
+  TSParseEventHandler event_handler;
+  Tree *streamed_leaf;
+  uint32_t streamed_leaf_node_count;
+  TreeBuilder tree_builder;
+  const TSOpaqueRegion *opaque_regions;
+  uint32_t opaque_region_count;
+  const uint32_t *expanded_opaque_bytes;
+  uint32_t expanded_opaque_byte_count;
+  unsigned operation_count;
+  uint32_t last_position;
+  bool has_partial_parse;
+
+  // In append mode, the parser resumes from the given snapshot, if any, and
+  // keeps the last snapshot that a later position has shown to be within the
+  // input, along with the latest one, which may depend on the end of it.
+  bool records_snapshots;
+  const ParseSnapshot *resume_snapshot;
+  ParseSnapshot confirmed_snapshot;
+  ParseSnapshot pending_snapshot;
+
+  // The largest sizes that the arrays of the pools into which the parser has
+  // parsed have grown to, which are reserved in the pool at the start of each
+  // parse, so that a shared parser's new pools don't regrow them.
+  TreePoolCapacity tree_pool_capacity;
 } Parser;
 
 bool parser_init(Parser *);
 void parser_destroy(Parser *);
+
+// Parse the given input, reusing the given old tree. If the parser's
+// cancellation flag is set, its timeout elapses, or it has advanced more than
+// `max_bytes_per_call` bytes or past a `priority_end_byte` that it hadn't yet
+// reached, this returns NULL, and the next call resumes the same parse,
+// ignoring its arguments. Call `parser_reset` to discard the unfinished parse
+// instead.
 Tree *parser_parse(Parser *, TSInput, Tree *, bool halt_on_error);
+
+// Combine the trees of an unfinished parse with the subtrees of its old tree
+// that follow the text parsed so far, returning NULL if there are none. The old
+// tree must still be alive.
+Tree *parser_provisional_tree(Parser *);
+void parser_reset(Parser *);
+
+// Move the latest snapshot recorded by the last parse that only depends on the
+// text of the given tree, which the parse returned, into the given snapshot,
+// releasing what was there before. The given snapshot is left empty if there
+// is none.
+void parser_take_snapshot(Parser *, Tree *, ParseSnapshot *);
 void parser_set_language(Parser *, const TSLanguage *);
+void parser_set_tree_pool(Parser *, TreePool *);
+
+// Give back the memory that the parser keeps between parses, and forget the
+// sizes that its pools grew to. An unfinished parse keeps the nodes of its
+// stack.
+void parser_trim(Parser *);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,630 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "tree_sitter/runtime.h"
+#include "runtime/alloc.h"
+#include "runtime/array.h"
+#include "runtime/language.h"
+#include "runtime/tree.h"
+#include "runtime/work_range.h"
+#include <ctype.h>
+#include <string.h>
+
+// A pattern set holds patterns written as S-expressions, such as
+// `(call_expression (member_expression (property_identifier) @name))`. A
+// pattern matches a node and, in order, some of the node's children, which
+// don't need to be adjacent. Named nodes are written as `(type ...)` and
+// anonymous ones as string literals; `(_)` matches any named node and `_`
+// matches any node. A node can be followed by `@name` to capture it. Each
+// pattern matches a given node at most once, using the earliest children that
+// fit.
+//
+// Node types are resolved to the language's symbols when the set is built, and
+// the patterns are indexed by the symbol of their outermost node, so that every
+// pattern in the set is matched in a single traversal of the tree.
+
+#define NONE UINT32_MAX
+
+// The steps of a pattern are stored in preorder. A step's first child, if it
+// has any, is the step that follows it.
+typedef struct {
+  TSSymbol symbol;
+  bool is_wildcard : 1;
+  bool is_named : 1;
+  bool has_children : 1;
+  uint32_t next_sibling_index;
+  uint32_t capture_index;
+} PatternStep;
+
+// Symbols are identified by an index that is the symbol itself, except for
+// the error symbol, which comes after every symbol in the language. Symbols
+// that share a type (such as aliases of one another) are mapped to the first
+// of them, and the patterns that can match a node are listed by that index.
+struct TSPatternSet {
+  const TSLanguage *language;
+  Array(PatternStep) steps;
+  Array(uint32_t) pattern_step_indices;
+  Array(char *) capture_names;
+  uint32_t symbol_index_count;
+  TSSymbol *canonical_symbol_indices;
+  uint32_t *dispatch_offsets;
+  uint32_t *dispatch_pattern_indices;
+};
+
+typedef struct {
+  const char *start;
+  const char *cursor;
+  const char *end;
+} PatternReader;
+
+typedef struct {
+  const TSPatternSet *set;
+  Array(TSNode) children;
+  Array(TSPatternCapture) captures;
+} PatternMatcher;
+
+/*
+ *  Symbols
+ */
+
+static inline TSSymbol pattern_set__symbol_for_index(const TSPatternSet *self, uint32_t index) {
+  return index + 1 == self->symbol_index_count ? ts_builtin_sym_error : index;
+}
+
+static inline uint32_t pattern_set__index_for_symbol(const TSPatternSet *self, TSSymbol symbol) {
+  return symbol == ts_builtin_sym_error ? self->symbol_index_count - 1 : symbol;
+}
+
+// Find the visible symbol with the given type. Returns NONE if there is no
+// such symbol.
+static uint32_t pattern_set__find_symbol_index(const TSPatternSet *self, const char *name,
+                                               uint32_t length, bool is_named) {
+  TSSymbol symbol = ts_language_symbol_for_name(self->language, name, length, is_named);
+  if (symbol == 0) return NONE;
+  return pattern_set__index_for_symbol(self, symbol);
+}
+
+static void pattern_set__build_canonical_symbol_indices(TSPatternSet *self) {
+  self->canonical_symbol_indices = ts_calloc(self->symbol_index_count, sizeof(TSSymbol));
+  for (uint32_t i = 0; i < self->symbol_index_count; i++) {
+    TSSymbol symbol = pattern_set__symbol_for_index(self, i);
+    TSSymbolMetadata metadata = ts_language_symbol_metadata(self->language, symbol);
+    const char *name = ts_language_symbol_name(self->language, symbol);
+    uint32_t index = NONE;
+    if (metadata.visible && name) {
+      index = pattern_set__find_symbol_index(self, name, strlen(name), metadata.named);
+    }
+    self->canonical_symbol_indices[i] = index == NONE ? i : index;
+  }
+}
+
+/*
+ *  Compiling
+ */
+
+static void pattern_reader__skip_whitespace(PatternReader *self) {
+  while (self->cursor < self->end) {
+    if (isspace((unsigned char)*self->cursor)) {
+      self->cursor++;
+    } else if (*self->cursor == ';') {
+      while (self->cursor < self->end && *self->cursor != '\n') self->cursor++;
+    } else {
+      break;
+    }
+  }
+}
+
+static inline bool pattern_reader__is_identifier_char(char c) {
+  return isalnum((unsigned char)c) || c == '_' || c == '-' || c == '.';
+}
+
+static uint32_t pattern_reader__read_identifier(PatternReader *self) {
+  const char *start = self->cursor;
+  while (self->cursor < self->end && pattern_reader__is_identifier_char(*self->cursor)) {
+    self->cursor++;
+  }
+  return self->cursor - start;
+}
+
+static uint32_t pattern_set__add_capture(TSPatternSet *self, const char *name, uint32_t length) {
+  for (uint32_t i = 0; i < self->capture_names.size; i++) {
+    const char *capture_name = self->capture_names.contents[i];
+    if (strlen(capture_name) == length && memcmp(capture_name, name, length) == 0) return i;
+  }
+  char *capture_name = ts_malloc(length + 1);
+  memcpy(capture_name, name, length);
+  capture_name[length] = '\0';
+  array_push(&self->capture_names, capture_name);
+  return self->capture_names.size - 1;
+}
+
+// Read one node of a pattern, along with its children and its capture, and
+// append its steps. Returns false, leaving the reader at the offending
+// character, if the pattern is malformed or names an unknown type.
+static bool pattern_set__read_step(TSPatternSet *self, PatternReader *reader) {
+  PatternStep step = {
+    .symbol = 0,
+    .is_wildcard = false,
+    .is_named = false,
+    .has_children = false,
+    .next_sibling_index = NONE,
+    .capture_index = NONE,
+  };
+  uint32_t step_index = self->steps.size;
+
+  if (reader->cursor == reader->end) return false;
+  if (*reader->cursor == '(') {
+    reader->cursor++;
+    pattern_reader__skip_whitespace(reader);
+    const char *name = reader->cursor;
+    uint32_t length = pattern_reader__read_identifier(reader);
+    step.is_named = true;
+    if (length == 1 && name[0] == '_') {
+      step.is_wildcard = true;
+    } else {
+      uint32_t index = pattern_set__find_symbol_index(self, name, length, true);
+      if (index == NONE) {
+        reader->cursor = name;
+        return false;
+      }
+      step.symbol = index;
+    }
+    array_push(&self->steps, step);
+
+    uint32_t previous_child_index = NONE;
+    for (;;) {
+      pattern_reader__skip_whitespace(reader);
+      if (reader->cursor == reader->end) return false;
+      if (*reader->cursor == ')') break;
+      uint32_t child_index = self->steps.size;
+      if (!pattern_set__read_step(self, reader)) return false;
+      if (previous_child_index == NONE) {
+        self->steps.contents[step_index].has_children = true;
+      } else {
+        self->steps.contents[previous_child_index].next_sibling_index = child_index;
+      }
+      previous_child_index = child_index;
+    }
+    reader->cursor++;
+  } else if (*reader->cursor == '"') {
+    const char *literal_start = reader->cursor;
+    Array(char) literal = array_new();
+    reader->cursor++;
+    while (reader->cursor < reader->end && *reader->cursor != '"') {
+      if (*reader->cursor == '\\' && reader->cursor + 1 < reader->end) reader->cursor++;
+      array_push(&literal, *reader->cursor);
+      reader->cursor++;
+    }
+    uint32_t index = NONE;
+    if (reader->cursor < reader->end && literal.size > 0) {
+      index = pattern_set__find_symbol_index(self, literal.contents, literal.size, false);
+    }
+    array_delete(&literal);
+    if (index == NONE) {
+      reader->cursor = literal_start;
+      return false;
+    }
+    reader->cursor++;
+    step.symbol = index;
+    array_push(&self->steps, step);
+  } else if (*reader->cursor == '_') {
+    const char *name = reader->cursor;
+    if (pattern_reader__read_identifier(reader) != 1) {
+      reader->cursor = name;
+      return false;
+    }
+    step.is_wildcard = true;
+    array_push(&self->steps, step);
+  } else {
+    return false;
+  }
+
+  pattern_reader__skip_whitespace(reader);
+  if (reader->cursor < reader->end && *reader->cursor == '@') {
+    reader->cursor++;
+    const char *name = reader->cursor;
+    uint32_t length = pattern_reader__read_identifier(reader);
+    if (length == 0) return false;
+    self->steps.contents[step_index].capture_index = pattern_set__add_capture(self, name, length);
+  }
+  return true;
+}
+
+// List the patterns that can match each type, in the order that the patterns
+// were written. Wildcard patterns are listed under every type they can match.
+static void pattern_set__build_dispatch_table(TSPatternSet *self) {
+  uint32_t *counts = ts_calloc(self->symbol_index_count + 1, sizeof(uint32_t));
+  for (uint32_t pass = 0; pass < 2; pass++) {
+    if (pass == 1) {
+      self->dispatch_offsets = ts_calloc(self->symbol_index_count + 1, sizeof(uint32_t));
+      for (uint32_t i = 0; i < self->symbol_index_count; i++) {
+        self->dispatch_offsets[i + 1] = self->dispatch_offsets[i] + counts[i];
+        counts[i] = self->dispatch_offsets[i];
+      }
+      self->dispatch_pattern_indices = ts_calloc(
+        self->dispatch_offsets[self->symbol_index_count] + 1, sizeof(uint32_t)
+      );
+    }
+
+    for (uint32_t i = 0; i < self->pattern_step_indices.size; i++) {
+      const PatternStep *step = &self->steps.contents[self->pattern_step_indices.contents[i]];
+      for (uint32_t j = 0; j < self->symbol_index_count; j++) {
+        if (step->is_wildcard) {
+          if (self->canonical_symbol_indices[j] != j) continue;
+          TSSymbol symbol = pattern_set__symbol_for_index(self, j);
+          TSSymbolMetadata metadata = ts_language_symbol_metadata(self->language, symbol);
+          if (!metadata.visible || (step->is_named && !metadata.named)) continue;
+        } else if (step->symbol != j) {
+          continue;
+        }
+        if (pass == 0) {
+          counts[j]++;
+        } else {
+          self->dispatch_pattern_indices[counts[j]++] = i;
+        }
+      }
+    }
+  }
+  ts_free(counts);
+}
+
+TSPatternSet *ts_pattern_set_new(const TSLanguage *language, const char *source,
+                                 uint32_t length, uint32_t *error_offset) {
+  TSPatternSet *self = ts_calloc(1, sizeof(TSPatternSet));
+  self->language = language;
+  array_init(&self->steps);
+  array_init(&self->pattern_step_indices);
+  array_init(&self->capture_names);
+  self->symbol_index_count = ts_language_symbol_count(language) + 1;
+  pattern_set__build_canonical_symbol_indices(self);
+
+  PatternReader reader = {source, source, source + length};
+  for (;;) {
+    pattern_reader__skip_whitespace(&reader);
+    if (reader.cursor == reader.end) break;
+    array_push(&self->pattern_step_indices, self->steps.size);
+    if (!pattern_set__read_step(self, &reader)) {
+      if (error_offset) *error_offset = reader.cursor - reader.start;
+      ts_pattern_set_delete(self);
+      return NULL;
+    }
+  }
+
+  pattern_set__build_dispatch_table(self);
+  if (error_offset) *error_offset = 0;
+  return self;
+}
+
+void ts_pattern_set_delete(TSPatternSet *self) {
+  for (uint32_t i = 0; i < self->capture_names.size; i++) {
+    ts_free(self->capture_names.contents[i]);
+  }
+  array_delete(&self->capture_names);
+  array_delete(&self->steps);
+  array_delete(&self->pattern_step_indices);
+  ts_free(self->canonical_symbol_indices);
+  ts_free(self->dispatch_offsets);
+  ts_free(self->dispatch_pattern_indices);
+  ts_free(self);
+}
+
+uint32_t ts_pattern_set_pattern_count(const TSPatternSet *self) {
+  return self->pattern_step_indices.size;
+}
+
+uint32_t ts_pattern_set_capture_count(const TSPatternSet *self) {
+  return self->capture_names.size;
+}
+
+const char *ts_pattern_set_capture_name(const TSPatternSet *self, uint32_t index) {
+  return index < self->capture_names.size ? self->capture_names.contents[index] : NULL;
+}
+
+/*
+ *  Matching
+ */
+
+static inline bool pattern_matcher__step_matches_node(const PatternMatcher *self,
+                                                      const PatternStep *step, TSNode node) {
+  if (step->is_wildcard) return !step->is_named || ts_node_is_named(node);
+  uint32_t index = pattern_set__index_for_symbol(self->set, ts_node_symbol(node));
+  return self->set->canonical_symbol_indices[index] == step->symbol;
+}
+
+static bool pattern_matcher__match_step(PatternMatcher *, uint32_t, TSNode);
+
+// Match the given step and its later siblings against the children in the
+// given range of the child buffer, backtracking when a later sibling can't be
+// matched.
+static bool pattern_matcher__match_children(PatternMatcher *self, uint32_t step_index,
+                                              uint32_t start, uint32_t end) {
+  if (step_index == NONE) return true;
+  uint32_t next_sibling_index = self->set->steps.contents[step_index].next_sibling_index;
+  uint32_t capture_count = self->captures.size;
+  for (uint32_t i = start; i < end; i++) {
+    if (pattern_matcher__match_step(self, step_index, self->children.contents[i]) &&
+        pattern_matcher__match_children(self, next_sibling_index, i + 1, end)) {
+      return true;
+    }
+    self->captures.size = capture_count;
+  }
+  return false;
+}
+
+// The children of the nodes being matched are pushed onto one buffer, which is
+// used as a stack.
+static bool pattern_matcher__match_step(PatternMatcher *self, uint32_t step_index, TSNode node) {
+  const PatternStep *step = &self->set->steps.contents[step_index];
+  if (!pattern_matcher__step_matches_node(self, step, node)) return false;
+  if (step->capture_index != NONE) {
+    array_push(&self->captures, ((TSPatternCapture){node, step->capture_index}));
+  }
+  if (!step->has_children) return true;
+
+  uint32_t start = self->children.size;
+  uint32_t child_count = ts_node_child_count(node);
+  array_reserve(&self->children, start + child_count);
+  child_count = ts_node_children(node, self->children.contents + start, child_count);
+  self->children.size = start + child_count;
+  bool result = pattern_matcher__match_children(self, step_index + 1, start, start + child_count);
+  self->children.size = start;
+  return result;
+}
+
+// Try each pattern that can match the node. Returns false if the callback
+// stopped the matching.
+static bool pattern_matcher__visit(PatternMatcher *self, TSNode node,
+                                   TSPatternMatchCallback callback, void *payload) {
+  const TSPatternSet *set = self->set;
+  uint32_t index = set->canonical_symbol_indices[
+    pattern_set__index_for_symbol(set, ts_node_symbol(node))
+  ];
+  for (uint32_t i = set->dispatch_offsets[index]; i < set->dispatch_offsets[index + 1]; i++) {
+    uint32_t pattern_index = set->dispatch_pattern_indices[i];
+    self->captures.size = 0;
+    if (pattern_matcher__match_step(self, set->pattern_step_indices.contents[pattern_index], node)) {
+      TSPatternMatch match = {pattern_index, self->captures.contents, self->captures.size};
+      if (!callback(payload, &match)) return false;
+    }
+  }
+  return true;
+}
+
+// Empty nodes are within a range if they are at its start or inside it, and
+// other nodes if they overlap it.
+static inline bool pattern_set__node_intersects_range(TSNode node, uint32_t start_byte,
+                                                      uint32_t end_byte) {
+  uint32_t node_start_byte = ts_node_start_byte(node);
+  uint32_t node_end_byte = ts_node_end_byte(node);
+  if (node_start_byte == node_end_byte) {
+    return start_byte <= node_start_byte && node_start_byte < end_byte;
+  }
+  return node_start_byte < end_byte && node_end_byte > start_byte;
+}
+
+static bool pattern_matcher__match_in_range(PatternMatcher *self, TSNode node,
+                                            uint32_t start_byte, uint32_t end_byte,
+                                            TSPatternMatchCallback callback, void *payload) {
+  TSTreeCursor *cursor = ts_tree_cursor_new(node);
+  bool result = true;
+
+  // Nodes are visited in preorder, so their start positions never decrease,
+  // and the traversal can end at the first node that starts after the range.
+  for (;;) {
+    TSNode current = ts_tree_cursor_current_node(cursor);
+    if (ts_node_start_byte(current) >= end_byte) break;
+
+    if (pattern_set__node_intersects_range(current, start_byte, end_byte)) {
+      if (!pattern_matcher__visit(self, current, callback, payload)) {
+        result = false;
+        break;
+      }
+      if (ts_tree_cursor_goto_first_child(cursor)) continue;
+    }
+
+    bool has_next = false;
+    do {
+      if (ts_tree_cursor_goto_next_sibling(cursor)) {
+        has_next = true;
+        break;
+      }
+    } while (ts_tree_cursor_goto_parent(cursor));
+    if (!has_next) break;
+  }
+
+  ts_tree_cursor_delete(cursor);
+  return result;
+}
+
+bool ts_pattern_set_match_in_range(const TSPatternSet *self, TSNode node,
+                                   uint32_t start_byte, uint32_t end_byte,
+                                   TSPatternMatchCallback callback, void *payload) {
+  PatternMatcher matcher = {self, array_new(), array_new()};
+  bool result = pattern_matcher__match_in_range(
+    &matcher, node, start_byte, end_byte, callback, payload
+  );
+  array_delete(&matcher.children);
+  array_delete(&matcher.captures);
+  return result;
+}
+
+bool ts_pattern_set_match(const TSPatternSet *self, TSNode node,
+                          TSPatternMatchCallback callback, void *payload) {
+  return ts_pattern_set_match_in_range(self, node, 0, UINT32_MAX, callback, payload);
+}
+
+/*
+ *  Parallel matching
+ */
+
+// To be matched on several threads, a tree is divided into units of work,
+// listed in document order. A unit is either a whole subtree, or a single node
+// whose children are divided further because its subtree is too large. The
+// matches that are found in each unit are recorded, and once every unit has
+// been matched, they are passed to the callback in the order of the units, so
+// that they arrive in the same order as from a traversal on one thread.
+
+#define PATTERN_WORK_UNITS_PER_THREAD 8
+
+typedef struct {
+  uint32_t pattern_index;
+  uint32_t capture_offset;
+  uint32_t capture_count;
+} PatternMatchRecord;
+
+typedef struct {
+  TSNode node;
+  bool includes_descendants;
+  Array(PatternMatchRecord) matches;
+  Array(TSPatternCapture) captures;
+} PatternWorkUnit;
+
+typedef Array(PatternWorkUnit) PatternWorkUnitArray;
+
+typedef struct {
+  PatternWorkUnit *units;
+  WorkRange *ranges;
+  uint32_t worker_count;
+} PatternWork;
+
+typedef struct {
+  PatternWork *work;
+  WorkRange *range;
+  PatternMatcher matcher;
+#ifndef _WIN32
+  pthread_t thread;
+#endif
+} PatternWorker;
+
+// Divide the tree so that each subtree that is matched as a unit has at most a
+// fraction of the tree's nodes, counting hidden ones, which are traversed too.
+// The tree is walked with a cursor, like a traversal on one thread, because
+// long repetitions can be deep until they are balanced.
+static void pattern_set__divide(TSNode node, uint32_t thread_count, PatternWorkUnitArray *units) {
+  uint32_t max_unit_node_count =
+    ts_tree_node_count(node.data) / (thread_count * PATTERN_WORK_UNITS_PER_THREAD) + 1;
+  TSTreeCursor *cursor = ts_tree_cursor_new(node);
+  for (;;) {
+    TSNode current = ts_tree_cursor_current_node(cursor);
+    bool includes_descendants = ts_tree_node_count(current.data) <= max_unit_node_count;
+    array_push(units, ((PatternWorkUnit){current, includes_descendants, array_new(), array_new()}));
+    if (!includes_descendants && ts_tree_cursor_goto_first_child(cursor)) continue;
+
+    bool has_next = false;
+    do {
+      if (ts_tree_cursor_goto_next_sibling(cursor)) {
+        has_next = true;
+        break;
+      }
+    } while (ts_tree_cursor_goto_parent(cursor));
+    if (!has_next) break;
+  }
+  ts_tree_cursor_delete(cursor);
+}
+
+static bool pattern_work_unit__record_match(void *payload, const TSPatternMatch *match) {
+  PatternWorkUnit *self = payload;
+  array_push(&self->matches, ((PatternMatchRecord){
+    match->pattern_index,
+    self->captures.size,
+    match->capture_count,
+  }));
+  for (uint32_t i = 0; i < match->capture_count; i++) {
+    array_push(&self->captures, match->captures[i]);
+  }
+  return true;
+}
+
+static void *pattern_worker__run(void *payload) {
+  PatternWorker *self = payload;
+  PatternWork *work = self->work;
+  uint32_t unit_index;
+  for (;;) {
+    if (work_range_take(self->range, &unit_index)) {
+      PatternWorkUnit *unit = &work->units[unit_index];
+      if (unit->includes_descendants) {
+        pattern_matcher__match_in_range(
+          &self->matcher, unit->node, 0, UINT32_MAX, pattern_work_unit__record_match, unit
+        );
+      } else {
+        pattern_matcher__visit(&self->matcher, unit->node, pattern_work_unit__record_match, unit);
+      }
+    } else if (!work_range_steal(self->range, work->ranges, work->worker_count)) {
+      break;
+    }
+  }
+  return NULL;
+}
+
+// Match the patterns against the node and its descendants on up to the given
+// number of threads, one of which is the calling thread. The tree is only
+// read, so it can be shared by other readers at the same time, but it must not
+// be freed until this returns, so a document's root node should be acquired
+// or snapshotted first. The callback is invoked on the calling thread, once
+// all of the nodes have been matched, with the same matches in the same order
+// as `ts_pattern_set_match`. Returns false if the callback stopped the
+// matching.
+bool ts_pattern_set_match_in_parallel(const TSPatternSet *self, TSNode node, uint32_t thread_count,
+                                      TSPatternMatchCallback callback, void *payload) {
+  if (thread_count <= 1 || !node.data) return ts_pattern_set_match(self, node, callback, payload);
+
+  PatternWorkUnitArray units = array_new();
+  pattern_set__divide(node, thread_count, &units);
+  uint32_t worker_count = thread_count < units.size ? thread_count : units.size;
+
+  PatternWork work = {units.contents, ts_calloc(worker_count, sizeof(WorkRange)), worker_count};
+  PatternWorker *workers = ts_calloc(worker_count, sizeof(PatternWorker));
+  for (uint32_t i = 0; i < worker_count; i++) {
+    PatternWorker *worker = &workers[i];
+    worker->work = &work;
+    worker->range = &work.ranges[i];
+    worker->matcher = (PatternMatcher){self, array_new(), array_new()};
+    work_range_init(
+      worker->range,
+      (uint32_t)((uint64_t)units.size * i / worker_count),
+      (uint32_t)((uint64_t)units.size * (i + 1) / worker_count)
+    );
+  }
+
+  // The first worker runs on the calling thread. If a thread can't be created,
+  // its units are left to be stolen by the workers that are running.
+#ifndef _WIN32
+  bool *started = ts_calloc(worker_count, sizeof(bool));
+  for (uint32_t i = 1; i < worker_count; i++) {
+    started[i] = pthread_create(&workers[i].thread, NULL, pattern_worker__run, &workers[i]) == 0;
+  }
+  pattern_worker__run(&workers[0]);
+  for (uint32_t i = 1; i < worker_count; i++) {
+    if (started[i]) pthread_join(workers[i].thread, NULL);
+  }
+  ts_free(started);
+#else
+  pattern_worker__run(&workers[0]);
+#endif
+
+  for (uint32_t i = 0; i < worker_count; i++) {
+    PatternWorker *worker = &workers[i];
+    array_delete(&worker->matcher.children);
+    array_delete(&worker->matcher.captures);
+    work_range_delete(worker->range);
+  }
+  ts_free(workers);
+  ts_free(work.ranges);
+
+  bool result = true;
+  for (uint32_t i = 0; i < units.size; i++) {
+    PatternWorkUnit *unit = &units.contents[i];
+    for (uint32_t j = 0; result && j < unit->matches.size; j++) {
+      PatternMatchRecord *record = &unit->matches.contents[j];
+      TSPatternMatch match = {
+        record->pattern_index,
+        unit->captures.contents + record->capture_offset,
+        record->capture_count,
+      };
+      result = callback(payload, &match);
+    }
+    array_delete(&unit->matches);
+    array_delete(&unit->captures);
+  }
+  array_delete(&units);
+  return result;
+}
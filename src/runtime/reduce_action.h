@@ -5,9 +5,13 @@
 extern "C" {
 #endif
 
+#include <string.h>
+#include "runtime/alloc.h"
 #include "runtime/array.h"
 #include "tree_sitter/runtime.h"
 
+#define REDUCE_ACTION_SET_INDEX_THRESHOLD 8
+
 typedef struct {
   uint32_t count;
   TSSymbol symbol;
@@ -15,16 +19,109 @@ typedef struct {
   unsigned short alias_sequence_id;
 } ReduceAction;
 
-typedef Array(ReduceAction) ReduceActionSet;
+typedef struct {
+  uint32_t generation;
+  uint32_t action_index;
+} ReduceActionSlot;
+
+// Small sets are searched linearly. Once a set reaches the threshold size, its
+// actions are also indexed by an open-addressed hash table, keyed on their
+// symbol and child count. Slots are only valid if their generation matches the
+// set's, so clearing the set doesn't require clearing the table.
+typedef struct {
+  Array(ReduceAction) actions;
+  ReduceActionSlot *slots;
+  uint32_t slot_count;
+  uint32_t generation;
+} ReduceActionSet;
+
+static inline void ts_reduce_action_set_init(ReduceActionSet *self) {
+  array_init(&self->actions);
+  self->slots = NULL;
+  self->slot_count = 0;
+  self->generation = 1;
+}
+
+static inline void ts_reduce_action_set_delete(ReduceActionSet *self) {
+  if (self->actions.contents) array_delete(&self->actions);
+  if (self->slots) ts_free(self->slots);
+  self->slots = NULL;
+  self->slot_count = 0;
+}
+
+static inline void ts_reduce_action_set__invalidate_slots(ReduceActionSet *self) {
+  self->generation++;
+  if (self->generation == 0) {
+    if (self->slots) memset(self->slots, 0, self->slot_count * sizeof(ReduceActionSlot));
+    self->generation = 1;
+  }
+}
+
+static inline void ts_reduce_action_set_clear(ReduceActionSet *self) {
+  array_clear(&self->actions);
+  ts_reduce_action_set__invalidate_slots(self);
+}
+
+static inline uint32_t ts_reduce_action_set__hash(TSSymbol symbol, uint32_t count) {
+  return (symbol * 31u + count) * 2654435761u;
+}
+
+// Find the slot for the given key: either the one that holds it, or the empty
+// one where it should be inserted.
+static inline ReduceActionSlot *ts_reduce_action_set__find_slot(ReduceActionSet *self,
+                                                               TSSymbol symbol,
+                                                               uint32_t count) {
+  uint32_t mask = self->slot_count - 1;
+  for (uint32_t i = ts_reduce_action_set__hash(symbol, count) & mask;; i = (i + 1) & mask) {
+    ReduceActionSlot *slot = &self->slots[i];
+    if (slot->generation != self->generation) return slot;
+    ReduceAction *action = &self->actions.contents[slot->action_index];
+    if (action->symbol == symbol && action->count == count) return slot;
+  }
+}
+
+static inline void ts_reduce_action_set__reindex(ReduceActionSet *self) {
+  uint32_t slot_count = self->slot_count > 0 ? self->slot_count : 2 * REDUCE_ACTION_SET_INDEX_THRESHOLD;
+  while (slot_count < 2 * (self->actions.size + 1)) slot_count *= 2;
+  if (slot_count != self->slot_count) {
+    if (self->slots) ts_free(self->slots);
+    self->slots = (ReduceActionSlot *)ts_calloc(slot_count, sizeof(ReduceActionSlot));
+    self->slot_count = slot_count;
+    self->generation = 1;
+  } else {
+    ts_reduce_action_set__invalidate_slots(self);
+  }
+
+  uint32_t generation = self->generation;
+  for (uint32_t i = 0; i < self->actions.size; i++) {
+    ReduceAction *action = &self->actions.contents[i];
+    ReduceActionSlot *slot = ts_reduce_action_set__find_slot(self, action->symbol, action->count);
+    *slot = (ReduceActionSlot){generation, i};
+  }
+}
 
 static inline void ts_reduce_action_set_add(ReduceActionSet *self,
                                             ReduceAction new_action) {
-  for (uint32_t i = 0; i < self->size; i++) {
-    ReduceAction action = self->contents[i];
-    if (action.symbol == new_action.symbol && action.count == new_action.count)
-      return;
+  if (self->actions.size < REDUCE_ACTION_SET_INDEX_THRESHOLD) {
+    for (uint32_t i = 0; i < self->actions.size; i++) {
+      ReduceAction action = self->actions.contents[i];
+      if (action.symbol == new_action.symbol && action.count == new_action.count)
+        return;
+    }
+    array_push(&self->actions, new_action);
+    if (self->actions.size == REDUCE_ACTION_SET_INDEX_THRESHOLD) {
+      ts_reduce_action_set__reindex(self);
+    }
+    return;
+  }
+
+  ReduceActionSlot *slot = ts_reduce_action_set__find_slot(self, new_action.symbol, new_action.count);
+  if (slot->generation == self->generation) return;
+  *slot = (ReduceActionSlot){self->generation, self->actions.size};
+  array_push(&self->actions, new_action);
+  if (2 * self->actions.size > self->slot_count) {
+    ts_reduce_action_set__reindex(self);
   }
-  array_push(self, new_action);
 }
 
 #ifdef __cplusplus
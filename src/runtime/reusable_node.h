@@ -2,45 +2,109 @@
 
 typedef struct {
   Tree *tree;
-  uint32_t byte_index;
+  uint32_t child_index;
+  uint32_t byte_offset;
+} ReusableNodeEntry;
+
+// Trees don't point to their parents, so the path from the root of the
+// previous tree to the current node is stored explicitly.
+typedef struct {
+  Array(ReusableNodeEntry) stack;
   Tree *last_external_token;
 } ReusableNode;
 
-static inline ReusableNode reusable_node_new(Tree *tree) {
-  ReusableNode result = {tree, 0, NULL};
-  return result;
+// The node after the current one is usually either its next sibling or its
+// first child, so those are requested from memory ahead of time, while the
+// parser is still busy with the current node.
+static inline void reusable_node__prefetch(const void *address) {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(address);
+#endif
 }
 
-static inline void reusable_node_pop(ReusableNode *self) {
-  self->byte_index += ts_tree_total_bytes(self->tree);
-  if (self->tree->has_external_tokens) {
-    self->last_external_token = ts_tree_last_external_token(self->tree);
+static inline void reusable_node__prefetch_next(const Tree *parent, uint32_t child_index) {
+  if (child_index + 1 < parent->children.size) {
+    reusable_node__prefetch(parent->children.contents[child_index + 1]);
   }
+  const Tree *tree = parent->children.contents[child_index];
+  if (tree->children.size > 0) reusable_node__prefetch(tree->children.contents);
+}
+
+static inline ReusableNode reusable_node_new() {
+  return (ReusableNode){array_new(), NULL};
+}
 
-  while (self->tree) {
-    Tree *parent = self->tree->context.parent;
-    uint32_t next_index = self->tree->context.index + 1;
-    if (parent && parent->children.size > next_index) {
-      self->tree = parent->children.contents[next_index];
-      return;
-    }
-    self->tree = parent;
+static inline void reusable_node_reset(ReusableNode *self, Tree *tree) {
+  array_clear(&self->stack);
+  if (tree) {
+    array_push(&self->stack, ((ReusableNodeEntry){
+      .tree = tree,
+      .child_index = 0,
+      .byte_offset = 0,
+    }));
   }
+  self->last_external_token = NULL;
+}
+
+static inline void reusable_node_delete(ReusableNode *self) {
+  array_delete(&self->stack);
+}
+
+static inline void reusable_node_assign(ReusableNode *self, const ReusableNode *other) {
+  array_reserve(&self->stack, other->stack.size);
+  if (other->stack.size > 0) memcpy(self->stack.contents, other->stack.contents, other->stack.size * sizeof(ReusableNodeEntry));
+  self->stack.size = other->stack.size;
+  self->last_external_token = other->last_external_token;
 }
 
-static inline ReusableNode reusable_node_after_leaf(const ReusableNode *self) {
-  ReusableNode result = *self;
-  while (result.tree->children.size > 0)
-    result.tree = result.tree->children.contents[0];
-  reusable_node_pop(&result);
-  return result;
+static inline Tree *reusable_node_tree(const ReusableNode *self) {
+  return self->stack.size > 0 ? self->stack.contents[self->stack.size - 1].tree : NULL;
+}
+
+static inline uint32_t reusable_node_byte_offset(const ReusableNode *self) {
+  return self->stack.size > 0 ? self->stack.contents[self->stack.size - 1].byte_offset : 0;
+}
+
+static inline void reusable_node_pop(ReusableNode *self) {
+  ReusableNodeEntry last_entry = *array_back(&self->stack);
+  uint32_t byte_offset = last_entry.byte_offset + ts_tree_total_bytes(last_entry.tree);
+  if (last_entry.tree->has_external_tokens) {
+    self->last_external_token = ts_tree_last_external_token(last_entry.tree);
+  }
+
+  Tree *parent;
+  uint32_t next_index;
+  do {
+    ReusableNodeEntry popped_entry = array_pop(&self->stack);
+    next_index = popped_entry.child_index + 1;
+    if (self->stack.size == 0) return;
+    parent = array_back(&self->stack)->tree;
+  } while (parent->children.size <= next_index);
+
+  array_push(&self->stack, ((ReusableNodeEntry){
+    .tree = parent->children.contents[next_index],
+    .child_index = next_index,
+    .byte_offset = byte_offset,
+  }));
+  reusable_node__prefetch_next(parent, next_index);
 }
 
 static inline bool reusable_node_breakdown(ReusableNode *self) {
-  if (self->tree->children.size == 0) {
+  ReusableNodeEntry last_entry = *array_back(&self->stack);
+  if (last_entry.tree->children.size == 0) {
     return false;
   } else {
-    self->tree = self->tree->children.contents[0];
+    array_push(&self->stack, ((ReusableNodeEntry){
+      .tree = last_entry.tree->children.contents[0],
+      .child_index = 0,
+      .byte_offset = last_entry.byte_offset,
+    }));
+    reusable_node__prefetch_next(last_entry.tree, 0);
     return true;
   }
 }
+
+static inline void reusable_node_pop_leaf(ReusableNode *self) {
+  while (reusable_node_breakdown(self));
+  reusable_node_pop(self);
+}
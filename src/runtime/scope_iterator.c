@@ -0,0 +1,110 @@
+#include "tree_sitter/runtime.h"
+#include "runtime/alloc.h"
+#include "runtime/array.h"
+
+// A scope iterator divides a window of a tree's text into spans, each of which
+// lies within the same stack of visible nodes. It walks the tree with a cursor,
+// skipping the subtrees that end before the window and stopping at the end of
+// the window, so that the cost of iterating over a window depends on the nodes
+// within it, rather than on the size of the tree.
+//
+// The cursor is either on a node that hasn't been entered yet, whose parent is
+// the innermost of the current scopes, or on the innermost scope itself, once
+// all of that scope's children have been visited.
+
+typedef enum {
+  ScopeIteratorAtChild,
+  ScopeIteratorAtScopeEnd,
+  ScopeIteratorDone,
+} ScopeIteratorState;
+
+struct TSScopeIterator {
+  TSTreeCursor *cursor;
+  TSNode root;
+  Array(TSSymbol) scopes;
+  uint32_t position;
+  uint32_t end_byte;
+  ScopeIteratorState state;
+};
+
+static void ts_scope_iterator__goto_next_node(TSScopeIterator *self) {
+  if (ts_tree_cursor_goto_next_sibling(self->cursor)) {
+    self->state = ScopeIteratorAtChild;
+  } else if (ts_tree_cursor_goto_parent(self->cursor)) {
+    self->state = ScopeIteratorAtScopeEnd;
+  } else {
+    self->state = ScopeIteratorDone;
+  }
+}
+
+static inline void ts_scope_iterator__emit(TSScopeIterator *self, uint32_t end_byte,
+                                           TSScopeSpan *span) {
+  if (end_byte > self->end_byte) end_byte = self->end_byte;
+  span->start_byte = self->position;
+  span->end_byte = end_byte;
+  span->scopes = self->scopes.contents;
+  span->scope_count = self->scopes.size;
+  self->position = end_byte;
+}
+
+TSScopeIterator *ts_scope_iterator_new(TSNode node, uint32_t start_byte, uint32_t end_byte) {
+  TSScopeIterator *self = ts_malloc(sizeof(TSScopeIterator));
+  self->cursor = ts_tree_cursor_new(node);
+  self->root = node;
+  array_init(&self->scopes);
+  ts_scope_iterator_reset(self, start_byte, end_byte);
+  return self;
+}
+
+void ts_scope_iterator_delete(TSScopeIterator *self) {
+  ts_tree_cursor_delete(self->cursor);
+  array_delete(&self->scopes);
+  ts_free(self);
+}
+
+// Start over with a new window, keeping the iterator's memory.
+void ts_scope_iterator_reset(TSScopeIterator *self, uint32_t start_byte, uint32_t end_byte) {
+  while (ts_tree_cursor_goto_parent(self->cursor)) {}
+  array_clear(&self->scopes);
+  uint32_t root_start_byte = ts_node_start_byte(self->root);
+  self->position = start_byte > root_start_byte ? start_byte : root_start_byte;
+  self->end_byte = end_byte;
+  self->state = ScopeIteratorAtChild;
+}
+
+bool ts_scope_iterator_next(TSScopeIterator *self, TSScopeSpan *span) {
+  while (self->state != ScopeIteratorDone && self->position < self->end_byte) {
+    TSNode node = ts_tree_cursor_current_node(self->cursor);
+
+    if (self->state == ScopeIteratorAtChild) {
+      // Skip the nodes that end before the current position, including empty
+      // ones, which don't contain any text.
+      if (ts_node_end_byte(node) <= self->position) {
+        ts_scope_iterator__goto_next_node(self);
+        continue;
+      }
+
+      uint32_t start_byte = ts_node_start_byte(node);
+      if (start_byte > self->position) {
+        ts_scope_iterator__emit(self, start_byte, span);
+        return true;
+      }
+
+      array_push(&self->scopes, ts_node_symbol(node));
+      if (!ts_tree_cursor_goto_first_child(self->cursor)) {
+        self->state = ScopeIteratorAtScopeEnd;
+      }
+    } else {
+      uint32_t end_byte = ts_node_end_byte(node);
+      if (end_byte > self->position) {
+        ts_scope_iterator__emit(self, end_byte, span);
+        return true;
+      }
+
+      self->scopes.size--;
+      ts_scope_iterator__goto_next_node(self);
+    }
+  }
+
+  return false;
+}
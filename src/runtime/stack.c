@@ -8,7 +8,7 @@
 #include <stdio.h>
 
 #define MAX_LINK_COUNT 8
-#define MAX_NODE_POOL_SIZE 50
+#define MIN_NODE_SLAB_SIZE 64
 #define MAX_ITERATOR_COUNT 64
 
 #ifdef _WIN32
@@ -25,20 +25,36 @@ typedef struct {
   bool is_pending;
 } StackLink;
 
+// Most nodes only ever have one link, which is stored inline. When a second
+// link is added, the links are moved to a block with room for MAX_LINK_COUNT.
 struct StackNode {
   TSStateId state;
-  Length position;
-  StackLink links[MAX_LINK_COUNT];
   short unsigned int link_count;
   uint32_t ref_count;
+  Length position;
+  StackLink *links;
+  StackLink first_link;
   unsigned error_cost;
   unsigned node_count;
   int dynamic_precedence;
 };
 
+// The trees that iterators pass are recorded as entries that point to the
+// entry before them, so iterators that split from a common path share the
+// entries for that path, and an iterator's trees are only copied into an array
+// when they are popped.
+#define PATH_NONE UINT32_MAX
+
+typedef struct {
+  Tree *tree;
+  uint32_t previous;
+} StackPathEntry;
+
 typedef struct {
   StackNode *node;
-  TreeArray trees;
+  uint32_t path;
+  uint32_t path_size;
+  Tree *first_tree;
   uint32_t tree_count;
   bool is_pending;
 } Iterator;
@@ -50,12 +66,50 @@ typedef struct {
 
 typedef Array(StackNode *) StackNodeArray;
 
+// Nodes are carved out of slabs, and released nodes are kept on a free list
+// until the stack is trimmed or deleted. Each new slab is as large as all of
+// the previous ones combined, so the pool quickly grows to the peak number of
+// nodes that a parse requires, and later parses with the same stack don't
+// allocate nodes.
+// The summaries recorded for error recovery are recycled in the same way.
+typedef struct {
+  StackNodeArray free_nodes;
+  Array(StackLink *) free_link_blocks;
+  Array(StackSummary *) free_summaries;
+  Array(StackNode *) slabs;
+  StackNode *slab_cursor;
+  StackNode *slab_end;
+  uint32_t capacity;
+  uint32_t link_block_count;
+} StackNodePool;
+
 typedef enum {
   StackStatusActive,
   StackStatusPaused,
   StackStatusHalted,
 } StackStatus;
 
+// A node on the linear part of the stack from which the last summary was
+// computed, along with its depth and the index of its entry in the summary.
+typedef struct {
+  StackNode *node;
+  unsigned depth;
+  uint32_t entry_index;
+} StackSummaryNode;
+
+typedef Array(StackSummaryNode) StackSummaryNodeArray;
+
+// During a run of errors, each summary is computed from a stack that shares
+// most of its nodes with the stack of the previous summary, so the last
+// summary is kept, and the next one copies its deeper entries from it. The
+// first node is retained, which keeps all of the others alive.
+typedef struct {
+  StackSummary entries;
+  StackSummaryNodeArray nodes;
+  StackSummaryNodeArray next_nodes;
+  unsigned max_depth;
+} StackSummaryCache;
+
 typedef struct {
   StackNode *node;
   Tree *last_external_token;
@@ -69,9 +123,11 @@ struct Stack {
   Array(StackHead) heads;
   StackSliceArray slices;
   Array(Iterator) iterators;
-  StackNodeArray node_pool;
+  Array(StackPathEntry) path_entries;
+  StackNodePool node_pool;
   StackNode *base_node;
   TreePool *tree_pool;
+  StackSummaryCache summary_cache;
 };
 
 typedef unsigned StackAction;
@@ -83,6 +139,81 @@ enum {
 
 typedef StackAction (*StackCallback)(void *, const Iterator *);
 
+static void stack_node_pool_init(StackNodePool *self) {
+  array_init(&self->free_nodes);
+  array_init(&self->free_link_blocks);
+  array_init(&self->free_summaries);
+  array_init(&self->slabs);
+  self->slab_cursor = NULL;
+  self->slab_end = NULL;
+  self->capacity = 0;
+  self->link_block_count = 0;
+}
+
+static void stack_node_pool_delete(StackNodePool *self) {
+  for (uint32_t i = 0; i < self->slabs.size; i++) {
+    ts_free(self->slabs.contents[i]);
+  }
+  for (uint32_t i = 0; i < self->free_link_blocks.size; i++) {
+    ts_free(self->free_link_blocks.contents[i]);
+  }
+  for (uint32_t i = 0; i < self->free_summaries.size; i++) {
+    array_delete(self->free_summaries.contents[i]);
+    ts_free(self->free_summaries.contents[i]);
+  }
+  array_delete(&self->free_nodes);
+  array_delete(&self->free_link_blocks);
+  array_delete(&self->free_summaries);
+  array_delete(&self->slabs);
+}
+
+static StackNode *stack_node_pool_allocate(StackNodePool *self) {
+  if (self->free_nodes.size > 0) {
+    return array_pop(&self->free_nodes);
+  }
+
+  if (self->slab_cursor == self->slab_end) {
+    uint32_t slab_size = self->capacity < MIN_NODE_SLAB_SIZE ? MIN_NODE_SLAB_SIZE : self->capacity;
+    StackNode *slab = ts_malloc(slab_size * sizeof(StackNode));
+    array_push(&self->slabs, slab);
+    self->slab_cursor = slab;
+    self->slab_end = slab + slab_size;
+    self->capacity += slab_size;
+  }
+
+  return self->slab_cursor++;
+}
+
+static void stack_node_pool_free(StackNodePool *self, StackNode *node) {
+  if (node->links != &node->first_link) {
+    array_push(&self->free_link_blocks, node->links);
+  }
+  array_push(&self->free_nodes, node);
+}
+
+static StackLink *stack_node_pool_allocate_links(StackNodePool *self) {
+  if (self->free_link_blocks.size > 0) {
+    return array_pop(&self->free_link_blocks);
+  }
+  self->link_block_count++;
+  return ts_malloc(MAX_LINK_COUNT * sizeof(StackLink));
+}
+
+static StackSummary *stack_node_pool_allocate_summary(StackNodePool *self) {
+  if (self->free_summaries.size > 0) {
+    StackSummary *summary = array_pop(&self->free_summaries);
+    array_clear(summary);
+    return summary;
+  }
+  StackSummary *summary = ts_malloc(sizeof(StackSummary));
+  array_init(summary);
+  return summary;
+}
+
+static void stack_node_pool_free_summary(StackNodePool *self, StackSummary *summary) {
+  array_push(&self->free_summaries, summary);
+}
+
 static void stack_node_retain(StackNode *self) {
   if (!self)
     return;
@@ -91,7 +222,7 @@ static void stack_node_retain(StackNode *self) {
   assert(self->ref_count != 0);
 }
 
-static void stack_node_release(StackNode *self, StackNodeArray *pool, TreePool *tree_pool) {
+static void stack_node_release(StackNode *self, StackNodePool *pool, TreePool *tree_pool) {
 recur:
   assert(self->ref_count != 0);
   self->ref_count--;
@@ -107,11 +238,7 @@ recur:
     first_predecessor = self->links[0].node;
   }
 
-  if (pool->size < MAX_NODE_POOL_SIZE) {
-    array_push(pool, self);
-  } else {
-    ts_free(self);
-  }
+  stack_node_pool_free(pool, self);
 
   if (first_predecessor) {
     self = first_predecessor;
@@ -120,11 +247,10 @@ recur:
 }
 
 static StackNode *stack_node_new(StackNode *previous_node, Tree *tree, bool is_pending,
-                                 TSStateId state, StackNodeArray *pool) {
-  StackNode *node = pool->size > 0 ?
-    array_pop(pool) :
-    ts_malloc(sizeof(StackNode));
+                                 TSStateId state, StackNodePool *pool) {
+  StackNode *node = stack_node_pool_allocate(pool);
   *node = (StackNode){.ref_count = 1, .link_count = 0, .state = state};
+  node->links = &node->first_link;
 
   if (previous_node) {
     node->link_count = 1;
@@ -167,43 +293,50 @@ static bool stack__tree_is_equivalent(const Tree *left, const Tree *right) {
        ts_tree_external_token_state_eq(left, right))));
 }
 
-static void stack_node_add_link(StackNode *self, StackLink link) {
-  if (link.node == self) return;
+// Returns true if a link was added to this node or to one of its predecessors.
+static bool stack_node_add_link(StackNode *self, StackLink link, StackNodePool *pool) {
+  if (link.node == self) return false;
 
   for (int i = 0; i < self->link_count; i++) {
     StackLink existing_link = self->links[i];
     if (stack__tree_is_equivalent(existing_link.tree, link.tree)) {
-      if (existing_link.node == link.node) return;
+      if (existing_link.node == link.node) return false;
       if (existing_link.node->state == link.node->state &&
           existing_link.node->position.bytes == link.node->position.bytes) {
+        bool did_add_link = false;
         for (int j = 0; j < link.node->link_count; j++) {
-          stack_node_add_link(existing_link.node, link.node->links[j]);
+          if (stack_node_add_link(existing_link.node, link.node->links[j], pool)) {
+            did_add_link = true;
+          }
         }
-        return;
+        return did_add_link;
       }
     }
   }
 
-  if (self->link_count == MAX_LINK_COUNT) return;
+  if (self->link_count == MAX_LINK_COUNT) return false;
+
+  if (self->links == &self->first_link && self->link_count == 1) {
+    self->links = stack_node_pool_allocate_links(pool);
+    self->links[0] = self->first_link;
+  }
 
   stack_node_retain(link.node);
   if (link.tree) ts_tree_retain(link.tree);
   self->links[self->link_count++] = link;
 
   unsigned node_count = link.node->node_count;
-  if (link.tree) node_count += link.tree->node_count;
+  if (link.tree) node_count += ts_tree_node_count(link.tree);
   if (node_count > self->node_count) self->node_count = node_count;
+  return true;
 }
 
-static void stack_head_delete(StackHead *self, StackNodeArray *pool, TreePool *tree_pool) {
+static void stack_head_delete(StackHead *self, StackNodePool *pool, TreePool *tree_pool) {
   if (self->node) {
     if (self->last_external_token) {
       ts_tree_release(tree_pool, self->last_external_token);
     }
-    if (self->summary) {
-      array_delete(self->summary);
-      ts_free(self->summary);
-    }
+    if (self->summary) stack_node_pool_free_summary(pool, self->summary);
     stack_node_release(self->node, pool, tree_pool);
   }
 }
@@ -239,26 +372,35 @@ static void ts_stack__add_slice(Stack *self, StackVersion original_version,
   array_push(&self->slices, slice);
 }
 
+static TreeArray stack__iterator_trees(Stack *self, const Iterator *iterator) {
+  TreeArray trees = array_new();
+  array_reserve(&trees, iterator->path_size);
+  for (uint32_t i = iterator->path; i != PATH_NONE; i = self->path_entries.contents[i].previous) {
+    Tree *tree = self->path_entries.contents[i].tree;
+    ts_tree_retain(tree);
+    trees.contents[trees.size++] = tree;
+  }
+  return trees;
+}
+
 inline StackSliceArray stack__iter(Stack *self, StackVersion version,
                                    StackCallback callback, void *payload,
                                    int goal_tree_count) {
   array_clear(&self->slices);
   array_clear(&self->iterators);
+  array_clear(&self->path_entries);
 
   StackHead *head = array_get(&self->heads, version);
   Iterator iterator = {
     .node = head->node,
-    .trees = array_new(),
+    .path = PATH_NONE,
+    .path_size = 0,
+    .first_tree = NULL,
     .tree_count = 0,
     .is_pending = true,
   };
 
-  bool include_trees = false;
-  if (goal_tree_count >= 0) {
-    include_trees = true;
-    array_reserve(&iterator.trees, goal_tree_count);
-  }
-
+  bool include_trees = goal_tree_count >= 0;
   array_push(&self->iterators, iterator);
 
   while (self->iterators.size > 0) {
@@ -271,10 +413,7 @@ inline StackSliceArray stack__iter(Stack *self, StackVersion version,
       bool should_stop = action & StackActionStop || node->link_count == 0;
 
       if (should_pop) {
-        TreeArray trees = iterator->trees;
-        if (!should_stop)
-          ts_tree_array_copy(trees, &trees);
-        ts_tree_array_reverse(&trees);
+        TreeArray trees = stack__iterator_trees(self, iterator);
         ts_stack__add_slice(
           self,
           version,
@@ -284,8 +423,6 @@ inline StackSliceArray stack__iter(Stack *self, StackVersion version,
       }
 
       if (should_stop) {
-        if (!should_pop)
-          ts_tree_array_delete(self->tree_pool, &iterator->trees);
         array_erase(&self->iterators, i);
         i--, size--;
         continue;
@@ -303,14 +440,16 @@ inline StackSliceArray stack__iter(Stack *self, StackVersion version,
           Iterator current_iterator = self->iterators.contents[i];
           array_push(&self->iterators, current_iterator);
           next_iterator = array_back(&self->iterators);
-          ts_tree_array_copy(next_iterator->trees, &next_iterator->trees);
         }
 
         next_iterator->node = link.node;
         if (link.tree) {
           if (include_trees) {
-            array_push(&next_iterator->trees, link.tree);
-            ts_tree_retain(link.tree);
+            StackPathEntry entry = {link.tree, next_iterator->path};
+            array_push(&self->path_entries, entry);
+            next_iterator->path = self->path_entries.size - 1;
+            next_iterator->path_size++;
+            if (!next_iterator->first_tree) next_iterator->first_tree = link.tree;
           }
 
           if (!link.tree->extra) {
@@ -330,17 +469,29 @@ inline StackSliceArray stack__iter(Stack *self, StackVersion version,
   return self->slices;
 }
 
+static void ts_stack__clear_summary_cache(Stack *self) {
+  StackSummaryCache *cache = &self->summary_cache;
+  if (cache->nodes.size > 0) {
+    stack_node_release(cache->nodes.contents[0].node, &self->node_pool, self->tree_pool);
+    array_clear(&cache->nodes);
+  }
+  array_clear(&cache->entries);
+}
+
 Stack *ts_stack_new(TreePool *tree_pool) {
   Stack *self = ts_calloc(1, sizeof(Stack));
 
   array_init(&self->heads);
   array_init(&self->slices);
   array_init(&self->iterators);
-  array_init(&self->node_pool);
+  array_init(&self->path_entries);
+  stack_node_pool_init(&self->node_pool);
+  array_init(&self->summary_cache.entries);
+  array_init(&self->summary_cache.nodes);
+  array_init(&self->summary_cache.next_nodes);
   array_reserve(&self->heads, 4);
   array_reserve(&self->slices, 4);
   array_reserve(&self->iterators, 4);
-  array_reserve(&self->node_pool, MAX_NODE_POOL_SIZE);
 
   self->tree_pool = tree_pool;
   self->base_node = stack_node_new(NULL, NULL, false, 1, &self->node_pool);
@@ -354,20 +505,66 @@ void ts_stack_delete(Stack *self) {
     array_delete(&self->slices);
   if (self->iterators.contents)
     array_delete(&self->iterators);
+  if (self->path_entries.contents)
+    array_delete(&self->path_entries);
+  ts_stack__clear_summary_cache(self);
+  array_delete(&self->summary_cache.entries);
+  array_delete(&self->summary_cache.nodes);
+  array_delete(&self->summary_cache.next_nodes);
   stack_node_release(self->base_node, &self->node_pool, self->tree_pool);
   for (uint32_t i = 0; i < self->heads.size; i++) {
     stack_head_delete(&self->heads.contents[i], &self->node_pool, self->tree_pool);
   }
   array_clear(&self->heads);
-  if (self->node_pool.contents) {
-    for (uint32_t i = 0; i < self->node_pool.size; i++)
-      ts_free(self->node_pool.contents[i]);
-    array_delete(&self->node_pool);
-  }
+  stack_node_pool_delete(&self->node_pool);
   array_delete(&self->heads);
   ts_free(self);
 }
 
+void ts_stack_trim(Stack *self) {
+  StackNodePool *pool = &self->node_pool;
+  for (uint32_t i = 0; i < pool->free_link_blocks.size; i++) {
+    ts_free(pool->free_link_blocks.contents[i]);
+  }
+  pool->link_block_count -= pool->free_link_blocks.size;
+  array_delete(&pool->free_link_blocks);
+  for (uint32_t i = 0; i < pool->free_summaries.size; i++) {
+    array_delete(pool->free_summaries.contents[i]);
+    ts_free(pool->free_summaries.contents[i]);
+  }
+  array_delete(&pool->free_summaries);
+
+  // Once the stack has been cleared, the base node is the only node in use, so
+  // the slabs are freed and the base node is allocated again.
+  if (self->heads.size == 1 && self->heads.contents[0].node == self->base_node &&
+      self->base_node->ref_count == 2) {
+    stack_node_pool_delete(pool);
+    stack_node_pool_init(pool);
+    self->base_node = stack_node_new(NULL, NULL, false, 1, pool);
+    stack_node_retain(self->base_node);
+    self->heads.contents[0].node = self->base_node;
+  }
+
+  array_shrink(&self->slices);
+  array_shrink(&self->iterators);
+  array_shrink(&self->path_entries);
+  array_shrink(&self->summary_cache.entries);
+  array_shrink(&self->summary_cache.nodes);
+  array_shrink(&self->summary_cache.next_nodes);
+  array_reserve(&self->slices, 4);
+  array_reserve(&self->iterators, 4);
+}
+
+void ts_stack_set_tree_pool(Stack *self, TreePool *tree_pool) {
+  self->tree_pool = tree_pool;
+}
+
+size_t ts_stack_allocated_bytes(const Stack *self) {
+  return
+    self->node_pool.capacity * sizeof(StackNode) +
+    self->node_pool.link_block_count * MAX_LINK_COUNT * sizeof(StackLink);
+}
+
 uint32_t ts_stack_version_count(const Stack *self) {
   return self->heads.size;
 }
@@ -391,6 +588,22 @@ void ts_stack_set_last_external_token(Stack *self, StackVersion version, Tree *t
   head->last_external_token = token;
 }
 
+Tree **ts_stack_bottom_tree(Stack *self, StackVersion version) {
+  StackNode *node = array_get(&self->heads, version)->node;
+  unsigned depth = 0;
+  while (node != self->base_node) {
+    if (node->link_count != 1) return NULL;
+    StackLink *link = &node->links[0];
+    depth++;
+    if (link->node == self->base_node) {
+      if (depth == 1 || link->is_pending || !link->tree) return NULL;
+      return &link->tree;
+    }
+    node = link->node;
+  }
+  return NULL;
+}
+
 unsigned ts_stack_error_cost(const Stack *self, StackVersion version) {
   StackHead *head = array_get(&self->heads, version);
   unsigned result = head->node->error_cost;
@@ -442,10 +655,74 @@ inline StackAction pop_count_callback(void *payload, const Iterator *iterator) {
   }
 }
 
+// Most reductions pop a part of the stack that has never been split, so the
+// nodes being popped each have a single link. In that case, the trees can be
+// collected with a direct walk, without the iterators that `stack__iter` uses
+// to follow every path. It produces the same single slice as `stack__iter`,
+// with its trees written in order into the given storage if they fit.
+static bool ts_stack__pop_count_linear(Stack *self, StackVersion version, uint32_t count,
+                                       TreeArray storage) {
+  StackNode *head_node = array_get(&self->heads, version)->node;
+  StackNode *node = head_node;
+  uint32_t tree_count = 0, link_count = 0, step_count = 0;
+  while (tree_count < count && node->link_count > 0) {
+    if (node->link_count > 1) return false;
+    const StackLink *link = &node->links[0];
+    if (link->tree) link_count++;
+    if (!link->tree || !link->tree->extra) tree_count++;
+    node = link->node;
+    step_count++;
+  }
+
+  // Like `stack__iter`, return no slices if the stack runs out of entries.
+  if (tree_count < count) {
+    array_clear(&self->slices);
+    return true;
+  }
+
+  TreeArray trees = storage;
+  if (link_count == 0 || link_count > storage.capacity) {
+    array_init(&trees);
+    array_reserve(&trees, link_count);
+  }
+  trees.size = link_count;
+  node = head_node;
+  for (uint32_t i = 0; i < step_count; i++) {
+    const StackLink *link = &node->links[0];
+    if (link->tree) {
+      ts_tree_retain(link->tree);
+      trees.contents[--link_count] = link->tree;
+    }
+    node = link->node;
+  }
+
+  array_clear(&self->slices);
+  ts_stack__add_slice(self, version, node, &trees);
+  return true;
+}
+
 StackSliceArray ts_stack_pop_count(Stack *self, StackVersion version, uint32_t count) {
+  TreeArray storage = array_new();
+  return ts_stack_pop_count_into(self, version, count, storage);
+}
+
+StackSliceArray ts_stack_pop_count_into(Stack *self, StackVersion version, uint32_t count,
+                                        TreeArray storage) {
+  if (ts_stack__pop_count_linear(self, version, count, storage)) return self->slices;
   return stack__iter(self, version, pop_count_callback, &count, count);
 }
 
+bool ts_stack_top_is_exclusive(const Stack *self, StackVersion version, uint32_t count) {
+  const StackNode *node = array_get(&self->heads, version)->node;
+  while (count > 0) {
+    if (node->ref_count > 1 || node->link_count != 1) return false;
+    const StackLink *link = &node->links[0];
+    if (!link->tree || !link->tree->extra) count--;
+    node = link->node;
+  }
+  return true;
+}
+
 inline StackAction pop_pending_callback(void *payload, const Iterator *iterator) {
   if (iterator->tree_count >= 1) {
     if (iterator->is_pending) {
@@ -468,9 +745,9 @@ StackSliceArray ts_stack_pop_pending(Stack *self, StackVersion version) {
 }
 
 inline StackAction pop_error_callback(void *payload, const Iterator *iterator) {
-  if (iterator->trees.size > 0) {
+  if (iterator->first_tree) {
     bool *found_error = payload;
-    if (!*found_error && iterator->trees.contents[0]->symbol == ts_builtin_sym_error) {
+    if (!*found_error && iterator->first_tree->symbol == ts_builtin_sym_error) {
       *found_error = true;
       return StackActionPop | StackActionStop;
     } else {
@@ -506,37 +783,132 @@ StackSliceArray ts_stack_pop_all(Stack *self, StackVersion version) {
   return stack__iter(self, version, pop_all_callback, NULL, 0);
 }
 
+static void stack__add_summary_entry(StackSummary *summary, StackSummaryEntry entry) {
+  for (unsigned i = summary->size - 1; i + 1 > 0; i--) {
+    StackSummaryEntry previous_entry = summary->contents[i];
+    if (previous_entry.depth < entry.depth) break;
+    if (previous_entry.depth == entry.depth && previous_entry.state == entry.state) return;
+  }
+  array_push(summary, entry);
+}
+
+// A node's entry can only be copied into a later summary if no entry precedes
+// it at the same depth, because an earlier entry could otherwise have been
+// left out of the later summary.
+static void stack__add_summary_node(StackSummaryNodeArray *nodes, StackSummary *summary,
+                                    StackNode *node, unsigned depth) {
+  if (summary->size > 0 && array_back(summary)->depth >= depth) return;
+  array_push(nodes, ((StackSummaryNode){
+    .node = node,
+    .depth = depth,
+    .entry_index = summary->size,
+  }));
+}
+
 typedef struct {
+  Stack *stack;
   StackSummary *summary;
   unsigned max_depth;
+  bool is_linear;
+  bool is_truncated;
 } SummarizeStackSession;
 
 inline StackAction summarize_stack_callback(void *payload, const Iterator *iterator) {
   SummarizeStackSession *session = payload;
-  TSStateId state = iterator->node->state;
+  StackNode *node = iterator->node;
   unsigned depth = iterator->tree_count;
+
+  // If some paths had to be dropped, this summary can't be extended later.
+  if (session->stack->iterators.size >= MAX_ITERATOR_COUNT) session->is_truncated = true;
+
   if (depth > session->max_depth) return StackActionStop;
-  for (unsigned i = session->summary->size - 1; i + 1 > 0; i--) {
-    StackSummaryEntry entry = session->summary->contents[i];
-    if (entry.depth < depth) break;
-    if (entry.depth == depth && entry.state == state) return StackActionNone;
+  if (session->is_linear) {
+    stack__add_summary_node(&session->stack->summary_cache.next_nodes, session->summary, node, depth);
+    if (node->link_count > 1) session->is_linear = false;
   }
-  array_push(session->summary, ((StackSummaryEntry){
-    .position = iterator->node->position,
+  stack__add_summary_entry(session->summary, ((StackSummaryEntry){
+    .position = node->position,
     .depth = depth,
-    .state = state,
+    .state = node->state,
   }));
   return StackActionNone;
 }
 
+// Walk down the linear part of the stack until reaching a node from which the
+// last summary was computed, at a depth no smaller than the node had in the
+// last summary, and copy the remaining entries from there. Returns false if
+// the stack branches before any such node is reached.
+static bool ts_stack__summarize_from_cache(Stack *self, StackNode *node,
+                                           StackSummary *summary, unsigned max_depth) {
+  StackSummaryCache *cache = &self->summary_cache;
+  if (cache->nodes.size == 0 || cache->max_depth != max_depth) return false;
+
+  unsigned depth = 0;
+  for (;;) {
+    if (depth > max_depth) return true;
+
+    for (uint32_t i = 0; i < cache->nodes.size; i++) {
+      StackSummaryNode *cached_node = &cache->nodes.contents[i];
+      if (cached_node->node != node || cached_node->depth > depth) continue;
+
+      unsigned depth_shift = depth - cached_node->depth;
+      for (uint32_t j = cached_node->entry_index; j < cache->entries.size; j++) {
+        StackSummaryEntry entry = cache->entries.contents[j];
+        entry.depth += depth_shift;
+        if (entry.depth > max_depth) continue;
+        if (i < cache->nodes.size && cache->nodes.contents[i].entry_index == j) {
+          StackSummaryNode next_node = cache->nodes.contents[i++];
+          stack__add_summary_node(&cache->next_nodes, summary, next_node.node, entry.depth);
+        }
+        stack__add_summary_entry(summary, entry);
+      }
+      return true;
+    }
+
+    stack__add_summary_node(&cache->next_nodes, summary, node, depth);
+    stack__add_summary_entry(summary, ((StackSummaryEntry){
+      .position = node->position,
+      .depth = depth,
+      .state = node->state,
+    }));
+    if (node->link_count == 0) return true;
+    if (node->link_count > 1) return false;
+    StackLink link = node->links[0];
+    if (!link.tree || !link.tree->extra) depth++;
+    node = link.node;
+  }
+}
+
 void ts_stack_record_summary(Stack *self, StackVersion version, unsigned max_depth) {
-  SummarizeStackSession session = {
-    .summary = ts_malloc(sizeof(StackSummary)),
-    .max_depth = max_depth
-  };
-  array_init(session.summary);
-  stack__iter(self, version, summarize_stack_callback, &session, -1);
-  self->heads.contents[version].summary = session.summary;
+  StackHead *head = array_get(&self->heads, version);
+  StackSummaryCache *cache = &self->summary_cache;
+  StackSummary *summary = stack_node_pool_allocate_summary(&self->node_pool);
+
+  array_clear(&cache->next_nodes);
+  if (!ts_stack__summarize_from_cache(self, head->node, summary, max_depth)) {
+    array_clear(summary);
+    array_clear(&cache->next_nodes);
+    SummarizeStackSession session = {
+      .stack = self,
+      .summary = summary,
+      .max_depth = max_depth,
+      .is_linear = true,
+      .is_truncated = false,
+    };
+    stack__iter(self, version, summarize_stack_callback, &session, -1);
+    if (session.is_truncated) array_clear(&cache->next_nodes);
+  }
+
+  if (head->summary) stack_node_pool_free_summary(&self->node_pool, head->summary);
+  head->summary = summary;
+
+  if (cache->next_nodes.size > 0) stack_node_retain(cache->next_nodes.contents[0].node);
+  ts_stack__clear_summary_cache(self);
+  StackSummaryNodeArray nodes = cache->nodes;
+  cache->nodes = cache->next_nodes;
+  cache->next_nodes = nodes;
+  cache->max_depth = max_depth;
+  array_push_all(&cache->entries, summary);
 }
 
 StackSummary *ts_stack_get_summary(Stack *self, StackVersion version) {
@@ -587,7 +959,9 @@ bool ts_stack_merge(Stack *self, StackVersion version1, StackVersion version2) {
   StackHead *head1 = &self->heads.contents[version1];
   StackHead *head2 = &self->heads.contents[version2];
   for (uint32_t i = 0; i < head2->node->link_count; i++) {
-    stack_node_add_link(head1->node, head2->node->links[i]);
+    if (stack_node_add_link(head1->node, head2->node->links[i], &self->node_pool)) {
+      ts_stack__clear_summary_cache(self);
+    }
   }
   if (head1->node->state == ERROR_STATE) {
     head1->node_count_at_last_error = head1->node->node_count;
@@ -641,6 +1015,7 @@ TSSymbol ts_stack_resume(Stack *self, StackVersion version) {
 }
 
 void ts_stack_clear(Stack *self) {
+  ts_stack__clear_summary_cache(self);
   stack_node_retain(self->base_node);
   for (uint32_t i = 0; i < self->heads.size; i++) {
     stack_head_delete(&self->heads.contents[i], &self->node_pool, self->tree_pool);
@@ -654,6 +1029,49 @@ void ts_stack_clear(Stack *self) {
   }));
 }
 
+bool ts_stack_take_snapshot(Stack *self, StackVersion version, unsigned max_depth,
+                            StackSnapshot *snapshot) {
+  StackHead *head = array_get(&self->heads, version);
+  unsigned depth = 0;
+  for (StackNode *node = head->node; node != self->base_node; node = node->links[0].node) {
+    if (node->link_count != 1 || !node->links[0].tree || depth == max_depth) return false;
+    depth++;
+  }
+
+  ts_stack_snapshot_clear(snapshot, self->tree_pool);
+  array_reserve(&snapshot->entries, depth);
+  snapshot->entries.size = depth;
+  StackNode *node = head->node;
+  for (unsigned i = depth; i > 0; i--) {
+    StackLink link = node->links[0];
+    ts_tree_retain(link.tree);
+    snapshot->entries.contents[i - 1] = (StackSnapshotEntry){link.tree, node->state, link.is_pending};
+    node = link.node;
+  }
+  snapshot->last_external_token = head->last_external_token;
+  if (snapshot->last_external_token) ts_tree_retain(snapshot->last_external_token);
+  return true;
+}
+
+void ts_stack_restore_snapshot(Stack *self, const StackSnapshot *snapshot) {
+  assert(self->heads.size == 1 && self->heads.contents[0].node == self->base_node);
+  for (uint32_t i = 0; i < snapshot->entries.size; i++) {
+    StackSnapshotEntry entry = snapshot->entries.contents[i];
+    ts_tree_retain(entry.tree);
+    ts_stack_push(self, 0, entry.tree, entry.is_pending, entry.state);
+  }
+  ts_stack_set_last_external_token(self, 0, snapshot->last_external_token);
+}
+
+void ts_stack_snapshot_clear(StackSnapshot *snapshot, TreePool *tree_pool) {
+  for (uint32_t i = 0; i < snapshot->entries.size; i++) {
+    ts_tree_release(tree_pool, snapshot->entries.contents[i].tree);
+  }
+  array_clear(&snapshot->entries);
+  if (snapshot->last_external_token) ts_tree_release(tree_pool, snapshot->last_external_token);
+  snapshot->last_external_token = NULL;
+}
+
 bool ts_stack_print_dot_graph(Stack *self, const TSLanguage *language, FILE *f) {
   bool was_recording_allocations = ts_toggle_allocation_recording(false);
   if (!f)
@@ -28,12 +28,40 @@ typedef struct {
 } StackSummaryEntry;
 typedef Array(StackSummaryEntry) StackSummary;
 
+typedef struct {
+  Tree *tree;
+  TSStateId state;
+  bool is_pending;
+} StackSnapshotEntry;
+
+// The entries of a version of the stack from its base up, along with its last
+// external token, from which the version can be pushed back onto an empty
+// stack. A snapshot retains its trees.
+typedef struct {
+  Array(StackSnapshotEntry) entries;
+  Tree *last_external_token;
+} StackSnapshot;
+
 // Create a stack.
 Stack *ts_stack_new(TreePool *);
 
 // Release the memory reserved for a given stack.
 void ts_stack_delete(Stack *);
 
+// Change the pool into which the stack releases its trees. The stack must not
+// be holding any trees.
+void ts_stack_set_tree_pool(Stack *, TreePool *);
+
+// Give back the memory that the stack has kept for later use: the links and
+// summaries on its free lists, and, if the stack has been cleared, all of its
+// nodes but the base.
+void ts_stack_trim(Stack *);
+
+// Get the number of bytes that the stack has allocated for its nodes and their
+// links, whether or not they are in use. Once allocated, they are kept until
+// the stack is trimmed or deleted.
+size_t ts_stack_allocated_bytes(const Stack *);
+
 // Get the stack's current number of versions.
 uint32_t ts_stack_version_count(const Stack *);
 
@@ -50,6 +78,11 @@ void ts_stack_set_last_external_token(Stack *, StackVersion, Tree *);
 // Get the position of the given version of the stack within the document.
 Length ts_stack_position(const Stack *, StackVersion);
 
+// Get the tree just above the base of the given version of the stack, so that
+// the caller can replace it, as long as the stack is a single path down to the
+// base, and that tree isn't the top of the stack. Returns NULL otherwise.
+Tree **ts_stack_bottom_tree(Stack *, StackVersion);
+
 // Push a tree and state onto the given version of the stack.
 //
 // This transfers ownership of the tree to the Stack. Callers that
@@ -64,6 +97,17 @@ void ts_stack_push(Stack *, StackVersion, Tree *, bool, TSStateId);
 // removed from that version.
 StackSliceArray ts_stack_pop_count(Stack *, StackVersion, uint32_t count);
 
+// Pop entries like `ts_stack_pop_count`, but when they lie along a single path
+// and fit within the given storage, write their trees into it, so that they
+// can be used without being copied. Slices whose trees don't use the storage
+// own their arrays as usual.
+StackSliceArray ts_stack_pop_count_into(Stack *, StackVersion, uint32_t count, TreeArray storage);
+
+// Check whether the given number of entries on top of the given version of
+// the stack are only reachable from that version, so that popping them and
+// removing the version leaves the slice as the only owner of their trees.
+bool ts_stack_top_is_exclusive(const Stack *, StackVersion, uint32_t count);
+
 // Remove an error at the top of the given version of the stack.
 TreeArray ts_stack_pop_error(Stack *, StackVersion);
 
@@ -120,6 +164,19 @@ void ts_stack_remove_version(Stack *, StackVersion);
 
 void ts_stack_clear(Stack *);
 
+// Record the given version of the stack in the given snapshot, replacing its
+// previous contents, as long as the version is a single path down to the base
+// of at most the given depth, with no errors along it. Returns false, leaving
+// the snapshot as it was, otherwise.
+bool ts_stack_take_snapshot(Stack *, StackVersion, unsigned max_depth, StackSnapshot *);
+
+// Push the entries of the given snapshot onto a stack that has just been
+// cleared.
+void ts_stack_restore_snapshot(Stack *, const StackSnapshot *);
+
+// Release the trees that the given snapshot retains, leaving it empty.
+void ts_stack_snapshot_clear(StackSnapshot *, TreePool *);
+
 bool ts_stack_print_dot_graph(Stack *, const TSLanguage *, FILE *);
 
 typedef void (*StackIterateCallback)(void *, TSStateId, uint32_t);
@@ -0,0 +1,161 @@
+#include "tree_sitter/runtime.h"
+#include "runtime/alloc.h"
+#include "runtime/array.h"
+#include "runtime/language.h"
+#include "runtime/length.h"
+#include "runtime/node.h"
+#include "runtime/tree.h"
+
+// A symbol iterator visits the visible nodes of a tree whose symbols are among
+// a given set, in document order, starting with the tree's root. The language
+// lists the symbols that can appear beneath each nonterminal, so the iterator
+// skips the subtrees that can't contain any of the given symbols, without
+// visiting their nodes. Subtrees with errors are always visited, since they
+// can contain anything.
+//
+// Like a token iterator, it walks the trees directly with an explicit stack,
+// on which the trees that remain to be visited are kept in reverse document
+// order. The children of the node that was visited last are only pushed when
+// the iterator advances, so that they can be skipped.
+
+typedef struct {
+  const Tree *tree;
+  Length position;
+  TSSymbol alias_symbol;
+} SymbolIteratorEntry;
+
+struct TSSymbolIterator {
+  Array(SymbolIteratorEntry) stack;
+  const Tree *root;
+  const TSLanguage *language;
+  uint32_t *symbols;
+  bool includes_errors;
+
+  // Whether each nonterminal can contain any of the symbols, indexed from the
+  // first nonterminal, or NULL if the language doesn't say.
+  bool *nonterminals_to_search;
+  SymbolIteratorEntry last_entry;
+  bool should_visit_children;
+};
+
+static inline bool symbol_iterator__has_symbol(const TSSymbolIterator *self, TSSymbol symbol) {
+  if (symbol == ts_builtin_sym_error) return self->includes_errors;
+  if (symbol >= ts_language_symbol_count(self->language)) return false;
+  return self->symbols[symbol / 32] & (1u << (symbol % 32));
+}
+
+static inline bool symbol_iterator__should_search(const TSSymbolIterator *self, const Tree *tree) {
+  if (tree->error_cost > 0 || !self->nonterminals_to_search) return true;
+  if (tree->symbol < self->language->token_count || tree->symbol >= self->language->symbol_count) return true;
+  return self->nonterminals_to_search[tree->symbol - self->language->token_count];
+}
+
+TSSymbolIterator *ts_symbol_iterator_new(TSNode node, const TSSymbol *symbols, uint32_t symbol_count) {
+  TSSymbolIterator *self = ts_malloc(sizeof(TSSymbolIterator));
+  const TSLanguage *language = node.language;
+  uint32_t word_count = (ts_language_symbol_count(language) + 31) / 32;
+  array_init(&self->stack);
+  self->root = node.root;
+  self->language = language;
+  self->symbols = ts_calloc(word_count, sizeof(uint32_t));
+  self->includes_errors = false;
+  for (uint32_t i = 0; i < symbol_count; i++) {
+    if (symbols[i] == ts_builtin_sym_error) {
+      self->includes_errors = true;
+    } else if (symbols[i] < ts_language_symbol_count(language)) {
+      self->symbols[symbols[i] / 32] |= 1u << (symbols[i] % 32);
+    }
+  }
+
+  self->nonterminals_to_search = NULL;
+  if (language->descendant_symbol_sets) {
+    uint32_t nonterminal_count = language->symbol_count - language->token_count;
+    self->nonterminals_to_search = ts_calloc(nonterminal_count ? nonterminal_count : 1, sizeof(bool));
+    for (uint32_t i = 0; i < nonterminal_count; i++) {
+      const uint32_t *descendant_symbols =
+        ts_language_descendant_symbols(language, language->token_count + i);
+      for (uint32_t j = 0; j < word_count; j++) {
+        if (descendant_symbols[j] & self->symbols[j]) {
+          self->nonterminals_to_search[i] = true;
+          break;
+        }
+      }
+    }
+  }
+
+  ts_symbol_iterator_reset(self, node);
+  return self;
+}
+
+void ts_symbol_iterator_delete(TSSymbolIterator *self) {
+  array_delete(&self->stack);
+  ts_free(self->symbols);
+  ts_free(self->nonterminals_to_search);
+  ts_free(self);
+}
+
+// Start over from a different node of a tree in the same language, keeping the
+// iterator's memory.
+void ts_symbol_iterator_reset(TSSymbolIterator *self, TSNode node) {
+  array_clear(&self->stack);
+  self->root = node.root;
+  self->should_visit_children = false;
+  if (node.data) {
+    array_push(&self->stack, ((SymbolIteratorEntry){
+      node.data,
+      {node.offset[0], {node.offset[1], node.offset[2]}},
+      node.alias_symbol,
+    }));
+  }
+}
+
+// Don't visit the descendants of the node that was visited last.
+void ts_symbol_iterator_skip_children(TSSymbolIterator *self) {
+  self->should_visit_children = false;
+}
+
+static void symbol_iterator__push_children(TSSymbolIterator *self, SymbolIteratorEntry entry) {
+  const Tree *tree = entry.tree;
+  if (tree->children.size == 0 || !symbol_iterator__should_search(self, tree)) return;
+
+  uint32_t first_index = self->stack.size;
+  uint32_t structural_child_index = 0;
+  Length position = entry.position;
+  for (uint32_t i = 0; i < tree->children.size; i++) {
+    const Tree *child = tree->children.contents[i];
+    TSSymbol alias_symbol = 0;
+    if (!child->extra) {
+      alias_symbol = ts_language_alias_at(self->language, tree->alias_sequence_id, structural_child_index);
+      structural_child_index++;
+    }
+    array_push(&self->stack, ((SymbolIteratorEntry){child, position, alias_symbol}));
+    position = length_add(position, ts_tree_total_size(child));
+  }
+
+  for (uint32_t i = first_index, j = self->stack.size - 1; i < j; i++, j--) {
+    SymbolIteratorEntry swapped_entry = self->stack.contents[i];
+    self->stack.contents[i] = self->stack.contents[j];
+    self->stack.contents[j] = swapped_entry;
+  }
+}
+
+bool ts_symbol_iterator_next(TSSymbolIterator *self, TSNode *node) {
+  if (self->should_visit_children) {
+    self->should_visit_children = false;
+    symbol_iterator__push_children(self, self->last_entry);
+  }
+
+  while (self->stack.size > 0) {
+    SymbolIteratorEntry entry = array_pop(&self->stack);
+    const Tree *tree = entry.tree;
+    bool is_visible = tree->visible || entry.alias_symbol;
+    if (is_visible && symbol_iterator__has_symbol(self, entry.alias_symbol ? entry.alias_symbol : tree->symbol)) {
+      *node = ts_node_make(tree, entry.position, entry.alias_symbol, self->root, self->language);
+      self->last_entry = entry;
+      self->should_visit_children = true;
+      return true;
+    }
+    symbol_iterator__push_children(self, entry);
+  }
+  return false;
+}
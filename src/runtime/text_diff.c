@@ -0,0 +1,267 @@
+#include <string.h>
+#include "runtime/text_diff.h"
+#include "runtime/point.h"
+
+// Comparing the lines costs time and memory in proportion to the square of
+// the number of lines that differ, so beyond this many, the text between the
+// common start and end is replaced as a whole.
+static const uint32_t MAX_LINE_DIFF_COST = 512;
+
+typedef struct {
+  uint32_t start;
+  uint32_t length;
+  uint64_t hash;
+} TextDiffLine;
+
+typedef Array(TextDiffLine) TextDiffLineArray;
+
+typedef struct {
+  const char *old_text;
+  const char *new_text;
+  uint32_t unit_size;
+  uint32_t new_position;
+  TSPoint new_point;
+  InputEditArray *edits;
+} TextDiff;
+
+// The text is compared a word at a time until the first difference.
+static uint32_t text_diff__common_prefix(const char *a, const char *b, uint32_t length,
+                                         uint32_t unit_size) {
+  uint32_t result = 0;
+  while (result + sizeof(uint64_t) <= length) {
+    uint64_t word_a, word_b;
+    memcpy(&word_a, a + result, sizeof(uint64_t));
+    memcpy(&word_b, b + result, sizeof(uint64_t));
+    if (word_a != word_b) break;
+    result += sizeof(uint64_t);
+  }
+  while (result < length && a[result] == b[result]) result++;
+  return result - result % unit_size;
+}
+
+static uint32_t text_diff__common_suffix(const char *a_end, const char *b_end, uint32_t length,
+                                         uint32_t unit_size) {
+  uint32_t result = 0;
+  while (result + sizeof(uint64_t) <= length) {
+    uint64_t word_a, word_b;
+    memcpy(&word_a, a_end - result - sizeof(uint64_t), sizeof(uint64_t));
+    memcpy(&word_b, b_end - result - sizeof(uint64_t), sizeof(uint64_t));
+    if (word_a != word_b) break;
+    result += sizeof(uint64_t);
+  }
+  while (result < length && a_end[-(int64_t)result - 1] == b_end[-(int64_t)result - 1]) result++;
+  return result - result % unit_size;
+}
+
+// The offset of the next newline at or after the given offset, or UINT32_MAX
+// if there is none. In UTF16, a newline is a code unit.
+static uint32_t text_diff__next_newline(const char *text, uint32_t start, uint32_t length,
+                                        uint32_t unit_size) {
+  if (unit_size == 1) {
+    const char *newline = memchr(text + start, '\n', length - start);
+    return newline ? (uint32_t)(newline - text) : UINT32_MAX;
+  }
+  for (uint32_t i = start; i + 2 <= length; i += 2) {
+    uint16_t unit;
+    memcpy(&unit, text + i, sizeof(unit));
+    if (unit == '\n') return i;
+  }
+  return UINT32_MAX;
+}
+
+static TSPoint text_diff__extent(const char *text, uint32_t length, uint32_t unit_size) {
+  TSPoint result = {0, 0};
+  uint32_t line_start = 0, newline;
+  while ((newline = text_diff__next_newline(text, line_start, length, unit_size)) != UINT32_MAX) {
+    result.row++;
+    line_start = newline + unit_size;
+  }
+  result.column = length - line_start;
+  return result;
+}
+
+// Add an edit that replaces the given range of the old text with the given
+// range of the new one. The text before it has already been made to match the
+// new text, so the edit starts at its position in the new text.
+static void text_diff__push_edit(TextDiff *self, uint32_t old_start, uint32_t old_end,
+                                 uint32_t new_start, uint32_t new_end) {
+  uint32_t old_length = old_end - old_start, new_length = new_end - new_start;
+  uint32_t min_length = old_length < new_length ? old_length : new_length;
+  uint32_t prefix = text_diff__common_prefix(
+    self->old_text + old_start, self->new_text + new_start, min_length, self->unit_size
+  );
+  old_start += prefix;
+  new_start += prefix;
+  min_length -= prefix;
+  uint32_t suffix = text_diff__common_suffix(
+    self->old_text + old_end, self->new_text + new_end, min_length, self->unit_size
+  );
+  old_end -= suffix;
+  new_end -= suffix;
+  if (old_start == old_end && new_start == new_end) return;
+
+  self->new_point = point_add(self->new_point, text_diff__extent(
+    self->new_text + self->new_position, new_start - self->new_position, self->unit_size
+  ));
+  self->new_position = new_start;
+  TSInputEdit edit = {
+    .start_byte = new_start,
+    .bytes_removed = old_end - old_start,
+    .bytes_added = new_end - new_start,
+    .start_point = self->new_point,
+    .extent_removed = text_diff__extent(self->old_text + old_start, old_end - old_start, self->unit_size),
+    .extent_added = text_diff__extent(self->new_text + new_start, new_end - new_start, self->unit_size),
+  };
+  array_push(self->edits, edit);
+}
+
+static void text_diff__split_lines(const char *text, uint32_t start, uint32_t end,
+                                   uint32_t unit_size, TextDiffLineArray *lines) {
+  while (start < end) {
+    uint32_t newline = text_diff__next_newline(text, start, end, unit_size);
+    uint32_t line_end = newline == UINT32_MAX ? end : newline + unit_size;
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (uint32_t i = start; i < line_end; i++) {
+      hash = (hash ^ (unsigned char)text[i]) * 0x100000001b3ull;
+    }
+    array_push(lines, ((TextDiffLine){start, line_end - start, hash}));
+    start = line_end;
+  }
+}
+
+static inline bool text_diff__lines_eq(const TextDiff *self, const TextDiffLine *old_line,
+                                       const TextDiffLine *new_line) {
+  return old_line->hash == new_line->hash && old_line->length == new_line->length &&
+    memcmp(self->old_text + old_line->start, self->new_text + new_line->start, old_line->length) == 0;
+}
+
+// Find the fewest lines to remove and insert with the greedy algorithm from
+// Myers' "An O(ND) Difference Algorithm and Its Variations", keeping the
+// furthest reaching path along each diagonal for every cost, so that the path
+// can be traced back. Returns false if the cost exceeds the maximum.
+static bool text_diff__compare_lines(TextDiff *self, uint32_t old_start, uint32_t old_end,
+                                     uint32_t new_start, uint32_t new_end) {
+  TextDiffLineArray old_lines = array_new(), new_lines = array_new();
+  text_diff__split_lines(self->old_text, old_start, old_end, self->unit_size, &old_lines);
+  text_diff__split_lines(self->new_text, new_start, new_end, self->unit_size, &new_lines);
+  int32_t n = old_lines.size, m = new_lines.size;
+  int32_t max_cost = (int32_t)MAX_LINE_DIFF_COST;
+  if (max_cost > n + m) max_cost = n + m;
+
+  // The furthest position in the old lines reached along diagonal `k` is kept
+  // at `k + offset`. Before each cost, the positions for the diagonals that it
+  // can extend are saved in the trace.
+  int32_t offset = max_cost + 1;
+  int32_t *furthest = ts_calloc(2 * offset + 1, sizeof(int32_t));
+  Array(int32_t) trace = array_new();
+  int32_t cost = -1;
+  for (int32_t d = 0; d <= max_cost && cost < 0; d++) {
+    array__splice((VoidArray *)&trace, sizeof(int32_t), trace.size, 0, 2 * d + 3, &furthest[offset - d - 1]);
+    for (int32_t k = -d; k <= d; k += 2) {
+      int32_t x;
+      if (k == -d || (k != d && furthest[offset + k - 1] < furthest[offset + k + 1])) {
+        x = furthest[offset + k + 1];
+      } else {
+        x = furthest[offset + k - 1] + 1;
+      }
+      int32_t y = x - k;
+      while (x < n && y < m && text_diff__lines_eq(self, &old_lines.contents[x], &new_lines.contents[y])) {
+        x++;
+        y++;
+      }
+      furthest[offset + k] = x;
+      if (x >= n && y >= m) {
+        cost = d;
+        break;
+      }
+    }
+  }
+
+  bool result = cost >= 0;
+  if (result) {
+    // Trace the path back from the end, recording the lines that each step
+    // kept, and then add an edit for each gap between them.
+    Array(int32_t) kept = array_new();
+    int32_t x = n, y = m;
+    uint32_t trace_end = trace.size;
+    for (int32_t d = cost; d > 0; d--) {
+      uint32_t trace_start = trace_end - (2 * d + 3);
+      const int32_t *previous = &trace.contents[trace_start + d + 1];
+      int32_t k = x - y;
+      bool inserted = k == -d || (k != d && previous[k - 1] < previous[k + 1]);
+      int32_t previous_x = previous[inserted ? k + 1 : k - 1];
+      int32_t previous_y = previous_x - (inserted ? k + 1 : k - 1);
+      int32_t step_x = inserted ? previous_x : previous_x + 1;
+      while (x > step_x) {
+        x--;
+        y--;
+        array_push(&kept, x);
+        array_push(&kept, y);
+      }
+      x = previous_x;
+      y = previous_y;
+      trace_end = trace_start;
+    }
+    while (x > 0) {
+      x--;
+      y--;
+      array_push(&kept, x);
+      array_push(&kept, y);
+    }
+
+    int32_t next_old = 0, next_new = 0;
+    for (uint32_t i = kept.size; i > 0; i -= 2) {
+      int32_t kept_old = kept.contents[i - 2], kept_new = kept.contents[i - 1];
+      if (kept_old > next_old || kept_new > next_new) {
+        text_diff__push_edit(
+          self,
+          next_old < n ? old_lines.contents[next_old].start : old_end,
+          old_lines.contents[kept_old].start,
+          next_new < m ? new_lines.contents[next_new].start : new_end,
+          new_lines.contents[kept_new].start
+        );
+      }
+      next_old = kept_old + 1;
+      next_new = kept_new + 1;
+    }
+    if (next_old < n || next_new < m) {
+      text_diff__push_edit(
+        self,
+        next_old < n ? old_lines.contents[next_old].start : old_end, old_end,
+        next_new < m ? new_lines.contents[next_new].start : new_end, new_end
+      );
+    }
+    array_delete(&kept);
+  }
+
+  ts_free(furthest);
+  array_delete(&trace);
+  array_delete(&old_lines);
+  array_delete(&new_lines);
+  return result;
+}
+
+void text_diff_compute(const char *old_text, uint32_t old_length, const char *new_text,
+                       uint32_t new_length, TSInputEncoding encoding, bool compare_lines,
+                       InputEditArray *edits) {
+  TextDiff self = {
+    .old_text = old_text,
+    .new_text = new_text,
+    .unit_size = encoding == TSInputEncodingUTF8 ? 1 : 2,
+    .new_position = 0,
+    .new_point = {0, 0},
+    .edits = edits,
+  };
+  uint32_t min_length = old_length < new_length ? old_length : new_length;
+  uint32_t prefix = text_diff__common_prefix(old_text, new_text, min_length, self.unit_size);
+  uint32_t suffix = text_diff__common_suffix(
+    old_text + old_length, new_text + new_length, min_length - prefix, self.unit_size
+  );
+  uint32_t old_end = old_length - suffix, new_end = new_length - suffix;
+  if (
+    !compare_lines ||
+    !text_diff__compare_lines(&self, prefix, old_end, prefix, new_end)
+  ) {
+    text_diff__push_edit(&self, prefix, old_end, prefix, new_end);
+  }
+}
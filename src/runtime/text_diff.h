@@ -0,0 +1,29 @@
+#ifndef RUNTIME_TEXT_DIFF_H_
+#define RUNTIME_TEXT_DIFF_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include "tree_sitter/runtime.h"
+#include "runtime/array.h"
+
+typedef Array(TSInputEdit) InputEditArray;
+
+// Compute edits that turn the old text into the new one, in the form that
+// `ts_document_edit_batch` expects: in order, each one in terms of the text as
+// changed by the ones before it. The text that the two have in common at their
+// start and end is always left out. When `compare_lines` is set, the lines in
+// between are compared as well, so that the lines that were kept between the
+// changes are left out too. Points are measured in bytes, and in UTF16, only
+// whole code units are compared.
+void text_diff_compute(const char *old_text, uint32_t old_length, const char *new_text,
+                       uint32_t new_length, TSInputEncoding, bool compare_lines,
+                       InputEditArray *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // RUNTIME_TEXT_DIFF_H_
@@ -0,0 +1,95 @@
+#include "tree_sitter/runtime.h"
+#include "runtime/alloc.h"
+#include "runtime/array.h"
+#include "runtime/language.h"
+#include "runtime/tree.h"
+
+// A token iterator visits the leaves of a tree whose text overlaps a window,
+// in document order. Unlike a cursor, it never needs to find a node's visible
+// parent or siblings, so it walks the trees directly with an explicit stack,
+// tracking only byte offsets. Subtrees that end before the window are skipped
+// as a whole, and the walk stops at the first leaf that starts after it.
+//
+// The trees that remain to be visited are kept on the stack in reverse
+// document order, along with the byte at which their padding starts.
+
+typedef struct {
+  const Tree *tree;
+  uint32_t position;
+  TSSymbol alias_symbol;
+} TokenIteratorEntry;
+
+struct TSTokenIterator {
+  Array(TokenIteratorEntry) stack;
+  const Tree *root;
+  uint32_t root_position;
+  const TSLanguage *language;
+  uint32_t start_byte;
+  uint32_t end_byte;
+};
+
+TSTokenIterator *ts_token_iterator_new(TSNode node, uint32_t start_byte, uint32_t end_byte) {
+  TSTokenIterator *self = ts_malloc(sizeof(TSTokenIterator));
+  array_init(&self->stack);
+  self->root = node.data;
+  self->root_position = node.offset[0];
+  self->language = node.language;
+  ts_token_iterator_reset(self, start_byte, end_byte);
+  return self;
+}
+
+void ts_token_iterator_delete(TSTokenIterator *self) {
+  array_delete(&self->stack);
+  ts_free(self);
+}
+
+// Start over with a different window, keeping the iterator's memory.
+void ts_token_iterator_reset(TSTokenIterator *self, uint32_t start_byte, uint32_t end_byte) {
+  self->start_byte = start_byte;
+  self->end_byte = end_byte;
+  array_clear(&self->stack);
+  if (self->root) {
+    array_push(&self->stack, ((TokenIteratorEntry){self->root, self->root_position, 0}));
+  }
+}
+
+bool ts_token_iterator_next(TSTokenIterator *self, TSToken *token) {
+  while (self->stack.size > 0) {
+    TokenIteratorEntry entry = array_pop(&self->stack);
+    const Tree *tree = entry.tree;
+    uint32_t start_byte = entry.position + tree->padding.bytes;
+    uint32_t end_byte = start_byte + tree->size.bytes;
+    if (start_byte >= self->end_byte) {
+      array_clear(&self->stack);
+      return false;
+    }
+    if (end_byte < self->start_byte || (end_byte == self->start_byte && tree->size.bytes > 0)) continue;
+
+    if (tree->children.size == 0) {
+      if (tree->size.bytes == 0 && !tree->is_missing) continue;
+      token->symbol = entry.alias_symbol ? entry.alias_symbol : tree->symbol;
+      token->start_byte = start_byte;
+      token->end_byte = end_byte;
+      token->is_extra = tree->extra;
+      return true;
+    }
+
+    uint32_t structural_child_index = 0;
+    for (uint32_t i = 0; i < tree->children.size; i++) {
+      if (!tree->children.contents[i]->extra) structural_child_index++;
+    }
+
+    uint32_t position = entry.position + ts_tree_total_bytes(tree);
+    for (uint32_t i = tree->children.size; i > 0; i--) {
+      const Tree *child = tree->children.contents[i - 1];
+      position -= ts_tree_total_bytes(child);
+      TSSymbol alias_symbol = 0;
+      if (!child->extra) {
+        structural_child_index--;
+        alias_symbol = ts_language_alias_at(self->language, tree->alias_sequence_id, structural_child_index);
+      }
+      array_push(&self->stack, ((TokenIteratorEntry){child, position, alias_symbol}));
+    }
+  }
+  return false;
+}
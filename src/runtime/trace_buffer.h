@@ -0,0 +1,74 @@
+#ifndef RUNTIME_TRACE_BUFFER_H_
+#define RUNTIME_TRACE_BUFFER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <string.h>
+#include "runtime/alloc.h"
+#include "tree_sitter/runtime.h"
+
+// A fixed-size ring of trace events. When it is full, each new event replaces
+// the oldest one, and the replaced events are counted so that the host can
+// tell that it didn't drain the buffer often enough.
+typedef struct {
+  TSTraceEvent *contents;
+  uint32_t capacity;
+  uint32_t start;
+  uint32_t size;
+  uint32_t dropped_count;
+} TraceBuffer;
+
+static inline void trace_buffer_init(TraceBuffer *self) {
+  self->contents = NULL;
+  self->capacity = 0;
+  self->start = 0;
+  self->size = 0;
+  self->dropped_count = 0;
+}
+
+static inline void trace_buffer_delete(TraceBuffer *self) {
+  if (self->contents) ts_free(self->contents);
+  trace_buffer_init(self);
+}
+
+static inline void trace_buffer_set_capacity(TraceBuffer *self, uint32_t capacity) {
+  trace_buffer_delete(self);
+  if (capacity > 0) {
+    self->contents = (TSTraceEvent *)ts_calloc(capacity, sizeof(TSTraceEvent));
+    self->capacity = capacity;
+  }
+}
+
+static inline void trace_buffer_push(TraceBuffer *self, TSTraceEvent event) {
+  uint32_t index = self->start + self->size;
+  if (index >= self->capacity) index -= self->capacity;
+  self->contents[index] = event;
+  if (self->size < self->capacity) {
+    self->size++;
+  } else {
+    self->start = self->start + 1 == self->capacity ? 0 : self->start + 1;
+    self->dropped_count++;
+  }
+}
+
+// Copy out up to `count` of the oldest events, removing them from the buffer.
+static inline uint32_t trace_buffer_drain(TraceBuffer *self, TSTraceEvent *events, uint32_t count) {
+  if (count > self->size) count = self->size;
+  if (count == 0) return 0;
+  uint32_t first_count = self->capacity - self->start;
+  if (first_count > count) first_count = count;
+  memcpy(events, self->contents + self->start, first_count * sizeof(TSTraceEvent));
+  memcpy(events + first_count, self->contents, (count - first_count) * sizeof(TSTraceEvent));
+  self->start += count;
+  if (self->start >= self->capacity) self->start -= self->capacity;
+  self->size -= count;
+  return count;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // RUNTIME_TRACE_BUFFER_H_
@@ -1,32 +1,87 @@
 #include <assert.h>
 #include <ctype.h>
 #include <limits.h>
+#include <stddef.h>
 #include <stdbool.h>
 #include <string.h>
 #include <stdio.h>
 #include "runtime/alloc.h"
+#include "runtime/atomic.h"
 #include "runtime/tree.h"
 #include "runtime/length.h"
+#include "runtime/point.h"
 #include "runtime/language.h"
 #include "runtime/error_costs.h"
 
 TSStateId TS_TREE_STATE_NONE = USHRT_MAX;
 
+// When the library is built with `TREE_SITTER_ATOMIC_REF_COUNTS`, the reference
+// counts of trees and of shared external scanner states are updated atomically,
+// so that threads other than the one that owns a tree's pool can retain the
+// tree and release it. The last reference to a tree must still be dropped by
+// the pool's owner, or handed back with `ts_tree_pool_release_remotely`.
+#ifdef TREE_SITTER_ATOMIC_REF_COUNTS
+#define ts_tree__increment_ref_count(count) atomic_inc(count)
+#define ts_tree__decrement_ref_count(count) atomic_dec(count)
+#else
+static inline uint32_t ts_tree__increment_ref_count(uint32_t *count) { return ++*count; }
+static inline uint32_t ts_tree__decrement_ref_count(uint32_t *count) { return --*count; }
+#endif
+
 // ExternalTokenState
 
+// States that don't fit inline are stored after a reference count, so that
+// tokens whose scanner states are identical can share a single buffer.
+typedef struct {
+  uint32_t ref_count;
+  char data[];
+} ExternalTokenStateBuffer;
+
+static inline ExternalTokenStateBuffer *ts_external_token_state__buffer(const TSExternalTokenState *self) {
+  return (ExternalTokenStateBuffer *)(self->long_data - offsetof(ExternalTokenStateBuffer, data));
+}
+
 void ts_external_token_state_init(TSExternalTokenState *self, const char *content, unsigned length) {
   self->length = length;
   if (length > sizeof(self->short_data)) {
-    self->long_data = ts_malloc(length);
-    memcpy(self->long_data, content, length);
+    ExternalTokenStateBuffer *buffer = ts_malloc(sizeof(ExternalTokenStateBuffer) + length);
+    buffer->ref_count = 1;
+    memcpy(buffer->data, content, length);
+    self->long_data = buffer->data;
   } else {
     memcpy(self->short_data, content, length);
   }
 }
 
+void ts_external_token_state_copy(TSExternalTokenState *self, const TSExternalTokenState *other) {
+  *self = *other;
+  if (self->length > sizeof(self->short_data)) {
+    ts_tree__increment_ref_count(&ts_external_token_state__buffer(self)->ref_count);
+  }
+}
+
+// Like `ts_external_token_state_init`, but if the content is the same as that
+// of the given existing state, share that state's buffer instead of copying it.
+void ts_external_token_state_intern(TSExternalTokenState *self, const char *content, unsigned length,
+                                    const TSExternalTokenState *existing) {
+  if (
+    existing &&
+    existing->length == length &&
+    length > sizeof(self->short_data) &&
+    memcmp(existing->long_data, content, length) == 0
+  ) {
+    ts_external_token_state_copy(self, existing);
+  } else {
+    ts_external_token_state_init(self, content, length);
+  }
+}
+
 void ts_external_token_state_delete(TSExternalTokenState *self) {
   if (self->length > sizeof(self->short_data)) {
-    ts_free(self->long_data);
+    ExternalTokenStateBuffer *buffer = ts_external_token_state__buffer(self);
+    uint32_t ref_count = ts_tree__decrement_ref_count(&buffer->ref_count);
+    assert(ref_count != UINT32_MAX);
+    if (ref_count == 0) ts_free(buffer);
   }
 }
 
@@ -94,45 +149,551 @@ void ts_tree_array_reverse(TreeArray *self) {
 
 // TreePool
 
-static const uint32_t MAX_TREE_POOL_SIZE = 1024;
+// Trees are carved out of slabs of TREE_SLAB_SIZE, and released trees are
+// kept on a free list. Once the free list has grown enough, it is swept, and
+// any slab whose trees are all free is returned to the allocator. Internal
+// nodes come from separate slabs, whose slots have room for a few children.
+static const uint32_t TREE_SLAB_SIZE = 256;
+static const uint32_t TREE_INLINE_CHILD_CAPACITY = 4;
 
-void ts_tree_pool_init(TreePool *self) {
+static void ts_tree_slabs__init(TreeSlabs *self, uint32_t tree_size) {
   array_init(&self->free_trees);
-  array_init(&self->tree_stack);
+  array_init(&self->slabs);
+  self->slab_cursor = NULL;
+  self->slab_end = NULL;
+  self->sweep_threshold = TREE_SLAB_SIZE;
+  self->tree_size = tree_size;
 }
 
-void ts_tree_pool_delete(TreePool *self) {
-  if (self->free_trees.contents) {
-    for (unsigned i = 0; i < self->free_trees.size; i++) {
-      ts_free(self->free_trees.contents[i]);
+static int ts_tree_slabs__find(const TreeSlabs *self, const void *tree) {
+  uint32_t low = 0, high = self->slabs.size;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    const char *slab = self->slabs.contents[middle];
+    if ((const char *)tree < slab) {
+      high = middle;
+    } else if ((const char *)tree >= slab + TREE_SLAB_SIZE * self->tree_size) {
+      low = middle + 1;
+    } else {
+      return middle;
     }
-    array_delete(&self->free_trees);
   }
-  if (self->tree_stack.contents) array_delete(&self->tree_stack);
+  return -1;
 }
 
-Tree *ts_tree_pool_allocate(TreePool *self) {
+static inline bool ts_tree_slabs__contains(const TreeSlabs *self, int index, const void *tree) {
+  const char *slab = self->slabs.contents[index];
+  return (const char *)tree >= slab && (const char *)tree < slab + TREE_SLAB_SIZE * self->tree_size;
+}
+
+// Trees that were freed together usually come from the same slab, so the slab
+// of the previous tree is checked before searching.
+static inline int ts_tree_slabs__find_near(const TreeSlabs *self, const void *tree, int previous_index) {
+  if (previous_index >= 0 && ts_tree_slabs__contains(self, previous_index, tree)) return previous_index;
+  return ts_tree_slabs__find(self, tree);
+}
+
+static void ts_tree_slabs__sweep(TreeSlabs *self) {
+  if (self->slabs.size == 0) return;
+
+  uint32_t *free_counts = ts_calloc(self->slabs.size, sizeof(uint32_t));
+  int index = -1;
+  for (uint32_t i = 0; i < self->free_trees.size; i++) {
+    index = ts_tree_slabs__find_near(self, self->free_trees.contents[i], index);
+    if (index >= 0) free_counts[index]++;
+  }
+
+  // The part of the current slab that hasn't been handed out yet is free.
+  int current_index = -1;
+  if (self->slab_cursor) {
+    current_index = ts_tree_slabs__find(self, self->slab_end - 1);
+    free_counts[current_index] += (self->slab_end - self->slab_cursor) / self->tree_size;
+  }
+
+  bool found_empty_slab = false;
+  for (uint32_t i = 0; i < self->slabs.size; i++) {
+    if (free_counts[i] == TREE_SLAB_SIZE) {
+      found_empty_slab = true;
+      if ((int)i == current_index) {
+        self->slab_cursor = NULL;
+        self->slab_end = NULL;
+      }
+    } else {
+      free_counts[i] = 0;
+    }
+  }
+
+  if (found_empty_slab) {
+    uint32_t kept_tree_count = 0;
+    index = -1;
+    for (uint32_t i = 0; i < self->free_trees.size; i++) {
+      Tree *tree = self->free_trees.contents[i];
+      index = ts_tree_slabs__find_near(self, tree, index);
+      if (index < 0 || free_counts[index] == 0) {
+        self->free_trees.contents[kept_tree_count++] = tree;
+      }
+    }
+    self->free_trees.size = kept_tree_count;
+
+    uint32_t kept_slab_count = 0;
+    for (uint32_t i = 0; i < self->slabs.size; i++) {
+      if (free_counts[i] == 0) {
+        self->slabs.contents[kept_slab_count++] = self->slabs.contents[i];
+      } else {
+        ts_free(self->slabs.contents[i]);
+      }
+    }
+    self->slabs.size = kept_slab_count;
+  }
+
+  ts_free(free_counts);
+  self->sweep_threshold = 2 * self->free_trees.size;
+  if (self->sweep_threshold < TREE_SLAB_SIZE) self->sweep_threshold = TREE_SLAB_SIZE;
+}
+
+static void ts_tree_slabs__delete(TreeSlabs *self) {
+  // Slabs that still contain live trees are left allocated, so that trees
+  // which were never released show up as leaks.
+  ts_tree_slabs__sweep(self);
+  if (self->free_trees.contents) array_delete(&self->free_trees);
+  if (self->slabs.contents) array_delete(&self->slabs);
+}
+
+// Carve a tree out of the current slab, without consulting the free list, so
+// that consecutive allocations are adjacent in memory.
+static Tree *ts_tree_slabs__allocate_sequentially(TreeSlabs *self) {
+  if (self->slab_cursor == self->slab_end) {
+    char *slab = ts_malloc(TREE_SLAB_SIZE * self->tree_size);
+    uint32_t index = 0;
+    while (index < self->slabs.size && self->slabs.contents[index] < slab) index++;
+    array_insert(&self->slabs, index, slab);
+    self->slab_cursor = slab;
+    self->slab_end = slab + TREE_SLAB_SIZE * self->tree_size;
+  }
+
+  Tree *result = (Tree *)self->slab_cursor;
+  self->slab_cursor += self->tree_size;
+  return result;
+}
+
+static Tree *ts_tree_slabs__allocate(TreeSlabs *self) {
   if (self->free_trees.size > 0) {
     return array_pop(&self->free_trees);
-  } else {
-    return ts_malloc(sizeof(Tree));
   }
+  return ts_tree_slabs__allocate_sequentially(self);
+}
+
+static inline void ts_tree_slabs__sweep_if_needed(TreeSlabs *self) {
+  if (self->free_trees.size >= self->sweep_threshold) {
+    ts_tree_slabs__sweep(self);
+  }
+}
+
+static void ts_tree_slabs__free(TreeSlabs *self, Tree *tree) {
+  array_push(&self->free_trees, tree);
+  ts_tree_slabs__sweep_if_needed(self);
+}
+
+// Take over all of another pool's slabs, so that trees allocated from it can
+// outlive it. The part of its current slab that hasn't been handed out yet is
+// added to the free list.
+static void ts_tree_slabs__adopt(TreeSlabs *self, TreeSlabs *other) {
+  for (char *cursor = other->slab_cursor; cursor && cursor < other->slab_end; cursor += other->tree_size) {
+    array_push(&self->free_trees, (Tree *)cursor);
+  }
+  array_push_all(&self->free_trees, &other->free_trees);
+
+  // Both lists of slabs are sorted by address, so they can be merged.
+  Array(char *) slabs = array_new();
+  array_reserve(&slabs, self->slabs.size + other->slabs.size);
+  uint32_t i = 0, j = 0;
+  while (i < self->slabs.size || j < other->slabs.size) {
+    if (j == other->slabs.size || (i < self->slabs.size && self->slabs.contents[i] < other->slabs.contents[j])) {
+      array_push(&slabs, self->slabs.contents[i++]);
+    } else {
+      array_push(&slabs, other->slabs.contents[j++]);
+    }
+  }
+  if (self->slabs.contents) array_delete(&self->slabs);
+  self->slabs.size = slabs.size;
+  self->slabs.capacity = slabs.capacity;
+  self->slabs.contents = slabs.contents;
+
+  if (other->free_trees.contents) array_delete(&other->free_trees);
+  if (other->slabs.contents) array_delete(&other->slabs);
+  ts_tree_slabs__init(other, other->tree_size);
+}
+
+void ts_tree_pool_init(TreePool *self) {
+  ts_tree_slabs__init(&self->leaves, sizeof(Tree));
+  ts_tree_slabs__init(&self->nodes, sizeof(Tree) + TREE_INLINE_CHILD_CAPACITY * sizeof(Tree *));
+  array_init(&self->tree_stack);
+  array_init(&self->edits);
+  self->interned_leaves = (LeafTable){NULL, 0, 0};
+  self->remote_releases = NULL;
+  self->generation = 0;
+}
+
+void ts_tree_pool_delete(TreePool *self) {
+  ts_tree_pool_drain_remote_releases(self);
+  LeafTable *table = &self->interned_leaves;
+  for (uint32_t i = 0; i < table->capacity; i++) {
+    if (table->entries[i]) ts_tree_release(self, table->entries[i]);
+  }
+  if (table->entries) ts_free(table->entries);
+  ts_tree_slabs__delete(&self->leaves);
+  ts_tree_slabs__delete(&self->nodes);
+  if (self->tree_stack.contents) array_delete(&self->tree_stack);
+  if (self->edits.contents) array_delete(&self->edits);
+}
+
+void ts_tree_pool_adopt(TreePool *self, TreePool *other) {
+  ts_tree_slabs__adopt(&self->leaves, &other->leaves);
+  ts_tree_slabs__adopt(&self->nodes, &other->nodes);
+}
+
+// Any thread can hand a reference back to a pool, without waiting for the
+// thread that owns it. Releasing a tree changes the reference counts of its
+// descendants and the pool's free lists, which only the owner may touch, so
+// the released trees are pushed onto a lock-free list, and their references
+// are dropped the next time that the owner drains it.
+void ts_tree_pool_release_remotely(TreePool *self, Tree *tree) {
+#ifdef TREE_SITTER_ATOMIC_REF_COUNTS
+  // Only the last reference needs to be handed back to the owner.
+  for (;;) {
+    uint32_t ref_count = atomic_load(&tree->ref_count);
+    if (ref_count <= 1) break;
+    if (atomic_compare_and_swap(&tree->ref_count, ref_count, ref_count - 1)) return;
+  }
+#endif
+
+  TreeRelease *release = ts_malloc(sizeof(TreeRelease));
+  release->tree = tree;
+  void *volatile *head_pointer = (void *volatile *)&self->remote_releases;
+  do {
+    release->next = atomic_load_pointer(head_pointer);
+  } while (!atomic_compare_and_swap_pointer(head_pointer, release->next, release));
+}
+
+void ts_tree_pool_drain_remote_releases(TreePool *self) {
+  void *volatile *head_pointer = (void *volatile *)&self->remote_releases;
+  if (!atomic_load_pointer(head_pointer)) return;
+  TreeRelease *release = atomic_exchange_pointer(head_pointer, NULL);
+  while (release) {
+    TreeRelease *next = release->next;
+    ts_tree_release(self, release->tree);
+    ts_free(release);
+    release = next;
+  }
+}
+
+Tree *ts_tree_pool_allocate(TreePool *self) {
+  return ts_tree_slabs__allocate(&self->leaves);
+}
+
+Tree *ts_tree_pool_allocate_node(TreePool *self) {
+  Tree *result = ts_tree_slabs__allocate(&self->nodes);
+  result->has_child_slots = true;
+  return result;
 }
 
 void ts_tree_pool_free(TreePool *self, Tree *tree) {
-  if (self->free_trees.size < MAX_TREE_POOL_SIZE) {
-    array_push(&self->free_trees, tree);
+  if (tree->has_child_slots) {
+    ts_tree_slabs__free(&self->nodes, tree);
   } else {
-    ts_free(tree);
+    ts_tree_slabs__free(&self->leaves, tree);
+  }
+}
+
+// Put a tree on its free list without sweeping the slabs, for releasing many
+// trees at once.
+static inline void ts_tree_pool__free_without_sweep(TreePool *self, Tree *tree) {
+  array_push(tree->has_child_slots ? &self->nodes.free_trees : &self->leaves.free_trees, tree);
+}
+
+static size_t ts_tree_slabs__allocated_bytes(const TreeSlabs *self) {
+  return (size_t)self->slabs.size * TREE_SLAB_SIZE * self->tree_size;
+}
+
+static size_t ts_tree_slabs__free_bytes(const TreeSlabs *self) {
+  return (size_t)self->free_trees.size * self->tree_size + (size_t)(self->slab_end - self->slab_cursor);
+}
+
+size_t ts_tree_pool_allocated_bytes(const TreePool *self) {
+  return ts_tree_slabs__allocated_bytes(&self->leaves) + ts_tree_slabs__allocated_bytes(&self->nodes);
+}
+
+size_t ts_tree_pool_free_bytes(const TreePool *self) {
+  return ts_tree_slabs__free_bytes(&self->leaves) + ts_tree_slabs__free_bytes(&self->nodes);
+}
+
+TreePoolCapacity ts_tree_pool_capacity(const TreePool *self) {
+  return (TreePoolCapacity){
+    .free_leaf_count = self->leaves.free_trees.capacity,
+    .free_node_count = self->nodes.free_trees.capacity,
+    .tree_stack_size = self->tree_stack.capacity,
+  };
+}
+
+// Reserving the arrays at the sizes that they reached in a similar pool
+// spares them from being regrown from a few elements, one doubling at a time.
+void ts_tree_pool_reserve(TreePool *self, TreePoolCapacity capacity) {
+  array_reserve(&self->leaves.free_trees, capacity.free_leaf_count);
+  array_reserve(&self->nodes.free_trees, capacity.free_node_count);
+  array_reserve(&self->tree_stack, capacity.tree_stack_size);
+}
+
+// Interned leaves
+
+// Leaves are interchangeable if everything that the parser and the incremental
+// reparse look at is the same, and if their fingerprints match, so that only
+// leaves with the same text are shared. Leaves with errors, external scanner
+// states, or no size are never interned.
+static inline bool ts_tree__leaf_eq(const Tree *self, const Tree *other) {
+  return
+    self->symbol == other->symbol &&
+    self->fingerprint == other->fingerprint &&
+    self->parse_state == other->parse_state &&
+    self->extra == other->extra &&
+    self->bytes_scanned == other->bytes_scanned &&
+    self->first_leaf.lex_mode.lex_state == other->first_leaf.lex_mode.lex_state &&
+    self->first_leaf.lex_mode.external_lex_state == other->first_leaf.lex_mode.external_lex_state &&
+    self->padding.bytes == other->padding.bytes &&
+    point_eq(self->padding.extent, other->padding.extent) &&
+    self->size.bytes == other->size.bytes &&
+    point_eq(self->size.extent, other->size.extent);
+}
+
+static inline uint32_t ts_tree__leaf_hash(const Tree *self) {
+  uint32_t values[] = {
+    self->symbol, self->parse_state, self->extra, self->bytes_scanned,
+    self->first_leaf.lex_mode.lex_state, self->first_leaf.lex_mode.external_lex_state,
+    self->padding.bytes, self->padding.extent.row, self->padding.extent.column,
+    self->size.bytes, self->size.extent.row, self->size.extent.column,
+    (uint32_t)self->fingerprint,
+  };
+  uint32_t hash = 2166136261u;
+  for (unsigned i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+    hash = (hash ^ values[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static Tree **ts_tree__leaf_table_slot(LeafTable *self, const Tree *leaf) {
+  uint32_t mask = self->capacity - 1;
+  uint32_t index = ts_tree__leaf_hash(leaf) & mask;
+  while (self->entries[index] && !ts_tree__leaf_eq(self->entries[index], leaf)) {
+    index = (index + 1) & mask;
+  }
+  return &self->entries[index];
+}
+
+// Rebuild the table with the given capacity, keeping only the leaves that are
+// still used outside of it if `should_prune` is set.
+static void ts_tree__leaf_table_rebuild(TreePool *pool, uint32_t capacity, bool should_prune) {
+  LeafTable *self = &pool->interned_leaves;
+  Tree **entries = self->entries;
+  uint32_t old_capacity = self->capacity;
+  self->entries = ts_calloc(capacity, sizeof(Tree *));
+  self->capacity = capacity;
+  self->size = 0;
+  for (uint32_t i = 0; i < old_capacity; i++) {
+    Tree *leaf = entries[i];
+    if (!leaf) continue;
+    if (should_prune && leaf->ref_count == 1) {
+      ts_tree_release(pool, leaf);
+    } else {
+      *ts_tree__leaf_table_slot(self, leaf) = leaf;
+      self->size++;
+    }
+  }
+  if (entries) ts_free(entries);
+}
+
+// Return the interned leaf that is identical to the given one, taking over the
+// caller's reference to the given leaf. The table is kept at most half full.
+Tree *ts_tree_pool_intern_leaf(TreePool *self, Tree *leaf) {
+  if (leaf->children.size > 0 || leaf->has_external_tokens || leaf->is_missing ||
+      leaf->symbol == ts_builtin_sym_error || leaf->size.bytes == 0) return leaf;
+
+  LeafTable *table = &self->interned_leaves;
+  if (2 * (table->size + 1) > table->capacity) {
+    ts_tree__leaf_table_rebuild(self, table->capacity ? 2 * table->capacity : 64, false);
   }
+
+  Tree **slot = ts_tree__leaf_table_slot(table, leaf);
+  if (*slot) {
+    ts_tree_retain(*slot);
+    ts_tree_release(self, leaf);
+    return *slot;
+  }
+
+  leaf->is_interned = true;
+  ts_tree_retain(leaf);
+  *slot = leaf;
+  table->size++;
+  return leaf;
+}
+
+// Drop the leaves that are no longer used by any tree.
+void ts_tree_pool_prune_interned_leaves(TreePool *self) {
+  LeafTable *table = &self->interned_leaves;
+  if (table->size == 0) return;
+  uint32_t capacity = table->capacity;
+  while (capacity > 64 && table->size < capacity / 8) capacity /= 2;
+  ts_tree__leaf_table_rebuild(self, capacity, true);
+}
+
+// The interned leaves that nothing else refers to are dropped first, so that
+// their slots are free when the slabs are swept. Slabs that still hold a live
+// tree can't be freed, so compacting the tree beforehand frees more of them.
+void ts_tree_pool_trim(TreePool *self) {
+  ts_tree_pool_prune_interned_leaves(self);
+  ts_tree_slabs__sweep(&self->leaves);
+  ts_tree_slabs__sweep(&self->nodes);
+  array_shrink(&self->leaves.free_trees);
+  array_shrink(&self->nodes.free_trees);
+  array_shrink(&self->leaves.slabs);
+  array_shrink(&self->nodes.slabs);
+  array_shrink(&self->tree_stack);
+  array_shrink(&self->edits);
+}
+
+size_t ts_tree_pool_interned_bytes(const TreePool *self) {
+  return
+    self->interned_leaves.size * sizeof(Tree) +
+    self->interned_leaves.capacity * sizeof(Tree *);
 }
 
 // Tree
 
-Tree *ts_tree_make_leaf(TreePool *pool, TSSymbol symbol, Length padding, Length size, const TSLanguage *language) {
+static inline Tree **ts_tree__child_slots(Tree *self) {
+  return (Tree **)(self + 1);
+}
+
+static inline bool ts_tree__has_inline_children(Tree *self) {
+  return self->has_child_slots && self->children.contents == ts_tree__child_slots(self);
+}
+
+// Nodes with many children use the child slots that they don't need for
+// storing their children to point to a table of the children's cumulative
+// sizes, so that edits and position queries can find the children they affect
+// by binary search. The table is filled in when the node's children are set.
+// Only its first `valid_count` entries are correct, since an edit changes the
+// positions of the children after the first one that it touches.
+static const uint32_t TREE_CHILD_OFFSET_THRESHOLD = 32;
+
+typedef struct {
+  Length end;
+  uint32_t max_scanned_byte;
+  uint32_t structural_child_count;
+} TreeChildOffset;
+
+typedef struct {
+  TreeChildOffset *contents;
+  uint32_t valid_count;
+} TreeChildOffsetTable;
+
+static TreeChildOffsetTable *ts_tree__child_offset_table(Tree *self) {
+  TreeChildOffsetTable *table = (TreeChildOffsetTable *)ts_tree__child_slots(self);
+  if (!self->has_child_offsets) {
+    table->contents = ts_malloc(self->children.size * sizeof(TreeChildOffset));
+    table->valid_count = 0;
+    self->has_child_offsets = true;
+  }
+  return table;
+}
+
+static void ts_tree__delete_child_offset_table(Tree *self) {
+  if (self->has_child_offsets && self->children.size > 0) {
+    ts_free(((TreeChildOffsetTable *)ts_tree__child_slots(self))->contents);
+  }
+  self->has_child_offsets = false;
+}
+
+static inline Length ts_tree__child_offset(const TreeChildOffsetTable *table, uint32_t index) {
+  return index > 0 ? table->contents[index - 1].end : length_zero();
+}
+
+// Fill in the table until it includes the child that contains the given byte.
+static void ts_tree__extend_child_offset_table(Tree *self, TreeChildOffsetTable *table, uint32_t byte) {
+  while (table->valid_count < self->children.size) {
+    TreeChildOffset previous = {length_zero(), 0, 0};
+    if (table->valid_count > 0) {
+      previous = table->contents[table->valid_count - 1];
+      if (previous.end.bytes >= byte) break;
+    }
+
+    Tree *child = self->children.contents[table->valid_count];
+    uint32_t scanned_byte = previous.end.bytes + child->bytes_scanned;
+    table->contents[table->valid_count++] = (TreeChildOffset){
+      .end = length_add(previous.end, ts_tree_total_size(child)),
+      .max_scanned_byte = scanned_byte > previous.max_scanned_byte ? scanned_byte : previous.max_scanned_byte,
+      .structural_child_count = previous.structural_child_count + !child->extra,
+    };
+  }
+}
+
+// Find the first child, starting at the given index, that ends at or after the
+// given byte.
+static uint32_t ts_tree__search_child_offset_table(const TreeChildOffsetTable *table,
+                                                   uint32_t start_index, uint32_t byte) {
+  uint32_t low = start_index, high = table->valid_count;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if (table->contents[mid].end.bytes < byte) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+// Find the first child that ends after the given byte or point, within the
+// part of the table that is valid. The children before it can be skipped when
+// searching for a child by position.
+static bool ts_tree__seek_child(const Tree *self, Length position, uint32_t byte, const TSPoint *point,
+                                TreeChildPosition *result) {
+  if (!self->has_child_offsets || self->children.size == 0) return false;
+  const TreeChildOffsetTable *table = (const TreeChildOffsetTable *)(self + 1);
+
+  uint32_t low = 0, high = table->valid_count;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    Length end = length_add(position, table->contents[mid].end);
+    if (point ? point_lte(end.extent, *point) : end.bytes <= byte) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  result->index = low;
+  if (low > 0) {
+    result->offset = table->contents[low - 1].end;
+    result->structural_index = table->contents[low - 1].structural_child_count;
+  } else {
+    result->offset = length_zero();
+    result->structural_index = 0;
+  }
+  return true;
+}
+
+bool ts_tree_seek_child_for_byte(const Tree *self, Length position, uint32_t byte,
+                                 TreeChildPosition *result) {
+  return ts_tree__seek_child(self, position, byte, NULL, result);
+}
+
+bool ts_tree_seek_child_for_point(const Tree *self, Length position, TSPoint point,
+                                  TreeChildPosition *result) {
+  return ts_tree__seek_child(self, position, 0, &point, result);
+}
+
+static void ts_tree__init(Tree *self, TSSymbol symbol, Length padding, Length size,
+                          const TSLanguage *language) {
   TSSymbolMetadata metadata = ts_language_symbol_metadata(language, symbol);
-  Tree *result = ts_tree_pool_allocate(pool);
-  *result = (Tree){
+  *self = (Tree){
     .ref_count = 1,
     .symbol = symbol,
     .size = size,
@@ -142,14 +703,36 @@ Tree *ts_tree_make_leaf(TreePool *pool, TSSymbol symbol, Length padding, Length
     .padding = padding,
     .visible = metadata.visible,
     .named = metadata.named,
-    .node_count = 1,
     .has_changes = false,
     .first_leaf = {
       .symbol = symbol,
       .lex_mode = {0, 0},
     },
+    .structure_hash = ts_tree_symbol_hash(symbol),
+    .fingerprint = ts_tree_leaf_fingerprint(symbol, size.bytes, 0),
     .has_external_tokens = false,
   };
+}
+
+// Move the tree's children into the slots allocated along with it, if they
+// fit, so that traversing the tree doesn't require a separate allocation.
+static void ts_tree__store_children_inline(Tree *self) {
+  if (!self->has_child_slots || ts_tree__has_inline_children(self)) return;
+  if (self->children.size == 0 || self->children.size > TREE_INLINE_CHILD_CAPACITY) return;
+
+  Tree **slots = ts_tree__child_slots(self);
+  memcpy(slots, self->children.contents, self->children.size * sizeof(Tree *));
+  uint32_t child_count = self->children.size;
+  array_delete(&self->children);
+  self->children.size = child_count;
+  self->children.capacity = TREE_INLINE_CHILD_CAPACITY;
+  self->children.contents = slots;
+}
+
+Tree *ts_tree_make_leaf(TreePool *pool, TSSymbol symbol, Length padding, Length size, const TSLanguage *language) {
+  Tree *result = ts_tree_pool_allocate(pool);
+  ts_tree__init(result, symbol, padding, size, language);
+  result->generation = pool->generation;
   return result;
 }
 
@@ -163,13 +746,27 @@ Tree *ts_tree_make_error(TreePool *pool, Length size, Length padding, int32_t lo
 }
 
 Tree *ts_tree_make_copy(TreePool *pool, Tree *self) {
-  Tree *result = ts_tree_pool_allocate(pool);
+  Tree *result = self->has_child_slots ?
+    ts_tree_slabs__allocate(&pool->nodes) :
+    ts_tree_pool_allocate(pool);
   *result = *self;
+  if (ts_tree__has_inline_children(self)) {
+    memcpy(ts_tree__child_slots(result), self->children.contents, self->children.size * sizeof(Tree *));
+    result->children.contents = ts_tree__child_slots(result);
+  }
+  result->has_child_offsets = false;
+  result->is_interned = false;
   result->ref_count = 1;
+  result->generation = pool->generation;
   return result;
 }
 
-static void ts_tree__compress(Tree *self, unsigned count, const TSLanguage *language) {
+// The trees along the left spine are pushed onto the given stack while they
+// are rotated, and their sizes are recomputed as they are popped back off.
+static void ts_tree__compress(Tree *self, unsigned count, const TSLanguage *language,
+                              TreeArray *stack) {
+  uint32_t initial_stack_size = stack->size;
+
   Tree *tree = self;
   for (unsigned i = 0; i < count; i++) {
     if (tree->ref_count > 1 || tree->children.size != 2) break;
@@ -188,85 +785,218 @@ static void ts_tree__compress(Tree *self, unsigned count, const TSLanguage *lang
       grandchild->symbol != tree->symbol
     ) break;
 
+    array_push(stack, tree);
     tree->children.contents[0] = grandchild;
-    grandchild->context.parent = tree;
-    grandchild->context.index = -1;
-
     child->children.contents[0] = grandchild->children.contents[1];
-    child->children.contents[0]->context.parent = child;
-    child->children.contents[0]->context.index = -1;
-
     grandchild->children.contents[1] = child;
-    grandchild->children.contents[1]->context.parent = grandchild;
-    grandchild->children.contents[1]->context.index = -1;
-
     tree = grandchild;
   }
 
-  while (tree != self) {
-    tree = tree->context.parent;
+  while (stack->size > initial_stack_size) {
+    tree = array_pop(stack);
     Tree *child = tree->children.contents[0];
     Tree *grandchild = child->children.contents[1];
+
+    // The bytes that a fragile tree depends on can extend past its children,
+    // so the trees that still start at the same position keep their range.
+    // The tree that moved no longer starts in the state in which it was parsed.
+    uint32_t tree_bytes_scanned = tree->bytes_scanned;
+    uint32_t child_bytes_scanned = child->bytes_scanned;
     ts_tree_set_children(grandchild, &grandchild->children, language);
     ts_tree_set_children(child, &child->children, language);
     ts_tree_set_children(tree, &tree->children, language);
+    ts_tree_resolve_child_counts(tree, stack, language);
+    if (child_bytes_scanned > child->bytes_scanned) child->bytes_scanned = child_bytes_scanned;
+    if (tree_bytes_scanned > tree->bytes_scanned) tree->bytes_scanned = tree_bytes_scanned;
+    if (grandchild->fragile_left || grandchild->fragile_right) {
+      grandchild->parse_state = TS_TREE_STATE_NONE;
+    }
   }
 }
 
-void ts_tree__balance(Tree *self, const TSLanguage *language) {
-  if (self->children.contents[0]->repeat_depth > self->children.contents[1]->repeat_depth) {
-    unsigned n = self->children.contents[0]->repeat_depth - self->children.contents[1]->repeat_depth;
+static void ts_tree__balance(Tree *self, const TSLanguage *language, TreeArray *stack) {
+  uint32_t first_repeat_depth = ts_tree_repeat_depth(self->children.contents[0]);
+  uint32_t second_repeat_depth = ts_tree_repeat_depth(self->children.contents[1]);
+  if (first_repeat_depth > second_repeat_depth) {
+    unsigned n = first_repeat_depth - second_repeat_depth;
     for (unsigned i = n / 2; i > 0; i /= 2) {
-      ts_tree__compress(self, i, language);
+      ts_tree__compress(self, i, language, stack);
       n -= i;
     }
   }
 }
 
-void ts_tree_assign_parents(Tree *self, TreePool *pool, const TSLanguage *language) {
-  self->context.parent = NULL;
+static void ts_tree__refresh_hashes(Tree *self) {
+  self->structure_hash = ts_tree_symbol_hash(self->symbol);
+  self->fingerprint = ts_tree_node_fingerprint(self->symbol, self->alias_sequence_id);
+  for (uint32_t i = 0; i < self->children.size; i++) {
+    Tree *child = self->children.contents[i];
+    if (self->symbol != ts_builtin_sym_error) {
+      self->structure_hash = ts_tree_structure_hash_add(self->structure_hash, child);
+    }
+    self->fingerprint = ts_tree_fingerprint_add(self->fingerprint, child, i == 0);
+  }
+}
+
+// Trees that are shared with another tree are never modified, and trees that
+// have already been balanced are skipped, so only the trees that were created
+// by parses since the last call are visited.
+//
+// The visited trees are kept on the stack, each after its parent, and the
+// rotations only use the stack above them. Rotating a repetition changes the
+// structure hash and the fingerprint of every tree above it, so once all of
+// the trees have been balanced, they are recomputed from the bottom up.
+void ts_tree_balance(Tree *self, TreePool *pool, const TSLanguage *language) {
+  if (self->ref_count > 1 || self->is_balanced) return;
   array_clear(&pool->tree_stack);
   array_push(&pool->tree_stack, self);
-  while (pool->tree_stack.size > 0) {
-    Tree *tree = array_pop(&pool->tree_stack);
+  for (uint32_t i = 0; i < pool->tree_stack.size; i++) {
+    Tree *tree = pool->tree_stack.contents[i];
+
+    if (ts_tree_repeat_depth(tree) > 0) {
+      ts_tree__balance(tree, language, &pool->tree_stack);
+    }
+    tree->is_balanced = true;
+
+    for (uint32_t j = 0; j < tree->children.size; j++) {
+      Tree *child = tree->children.contents[j];
+      if (child->ref_count == 1 && !child->is_balanced && child->children.size > 0) {
+        array_push(&pool->tree_stack, child);
+      }
+    }
+  }
+
+  for (uint32_t i = pool->tree_stack.size; i > 0; i--) {
+    ts_tree__refresh_hashes(pool->tree_stack.contents[i - 1]);
+  }
+  array_clear(&pool->tree_stack);
+}
+
+static Tree *ts_tree__relocate(TreePool *pool, Tree *self) {
+  TreeSlabs *slabs = self->has_child_slots ? &pool->nodes : &pool->leaves;
+  Tree *result = ts_tree_slabs__allocate_sequentially(slabs);
+  memcpy(result, self, slabs->tree_size);
+  if (ts_tree__has_inline_children(self)) result->children.contents = ts_tree__child_slots(result);
+  ts_tree_pool__free_without_sweep(pool, self);
+  return result;
+}
+
+// Move a tree into fresh slab memory in depth-first order, so that traversing
+// it reads memory sequentially. Nodes and leaves come from separate slabs, so
+// each kind is laid out in order. Trees that are shared are left in place along
+// with their descendants, since their other owners may be reading them. The
+// moved trees' previous slots are freed, so the slabs that held them can be
+// returned to the allocator. Returns the tree's new address.
+Tree *ts_tree_compact(TreePool *pool, Tree *self) {
+  if (self->ref_count > 1) return self;
+
+  Array(Tree **) stack = array_new();
+  array_push(&stack, &self);
+  while (stack.size > 0) {
+    Tree **slot = array_pop(&stack);
+    Tree *tree = ts_tree__relocate(pool, *slot);
+    *slot = tree;
+    for (uint32_t i = tree->children.size; i > 0; i--) {
+      Tree **child_slot = &tree->children.contents[i - 1];
+      if ((*child_slot)->ref_count == 1) array_push(&stack, child_slot);
+    }
+  }
+  array_delete(&stack);
+
+  ts_tree_slabs__sweep(&pool->leaves);
+  ts_tree_slabs__sweep(&pool->nodes);
+  return self;
+}
+
+// Extend a tree's size to include a child that follows its current content.
+static inline void ts_tree__add_child_size(Tree *self, const Tree *child) {
+  uint32_t bytes_scanned = ts_tree_total_bytes(self) + child->bytes_scanned;
+  if (bytes_scanned > self->bytes_scanned) self->bytes_scanned = bytes_scanned;
+  self->size = length_add(self->size, ts_tree_total_size(child));
+}
+
+static inline void ts_tree__add_child_counts(Tree *self, const Tree *child) {
+  if (child->symbol != ts_builtin_sym_error_repeat) {
+    self->error_cost += child->error_cost;
+  }
+  self->dynamic_precedence += child->dynamic_precedence;
+  self->node_count += ts_tree_node_count(child);
+  if (child->has_external_tokens) self->has_external_tokens = true;
+
+  if (child->symbol == ts_builtin_sym_error) {
+    self->fragile_left = self->fragile_right = true;
+    self->parse_state = TS_TREE_STATE_NONE;
+  }
+}
 
-    if (tree->repeat_depth > 0) {
-      ts_tree__balance(tree, language);
+static void ts_tree__compute_child_counts(Tree *self, const TSLanguage *language) {
+  self->visible_child_count = 0;
+  self->named_child_count = 0;
+  uint32_t non_extra_index = 0;
+  for (uint32_t i = 0; i < self->children.size; i++) {
+    const Tree *child = self->children.contents[i];
+    TSSymbol alias_symbol = 0;
+    if (!child->extra) {
+      alias_symbol = ts_language_alias_at(language, self->alias_sequence_id, non_extra_index++);
     }
 
-    Length offset = length_zero();
-    const TSSymbol *alias_sequence = ts_language_alias_sequence(language, tree->alias_sequence_id);
-    uint32_t non_extra_index = 0;
-    bool earlier_child_was_changed = false;
+    if (alias_symbol != 0) {
+      self->visible_child_count++;
+      if (ts_language_symbol_metadata(language, alias_symbol).named) {
+        self->named_child_count++;
+      }
+    } else if (child->visible) {
+      self->visible_child_count++;
+      if (child->named) self->named_child_count++;
+    } else if (child->children.size > 0) {
+      self->visible_child_count += child->visible_child_count;
+      self->named_child_count += child->named_child_count;
+    }
+  }
+  self->has_pending_child_counts = false;
+}
+
+// Compute the child counts of every tree whose counts are pending, which are
+// the trees that were built since the tree was last published. Their parents
+// are always pending as well, so the traversal stops at trees that aren't.
+// The given stack is left as it was found.
+void ts_tree_resolve_child_counts(Tree *self, TreeArray *stack, const TSLanguage *language) {
+  if (!self->has_pending_child_counts) return;
+  uint32_t initial_stack_size = stack->size;
+  array_push(stack, self);
+  while (stack->size > initial_stack_size) {
+    Tree *tree = *array_back(stack);
+    if (!tree->has_pending_child_counts) {
+      stack->size--;
+      continue;
+    }
+
+    bool has_pending_children = false;
     for (uint32_t i = 0; i < tree->children.size; i++) {
       Tree *child = tree->children.contents[i];
-      if (earlier_child_was_changed || child->context.parent != tree || child->context.index != i) {
-        earlier_child_was_changed = true;
-        child->context.parent = tree;
-        child->context.index = i;
-        child->context.offset = offset;
-        if (!child->extra && alias_sequence && alias_sequence[non_extra_index] != 0) {
-          TSSymbolMetadata metadata = ts_language_symbol_metadata(language, alias_sequence[non_extra_index]);
-          child->context.alias_symbol = alias_sequence[non_extra_index];
-          child->context.alias_is_named = metadata.named;
-        } else {
-          child->context.alias_symbol = 0;
-          child->context.alias_is_named = false;
-        }
-        array_push(&pool->tree_stack, child);
+      if (child->has_pending_child_counts) {
+        array_push(stack, child);
+        has_pending_children = true;
       }
-      offset = length_add(offset, ts_tree_total_size(child));
-      if (!child->extra) non_extra_index++;
+    }
+
+    if (!has_pending_children) {
+      stack->size--;
+      ts_tree__compute_child_counts(tree, language);
     }
   }
 }
 
 void ts_tree_set_children(Tree *self, TreeArray *children, const TSLanguage *language) {
-  if (self->children.size > 0 && children->contents != self->children.contents) {
+  ts_tree__delete_child_offset_table(self);
+  if (self->children.size > 0 && children->contents != self->children.contents &&
+      !ts_tree__has_inline_children(self)) {
     array_delete(&self->children);
   }
 
   self->children = *children;
+  self->is_balanced = false;
+  self->has_pending_child_counts = self->children.size > 0;
   self->named_child_count = 0;
   self->visible_child_count = 0;
   self->error_cost = 0;
@@ -274,9 +1004,8 @@ void ts_tree_set_children(Tree *self, TreeArray *children, const TSLanguage *lan
   self->node_count = 1;
   self->has_external_tokens = false;
   self->dynamic_precedence = 0;
-
-  uint32_t non_extra_index = 0;
-  const TSSymbol *alias_sequence = ts_language_alias_sequence(language, self->alias_sequence_id);
+  self->structure_hash = ts_tree_symbol_hash(self->symbol);
+  self->fingerprint = ts_tree_node_fingerprint(self->symbol, self->alias_sequence_id);
 
   for (uint32_t i = 0; i < self->children.size; i++) {
     Tree *child = self->children.contents[i];
@@ -286,54 +1015,41 @@ void ts_tree_set_children(Tree *self, TreeArray *children, const TSLanguage *lan
       self->size = child->size;
       self->bytes_scanned = child->bytes_scanned;
     } else {
-      uint32_t bytes_scanned = ts_tree_total_bytes(self) + child->bytes_scanned;
-      if (bytes_scanned > self->bytes_scanned) self->bytes_scanned = bytes_scanned;
-      self->size = length_add(self->size, ts_tree_total_size(child));
+      ts_tree__add_child_size(self, child);
     }
 
-    if (child->symbol != ts_builtin_sym_error_repeat) {
-      self->error_cost += child->error_cost;
-    }
-    self->dynamic_precedence += child->dynamic_precedence;
-    self->node_count += child->node_count;
-
-    if (alias_sequence && alias_sequence[non_extra_index] != 0 && !child->extra) {
-      self->visible_child_count++;
-      if (ts_language_symbol_metadata(language, alias_sequence[non_extra_index]).named) {
-        self->named_child_count++;
-      }
-    } else if (child->visible) {
-      self->visible_child_count++;
-      if (child->named) self->named_child_count++;
-    } else if (child->children.size > 0) {
-      self->visible_child_count += child->visible_child_count;
-      self->named_child_count += child->named_child_count;
-    }
-
-    if (child->has_external_tokens) self->has_external_tokens = true;
-
-    if (child->symbol == ts_builtin_sym_error) {
-      self->fragile_left = self->fragile_right = true;
-      self->parse_state = TS_TREE_STATE_NONE;
+    ts_tree__add_child_counts(self, child);
+    if (self->symbol != ts_builtin_sym_error) {
+      self->structure_hash = ts_tree_structure_hash_add(self->structure_hash, child);
     }
+    self->fingerprint = ts_tree_fingerprint_add(self->fingerprint, child, i == 0);
+  }
 
-    if (!child->extra) non_extra_index++;
+  if (self->has_child_slots && self->children.size >= TREE_CHILD_OFFSET_THRESHOLD) {
+    ts_tree__extend_child_offset_table(self, ts_tree__child_offset_table(self), UINT32_MAX);
   }
 
   if (self->symbol == ts_builtin_sym_error || self->symbol == ts_builtin_sym_error_repeat) {
     self->error_cost += ERROR_COST_PER_RECOVERY +
                         ERROR_COST_PER_SKIPPED_CHAR * self->size.bytes +
                         ERROR_COST_PER_SKIPPED_LINE * self->size.extent.row;
+    TreeArray stack = array_new();
     for (uint32_t i = 0; i < self->children.size; i++) {
       Tree *child = self->children.contents[i];
       if (child->extra) continue;
       if (child->symbol == ts_builtin_sym_error && child->children.size == 0) continue;
       if (child->visible) {
         self->error_cost += ERROR_COST_PER_SKIPPED_TREE;
+      } else if (child->children.size == 1 && child->children.contents[0]->is_compact_error) {
+        // A compact error leaf stands for all of the trees that it replaced,
+        // and its cost already includes the cost of skipping each of them.
+        self->error_cost += child->children.contents[0]->error_cost;
       } else {
+        ts_tree_resolve_child_counts(child, &stack, language);
         self->error_cost += ERROR_COST_PER_SKIPPED_TREE * child->visible_child_count;
       }
     }
+    array_delete(&stack);
   }
 
   if (self->children.size > 0) {
@@ -343,15 +1059,17 @@ void ts_tree_set_children(Tree *self, TreeArray *children, const TSLanguage *lan
     if (first_child->fragile_left) self->fragile_left = true;
     if (last_child->fragile_right) self->fragile_right = true;
     if (
-      self->children.size == 2 &&
+      self->children.size >= 2 &&
       !self->visible && !self->named &&
       first_child->symbol == self->symbol &&
       last_child->symbol == self->symbol
     ) {
-      if (first_child->repeat_depth > last_child->repeat_depth) {
-        self->repeat_depth = first_child->repeat_depth + 1;
+      uint32_t first_repeat_depth = ts_tree_repeat_depth(first_child);
+      uint32_t last_repeat_depth = ts_tree_repeat_depth(last_child);
+      if (first_repeat_depth > last_repeat_depth) {
+        self->repeat_depth = first_repeat_depth + 1;
       } else {
-        self->repeat_depth = last_child->repeat_depth + 1;
+        self->repeat_depth = last_repeat_depth + 1;
       }
     }
   }
@@ -359,16 +1077,139 @@ void ts_tree_set_children(Tree *self, TreeArray *children, const TSLanguage *lan
 
 Tree *ts_tree_make_node(TreePool *pool, TSSymbol symbol, TreeArray *children,
                         unsigned alias_sequence_id, const TSLanguage *language) {
-  Tree *result = ts_tree_make_leaf(pool, symbol, length_zero(), length_zero(), language);
+  return ts_tree_init_node(
+    pool, ts_tree_pool_allocate_node(pool), symbol, children, alias_sequence_id, language
+  );
+}
+
+TreeArray ts_tree_child_slots(Tree *self) {
+  return (TreeArray) {
+    .contents = ts_tree__child_slots(self),
+    .size = 0,
+    .capacity = TREE_INLINE_CHILD_CAPACITY,
+  };
+}
+
+Tree *ts_tree_init_node(TreePool *pool, Tree *result, TSSymbol symbol, TreeArray *children,
+                        unsigned alias_sequence_id, const TSLanguage *language) {
+  ts_tree__init(result, symbol, length_zero(), length_zero(), language);
+  result->generation = pool->generation;
+  result->has_child_slots = true;
   result->alias_sequence_id = alias_sequence_id;
   if (symbol == ts_builtin_sym_error || symbol == ts_builtin_sym_error_repeat) {
     result->fragile_left = true;
     result->fragile_right = true;
   }
   ts_tree_set_children(result, children, language);
+  ts_tree__store_children_inline(result);
   return result;
 }
 
+// Repetitions are built as wide nodes, rather than as chains of binary nodes.
+// Each new element is added to the rightmost node along the repetition's right
+// edge that has room for it, and full nodes are grouped under new ones, so the
+// depth of a repetition grows with the logarithm of its length.
+static const uint32_t TREE_REPETITION_CAPACITY = 32;
+
+static inline bool ts_tree__is_repetition(const Tree *self) {
+  return ts_tree_repeat_depth(self) > 0 && self->alias_sequence_id == 0 && !self->visible;
+}
+
+static void ts_tree__push_child(Tree *self, Tree *child) {
+  if (ts_tree__has_inline_children(self)) {
+    if (self->children.size < TREE_INLINE_CHILD_CAPACITY) {
+      self->children.contents[self->children.size++] = child;
+      return;
+    }
+    TreeArray children = array_new();
+    array_reserve(&children, 2 * TREE_INLINE_CHILD_CAPACITY);
+    memcpy(children.contents, self->children.contents, self->children.size * sizeof(Tree *));
+    children.size = self->children.size;
+    self->children = children;
+  }
+  array_push(&self->children, child);
+}
+
+// Returns the number of nodes that were added to the tree, which is zero if
+// the tree is full.
+static uint32_t ts_tree__push_repetition(TreePool *pool, Tree *self, Tree *element,
+                                         const TSLanguage *language) {
+  uint32_t node_count = 0;
+  Tree **last_child = &self->children.contents[self->children.size - 1];
+  uint32_t last_child_depth = ts_tree_repeat_depth(*last_child);
+  uint16_t last_child_hash = (*last_child)->structure_hash;
+  uint64_t last_child_fingerprint = (*last_child)->fingerprint;
+
+  if (self->repeat_depth > 1) {
+    if ((*last_child)->ref_count == 1 && ts_tree__is_repetition(*last_child)) {
+      node_count = ts_tree__push_repetition(pool, *last_child, element, language);
+    }
+
+    // A child that is shallower than its siblings is grouped with the new
+    // element, so that it can keep growing in place.
+    if (node_count == 0 && last_child_depth + 1 < self->repeat_depth) {
+      TSStateId parse_state = (*last_child)->parse_state;
+      TreeArray children = array_new();
+      array_reserve(&children, 2);
+      array_push(&children, *last_child);
+      array_push(&children, element);
+      *last_child = ts_tree_make_node(pool, self->symbol, &children, 0, language);
+      (*last_child)->parse_state = parse_state;
+      node_count = ts_tree_node_count(element) + 1;
+    }
+  }
+
+  if (node_count == 0) {
+    if (self->children.size >= TREE_REPETITION_CAPACITY) return 0;
+    ts_tree__push_child(self, element);
+    node_count = ts_tree_node_count(element);
+    self->structure_hash = ts_tree_structure_hash_add(self->structure_hash, element);
+    self->fingerprint = ts_tree_fingerprint_add(self->fingerprint, element, false);
+  } else {
+    self->structure_hash += (*last_child)->structure_hash - last_child_hash;
+    self->fingerprint += (*last_child)->fingerprint - last_child_fingerprint;
+  }
+
+  ts_tree__add_child_size(self, element);
+  ts_tree__add_child_counts(self, element);
+  self->has_pending_child_counts = true;
+  self->node_count += node_count - ts_tree_node_count(element);
+  if (element->fragile_right) self->fragile_right = true;
+  self->is_balanced = false;
+
+  // Once a node is full, its children's offsets are recorded in its unused child
+  // slots, as in any other node with that many children.
+  if (self->children.size == TREE_REPETITION_CAPACITY) {
+    ts_tree_set_children(self, &self->children, language);
+  }
+  return node_count;
+}
+
+// The repetition is modified in place, so the caller must ensure that nothing
+// else observes it. Returns false if the element can't be added.
+bool ts_tree_push_repetition(TreePool *pool, Tree *self, Tree *element, const TSLanguage *language) {
+  if (!ts_tree__is_repetition(self)) return false;
+  if (element->symbol != self->symbol || element->extra || ts_tree_repeat_depth(element) > 0) {
+    return false;
+  }
+  return ts_tree__push_repetition(pool, self, element, language) > 0;
+}
+
+// Give the tree the children of `replacement`, a modified copy of the tree,
+// and release the tree's previous children.
+void ts_tree_replace_children(TreePool *pool, Tree *self, const Tree *replacement) {
+  for (uint32_t i = 0; i < self->children.size; i++) {
+    ts_tree_release(pool, self->children.contents[i]);
+  }
+  ts_tree__delete_child_offset_table(self);
+  if (self->children.size > 0 && !ts_tree__has_inline_children(self)) {
+    array_delete(&self->children);
+  }
+
+  *self = *replacement;
+  ts_tree__store_children_inline(self);
+}
+
 Tree *ts_tree_make_error_node(TreePool *pool, TreeArray *children, const TSLanguage *language) {
   return ts_tree_make_node(pool, ts_builtin_sym_error, children, 0, language);
 }
@@ -381,49 +1222,104 @@ Tree *ts_tree_make_missing_leaf(TreePool *pool, TSSymbol symbol, const TSLanguag
 }
 
 void ts_tree_retain(Tree *self) {
-  assert(self->ref_count > 0);
-  self->ref_count++;
-  assert(self->ref_count != 0);
+  uint32_t ref_count = ts_tree__increment_ref_count(&self->ref_count);
+  assert(ref_count > 1);
+  (void)ref_count;
 }
 
+// Only the trees whose last reference is dropped are visited. Sweeping the
+// pool's slabs costs time in proportion to the number of free trees, so when a
+// whole tree is freed, the slabs are swept once at the end, rather than each
+// time the free lists grow past their thresholds along the way.
 void ts_tree_release(TreePool *pool, Tree *self) {
+  uint32_t ref_count = ts_tree__decrement_ref_count(&self->ref_count);
+  assert(ref_count != UINT32_MAX);
+  if (ref_count > 0) return;
+
   array_clear(&pool->tree_stack);
   array_push(&pool->tree_stack, self);
   while (pool->tree_stack.size > 0) {
     Tree *tree = array_pop(&pool->tree_stack);
-    assert(tree->ref_count > 0);
-    tree->ref_count--;
-    if (tree->ref_count == 0) {
-      if (tree->children.size > 0) {
-        for (uint32_t i = 0; i < tree->children.size; i++) {
-          array_push(&pool->tree_stack, tree->children.contents[i]);
-        }
-        array_delete(&tree->children);
-      } else if (tree->has_external_tokens) {
-        ts_external_token_state_delete(&tree->external_token_state);
+    if (tree->children.size > 0) {
+      for (uint32_t i = 0; i < tree->children.size; i++) {
+        Tree *child = tree->children.contents[i];
+        assert(child->ref_count > 0);
+        if (ts_tree__decrement_ref_count(&child->ref_count) == 0) array_push(&pool->tree_stack, child);
       }
-      ts_tree_pool_free(pool, tree);
+      ts_tree__delete_child_offset_table(tree);
+      if (!ts_tree__has_inline_children(tree)) array_delete(&tree->children);
+    } else if (tree->has_external_tokens) {
+      ts_external_token_state_delete(&tree->external_token_state);
     }
+    ts_tree_pool__free_without_sweep(pool, tree);
   }
+
+  ts_tree_slabs__sweep_if_needed(&pool->leaves);
+  ts_tree_slabs__sweep_if_needed(&pool->nodes);
 }
 
-uint32_t ts_tree_start_column(const Tree *self) {
-  uint32_t column = self->padding.extent.column;
-  if (self->padding.extent.row > 0)
-    return column;
-  for (const Tree *tree = self; tree != NULL; tree = tree->context.parent) {
-    column += tree->context.offset.extent.column;
-    if (tree->context.offset.extent.row > 0)
-      break;
+// The bytes taken up by the tree's nodes, along with their child arrays, child
+// offset tables and external scanner states. Subtrees and scanner states that
+// are shared with other trees are counted in full. Interned leaves are left
+// out, since they belong to the pool's table.
+size_t ts_tree_memory_usage(const Tree *self) {
+  size_t result = 0;
+  Array(const Tree *) stack = array_new();
+  array_push(&stack, self);
+  while (stack.size > 0) {
+    const Tree *tree = array_pop(&stack);
+    if (tree->is_interned) continue;
+    if (tree->has_child_slots) {
+      result += sizeof(Tree) + TREE_INLINE_CHILD_CAPACITY * sizeof(Tree *);
+    } else {
+      result += sizeof(Tree);
+    }
+
+    if (tree->children.size > 0) {
+      if (!ts_tree__has_inline_children((Tree *)tree)) result += tree->children.capacity * sizeof(Tree *);
+      if (tree->has_child_offsets) result += tree->children.size * sizeof(TreeChildOffset);
+      for (uint32_t i = 0; i < tree->children.size; i++) {
+        array_push(&stack, tree->children.contents[i]);
+      }
+    } else if (tree->has_external_tokens &&
+               tree->external_token_state.length > sizeof(tree->external_token_state.short_data)) {
+      result += sizeof(ExternalTokenStateBuffer) + tree->external_token_state.length;
+    }
   }
-  return column;
+  array_delete(&stack);
+  return result;
 }
 
-uint32_t ts_tree_end_column(const Tree *self) {
-  uint32_t result = self->size.extent.column;
-  if (self->size.extent.row == 0)
-    result += ts_tree_start_column(self);
-  return result;
+typedef struct {
+  const Tree *tree;
+  uint32_t depth;
+} TreeDepthEntry;
+
+// Fill in the fields of the stats that describe the tree's shape. Every tree
+// is counted, including hidden ones, and the root is at a depth of one. The
+// bytes of external scanner state are counted once per leaf that holds a state,
+// even where leaves share a state.
+void ts_tree_get_stats(const Tree *self, TSTreeStats *stats) {
+  Array(TreeDepthEntry) stack = array_new();
+  array_push(&stack, ((TreeDepthEntry){self, 1}));
+  stats->node_count = ts_tree_node_count(self);
+  stats->error_cost = self->error_cost;
+  while (stack.size > 0) {
+    TreeDepthEntry entry = array_pop(&stack);
+    const Tree *tree = entry.tree;
+    if (entry.depth > stats->max_depth) stats->max_depth = entry.depth;
+    if (tree->symbol == ts_builtin_sym_error) stats->error_count++;
+    if (tree->children.size > 0) {
+      for (uint32_t i = 0; i < tree->children.size; i++) {
+        array_push(&stack, ((TreeDepthEntry){tree->children.contents[i], entry.depth + 1}));
+      }
+    } else {
+      stats->leaf_count++;
+      if (tree->is_missing) stats->missing_count++;
+      if (tree->has_external_tokens) stats->external_token_state_bytes += tree->external_token_state.length;
+    }
+  }
+  array_delete(&stack);
 }
 
 bool ts_tree_eq(const Tree *self, const Tree *other) {
@@ -433,6 +1329,8 @@ bool ts_tree_eq(const Tree *self, const Tree *other) {
     return !other;
   }
 
+  if (self == other) return true;
+  if (self->structure_hash != other->structure_hash) return false;
   if (self->symbol != other->symbol) return false;
   if (self->visible != other->visible) return false;
   if (self->named != other->named) return false;
@@ -451,7 +1349,11 @@ bool ts_tree_eq(const Tree *self, const Tree *other) {
   return true;
 }
 
+// Ambiguous trees usually share most of their subtrees, which are skipped
+// without being descended into.
 int ts_tree_compare(const Tree *left, const Tree *right) {
+  if (left == right)
+    return 0;
   if (left->symbol < right->symbol)
     return -1;
   if (right->symbol < left->symbol)
@@ -463,6 +1365,7 @@ int ts_tree_compare(const Tree *left, const Tree *right) {
   for (uint32_t i = 0; i < left->children.size; i++) {
     Tree *left_child = left->children.contents[i];
     Tree *right_child = right->children.contents[i];
+    if (left_child == right_child) continue;
     switch (ts_tree_compare(left_child, right_child)) {
       case -1:
         return -1;
@@ -479,106 +1382,246 @@ static inline long min_byte(long a, long b) {
   return a <= b ? a : b;
 }
 
-bool ts_tree_invalidate_lookahead(Tree *self, uint32_t edit_byte_offset) {
-  if (edit_byte_offset >= self->bytes_scanned) return false;
+// Trees that are shared, for example with a snapshot of a document, can't be
+// edited in place. Instead, they are replaced with a copy that retains their
+// children, so that only the nodes along the edited paths are copied.
+Tree *ts_tree_make_mut(TreePool *pool, Tree *self) {
+  if (self->ref_count == 1) return self;
+
+  Tree *result = ts_tree_make_copy(pool, self);
+  if (self->children.size > 0) {
+    if (!ts_tree__has_inline_children(self)) {
+      ts_tree_array_copy(self->children, &result->children);
+    } else {
+      for (uint32_t i = 0; i < result->children.size; i++) {
+        ts_tree_retain(result->children.contents[i]);
+      }
+    }
+  } else if (self->has_external_tokens) {
+    ts_external_token_state_copy(&result->external_token_state, &self->external_token_state);
+  }
+  ts_tree_release(pool, self);
+  return result;
+}
+
+static Tree *ts_tree__invalidate_lookahead(TreePool *pool, Tree *self, uint32_t edit_byte_offset) {
+  if (edit_byte_offset >= self->bytes_scanned) return self;
+  self = ts_tree_make_mut(pool, self);
   self->has_changes = true;
   if (self->children.size > 0) {
     uint32_t child_start_byte = 0;
     for (uint32_t i = 0; i < self->children.size; i++) {
-      Tree *child = self->children.contents[i];
+      Tree **child = &self->children.contents[i];
       if (child_start_byte > edit_byte_offset) break;
-      ts_tree_invalidate_lookahead(child, edit_byte_offset - child_start_byte);
-      child_start_byte += ts_tree_total_bytes(child);
+      *child = ts_tree__invalidate_lookahead(pool, *child, edit_byte_offset - child_start_byte);
+      child_start_byte += ts_tree_total_bytes(*child);
     }
   }
-  return true;
+  return self;
 }
 
-static inline TSPoint ts_tree_total_extent(const Tree *self) {
-  return point_add(self->padding.extent, self->size.extent);
-}
-
-void ts_tree_edit(Tree *self, const TSInputEdit *edit) {
+// Adjust a tree's padding and size for an edit that starts within it. The
+// edit's position is relative to the start of the tree.
+static void ts_tree__edit_lengths(Length *padding, Length *size, const TSInputEdit *edit) {
   uint32_t old_end_byte = edit->start_byte + edit->bytes_removed;
   uint32_t new_end_byte = edit->start_byte + edit->bytes_added;
   TSPoint old_end_point = point_add(edit->start_point, edit->extent_removed);
   TSPoint new_end_point = point_add(edit->start_point, edit->extent_added);
 
-  assert(old_end_byte <= ts_tree_total_bytes(self));
+  if (edit->start_byte < padding->bytes) {
+    if (padding->bytes >= old_end_byte) {
+      uint32_t trailing_padding_bytes = padding->bytes - old_end_byte;
+      TSPoint trailing_padding_extent = point_sub(padding->extent, old_end_point);
+      padding->bytes = new_end_byte + trailing_padding_bytes;
+      padding->extent = point_add(new_end_point, trailing_padding_extent);
+    } else {
+      uint32_t removed_content_bytes = old_end_byte - padding->bytes;
+      TSPoint removed_content_extent = point_sub(old_end_point, padding->extent);
+      size->bytes = size->bytes - removed_content_bytes;
+      size->extent = point_sub(size->extent, removed_content_extent);
+      padding->bytes = new_end_byte;
+      padding->extent = new_end_point;
+    }
+  } else if (edit->start_byte == padding->bytes && edit->bytes_removed == 0) {
+    padding->bytes = padding->bytes + edit->bytes_added;
+    padding->extent = point_add(padding->extent, edit->extent_added);
+  } else {
+    uint32_t trailing_content_bytes = padding->bytes + size->bytes - old_end_byte;
+    TSPoint trailing_content_extent = point_sub(point_add(padding->extent, size->extent), old_end_point);
+    size->bytes = new_end_byte + trailing_content_bytes - padding->bytes;
+    size->extent = point_sub(point_add(new_end_point, trailing_content_extent), padding->extent);
+  }
+}
 
+// Apply the edits stored in the pool at the given range to a tree. The edits
+// are sorted by position and don't overlap, and each one is relative to the
+// start of the tree, in terms of the text after the preceding edits. The
+// children are visited in a single pass, during which each child is given the
+// parts of the edits that touch it, in the same form. A child is edited just as
+// it would be if the edits were applied one at a time, but the children before
+// and after each edit are only visited once for the whole batch. In nodes with
+// many children, the children between edits are skipped using the offset
+// table, which stores their positions from before this batch.
+static Tree *ts_tree__edit(TreePool *pool, Tree *self, uint32_t edit_index, uint32_t edit_count) {
+  self = ts_tree_make_mut(pool, self);
   self->has_changes = true;
+  int64_t bytes_delta = 0;
+  uint32_t last_old_end_byte = 0;
+  for (uint32_t i = 0; i < edit_count; i++) {
+    const TSInputEdit *edit = &pool->edits.contents[edit_index + i];
+    assert(edit->start_byte + edit->bytes_removed <= ts_tree_total_bytes(self));
+    ts_tree__edit_lengths(&self->padding, &self->size, edit);
+    last_old_end_byte = edit->start_byte + edit->bytes_removed - bytes_delta;
+    bytes_delta += (int64_t)edit->bytes_added - edit->bytes_removed;
+  }
 
-  if (edit->start_byte < self->padding.bytes) {
-    if (self->padding.bytes >= old_end_byte) {
-      uint32_t trailing_padding_bytes = self->padding.bytes - old_end_byte;
-      TSPoint trailing_padding_extent = point_sub(self->padding.extent, old_end_point);
-      self->padding.bytes = new_end_byte + trailing_padding_bytes;
-      self->padding.extent = point_add(new_end_point, trailing_padding_extent);
-    } else {
-      uint32_t removed_content_bytes = old_end_byte - self->padding.bytes;
-      TSPoint removed_content_extent = point_sub(old_end_point, self->padding.extent);
-      self->size.bytes = self->size.bytes - removed_content_bytes;
-      self->size.extent = point_sub(self->size.extent, removed_content_extent);
-      self->padding.bytes = new_end_byte;
-      self->padding.extent = new_end_point;
-    }
-  } else if (edit->start_byte == self->padding.bytes && edit->bytes_removed == 0) {
-    self->padding.bytes = self->padding.bytes + edit->bytes_added;
-    self->padding.extent = point_add(self->padding.extent, edit->extent_added);
-  } else {
-    uint32_t trailing_content_bytes = ts_tree_total_bytes(self) - old_end_byte;
-    TSPoint trailing_content_extent = point_sub(ts_tree_total_extent(self), old_end_point);
-    self->size.bytes = new_end_byte + trailing_content_bytes - self->padding.bytes;
-    self->size.extent = point_sub(point_add(new_end_point, trailing_content_extent), self->padding.extent);
+  TreeChildOffsetTable *table = NULL;
+  if (self->has_child_slots && self->children.size >= TREE_CHILD_OFFSET_THRESHOLD) {
+    table = ts_tree__child_offset_table(self);
+    ts_tree__extend_child_offset_table(self, table, last_old_end_byte);
   }
 
-  bool found_first_child = false;
-  long remaining_bytes_to_delete = 0;
+  uint32_t current_edit = 0;
+  uint32_t first_resized_child = self->children.size;
+  uint32_t remaining_bytes_to_delete = 0;
   TSPoint remaining_extent_to_delete = {0, 0};
-  Length child_left, child_right = length_zero();
-  for (uint32_t i = 0; i < self->children.size; i++) {
-    Tree *child = self->children.contents[i];
-    child_left = child_right;
-    child_right = length_add(child_left, ts_tree_total_size(child));
-
-    if (!found_first_child && child_right.bytes >= edit->start_byte) {
-      found_first_child = true;
-      TSInputEdit child_edit = {
-        .start_byte = edit->start_byte - child_left.bytes,
-        .bytes_added = edit->bytes_added,
-        .bytes_removed = edit->bytes_removed,
-        .start_point = point_sub(edit->start_point, child_left.extent),
-        .extent_added = edit->extent_added,
-        .extent_removed = edit->extent_removed,
-      };
-
-      if (old_end_byte > child_right.bytes) {
-        child_edit.bytes_removed = child_right.bytes - edit->start_byte;
-        child_edit.extent_removed = point_sub(child_right.extent, edit->start_point);
-        remaining_bytes_to_delete = old_end_byte - child_right.bytes;
-        remaining_extent_to_delete = point_sub(old_end_point, child_right.extent);
+  Length child_left = length_zero();
+  bytes_delta = 0;
+  for (uint32_t i = 0; i < self->children.size && current_edit < edit_count; i++) {
+    if (table && remaining_bytes_to_delete == 0) {
+      uint32_t old_start_byte = pool->edits.contents[edit_index + current_edit].start_byte - bytes_delta;
+      uint32_t next_child = ts_tree__search_child_offset_table(table, i, old_start_byte);
+      if (next_child > i) {
+        // The children that are skipped still need to be invalidated if they
+        // depended on the text that changed when they were lexed. The table's
+        // maximum scanned bytes show where to stop looking.
+        for (uint32_t j = next_child; j > i; j--) {
+          if (table->contents[j - 1].max_scanned_byte <= old_start_byte) break;
+          Tree **child = &self->children.contents[j - 1];
+          uint32_t old_child_left_byte = ts_tree__child_offset(table, j - 1).bytes;
+          *child = ts_tree__invalidate_lookahead(pool, *child, old_start_byte - old_child_left_byte);
+        }
+        child_left = length_add(child_left, length_sub(
+          ts_tree__child_offset(table, next_child),
+          ts_tree__child_offset(table, i)
+        ));
+        i = next_child;
       }
+    }
 
-      ts_tree_edit(child, &child_edit);
-    } else if (remaining_bytes_to_delete > 0) {
-      TSInputEdit child_edit = {
-        .start_byte = 0,
-        .bytes_added = 0,
-        .bytes_removed = min_byte(remaining_bytes_to_delete, ts_tree_total_bytes(child)),
-        .start_point = {0, 0},
-        .extent_added = {0, 0},
-        .extent_removed = point_min(remaining_extent_to_delete, ts_tree_total_size(child).extent),
-      };
-      remaining_bytes_to_delete -= child_edit.bytes_removed;
-      remaining_extent_to_delete = point_sub(remaining_extent_to_delete, child_edit.extent_removed);
-      ts_tree_edit(child, &child_edit);
-    } else {
-      ts_tree_invalidate_lookahead(child, edit->start_byte - child_left.bytes);
+    Tree **child = &self->children.contents[i];
+    Length child_padding = (*child)->padding;
+    Length child_size = (*child)->size;
+    uint32_t child_edit_index = pool->edits.size;
+
+    while (current_edit < edit_count) {
+      TSInputEdit edit = pool->edits.contents[edit_index + current_edit];
+      Length child_total_size = length_add(child_padding, child_size);
+      TSInputEdit child_edit;
+
+      if (remaining_bytes_to_delete > 0) {
+        child_edit = (TSInputEdit){
+          .start_byte = 0,
+          .bytes_added = 0,
+          .bytes_removed = min_byte(remaining_bytes_to_delete, child_total_size.bytes),
+          .start_point = {0, 0},
+          .extent_added = {0, 0},
+          .extent_removed = point_min(remaining_extent_to_delete, child_total_size.extent),
+        };
+        remaining_bytes_to_delete -= child_edit.bytes_removed;
+        remaining_extent_to_delete = point_sub(remaining_extent_to_delete, child_edit.extent_removed);
+        if (remaining_bytes_to_delete == 0) {
+          bytes_delta += (int64_t)edit.bytes_added - edit.bytes_removed;
+          current_edit++;
+        }
+      } else {
+        Length child_right = length_add(child_left, child_total_size);
+        if (child_right.bytes < edit.start_byte) break;
+
+        child_edit = (TSInputEdit){
+          .start_byte = edit.start_byte - child_left.bytes,
+          .bytes_added = edit.bytes_added,
+          .bytes_removed = edit.bytes_removed,
+          .start_point = point_sub(edit.start_point, child_left.extent),
+          .extent_added = edit.extent_added,
+          .extent_removed = edit.extent_removed,
+        };
+
+        uint32_t old_end_byte = edit.start_byte + edit.bytes_removed;
+        if (old_end_byte > child_right.bytes) {
+          TSPoint old_end_point = point_add(edit.start_point, edit.extent_removed);
+          child_edit.bytes_removed = child_right.bytes - edit.start_byte;
+          child_edit.extent_removed = point_sub(child_right.extent, edit.start_point);
+          remaining_bytes_to_delete = old_end_byte - child_right.bytes;
+          remaining_extent_to_delete = point_sub(old_end_point, child_right.extent);
+        } else {
+          bytes_delta += (int64_t)edit.bytes_added - edit.bytes_removed;
+          current_edit++;
+        }
+      }
+
+      ts_tree__edit_lengths(&child_padding, &child_size, &child_edit);
+      array_push(&pool->edits, child_edit);
+      if (remaining_bytes_to_delete > 0) break;
+    }
+
+    if (pool->edits.size > child_edit_index) {
+      // The offset table stays valid until the edits change a child's size.
+      Length old_child_size = ts_tree_total_size(*child);
+      Length new_child_size = length_add(child_padding, child_size);
+      if (first_resized_child > i && (old_child_size.bytes != new_child_size.bytes ||
+                                      !point_eq(old_child_size.extent, new_child_size.extent))) {
+        first_resized_child = i;
+      }
+      *child = ts_tree__edit(pool, *child, child_edit_index, pool->edits.size - child_edit_index);
+      pool->edits.size = child_edit_index;
     }
 
-    child_right = length_add(child_left, ts_tree_total_size(child));
-    child->context.offset = child_left;
+    // A child that precedes an edit may have depended on the text that changed
+    // when it was lexed. Only the nearest edit needs to be considered.
+    if (current_edit < edit_count && remaining_bytes_to_delete == 0) {
+      uint32_t start_byte = pool->edits.contents[edit_index + current_edit].start_byte;
+      *child = ts_tree__invalidate_lookahead(pool, *child, start_byte - child_left.bytes);
+    }
+
+    child_left = length_add(child_left, ts_tree_total_size(*child));
   }
+
+  if (table && table->valid_count > first_resized_child) {
+    table->valid_count = first_resized_child;
+  }
+
+  return self;
+}
+
+Tree *ts_tree_edit(TreePool *pool, Tree *self, const TSInputEdit *edit) {
+  return ts_tree_edit_batch(pool, self, edit, 1);
+}
+
+// Edits that are adjacent are merged. If an edit comes before the end of the
+// previous one, the edits accumulated so far are applied first.
+Tree *ts_tree_edit_batch(TreePool *pool, Tree *self, const TSInputEdit *edits, uint32_t count) {
+  array_clear(&pool->edits);
+  for (uint32_t i = 0; i < count; i++) {
+    const TSInputEdit *edit = &edits[i];
+    if (pool->edits.size > 0) {
+      TSInputEdit *previous_edit = array_back(&pool->edits);
+      uint32_t previous_end_byte = previous_edit->start_byte + previous_edit->bytes_added;
+      if (edit->start_byte == previous_end_byte) {
+        previous_edit->bytes_removed += edit->bytes_removed;
+        previous_edit->bytes_added += edit->bytes_added;
+        previous_edit->extent_removed = point_add(previous_edit->extent_removed, edit->extent_removed);
+        previous_edit->extent_added = point_add(previous_edit->extent_added, edit->extent_added);
+        continue;
+      } else if (edit->start_byte < previous_end_byte) {
+        self = ts_tree__edit(pool, self, 0, pool->edits.size);
+        array_clear(&pool->edits);
+      }
+    }
+    array_push(&pool->edits, *edit);
+  }
+  if (pool->edits.size > 0) self = ts_tree__edit(pool, self, 0, pool->edits.size);
+  return self;
 }
 
 Tree *ts_tree_last_external_token(Tree *tree) {
@@ -595,75 +1638,138 @@ Tree *ts_tree_last_external_token(Tree *tree) {
   return tree;
 }
 
-static size_t ts_tree__write_char_to_string(char *s, size_t n, int32_t c) {
+// Output is gathered in a fixed buffer, which is passed to the callback in
+// pieces whenever it fills up, so that a large tree is written in one pass
+// without being held in memory all at once.
+#define TREE_STRING_BUFFER_SIZE 4096
+
+typedef struct {
+  TSWriteCallback callback;
+  void *payload;
+  uint32_t size;
+  char buffer[TREE_STRING_BUFFER_SIZE];
+} TreeStringWriter;
+
+static void ts_tree__flush_string(TreeStringWriter *self) {
+  if (self->size > 0) self->callback(self->payload, self->buffer, self->size);
+  self->size = 0;
+}
+
+static void ts_tree__write_text(TreeStringWriter *self, const char *text) {
+  while (*text) {
+    if (self->size == TREE_STRING_BUFFER_SIZE) ts_tree__flush_string(self);
+    self->buffer[self->size++] = *text++;
+  }
+}
+
+static void ts_tree__write_char(TreeStringWriter *self, int32_t c) {
+  char string[16];
   if (c == 0)
-    return snprintf(s, n, "EOF");
-  if (c == -1)
-    return snprintf(s, n, "INVALID");
+    snprintf(string, sizeof(string), "EOF");
+  else if (c == -1)
+    snprintf(string, sizeof(string), "INVALID");
   else if (c == '\n')
-    return snprintf(s, n, "'\\n'");
+    snprintf(string, sizeof(string), "'\\n'");
   else if (c == '\t')
-    return snprintf(s, n, "'\\t'");
+    snprintf(string, sizeof(string), "'\\t'");
   else if (c == '\r')
-    return snprintf(s, n, "'\\r'");
+    snprintf(string, sizeof(string), "'\\r'");
   else if (0 < c && c < 128 && isprint(c))
-    return snprintf(s, n, "'%c'", c);
+    snprintf(string, sizeof(string), "'%c'", c);
   else
-    return snprintf(s, n, "%d", c);
+    snprintf(string, sizeof(string), "%d", c);
+  ts_tree__write_text(self, string);
 }
 
-static size_t ts_tree__write_to_string(const Tree *self, const TSLanguage *language,
-                                       char *string, size_t limit, bool is_root,
-                                       bool include_all) {
-  if (!self) return snprintf(string, limit, "(NULL)");
+static void ts_tree__write(const Tree *self, TSSymbol alias_symbol, bool alias_is_named,
+                           const TSLanguage *language, TreeStringWriter *writer,
+                           bool is_root, bool include_all) {
+  if (!self) {
+    ts_tree__write_text(writer, "(NULL)");
+    return;
+  }
 
-  char *cursor = string;
-  char **writer = (limit > 0) ? &cursor : &string;
   bool visible =
     include_all ||
     is_root ||
     self->is_missing ||
     (self->visible && self->named) ||
-    self->context.alias_is_named;
+    alias_is_named;
 
   if (visible && !is_root) {
-    cursor += snprintf(*writer, limit, " ");
+    ts_tree__write_text(writer, " ");
   }
 
   if (visible) {
-    if (self->symbol == ts_builtin_sym_error && self->children.size == 0 && self->size.bytes > 0) {
-      cursor += snprintf(*writer, limit, "(UNEXPECTED ");
-      cursor += ts_tree__write_char_to_string(*writer, limit, self->lookahead_char);
+    if (self->symbol == ts_builtin_sym_error && self->children.size == 0 &&
+        self->size.bytes > 0 && !self->is_compact_error) {
+      ts_tree__write_text(writer, "(UNEXPECTED ");
+      ts_tree__write_char(writer, self->lookahead_char);
     } else if (self->is_missing) {
-      cursor += snprintf(*writer, limit, "(MISSING");
+      ts_tree__write_text(writer, "(MISSING");
     } else {
-      TSSymbol symbol = self->context.alias_symbol ? self->context.alias_symbol : self->symbol;
-      const char *symbol_name = ts_language_symbol_name(language, symbol);
-      cursor += snprintf(*writer, limit, "(%s", symbol_name);
+      TSSymbol symbol = alias_symbol ? alias_symbol : self->symbol;
+      ts_tree__write_text(writer, "(");
+      ts_tree__write_text(writer, ts_language_symbol_name(language, symbol));
     }
   }
 
+  uint32_t structural_child_index = 0;
   for (uint32_t i = 0; i < self->children.size; i++) {
     Tree *child = self->children.contents[i];
-    cursor += ts_tree__write_to_string(child, language, *writer, limit, false, include_all);
+    TSSymbol child_alias_symbol = 0;
+    bool child_alias_is_named = false;
+    if (!child->extra) {
+      child_alias_symbol = ts_language_alias_at(language, self->alias_sequence_id, structural_child_index);
+      if (child_alias_symbol) {
+        child_alias_is_named = ts_language_symbol_metadata(language, child_alias_symbol).named;
+      }
+      structural_child_index++;
+    }
+    ts_tree__write(
+      child, child_alias_symbol, child_alias_is_named,
+      language, writer, false, include_all
+    );
   }
 
-  if (visible) cursor += snprintf(*writer, limit, ")");
+  if (visible) ts_tree__write_text(writer, ")");
+}
 
-  return cursor - string;
+void ts_tree_write_string(const Tree *self, TSSymbol alias_symbol, const TSLanguage *language,
+                          bool include_all, TSWriteCallback callback, void *payload) {
+  TreeStringWriter writer;
+  writer.callback = callback;
+  writer.payload = payload;
+  writer.size = 0;
+  bool alias_is_named = alias_symbol && ts_language_symbol_metadata(language, alias_symbol).named;
+  ts_tree__write(self, alias_symbol, alias_is_named, language, &writer, true, include_all);
+  ts_tree__flush_string(&writer);
 }
 
-char *ts_tree_string(const Tree *self, const TSLanguage *language, bool include_all) {
-  char scratch_string[1];
-  size_t size = ts_tree__write_to_string(self, language, scratch_string, 0, true, include_all) + 1;
-  char *result = ts_malloc(size * sizeof(char));
-  ts_tree__write_to_string(self, language, result, size, true, include_all);
-  return result;
+typedef Array(char) CharArray;
+
+static void ts_tree__append_string(void *payload, const char *text, uint32_t length) {
+  CharArray *string = payload;
+  if (string->size + length > string->capacity) {
+    uint32_t capacity = 2 * string->capacity;
+    if (capacity < string->size + length) capacity = string->size + length;
+    array_reserve(string, capacity);
+  }
+  memcpy(&string->contents[string->size], text, length);
+  string->size += length;
 }
 
-void ts_tree__print_dot_graph(const Tree *self, uint32_t byte_offset,
+char *ts_tree_string(const Tree *self, TSSymbol alias_symbol, const TSLanguage *language,
+                     bool include_all) {
+  CharArray string = array_new();
+  ts_tree_write_string(self, alias_symbol, language, include_all, ts_tree__append_string, &string);
+  array_push(&string, '\0');
+  return string.contents;
+}
+
+void ts_tree__print_dot_graph(const Tree *self, uint32_t byte_offset, TSSymbol alias_symbol,
                               const TSLanguage *language, FILE *f) {
-  TSSymbol symbol = self->context.alias_symbol ? self->context.alias_symbol : self->symbol;
+  TSSymbol symbol = alias_symbol ? alias_symbol : self->symbol;
   fprintf(f, "tree_%p [label=\"%s\"", self, ts_language_symbol_name(language, symbol));
 
   if (self->children.size == 0)
@@ -673,10 +1779,16 @@ void ts_tree__print_dot_graph(const Tree *self, uint32_t byte_offset,
 
   fprintf(f, ", tooltip=\"address:%p\nrange:%u - %u\nstate:%d\nerror-cost:%u\nrepeat-depth:%u\"]\n",
           self, byte_offset, byte_offset + ts_tree_total_bytes(self), self->parse_state,
-          self->error_cost, self->repeat_depth);
+          self->error_cost, ts_tree_repeat_depth(self));
+  uint32_t structural_child_index = 0;
   for (uint32_t i = 0; i < self->children.size; i++) {
     const Tree *child = self->children.contents[i];
-    ts_tree__print_dot_graph(child, byte_offset, language, f);
+    TSSymbol child_alias_symbol = 0;
+    if (!child->extra) {
+      child_alias_symbol = ts_language_alias_at(language, self->alias_sequence_id, structural_child_index);
+      structural_child_index++;
+    }
+    ts_tree__print_dot_graph(child, byte_offset, child_alias_symbol, language, f);
     fprintf(f, "tree_%p -> tree_%p [tooltip=%u]\n", self, child, i);
     byte_offset += ts_tree_total_bytes(child);
   }
@@ -685,7 +1797,7 @@ void ts_tree__print_dot_graph(const Tree *self, uint32_t byte_offset,
 void ts_tree_print_dot_graph(const Tree *self, const TSLanguage *language, FILE *f) {
   fprintf(f, "digraph tree {\n");
   fprintf(f, "edge [arrowhead=none]\n");
-  ts_tree__print_dot_graph(self, 0, language, f);
+  ts_tree__print_dot_graph(self, 0, 0, language, f);
   fprintf(f, "}\n");
 }
 
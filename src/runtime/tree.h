@@ -27,24 +27,18 @@ typedef struct Tree Tree;
 typedef Array(Tree *) TreeArray;
 
 struct Tree {
-  struct {
-    struct Tree *parent;
-    uint32_t index;
-    Length offset;
-    TSSymbol alias_symbol : 15;
-    bool alias_is_named : 1;
-  } context;
-
   Length padding;
   Length size;
   uint32_t ref_count;
   uint32_t bytes_scanned;
   uint32_t error_cost;
-  uint32_t node_count;
-  uint32_t repeat_depth;
-  uint32_t child_count;
   int32_t dynamic_precedence;
 
+  // The generation of the pool when the tree was created. Trees are never
+  // older than their children, so a tree that predates a parse contains no
+  // trees that were created by it.
+  uint32_t generation;
+
   bool visible : 1;
   bool named : 1;
   bool extra : 1;
@@ -53,19 +47,48 @@ struct Tree {
   bool has_changes : 1;
   bool has_external_tokens : 1;
   bool is_missing : 1;
+  bool has_child_slots : 1;
+  bool has_child_offsets : 1;
+  bool is_balanced : 1;
+  bool is_interned : 1;
+  bool is_opaque : 1;
+  bool is_compact_error : 1;
+
+  // Parsing doesn't need the counts of a node's visible and named children,
+  // so they are only computed once the tree is published.
+  bool has_pending_child_counts : 1;
   TSSymbol symbol;
   TSStateId parse_state;
+  uint16_t alias_sequence_id;
   struct {
     TSSymbol symbol;
     TSLexMode lex_mode;
   } first_leaf;
 
+  // A hash of the tree's symbol and of its children's hashes. Trees that are
+  // equal always have the same hash, so trees with different hashes can be
+  // told apart without comparing their descendants.
+  uint16_t structure_hash;
+
+  // A hash of the tree's symbol and text. A leaf's fingerprint combines its
+  // symbol, its size and a hash of its text computed by the lexer, and a
+  // node's combines its symbol with its children's fingerprints and the
+  // padding between them, so that it changes whenever any token in the tree
+  // does, but not when the tree is only moved. An opaque leaf hashes the
+  // tokens of the region it skipped, and a compact error leaf the trees that
+  // it replaced.
+  uint64_t fingerprint;
+
+  // Fields that only apply to internal nodes share space with the data
+  // stored in leaves. The first word is always zero for leaves, since it
+  // overlaps `children.size`.
   union {
     struct {
       TreeArray children;
       uint32_t visible_child_count;
       uint32_t named_child_count;
-      uint16_t alias_sequence_id;
+      uint32_t node_count;
+      uint32_t repeat_depth;
     };
     struct {
       uint32_t _2;
@@ -80,10 +103,55 @@ struct Tree {
 
 typedef struct {
   TreeArray free_trees;
+  Array(char *) slabs;
+  char *slab_cursor;
+  char *slab_end;
+  uint32_t sweep_threshold;
+  uint32_t tree_size;
+} TreeSlabs;
+
+typedef struct {
+  uint32_t index;
+  uint32_t structural_index;
+  Length offset;
+} TreeChildPosition;
+
+// A hash set of leaves that are shared by every position at which an identical
+// token occurs. The set holds a reference to each of its leaves.
+typedef struct {
+  Tree **entries;
+  uint32_t capacity;
+  uint32_t size;
+} LeafTable;
+
+// A reference to a tree that was dropped on a thread other than the one that
+// owns the tree's pool.
+typedef struct TreeRelease {
+  Tree *tree;
+  struct TreeRelease *next;
+} TreeRelease;
+
+typedef struct {
+  TreeSlabs leaves;
+  TreeSlabs nodes;
   TreeArray tree_stack;
+  Array(TSInputEdit) edits;
+  LeafTable interned_leaves;
+  TreeRelease *remote_releases;
+  uint32_t generation;
 } TreePool;
 
+// The numbers of elements that a pool's arrays have grown to.
+typedef struct {
+  uint32_t free_leaf_count;
+  uint32_t free_node_count;
+  uint32_t tree_stack_size;
+} TreePoolCapacity;
+
 void ts_external_token_state_init(TSExternalTokenState *, const char *, unsigned);
+void ts_external_token_state_intern(TSExternalTokenState *, const char *, unsigned,
+                                    const TSExternalTokenState *);
+void ts_external_token_state_copy(TSExternalTokenState *, const TSExternalTokenState *);
 const char *ts_external_token_state_data(const TSExternalTokenState *);
 
 bool ts_tree_array_copy(TreeArray, TreeArray *);
@@ -91,30 +159,112 @@ void ts_tree_array_delete(TreePool *, TreeArray *);
 TreeArray ts_tree_array_remove_trailing_extras(TreeArray *);
 void ts_tree_array_reverse(TreeArray *);
 
+static inline uint32_t ts_tree_node_count(const Tree *self) {
+  return self->children.size > 0 ? self->node_count : 1;
+}
+
+static inline uint32_t ts_tree_repeat_depth(const Tree *self) {
+  return self->children.size > 0 ? self->repeat_depth : 0;
+}
+
+// Error nodes are compared without their children, so their hash only depends
+// on their symbol. Each child is added to the hash after the ones before it,
+// which means that replacing the last child only changes the hash by the
+// difference between the old child's hash and the new one's.
+static inline uint16_t ts_tree_symbol_hash(TSSymbol symbol) {
+  return (uint16_t)(symbol * 40503u + 1);
+}
+
+static inline uint16_t ts_tree_structure_hash_add(uint16_t hash, const Tree *child) {
+  return (uint16_t)(hash * 31u + child->structure_hash);
+}
+
+// Fingerprints are built the same way, except that the children of error
+// nodes are included, and that each child after the first one also adds the
+// size of its padding. Leaves whose text was not seen by the lexer, such as
+// missing leaves, error leaves and leaves that were read from a serialized
+// tree, use a text hash of zero.
+static inline uint64_t ts_tree_fingerprint_mix(uint64_t value) {
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+  return value ^ (value >> 31);
+}
+
+static inline uint64_t ts_tree_leaf_fingerprint(TSSymbol symbol, uint32_t size, uint64_t text_hash) {
+  return ts_tree_fingerprint_mix(text_hash ^ ((uint64_t)symbol << 32 | size));
+}
+
+static inline uint64_t ts_tree_node_fingerprint(TSSymbol symbol, uint16_t alias_sequence_id) {
+  return ts_tree_fingerprint_mix(~((uint64_t)symbol << 16 | alias_sequence_id));
+}
+
+static inline uint64_t ts_tree_fingerprint_add(uint64_t fingerprint, const Tree *child, bool is_first) {
+  return fingerprint * 0x100000001b3ull + child->fingerprint + (is_first ? 0 : child->padding.bytes);
+}
+
 void ts_tree_pool_init(TreePool *);
+
+// Every tree that was allocated from the pool must be released, or its slabs
+// handed to another pool with `ts_tree_pool_adopt`, before the pool is deleted.
+// Slabs that still hold live trees aren't freed, so that trees which were never
+// released show up as leaks instead of as dangling pointers.
 void ts_tree_pool_delete(TreePool *);
 Tree *ts_tree_pool_allocate(TreePool *);
+Tree *ts_tree_pool_allocate_node(TreePool *);
 void ts_tree_pool_free(TreePool *, Tree *);
+void ts_tree_pool_adopt(TreePool *, TreePool *);
+void ts_tree_pool_release_remotely(TreePool *, Tree *);
+void ts_tree_pool_drain_remote_releases(TreePool *);
+size_t ts_tree_pool_allocated_bytes(const TreePool *);
+size_t ts_tree_pool_free_bytes(const TreePool *);
+TreePoolCapacity ts_tree_pool_capacity(const TreePool *);
+void ts_tree_pool_reserve(TreePool *, TreePoolCapacity);
+
+// Return the slabs whose trees are all free to the allocator, and give back
+// the memory reserved beyond the size of each of the pool's arrays.
+void ts_tree_pool_trim(TreePool *);
+Tree *ts_tree_pool_intern_leaf(TreePool *, Tree *);
+void ts_tree_pool_prune_interned_leaves(TreePool *);
+size_t ts_tree_pool_interned_bytes(const TreePool *);
 
 Tree *ts_tree_make_leaf(TreePool *, TSSymbol, Length, Length, const TSLanguage *);
 Tree *ts_tree_make_node(TreePool *, TSSymbol, TreeArray *, unsigned, const TSLanguage *);
+
+// A node can be allocated before its children are known, so that they can be
+// written directly into the slots allocated along with it, which
+// `ts_tree_child_slots` returns as an empty array. The node is valid once
+// `ts_tree_init_node` has been called, and can be returned to the pool with
+// `ts_tree_pool_free` before that.
+TreeArray ts_tree_child_slots(Tree *);
+Tree *ts_tree_init_node(TreePool *, Tree *, TSSymbol, TreeArray *, unsigned, const TSLanguage *);
+
 Tree *ts_tree_make_copy(TreePool *, Tree *child);
+Tree *ts_tree_make_mut(TreePool *, Tree *);
 Tree *ts_tree_make_error_node(TreePool *, TreeArray *, const TSLanguage *);
 Tree *ts_tree_make_error(TreePool *, Length, Length, int32_t, const TSLanguage *);
 Tree *ts_tree_make_missing_leaf(TreePool *, TSSymbol, const TSLanguage *);
+bool ts_tree_push_repetition(TreePool *, Tree *, Tree *, const TSLanguage *);
 void ts_tree_retain(Tree *tree);
 void ts_tree_release(TreePool *, Tree *tree);
+size_t ts_tree_memory_usage(const Tree *);
+void ts_tree_get_stats(const Tree *, TSTreeStats *);
 bool ts_tree_eq(const Tree *tree1, const Tree *tree2);
 int ts_tree_compare(const Tree *tree1, const Tree *tree2);
-uint32_t ts_tree_start_column(const Tree *self);
-uint32_t ts_tree_end_column(const Tree *self);
 void ts_tree_set_children(Tree *, TreeArray *, const TSLanguage *);
-void ts_tree_assign_parents(Tree *, TreePool *, const TSLanguage *);
-void ts_tree_edit(Tree *, const TSInputEdit *edit);
-char *ts_tree_string(const Tree *, const TSLanguage *, bool include_all);
+bool ts_tree_seek_child_for_byte(const Tree *, Length, uint32_t, TreeChildPosition *);
+bool ts_tree_seek_child_for_point(const Tree *, Length, TSPoint, TreeChildPosition *);
+void ts_tree_replace_children(TreePool *, Tree *, const Tree *);
+void ts_tree_balance(Tree *, TreePool *, const TSLanguage *);
+Tree *ts_tree_compact(TreePool *, Tree *);
+Tree *ts_tree_edit(TreePool *, Tree *, const TSInputEdit *edit);
+Tree *ts_tree_edit_batch(TreePool *, Tree *, const TSInputEdit *edits, uint32_t count);
+char *ts_tree_string(const Tree *, TSSymbol alias_symbol, const TSLanguage *, bool include_all);
+void ts_tree_write_string(const Tree *, TSSymbol alias_symbol, const TSLanguage *, bool include_all,
+                          TSWriteCallback, void *);
 void ts_tree_print_dot_graph(const Tree *, const TSLanguage *, FILE *);
 Tree *ts_tree_last_external_token(Tree *);
 bool ts_tree_external_token_state_eq(const Tree *, const Tree *);
+void ts_tree_resolve_child_counts(Tree *, TreeArray *, const TSLanguage *);
 
 static inline uint32_t ts_tree_total_bytes(const Tree *self) {
   return self->padding.bytes + self->size.bytes;
@@ -0,0 +1,151 @@
+#include <string.h>
+#include "runtime/tree_builder.h"
+#include "runtime/alloc.h"
+
+// A tree's start byte is the start of its padding. Hidden trees don't get
+// objects of their own: their visible descendants become the children of
+// their nearest visible ancestor instead.
+
+static inline uint32_t tree_builder__hash(const Tree *tree) {
+  uint64_t value = (uintptr_t)tree;
+  return (uint32_t)((value >> 4) * 0x9e3779b97f4a7c15ull >> 32);
+}
+
+static BuiltObject *tree_builder__slot(const TreeBuilder *self, const Tree *tree) {
+  uint32_t mask = self->capacity - 1;
+  uint32_t index = tree_builder__hash(tree) & mask;
+  while (self->objects[index].tree && self->objects[index].tree != tree) {
+    index = (index + 1) & mask;
+  }
+  return &self->objects[index];
+}
+
+static void tree_builder__grow(TreeBuilder *self) {
+  BuiltObject *old_objects = self->objects;
+  uint32_t old_capacity = self->capacity;
+  self->capacity = old_capacity ? old_capacity * 2 : 64;
+  self->objects = ts_calloc(self->capacity, sizeof(BuiltObject));
+  for (uint32_t i = 0; i < old_capacity; i++) {
+    if (old_objects[i].tree) *tree_builder__slot(self, old_objects[i].tree) = old_objects[i];
+  }
+  if (old_objects) ts_free(old_objects);
+}
+
+static void tree_builder__insert(TreeBuilder *self, Tree *tree, void *object) {
+  if (2 * (self->size + 1) > self->capacity) tree_builder__grow(self);
+  ts_tree_retain(tree);
+  *tree_builder__slot(self, tree) = (BuiltObject){tree, object, false};
+  self->size++;
+}
+
+void tree_builder_init(TreeBuilder *self) {
+  memset(&self->callbacks, 0, sizeof(self->callbacks));
+  self->objects = NULL;
+  self->capacity = 0;
+  self->size = 0;
+  array_init(&self->children);
+  array_init(&self->stack);
+}
+
+void tree_builder_delete(TreeBuilder *self, TreePool *pool) {
+  tree_builder_clear(self, pool);
+  if (self->objects) ts_free(self->objects);
+  if (self->children.contents) array_delete(&self->children);
+  if (self->stack.contents) array_delete(&self->stack);
+}
+
+// Release every object that hasn't been kept, along with the trees.
+void tree_builder_clear(TreeBuilder *self, TreePool *pool) {
+  if (self->size == 0) return;
+  for (uint32_t i = 0; i < self->capacity; i++) {
+    BuiltObject *entry = &self->objects[i];
+    if (!entry->tree) continue;
+    if (!entry->is_kept && self->callbacks.release) {
+      self->callbacks.release(self->callbacks.payload, entry->object);
+    }
+    ts_tree_release(pool, entry->tree);
+  }
+  memset(self->objects, 0, self->capacity * sizeof(BuiltObject));
+  self->size = 0;
+}
+
+// Return the object for a visible tree, creating it and the objects of its
+// visible descendants if they don't exist yet. The hidden trees in between
+// are walked with an explicit stack, since hidden repetitions can be deep.
+void *tree_builder_build(TreeBuilder *self, Tree *tree, uint32_t start_byte) {
+  if (!tree->visible) return NULL;
+  if (self->size > 0) {
+    BuiltObject *slot = tree_builder__slot(self, tree);
+    if (slot->tree) return slot->object;
+  }
+
+  TSSymbol symbol = tree->symbol;
+  uint32_t node_start_byte = start_byte + tree->padding.bytes;
+  uint32_t node_end_byte = node_start_byte + tree->size.bytes;
+  void *object = NULL;
+  if (tree->children.size == 0) {
+    if (self->callbacks.leaf) {
+      object = self->callbacks.leaf(self->callbacks.payload, symbol, node_start_byte, node_end_byte);
+    }
+  } else {
+    uint32_t first_child = self->children.size;
+    uint32_t stack_base = self->stack.size;
+    array_push(&self->stack, ((TreeBuilderEntry){tree, start_byte}));
+    while (self->stack.size > stack_base) {
+      TreeBuilderEntry entry = array_pop(&self->stack);
+      if (entry.tree != tree && entry.tree->visible) {
+        void *child = tree_builder_build(self, (Tree *)entry.tree, entry.start_byte);
+        array_push(&self->children, child);
+        continue;
+      }
+
+      uint32_t start = self->stack.size;
+      uint32_t child_start_byte = entry.start_byte;
+      for (uint32_t i = 0; i < entry.tree->children.size; i++) {
+        const Tree *child = entry.tree->children.contents[i];
+        array_push(&self->stack, ((TreeBuilderEntry){child, child_start_byte}));
+        child_start_byte += ts_tree_total_bytes(child);
+      }
+      for (uint32_t i = start, j = self->stack.size; i + 1 < j; i++) {
+        j--;
+        TreeBuilderEntry swap = self->stack.contents[i];
+        self->stack.contents[i] = self->stack.contents[j];
+        self->stack.contents[j] = swap;
+      }
+    }
+
+    if (self->callbacks.node) {
+      object = self->callbacks.node(
+        self->callbacks.payload, symbol, node_start_byte, node_end_byte,
+        &self->children.contents[first_child], self->children.size - first_child
+      );
+    }
+    self->children.size = first_child;
+  }
+
+  tree_builder__insert(self, tree, object);
+  return object;
+}
+
+// Hand the root's object to the caller, who then owns every object that
+// belongs to the final tree. The rest were built for interpretations of the
+// input that were discarded, and are released.
+void tree_builder_accept(TreeBuilder *self, TreePool *pool, Tree *root) {
+  void *root_object = tree_builder_build(self, root, 0);
+
+  array_clear(&self->stack);
+  array_push(&self->stack, ((TreeBuilderEntry){root, 0}));
+  while (self->stack.size > 0) {
+    const Tree *tree = array_pop(&self->stack).tree;
+    if (tree->visible) {
+      BuiltObject *slot = tree_builder__slot(self, tree);
+      if (slot->tree) slot->is_kept = true;
+    }
+    for (uint32_t i = 0; i < tree->children.size; i++) {
+      array_push(&self->stack, ((TreeBuilderEntry){tree->children.contents[i], 0}));
+    }
+  }
+
+  tree_builder_clear(self, pool);
+  if (self->callbacks.accept) self->callbacks.accept(self->callbacks.payload, root_object);
+}
@@ -0,0 +1,49 @@
+#ifndef RUNTIME_TREE_BUILDER_H_
+#define RUNTIME_TREE_BUILDER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include "tree_sitter/runtime.h"
+#include "runtime/tree.h"
+
+typedef struct {
+  Tree *tree;
+  void *object;
+  bool is_kept;
+} BuiltObject;
+
+typedef struct {
+  const Tree *tree;
+  uint32_t start_byte;
+} TreeBuilderEntry;
+
+// The objects that a caller's tree builder has created during a parse, keyed
+// by the trees that they stand for. Each of those trees is retained until the
+// parse finishes, so that its address can't be taken by a different tree.
+typedef struct {
+  TSTreeBuilder callbacks;
+  BuiltObject *objects;
+  uint32_t capacity;
+  uint32_t size;
+  Array(void *) children;
+  Array(TreeBuilderEntry) stack;
+} TreeBuilder;
+
+void tree_builder_init(TreeBuilder *);
+void tree_builder_delete(TreeBuilder *, TreePool *);
+void tree_builder_clear(TreeBuilder *, TreePool *);
+void *tree_builder_build(TreeBuilder *, Tree *, uint32_t start_byte);
+void tree_builder_accept(TreeBuilder *, TreePool *, Tree *);
+
+static inline bool tree_builder_is_active(const TreeBuilder *self) {
+  return self->callbacks.leaf || self->callbacks.node;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // RUNTIME_TREE_BUILDER_H_
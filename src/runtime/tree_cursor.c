@@ -0,0 +1,158 @@
+#include "runtime/tree_cursor.h"
+#include "runtime/alloc.h"
+#include "runtime/language.h"
+#include "runtime/node.h"
+#include "runtime/tree.h"
+
+TSTreeCursor *ts_tree_cursor_new(TSNode node) {
+  TSTreeCursor *self = ts_malloc(sizeof(TSTreeCursor));
+  array_init(&self->stack);
+  array_push(&self->stack, ((TreeCursorEntry){
+    .tree = node.data,
+    .position = { node.offset[0], { node.offset[1], node.offset[2] } },
+    .child_index = 0,
+    .structural_child_index = 0,
+    .visible_child_index = node.child_index,
+  }));
+  self->root = node.root;
+  self->language = node.language;
+  self->alias_symbol = node.alias_symbol;
+  return self;
+}
+
+void ts_tree_cursor_delete(TSTreeCursor *self) {
+  array_delete(&self->stack);
+  ts_free(self);
+}
+
+/*
+ *  Private
+ */
+
+static inline TSSymbol ts_tree_cursor__alias_symbol(const TSTreeCursor *self,
+                                                    const Tree *parent,
+                                                    const Tree *child,
+                                                    uint32_t structural_child_index) {
+  if (child->extra) return 0;
+  return ts_language_alias_at(self->language, parent->alias_sequence_id, structural_child_index);
+}
+
+static inline bool ts_tree_cursor__is_visible(const TSTreeCursor *self, uint32_t index) {
+  if (index == 0) return true;
+  const TreeCursorEntry *entry = &self->stack.contents[index];
+  const Tree *parent = self->stack.contents[index - 1].tree;
+  return entry->tree->visible || ts_tree_cursor__alias_symbol(
+    self, parent, entry->tree, entry->structural_child_index
+  );
+}
+
+// Push the first child of the given parent, starting at the given index, that
+// is either visible or contains visible descendants. The visible child index
+// is the child's index among the children of its visible parent.
+static bool ts_tree_cursor__push_child(TSTreeCursor *self, const Tree *parent,
+                                       uint32_t child_index,
+                                       uint32_t structural_child_index,
+                                       uint32_t visible_child_index,
+                                       Length position) {
+  for (; child_index < parent->children.size; child_index++) {
+    const Tree *child = parent->children.contents[child_index];
+    bool visible = child->visible ||
+      ts_tree_cursor__alias_symbol(self, parent, child, structural_child_index);
+    if (visible || child->visible_child_count > 0) {
+      array_push(&self->stack, ((TreeCursorEntry){
+        .tree = child,
+        .position = position,
+        .child_index = child_index,
+        .structural_child_index = structural_child_index,
+        .visible_child_index = visible_child_index,
+      }));
+      return true;
+    }
+    if (!child->extra) structural_child_index++;
+    position = length_add(position, ts_tree_total_size(child));
+  }
+  return false;
+}
+
+// The number of positions that an entry takes up among the children of its
+// visible parent.
+static inline uint32_t ts_tree_cursor__visible_width(const TSTreeCursor *self, uint32_t index) {
+  const TreeCursorEntry *entry = &self->stack.contents[index];
+  if (ts_tree_cursor__is_visible(self, index)) return 1;
+  return entry->tree->children.size > 0 ? entry->tree->visible_child_count : 0;
+}
+
+// Descend from the entry at the top of the stack through invisible trees
+// until a visible one is reached. Every invisible tree that is pushed onto the
+// stack has visible descendants, so this always succeeds.
+static void ts_tree_cursor__descend_to_visible(TSTreeCursor *self) {
+  while (!ts_tree_cursor__is_visible(self, self->stack.size - 1)) {
+    TreeCursorEntry entry = *array_back(&self->stack);
+    if (!ts_tree_cursor__push_child(self, entry.tree, 0, 0, entry.visible_child_index,
+                                    entry.position)) break;
+  }
+}
+
+/*
+ *  Public
+ */
+
+bool ts_tree_cursor_goto_first_child(TSTreeCursor *self) {
+  TreeCursorEntry entry = *array_back(&self->stack);
+  if (!ts_tree_cursor__push_child(self, entry.tree, 0, 0, 0, entry.position)) return false;
+  ts_tree_cursor__descend_to_visible(self);
+  return true;
+}
+
+bool ts_tree_cursor_goto_next_sibling(TSTreeCursor *self) {
+  // Climb out of the current node until an ancestor has a later child that is
+  // visible or has visible descendants, stopping at the current node's parent.
+  for (uint32_t i = self->stack.size - 1; i > 0; i--) {
+    TreeCursorEntry entry = self->stack.contents[i];
+    const Tree *parent = self->stack.contents[i - 1].tree;
+    uint32_t structural_child_index = entry.structural_child_index;
+    if (!entry.tree->extra) structural_child_index++;
+    Length position = length_add(entry.position, ts_tree_total_size(entry.tree));
+    uint32_t visible_child_index = entry.visible_child_index;
+    if (visible_child_index != TS_NODE_CHILD_INDEX_UNKNOWN) {
+      visible_child_index += ts_tree_cursor__visible_width(self, i);
+    }
+
+    uint32_t previous_size = self->stack.size;
+    self->stack.size = i;
+    if (ts_tree_cursor__push_child(self, parent, entry.child_index + 1,
+                                   structural_child_index, visible_child_index, position)) {
+      ts_tree_cursor__descend_to_visible(self);
+      return true;
+    }
+    self->stack.size = previous_size;
+
+    if (ts_tree_cursor__is_visible(self, i - 1)) break;
+  }
+
+  return false;
+}
+
+bool ts_tree_cursor_goto_parent(TSTreeCursor *self) {
+  for (uint32_t i = self->stack.size - 1; i > 0; i--) {
+    if (ts_tree_cursor__is_visible(self, i - 1)) {
+      self->stack.size = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+TSNode ts_tree_cursor_current_node(const TSTreeCursor *self) {
+  const TreeCursorEntry *entry = array_back(&self->stack);
+  TSSymbol alias_symbol = self->alias_symbol;
+  if (self->stack.size > 1) {
+    const Tree *parent = self->stack.contents[self->stack.size - 2].tree;
+    alias_symbol = ts_tree_cursor__alias_symbol(
+      self, parent, entry->tree, entry->structural_child_index
+    );
+  }
+  TSNode result = ts_node_make(entry->tree, entry->position, alias_symbol, self->root, self->language);
+  result.child_index = entry->visible_child_index;
+  return result;
+}
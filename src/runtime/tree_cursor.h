@@ -0,0 +1,24 @@
+#ifndef RUNTIME_TREE_CURSOR_H_
+#define RUNTIME_TREE_CURSOR_H_
+
+#include "runtime/tree.h"
+
+typedef struct {
+  const Tree *tree;
+  Length position;
+  uint32_t child_index;
+  uint32_t structural_child_index;
+  uint32_t visible_child_index;
+} TreeCursorEntry;
+
+// The stack holds every tree between the cursor's starting node and its
+// current node, including invisible ones, so that moving the cursor never
+// requires searching from the root.
+struct TSTreeCursor {
+  Array(TreeCursorEntry) stack;
+  const Tree *root;
+  const TSLanguage *language;
+  TSSymbol alias_symbol;
+};
+
+#endif  // RUNTIME_TREE_CURSOR_H_
@@ -0,0 +1,179 @@
+#include "tree_sitter/runtime.h"
+#include "runtime/array.h"
+#include "runtime/node.h"
+
+// Two trees that came from the same document share every subtree that an
+// edit or a re-parse left alone, so a pair of nodes with the same tree and
+// alias is reported as retained without looking inside it. The other pairs
+// of nodes with the same symbol are reported as changed, and their visible
+// children are matched up: first the children that are shared at the start
+// and at the end of both lists, and then the rest in order, pairing those
+// with the same symbol. The work is therefore proportional to the number of
+// changed nodes and their children, rather than to the size of the trees.
+//
+// Entries are reported in document order. Pending work is kept on an explicit
+// stack, so that the depth of the trees doesn't matter: an item either holds
+// an entry that is ready to be reported, or a pair of nodes that still needs
+// to be compared.
+
+typedef struct {
+  TSNodeDiffEntry entry;
+  bool needs_comparison;
+} DiffItem;
+
+typedef Array(DiffItem) DiffItemArray;
+typedef Array(TSNode) NodeArray;
+
+typedef struct {
+  DiffItemArray stack;
+  DiffItemArray items;
+  NodeArray old_children;
+  NodeArray new_children;
+} TreeDiff;
+
+static inline TSNode tree_diff__null_node() {
+  return ts_node_make(NULL, length_zero(), 0, NULL, NULL);
+}
+
+static inline bool tree_diff__is_shared(TSNode old_node, TSNode new_node) {
+  return old_node.data == new_node.data && old_node.alias_symbol == new_node.alias_symbol;
+}
+
+static void tree_diff__add_item(TreeDiff *self, TSNodeDiffType type, TSNode old_node, TSNode new_node,
+                                bool needs_comparison) {
+  DiffItem item = {
+    .entry = { .type = type, .old_node = old_node, .new_node = new_node },
+    .needs_comparison = needs_comparison,
+  };
+  array_push(&self->items, item);
+}
+
+static void tree_diff__add_removed(TreeDiff *self, TSNode old_node) {
+  tree_diff__add_item(self, TSNodeDiffRemoved, old_node, tree_diff__null_node(), false);
+}
+
+static void tree_diff__add_inserted(TreeDiff *self, TSNode new_node) {
+  tree_diff__add_item(self, TSNodeDiffInserted, tree_diff__null_node(), new_node, false);
+}
+
+static void tree_diff__get_children(TSNode node, NodeArray *children) {
+  array_clear(children);
+  uint32_t count = ts_node_child_count(node);
+  array_reserve(children, count);
+  children->size = ts_node_children(node, children->contents, count);
+}
+
+// Match up the children of two nodes with the same symbol, and push the
+// resulting items onto the stack in reverse, so that they're popped in order.
+static void tree_diff__compare_children(TreeDiff *self, TSNode old_node, TSNode new_node) {
+  tree_diff__get_children(old_node, &self->old_children);
+  tree_diff__get_children(new_node, &self->new_children);
+  const TSNode *old_children = self->old_children.contents;
+  const TSNode *new_children = self->new_children.contents;
+  uint32_t old_end = self->old_children.size;
+  uint32_t new_end = self->new_children.size;
+
+  uint32_t prefix_length = 0;
+  while (prefix_length < old_end && prefix_length < new_end &&
+         tree_diff__is_shared(old_children[prefix_length], new_children[prefix_length])) {
+    prefix_length++;
+  }
+
+  uint32_t suffix_length = 0;
+  while (prefix_length + suffix_length < old_end && prefix_length + suffix_length < new_end &&
+         tree_diff__is_shared(old_children[old_end - suffix_length - 1],
+                              new_children[new_end - suffix_length - 1])) {
+    suffix_length++;
+  }
+
+  array_clear(&self->items);
+  for (uint32_t i = 0; i < prefix_length; i++) {
+    tree_diff__add_item(self, TSNodeDiffRetained, old_children[i], new_children[i], false);
+  }
+
+  // When one list has more unmatched children than the other, the children
+  // whose symbols differ are taken from the longer list first.
+  uint32_t i = prefix_length, j = prefix_length;
+  old_end -= suffix_length;
+  new_end -= suffix_length;
+  while (i < old_end && j < new_end) {
+    TSNode old_child = old_children[i], new_child = new_children[j];
+    if (ts_node_symbol(old_child) == ts_node_symbol(new_child)) {
+      tree_diff__add_item(self, TSNodeDiffChanged, old_child, new_child, true);
+      i++;
+      j++;
+    } else if (old_end - i > new_end - j) {
+      tree_diff__add_removed(self, old_child);
+      i++;
+    } else if (new_end - j > old_end - i) {
+      tree_diff__add_inserted(self, new_child);
+      j++;
+    } else {
+      tree_diff__add_removed(self, old_child);
+      tree_diff__add_inserted(self, new_child);
+      i++;
+      j++;
+    }
+  }
+  for (; i < old_end; i++) tree_diff__add_removed(self, old_children[i]);
+  for (; j < new_end; j++) tree_diff__add_inserted(self, new_children[j]);
+
+  for (uint32_t k = 0; k < suffix_length; k++) {
+    tree_diff__add_item(self, TSNodeDiffRetained, old_children[old_end + k], new_children[new_end + k], false);
+  }
+
+  for (uint32_t k = self->items.size; k > 0; k--) {
+    array_push(&self->stack, self->items.contents[k - 1]);
+  }
+}
+
+bool ts_node_diff(TSNode old_node, TSNode new_node, TSNodeDiffCallback callback, void *payload) {
+  TreeDiff self = {
+    .stack = array_new(),
+    .items = array_new(),
+    .old_children = array_new(),
+    .new_children = array_new(),
+  };
+  DiffItem root = {
+    .entry = { .type = TSNodeDiffChanged, .old_node = old_node, .new_node = new_node },
+    .needs_comparison = true,
+  };
+  if (old_node.data && new_node.data) array_push(&self.stack, root);
+  else if (old_node.data) tree_diff__add_removed(&self, old_node);
+  else if (new_node.data) tree_diff__add_inserted(&self, new_node);
+  if (self.items.size > 0) array_push(&self.stack, self.items.contents[0]);
+
+  bool completed = true;
+  while (self.stack.size > 0) {
+    DiffItem item = array_pop(&self.stack);
+    TSNodeDiffEntry entry = item.entry;
+    if (item.needs_comparison) {
+      if (tree_diff__is_shared(entry.old_node, entry.new_node)) {
+        entry.type = TSNodeDiffRetained;
+        item.needs_comparison = false;
+      } else if (ts_node_symbol(entry.old_node) != ts_node_symbol(entry.new_node)) {
+        // A removal and an insertion take the place of the pair.
+        DiffItem inserted = {
+          .entry = { .type = TSNodeDiffInserted, .old_node = tree_diff__null_node(), .new_node = entry.new_node },
+          .needs_comparison = false,
+        };
+        array_push(&self.stack, inserted);
+        entry.type = TSNodeDiffRemoved;
+        entry.new_node = tree_diff__null_node();
+        item.needs_comparison = false;
+      }
+    }
+
+    if (!callback(payload, &entry)) {
+      completed = false;
+      break;
+    }
+    if (item.needs_comparison) tree_diff__compare_children(&self, entry.old_node, entry.new_node);
+  }
+
+  array_delete(&self.stack);
+  array_delete(&self.items);
+  array_delete(&self.old_children);
+  array_delete(&self.new_children);
+  return completed;
+}
@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <string.h>
+#include "tree_sitter/runtime.h"
+#include "runtime/language.h"
+
+// Nodes are exported in pre-order, one record per visible node, by walking a
+// tree cursor rather than recursing, so that the depth of the tree doesn't
+// matter. Each record holds the node's symbol, whether it's named, its byte
+// range and its number of children, which is enough for a consumer to rebuild
+// the tree's shape as the records arrive. Records are gathered in a fixed
+// buffer that is handed to the callback whenever it is nearly full.
+//
+// In the JSON lines format, each record is an object on its own line. In the
+// binary format, each record is a sequence of LEB128 varints: the symbol, the
+// named flag, the start byte, the length in bytes and the child count.
+
+#define EXPORT_BUFFER_SIZE 4096
+#define EXPORT_MAX_RECORD_SIZE 128
+
+typedef struct {
+  TSWriteCallback callback;
+  void *payload;
+  uint32_t size;
+  char buffer[EXPORT_BUFFER_SIZE];
+} ExportWriter;
+
+static void export_writer__flush(ExportWriter *self) {
+  if (self->size > 0) self->callback(self->payload, self->buffer, self->size);
+  self->size = 0;
+}
+
+// Make room for a record of bounded size, apart from its type name.
+static void export_writer__reserve(ExportWriter *self) {
+  if (self->size + EXPORT_MAX_RECORD_SIZE > EXPORT_BUFFER_SIZE) export_writer__flush(self);
+}
+
+static void export_writer__write_byte(ExportWriter *self, char byte) {
+  if (self->size == EXPORT_BUFFER_SIZE) export_writer__flush(self);
+  self->buffer[self->size++] = byte;
+}
+
+static void export_writer__write_varint(ExportWriter *self, uint32_t value) {
+  while (value >= 0x80) {
+    self->buffer[self->size++] = (char)(value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  self->buffer[self->size++] = (char)value;
+}
+
+// Type names of anonymous nodes are the text of their tokens, so they may
+// contain quotes, backslashes or control characters.
+static void export_writer__write_json_string(ExportWriter *self, const char *string) {
+  export_writer__write_byte(self, '"');
+  for (const char *c = string; *c; c++) {
+    unsigned char byte = (unsigned char)*c;
+    if (byte == '"' || byte == '\\') {
+      export_writer__write_byte(self, '\\');
+      export_writer__write_byte(self, (char)byte);
+    } else if (byte < 0x20) {
+      char escape[8];
+      snprintf(escape, sizeof(escape), "\\u%04x", byte);
+      for (const char *e = escape; *e; e++) export_writer__write_byte(self, *e);
+    } else {
+      export_writer__write_byte(self, (char)byte);
+    }
+  }
+  export_writer__write_byte(self, '"');
+}
+
+static void export_writer__write_json_record(ExportWriter *self, TSNode node, TSSymbol symbol,
+                                             bool named, uint32_t child_count) {
+  export_writer__reserve(self);
+  self->size += snprintf(&self->buffer[self->size], EXPORT_MAX_RECORD_SIZE, "{\"symbol\":%u,\"type\":", symbol);
+  export_writer__write_json_string(self, ts_language_symbol_name(node.language, symbol));
+  export_writer__reserve(self);
+  self->size += snprintf(
+    &self->buffer[self->size], EXPORT_MAX_RECORD_SIZE,
+    ",\"named\":%s,\"start_byte\":%u,\"end_byte\":%u,\"child_count\":%u}\n",
+    named ? "true" : "false", ts_node_start_byte(node), ts_node_end_byte(node), child_count
+  );
+}
+
+static void export_writer__write_binary_record(ExportWriter *self, TSNode node, TSSymbol symbol,
+                                               bool named, uint32_t child_count) {
+  export_writer__reserve(self);
+  uint32_t start_byte = ts_node_start_byte(node);
+  export_writer__write_varint(self, symbol);
+  export_writer__write_varint(self, named);
+  export_writer__write_varint(self, start_byte);
+  export_writer__write_varint(self, ts_node_end_byte(node) - start_byte);
+  export_writer__write_varint(self, child_count);
+}
+
+void ts_node_export(TSNode self, TSExportFormat format, TSWriteCallback callback, void *payload) {
+  if (!self.data) return;
+
+  ExportWriter writer;
+  writer.callback = callback;
+  writer.payload = payload;
+  writer.size = 0;
+
+  TSTreeCursor *cursor = ts_tree_cursor_new(self);
+  bool is_done = false;
+  while (!is_done) {
+    TSNode node = ts_tree_cursor_current_node(cursor);
+    TSSymbol symbol = ts_node_symbol(node);
+    bool named = ts_node_is_named(node);
+    uint32_t child_count = ts_node_child_count(node);
+    if (format == TSExportFormatBinary) {
+      export_writer__write_binary_record(&writer, node, symbol, named, child_count);
+    } else {
+      export_writer__write_json_record(&writer, node, symbol, named, child_count);
+    }
+
+    if (ts_tree_cursor_goto_first_child(cursor)) continue;
+    while (!ts_tree_cursor_goto_next_sibling(cursor)) {
+      if (!ts_tree_cursor_goto_parent(cursor)) {
+        is_done = true;
+        break;
+      }
+    }
+  }
+
+  ts_tree_cursor_delete(cursor);
+  export_writer__flush(&writer);
+}
@@ -0,0 +1,376 @@
+#include "runtime/tree_serialization.h"
+#include "runtime/alloc.h"
+#include "runtime/array.h"
+#include "runtime/language.h"
+#include <string.h>
+
+// A serialized tree starts with a header that identifies the format and the
+// language and gives the number of records, followed by one record for each
+// tree, in post-order. Every number
+// is written as a LEB128 varint, and signed numbers are zigzag-encoded first.
+// Only the fields that a parent can't recompute from its children are stored,
+// so a node's record has no positions, and each node is rebuilt from the
+// records that precede it, just as the parser builds it during a reduction.
+// Fields that usually have a predictable value are only written when they
+// don't, which is recorded in the flags.
+
+static const char SERIALIZATION_MAGIC[4] = {'T', 'S', 'T', 'R'};
+static const uint32_t SERIALIZATION_FORMAT_VERSION = 2;
+
+enum {
+  SerializedTreeExtra = 1 << 0,
+  SerializedTreeFragileLeft = 1 << 1,
+  SerializedTreeFragileRight = 1 << 2,
+  SerializedTreeHasChanges = 1 << 3,
+  SerializedTreeHasDynamicPrecedence = 1 << 4,
+  SerializedTreeHasErrorCost = 1 << 5,
+  SerializedTreeIsMissing = 1 << 6,
+  SerializedTreeHasExternalTokens = 1 << 7,
+  SerializedTreeHasOwnVisibility = 1 << 8,
+  SerializedTreeHasOwnLexMode = 1 << 9,
+  SerializedTreeIsOpaque = 1 << 10,
+  SerializedTreeIsCompactError = 1 << 11,
+};
+
+typedef Array(char) ByteArray;
+
+typedef struct {
+  const Tree *tree;
+  uint32_t child_index;
+} SerializationEntry;
+
+typedef struct {
+  const char *cursor;
+  const char *end;
+  bool has_error;
+  uint32_t record_count;
+  uint32_t alias_sequence_count;
+  const TSExternalTokenState *last_external_token_state;
+} Deserializer;
+
+// A leaf's lex mode is normally the one for the state in which it was lexed.
+static bool tree_serialization__has_own_lex_mode(const Tree *tree, const TSLanguage *language) {
+  if (tree->parse_state >= language->state_count) return true;
+  TSLexMode lex_mode = ts_language_lex_mode(language, tree->parse_state);
+  return
+    tree->first_leaf.lex_mode.lex_state != lex_mode.lex_state ||
+    tree->first_leaf.lex_mode.external_lex_state != lex_mode.external_lex_state;
+}
+
+static void serializer__write_varint(ByteArray *self, uint32_t value) {
+  while (value >= 0x80) {
+    array_push(self, (char)(value | 0x80));
+    value >>= 7;
+  }
+  array_push(self, (char)value);
+}
+
+static void serializer__write_signed_varint(ByteArray *self, int32_t value) {
+  serializer__write_varint(self, ((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+}
+
+// The column is omitted when the length spans no lines and its column count
+// matches its byte count, as it does for ASCII text.
+static void serializer__write_length(ByteArray *self, Length length) {
+  bool has_own_column = length.extent.row > 0 || length.extent.column != length.bytes;
+  serializer__write_varint(self, length.bytes);
+  serializer__write_varint(self, length.extent.row << 1 | has_own_column);
+  if (has_own_column) serializer__write_varint(self, length.extent.column);
+}
+
+static void serializer__write_header(ByteArray *self, uint32_t record_count, const TSLanguage *language) {
+  for (unsigned i = 0; i < sizeof(SERIALIZATION_MAGIC); i++) {
+    array_push(self, SERIALIZATION_MAGIC[i]);
+  }
+  serializer__write_varint(self, SERIALIZATION_FORMAT_VERSION);
+  serializer__write_varint(self, language->symbol_count);
+  serializer__write_varint(self, language->alias_count);
+  serializer__write_varint(self, language->token_count);
+  serializer__write_varint(self, language->external_token_count);
+  serializer__write_varint(self, language->state_count);
+  serializer__write_varint(self, record_count);
+}
+
+static void serializer__write_tree(ByteArray *self, const Tree *tree, const TSLanguage *language) {
+  TSSymbolMetadata metadata = ts_language_symbol_metadata(language, tree->symbol);
+  bool is_leaf = tree->children.size == 0;
+  uint32_t flags = 0;
+  if (tree->extra) flags |= SerializedTreeExtra;
+  if (tree->fragile_left) flags |= SerializedTreeFragileLeft;
+  if (tree->fragile_right) flags |= SerializedTreeFragileRight;
+  if (tree->has_changes) flags |= SerializedTreeHasChanges;
+  if (tree->dynamic_precedence != 0) flags |= SerializedTreeHasDynamicPrecedence;
+  if (is_leaf && tree->error_cost != 0) flags |= SerializedTreeHasErrorCost;
+  if (tree->is_missing) flags |= SerializedTreeIsMissing;
+  if (tree->is_opaque) flags |= SerializedTreeIsOpaque;
+  if (tree->is_compact_error) flags |= SerializedTreeIsCompactError;
+  if (is_leaf && tree->has_external_tokens) flags |= SerializedTreeHasExternalTokens;
+  if (tree->visible != metadata.visible || tree->named != metadata.named) {
+    flags |= SerializedTreeHasOwnVisibility;
+  }
+  if (is_leaf && tree_serialization__has_own_lex_mode(tree, language)) {
+    flags |= SerializedTreeHasOwnLexMode;
+  }
+
+  // The parse state is offset by one so that `TS_TREE_STATE_NONE` takes up a
+  // single byte.
+  serializer__write_varint(self, tree->children.size);
+  serializer__write_varint(self, tree->symbol);
+  serializer__write_varint(self, flags);
+  serializer__write_varint(self, (TSStateId)(tree->parse_state + 1));
+  if (flags & SerializedTreeHasDynamicPrecedence) {
+    serializer__write_signed_varint(self, tree->dynamic_precedence);
+  }
+  if (flags & SerializedTreeHasOwnVisibility) {
+    serializer__write_varint(self, tree->visible | tree->named << 1);
+  }
+
+  if (!is_leaf) {
+    serializer__write_varint(self, tree->alias_sequence_id);
+    return;
+  }
+
+  serializer__write_length(self, tree->padding);
+  serializer__write_length(self, tree->size);
+  serializer__write_signed_varint(self, (int32_t)(tree->bytes_scanned - ts_tree_total_bytes(tree)));
+  if (flags & SerializedTreeHasErrorCost) {
+    serializer__write_varint(self, tree->error_cost);
+  }
+  if (flags & SerializedTreeHasOwnLexMode) {
+    serializer__write_varint(self, tree->first_leaf.lex_mode.lex_state);
+    serializer__write_varint(self, tree->first_leaf.lex_mode.external_lex_state);
+  }
+  if (flags & SerializedTreeIsOpaque) {
+    serializer__write_varint(self, tree->first_leaf.symbol);
+  }
+
+  if (flags & SerializedTreeHasExternalTokens) {
+    uint32_t length = tree->external_token_state.length;
+    const char *data = ts_external_token_state_data(&tree->external_token_state);
+    serializer__write_varint(self, length);
+    for (uint32_t i = 0; i < length; i++) array_push(self, data[i]);
+  } else if (tree->symbol == ts_builtin_sym_error) {
+    serializer__write_signed_varint(self, tree->lookahead_char);
+  }
+}
+
+char *ts_tree_serialize(const Tree *self, const TSLanguage *language, uint32_t *length) {
+  ByteArray bytes = array_new();
+  uint32_t record_count = 0;
+  Array(SerializationEntry) stack = array_new();
+  array_push(&stack, ((SerializationEntry){self, 0}));
+  while (stack.size > 0) {
+    SerializationEntry *entry = array_back(&stack);
+    const Tree *tree = entry->tree;
+    if (entry->child_index < tree->children.size) {
+      const Tree *child = tree->children.contents[entry->child_index++];
+      array_push(&stack, ((SerializationEntry){child, 0}));
+    } else {
+      serializer__write_tree(&bytes, tree, language);
+      record_count++;
+      stack.size--;
+    }
+  }
+  array_delete(&stack);
+
+  // The header is written once the records have been counted.
+  ByteArray header = array_new();
+  serializer__write_header(&header, record_count, language);
+  array_splice(&bytes, 0, 0, &header);
+  array_delete(&header);
+
+  *length = bytes.size;
+  return bytes.contents;
+}
+
+static uint32_t deserializer__read_varint(Deserializer *self) {
+  uint32_t result = 0;
+  for (unsigned shift = 0; shift < 32; shift += 7) {
+    if (self->cursor == self->end) break;
+    uint8_t byte = (uint8_t)*(self->cursor++);
+    result |= (uint32_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) return result;
+  }
+  self->has_error = true;
+  return 0;
+}
+
+static int32_t deserializer__read_signed_varint(Deserializer *self) {
+  uint32_t value = deserializer__read_varint(self);
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static Length deserializer__read_length(Deserializer *self) {
+  Length result;
+  result.bytes = deserializer__read_varint(self);
+  uint32_t row = deserializer__read_varint(self);
+  result.extent.row = row >> 1;
+  result.extent.column = (row & 1) ? deserializer__read_varint(self) : result.bytes;
+  return result;
+}
+
+static bool deserializer__read_header(Deserializer *self, const TSLanguage *language) {
+  if ((size_t)(self->end - self->cursor) < sizeof(SERIALIZATION_MAGIC)) return false;
+  if (memcmp(self->cursor, SERIALIZATION_MAGIC, sizeof(SERIALIZATION_MAGIC)) != 0) return false;
+  self->cursor += sizeof(SERIALIZATION_MAGIC);
+  bool matches_language =
+    deserializer__read_varint(self) == SERIALIZATION_FORMAT_VERSION &&
+    deserializer__read_varint(self) == language->symbol_count &&
+    deserializer__read_varint(self) == language->alias_count &&
+    deserializer__read_varint(self) == language->token_count &&
+    deserializer__read_varint(self) == language->external_token_count &&
+    deserializer__read_varint(self) == language->state_count;
+  if (!matches_language) return false;
+  self->record_count = deserializer__read_varint(self);
+  return !self->has_error;
+}
+
+// The number of alias sequences isn't stored in the language, so it is found
+// from the reduce actions, which are the only ones that refer to them. Their
+// lookahead symbols are always tokens. This is only done once a record with an
+// alias sequence is read.
+static uint32_t deserializer__alias_sequence_count(Deserializer *self, const TSLanguage *language) {
+  if (self->alias_sequence_count > 0) return self->alias_sequence_count;
+  uint32_t result = 1;
+  for (TSStateId state = 1; state < language->state_count; state++) {
+    for (TSSymbol symbol = 0; symbol < language->token_count; symbol++) {
+      uint32_t count;
+      const TSParseAction *actions = ts_language_actions(language, state, symbol, &count);
+      for (uint32_t i = 0; i < count; i++) {
+        if (actions[i].type == TSParseActionTypeReduce && actions[i].params.alias_sequence_id >= result) {
+          result = actions[i].params.alias_sequence_id + 1;
+        }
+      }
+    }
+  }
+  self->alias_sequence_count = result;
+  return result;
+}
+
+// Read one record, taking a node's children from the top of the stack.
+static Tree *deserializer__read_tree(Deserializer *self, TreePool *pool, TreeArray *stack,
+                                     const TSLanguage *language) {
+  uint32_t child_count = deserializer__read_varint(self);
+  uint32_t symbol = deserializer__read_varint(self);
+  uint32_t flags = deserializer__read_varint(self);
+  TSStateId parse_state = (TSStateId)(deserializer__read_varint(self) - 1);
+  int32_t dynamic_precedence = 0;
+  if (flags & SerializedTreeHasDynamicPrecedence) {
+    dynamic_precedence = deserializer__read_signed_varint(self);
+  }
+  uint32_t visibility = 0;
+  if (flags & SerializedTreeHasOwnVisibility) {
+    visibility = deserializer__read_varint(self);
+  }
+  if (self->has_error || child_count > stack->size || symbol > UINT16_MAX) return NULL;
+  if (symbol >= language->symbol_count &&
+      symbol != ts_builtin_sym_error &&
+      symbol != ts_builtin_sym_error_repeat) return NULL;
+
+  Tree *result;
+  if (child_count > 0) {
+    uint32_t alias_sequence_id = deserializer__read_varint(self);
+    if (self->has_error) return NULL;
+    if (alias_sequence_id > 0 &&
+        (language->max_alias_sequence_length == 0 ||
+         alias_sequence_id >= deserializer__alias_sequence_count(self, language))) return NULL;
+    TreeArray children = array_new();
+    array_reserve(&children, child_count);
+    memcpy(children.contents, stack->contents + stack->size - child_count, child_count * sizeof(Tree *));
+    children.size = child_count;
+    stack->size -= child_count;
+    result = ts_tree_make_node(pool, symbol, &children, alias_sequence_id, language);
+  } else {
+    Length padding = deserializer__read_length(self);
+    Length size = deserializer__read_length(self);
+    int32_t bytes_scanned = deserializer__read_signed_varint(self);
+    uint32_t error_cost = 0;
+    if (flags & SerializedTreeHasErrorCost) {
+      error_cost = deserializer__read_varint(self);
+    }
+    TSLexMode lex_mode = {0, 0};
+    if (flags & SerializedTreeHasOwnLexMode) {
+      lex_mode.lex_state = deserializer__read_varint(self);
+      lex_mode.external_lex_state = deserializer__read_varint(self);
+    } else if (parse_state < language->state_count) {
+      lex_mode = ts_language_lex_mode(language, parse_state);
+    } else {
+      return NULL;
+    }
+
+    // An opaque node's first leaf is the token that opened its region.
+    uint32_t first_leaf_symbol = symbol;
+    if (flags & SerializedTreeIsOpaque) {
+      first_leaf_symbol = deserializer__read_varint(self);
+      if (first_leaf_symbol >= language->token_count) return NULL;
+    }
+    if (self->has_error) return NULL;
+
+    result = ts_tree_make_leaf(pool, symbol, padding, size, language);
+    result->bytes_scanned = (uint32_t)bytes_scanned + ts_tree_total_bytes(result);
+    result->error_cost = error_cost;
+    result->first_leaf.symbol = first_leaf_symbol;
+    result->first_leaf.lex_mode = lex_mode;
+
+    if (flags & SerializedTreeHasExternalTokens) {
+      uint32_t length = deserializer__read_varint(self);
+      if (self->has_error || length > (size_t)(self->end - self->cursor)) {
+        ts_tree_release(pool, result);
+        return NULL;
+      }
+      ts_external_token_state_intern(
+        &result->external_token_state,
+        self->cursor,
+        length,
+        self->last_external_token_state
+      );
+      self->last_external_token_state = &result->external_token_state;
+      result->has_external_tokens = true;
+      self->cursor += length;
+    } else if (symbol == ts_builtin_sym_error) {
+      result->lookahead_char = deserializer__read_signed_varint(self);
+    }
+  }
+
+  if (flags & SerializedTreeHasOwnVisibility) {
+    result->visible = visibility & 1;
+    result->named = visibility & 2;
+  }
+  result->extra = flags & SerializedTreeExtra;
+  result->fragile_left = flags & SerializedTreeFragileLeft;
+  result->fragile_right = flags & SerializedTreeFragileRight;
+  result->has_changes = flags & SerializedTreeHasChanges;
+  result->is_missing = flags & SerializedTreeIsMissing;
+  result->is_opaque = flags & SerializedTreeIsOpaque;
+  result->is_compact_error = flags & SerializedTreeIsCompactError;
+  result->parse_state = parse_state;
+  result->dynamic_precedence = dynamic_precedence;
+  return result;
+}
+
+Tree *ts_tree_deserialize(TreePool *pool, const char *data, uint32_t length,
+                          const TSLanguage *language) {
+  Deserializer deserializer = {data, data + length, false, 0, 0, NULL};
+  if (!deserializer__read_header(&deserializer, language)) return NULL;
+
+  // A buffer that was cut short after a complete subtree would otherwise be
+  // read as a smaller tree.
+  TreeArray stack = array_new();
+  uint32_t record_count = 0;
+  while (deserializer.cursor < deserializer.end && record_count < deserializer.record_count) {
+    Tree *tree = deserializer__read_tree(&deserializer, pool, &stack, language);
+    if (!tree) break;
+    array_push(&stack, tree);
+    record_count++;
+  }
+
+  if (deserializer.cursor != deserializer.end || deserializer.has_error || stack.size != 1 ||
+      record_count != deserializer.record_count) {
+    ts_tree_array_delete(pool, &stack);
+    return NULL;
+  }
+
+  Tree *result = stack.contents[0];
+  array_delete(&stack);
+  return result;
+}
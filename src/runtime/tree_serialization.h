@@ -0,0 +1,22 @@
+#ifndef RUNTIME_TREE_SERIALIZATION_H_
+#define RUNTIME_TREE_SERIALIZATION_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "runtime/tree.h"
+
+// Write the tree in a compact binary format that doesn't depend on where the
+// trees are stored in memory. The result must be freed by the caller.
+char *ts_tree_serialize(const Tree *, const TSLanguage *, uint32_t *length);
+
+// Rebuild a tree that was written by `ts_tree_serialize`. Returns NULL if the
+// data is malformed or was written for a different language.
+Tree *ts_tree_deserialize(TreePool *, const char *data, uint32_t length, const TSLanguage *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // RUNTIME_TREE_SERIALIZATION_H_
@@ -1,3 +1,4 @@
+#include <string.h>
 #include "runtime/utf16.h"
 
 int utf16_iterate(const uint8_t *string, size_t length, int32_t *code_point) {
@@ -27,3 +28,26 @@ int utf16_iterate(const uint8_t *string, size_t length, int32_t *code_point) {
   *code_point = -1;
   return 2;
 }
+
+size_t utf16_scan_non_surrogates(const uint8_t *string, size_t length) {
+  size_t i = 0;
+
+  // Check four code units at a time. A unit is a surrogate if its top five
+  // bits are 11011, which makes the corresponding lane of `lanes` zero.
+  while (i + sizeof(uint64_t) <= length) {
+    uint64_t word;
+    memcpy(&word, string + i, sizeof(word));
+    uint64_t lanes = (word & 0xf800f800f800f800ull) ^ 0xd800d800d800d800ull;
+    if ((lanes - 0x0001000100010001ull) & ~lanes & 0x8000800080008000ull) break;
+    i += sizeof(word);
+  }
+
+  while (i + 2 <= length) {
+    uint16_t unit;
+    memcpy(&unit, string + i, sizeof(unit));
+    if (unit >= 0xd800 && unit < 0xe000) break;
+    i += 2;
+  }
+
+  return i;
+}
@@ -13,6 +13,11 @@ extern "C" {
 // Returns the number of bytes in `string` that were read.
 int utf16_iterate(const uint8_t *string, size_t length, int32_t *code_point);
 
+// Returns the number of bytes at the start of the given string that consist of
+// code units which aren't surrogates, and so each encode a code point by
+// themselves.
+size_t utf16_scan_non_surrogates(const uint8_t *string, size_t length);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,77 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "runtime/work_range.h"
+
+#ifndef _WIN32
+#define work_range__lock(self) pthread_mutex_lock(&(self)->lock)
+#define work_range__unlock(self) pthread_mutex_unlock(&(self)->lock)
+#else
+#define work_range__lock(self)
+#define work_range__unlock(self)
+#endif
+
+void work_range_init(WorkRange *self, uint32_t start, uint32_t end) {
+  self->next = start;
+  self->end = end;
+#ifndef _WIN32
+  pthread_mutex_init(&self->lock, NULL);
+#endif
+}
+
+void work_range_delete(WorkRange *self) {
+#ifndef _WIN32
+  pthread_mutex_destroy(&self->lock);
+#endif
+}
+
+bool work_range_take(WorkRange *self, uint32_t *index) {
+  work_range__lock(self);
+  bool result = self->next < self->end;
+  if (result) *index = self->next++;
+  work_range__unlock(self);
+  return result;
+}
+
+static uint32_t work_range__remaining_count(WorkRange *self) {
+  work_range__lock(self);
+  uint32_t result = self->end - self->next;
+  work_range__unlock(self);
+  return result;
+}
+
+// Move the back half of the largest of the other ranges to this one. The
+// chosen range may have shrunk by the time that it is split, in which case the
+// search starts over. Only one range's lock is held at a time, so that two
+// workers that try to steal from each other can't deadlock.
+bool work_range_steal(WorkRange *self, WorkRange *ranges, uint32_t range_count) {
+  for (;;) {
+    WorkRange *victim = NULL;
+    uint32_t victim_size = 0;
+    for (uint32_t i = 0; i < range_count; i++) {
+      WorkRange *range = &ranges[i];
+      if (range == self) continue;
+      uint32_t size = work_range__remaining_count(range);
+      if (size > victim_size) {
+        victim = range;
+        victim_size = size;
+      }
+    }
+    if (!victim) return false;
+
+    work_range__lock(victim);
+    uint32_t start = victim->end, end = victim->end;
+    if (victim->end > victim->next) {
+      start = victim->end - (victim->end - victim->next + 1) / 2;
+      victim->end = start;
+    }
+    work_range__unlock(victim);
+
+    if (start < end) {
+      work_range__lock(self);
+      self->next = start;
+      self->end = end;
+      work_range__unlock(self);
+      return true;
+    }
+  }
+}
@@ -0,0 +1,37 @@
+#ifndef RUNTIME_WORK_RANGE_H_
+#define RUNTIME_WORK_RANGE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+// A contiguous range of the indices of work items, which are dealt out to a
+// fixed set of workers. A worker takes items from the front of its own range,
+// and once that is empty, steals the back half of the largest range that
+// remains, so that workers that are given small items don't sit idle while
+// others work through large ones.
+typedef struct {
+  uint32_t next;
+  uint32_t end;
+#ifndef _WIN32
+  pthread_mutex_t lock;
+#endif
+} WorkRange;
+
+void work_range_init(WorkRange *, uint32_t start, uint32_t end);
+void work_range_delete(WorkRange *);
+bool work_range_take(WorkRange *, uint32_t *index);
+bool work_range_steal(WorkRange *, WorkRange *ranges, uint32_t range_count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // RUNTIME_WORK_RANGE_H_
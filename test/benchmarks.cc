@@ -1,12 +1,27 @@
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <map>
+#include <random>
+#include <unordered_map>
 #include <vector>
-#include <ctime>
 #include <string>
 #include "tree_sitter/runtime.h"
+#include "tree_sitter/parser.h"
+#include "runtime/alloc.h"
+#include "runtime/document.h"
+#include "runtime/get_changed_ranges.h"
+#include "runtime/tree.h"
+#include "helpers/benchmark_helpers.h"
+#include "helpers/file_helpers.h"
 #include "helpers/load_language.h"
+#include "helpers/perf_counters.h"
 #include "helpers/stderr_logger.h"
 #include "helpers/read_test_entries.h"
+#include "helpers/spy_input.h"
 
 using std::map;
 using std::vector;
@@ -20,28 +35,885 @@ vector<string> language_names({
   "bash",
 });
 
-size_t mean(const vector<size_t> &values) {
+// Each example is parsed a number of times before it's measured, so that the
+// tree pool and the caches have warmed up, and then a number of times while
+// measuring the wall-clock time of each parse. When hardware counters are
+// requested, they are summed over the measured parses.
+struct ExampleResult {
+  string file_name;
+  size_t byte_count;
+  bool has_errors;
+  vector<double> durations;
+  PerfCounterValues counters;
+};
+
+// Each example is also edited the way that it would be in an editor, by
+// typing a line one character at a time, deleting it again, pasting a block
+// of text and undoing the paste. For each keystroke, the time taken to edit
+// and reparse the document, and the time taken to compute the changed ranges,
+// are measured separately, along with the fraction of the text that was
+// covered by reused subtrees.
+struct EditExampleResult {
+  string file_name;
+  size_t byte_count;
+  vector<double> parse_durations;
+  vector<double> changed_range_durations;
+  vector<double> reused_fractions;
+};
+
+// Each example is also parsed by a new document while the runtime's
+// allocator is replaced with one that counts the bytes that are live. The
+// live bytes after the parse include everything that the document holds on
+// to, such as the parser's stack and the tree pool's free nodes.
+struct MemoryExampleResult {
+  string file_name;
+  size_t byte_count;
+  size_t peak_bytes;
+  size_t live_bytes;
+  size_t allocation_count;
+  size_t tree_bytes;
+  size_t node_count;
+};
+
+// The inputs that the slow-input fuzzer has found are parsed as well, and
+// the work that each one takes is reported per byte, so that a change that
+// makes one of them superlinear again is noticed.
+struct PathologicalExampleResult {
+  string file_name;
+  size_t byte_count;
+  vector<double> durations;
+  uint64_t operation_count;
+  uint32_t recovery_step_count;
+  uint32_t max_summary_depth;
+  uint32_t max_version_count;
+};
+
+// Inputs that lean on a language's external scanner, such as deeply indented
+// Python and Bash with many heredocs, are generated and parsed as well. Their
+// durations are measured without profiling, and then one more parse is
+// profiled, to break down how its time was spent inside the scanner's
+// callbacks.
+struct ScannerExampleResult {
+  string file_name;
+  size_t byte_count;
+  vector<double> durations;
+  TSParseProfile profile;
+};
+
+struct LanguageResult {
+  string name;
+  size_t parse_table_size;
+  size_t dense_parse_table_size;
+  vector<ExampleResult> examples;
+  vector<EditExampleResult> edit_examples;
+  vector<MemoryExampleResult> memory_examples;
+  vector<PathologicalExampleResult> pathological_examples;
+  vector<ScannerExampleResult> scanner_examples;
+};
+
+// Blocks that were allocated before the recorder was installed are passed
+// through to libc when they are reallocated or freed.
+struct AllocationRecorder {
+  std::unordered_map<void *, size_t> sizes;
+  size_t live_bytes;
+  size_t peak_bytes;
+  size_t allocation_count;
+
+  void *record(void *pointer, size_t size) {
+    if (!pointer) return pointer;
+    sizes[pointer] = size;
+    live_bytes += size;
+    allocation_count++;
+    if (live_bytes > peak_bytes) peak_bytes = live_bytes;
+    return pointer;
+  }
+
+  void forget(void *pointer) {
+    auto entry = sizes.find(pointer);
+    if (entry == sizes.end()) return;
+    live_bytes -= entry->second;
+    sizes.erase(entry);
+  }
+};
+
+void *recording_malloc(void *payload, size_t size) {
+  return static_cast<AllocationRecorder *>(payload)->record(malloc(size), size);
+}
+
+void *recording_calloc(void *payload, size_t count, size_t size) {
+  return static_cast<AllocationRecorder *>(payload)->record(calloc(count, size), count * size);
+}
+
+void *recording_realloc(void *payload, void *buffer, size_t size) {
+  auto recorder = static_cast<AllocationRecorder *>(payload);
+  recorder->forget(buffer);
+  return recorder->record(realloc(buffer, size), size);
+}
+
+void recording_free(void *payload, void *buffer) {
+  static_cast<AllocationRecorder *>(payload)->forget(buffer);
+  free(buffer);
+}
+
+double mean(const vector<double> &values) {
   if (values.empty()) return 0;
-  size_t result = 0;
-  for (size_t value : values) {
+  double result = 0;
+  for (double value : values) {
     result += value;
   }
   return result / values.size();
 }
 
-size_t min(const vector<size_t> &values) {
-  size_t result = 0;
-  for (unsigned i = 0; i < values.size(); i++) {
-    size_t value = values[i];
-    if (i == 0 || value < result) result = value;
+// The speed of an example is based on its median parse time.
+double speed(const ExampleResult &example) {
+  double duration = percentile(example.durations, 0.5);
+  return duration > 0 ? example.byte_count / duration : 0;
+}
+
+vector<double> speeds(const vector<LanguageResult> &languages, bool has_errors) {
+  vector<double> result;
+  for (auto &language : languages) {
+    for (auto &example : language.examples) {
+      if (example.has_errors == has_errors) result.push_back(speed(example));
+    }
+  }
+  return result;
+}
+
+// The counters are read outside of the timed section, so that reading them
+// doesn't add to the durations.
+ExampleResult measure_example(TSDocument *document, const ExampleEntry &example, bool has_errors,
+                              unsigned warmup_run_count, unsigned run_count,
+                              PerfCounters *perf_counters) {
+  ExampleResult result{example.file_name, example.input.size(), has_errors, {}, {}};
+  for (unsigned j = 0; j < PerfCounterCount; j++) result.counters.available[j] = perf_counters;
+  for (unsigned i = 0; i < warmup_run_count + run_count; i++) {
+    ts_document_invalidate(document);
+    ts_document_set_input_string(document, example.input.c_str());
+
+    if (perf_counters) perf_counters->start();
+    auto start_time = std::chrono::steady_clock::now();
+    ts_document_parse(document);
+    auto end_time = std::chrono::steady_clock::now();
+    PerfCounterValues counters = perf_counters ? perf_counters->stop() : PerfCounterValues{};
+
+    if (!has_errors) assert(!ts_node_has_error(ts_document_root_node(document)));
+    if (i >= warmup_run_count) {
+      result.durations.push_back(std::chrono::duration<double, std::milli>(end_time - start_time).count());
+      for (unsigned j = 0; j < PerfCounterCount; j++) {
+        result.counters.values[j] += counters.values[j];
+        result.counters.available[j] = result.counters.available[j] && counters.available[j];
+      }
+    }
+  }
+  return result;
+}
+
+bool has_counter(const ExampleResult &example, PerfCounter counter) {
+  return example.counters.available[counter];
+}
+
+// The number of events for every kilobyte parsed.
+double counter_per_kilobyte(const ExampleResult &example, PerfCounter counter) {
+  size_t byte_count = example.byte_count * example.durations.size();
+  return byte_count > 0 ? example.counters.values[counter] * 1024.0 / byte_count : 0;
+}
+
+double instructions_per_cycle(const ExampleResult &example) {
+  uint64_t cycles = example.counters.values[PerfCounterCycles];
+  return cycles > 0 ? static_cast<double>(example.counters.values[PerfCounterInstructions]) / cycles : 0;
+}
+
+void replay_edit(TSDocument *document, SpyInput &input, TSInputEdit edit, TreePath *path1,
+                 TreePath *path2, EditExampleResult &result) {
+  input.clear();
+  auto start_time = std::chrono::steady_clock::now();
+  ts_document_edit(document, edit);
+  Tree *old_tree = document->tree;
+  if (old_tree) ts_tree_retain(old_tree);
+  ts_document_parse(document);
+  auto parse_end_time = std::chrono::steady_clock::now();
+
+  if (old_tree) {
+    TSRange *ranges = nullptr;
+    ts_tree_get_changed_ranges(old_tree, document->tree, path1, path2, document->language, &ranges);
+    ts_free(ranges);
+    ts_tree_release(document->tree_pool, old_tree);
+  }
+  auto end_time = std::chrono::steady_clock::now();
+
+  result.parse_durations.push_back(
+    std::chrono::duration<double, std::milli>(parse_end_time - start_time).count());
+  result.changed_range_durations.push_back(
+    std::chrono::duration<double, std::milli>(end_time - parse_end_time).count());
+  size_t byte_count = input.content.size();
+  result.reused_fractions.push_back(
+    byte_count > 0 ? static_cast<double>(ts_document_parse_stats(document).reused_byte_count) / byte_count : 0);
+}
+
+// The edits are chosen with a fixed seed, so that every run replays the same
+// keystrokes.
+EditExampleResult measure_example_edits(TSDocument *document, const ExampleEntry &example,
+                                        unsigned session_count) {
+  EditExampleResult result{example.file_name, example.input.size(), {}, {}, {}};
+  SpyInput input(example.input, 1024);
+  ts_document_invalidate(document);
+  ts_document_set_input(document, input.input());
+  ts_document_parse(document);
+
+  TreePath path1 = array_new();
+  TreePath path2 = array_new();
+  std::mt19937 random(0);
+
+  for (unsigned i = 0; i < session_count; i++) {
+    vector<size_t> line_starts({0});
+    for (size_t j = 0; j + 1 < input.content.size(); j++) {
+      if (input.content[j] == '\n') line_starts.push_back(j + 1);
+    }
+    auto random_line_start = [&]() {
+      return line_starts[random() % line_starts.size()];
+    };
+
+    size_t position = random_line_start();
+    size_t source_start = random_line_start();
+    size_t source_end = input.content.find('\n', source_start);
+    if (source_end == string::npos) source_end = input.content.size();
+    string line = input.content.substr(source_start, std::min<size_t>(source_end - source_start, 40)) + "\n";
+
+    for (size_t j = 0; j < line.size(); j++) {
+      replay_edit(document, input, input.replace(position + j, 0, line.substr(j, 1)), &path1, &path2, result);
+    }
+    for (size_t j = line.size(); j > 0; j--) {
+      replay_edit(document, input, input.replace(position + j - 1, 1, ""), &path1, &path2, result);
+    }
+
+    size_t paste_start = random_line_start();
+    size_t paste_end = input.content.rfind('\n', paste_start + 1024);
+    if (paste_end == string::npos || paste_end < paste_start) paste_end = paste_start + 1023;
+    string block = input.content.substr(paste_start, paste_end + 1 - paste_start);
+    replay_edit(document, input, input.replace(position, 0, block), &path1, &path2, result);
+    replay_edit(document, input, input.undo(), &path1, &path2, result);
+  }
+
+  array_delete(&path1);
+  array_delete(&path2);
+  ts_document_set_input_string(document, "");
+  return result;
+}
+
+MemoryExampleResult measure_example_memory(const TSLanguage *language, const ExampleEntry &example) {
+  AllocationRecorder recorder{{}, 0, 0, 0};
+  ts_set_allocator({&recorder, recording_malloc, recording_calloc, recording_realloc, recording_free});
+
+  TSDocument *document = ts_document_new();
+  ts_document_set_language(document, language);
+  ts_document_set_input_string(document, example.input.c_str());
+  ts_document_parse(document);
+
+  MemoryExampleResult result{
+    example.file_name,
+    example.input.size(),
+    recorder.peak_bytes,
+    recorder.live_bytes,
+    recorder.allocation_count,
+    ts_document_memory_usage(document).tree_bytes,
+    document->tree ? ts_tree_node_count(document->tree) : 0,
+  };
+
+  ts_document_free(document);
+  ts_set_allocator(TSAllocator{});
+  return result;
+}
+
+// The operations are counted the same way as by the slow-input fuzzer.
+PathologicalExampleResult measure_pathological_example(TSDocument *document, const ExampleEntry &example,
+                                                       unsigned run_count) {
+  PathologicalExampleResult result{example.file_name, example.input.size(), {}, 0, 0, 0, 0};
+  TSParseOptions options = {};
+  options.enable_profiling = true;
+
+  for (unsigned i = 0; i < run_count; i++) {
+    ts_document_invalidate(document);
+    ts_document_set_input_string_with_length(document, example.input.c_str(), example.input.size());
+    auto start_time = std::chrono::steady_clock::now();
+    ts_document_parse_with_options(document, options);
+    auto end_time = std::chrono::steady_clock::now();
+    result.durations.push_back(std::chrono::duration<double, std::milli>(end_time - start_time).count());
+  }
+
+  TSParseStats stats = ts_document_parse_stats(document);
+  TSParseProfile profile = ts_document_parse_profile(document);
+  result.operation_count =
+    stats.lexed_token_count + stats.recovery_step_count + profile.step_count + profile.total_version_count;
+  result.recovery_step_count = stats.recovery_step_count;
+  result.max_summary_depth = stats.max_summary_depth;
+  result.max_version_count = profile.max_version_count;
+  ts_document_set_input_string(document, "");
+  return result;
+}
+
+const size_t SCANNER_EXAMPLE_SIZE = 64 * 1024;
+
+// Blocks nested up to eight levels deep, with blank lines and comments at
+// other indentation levels, and dedents of several levels at once.
+string indented_python_input() {
+  string result;
+  for (unsigned i = 0; result.size() < SCANNER_EXAMPLE_SIZE; i++) {
+    unsigned depth = 1 + i % 8;
+    result += "def function_" + std::to_string(i) + "(a, b):\n";
+    for (unsigned level = 1; level <= depth; level++) {
+      string indent(level * 4, ' ');
+      result += indent + "value = a + " + std::to_string(level) + "\n";
+      result += "\n";
+      result += string((level - 1) * 4, ' ') + "# level " + std::to_string(level) + "\n";
+      result += indent + (level % 2 ? "if value > b:\n" : "for item in b:\n");
+    }
+    result += string((depth + 1) * 4, ' ') + "return (a,\n  b)\n";
+    result += "\n";
+  }
+  return result;
+}
+
+string heredoc_bash_input() {
+  string result;
+  for (unsigned i = 0; result.size() < SCANNER_EXAMPLE_SIZE; i++) {
+    string delimiter = "END_" + std::to_string(i % 16);
+    result += "cat <<" + delimiter + " > file_" + std::to_string(i) + "\n";
+    result += "  value: ${value_" + std::to_string(i) + "}\n";
+    result += "  command: $(echo " + std::to_string(i) + ")\n";
+    result += delimiter + "\n";
+    result += "cat <<-'" + delimiter + "'\n";
+    result += "\tliteral $value\n";
+    result += "\t" + delimiter + "\n";
+    result += "echo done_" + std::to_string(i) + "\n\n";
+  }
+  return result;
+}
+
+vector<ExampleEntry> scanner_inputs_for_language(const string &language_name) {
+  if (language_name == "python") return {{"indentation.py", indented_python_input()}};
+  if (language_name == "bash") return {{"heredocs.sh", heredoc_bash_input()}};
+  return {};
+}
+
+ScannerExampleResult measure_scanner_example(TSDocument *document, const ExampleEntry &example,
+                                             unsigned warmup_run_count, unsigned run_count) {
+  ScannerExampleResult result{example.file_name, example.input.size(), {}, {}};
+  for (unsigned i = 0; i < warmup_run_count + run_count; i++) {
+    ts_document_invalidate(document);
+    ts_document_set_input_string_with_length(document, example.input.c_str(), example.input.size());
+    auto start_time = std::chrono::steady_clock::now();
+    ts_document_parse(document);
+    auto end_time = std::chrono::steady_clock::now();
+    if (i >= warmup_run_count) {
+      result.durations.push_back(std::chrono::duration<double, std::milli>(end_time - start_time).count());
+    }
+  }
+
+  TSParseOptions options = {};
+  options.enable_profiling = true;
+  ts_document_invalidate(document);
+  ts_document_set_input_string_with_length(document, example.input.c_str(), example.input.size());
+  ts_document_parse_with_options(document, options);
+  result.profile = ts_document_parse_profile(document);
+  ts_document_set_input_string(document, "");
+  return result;
+}
+
+// The phases measured around the main loop's calls don't overlap, so their
+// sum is the profiled parse's total time. The scanner's phases are nested
+// inside of lexing.
+uint64_t profiled_micros(const TSParseProfile &profile) {
+  return profile.lex.micros + profile.shift.micros + profile.reduce.micros +
+    profile.recover.micros + profile.condense.micros;
+}
+
+double phase_percentage(const TSParseProfile &profile, const TSParsePhaseProfile &phase) {
+  uint64_t total = profiled_micros(profile);
+  return total > 0 ? phase.micros * 100.0 / total : 0;
+}
+
+double per_kilobyte(uint64_t count, size_t byte_count) {
+  return byte_count > 0 ? count * 1024.0 / byte_count : 0;
+}
+
+void print_example(const ExampleResult &example) {
+  printf(
+    "  %-30s\tp50 %.3f ms\tp90 %.3f ms\tp99 %.3f ms\t%.1f bytes/ms\n",
+    example.file_name.c_str(),
+    percentile(example.durations, 0.5),
+    percentile(example.durations, 0.9),
+    percentile(example.durations, 0.99),
+    speed(example)
+  );
+
+  bool has_any_counter = false;
+  for (unsigned i = 0; i < PerfCounterCount; i++) {
+    if (has_counter(example, static_cast<PerfCounter>(i))) has_any_counter = true;
+  }
+  if (!has_any_counter) return;
+  printf("  %-30s", "");
+  if (has_counter(example, PerfCounterInstructions)) {
+    printf("\t%.1f instructions/byte", counter_per_kilobyte(example, PerfCounterInstructions) / 1024);
+  }
+  if (has_counter(example, PerfCounterInstructions) && has_counter(example, PerfCounterCycles)) {
+    printf("\t%.2f IPC", instructions_per_cycle(example));
+  }
+  for (PerfCounter counter : {PerfCounterBranchMisses, PerfCounterL1DataMisses,
+                              PerfCounterLastLevelCacheMisses, PerfCounterPageFaults}) {
+    if (has_counter(example, counter)) {
+      printf("\t%.1f %s/KB", counter_per_kilobyte(example, counter), perf_counter_name(counter));
+    }
+  }
+  printf("\n");
+}
+
+void print_edit_example(const EditExampleResult &example) {
+  printf(
+    "  %-30s\tedit+parse p50 %.3f ms\tp90 %.3f ms\tp99 %.3f ms\tchanged ranges p50 %.3f ms\treused %.1f%%\n",
+    example.file_name.c_str(),
+    percentile(example.parse_durations, 0.5),
+    percentile(example.parse_durations, 0.9),
+    percentile(example.parse_durations, 0.99),
+    percentile(example.changed_range_durations, 0.5),
+    mean(example.reused_fractions) * 100
+  );
+}
+
+void print_memory_example(const MemoryExampleResult &example) {
+  printf(
+    "  %-30s\tpeak %lu bytes\tlive %lu bytes\t%.1f allocations/KB\t%.1f bytes/node\n",
+    example.file_name.c_str(),
+    example.peak_bytes,
+    example.live_bytes,
+    example.allocation_count * 1024.0 / example.byte_count,
+    example.node_count > 0 ? static_cast<double>(example.tree_bytes) / example.node_count : 0
+  );
+}
+
+void print_pathological_example(const PathologicalExampleResult &example) {
+  printf(
+    "  %-30s\tp50 %.3f ms\t%.1f operations/byte\t%u recovery steps\t%u max summary depth\t%u max versions\n",
+    example.file_name.c_str(),
+    percentile(example.durations, 0.5),
+    static_cast<double>(example.operation_count) / example.byte_count,
+    example.recovery_step_count,
+    example.max_summary_depth,
+    example.max_version_count
+  );
+}
+
+void print_scanner_example(const ScannerExampleResult &example) {
+  const TSParseProfile &profile = example.profile;
+  printf(
+    "  %-30s\tp50 %.3f ms\tlex %.1f%%\tscan %.1f%% (%.1f calls/KB)\tserialize %.1f%% (%.1f calls/KB)"
+    "\tdeserialize %.1f%% (%.1f calls/KB)\t%.1f column rescans/KB (%.1f bytes each)\n",
+    example.file_name.c_str(),
+    percentile(example.durations, 0.5),
+    phase_percentage(profile, profile.lex),
+    phase_percentage(profile, profile.external_scan),
+    per_kilobyte(profile.external_scan.count, example.byte_count),
+    phase_percentage(profile, profile.external_serialize),
+    per_kilobyte(profile.external_serialize.count, example.byte_count),
+    phase_percentage(profile, profile.external_deserialize),
+    per_kilobyte(profile.external_deserialize.count, example.byte_count),
+    per_kilobyte(profile.column_rescan_count, example.byte_count),
+    profile.column_rescan_count > 0
+      ? static_cast<double>(profile.column_rescan_byte_count) / profile.column_rescan_count
+      : 0
+  );
+}
+
+void print_speeds(const char *title, const vector<double> &values) {
+  printf("%s\n", title);
+  printf("  %-30s\t%.1f bytes/ms\n", "average speed", mean(values));
+  printf("  %-30s\t%.1f bytes/ms\n", "median speed", percentile(values, 0.5));
+  printf("  %-30s\t%.1f bytes/ms\n", "worst speed", values.empty() ? 0 : *std::min_element(values.begin(), values.end()));
+}
+
+string json_string(const string &value) {
+  string result = "\"";
+  for (char c : value) {
+    if (c == '"' || c == '\\') result += '\\';
+    result += c;
+  }
+  return result + "\"";
+}
+
+void write_json_speeds(FILE *file, const vector<double> &values) {
+  fprintf(
+    file, "{\"average\": %.3f, \"p50\": %.3f, \"worst\": %.3f}",
+    mean(values), percentile(values, 0.5),
+    values.empty() ? 0 : *std::min_element(values.begin(), values.end())
+  );
+}
+
+void write_json(FILE *file, const vector<LanguageResult> &languages, unsigned warmup_run_count,
+                unsigned run_count) {
+  fprintf(file, "{\n  \"warmup_runs\": %u,\n  \"runs\": %u,\n  \"languages\": [", warmup_run_count, run_count);
+  for (size_t i = 0; i < languages.size(); i++) {
+    const LanguageResult &language = languages[i];
+    fprintf(file, "%s\n    {\n", i > 0 ? "," : "");
+    fprintf(file, "      \"name\": %s,\n", json_string(language.name).c_str());
+    fprintf(file, "      \"parse_table_size\": %lu,\n", language.parse_table_size);
+    fprintf(file, "      \"dense_parse_table_size\": %lu,\n", language.dense_parse_table_size);
+    fprintf(file, "      \"examples\": [");
+    for (size_t j = 0; j < language.examples.size(); j++) {
+      const ExampleResult &example = language.examples[j];
+      fprintf(
+        file,
+        "%s\n        {\"file_name\": %s, \"bytes\": %lu, \"has_errors\": %s, "
+        "\"mean_ms\": %.4f, \"p50_ms\": %.4f, \"p90_ms\": %.4f, \"p99_ms\": %.4f, \"bytes_per_ms\": %.3f",
+        j > 0 ? "," : "",
+        json_string(example.file_name).c_str(),
+        example.byte_count,
+        example.has_errors ? "true" : "false",
+        mean(example.durations),
+        percentile(example.durations, 0.5),
+        percentile(example.durations, 0.9),
+        percentile(example.durations, 0.99),
+        speed(example)
+      );
+      for (unsigned k = 0; k < PerfCounterCount; k++) {
+        PerfCounter counter = static_cast<PerfCounter>(k);
+        if (!has_counter(example, counter)) continue;
+        fprintf(
+          file, ", \"%s\": %lu, \"%s_per_kb\": %.3f",
+          perf_counter_name(counter),
+          static_cast<unsigned long>(example.counters.values[counter]),
+          perf_counter_name(counter),
+          counter_per_kilobyte(example, counter)
+        );
+      }
+      if (has_counter(example, PerfCounterInstructions) && has_counter(example, PerfCounterCycles)) {
+        fprintf(file, ", \"ipc\": %.3f", instructions_per_cycle(example));
+      }
+      fprintf(file, "}");
+    }
+    fprintf(file, "\n      ],\n      \"edit_examples\": [");
+    for (size_t j = 0; j < language.edit_examples.size(); j++) {
+      const EditExampleResult &example = language.edit_examples[j];
+      fprintf(
+        file,
+        "%s\n        {\"file_name\": %s, \"bytes\": %lu, \"keystrokes\": %lu, "
+        "\"parse_p50_ms\": %.4f, \"parse_p90_ms\": %.4f, \"parse_p99_ms\": %.4f, "
+        "\"changed_ranges_p50_ms\": %.4f, \"changed_ranges_p99_ms\": %.4f, \"reused_fraction\": %.4f}",
+        j > 0 ? "," : "",
+        json_string(example.file_name).c_str(),
+        example.byte_count,
+        example.parse_durations.size(),
+        percentile(example.parse_durations, 0.5),
+        percentile(example.parse_durations, 0.9),
+        percentile(example.parse_durations, 0.99),
+        percentile(example.changed_range_durations, 0.5),
+        percentile(example.changed_range_durations, 0.99),
+        mean(example.reused_fractions)
+      );
+    }
+    fprintf(file, "\n      ],\n      \"memory_examples\": [");
+    for (size_t j = 0; j < language.memory_examples.size(); j++) {
+      const MemoryExampleResult &example = language.memory_examples[j];
+      fprintf(
+        file,
+        "%s\n        {\"file_name\": %s, \"bytes\": %lu, \"peak_bytes\": %lu, \"live_bytes\": %lu, "
+        "\"allocations\": %lu, \"tree_bytes\": %lu, \"node_count\": %lu}",
+        j > 0 ? "," : "",
+        json_string(example.file_name).c_str(),
+        example.byte_count,
+        example.peak_bytes,
+        example.live_bytes,
+        example.allocation_count,
+        example.tree_bytes,
+        example.node_count
+      );
+    }
+    fprintf(file, "\n      ],\n      \"pathological_examples\": [");
+    for (size_t j = 0; j < language.pathological_examples.size(); j++) {
+      const PathologicalExampleResult &example = language.pathological_examples[j];
+      fprintf(
+        file,
+        "%s\n        {\"file_name\": %s, \"bytes\": %lu, \"p50_ms\": %.4f, \"operations\": %lu, "
+        "\"operations_per_byte\": %.3f, \"recovery_steps\": %u, \"max_summary_depth\": %u, "
+        "\"max_versions\": %u}",
+        j > 0 ? "," : "",
+        json_string(example.file_name).c_str(),
+        example.byte_count,
+        percentile(example.durations, 0.5),
+        static_cast<unsigned long>(example.operation_count),
+        static_cast<double>(example.operation_count) / example.byte_count,
+        example.recovery_step_count,
+        example.max_summary_depth,
+        example.max_version_count
+      );
+    }
+    fprintf(file, "\n      ],\n      \"scanner_examples\": [");
+    for (size_t j = 0; j < language.scanner_examples.size(); j++) {
+      const ScannerExampleResult &example = language.scanner_examples[j];
+      const TSParseProfile &profile = example.profile;
+      fprintf(
+        file,
+        "%s\n        {\"file_name\": %s, \"bytes\": %lu, \"p50_ms\": %.4f, \"profiled_us\": %lu, "
+        "\"lex_us\": %lu, \"scan_us\": %lu, \"scan_calls\": %u, \"serialize_us\": %lu, "
+        "\"serialize_calls\": %u, \"deserialize_us\": %lu, \"deserialize_calls\": %u, "
+        "\"column_rescans\": %u, \"column_rescan_bytes\": %lu}",
+        j > 0 ? "," : "",
+        json_string(example.file_name).c_str(),
+        example.byte_count,
+        percentile(example.durations, 0.5),
+        static_cast<unsigned long>(profiled_micros(profile)),
+        static_cast<unsigned long>(profile.lex.micros),
+        static_cast<unsigned long>(profile.external_scan.micros),
+        profile.external_scan.count,
+        static_cast<unsigned long>(profile.external_serialize.micros),
+        profile.external_serialize.count,
+        static_cast<unsigned long>(profile.external_deserialize.micros),
+        profile.external_deserialize.count,
+        profile.column_rescan_count,
+        static_cast<unsigned long>(profile.column_rescan_byte_count)
+      );
+    }
+    fprintf(file, "\n      ],\n      \"without_errors\": ");
+    write_json_speeds(file, speeds({language}, false));
+    fprintf(file, ",\n      \"with_errors\": ");
+    write_json_speeds(file, speeds({language}, true));
+    fprintf(file, "\n    }");
+  }
+  fprintf(file, "\n  ],\n  \"without_errors\": ");
+  write_json_speeds(file, speeds(languages, false));
+  fprintf(file, ",\n  \"with_errors\": ");
+  write_json_speeds(file, speeds(languages, true));
+  fprintf(file, "\n}\n");
+}
+
+// In loop mode, a single example is parsed over and over, for a number of
+// iterations or seconds, so that a profiler attached to the process sees
+// nothing but steady-state parsing. Only the example's own language is
+// loaded. The iterations alternate between full parses and incremental
+// ones: each pair of incremental parses inserts a line at a random line
+// start and then undoes the insertion, so the text never drifts from the
+// example.
+void run_loop(TSDocument *document, const string &language_name, const ExampleEntry &example,
+              unsigned iteration_count, unsigned duration_seconds) {
+  ts_document_set_language(document, load_real_language(language_name));
+  SpyInput input(example.input, 1024);
+  ts_document_set_input(document, input.input());
+  ts_document_parse(document);
+
+  vector<size_t> line_starts({0});
+  for (size_t i = 0; i + 1 < example.input.size(); i++) {
+    if (example.input[i] == '\n') line_starts.push_back(i + 1);
+  }
+  std::mt19937 random(0);
+  string inserted_line = "x\n";
+
+  printf(
+    "looping over %s (%s, %lu bytes) for %u %s\n",
+    example.file_name.c_str(),
+    language_name.c_str(),
+    example.input.size(),
+    iteration_count > 0 ? iteration_count : duration_seconds,
+    iteration_count > 0 ? "iterations" : "seconds"
+  );
+  fflush(stdout);
+
+  double full_ms = 0, incremental_ms = 0;
+  unsigned full_count = 0, incremental_count = 0;
+  auto loop_start_time = std::chrono::steady_clock::now();
+  for (unsigned i = 0;; i++) {
+    if (iteration_count > 0) {
+      if (i >= iteration_count) break;
+    } else if (std::chrono::steady_clock::now() - loop_start_time >= std::chrono::seconds(duration_seconds)) {
+      break;
+    }
+
+    input.clear();
+    auto start_time = std::chrono::steady_clock::now();
+    switch (i % 4) {
+      case 0:
+      case 2:
+        ts_document_invalidate(document);
+        ts_document_parse(document);
+        break;
+      case 1:
+        ts_document_edit(document, input.replace(line_starts[random() % line_starts.size()], 0, inserted_line));
+        ts_document_parse(document);
+        break;
+      case 3:
+        ts_document_edit(document, input.undo());
+        ts_document_parse(document);
+        break;
+    }
+    double duration = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+    if (i % 2 == 0) {
+      full_ms += duration;
+      full_count++;
+    } else {
+      incremental_ms += duration;
+      incremental_count++;
+    }
+  }
+
+  printf(
+    "  %u full parses\t%.3f ms each\t%.1f bytes/ms\n",
+    full_count,
+    full_count > 0 ? full_ms / full_count : 0,
+    full_ms > 0 ? example.input.size() * full_count / full_ms : 0
+  );
+  printf(
+    "  %u incremental parses\t%.3f ms each\n",
+    incremental_count,
+    incremental_count > 0 ? incremental_ms / incremental_count : 0
+  );
+  ts_document_set_input_string(document, "");
+}
+
+// A baseline file records every measured duration of every example, one
+// example per line, so that a later run can be compared against it.
+const char *BASELINE_HEADER = "# tree-sitter benchmark baseline 1";
+
+string baseline_key(const string &language_name, const ExampleResult &example) {
+  return language_name + "\t" + example.file_name + "\t" + (example.has_errors ? "1" : "0");
+}
+
+void write_baseline(FILE *file, const vector<LanguageResult> &languages) {
+  fprintf(file, "%s\n", BASELINE_HEADER);
+  for (auto &language : languages) {
+    for (auto &example : language.examples) {
+      fprintf(file, "%s\t%lu\t", baseline_key(language.name, example).c_str(), example.byte_count);
+      for (size_t i = 0; i < example.durations.size(); i++) {
+        fprintf(file, "%s%.6f", i > 0 ? " " : "", example.durations[i]);
+      }
+      fprintf(file, "\n");
+    }
+  }
+}
+
+// Returns false if the file isn't a baseline.
+bool read_baseline(const string &content, map<string, vector<double>> *durations_by_key) {
+  size_t line_start = content.find('\n');
+  if (content.compare(0, line_start, BASELINE_HEADER) != 0) return false;
+  while (line_start != string::npos && line_start + 1 < content.size()) {
+    line_start++;
+    size_t line_end = content.find('\n', line_start);
+    string line = content.substr(line_start, line_end == string::npos ? string::npos : line_end - line_start);
+    line_start = line_end;
+
+    size_t durations_start = line.rfind('\t');
+    size_t bytes_start = durations_start == string::npos ? string::npos : line.rfind('\t', durations_start - 1);
+    if (bytes_start == string::npos) return false;
+    vector<double> &durations = (*durations_by_key)[line.substr(0, bytes_start)];
+    const char *cursor = line.c_str() + durations_start + 1;
+    char *end;
+    for (double value = strtod(cursor, &end); end != cursor; value = strtod(cursor, &end)) {
+      durations.push_back(value);
+      cursor = end;
+    }
+  }
+  return true;
+}
+
+// The noise in a median is estimated from the median absolute deviation of
+// the durations, which scales to the standard deviation of normally
+// distributed values, and the standard error of a median is about 1.25 times
+// that of a mean.
+double median_standard_error(const vector<double> &values) {
+  if (values.size() < 2) return 0;
+  double median = percentile(values, 0.5);
+  vector<double> deviations;
+  for (double value : values) deviations.push_back(std::abs(value - median));
+  return 1.253 * 1.4826 * percentile(deviations, 0.5) / std::sqrt(static_cast<double>(values.size()));
+}
+
+// Each example's change is the relative change in its median duration, and
+// its noise is the half-width of a 95% confidence interval around that
+// change. An example has regressed when it slowed down by more than both the
+// threshold and the noise. Returns the number of regressions, counting a
+// slowdown of the overall geometric mean beyond the threshold as one more.
+unsigned compare_to_baseline(const vector<LanguageResult> &languages,
+                             const map<string, vector<double>> &baseline,
+                             double threshold_percentage) {
+  unsigned regression_count = 0, compared_count = 0;
+  double log_ratio_sum = 0;
+  printf("compared to the baseline:\n");
+  for (auto &language : languages) {
+    for (auto &example : language.examples) {
+      auto entry = baseline.find(baseline_key(language.name, example));
+      if (entry == baseline.end() || entry->second.empty()) continue;
+      double old_median = percentile(entry->second, 0.5);
+      double new_median = percentile(example.durations, 0.5);
+      if (old_median <= 0 || new_median <= 0) continue;
+
+      double change = (new_median - old_median) / old_median * 100;
+      double noise = 1.96 * 100 / old_median * std::sqrt(
+        std::pow(median_standard_error(entry->second), 2) +
+        std::pow(median_standard_error(example.durations), 2)
+      );
+      bool is_regression = change > threshold_percentage && change > noise;
+      bool is_improvement = -change > noise;
+      printf(
+        "  %-12s %-30s%s\t%+.1f%% +/- %.1f%%\t%s\n",
+        language.name.c_str(),
+        example.file_name.c_str(),
+        example.has_errors ? " (errors)" : "",
+        change,
+        noise,
+        is_regression ? "REGRESSION" : is_improvement ? "faster" : change > noise ? "slower" : ""
+      );
+      if (is_regression) regression_count++;
+      log_ratio_sum += std::log(new_median / old_median);
+      compared_count++;
+    }
+  }
+
+  if (compared_count == 0) {
+    printf("  no examples in common\n");
+    return 0;
+  }
+  double overall_change = (std::exp(log_ratio_sum / compared_count) - 1) * 100;
+  printf("  %-43s\t%+.1f%%\n", "geometric mean", overall_change);
+  if (overall_change > threshold_percentage) regression_count++;
+  return regression_count;
+}
+
+size_t parse_table_cell_size(const TSLanguage *language) {
+  return language->byte_parse_table ? sizeof(uint8_t) : sizeof(uint16_t);
+}
+
+size_t dense_parse_table_size(const TSLanguage *language) {
+  return language->state_count * language->symbol_count * parse_table_cell_size(language);
+}
+
+size_t parse_table_size(const TSLanguage *language) {
+  size_t result = language->large_state_count * language->symbol_count * parse_table_cell_size(language);
+  if (!language->small_parse_table && !language->byte_small_parse_table) {
+    return dense_parse_table_size(language);
+  }
+
+  auto small_parse_table_cell = [&](size_t index) -> uint16_t {
+    if (language->byte_small_parse_table) return language->byte_small_parse_table[index];
+    return language->small_parse_table[index];
+  };
+
+  size_t small_state_count = language->state_count - language->large_state_count;
+  size_t small_table_length = 0;
+  for (size_t i = 0; i < small_state_count; i++) {
+    size_t index = language->small_parse_table_map[i];
+    uint16_t group_count = small_parse_table_cell(index++);
+    for (unsigned j = 0; j < group_count; j++) {
+      index++;
+      index += small_parse_table_cell(index) + 1;
+    }
+    if (index > small_table_length) small_table_length = index;
   }
+
+  result += small_table_length * parse_table_cell_size(language);
+  result += small_state_count * sizeof(uint32_t);
   return result;
 }
 
 int main(int argc, char *arg[]) {
   map<string, vector<ExampleEntry>> example_entries_by_language_name;
-  vector<size_t> error_speeds;
-  vector<size_t> non_error_speeds;
+  vector<LanguageResult> results;
 
   auto document = ts_document_new();
 
@@ -53,6 +925,57 @@ int main(int argc, char *arg[]) {
 
   auto language_filter = getenv("TREE_SITTER_BENCHMARK_LANGUAGE");
   auto file_name_filter = getenv("TREE_SITTER_BENCHMARK_FILE_NAME");
+  auto json_path = getenv("TREE_SITTER_BENCHMARK_JSON");
+  auto save_path = getenv("TREE_SITTER_BENCHMARK_SAVE");
+  auto baseline_path = getenv("TREE_SITTER_BENCHMARK_BASELINE");
+  auto threshold = getenv("TREE_SITTER_BENCHMARK_THRESHOLD");
+  double threshold_percentage = threshold ? strtod(threshold, nullptr) : 5;
+  unsigned warmup_run_count = env_unsigned("TREE_SITTER_BENCHMARK_WARMUP_RUNS", 2);
+  unsigned run_count = env_unsigned("TREE_SITTER_BENCHMARK_RUNS", 10);
+  if (run_count == 0) run_count = 1;
+  unsigned edit_session_count = env_unsigned("TREE_SITTER_BENCHMARK_EDIT_SESSIONS", 3);
+
+  PerfCounters *perf_counters = nullptr;
+  if (getenv("TREE_SITTER_BENCHMARK_COUNTERS")) {
+    perf_counters = new PerfCounters();
+    if (!perf_counters->is_available()) {
+      fprintf(stderr, "Hardware counters are not available\n");
+      delete perf_counters;
+      perf_counters = nullptr;
+    }
+  }
+
+  if (getenv("TREE_SITTER_BENCHMARK_LOOP")) {
+    if (!file_name_filter) {
+      fprintf(stderr, "Loop mode needs an example's file name\n");
+      return 1;
+    }
+    unsigned iteration_count = env_unsigned("TREE_SITTER_BENCHMARK_ITERATIONS", 0);
+    unsigned duration_seconds = env_unsigned("TREE_SITTER_BENCHMARK_SECONDS", 10);
+    for (auto &language_name : language_names) {
+      if (language_filter && language_name != language_filter) continue;
+      for (auto &example : examples_for_language(language_name)) {
+        if (example.file_name != file_name_filter) continue;
+        run_loop(document, language_name, example, iteration_count, duration_seconds);
+        delete perf_counters;
+        ts_document_free(document);
+        return 0;
+      }
+    }
+    fprintf(stderr, "No example named %s\n", file_name_filter);
+    return 1;
+  }
+
+  // The baseline is read before anything is measured, so that a missing one
+  // is reported right away.
+  map<string, vector<double>> baseline;
+  if (baseline_path) {
+    string content = read_file(baseline_path);
+    if (!read_baseline(content, &baseline)) {
+      fprintf(stderr, "Could not read a baseline from %s\n", baseline_path);
+      return 1;
+    }
+  }
 
   for (auto &language_name : language_names) {
     example_entries_by_language_name[language_name] = examples_for_language(language_name);
@@ -61,29 +984,56 @@ int main(int argc, char *arg[]) {
   for (auto &language_name : language_names) {
     if (language_filter && language_name != language_filter) continue;
 
-    ts_document_set_language(document, load_real_language(language_name));
+    const TSLanguage *language = load_real_language(language_name);
+    ts_document_set_language(document, language);
+    results.push_back({language_name, parse_table_size(language), dense_parse_table_size(language), {}, {}, {}, {}, {}});
+    LanguageResult &result = results.back();
 
     printf("%s\n", language_name.c_str());
+    printf(
+      "  %-30s\t%lu bytes (%lu bytes dense)\n",
+      "parse table size",
+      result.parse_table_size,
+      result.dense_parse_table_size
+    );
+
+    ts_document_invalidate(document);
+    ts_document_set_input_string(document, "");
+    ts_document_parse(document);
 
     for (auto &example : example_entries_by_language_name[language_name]) {
       if (file_name_filter && example.file_name != file_name_filter) continue;
       if (example.input.size() < 256) continue;
+      result.examples.push_back(measure_example(document, example, false, warmup_run_count, run_count, perf_counters));
+      print_example(result.examples.back());
+    }
 
-      ts_document_invalidate(document);
-      ts_document_set_input_string(document, "");
-      ts_document_parse(document);
+    if (edit_session_count > 0) {
+      for (auto &example : example_entries_by_language_name[language_name]) {
+        if (file_name_filter && example.file_name != file_name_filter) continue;
+        if (example.input.size() < 256) continue;
+        result.edit_examples.push_back(measure_example_edits(document, example, edit_session_count));
+        print_edit_example(result.edit_examples.back());
+      }
+    }
 
-      ts_document_invalidate(document);
-      ts_document_set_input_string(document, example.input.c_str());
+    for (auto &example : example_entries_by_language_name[language_name]) {
+      if (file_name_filter && example.file_name != file_name_filter) continue;
+      if (example.input.size() < 256) continue;
+      result.memory_examples.push_back(measure_example_memory(language, example));
+      print_memory_example(result.memory_examples.back());
+    }
+
+    for (auto &example : pathological_inputs_for_language(language_name)) {
+      if (file_name_filter && example.file_name != file_name_filter) continue;
+      result.pathological_examples.push_back(measure_pathological_example(document, example, run_count));
+      print_pathological_example(result.pathological_examples.back());
+    }
 
-      clock_t start_time = clock();
-      ts_document_parse(document);
-      clock_t end_time = clock();
-      unsigned duration = (end_time - start_time) * 1000 / CLOCKS_PER_SEC;
-      assert(!ts_node_has_error(ts_document_root_node(document)));
-      size_t speed = static_cast<double>(example.input.size()) / duration;
-      printf("  %-30s\t%u ms\t\t%lu bytes/ms\n", example.file_name.c_str(), duration, speed);
-      if (speed != 0) non_error_speeds.push_back(speed);
+    for (auto &example : scanner_inputs_for_language(language_name)) {
+      if (file_name_filter && example.file_name != file_name_filter) continue;
+      result.scanner_examples.push_back(measure_scanner_example(document, example, warmup_run_count, run_count));
+      print_scanner_example(result.scanner_examples.back());
     }
 
     for (auto &other_language_name : language_names) {
@@ -92,31 +1042,49 @@ int main(int argc, char *arg[]) {
       for (auto &example : example_entries_by_language_name[other_language_name]) {
         if (file_name_filter && example.file_name != file_name_filter) continue;
         if (example.input.size() < 256) continue;
-
-        ts_document_invalidate(document);
-        ts_document_set_input_string(document, example.input.c_str());
-
-        clock_t start_time = clock();
-        ts_document_parse(document);
-        clock_t end_time = clock();
-        unsigned duration = (end_time - start_time) * 1000 / CLOCKS_PER_SEC;
-        size_t speed = static_cast<double>(example.input.size()) / duration;
-        printf("  %-30s\t%u ms\t\t%lu bytes/ms\n", example.file_name.c_str(), duration, speed);
-        if (speed != 0) error_speeds.push_back(speed);
+        result.examples.push_back(measure_example(document, example, true, warmup_run_count, run_count, perf_counters));
+        print_example(result.examples.back());
       }
     }
 
     puts("");
   }
 
-  puts("without errors:");
-  printf("  %-30s\t%lu bytes/ms\n", "average speed", mean(non_error_speeds));
-  printf("  %-30s\t%lu bytes/ms\n", "worst speed", min(non_error_speeds));
+  print_speeds("without errors:", speeds(results, false));
   puts("");
+  print_speeds("with errors:", speeds(results, true));
 
-  puts("with errors:");
-  printf("  %-30s\t%lu bytes/ms\n", "average speed", mean(error_speeds));
-  printf("  %-30s\t%lu bytes/ms\n", "worst speed", min(error_speeds));
+  if (json_path) {
+    FILE *file = fopen(json_path, "w");
+    if (!file) {
+      fprintf(stderr, "Could not open %s\n", json_path);
+      return 1;
+    }
+    write_json(file, results, warmup_run_count, run_count);
+    fclose(file);
+  }
 
+  if (save_path) {
+    FILE *file = fopen(save_path, "w");
+    if (!file) {
+      fprintf(stderr, "Could not open %s\n", save_path);
+      return 1;
+    }
+    write_baseline(file, results);
+    fclose(file);
+  }
+
+  unsigned regression_count = 0;
+  if (baseline_path) {
+    puts("");
+    regression_count = compare_to_baseline(results, baseline, threshold_percentage);
+  }
+
+  delete perf_counters;
+  ts_document_free(document);
+  if (regression_count > 0) {
+    printf("%u regressions beyond %.1f%%\n", regression_count, threshold_percentage);
+    return 1;
+  }
   return 0;
 }
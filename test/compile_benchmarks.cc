@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "tree_sitter/compiler.h"
+#include "helpers/benchmark_helpers.h"
+#include "helpers/file_helpers.h"
+
+using std::string;
+using std::vector;
+
+// Each grammar in the fixtures directory is compiled a number of times, and the
+// run with the shortest total time is reported, since compilation is
+// deterministic and slower runs only reflect noise from the rest of the
+// system.
+struct GrammarResult {
+  string name;
+  TSCompileProfile profile;
+  TSCompileErrorType error_type;
+};
+
+uint64_t total_micros(const TSCompileProfile &profile) {
+  return
+    profile.parse_grammar_micros +
+    profile.prepare_grammar_micros +
+    profile.build_parse_table_micros +
+    profile.optimize_parse_table_micros +
+    profile.build_lex_table_micros +
+    profile.generate_code_micros;
+}
+
+GrammarResult compile_grammar(const string &name, const string &grammar_json, unsigned run_count,
+                              unsigned thread_count) {
+  GrammarResult result{name, TSCompileProfile(), TSCompileErrorTypeNone};
+  TSCompileOptions options = {};
+  options.thread_count = thread_count;
+  for (unsigned i = 0; i < run_count; i++) {
+    TSCompileResult compile_result = ts_compile_grammar_with_options(grammar_json.c_str(), options);
+    free(compile_result.code);
+    free(compile_result.error_message);
+    if (i == 0 || total_micros(compile_result.profile) < total_micros(result.profile)) {
+      result.profile = compile_result.profile;
+      result.error_type = compile_result.error_type;
+    }
+  }
+  return result;
+}
+
+void print_phase(const char *name, uint64_t micros) {
+  printf("  %-30s\t%.3f ms\n", name, micros / 1000.0);
+}
+
+void print_result(const GrammarResult &result) {
+  const TSCompileProfile &profile = result.profile;
+  printf("%s\n", result.name.c_str());
+  if (result.error_type != TSCompileErrorTypeNone) {
+    printf("  %-30s\t%d\n", "compile error", result.error_type);
+  }
+  print_phase("parse grammar", profile.parse_grammar_micros);
+  print_phase("prepare grammar", profile.prepare_grammar_micros);
+  print_phase("build parse table", profile.build_parse_table_micros);
+  print_phase("optimize parse table", profile.optimize_parse_table_micros);
+  print_phase("build lex table", profile.build_lex_table_micros);
+  print_phase("generate code", profile.generate_code_micros);
+  print_phase("total", total_micros(profile));
+  printf("  %-30s\t%u\n", "item sets", profile.item_set_count);
+  printf("  %-30s\t%lu\n", "parse items", static_cast<unsigned long>(profile.parse_item_count));
+  printf("  %-30s\t%u\n", "parse states", profile.parse_state_count);
+  printf("  %-30s\t%u (%u keyword)\n", "lex states", profile.lex_state_count, profile.keyword_lex_state_count);
+  puts("");
+}
+
+void write_json(FILE *file, const vector<GrammarResult> &results, unsigned run_count) {
+  fprintf(file, "{\n  \"runs\": %u,\n  \"grammars\": [", run_count);
+  for (size_t i = 0; i < results.size(); i++) {
+    const TSCompileProfile &profile = results[i].profile;
+    fprintf(
+      file,
+      "%s\n    {\"name\": \"%s\", \"error_type\": %d, "
+      "\"parse_grammar_ms\": %.3f, \"prepare_grammar_ms\": %.3f, \"build_parse_table_ms\": %.3f, "
+      "\"optimize_parse_table_ms\": %.3f, \"build_lex_table_ms\": %.3f, \"generate_code_ms\": %.3f, "
+      "\"total_ms\": %.3f, \"item_sets\": %u, \"parse_items\": %lu, \"parse_states\": %u, "
+      "\"lex_states\": %u, \"keyword_lex_states\": %u}",
+      i > 0 ? "," : "",
+      results[i].name.c_str(),
+      results[i].error_type,
+      profile.parse_grammar_micros / 1000.0,
+      profile.prepare_grammar_micros / 1000.0,
+      profile.build_parse_table_micros / 1000.0,
+      profile.optimize_parse_table_micros / 1000.0,
+      profile.build_lex_table_micros / 1000.0,
+      profile.generate_code_micros / 1000.0,
+      total_micros(profile) / 1000.0,
+      profile.item_set_count,
+      static_cast<unsigned long>(profile.parse_item_count),
+      profile.parse_state_count,
+      profile.lex_state_count,
+      profile.keyword_lex_state_count
+    );
+  }
+  fprintf(file, "\n  ]\n}\n");
+}
+
+int main() {
+  auto language_filter = getenv("TREE_SITTER_BENCHMARK_LANGUAGE");
+  auto json_path = getenv("TREE_SITTER_BENCHMARK_JSON");
+  unsigned run_count = env_unsigned("TREE_SITTER_BENCHMARK_RUNS", 3);
+  if (run_count == 0) run_count = 1;
+  unsigned thread_count = env_unsigned("TREE_SITTER_BENCHMARK_THREADS", 0);
+
+  string grammars_directory = join_path({"test", "fixtures", "grammars"});
+  vector<string> language_names = list_directory(grammars_directory);
+  std::sort(language_names.begin(), language_names.end());
+
+  vector<GrammarResult> results;
+  for (const string &language_name : language_names) {
+    if (language_filter && language_name != language_filter) continue;
+    string grammar_path = join_path({grammars_directory, language_name, "src", "grammar.json"});
+    if (!file_exists(grammar_path)) continue;
+    results.push_back(compile_grammar(language_name, read_file(grammar_path), run_count, thread_count));
+    print_result(results.back());
+  }
+
+  if (json_path) {
+    FILE *file = fopen(json_path, "w");
+    if (!file) {
+      fprintf(stderr, "Could not open %s\n", json_path);
+      return 1;
+    }
+    write_json(file, results, run_count);
+    fclose(file);
+  }
+
+  return 0;
+}
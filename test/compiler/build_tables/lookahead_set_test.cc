@@ -0,0 +1,113 @@
+#include "test_helper.h"
+#include "compiler/build_tables/lookahead_set.h"
+#include "compiler/rule.h"
+
+using namespace rules;
+using namespace build_tables;
+
+START_TEST
+
+describe("LookaheadSet", [&]() {
+  auto symbols = [](const LookaheadSet &set) {
+    vector<Symbol> result;
+    set.for_each([&](Symbol symbol) {
+      result.push_back(symbol);
+      return true;
+    });
+    return result;
+  };
+
+  it("visits its externals, then the end of input, then its terminals, in order", [&]() {
+    LookaheadSet set({
+      Symbol::terminal(130),
+      Symbol::terminal(3),
+      Symbol::external(64),
+      END_OF_INPUT(),
+      Symbol::terminal(63),
+      Symbol::terminal(64),
+      Symbol::external(0),
+    });
+
+    AssertThat(set.size(), Equals<size_t>(7));
+    AssertThat(symbols(set), Equals(vector<Symbol>({
+      Symbol::external(0),
+      Symbol::external(64),
+      END_OF_INPUT(),
+      Symbol::terminal(3),
+      Symbol::terminal(63),
+      Symbol::terminal(64),
+      Symbol::terminal(130),
+    })));
+    AssertThat(set.contains(Symbol::terminal(64)), IsTrue());
+    AssertThat(set.contains(Symbol::terminal(65)), IsFalse());
+    AssertThat(set.contains(Symbol::terminal(500)), IsFalse());
+    AssertThat(set.contains(Symbol::external(3)), IsFalse());
+  });
+
+  it("reports whether a union added any symbols", [&]() {
+    LookaheadSet set({Symbol::terminal(1), Symbol::terminal(70)});
+    AssertThat(set.insert_all(LookaheadSet({Symbol::terminal(70)})), IsFalse());
+    AssertThat(set.insert_all(LookaheadSet({Symbol::terminal(1), Symbol::terminal(200)})), IsTrue());
+    AssertThat(set.insert_all(LookaheadSet({END_OF_INPUT()})), IsTrue());
+    AssertThat(symbols(set), Equals(vector<Symbol>({
+      END_OF_INPUT(),
+      Symbol::terminal(1),
+      Symbol::terminal(70),
+      Symbol::terminal(200),
+    })));
+  });
+
+  it("compares sets by their symbols, regardless of the order of insertion", [&]() {
+    LookaheadSet set1({Symbol::terminal(100), Symbol::terminal(2)});
+    LookaheadSet set2({Symbol::terminal(2)});
+    AssertThat(set1 == set2, IsFalse());
+    set2.insert_all(LookaheadSet({Symbol::terminal(100)}));
+    AssertThat(set1 == set2, IsTrue());
+    AssertThat(std::hash<LookaheadSet>()(set1), Equals(std::hash<LookaheadSet>()(set2)));
+  });
+
+  it("removes symbols, leaving a set equal to one that never contained them", [&]() {
+    LookaheadSet set({Symbol::terminal(1), Symbol::terminal(70), Symbol::terminal(200), END_OF_INPUT()});
+    AssertThat(set.remove(Symbol::terminal(2)), IsFalse());
+    AssertThat(set.remove(Symbol::terminal(500)), IsFalse());
+    AssertThat(set.remove(Symbol::terminal(200)), IsTrue());
+    AssertThat(set.remove_all(LookaheadSet({Symbol::terminal(70), Symbol::external(1)})), IsTrue());
+    AssertThat(set.remove_all(LookaheadSet({Symbol::terminal(70)})), IsFalse());
+
+    LookaheadSet expected({Symbol::terminal(1), END_OF_INPUT()});
+    AssertThat(set == expected, IsTrue());
+    AssertThat(std::hash<LookaheadSet>()(set), Equals(std::hash<LookaheadSet>()(expected)));
+
+    AssertThat(set.remove(END_OF_INPUT()), IsTrue());
+    AssertThat(set.remove(Symbol::terminal(1)), IsTrue());
+    AssertThat(set.empty(), IsTrue());
+  });
+
+  it("finds intersections across words", [&]() {
+    LookaheadSet set({Symbol::terminal(1), Symbol::terminal(129)});
+    AssertThat(set.intersects(LookaheadSet({Symbol::terminal(129)})), IsTrue());
+    AssertThat(set.intersects(LookaheadSet({Symbol::terminal(65), Symbol::external(1)})), IsFalse());
+    AssertThat(LookaheadSet({END_OF_INPUT()}).intersects(LookaheadSet({END_OF_INPUT()})), IsTrue());
+  });
+
+  it("visits the symbols that are in exactly one of two sets", [&]() {
+    LookaheadSet set1({Symbol::terminal(1), Symbol::terminal(65), Symbol::external(2), END_OF_INPUT()});
+    LookaheadSet set2({Symbol::terminal(1), Symbol::terminal(66), Symbol::terminal(200)});
+
+    vector<pair<bool, Symbol>> differences;
+    set1.for_each_difference(set2, [&](bool in_set1, Symbol symbol) {
+      differences.push_back({in_set1, symbol});
+      return true;
+    });
+
+    AssertThat(differences, Equals(vector<pair<bool, Symbol>>({
+      {true, Symbol::external(2)},
+      {true, END_OF_INPUT()},
+      {true, Symbol::terminal(65)},
+      {false, Symbol::terminal(66)},
+      {false, Symbol::terminal(200)},
+    })));
+  });
+});
+
+END_TEST
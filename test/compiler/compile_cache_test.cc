@@ -0,0 +1,102 @@
+#include "test_helper.h"
+#include "compiler/compile_cache.h"
+#include "helpers/file_helpers.h"
+
+START_TEST
+
+describe("ts_compile_grammar_cached", []() {
+  string cache_dir = join_path({"out", "tmp", "compile-cache-test"});
+  TSCompileOptions options = {};
+
+  string grammar = R"JSON({
+    "name": "cached_grammar",
+    "rules": {
+      "program": {"type": "REPEAT", "content": {"type": "SYMBOL", "name": "word"}},
+      "word": {"type": "PATTERN", "value": "[a-z]+"}
+    },
+    "extras": [{"type": "PATTERN", "value": "\\s"}]
+  })JSON";
+
+  before_each([&]() {
+    make_directory("out");
+    make_directory(join_path({"out", "tmp"}));
+    make_directory(cache_dir);
+    remove(join_path({cache_dir, compile_cache_key(grammar, options) + ".c"}).c_str());
+  });
+
+  it("returns the code that was stored for the grammar by an earlier call", [&]() {
+    TSCompileResult first_result = ts_compile_grammar_cached(grammar.c_str(), options, cache_dir.c_str());
+    AssertThat(first_result.error_type, Equals(TSCompileErrorTypeNone));
+    AssertThat(first_result.profile.loaded_from_cache, IsFalse());
+
+    TSCompileResult second_result = ts_compile_grammar_cached(grammar.c_str(), options, cache_dir.c_str());
+    AssertThat(second_result.error_type, Equals(TSCompileErrorTypeNone));
+    AssertThat(second_result.profile.loaded_from_cache, IsTrue());
+    AssertThat(second_result.profile.parse_state_count, Equals<uint32_t>(0));
+    AssertThat(string(second_result.code), Equals(string(first_result.code)));
+
+    free(first_result.code);
+    free(second_result.code);
+  });
+
+  it("identifies grammars by their contents rather than their formatting", [&]() {
+    string reformatted_grammar = R"JSON(
+      // A comment
+      {"name":"cached_grammar","rules":{
+        "program":{"type":"REPEAT","content":{"type":"SYMBOL","name":"word"}},
+        "word":{"type":"PATTERN","value":"[a-z]+"}},
+      "extras":[{"type":"PATTERN","value":"\\s"}]}
+    )JSON";
+
+    string reordered_grammar = R"JSON({
+      "name": "cached_grammar",
+      "rules": {
+        "word": {"type": "PATTERN", "value": "[a-z]+"},
+        "program": {"type": "REPEAT", "content": {"type": "SYMBOL", "name": "word"}}
+      },
+      "extras": [{"type": "PATTERN", "value": "\\s"}]
+    })JSON";
+
+    string key = compile_cache_key(grammar, options);
+    AssertThat(key, !Equals(""));
+    AssertThat(compile_cache_key(reformatted_grammar, options), Equals(key));
+    AssertThat(compile_cache_key(reordered_grammar, options), !Equals(key));
+
+    for (bool TSCompileOptions::*field : vector<bool TSCompileOptions::*>({
+      &TSCompileOptions::use_lex_tables,
+      &TSCompileOptions::compact_code,
+      &TSCompileOptions::specialize_table_lookups,
+      &TSCompileOptions::reorder_parse_states,
+      &TSCompileOptions::narrow_parse_table_rows,
+    })) {
+      TSCompileOptions other_options = options;
+      other_options.*field = true;
+      AssertThat(compile_cache_key(grammar, other_options), !Equals(key));
+    }
+
+    TSCompileOptions threaded_options = options;
+    threaded_options.thread_count = 4;
+    AssertThat(compile_cache_key(grammar, threaded_options), Equals(key));
+  });
+
+  it("doesn't store grammars that fail to compile", [&]() {
+    string invalid_grammar = R"JSON({
+      "name": "invalid_cached_grammar",
+      "rules": {"a": {"type": "SYMBOL", "name": "b"}}
+    })JSON";
+
+    for (unsigned i = 0; i < 2; i++) {
+      TSCompileResult result = ts_compile_grammar_cached(invalid_grammar.c_str(), options, cache_dir.c_str());
+      AssertThat(result.error_type, Equals(TSCompileErrorTypeUndefinedSymbol));
+      AssertThat(result.profile.loaded_from_cache, IsFalse());
+      free(result.error_message);
+    }
+
+    AssertThat(compile_cache_key("{", options), Equals(""));
+    TSCompileResult result = ts_compile_grammar_cached("{", options, cache_dir.c_str());
+    AssertThat(result.error_type, Equals(TSCompileErrorTypeInvalidGrammar));
+    free(result.error_message);
+  });
+});
+
+END_TEST
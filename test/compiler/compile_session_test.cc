@@ -0,0 +1,74 @@
+#include "test_helper.h"
+
+START_TEST
+
+describe("ts_compile_session_compile", []() {
+  TSCompileOptions options = {};
+  TSCompileSession *session;
+
+  string grammar = R"JSON({
+    "name": "session_grammar",
+    "rules": {
+      "program": {"type": "REPEAT", "content": {"type": "SYMBOL", "name": "_expression"}},
+      "_expression": {"type": "CHOICE", "members": [
+        {"type": "SYMBOL", "name": "sum"},
+        {"type": "SYMBOL", "name": "word"}
+      ]},
+      "sum": {"type": "PREC_LEFT", "value": 1, "content": {"type": "SEQ", "members": [
+        {"type": "SYMBOL", "name": "_expression"},
+        {"type": "STRING", "value": "+"},
+        {"type": "SYMBOL", "name": "_expression"}
+      ]}},
+      "word": {"type": "PATTERN", "value": "[a-z]+"}
+    },
+    "extras": [{"type": "PATTERN", "value": "\\s"}]
+  })JSON";
+
+  before_each([&]() {
+    session = ts_compile_session_new();
+  });
+
+  after_each([&]() {
+    ts_compile_session_free(session);
+  });
+
+  it("reuses the parse states when only the grammar's tokens have changed", [&]() {
+    TSCompileResult first_result = ts_compile_session_compile(session, grammar.c_str(), options);
+    AssertThat(first_result.error_type, Equals(TSCompileErrorTypeNone));
+    AssertThat(first_result.profile.reused_parse_states, IsFalse());
+
+    string new_grammar = grammar;
+    new_grammar.replace(new_grammar.find("[a-z]+"), 6, "[a-zA-Z_]+");
+    new_grammar.replace(new_grammar.find("\"+\""), 3, "\"plus\"");
+
+    TSCompileResult second_result = ts_compile_session_compile(session, new_grammar.c_str(), options);
+    AssertThat(second_result.error_type, Equals(TSCompileErrorTypeNone));
+    AssertThat(second_result.profile.reused_parse_states, IsTrue());
+    AssertThat(second_result.profile.build_parse_table_micros, Equals<uint64_t>(0));
+
+    TSCompileResult expected_result = ts_compile_grammar_with_options(new_grammar.c_str(), options);
+    AssertThat(string(second_result.code), Equals(string(expected_result.code)));
+
+    free(first_result.code);
+    free(second_result.code);
+    free(expected_result.code);
+  });
+
+  it("builds the parse states again when the grammar's syntax rules have changed", [&]() {
+    TSCompileResult first_result = ts_compile_session_compile(session, grammar.c_str(), options);
+    AssertThat(first_result.error_type, Equals(TSCompileErrorTypeNone));
+
+    string new_grammar = grammar;
+    new_grammar.replace(new_grammar.find("\"value\": 1"), 10, "\"value\": 2");
+    new_grammar.replace(new_grammar.find("PREC_LEFT"), 9, "PREC_RIGHT");
+
+    TSCompileResult second_result = ts_compile_session_compile(session, new_grammar.c_str(), options);
+    AssertThat(second_result.error_type, Equals(TSCompileErrorTypeNone));
+    AssertThat(second_result.profile.reused_parse_states, IsFalse());
+
+    free(first_result.code);
+    free(second_result.code);
+  });
+});
+
+END_TEST
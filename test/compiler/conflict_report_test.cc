@@ -0,0 +1,79 @@
+#include "test_helper.h"
+
+START_TEST
+
+describe("ts_compile_grammar_conflict_report", []() {
+  TSCompileOptions options = {};
+
+  it("lists the actions for each lookahead that has more than one", [&]() {
+    TSCompileResult result = ts_compile_grammar_conflict_report(R"JSON({
+      "name": "reported_conflict",
+
+      "conflicts": [["a", "b"]],
+
+      "rules": {
+        "program": {
+          "type": "CHOICE",
+          "members": [
+            {
+              "type": "SEQ",
+              "members": [
+                {"type": "SYMBOL", "name": "a"},
+                {"type": "STRING", "value": "!"}
+              ]
+            },
+            {
+              "type": "SEQ",
+              "members": [
+                {"type": "SYMBOL", "name": "b"},
+                {"type": "STRING", "value": "!"},
+                {"type": "STRING", "value": "?"}
+              ]
+            }
+          ]
+        },
+
+        "a": {"type": "STRING", "value": "x"},
+        "b": {"type": "STRING", "value": "x"}
+      }
+    })JSON", options);
+
+    AssertThat(result.error_type, Equals(TSCompileErrorTypeNone));
+    string report(result.code);
+    AssertThat(report, StartsWith(
+      "Parse states with more than one action: 1\n"
+      "Lookaheads with more than one action: 1\n"
+    ));
+    AssertThat(report, Contains("lookahead '!':\n"));
+    AssertThat(report, Contains("  reduce a (1 child)\n"));
+    AssertThat(report, Contains("  reduce b (1 child)\n"));
+    free(result.code);
+  });
+
+  it("reports no states for a grammar without conflicts", [&]() {
+    TSCompileResult result = ts_compile_grammar_conflict_report(R"JSON({
+      "name": "unreported_conflict",
+      "rules": {
+        "program": {"type": "REPEAT", "content": {"type": "SYMBOL", "name": "word"}},
+        "word": {"type": "PATTERN", "value": "[a-z]+"}
+      },
+      "extras": [{"type": "PATTERN", "value": "\\s"}]
+    })JSON", options);
+
+    AssertThat(result.error_type, Equals(TSCompileErrorTypeNone));
+    AssertThat(string(result.code), Equals(
+      "Parse states with more than one action: 0\n"
+      "Lookaheads with more than one action: 0\n"
+    ));
+    free(result.code);
+  });
+
+  it("returns the error for a grammar that can't be compiled", [&]() {
+    TSCompileResult result = ts_compile_grammar_conflict_report("{\"name\": \"invalid\"}", options);
+    AssertThat(result.error_type, Equals(TSCompileErrorTypeInvalidGrammar));
+    AssertThat(result.code, Equals<char *>(nullptr));
+    free(result.error_message);
+  });
+});
+
+END_TEST
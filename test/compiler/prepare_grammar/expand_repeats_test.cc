@@ -165,6 +165,93 @@ describe("expand_repeats", []() {
       })},
     }));
   });
+
+  it("shares auxiliary rules between repeats of choices whose elements are in different orders", [&]() {
+    InitialSyntaxGrammar grammar{
+      {
+        Variable{"rule0", VariableTypeNamed, Repeat{Rule::choice({
+          Symbol::terminal(10),
+          Symbol::terminal(11),
+        })}},
+        Variable{"rule1", VariableTypeNamed, Repeat{Rule::choice({
+          Symbol::terminal(11),
+          Symbol::terminal(10),
+        })}},
+      },
+      {}, {}, {}, {}
+    };
+
+    auto result = expand_repeats(grammar);
+
+    AssertThat(result.variables, Equals(vector<Variable>{
+      Variable{"rule0", VariableTypeNamed, Symbol::non_terminal(2)},
+      Variable{"rule1", VariableTypeNamed, Symbol::non_terminal(2)},
+      Variable{"rule0_repeat1", VariableTypeAuxiliary, Choice{{
+        Rule::seq({ Symbol::non_terminal(2), Symbol::non_terminal(2) }),
+        Rule::choice({ Symbol::terminal(10), Symbol::terminal(11) }),
+      }}},
+    }));
+  });
+
+  it("doesn't share auxiliary rules between repeats of choices with only some elements in common", [&]() {
+    auto element = [](Rule first, Rule second, Rule third) {
+      return Rule::seq({ Symbol::terminal(10), Rule::choice({ first, second, third }) });
+    };
+    auto other_element = [](Rule first, Rule second) {
+      return Rule::seq({ Symbol::terminal(14), Rule::choice({ first, second }) });
+    };
+
+    // Every element of the second choice is equivalent to an element of the
+    // first one, but not the other way around. The choices' hashes are equal.
+    InitialSyntaxGrammar grammar{
+      {
+        Variable{"rule0", VariableTypeNamed, Repeat{Rule::choice({
+          element(Symbol::terminal(11), Symbol::terminal(12), Symbol::terminal(13)),
+          element(Symbol::terminal(12), Symbol::terminal(11), Symbol::terminal(13)),
+          other_element(Symbol::terminal(15), Symbol::terminal(16)),
+          other_element(Symbol::terminal(16), Symbol::terminal(15)),
+        })}},
+        Variable{"rule1", VariableTypeNamed, Repeat{Rule::choice({
+          element(Symbol::terminal(11), Symbol::terminal(12), Symbol::terminal(13)),
+          element(Symbol::terminal(12), Symbol::terminal(11), Symbol::terminal(13)),
+          element(Symbol::terminal(13), Symbol::terminal(12), Symbol::terminal(11)),
+          element(Symbol::terminal(11), Symbol::terminal(13), Symbol::terminal(12)),
+        })}},
+      },
+      {}, {}, {}, {}
+    };
+
+    auto result = expand_repeats(grammar);
+
+    AssertThat(result.variables.size(), Equals<size_t>(4));
+    AssertThat(result.variables[0].rule, Equals<Rule>(Symbol::non_terminal(2)));
+    AssertThat(result.variables[1].rule, Equals<Rule>(Symbol::non_terminal(3)));
+  });
+
+  it("replaces a repeat of a repeat with the inner repeat", [&]() {
+    InitialSyntaxGrammar grammar{
+      {
+        Variable{"rule0", VariableTypeNamed, Rule::seq({
+          Symbol::terminal(10),
+          Repeat{Repeat{Symbol::terminal(11)}},
+        })},
+      },
+      {}, {}, {}, {}
+    };
+
+    auto result = expand_repeats(grammar);
+
+    AssertThat(result.variables, Equals(vector<Variable>{
+      Variable{"rule0", VariableTypeNamed, Rule::seq({
+        Symbol::terminal(10),
+        Symbol::non_terminal(1),
+      })},
+      Variable{"rule0_repeat1", VariableTypeAuxiliary, Rule::choice({
+        Rule::seq({ Symbol::non_terminal(1), Symbol::non_terminal(1) }),
+        Symbol::terminal(11),
+      })},
+    }));
+  });
 });
 
 END_TEST
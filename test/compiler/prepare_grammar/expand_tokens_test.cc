@@ -8,6 +8,7 @@ START_TEST
 using namespace rules;
 using prepare_grammar::expand_token;
 using prepare_grammar::ExpandTokenResult;
+using prepare_grammar::PatternExpansionCache;
 
 describe("expand_tokens", []() {
   MetadataParams string_token_params;
@@ -83,6 +84,23 @@ describe("expand_tokens", []() {
         ))
       );
     });
+
+    it("parses each pattern once when given a cache", [&]() {
+      PatternExpansionCache cache;
+      Rule rule = Rule::seq({
+        Pattern{"[a-z]+"},
+        String{"."},
+        Pattern{"[a-z]+"},
+      });
+
+      auto result = expand_token(rule, &cache);
+      AssertThat(result.rule, Equals(expand_token(rule).rule));
+      AssertThat(cache.size(), Equals<size_t>(1));
+      AssertThat(cache.at("[a-z]+").rule, Equals(Rule(Repeat{CharacterSet().include('a', 'z')})));
+
+      AssertThat(expand_token(Pattern{"("}, &cache).error.type, Equals(TSCompileErrorTypeInvalidRegex));
+      AssertThat(cache.at("(").error.type, Equals(TSCompileErrorTypeInvalidRegex));
+    });
   });
 });
 
@@ -184,6 +184,62 @@ describe("extract_tokens", []() {
     }))
   });
 
+  it("merges tokens that are written differently but match the same text", [&]() {
+    auto result = extract_tokens(InternedGrammar{
+      {
+        {
+          "rule_A",
+          VariableTypeNamed,
+          Rule::seq({
+            Pattern{"[ab]+"},
+            Symbol::non_terminal(1),
+            Pattern{"\\w"},
+          })
+        },
+        {
+          "rule_B",
+          VariableTypeNamed,
+          Rule::seq({
+            Pattern{"(a|b)(a|b)*"},
+            Pattern{"[a-zA-Z0-9_]"},
+            Pattern{"c"},
+            String{"c"},
+          })
+        },
+      },
+      {}, {}, {}, {}
+    });
+
+    InitialSyntaxGrammar &syntax_grammar = get<0>(result);
+    LexicalGrammar &lexical_grammar = get<1>(result);
+
+    AssertThat(syntax_grammar.variables, Equals(vector<Variable> {
+      Variable{
+        "rule_A",
+        VariableTypeNamed,
+        Rule::seq({
+          Symbol::terminal(0),
+          Symbol::non_terminal(1),
+          Symbol::terminal(1),
+        })
+      },
+      Variable{
+        "rule_B",
+        VariableTypeNamed,
+        Rule::seq({
+          Symbol::terminal(0),
+          Symbol::terminal(1),
+          Symbol::terminal(2),
+          Symbol::terminal(3),
+        })
+      },
+    }));
+
+    AssertThat(lexical_grammar.variables.size(), Equals<size_t>(4));
+    AssertThat(lexical_grammar.variables[2].type, Equals(VariableTypeAuxiliary));
+    AssertThat(lexical_grammar.variables[3].type, Equals(VariableTypeAnonymous));
+  });
+
   it("does not move entire rules into the lexical grammar if their content is used elsewhere in the grammar", [&]() {
     auto result = extract_tokens(InternedGrammar{
       {
@@ -8,6 +8,8 @@ START_TEST
 
 using namespace rules;
 using prepare_grammar::flatten_rule;
+using prepare_grammar::flatten_grammar;
+using prepare_grammar::InitialSyntaxGrammar;
 
 describe("flatten_grammar", []() {
   it("associates each symbol with the precedence and associativity binding it to its successor", [&]() {
@@ -125,6 +127,89 @@ describe("flatten_grammar", []() {
       }, 0)
     })));
   });
+
+  describe("when the grammar asks for its hidden rules to be inlined", [&]() {
+    InitialSyntaxGrammar grammar;
+
+    before_each([&]() {
+      grammar = InitialSyntaxGrammar{
+        {
+          Variable{"_program", VariableTypeHidden, Symbol::non_terminal(1)},
+          Variable{"_statement", VariableTypeHidden, Rule::choice({
+            Symbol::non_terminal(2),
+            Symbol::non_terminal(3),
+          })},
+          Variable{"expression_statement", VariableTypeNamed, Rule::seq({
+            Symbol::non_terminal(5),
+            Symbol::terminal(0),
+          })},
+          Variable{"block", VariableTypeNamed, Symbol::non_terminal(4)},
+          Variable{"_block_body", VariableTypeHidden, Rule::seq({
+            Symbol::terminal(1),
+            Symbol::non_terminal(1),
+            Symbol::terminal(2),
+          })},
+          Variable{"_expression", VariableTypeHidden, Rule::choice({
+            Symbol::non_terminal(6),
+            Symbol::non_terminal(7),
+            Symbol::terminal(3),
+          })},
+          Variable{"sum", VariableTypeNamed, Metadata::prec_left(0, Rule::seq({
+            Symbol::non_terminal(5),
+            Symbol::terminal(4),
+            Symbol::non_terminal(5),
+          }))},
+          Variable{"call", VariableTypeNamed, Rule::seq({
+            Metadata::alias("function", true, Symbol::non_terminal(9)),
+            Symbol::terminal(5),
+            Rule::choice({Symbol::non_terminal(8), Blank{}}),
+            Symbol::terminal(6),
+          })},
+          Variable{"_arguments", VariableTypeHidden, Rule::seq({
+            Symbol::non_terminal(5),
+            Rule::choice({
+              Rule::seq({Symbol::terminal(7), Symbol::non_terminal(8)}),
+              Blank{},
+            }),
+          })},
+          Variable{"_name", VariableTypeHidden, Rule::seq({
+            Symbol::terminal(8),
+            Rule::choice({
+              Rule::seq({Symbol::terminal(9), Symbol::terminal(8)}),
+              Blank{},
+            }),
+          })},
+          Variable{"_preferred_expression", VariableTypeHidden, Metadata::prec_dynamic(1, Symbol::non_terminal(5))},
+          Variable{"_conflicting_expression", VariableTypeHidden, Symbol::non_terminal(5)},
+        },
+        {}, {{Symbol::non_terminal(11), Symbol::non_terminal(2)}}, {}, {}
+      };
+      grammar.inline_hidden_rules = true;
+    });
+
+    it("inlines the hidden rules whose nodes would never appear in the tree", [&]() {
+      auto result = flatten_grammar(grammar);
+      AssertThat(result.second, Equals(CompileError::none()));
+      AssertThat(result.first.variables_to_inline, Equals(set<Symbol>({
+        Symbol::non_terminal(1),
+        Symbol::non_terminal(4),
+        Symbol::non_terminal(5),
+      })));
+    });
+
+    it("keeps the start rule, and hidden rules that are aliased, recursive, dynamically "
+       "preferred or named in conflicts", [&]() {
+      auto result = flatten_grammar(grammar);
+      for (Symbol::Index index : {0, 8, 9, 10, 11}) {
+        AssertThat(result.first.variables_to_inline.count(Symbol::non_terminal(index)), Equals(0u));
+      }
+    });
+
+    it("inlines nothing unless the grammar asks for it", [&]() {
+      grammar.inline_hidden_rules = false;
+      AssertThat(flatten_grammar(grammar).first.variables_to_inline, IsEmpty());
+    });
+  });
 });
 
 END_TEST
@@ -319,6 +319,65 @@ describe("CharacterSet", []() {
         CharacterRange('z'),
       })));
     });
+
+    it("merges ranges that overlap or touch as they are added", [&]() {
+      CharacterSet set1 = CharacterSet()
+        .include(0x3000, 0xffff)
+        .include('a', 'f')
+        .include('g', 'k')
+        .include('c', 'z')
+        .include(0xa0, 0x2fff);
+
+      AssertThat(set1.included_ranges(), Equals(vector<CharacterRange>({
+        CharacterRange{'a', 'z'},
+        CharacterRange{0xa0, 0xffff},
+      })));
+    });
+
+    it("splits ranges that have characters removed from their middle", [&]() {
+      CharacterSet set1 = CharacterSet().include(0, 0x10ffff);
+      set1.remove_set(CharacterSet().include('a', 'z').include(0xd800, 0xdfff));
+
+      AssertThat(set1.included_ranges(), Equals(vector<CharacterRange>({
+        CharacterRange{0, 'a' - 1},
+        CharacterRange{'z' + 1, 0xd7ff},
+        CharacterRange{0xe000, 0x10ffff},
+      })));
+    });
+  });
+
+  describe("::contains", [&]() {
+    it("returns whether every character in the given range is in the set", [&]() {
+      CharacterSet set1 = CharacterSet()
+        .include('a', 'm')
+        .include(0xa0, 0xffff);
+
+      AssertThat(set1.contains('a'), IsTrue());
+      AssertThat(set1.contains('n'), IsFalse());
+      AssertThat(set1.contains(0x100, 0xfff), IsTrue());
+      AssertThat(set1.contains('l', 0xa0), IsFalse());
+
+      CharacterSet set2 = CharacterSet()
+        .include_all()
+        .exclude('a', 'm');
+
+      AssertThat(set2.contains('a'), IsFalse());
+      AssertThat(set2.contains('n', 0xffff), IsTrue());
+      AssertThat(set2.contains('0', 'a'), IsFalse());
+    });
+  });
+
+  describe("ordering", [&]() {
+    it("orders sets by their size, and then by their characters", [&]() {
+      CharacterSet set1 = CharacterSet().include('a', 'c').include('x');
+      CharacterSet set2 = CharacterSet().include('a', 'b').include('w', 'x');
+      CharacterSet set3 = CharacterSet().include('a', 'z');
+
+      AssertThat(set1 < set2, IsTrue());
+      AssertThat(set2 < set1, IsFalse());
+      AssertThat(set1 < set3, IsTrue());
+      AssertThat(set1 < set1, IsFalse());
+    });
   });
 });
 
@@ -0,0 +1,46 @@
+#include <tree_sitter/parser.h>
+
+enum {
+  EVEN_COLUMN_BAR,
+  ODD_COLUMN_BAR,
+};
+
+void *tree_sitter_external_column_tokens_external_scanner_create() {
+  return NULL;
+}
+
+void tree_sitter_external_column_tokens_external_scanner_destroy(
+  void *payload) {}
+
+void tree_sitter_external_column_tokens_external_scanner_reset(
+  void *payload) {}
+
+unsigned tree_sitter_external_column_tokens_external_scanner_serialize(
+  void *payload,
+  char *buffer
+) { return 0; }
+
+void tree_sitter_external_column_tokens_external_scanner_deserialize(
+  void *payload,
+  const char *buffer,
+  unsigned length
+) {}
+
+bool tree_sitter_external_column_tokens_external_scanner_scan(
+  void *payload,
+  TSLexer *lexer,
+  const bool *valid_symbols
+) {
+  while (lexer->lookahead == ' ' || lexer->lookahead == '\n') {
+    lexer->advance(lexer, true);
+  }
+
+  if (lexer->lookahead == '|') {
+    uint32_t column = lexer->get_column(lexer);
+    lexer->advance(lexer, false);
+    lexer->result_symbol = column % 2 == 0 ? EVEN_COLUMN_BAR : ODD_COLUMN_BAR;
+    return true;
+  }
+
+  return false;
+}
@@ -0,0 +1,68 @@
+#include <tree_sitter/parser.h>
+#include <string.h>
+
+enum {
+  RAW_STRING,
+  EVEN_COLUMN_BAR,
+  ODD_COLUMN_BAR,
+};
+
+void *tree_sitter_external_raw_strings_external_scanner_create() {
+  return NULL;
+}
+
+void tree_sitter_external_raw_strings_external_scanner_destroy(
+  void *payload) {}
+
+void tree_sitter_external_raw_strings_external_scanner_reset(
+  void *payload) {}
+
+unsigned tree_sitter_external_raw_strings_external_scanner_serialize(
+  void *payload,
+  char *buffer
+) { return 0; }
+
+void tree_sitter_external_raw_strings_external_scanner_deserialize(
+  void *payload,
+  const char *buffer,
+  unsigned length
+) {}
+
+bool tree_sitter_external_raw_strings_external_scanner_scan(
+  void *payload,
+  TSLexer *lexer,
+  const bool *valid_symbols
+) {
+  while (lexer->lookahead == ' ' || lexer->lookahead == '\n') {
+    lexer->advance(lexer, true);
+  }
+
+  if (lexer->lookahead == '|') {
+    uint32_t column = lexer->get_column(lexer);
+    lexer->advance(lexer, false);
+    lexer->result_symbol = column % 2 == 0 ? EVEN_COLUMN_BAR : ODD_COLUMN_BAR;
+    return true;
+  }
+
+  // The contents of a raw string are consumed a chunk at a time, up to the
+  // closing backtick.
+  if (lexer->lookahead == '`') {
+    lexer->advance(lexer, false);
+    for (;;) {
+      uint32_t length;
+      const char *text = lexer->peek(lexer, &length);
+      if (length == 0) return false;
+
+      const char *end = memchr(text, '`', length);
+      if (end) {
+        lexer->advance_bytes(lexer, end - text, false);
+        lexer->advance(lexer, false);
+        lexer->result_symbol = RAW_STRING;
+        return true;
+      }
+      lexer->advance_bytes(lexer, length, false);
+    }
+  }
+
+  return false;
+}
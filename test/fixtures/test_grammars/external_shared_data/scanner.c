@@ -0,0 +1,71 @@
+#include <tree_sitter/parser.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+  KEYWORD,
+};
+
+// The keywords are stored in a table that is built once and shared by every
+// scanner.
+typedef struct {
+  char **keywords;
+  unsigned keyword_count;
+} KeywordTable;
+
+static const char *KEYWORDS[] = {"do", "else", "end", "if", "then", "while"};
+
+void *tree_sitter_external_shared_data_external_scanner_create_shared() {
+  KeywordTable *table = malloc(sizeof(KeywordTable));
+  table->keyword_count = sizeof(KEYWORDS) / sizeof(KEYWORDS[0]);
+  table->keywords = malloc(table->keyword_count * sizeof(char *));
+  for (unsigned i = 0; i < table->keyword_count; i++) {
+    table->keywords[i] = strdup(KEYWORDS[i]);
+  }
+  return table;
+}
+
+void *tree_sitter_external_shared_data_external_scanner_create_with_shared(const void *shared) {
+  return (void *)shared;
+}
+
+void tree_sitter_external_shared_data_external_scanner_destroy(void *payload) {}
+
+unsigned tree_sitter_external_shared_data_external_scanner_serialize(
+  void *payload,
+  char *buffer
+) { return 0; }
+
+void tree_sitter_external_shared_data_external_scanner_deserialize(
+  void *payload,
+  const char *buffer,
+  unsigned length
+) {}
+
+bool tree_sitter_external_shared_data_external_scanner_scan(
+  void *payload,
+  TSLexer *lexer,
+  const bool *valid_symbols
+) {
+  const KeywordTable *table = payload;
+  while (lexer->lookahead == ' ' || lexer->lookahead == '\n') {
+    lexer->advance(lexer, true);
+  }
+
+  char word[8];
+  unsigned length = 0;
+  while (lexer->lookahead >= 'a' && lexer->lookahead <= 'z') {
+    if (length == sizeof(word) - 1) return false;
+    word[length++] = lexer->lookahead;
+    lexer->advance(lexer, false);
+  }
+  word[length] = '\0';
+
+  for (unsigned i = 0; i < table->keyword_count; i++) {
+    if (strcmp(table->keywords[i], word) == 0) {
+      lexer->result_symbol = KEYWORD;
+      return true;
+    }
+  }
+  return false;
+}
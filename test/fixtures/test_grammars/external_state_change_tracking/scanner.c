@@ -0,0 +1,77 @@
+#include <tree_sitter/parser.h>
+
+enum {
+  TOGGLE,
+  MARKER,
+};
+
+// The scanner's state is a flag that each `!` flips. A `;` leaves the state as
+// it was, which the scanner reports, so that the state doesn't need to be
+// serialized again.
+typedef struct {
+  bool is_on;
+  bool is_changed;
+} Scanner;
+
+void *tree_sitter_external_state_change_tracking_external_scanner_create() {
+  Scanner *scanner = malloc(sizeof(Scanner));
+  scanner->is_on = false;
+  scanner->is_changed = false;
+  return scanner;
+}
+
+void tree_sitter_external_state_change_tracking_external_scanner_destroy(void *payload) {
+  free(payload);
+}
+
+unsigned tree_sitter_external_state_change_tracking_external_scanner_serialize(
+  void *payload,
+  char *buffer
+) {
+  Scanner *scanner = payload;
+  scanner->is_changed = false;
+  buffer[0] = scanner->is_on;
+  return 1;
+}
+
+void tree_sitter_external_state_change_tracking_external_scanner_deserialize(
+  void *payload,
+  const char *buffer,
+  unsigned length
+) {
+  Scanner *scanner = payload;
+  scanner->is_changed = false;
+  scanner->is_on = length > 0 ? buffer[0] : false;
+}
+
+bool tree_sitter_external_state_change_tracking_external_scanner_state_changed(void *payload) {
+  Scanner *scanner = payload;
+  return scanner->is_changed;
+}
+
+bool tree_sitter_external_state_change_tracking_external_scanner_scan(
+  void *payload,
+  TSLexer *lexer,
+  const bool *valid_symbols
+) {
+  Scanner *scanner = payload;
+  while (lexer->lookahead == ' ' || lexer->lookahead == '\n') {
+    lexer->advance(lexer, true);
+  }
+
+  if (lexer->lookahead == '!' && valid_symbols[TOGGLE]) {
+    lexer->advance(lexer, false);
+    scanner->is_on = !scanner->is_on;
+    scanner->is_changed = true;
+    lexer->result_symbol = TOGGLE;
+    return true;
+  }
+
+  if (lexer->lookahead == ';' && valid_symbols[MARKER]) {
+    lexer->advance(lexer, false);
+    lexer->result_symbol = MARKER;
+    return true;
+  }
+
+  return false;
+}
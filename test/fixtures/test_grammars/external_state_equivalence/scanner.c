@@ -0,0 +1,84 @@
+#include <tree_sitter/parser.h>
+
+enum {
+  OPEN_BRACE,
+  CLOSE_BRACE,
+};
+
+// The scanner tracks the nesting depth, which determines whether a closing
+// brace is valid, and the number of blocks opened so far, which doesn't
+// affect the tokens that it produces.
+typedef struct {
+  uint8_t depth;
+  uint8_t opened_count;
+} Scanner;
+
+void *tree_sitter_external_state_equivalence_external_scanner_create() {
+  Scanner *scanner = malloc(sizeof(Scanner));
+  scanner->depth = 0;
+  scanner->opened_count = 0;
+  return scanner;
+}
+
+void tree_sitter_external_state_equivalence_external_scanner_destroy(void *payload) {
+  free(payload);
+}
+
+unsigned tree_sitter_external_state_equivalence_external_scanner_serialize(
+  void *payload,
+  char *buffer
+) {
+  Scanner *scanner = payload;
+  buffer[0] = scanner->depth;
+  buffer[1] = scanner->opened_count;
+  return 2;
+}
+
+void tree_sitter_external_state_equivalence_external_scanner_deserialize(
+  void *payload,
+  const char *buffer,
+  unsigned length
+) {
+  Scanner *scanner = payload;
+  scanner->depth = length > 0 ? buffer[0] : 0;
+  scanner->opened_count = length > 1 ? buffer[1] : 0;
+}
+
+bool tree_sitter_external_state_equivalence_external_scanner_equivalent(
+  const char *buffer1,
+  unsigned length1,
+  const char *buffer2,
+  unsigned length2
+) {
+  uint8_t depth1 = length1 > 0 ? buffer1[0] : 0;
+  uint8_t depth2 = length2 > 0 ? buffer2[0] : 0;
+  return depth1 == depth2;
+}
+
+bool tree_sitter_external_state_equivalence_external_scanner_scan(
+  void *payload,
+  TSLexer *lexer,
+  const bool *valid_symbols
+) {
+  Scanner *scanner = payload;
+  while (lexer->lookahead == ' ' || lexer->lookahead == '\n') {
+    lexer->advance(lexer, true);
+  }
+
+  if (lexer->lookahead == '{' && valid_symbols[OPEN_BRACE]) {
+    lexer->advance(lexer, false);
+    scanner->depth++;
+    scanner->opened_count++;
+    lexer->result_symbol = OPEN_BRACE;
+    return true;
+  }
+
+  if (lexer->lookahead == '}' && valid_symbols[CLOSE_BRACE] && scanner->depth > 0) {
+    lexer->advance(lexer, false);
+    scanner->depth--;
+    lexer->result_symbol = CLOSE_BRACE;
+    return true;
+  }
+
+  return false;
+}
@@ -1,3 +1,5 @@
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "tree_sitter/runtime.h"
 
@@ -9,6 +11,49 @@ TSLogger logger = {
 
 extern "C" const TSLanguage *TS_LANG();
 
+#ifdef TS_SLOW_INPUT_THRESHOLD
+
+#ifndef TS_SLOW_INPUT_MEMORY_THRESHOLD
+#define TS_SLOW_INPUT_MEMORY_THRESHOLD 1024
+#endif
+
+// Inputs shorter than this are allowed a fixed amount of work, because the
+// cost of setting up a parse dominates the per-byte ratio for them.
+#define TS_SLOW_INPUT_MIN_SIZE 64
+
+// In slow-input mode, an input is a failure if the work that it takes to
+// parse, or the memory that its tree and stack hold on to, grows faster than
+// the input does. The work counts every lexed token, every version that is
+// advanced on each step of the parse loop, and every step of error recovery.
+// Aborting makes libFuzzer save the input as an artifact.
+static void check_parse_cost(TSDocument *document, size_t size) {
+  TSParseStats stats = ts_document_parse_stats(document);
+  TSParseProfile profile = ts_document_parse_profile(document);
+  TSMemoryUsage memory = ts_document_memory_usage(document);
+
+  uint64_t operation_count =
+    stats.lexed_token_count + stats.recovery_step_count + profile.step_count + profile.total_version_count;
+  uint64_t memory_bytes = memory.tree_bytes + memory.stack_bytes;
+  uint64_t scaled_size = size < TS_SLOW_INPUT_MIN_SIZE ? TS_SLOW_INPUT_MIN_SIZE : size;
+
+  bool is_slow = operation_count > TS_SLOW_INPUT_THRESHOLD * scaled_size;
+  bool is_large = memory_bytes > TS_SLOW_INPUT_MEMORY_THRESHOLD * scaled_size;
+  if (is_slow || is_large) {
+    fprintf(
+      stderr,
+      "slow input: %lu bytes, %.1f operations per byte (limit %u), %.1f memory bytes per byte (limit %u), "
+      "%u lexed tokens, %u recovery steps, %u steps, %u max versions\n",
+      (unsigned long)size,
+      (double)operation_count / scaled_size, (unsigned)TS_SLOW_INPUT_THRESHOLD,
+      (double)memory_bytes / scaled_size, (unsigned)TS_SLOW_INPUT_MEMORY_THRESHOLD,
+      stats.lexed_token_count, stats.recovery_step_count, profile.step_count, profile.max_version_count
+    );
+    abort();
+  }
+}
+
+#endif
+
 extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
   const char *str = reinterpret_cast<const char *>(data);
 
@@ -18,8 +63,15 @@ extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
 
   TSParseOptions options = {};
   options.halt_on_error = TS_HALT_ON_ERROR;
+#ifdef TS_SLOW_INPUT_THRESHOLD
+  options.enable_profiling = true;
+#endif
   ts_document_parse_with_options(document, options);
 
+#ifdef TS_SLOW_INPUT_THRESHOLD
+  check_parse_cost(document, size);
+#endif
+
   TSNode root_node = ts_document_root_node(document);
   ts_document_free(document);
 
@@ -0,0 +1,23 @@
+#include "helpers/benchmark_helpers.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+using std::vector;
+
+unsigned env_unsigned(const char *name, unsigned default_value) {
+  const char *value = getenv(name);
+  return value ? static_cast<unsigned>(strtoul(value, nullptr, 10)) : default_value;
+}
+
+double percentile(vector<double> values, double fraction) {
+  if (values.empty()) return 0;
+  std::sort(values.begin(), values.end());
+  size_t rank = static_cast<size_t>(std::ceil(fraction * values.size()));
+  return values[rank > 0 ? rank - 1 : 0];
+}
+
+double milliseconds_between(std::chrono::steady_clock::time_point start_time,
+                            std::chrono::steady_clock::time_point end_time) {
+  return std::chrono::duration<double, std::milli>(end_time - start_time).count();
+}
@@ -0,0 +1,17 @@
+#ifndef HELPERS_BENCHMARK_HELPERS_H_
+#define HELPERS_BENCHMARK_HELPERS_H_
+
+#include <chrono>
+#include <vector>
+
+// Read an unsigned setting from the environment, or return the default if the
+// variable isn't set.
+unsigned env_unsigned(const char *name, unsigned default_value);
+
+// The nearest-rank percentile of the given values, or zero if there are none.
+double percentile(std::vector<double> values, double fraction);
+
+double milliseconds_between(std::chrono::steady_clock::time_point start_time,
+                            std::chrono::steady_clock::time_point end_time);
+
+#endif  // HELPERS_BENCHMARK_HELPERS_H_
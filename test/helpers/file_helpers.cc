@@ -61,6 +61,10 @@ vector<string> list_directory(const string &path) {
   return result;
 }
 
+void make_directory(const string &path) {
+  CreateDirectory(path.c_str(), nullptr);
+}
+
 #else
 
 #include <dirent.h>
@@ -88,6 +92,10 @@ vector<string> list_directory(const string &path) {
   return result;
 }
 
+void make_directory(const string &path) {
+  mkdir(path.c_str(), 0777);
+}
+
 #endif
 
 string join_path(const vector<string> &parts) {
@@ -10,6 +10,7 @@ int get_modified_time(const std::string &path);
 std::string read_file(const std::string &path);
 void write_file(const std::string &path, const std::string &content);
 std::vector<std::string> list_directory(const std::string &path);
+void make_directory(const std::string &path);
 std::string join_path(const std::vector<std::string> &parts);
 
 #endif  // HELPERS_FILE_HELPERS_H_
@@ -141,11 +141,10 @@ static void *load_function_from_library(string library_path, string function_nam
 
 #endif
 
-static const TSLanguage *load_language(const string &source_filename,
-                                       const string &lib_filename,
-                                       const string &language_name,
-                                       string external_scanner_filename = "") {
-  string language_function_name = "tree_sitter_" + language_name;
+// Compile the parser into a library, unless the library is newer than its
+// sources.
+static void build_library(const string &source_filename, const string &lib_filename,
+                          const string &external_scanner_filename) {
   string header_dir = join_path({get_cwd(), "include"});
   int source_mtime = get_modified_time(source_filename);
   int header_mtime = get_modified_time(join_path({header_dir, "tree_sitter", "parser.h"}));
@@ -166,7 +165,14 @@ static const TSLanguage *load_language(const string &source_filename,
 
     if (status_code != 0) abort();
   }
+}
 
+static const TSLanguage *load_language(const string &source_filename,
+                                       const string &lib_filename,
+                                       const string &language_name,
+                                       string external_scanner_filename = "") {
+  string language_function_name = "tree_sitter_" + language_name;
+  build_library(source_filename, lib_filename, external_scanner_filename);
   void *language_function = load_function_from_library(lib_filename, language_function_name);
 
   return reinterpret_cast<TSLanguage *(*)()>(language_function)();
@@ -194,10 +200,7 @@ const TSLanguage *load_test_language(const string &name,
   return language;
 }
 
-const TSLanguage *load_real_language(const string &language_name) {
-  if (loaded_languages[language_name])
-    return loaded_languages[language_name];
-
+string build_real_language(const string &language_name) {
   string language_dir = join_path({"test", "fixtures", "grammars", language_name});
   string grammar_filename = join_path({language_dir, "src", "grammar.json"});
   string parser_filename = join_path({language_dir, "src", "parser.c"});
@@ -210,11 +213,11 @@ const TSLanguage *load_real_language(const string &language_name) {
   }
 
   int grammar_mtime = get_modified_time(grammar_filename);
-  if (!grammar_mtime) return nullptr;
+  if (!grammar_mtime) return "";
 
   if (libcompiler_mtime == -1) {
     libcompiler_mtime = get_modified_time(libcompiler_path);
-    if (!libcompiler_mtime) return nullptr;
+    if (!libcompiler_mtime) return "";
   }
 
   int parser_mtime = get_modified_time(parser_filename);
@@ -222,18 +225,36 @@ const TSLanguage *load_real_language(const string &language_name) {
   if (parser_mtime <= grammar_mtime || parser_mtime <= libcompiler_mtime) {
     printf("\n" "Regenerating the %s parser...\n", language_name.c_str());
 
+    // The cache is keyed by the compiler library's modification time as well
+    // as the grammar, so that changes to the compiler are never hidden by it.
+    string cache_dir = join_path({"out", "tmp", "compile-cache-" + to_string(libcompiler_mtime)});
+    make_directory("out");
+    make_directory(join_path({"out", "tmp"}));
+    make_directory(cache_dir);
+
     string grammar_json = read_file(grammar_filename);
-    TSCompileResult result = ts_compile_grammar(grammar_json.c_str());
+    TSCompileResult result = ts_compile_grammar_cached(grammar_json.c_str(), TSCompileOptions{}, cache_dir.c_str());
     if (result.error_type != TSCompileErrorTypeNone) {
       fprintf(stderr, "Failed to compile %s grammar: %s\n", language_name.c_str(), result.error_message);
-      return nullptr;
+      return "";
     }
 
     write_file(parser_filename, result.code);
   }
 
   string lib_filename = join_path({"out", "tmp", language_name + dylib_extension});
-  const TSLanguage *language = load_language(parser_filename, lib_filename, language_name, external_scanner_filename);
+  build_library(parser_filename, lib_filename, external_scanner_filename);
+  return lib_filename;
+}
+
+const TSLanguage *load_real_language(const string &language_name) {
+  if (loaded_languages[language_name])
+    return loaded_languages[language_name];
+
+  string lib_filename = build_real_language(language_name);
+  if (lib_filename.empty()) return nullptr;
+  void *language_function = load_function_from_library(lib_filename, "tree_sitter_" + language_name);
+  const TSLanguage *language = reinterpret_cast<TSLanguage *(*)()>(language_function)();
   loaded_languages[language_name] = language;
   return language;
 };
@@ -7,6 +7,11 @@
 
 const TSLanguage *load_real_language(const std::string &name);
 
+// Generate and compile a real language's parser if it has changed, without
+// loading it. Returns the path of the compiled library, or an empty string if
+// the grammar could not be compiled.
+std::string build_real_language(const std::string &name);
+
 const TSLanguage *load_test_language(const std::string &name,
                                      const TSCompileResult &compile_result,
                                      std::string external_scanner_path = "");
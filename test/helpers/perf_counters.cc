@@ -0,0 +1,116 @@
+#include "helpers/perf_counters.h"
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int open_counter(uint32_t type, uint64_t config) {
+  perf_event_attr attributes;
+  memset(&attributes, 0, sizeof(attributes));
+  attributes.size = sizeof(attributes);
+  attributes.type = type;
+  attributes.config = config;
+  attributes.exclude_kernel = 1;
+  attributes.exclude_hv = 1;
+  attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+}
+
+static bool read_counter(int fd, uint64_t *value, uint64_t *enabled, uint64_t *running) {
+  uint64_t buffer[3];
+  if (read(fd, buffer, sizeof(buffer)) != sizeof(buffer)) return false;
+  *value = buffer[0];
+  *enabled = buffer[1];
+  *running = buffer[2];
+  return true;
+}
+
+PerfCounters::PerfCounters() {
+  const uint64_t l1_data_read_misses =
+    PERF_COUNT_HW_CACHE_L1D |
+    (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  fds[PerfCounterInstructions] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+  fds[PerfCounterCycles] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+  fds[PerfCounterBranchMisses] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+  fds[PerfCounterL1DataMisses] = open_counter(PERF_TYPE_HW_CACHE, l1_data_read_misses);
+  fds[PerfCounterLastLevelCacheMisses] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+  fds[PerfCounterPageFaults] = open_counter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+}
+
+PerfCounters::~PerfCounters() {
+  for (int fd : fds) {
+    if (fd >= 0) close(fd);
+  }
+}
+
+bool PerfCounters::is_available() const {
+  for (int fd : fds) {
+    if (fd >= 0) return true;
+  }
+  return false;
+}
+
+void PerfCounters::start() {
+  for (unsigned i = 0; i < PerfCounterCount; i++) {
+    if (fds[i] >= 0 && !read_counter(fds[i], &start_values[i], &start_enabled[i], &start_running[i])) {
+      close(fds[i]);
+      fds[i] = -1;
+    }
+  }
+}
+
+PerfCounterValues PerfCounters::stop() {
+  PerfCounterValues result;
+  for (unsigned i = 0; i < PerfCounterCount; i++) {
+    uint64_t value, enabled, running;
+    result.values[i] = 0;
+    result.available[i] = fds[i] >= 0 && read_counter(fds[i], &value, &enabled, &running);
+    if (!result.available[i]) continue;
+    value -= start_values[i];
+    enabled -= start_enabled[i];
+    running -= start_running[i];
+    if (running > 0 && running < enabled) {
+      value = static_cast<uint64_t>(static_cast<double>(value) * enabled / running);
+    }
+    result.values[i] = value;
+  }
+  return result;
+}
+
+#else
+
+PerfCounters::PerfCounters() {
+  for (int &fd : fds) fd = -1;
+}
+
+PerfCounters::~PerfCounters() {}
+
+bool PerfCounters::is_available() const {
+  return false;
+}
+
+void PerfCounters::start() {}
+
+PerfCounterValues PerfCounters::stop() {
+  PerfCounterValues result;
+  memset(&result, 0, sizeof(result));
+  return result;
+}
+
+#endif
+
+const char *perf_counter_name(PerfCounter counter) {
+  switch (counter) {
+    case PerfCounterInstructions: return "instructions";
+    case PerfCounterCycles: return "cycles";
+    case PerfCounterBranchMisses: return "branch_misses";
+    case PerfCounterL1DataMisses: return "l1d_misses";
+    case PerfCounterLastLevelCacheMisses: return "llc_misses";
+    case PerfCounterPageFaults: return "page_faults";
+    default: return "";
+  }
+}
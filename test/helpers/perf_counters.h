@@ -0,0 +1,42 @@
+#ifndef HELPERS_PERF_COUNTERS_H_
+#define HELPERS_PERF_COUNTERS_H_
+
+#include <cstdint>
+
+enum PerfCounter {
+  PerfCounterInstructions,
+  PerfCounterCycles,
+  PerfCounterBranchMisses,
+  PerfCounterL1DataMisses,
+  PerfCounterLastLevelCacheMisses,
+  PerfCounterPageFaults,
+  PerfCounterCount,
+};
+
+struct PerfCounterValues {
+  uint64_t values[PerfCounterCount];
+  bool available[PerfCounterCount];
+};
+
+// Hardware counters for the calling thread, read through perf_event on Linux.
+// A counter that the kernel or the hardware doesn't provide is left out, and
+// on other platforms, none are available. The counters are scaled when the
+// kernel had to multiplex them.
+class PerfCounters {
+  int fds[PerfCounterCount];
+  uint64_t start_values[PerfCounterCount];
+  uint64_t start_enabled[PerfCounterCount];
+  uint64_t start_running[PerfCounterCount];
+
+ public:
+  PerfCounters();
+  ~PerfCounters();
+
+  bool is_available() const;
+  void start();
+  PerfCounterValues stop();
+};
+
+const char *perf_counter_name(PerfCounter);
+
+#endif  // HELPERS_PERF_COUNTERS_H_
@@ -103,3 +103,16 @@ vector<ExampleEntry> examples_for_language(string language_name) {
   }
   return result;
 }
+
+vector<ExampleEntry> pathological_inputs_for_language(string language_name) {
+  vector<ExampleEntry> result;
+  string inputs_directory = join_path({"test", "fixtures", "pathological_inputs", language_name});
+  if (!file_exists(inputs_directory)) return result;
+  for (string &filename : list_directory(inputs_directory)) {
+    auto content = read_file(join_path({inputs_directory, filename}));
+    if (!content.empty()) {
+      result.push_back({filename, move(content)});
+    }
+  }
+  return result;
+}
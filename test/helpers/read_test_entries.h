@@ -18,5 +18,6 @@ struct ExampleEntry {
 std::vector<TestEntry> read_real_language_corpus(std::string name);
 std::vector<TestEntry> read_test_language_corpus(std::string name);
 std::vector<ExampleEntry> examples_for_language(std::string name);
+std::vector<ExampleEntry> pathological_inputs_for_language(std::string name);
 
 #endif
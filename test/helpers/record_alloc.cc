@@ -1,13 +1,18 @@
 #include <stdlib.h>
 #include <map>
+#include <mutex>
 #include <vector>
+#include "runtime/alloc.h"
 
+using std::lock_guard;
 using std::map;
+using std::mutex;
 using std::vector;
 
 static bool _enabled = false;
 static size_t _allocation_count = 0;
 static map<void *, size_t> _outstanding_allocations;
+static mutex _mutex;
 
 namespace record_alloc {
 
@@ -38,6 +43,7 @@ size_t allocation_count() {
 extern "C" {
 
 static void *record_allocation(void *result) {
+  lock_guard<mutex> lock(_mutex);
   if (!_enabled) return result;
   _outstanding_allocations[result] = _allocation_count;
   _allocation_count++;
@@ -45,6 +51,7 @@ static void *record_allocation(void *result) {
 }
 
 static void record_deallocation(void *pointer) {
+  lock_guard<mutex> lock(_mutex);
   auto entry = _outstanding_allocations.find(pointer);
   if (entry != _outstanding_allocations.end()) {
     _outstanding_allocations.erase(entry);
@@ -52,21 +59,21 @@ static void record_deallocation(void *pointer) {
 }
 
 void *ts_record_malloc(size_t size) {
-  return record_allocation(malloc(size));
+  return record_allocation(ts_allocator_malloc(size));
 }
 
 void *ts_record_realloc(void *pointer, size_t size) {
   record_deallocation(pointer);
-  return record_allocation(realloc(pointer, size));
+  return record_allocation(ts_allocator_realloc(pointer, size));
 }
 
 void *ts_record_calloc(size_t count, size_t size) {
-  return record_allocation(calloc(count, size));
+  return record_allocation(ts_allocator_calloc(count, size));
 }
 
 void ts_record_free(void *pointer) {
   record_deallocation(pointer);
-  free(pointer);
+  ts_allocator_free(pointer);
 }
 
 bool ts_record_allocations_toggle(bool value) {
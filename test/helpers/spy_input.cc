@@ -12,6 +12,8 @@ SpyInput::SpyInput(string content, size_t chars_per_chunk) :
   buffer(nullptr),
   byte_offset(0),
   chars_per_chunk(chars_per_chunk),
+  available_bytes(UINT32_MAX),
+  read_count(0),
   content(content),
   encoding(TSInputEncodingUTF8),
   ranges_read({}) {}
@@ -35,15 +37,25 @@ static void add_byte_range(vector<pair<uint32_t, uint32_t>> *ranges,
 
 const char * SpyInput::read(void *payload, uint32_t *bytes_read) {
   auto spy = static_cast<SpyInput *>(payload);
+  spy->read_count++;
 
   if (spy->byte_offset > spy->content.size()) {
     *bytes_read = 0;
     return "";
   }
 
+  // Reading past the available bytes blocks, as if the rest of the content
+  // hadn't arrived yet.
+  if (spy->byte_offset >= spy->available_bytes && spy->byte_offset < spy->content.size()) {
+    *bytes_read = TS_INPUT_WOULD_BLOCK;
+    return nullptr;
+  }
+
   long byte_count = string_byte_for_character(spy->encoding, spy->content, spy->byte_offset, spy->chars_per_chunk);
   if (byte_count < 0)
     byte_count = spy->content.size() - spy->byte_offset;
+  if (spy->byte_offset + byte_count > spy->available_bytes)
+    byte_count = spy->available_bytes - spy->byte_offset;
 
   string result = spy->content.substr(spy->byte_offset, byte_count);
   *bytes_read = byte_count;
@@ -31,6 +31,8 @@ class SpyInput {
   std::vector<std::string> strings_read() const;
 
   uint32_t chars_per_chunk;
+  uint32_t available_bytes;
+  uint32_t read_count;
   std::string content;
   TSInputEncoding encoding;
   std::vector<std::pair<uint32_t, uint32_t>> ranges_read;
@@ -50,7 +50,7 @@ ostream &operator<<(ostream &stream, const CharacterRange &range) {
 ostream &operator<<(ostream &stream, const CharacterSet &rule) {
   stream << "(CharacterSet";
   if (rule.includes_all) {
-    if (rule.excluded_chars.empty()) {
+    if (rule.excluded_ranges().empty()) {
       stream << " all";
     } else {
       stream << " exclude";
@@ -29,9 +29,9 @@ TreeArray *tree_array(std::vector<Tree *> trees) {
 ostream &operator<<(std::ostream &stream, const Tree *tree) {
   static TSLanguage DUMMY_LANGUAGE = {};
   static TSDocument DUMMY_DOCUMENT = {};
-  DUMMY_DOCUMENT.parser.language = &DUMMY_LANGUAGE;
+  DUMMY_DOCUMENT.language = &DUMMY_LANGUAGE;
   DUMMY_LANGUAGE.symbol_names = symbol_names;
-  TSNode node;
+  TSNode node = {};
   node.data = tree;
   return stream << string(ts_node_string(node, &DUMMY_DOCUMENT));
 }
@@ -73,6 +73,34 @@ for (auto &language_name : test_languages) {
         AssertThat(record_alloc::outstanding_allocation_indices(), IsEmpty());
       });
     }
+
+    if (!file_exists(join_path({directory_path, "scanner.c"}))) {
+      it("parses the same trees when loaded from a binary language", [&]() {
+        uint32_t length;
+        TSCompileResult compile_result = ts_compile_grammar_binary(grammar_json.c_str(), &length);
+        if (compile_result.error_type == TSCompileErrorTypeInvalidExternalToken) {
+          free(compile_result.error_message);
+          return;
+        }
+        const TSLanguage *binary_language = ts_language_load(compile_result.code, length);
+        AssertThat((void *)binary_language, !Equals<void *>(nullptr));
+
+        for (auto &entry : read_test_language_corpus(language_name)) {
+          TSDocument *document = ts_document_new();
+          ts_document_set_language(document, binary_language);
+          ts_document_set_input_string_with_length(document, entry.input.c_str(), entry.input.size());
+          ts_document_parse(document);
+          const char *node_string = ts_node_string(ts_document_root_node(document), document);
+          string result(node_string);
+          ts_free((void *)node_string);
+          ts_document_free(document);
+          AssertThat(result, Equals(entry.tree_string));
+        }
+
+        ts_language_delete(binary_language);
+        free(compile_result.code);
+      });
+    }
   });
 }
 
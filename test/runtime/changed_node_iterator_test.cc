@@ -0,0 +1,108 @@
+#include "test_helper.h"
+#include "helpers/load_language.h"
+#include "helpers/record_alloc.h"
+#include "helpers/spy_input.h"
+#include "helpers/stream_methods.h"
+
+START_TEST
+
+describe("ChangedNodeIterator", [&]() {
+  TSDocument *document;
+  TSChangedNodeIterator *iterator;
+  string text = "[1, [2, 3], {\"a\": true}]";
+
+  before_each([&]() {
+    record_alloc::start();
+    document = ts_document_new();
+    ts_document_set_language(document, load_real_language("json"));
+    ts_document_set_input_string(document, text.c_str());
+    ts_document_parse(document);
+    iterator = nullptr;
+  });
+
+  after_each([&]() {
+    if (iterator) ts_changed_node_iterator_delete(iterator);
+    ts_document_free(document);
+    record_alloc::stop();
+    AssertThat(record_alloc::outstanding_allocation_indices(), IsEmpty());
+  });
+
+  auto read_nodes = [&]() {
+    vector<string> result;
+    TSNode node;
+    while (ts_changed_node_iterator_next(iterator, &node)) {
+      result.push_back(string(ts_node_type(node, document)) + " " + to_string(ts_node_start_byte(node)));
+    }
+    return result;
+  };
+
+  auto replace_three_with_four = [&](SpyInput *input) {
+    uint32_t index = text.find("3");
+    TSInputEdit edit = {};
+    edit.start_point.column = edit.start_byte = index;
+    edit.extent_removed.column = edit.bytes_removed = 1;
+    edit.extent_added.column = edit.bytes_added = 1;
+    ts_document_edit(document, edit);
+    ts_document_set_input(document, input->input());
+  };
+
+  it("visits every visible node after the first parse, in document order", [&]() {
+    iterator = ts_changed_node_iterator_new(document);
+    vector<string> nodes = read_nodes();
+
+    vector<string> all_nodes;
+    TSTreeCursor *cursor = ts_tree_cursor_new(ts_document_root_node(document));
+    for (;;) {
+      TSNode node = ts_tree_cursor_current_node(cursor);
+      all_nodes.push_back(string(ts_node_type(node, document)) + " " + to_string(ts_node_start_byte(node)));
+      if (ts_tree_cursor_goto_first_child(cursor)) continue;
+      while (!ts_tree_cursor_goto_next_sibling(cursor) && ts_tree_cursor_goto_parent(cursor)) {}
+      if (ts_tree_cursor_current_node(cursor).data == ts_document_root_node(document).data) break;
+    }
+    ts_tree_cursor_delete(cursor);
+
+    AssertThat(nodes, Equals(all_nodes));
+    AssertThat(nodes[0], Equals("value 0"));
+    AssertThat(nodes[1], Equals("array 0"));
+  });
+
+  it("visits only the nodes that were created by the most recent parse", [&]() {
+    string new_text = text;
+    new_text.replace(text.find("3"), 1, "4");
+    SpyInput input(new_text, 3);
+    replace_three_with_four(&input);
+    ts_document_parse(document);
+
+    iterator = ts_changed_node_iterator_new(document);
+    vector<string> nodes = read_nodes();
+    AssertThat(nodes, Contains("array 0"));
+    AssertThat(nodes, Contains("array 4"));
+    AssertThat(nodes, Contains("number " + to_string(text.find("3"))));
+    AssertThat(nodes, !Contains("number 1"));
+    AssertThat(nodes, !Contains("object " + to_string(text.find("{"))));
+    AssertThat(nodes, !Contains("true " + to_string(text.find("true"))));
+  });
+
+  it("visits the nodes that contain edits that haven't been parsed yet", [&]() {
+    string new_text = text;
+    new_text.replace(text.find("3"), 1, "4");
+    SpyInput input(new_text, 3);
+    replace_three_with_four(&input);
+
+    iterator = ts_changed_node_iterator_new(document);
+    vector<string> nodes = read_nodes();
+    AssertThat(nodes, Contains("array 4"));
+    AssertThat(nodes, Contains("number " + to_string(text.find("3"))));
+    AssertThat(nodes, !Contains("number 5"));
+    AssertThat(nodes, !Contains("object " + to_string(text.find("{"))));
+  });
+
+  it("can be reset to visit the same nodes again", [&]() {
+    iterator = ts_changed_node_iterator_new(document);
+    vector<string> nodes = read_nodes();
+    ts_changed_node_iterator_reset(iterator);
+    AssertThat(read_nodes(), Equals(nodes));
+  });
+});
+
+END_TEST
@@ -1,5 +1,6 @@
 #include "test_helper.h"
 #include "runtime/alloc.h"
+#include "runtime/language.h"
 #include "helpers/record_alloc.h"
 #include "helpers/stream_methods.h"
 #include "helpers/tree_helpers.h"
@@ -8,6 +9,13 @@
 #include "helpers/stderr_logger.h"
 #include "helpers/spy_input.h"
 #include "helpers/load_language.h"
+#include "helpers/file_helpers.h"
+#include "runtime/string_input.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <thread>
+#include <atomic>
+#include <map>
 
 TSPoint point(size_t row, size_t column) {
   return TSPoint{static_cast<uint32_t>(row), static_cast<uint32_t>(column)};
@@ -41,6 +49,74 @@ describe("Document", [&]() {
     AssertThat(actual, Equals(expected));
   };
 
+  auto assert_document_tree_equals = [&](TSDocument *other_document, const string &expected) {
+    char *str = ts_node_string(ts_document_root_node(other_document), other_document);
+    string actual(str);
+    ts_free(str);
+    AssertThat(actual, Equals(expected));
+  };
+
+  auto load_state_change_tracking_language = [&]() {
+    string grammar_dir = join_path({"test", "fixtures", "test_grammars", "external_state_change_tracking"});
+    TSCompileResult compile_result = ts_compile_grammar(R"JSON({
+      "name": "external_state_change_tracking",
+      "externals": [
+        {"type": "SYMBOL", "name": "toggle"},
+        {"type": "SYMBOL", "name": "marker"}
+      ],
+      "external_state_change_tracking": true,
+      "extras": [{"type": "PATTERN", "value": "\\s"}],
+      "rules": {
+        "program": {
+          "type": "REPEAT",
+          "content": {
+            "type": "CHOICE",
+            "members": [
+              {"type": "SYMBOL", "name": "toggle"},
+              {"type": "SYMBOL", "name": "marker"},
+              {"type": "SYMBOL", "name": "word"},
+              {"type": "SYMBOL", "name": "group"}
+            ]
+          }
+        },
+        "group": {
+          "type": "SEQ",
+          "members": [
+            {"type": "STRING", "value": "("},
+            {"type": "ALIAS", "value": "key", "named": true, "content": {"type": "SYMBOL", "name": "word"}},
+            {"type": "STRING", "value": ")"}
+          ]
+        },
+        "word": {"type": "PATTERN", "value": "[a-z]+"}
+      }
+    })JSON");
+    return load_test_language(
+      "external_state_change_tracking",
+      compile_result,
+      join_path({grammar_dir, "scanner.c"})
+    );
+  };
+
+  // A version 8 language has a full parse table and a lex mode for each state,
+  // and none of the fields that were added later, such as the state change
+  // callback, the alias sequence offsets and the descendant sets. The tables
+  // are stored in the given vectors, which must outlive the language.
+  auto make_version_8_language = [&](const TSLanguage *language,
+                                     vector<uint16_t> *parse_table,
+                                     vector<TSLexMode> *lex_modes) {
+    for (TSStateId state = 0; state < language->state_count; state++) {
+      for (TSSymbol symbol = 0; symbol < language->symbol_count; symbol++) {
+        parse_table->push_back(ts_language_lookup(language, state, symbol));
+      }
+      lex_modes->push_back(ts_language_lex_mode(language, state));
+    }
+    TSLanguage result = *language;
+    result.version = TREE_SITTER_MIN_COMPATIBLE_LANGUAGE_VERSION;
+    result.parse_table = parse_table->data();
+    result.lex_modes = lex_modes->data();
+    return result;
+  };
+
   describe("set_input(input)", [&]() {
     SpyInput *spy_input;
 
@@ -76,6 +152,23 @@ describe("Document", [&]() {
         "(value (array (true) (false)))");
     });
 
+    it("handles UTF16 data containing surrogate pairs", [&]() {
+      const char16_t content[] = u"[\"a\U0001F600b\", \"\u00e9\u4e2d\", [\"\U0001F600\U0001F601\"]]";
+      spy_input->content = string((const char *)content, sizeof(content) - sizeof(char16_t));
+      spy_input->encoding = TSInputEncodingUTF16;
+
+      ts_document_set_input(document, spy_input->input());
+      ts_document_invalidate(document);
+      ts_document_parse(document);
+
+      root = ts_document_root_node(document);
+      assert_node_string_equals(
+        root,
+        "(value (array (string) (string) (array (string))))");
+      AssertThat(ts_node_end_point(root), Equals<TSPoint>({0, (uint32_t)spy_input->content.size()}));
+      AssertThat(ts_node_end_byte(ts_node_child(ts_node_child(root, 0), 1)), Equals<size_t>(2 * strlen("[\"a??b\"")));
+    });
+
     it("handles truncated UTF16 data", [&]() {
       const char content[1] = { '\0' };
       spy_input->content = string(content, sizeof(content));
@@ -162,6 +255,309 @@ describe("Document", [&]() {
     });
   });
 
+  describe("set_input_chunks(chunks, count)", [&]() {
+    before_each([&]() {
+      ts_document_set_language(document, load_real_language("json"));
+    });
+
+    it("reads the chunks as one contiguous text", [&]() {
+      vector<TSInputChunk> chunks({
+        {"[1", 2},
+        {"", 0},
+        {", {\"a", 5},
+        {"\": tr", 5},
+        {"ue}]", 4},
+      });
+
+      ts_document_set_input_chunks(document, chunks.data(), chunks.size());
+      ts_document_parse(document);
+
+      root = ts_document_root_node(document);
+      AssertThat(ts_node_end_byte(root), Equals<size_t>(16));
+      assert_node_string_equals(
+        root,
+        "(value (array (number) (object (pair (string) (true)))))");
+    });
+
+    it("seeks to arbitrary positions when reparsing after an edit", [&]() {
+      vector<TSInputChunk> chunks({{"[1, ", 4}, {"2, ", 3}, {"3, ", 3}, {"4]", 2}});
+      ts_document_set_input_chunks(document, chunks.data(), chunks.size());
+      ts_document_parse(document);
+
+      TSInputEdit edit = {};
+      edit.start_byte = 7;
+      edit.bytes_removed = 1;
+      edit.bytes_added = 4;
+      edit.start_point = {0, 7};
+      edit.extent_removed = {0, 1};
+      edit.extent_added = {0, 4};
+      ts_document_edit(document, edit);
+
+      chunks = vector<TSInputChunk>({{"[1, ", 4}, {"2, ", 3}, {"null", 4}, {", ", 2}, {"4]", 2}});
+      ts_document_set_input_chunks(document, chunks.data(), chunks.size());
+      ts_document_parse(document);
+
+      root = ts_document_root_node(document);
+      AssertThat(ts_node_end_byte(root), Equals<size_t>(15));
+      assert_node_string_equals(
+        root,
+        "(value (array (number) (number) (null) (number)))");
+    });
+  });
+
+  describe("set_included_ranges(ranges, count)", [&]() {
+    before_each([&]() {
+      ts_document_set_language(document, load_real_language("json"));
+    });
+
+    auto range_for_text = [](const string &text, const string &substring) {
+      size_t start_byte = text.find(substring);
+      size_t end_byte = start_byte + substring.size();
+      TSPoint start = {0, 0};
+      for (size_t i = 0; i < start_byte; i++) {
+        if (text[i] == '\n') start = {start.row + 1, 0}; else start.column++;
+      }
+      TSPoint end = start;
+      for (size_t i = start_byte; i < end_byte; i++) {
+        if (text[i] == '\n') end = {end.row + 1, 0}; else end.column++;
+      }
+      return TSRange{start, end, static_cast<uint32_t>(start_byte), static_cast<uint32_t>(end_byte)};
+    };
+
+    it("parses only the text within the ranges, at its original positions", [&]() {
+      string text = "<div>[1,</div>\n  <p>{\"a\": 2}]</p>";
+      SpyInput input(text, 3);
+      vector<TSRange> ranges({range_for_text(text, "[1,"), range_for_text(text, "{\"a\": 2}]")});
+      AssertThat(ts_document_set_included_ranges(document, ranges.data(), ranges.size()), IsTrue());
+      ts_document_set_input(document, input.input());
+      ts_document_parse(document);
+
+      root = ts_document_root_node(document);
+      assert_node_string_equals(
+        root,
+        "(value (array (number) (object (pair (string) (number)))))");
+
+      TSNode array = ts_node_named_child(root, 0);
+      AssertThat(ts_node_start_byte(array), Equals<size_t>(text.find("[")));
+      AssertThat(ts_node_end_byte(array), Equals<size_t>(text.find("</p>")));
+      AssertThat(ts_node_end_point(array), Equals<TSPoint>({1, 14}));
+
+      TSNode object = ts_node_named_child(array, 1);
+      AssertThat(ts_node_start_byte(object), Equals<size_t>(text.find("{")));
+      AssertThat(ts_node_start_point(object), Equals<TSPoint>({1, 5}));
+      AssertThat(ts_node_end_byte(object), Equals<size_t>(text.find("]")));
+    });
+
+    it("lexes tokens that are split across ranges as though they were contiguous", [&]() {
+      string text = "[tr---ue, fa-lse]";
+      vector<TSRange> ranges({
+        range_for_text(text, "[tr"),
+        range_for_text(text, "ue, fa"),
+        range_for_text(text, "lse]"),
+      });
+      ts_document_set_included_ranges(document, ranges.data(), ranges.size());
+      ts_document_set_input_string(document, text.c_str());
+      ts_document_parse(document);
+
+      root = ts_document_root_node(document);
+      assert_node_string_equals(root, "(value (array (true) (false)))");
+      TSNode true_node = ts_node_named_child(ts_node_named_child(root, 0), 0);
+      AssertThat(ts_node_start_byte(true_node), Equals<size_t>(1));
+      AssertThat(ts_node_end_byte(true_node), Equals<size_t>(text.find(",")));
+    });
+
+    it("parses the whole input again once the ranges are removed", [&]() {
+      string text = "[1, 2] [3]";
+      vector<TSRange> ranges({range_for_text(text, "[3]")});
+      ts_document_set_included_ranges(document, ranges.data(), ranges.size());
+      ts_document_set_input_string(document, text.c_str());
+      ts_document_parse(document);
+      root = ts_document_root_node(document);
+      assert_node_string_equals(root, "(value (array (number)))");
+      AssertThat(ts_node_start_byte(ts_node_child(root, 0)), Equals<size_t>(7));
+
+      uint32_t count;
+      AssertThat(ts_document_included_ranges(document, &count)[0].start_byte, Equals<uint32_t>(7));
+      AssertThat(count, Equals<uint32_t>(1));
+
+      ts_document_set_included_ranges(document, nullptr, 0);
+      ts_document_parse(document);
+      root = ts_document_root_node(document);
+      assert_node_string_equals(root, "(value (ERROR (array (number) (number))) (array (number)))");
+      AssertThat(ts_document_included_ranges(document, &count), Equals<const TSRange *>(nullptr));
+      AssertThat(count, Equals<uint32_t>(0));
+    });
+
+    it("rejects ranges that are out of order or that overlap", [&]() {
+      string text = "[1, 2, 3]";
+      vector<TSRange> out_of_order({range_for_text(text, "2, 3]"), range_for_text(text, "[1, ")});
+      vector<TSRange> overlapping({range_for_text(text, "[1, 2"), range_for_text(text, "2, 3]")});
+      AssertThat(ts_document_set_included_ranges(document, out_of_order.data(), 2), IsFalse());
+      AssertThat(ts_document_set_included_ranges(document, overlapping.data(), 2), IsFalse());
+
+      uint32_t count;
+      ts_document_included_ranges(document, &count);
+      AssertThat(count, Equals<uint32_t>(0));
+    });
+  });
+
+  describe("set_opaque_regions(regions, count)", [&]() {
+    TSOpaqueRegion object_region;
+
+    before_each([&]() {
+      const TSLanguage *language = load_real_language("json");
+      ts_document_set_language(document, language);
+
+      auto symbol_named = [&](const string &name) {
+        for (TSSymbol symbol = 0; symbol < ts_language_symbol_count(language); symbol++) {
+          if (ts_language_symbol_name(language, symbol) == name) return symbol;
+        }
+        return TSSymbol(0);
+      };
+      object_region = {symbol_named("object"), symbol_named("{"), symbol_named("}")};
+    });
+
+    it("represents each region as a single node with no children", [&]() {
+      ts_document_set_opaque_regions(document, &object_region, 1);
+      ts_document_set_input_string(document, "[1, {\"a\": {\"b\": \"}\"}}, 2]");
+      ts_document_parse(document);
+
+      root = ts_document_root_node(document);
+      assert_node_string_equals(root, "(value (array (number) (object) (number)))");
+
+      TSNode object = ts_node_named_child(ts_node_named_child(root, 0), 1);
+      AssertThat(ts_node_is_opaque(object), IsTrue());
+      AssertThat(ts_node_child_count(object), Equals<size_t>(0));
+      AssertThat(ts_node_start_byte(object), Equals<size_t>(4));
+      AssertThat(ts_node_end_byte(object), Equals<size_t>(21));
+      AssertThat(ts_node_is_opaque(ts_node_named_child(ts_node_named_child(root, 0), 0)), IsFalse());
+    });
+
+    it("gives each opaque node a fingerprint of the text that it skipped", [&]() {
+      ts_document_set_opaque_regions(document, &object_region, 1);
+      ts_document_set_input_string(document, "[{\"a\": 1}, {\"b\": 2}, {\"a\": 1}]");
+      ts_document_parse(document);
+
+      TSNode array = ts_node_named_child(ts_document_root_node(document), 0);
+      AssertThat(ts_node_is_opaque(ts_node_named_child(array, 0)), IsTrue());
+      uint64_t fingerprint = ts_node_fingerprint(ts_node_named_child(array, 0));
+      AssertThat(ts_node_fingerprint(ts_node_named_child(array, 1)), !Equals(fingerprint));
+      AssertThat(ts_node_fingerprint(ts_node_named_child(array, 2)), Equals(fingerprint));
+    });
+
+    it("parses the contents of an opaque node once it is expanded", [&]() {
+      ts_document_set_opaque_regions(document, &object_region, 1);
+      ts_document_set_input_string(document, "[1, {\"a\": {\"b\": \"}\"}}, 2]");
+      ts_document_parse(document);
+
+      root = ts_document_root_node(document);
+      ts_document_expand_opaque_node(document, ts_node_named_child(ts_node_named_child(root, 0), 1));
+      ts_document_parse(document);
+
+      root = ts_document_root_node(document);
+      assert_node_string_equals(root, "(value (array (number) (object (pair (string) (object))) (number)))");
+      TSNode object = ts_node_named_child(ts_node_named_child(root, 0), 1);
+      AssertThat(ts_node_is_opaque(object), IsFalse());
+      TSNode inner_object = ts_node_named_child(ts_node_named_child(object, 0), 1);
+      AssertThat(ts_node_is_opaque(inner_object), IsTrue());
+    });
+
+    it("keeps expanded regions expanded when the text before them is edited", [&]() {
+      string text = "[1, {\"a\": 2}]";
+      ts_document_set_opaque_regions(document, &object_region, 1);
+      ts_document_set_input_string(document, text.c_str());
+      ts_document_parse(document);
+
+      root = ts_document_root_node(document);
+      ts_document_expand_opaque_node(document, ts_node_named_child(ts_node_named_child(root, 0), 1));
+
+      text.insert(1, "0, ");
+      ts_document_set_input_string(document, text.c_str());
+      TSInputEdit edit = {};
+      edit.start_point.column = edit.start_byte = 1;
+      edit.extent_added.column = edit.bytes_added = 3;
+      ts_document_edit(document, edit);
+      ts_document_parse(document);
+
+      root = ts_document_root_node(document);
+      assert_node_string_equals(root, "(value (array (number) (number) (object (pair (string) (number)))))");
+    });
+
+    it("parses regions in full once the regions are removed", [&]() {
+      ts_document_set_opaque_regions(document, &object_region, 1);
+      ts_document_set_input_string(document, "[{\"a\": 1}]");
+      ts_document_parse(document);
+      assert_node_string_equals(ts_document_root_node(document), "(value (array (object)))");
+
+      ts_document_set_opaque_regions(document, nullptr, 0);
+      ts_document_parse(document);
+      assert_node_string_equals(ts_document_root_node(document), "(value (array (object (pair (string) (number)))))");
+    });
+  });
+
+  describe("set_input_path(path)", [&]() {
+    string path = join_path({"out", "tmp", "document-input.json"});
+
+    before_each([&]() {
+      ts_document_set_language(document, load_real_language("json"));
+    });
+
+    it("parses the contents of the file", [&]() {
+      write_file(path, "[1, {\"a\": true}]");
+      AssertThat(ts_document_set_input_path(document, path.c_str()), IsTrue());
+      ts_document_parse(document);
+
+      root = ts_document_root_node(document);
+      assert_node_string_equals(
+        root,
+        "(value (array (number) (object (pair (string) (true)))))");
+    });
+
+    it("handles empty files", [&]() {
+      write_file(path, "");
+      AssertThat(ts_document_set_input_path(document, path.c_str()), IsTrue());
+      ts_document_parse(document);
+
+      root = ts_document_root_node(document);
+      AssertThat(ts_node_end_byte(root), Equals<size_t>(0));
+    });
+
+    it("can read from an open file descriptor", [&]() {
+      write_file(path, "[null]");
+      int fd = open(path.c_str(), O_RDONLY);
+      AssertThat(ts_document_set_input_file(document, fd), IsTrue());
+      close(fd);
+      ts_document_parse(document);
+
+      root = ts_document_root_node(document);
+      assert_node_string_equals(root, "(value (array (null)))");
+    });
+
+    it("can read a range of a file that starts partway through a page", [&]() {
+      string prefix(5000, 'x');
+      write_file(path, prefix + "[1, 2]" + "trailing");
+      int fd = open(path.c_str(), O_RDONLY);
+      AssertThat(ts_document_set_input_file_range(document, fd, prefix.size() + 100, 6), IsFalse());
+      AssertThat(ts_document_set_input_file_range(document, fd, prefix.size(), 6), IsTrue());
+      close(fd);
+      ts_document_parse(document);
+
+      root = ts_document_root_node(document);
+      assert_node_string_equals(root, "(value (array (number) (number)))");
+      AssertThat(ts_node_end_byte(root), Equals<size_t>(6));
+      AssertThat(ts_document_base_byte(document), Equals<uint64_t>(prefix.size()));
+    });
+
+    it("returns false and keeps the previous input when the file can't be opened", [&]() {
+      ts_document_set_input_string(document, "[true]");
+      AssertThat(ts_document_set_input_path(document, "out/tmp/nonexistent.json"), IsFalse());
+      ts_document_parse(document);
+
+      root = ts_document_root_node(document);
+      assert_node_string_equals(root, "(value (array (true)))");
+    });
+  });
+
   describe("set_language(language)", [&]() {
     before_each([&]() {
       ts_document_set_input_string(document, "{\"key\": [1, 2]}\n");
@@ -202,6 +598,127 @@ describe("Document", [&]() {
       ts_document_set_language(document, &language);
       AssertThat(ts_document_language(document), Equals<const TSLanguage *>(nullptr));
     });
+
+    it("allows setting a language that was generated for an older compatible version", [&]() {
+      TSLanguage language = *load_real_language("json");
+      language.version = TREE_SITTER_MIN_COMPATIBLE_LANGUAGE_VERSION;
+
+      ts_document_set_language(document, &language);
+      AssertThat(ts_document_language(document), Equals<const TSLanguage *>(&language));
+      AssertThat(
+        ts_language_symbol_for_name(&language, "array", 5, true),
+        Equals(ts_language_symbol_for_name(load_real_language("json"), "array", 5, true))
+      );
+
+      ts_document_set_language(document, load_real_language("json"));
+      AssertThat(ts_document_language(document), Equals(load_real_language("json")));
+    });
+
+    it("parses with a language that was generated for an older compatible version", [&]() {
+      const TSLanguage *language = load_state_change_tracking_language();
+      vector<uint16_t> parse_table;
+      vector<TSLexMode> lex_modes;
+      TSLanguage old_language = make_version_8_language(language, &parse_table, &lex_modes);
+
+      TSParseOptions options = {};
+      options.enable_profiling = true;
+      vector<unsigned> serialize_counts;
+      for (const TSLanguage *parsed_language : vector<const TSLanguage *>({language, &old_language})) {
+        ts_document_set_language(document, parsed_language);
+        AssertThat(ts_document_language(document), Equals(parsed_language));
+        ts_document_set_input_string(document, "; a ; ! (b) ; ; ! ;");
+        ts_document_parse_with_options(document, options);
+
+        root = ts_document_root_node(document);
+        assert_node_string_equals(
+          root,
+          "(program (marker) (word) (marker) (toggle) (group (key)) (marker) (marker) (toggle) (marker))");
+        serialize_counts.push_back(ts_document_parse_profile(document).external_serialize.count);
+
+        TSSymbol key = ts_language_symbol_for_name(parsed_language, "key", 3, true);
+        TSSymbolIterator *iterator = ts_symbol_iterator_new(root, &key, 1);
+        TSNode node;
+        AssertThat(ts_symbol_iterator_next(iterator, &node), IsTrue());
+        AssertThat(ts_node_start_byte(node), Equals(9u));
+        AssertThat(ts_symbol_iterator_next(iterator, &node), IsFalse());
+        ts_symbol_iterator_delete(iterator);
+      }
+
+      // Without the state change callback, the scanner's state is serialized
+      // after every external token.
+      AssertThat(serialize_counts, Equals(vector<unsigned>({2, 7})));
+    });
+  });
+
+  describe("fork()", [&]() {
+    it("shares the document's tree, so that the fork's first parse is incremental", [&]() {
+      ts_document_set_language(document, load_real_language("json"));
+      ts_document_set_input_string(document, "{\"key\": [1, 2]}");
+      ts_document_parse(document);
+
+      TSDocument *fork = ts_document_fork(document);
+      SpyInput input("{\"key\": [null, 2]}", 3);
+      ts_document_set_input(fork, input.input());
+
+      // Insert 'null', delete '1'.
+      TSInputEdit edit = {};
+      edit.start_point.column = edit.start_byte = strlen("{\"key\": [");
+      edit.extent_added.column = edit.bytes_added = 4;
+      edit.extent_removed.column = edit.bytes_removed = 1;
+      ts_document_edit(fork, edit);
+      ts_document_parse(fork);
+
+      assert_node_string_equals(
+        ts_document_root_node(fork),
+        "(value (object (pair (string) (array (null) (number)))))");
+      AssertThat(input.strings_read(), Equals(vector<string>({" [null, 2" })));
+
+      // Each document keeps its own tree, and the trees that they share
+      // outlive the document that they came from.
+      assert_node_string_equals(
+        ts_document_root_node(document),
+        "(value (object (pair (string) (array (number) (number)))))");
+      ts_document_free(document);
+      document = ts_document_new();
+      assert_node_string_equals(
+        ts_document_root_node(fork),
+        "(value (object (pair (string) (array (null) (number)))))");
+      ts_document_free(fork);
+    });
+  });
+
+  describe("DocumentGroup", [&]() {
+    it("reuses the nodes freed by one of its documents in another's parses", [&]() {
+      string text = "[";
+      for (unsigned i = 0; i < 100; i++) text += "{\"key\": [1, 2, 3]},\n";
+      text += "{}]";
+
+      TSDocumentGroup *group = ts_document_group_new(load_real_language("json"));
+      AssertThat(ts_document_group_language(group), Equals(load_real_language("json")));
+
+      TSDocument *first_document = ts_document_group_new_document(group);
+      ts_document_set_input_string(first_document, text.c_str());
+      ts_document_parse(first_document);
+      ts_document_set_input_string(first_document, "[1, 2]");
+      ts_document_parse(first_document);
+      size_t free_tree_bytes = ts_document_memory_usage(first_document).free_tree_bytes;
+      AssertThat(free_tree_bytes, IsGreaterThan(0u));
+
+      TSDocument *second_document = ts_document_group_new_document(group);
+      AssertThat(ts_document_language(second_document), Equals(load_real_language("json")));
+      AssertThat(ts_document_memory_usage(second_document).free_tree_bytes, Equals(free_tree_bytes));
+      ts_document_set_input_string(second_document, text.c_str());
+      ts_document_parse(second_document);
+      AssertThat(ts_document_memory_usage(first_document).free_tree_bytes, IsLessThan(free_tree_bytes));
+      ts_document_free(first_document);
+
+      // The documents can outlive the group.
+      ts_document_group_delete(group);
+      assert_node_string_equals(
+        ts_node_child(ts_node_child(ts_document_root_node(second_document), 0), 1),
+        "(object (pair (string) (array (number) (number) (number))))");
+      ts_document_free(second_document);
+    });
   });
 
   describe("set_logger(TSLogger)", [&]() {
@@ -306,6 +823,17 @@ describe("Document", [&]() {
       })));
     });
 
+    it("reports the byte offsets of each range along with its points", [&]() {
+      // Replace `null` with `nothing`
+      auto ranges = get_invalidated_ranges_for_edit([&]() {
+        return input->replace(input->content.find("ull"), 1, "othing");
+      });
+
+      AssertThat(ranges.size(), Equals<size_t>(1));
+      AssertThat(ranges[0].start_byte, Equals(input->content.find("nothing")));
+      AssertThat(ranges[0].end_byte, Equals(input->content.find("}")));
+    });
+
     it("reports no changes when leading whitespace has changed (regression)", [&]() {
       input->chars_per_chunk = 80;
 
@@ -484,6 +1012,1974 @@ describe("Document", [&]() {
         root,
         "(value (array (number) (null) (number)))");
     });
+
+    it("halts once every version's error cost is over the max_error_cost limit", [&]() {
+      string input_string = "[1, null, ";
+      for (unsigned i = 0; i < 100; i++) input_string += "} ";
+      input_string += "3]";
+      ts_document_set_language(document, load_real_language("json"));
+      ts_document_set_input_string(document, input_string.c_str());
+
+      TSParseOptions options = {};
+      options.max_error_cost = 2000;
+      ts_document_parse_with_options(document, options);
+      root = ts_document_root_node(document);
+      AssertThat(ts_document_parse_stats(document).exceeded_max_error_cost, IsTrue());
+      AssertThat(ts_node_type(root, document), Equals("ERROR"));
+      AssertThat(ts_node_end_byte(root), Equals(input_string.size()));
+
+      ts_document_invalidate(document);
+
+      options.max_error_cost = 0;
+      ts_document_parse_with_options(document, options);
+      root = ts_document_root_node(document);
+      AssertThat(ts_document_parse_stats(document).exceeded_max_error_cost, IsFalse());
+      AssertThat(ts_node_type(root, document), Equals("value"));
+    });
+
+    it("can parse code with few errors with the max_error_cost limit set", [&]() {
+      string input_string = "[1, null, error, 3]";
+      ts_document_set_language(document, load_real_language("json"));
+      ts_document_set_input_string(document, input_string.c_str());
+
+      TSParseOptions options = {};
+      options.max_error_cost = 2000;
+      ts_document_parse_with_options(document, options);
+      root = ts_document_root_node(document);
+      AssertThat(ts_document_parse_stats(document).exceeded_max_error_cost, IsFalse());
+      assert_node_string_equals(
+        root,
+        "(value (array (number) (null) (ERROR (UNEXPECTED 'e')) (number)))");
+    });
+
+    it("serves re-lexes from the input window instead of reading the input again", [&]() {
+      string input_string = "[1, null, error, {\"a\": true}, ";
+      for (unsigned i = 0; i < 20; i++) input_string += "} ";
+      input_string += "3]";
+      SpyInput input(input_string, 1);
+      ts_document_set_language(document, load_real_language("json"));
+      ts_document_set_input(document, input.input());
+
+      TSParseOptions options = {};
+      ts_document_parse_with_options(document, options);
+      char *tree_string = ts_node_string(ts_document_root_node(document), document);
+      string tree_without_window(tree_string);
+      ts_free(tree_string);
+      AssertThat(input.read_count, IsGreaterThan(input_string.size() + 1));
+
+      ts_document_invalidate(document);
+      input.read_count = 0;
+      options.input_window_bytes = 64;
+      ts_document_parse_with_options(document, options);
+      assert_node_string_equals(ts_document_root_node(document), tree_without_window);
+      AssertThat(input.read_count, Equals(input_string.size() + 1));
+    });
+
+    it("produces the same trees when the input is prefetched", [&]() {
+      string input_string = "[1, null, error, {\"a\": true}, ";
+      for (unsigned i = 0; i < 20; i++) input_string += "} ";
+      input_string += "3]";
+      SpyInput input(input_string, 3);
+      ts_document_set_language(document, load_real_language("json"));
+      ts_document_set_input(document, input.input());
+
+      TSParseOptions options = {};
+      ts_document_parse_with_options(document, options);
+      char *tree_string = ts_node_string(ts_document_root_node(document), document);
+      string tree_without_prefetch(tree_string);
+      ts_free(tree_string);
+
+      ts_document_invalidate(document);
+      options.prefetch_input = true;
+      ts_document_parse_with_options(document, options);
+      assert_node_string_equals(ts_document_root_node(document), tree_without_prefetch);
+
+      ts_document_edit(document, input.replace(input.content.find("null"), 4, "false"));
+      ts_document_parse_with_options(document, options);
+      assert_node_string_equals(
+        ts_document_root_node(document),
+        tree_without_prefetch.replace(tree_without_prefetch.find("(null)"), 6, "(false)")
+      );
+    });
+
+    describe("when the parse is cancelled", [&]() {
+      string input_string;
+
+      before_each([&]() {
+        input_string = "[";
+        for (unsigned i = 0; i < 500; i++) {
+          input_string += "{\"key\": [1, 2, 3], \"other\": null},\n";
+        }
+        input_string += "{}]";
+        ts_document_set_language(document, load_real_language("json"));
+      });
+
+      auto tree_string = [&]() {
+        char *str = ts_node_string(ts_document_root_node(document), document);
+        string result(str);
+        ts_free(str);
+        return result;
+      };
+
+      it("returns false and leaves the previous tree in place", [&]() {
+        ts_document_set_input_string(document, "[1, 2]");
+        ts_document_parse(document);
+        string previous_tree = tree_string();
+
+        ts_document_set_input_string(document, input_string.c_str());
+        bool cancelled = true;
+        TSParseOptions options = {};
+        options.cancellation_flag = &cancelled;
+        AssertThat(ts_document_parse_with_options(document, options), IsFalse());
+        AssertThat(tree_string(), Equals(previous_tree));
+
+        cancelled = false;
+        AssertThat(ts_document_parse_with_options(document, options), IsTrue());
+        root = ts_document_root_node(document);
+        AssertThat(ts_node_end_byte(root), Equals(input_string.size()));
+        AssertThat(tree_string(), !Contains("ERROR"));
+      });
+
+      it("can resume a parse that timed out, producing the same tree", [&]() {
+        ts_document_set_input_string(document, input_string.c_str());
+        ts_document_parse(document);
+        string expected_tree = tree_string();
+
+        ts_document_invalidate(document);
+        TSParseOptions options = {};
+        options.timeout_micros = 1;
+        unsigned parse_count = 1;
+        while (!ts_document_parse_with_options(document, options)) parse_count++;
+
+        AssertThat(parse_count, IsGreaterThan(1u));
+        AssertThat(tree_string(), Equals(expected_tree));
+      });
+
+      it("can spread a parse across calls that each parse a given number of bytes", [&]() {
+        ts_document_set_input_string(document, input_string.c_str());
+        ts_document_parse(document);
+        string expected_tree = tree_string();
+
+        ts_document_invalidate(document);
+        TSParseOptions options = {};
+        options.max_bytes_per_call = 1024;
+        options.thread_count = 4;
+        unsigned parse_count = 1;
+        while (!ts_document_parse_with_options(document, options)) {
+          AssertThat(ts_document_has_unfinished_parse(document), IsTrue());
+          parse_count++;
+        }
+
+        AssertThat(ts_document_has_unfinished_parse(document), IsFalse());
+        AssertThat(parse_count, IsGreaterThan(input_string.size() / 1024));
+        AssertThat(tree_string(), Equals(expected_tree));
+      });
+
+      it("discards the unfinished parse when the document is edited", [&]() {
+        SpyInput input(input_string, 64);
+        ts_document_set_input(document, input.input());
+        ts_document_parse(document);
+
+        ts_document_edit(document, input.replace(1, 0, "null, "));
+        bool cancelled = true;
+        TSParseOptions options = {};
+        options.cancellation_flag = &cancelled;
+        AssertThat(ts_document_parse_with_options(document, options), IsFalse());
+
+        ts_document_edit(document, input.replace(1, 0, "true, "));
+        cancelled = false;
+        AssertThat(ts_document_parse_with_options(document, options), IsTrue());
+        root = ts_document_root_node(document);
+        AssertThat(ts_node_end_byte(root), Equals(input.content.size()));
+        AssertThat(tree_string().find("(value (array (true) (null) (object"), Equals(0u));
+        AssertThat(tree_string(), !Contains("ERROR"));
+      });
+
+      it("stops when the input would block, and resumes once more of it is available", [&]() {
+        SpyInput input(input_string, 64);
+        input.available_bytes = 1000;
+        ts_document_set_input(document, input.input());
+
+        unsigned parse_count = 1;
+        while (!ts_document_parse_with_options(document, {})) {
+          AssertThat(ts_document_has_unfinished_parse(document), IsTrue());
+          AssertThat(ts_document_parse_stats(document).blocked_on_input, IsTrue());
+          input.available_bytes += 1000;
+          parse_count++;
+        }
+
+        AssertThat(parse_count, IsGreaterThan(input_string.size() / 1000));
+        AssertThat(ts_document_parse_stats(document).blocked_on_input, IsFalse());
+        string tree = tree_string();
+
+        ts_document_set_input_string(document, input_string.c_str());
+        ts_document_parse(document);
+        AssertThat(tree, Equals(tree_string()));
+      });
+
+      it("stops at the end of the priority range, publishing a tree that is accurate within it", [&]() {
+        SpyInput input(input_string, 64);
+        ts_document_set_input(document, input.input());
+        ts_document_parse(document);
+
+        size_t edit_position = input_string.find("1", input_string.size() / 2);
+        ts_document_edit(document, input.replace(edit_position, 1, "true"));
+        TSParseOptions options = {};
+        options.priority_end_byte = edit_position + 100;
+        AssertThat(ts_document_parse_with_options(document, options), IsFalse());
+        AssertThat(ts_document_has_unfinished_parse(document), IsTrue());
+
+        TSNode provisional_root = ts_document_provisional_root_node(document);
+        AssertThat(ts_node_end_byte(provisional_root), Equals(input.content.size()));
+        TSNode node = ts_node_named_descendant_for_byte_range(provisional_root, edit_position, edit_position);
+        AssertThat(ts_node_type(node, document), Equals("true"));
+        AssertThat(tree_string(), !Contains("(true)"));
+
+        AssertThat(ts_document_parse_with_options(document, options), IsTrue());
+        string tree = tree_string();
+        AssertThat(ts_node_eq(ts_document_provisional_root_node(document), ts_document_root_node(document)), IsTrue());
+
+        ts_document_invalidate(document);
+        ts_document_parse(document);
+        AssertThat(tree, Equals(tree_string()));
+      });
+    });
+
+    describe("when the thread_count is greater than one", [&]() {
+      before_each([&]() {
+        TSCompileResult compile_result = ts_compile_grammar(R"JSON({
+          "name": "assignments",
+
+          "extras": [
+            {"type": "PATTERN", "value": "\\s"}
+          ],
+
+          "rules": {
+            "program": {
+              "type": "REPEAT",
+              "content": {"type": "SYMBOL", "name": "assignment"}
+            },
+
+            "assignment": {
+              "type": "SEQ",
+              "members": [
+                {"type": "SYMBOL", "name": "identifier"},
+                {"type": "STRING", "value": "="},
+                {"type": "SYMBOL", "name": "_expression"},
+                {"type": "STRING", "value": ";"}
+              ]
+            },
+
+            "_expression": {
+              "type": "CHOICE",
+              "members": [
+                {"type": "SYMBOL", "name": "identifier"},
+                {"type": "SYMBOL", "name": "number"},
+                {"type": "SYMBOL", "name": "list"}
+              ]
+            },
+
+            "list": {
+              "type": "SEQ",
+              "members": [
+                {"type": "STRING", "value": "["},
+                {
+                  "type": "REPEAT",
+                  "content": {
+                    "type": "SEQ",
+                    "members": [
+                      {"type": "SYMBOL", "name": "_expression"},
+                      {"type": "STRING", "value": ","}
+                    ]
+                  }
+                },
+                {"type": "STRING", "value": "]"}
+              ]
+            },
+
+            "identifier": {"type": "PATTERN", "value": "[a-z]+"},
+            "number": {"type": "PATTERN", "value": "\\d+"}
+          }
+        })JSON");
+
+        ts_document_set_language(document, load_test_language("assignments", compile_result));
+      });
+
+      auto parse_with_thread_count = [&](const string &text, uint32_t thread_count) {
+        ts_document_set_input_string(document, text.c_str());
+        TSParseOptions options = {};
+        options.thread_count = thread_count;
+        ts_document_parse_with_options(document, options);
+        root = ts_document_root_node(document);
+        AssertThat(ts_node_end_byte(root), Equals(text.size()));
+        char *str = ts_node_string(root, document);
+        string result(str);
+        ts_free(str);
+        return result;
+      };
+
+      it("produces the same tree as a serial parse", [&]() {
+        string text;
+        for (unsigned i = 0; i < 2000; i++) {
+          text += "abc = [\n  1,\n  [def, 2,],\n];\n\nghi = 3;\n";
+        }
+
+        string serial_tree = parse_with_thread_count(text, 1);
+        AssertThat(serial_tree, !Contains("ERROR"));
+        AssertThat(parse_with_thread_count(text, 4), Equals(serial_tree));
+      });
+
+      it("re-parses chunks whose boundaries were guessed wrong", [&]() {
+        string text;
+        for (unsigned i = 0; i < 2000; i++) {
+          text += "abc = [\ndef,\n1,\n];\n";
+        }
+
+        string serial_tree = parse_with_thread_count(text, 1);
+        AssertThat(serial_tree, !Contains("ERROR"));
+        AssertThat(parse_with_thread_count(text, 4), Equals(serial_tree));
+      });
+
+      it("recovers from errors the same way as a serial parse", [&]() {
+        string text;
+        for (unsigned i = 0; i < 2000; i++) {
+          text += (i % 300 == 7) ? "abc = [1, 2;\n" : "abc = [1, 2,];\n";
+        }
+
+        string serial_tree = parse_with_thread_count(text, 1);
+        AssertThat(serial_tree, Contains("ERROR"));
+        AssertThat(parse_with_thread_count(text, 4), Equals(serial_tree));
+      });
+    });
+  });
+
+  describe("parse_with_options(options) with a changed_range_callback", [&]() {
+    struct RangeRecorder {
+      vector<TSRange> ranges;
+      size_t limit;
+    };
+
+    SpyInput *input;
+    RangeRecorder recorder;
+    TSParseOptions options;
+
+    before_each([&]() {
+      input = new SpyInput("[1, null, 2, true, 3, false]", 3);
+      ts_document_set_language(document, load_real_language("json"));
+      ts_document_set_input(document, input->input());
+      ts_document_parse(document);
+
+      vector<TSInputEdit> edits;
+      edits.push_back(input->replace(input->content.find("null"), 4, "\"a\""));
+      edits.push_back(input->replace(input->content.find("true"), 4, "{}"));
+      edits.push_back(input->replace(input->content.find("false"), 5, "[]"));
+      ts_document_edit_batch(document, edits.data(), edits.size());
+
+      recorder.ranges.clear();
+      recorder.limit = 0;
+      options = {};
+      options.changed_range_payload = &recorder;
+      options.changed_range_callback = [](void *payload, TSRange range) -> bool {
+        auto recorder = static_cast<RangeRecorder *>(payload);
+        recorder->ranges.push_back(range);
+        return recorder->ranges.size() != recorder->limit;
+      };
+    });
+
+    after_each([&]() {
+      delete input;
+    });
+
+    it("passes each changed range to the callback", [&]() {
+      AssertThat(ts_document_parse_with_options(document, options), IsTrue());
+      assert_node_string_equals(
+        ts_document_root_node(document),
+        "(value (array (number) (string) (number) (object) (number) (array)))");
+
+      AssertThat(recorder.ranges.size(), Equals<size_t>(3));
+      AssertThat(recorder.ranges[0].start_byte, Equals(input->content.find("\"a\"")));
+      AssertThat(recorder.ranges[0].end_byte, Equals(input->content.find(", 2")));
+      AssertThat(recorder.ranges[1].start_byte, Equals(input->content.find("{}")));
+      AssertThat(recorder.ranges[1].end_byte, Equals(input->content.find(", 3")));
+      AssertThat(recorder.ranges[2].start_byte, Equals(input->content.find("[]")));
+      AssertThat(recorder.ranges[2].end_byte, Equals(input->content.find("]", input->content.find("[]") + 2)));
+    });
+
+    it("stops comparing the trees once the callback returns false", [&]() {
+      recorder.limit = 2;
+      AssertThat(ts_document_parse_with_options(document, options), IsTrue());
+      assert_node_string_equals(
+        ts_document_root_node(document),
+        "(value (array (number) (string) (number) (object) (number) (array)))");
+
+      AssertThat(recorder.ranges.size(), Equals<size_t>(2));
+      AssertThat(recorder.ranges[1].start_byte, Equals(input->content.find("{}")));
+    });
+  });
+
+  describe("parse_with_options(options) with a streamed_node_callback", [&]() {
+    struct StreamedNode {
+      TSSymbol symbol;
+      uint32_t start_byte;
+      uint32_t end_byte;
+    };
+
+    vector<StreamedNode> streamed_nodes;
+    TSParseOptions options;
+    string text;
+
+    before_each([&]() {
+      text.clear();
+      for (unsigned i = 0; i < 100; i++) {
+        text += "abc" + to_string(i) + ";\n";
+      }
+
+      ts_document_set_language(document, load_real_language("javascript"));
+      ts_document_set_input_string(document, text.c_str());
+
+      streamed_nodes.clear();
+      options = {};
+      options.streamed_node_payload = &streamed_nodes;
+      options.streamed_node_callback = [](void *payload, TSNode node) {
+        auto streamed_nodes = static_cast<vector<StreamedNode> *>(payload);
+        streamed_nodes->push_back({
+          ts_node_symbol(node),
+          ts_node_start_byte(node),
+          ts_node_end_byte(node)
+        });
+      };
+    });
+
+    it("passes completed top-level nodes to the callback and drops them from the tree", [&]() {
+      AssertThat(ts_document_parse_with_options(document, options), IsTrue());
+      AssertThat(streamed_nodes.size(), IsGreaterThan<size_t>(90));
+
+      uint32_t end_byte = 0;
+      for (const StreamedNode &node : streamed_nodes) {
+        AssertThat(
+          ts_language_symbol_name(ts_document_language(document), node.symbol),
+          Equals("expression_statement"));
+        AssertThat(node.start_byte, !IsLessThan(end_byte));
+        AssertThat(text[node.start_byte], Equals('a'));
+        AssertThat(text[node.end_byte - 1], Equals(';'));
+        end_byte = node.end_byte;
+      }
+
+      TSNode root = ts_document_root_node(document);
+      AssertThat(ts_node_end_byte(root), Equals(text.size()));
+      AssertThat(ts_node_child_count(root) + streamed_nodes.size(), Equals<size_t>(100));
+    });
+
+    it("parses the whole input again on the next parse", [&]() {
+      ts_document_parse_with_options(document, options);
+      ts_document_parse(document);
+      TSNode root = ts_document_root_node(document);
+      AssertThat(ts_node_child_count(root), Equals<size_t>(100));
+      AssertThat(ts_node_has_error(root), IsFalse());
+    });
+
+    it("doesn't pass on nodes that later become part of a larger node", [&]() {
+      text.clear();
+      for (unsigned i = 0; i < 100; i++) {
+        text += "a.b(c" + to_string(i) + ");\n";
+      }
+      ts_document_set_input_string(document, text.c_str());
+
+      AssertThat(ts_document_parse_with_options(document, options), IsTrue());
+      AssertThat(streamed_nodes.size(), IsGreaterThan<size_t>(90));
+      for (const StreamedNode &node : streamed_nodes) {
+        AssertThat(
+          ts_language_symbol_name(ts_document_language(document), node.symbol),
+          Equals("expression_statement"));
+        AssertThat(text[node.start_byte], Equals('a'));
+        AssertThat(text[node.end_byte - 1], Equals(';'));
+      }
+
+      TSNode root = ts_document_root_node(document);
+      AssertThat(ts_node_child_count(root) + streamed_nodes.size(), Equals<size_t>(100));
+    });
+
+    it("doesn't let error recovery wrap the nodes that it has passed on", [&]() {
+      text.clear();
+      for (unsigned i = 0; i < 100; i++) {
+        text += (i % 10 == 5) ? ") " : "";
+        text += "a.b(c" + to_string(i) + ");\n";
+      }
+      ts_document_set_input_string(document, text.c_str());
+
+      AssertThat(ts_document_parse_with_options(document, options), IsTrue());
+      AssertThat(streamed_nodes.size(), IsGreaterThan<size_t>(0));
+
+      uint32_t end_byte = 0;
+      for (const StreamedNode &node : streamed_nodes) {
+        AssertThat(node.start_byte, !IsLessThan(end_byte));
+        end_byte = node.end_byte;
+      }
+
+      TSNode root = ts_document_root_node(document);
+      for (uint32_t i = 0, n = ts_node_child_count(root); i < n; i++) {
+        AssertThat(ts_node_start_byte(ts_node_child(root, i)), !IsLessThan(end_byte));
+      }
+    });
+  });
+
+  describe("parse_with_options(options) in append mode", [&]() {
+    SpyInput *input;
+    SpyLogger *logger;
+    TSParseOptions options;
+
+    before_each([&]() {
+      string text;
+      for (unsigned i = 0; i < 50; i++) {
+        text += "abc" + to_string(i) + ";\n";
+      }
+
+      input = new SpyInput(text, 3);
+      logger = new SpyLogger();
+      ts_document_set_language(document, load_real_language("javascript"));
+      ts_document_set_input(document, input->input());
+      ts_document_set_logger(document, logger->logger());
+      options = {};
+      options.append_mode = true;
+      ts_document_parse_with_options(document, options);
+    });
+
+    after_each([&]() {
+      delete input;
+      delete logger;
+    });
+
+    auto resumed_from_snapshot = [&]() {
+      for (const string &message : logger->messages) {
+        if (message.find("resume_from_snapshot") == 0) return true;
+      }
+      return false;
+    };
+
+    auto assert_same_tree_as_full_parse = [&]() {
+      TSDocument *other_document = ts_document_new();
+      ts_document_set_language(other_document, load_real_language("javascript"));
+      ts_document_set_input_string(other_document, input->content.c_str());
+      ts_document_parse(other_document);
+      char *expected_string = ts_node_string(ts_document_root_node(other_document), other_document);
+      assert_node_string_equals(ts_document_root_node(document), expected_string);
+      ts_free(expected_string);
+      ts_document_free(other_document);
+    };
+
+    it("resumes from a snapshot near the end of the previous parse when text is appended", [&]() {
+      for (unsigned i = 0; i < 5; i++) {
+        logger->clear();
+        ts_document_edit(document, input->replace(input->content.size(), 0, "xyz" + to_string(i) + ";\n"));
+        ts_document_parse_with_options(document, options);
+        AssertThat(resumed_from_snapshot(), IsTrue());
+        assert_same_tree_as_full_parse();
+      }
+
+      // A token that the snapshot depends on can be extended by appended text.
+      logger->clear();
+      ts_document_edit(document, input->replace(input->content.size(), 0, "xyz"));
+      ts_document_parse_with_options(document, options);
+      ts_document_edit(document, input->replace(input->content.size(), 0, "123 + 4;"));
+      ts_document_parse_with_options(document, options);
+      assert_same_tree_as_full_parse();
+    });
+
+    it("parses the input as usual when it is edited before the end of the snapshot", [&]() {
+      logger->clear();
+      ts_document_edit(document, input->replace(input->content.find("abc40"), 3, "def"));
+      ts_document_edit(document, input->replace(input->content.size(), 0, "xyz;\n"));
+      ts_document_parse_with_options(document, options);
+      AssertThat(resumed_from_snapshot(), IsFalse());
+      assert_same_tree_as_full_parse();
+    });
+  });
+
+  describe("parse_with_options(options) with an event_handler", [&]() {
+    vector<string> events;
+    TSParseOptions options;
+
+    before_each([&]() {
+      events.clear();
+      options = {};
+      options.event_handler.payload = &events;
+      options.event_handler.shift = [](void *payload, TSSymbol symbol, uint32_t start_byte, uint32_t end_byte) {
+        static_cast<vector<string> *>(payload)->push_back(
+          "shift " + to_string(symbol) + " " + to_string(start_byte) + " " + to_string(end_byte)
+        );
+      };
+      options.event_handler.reduce = [](void *payload, TSSymbol symbol, uint32_t start_byte, uint32_t end_byte,
+                                        uint32_t child_count) {
+        static_cast<vector<string> *>(payload)->push_back(
+          "reduce " + to_string(symbol) + " " + to_string(start_byte) + " " + to_string(end_byte) +
+          " " + to_string(child_count)
+        );
+      };
+    });
+
+    auto expected_events = [&]() {
+      vector<string> result;
+      std::function<void(TSNode)> visit = [&](TSNode node) {
+        uint32_t child_count = ts_node_child_count(node);
+        for (uint32_t i = 0; i < child_count; i++) visit(ts_node_child(node, i));
+        string range = to_string(ts_node_start_byte(node)) + " " + to_string(ts_node_end_byte(node));
+        if (child_count == 0) {
+          result.push_back("shift " + to_string(ts_node_symbol(node)) + " " + range);
+        } else {
+          result.push_back("reduce " + to_string(ts_node_symbol(node)) + " " + range + " " + to_string(child_count));
+        }
+      };
+      visit(ts_document_root_node(document));
+      return result;
+    };
+
+    it("reports a shift or a reduce for each visible node, in post-order", [&]() {
+      ts_document_set_language(document, load_real_language("json"));
+      ts_document_set_input_string(document, "[1, [2, 3], {\"a\": true}]");
+      AssertThat(ts_document_parse_with_options(document, options), IsTrue());
+      AssertThat(ts_document_root_node(document).data, Equals<const void *>(nullptr));
+
+      ts_document_parse(document);
+      AssertThat(events, Equals(expected_events()));
+    });
+
+    it("reports the nodes that were streamed before the end of the parse", [&]() {
+      string text;
+      for (unsigned i = 0; i < 100; i++) {
+        text += "abc" + to_string(i) + " = [" + to_string(i) + "];\n";
+      }
+
+      ts_document_set_language(document, load_real_language("javascript"));
+      ts_document_set_input_string(document, text.c_str());
+      AssertThat(ts_document_parse_with_options(document, options), IsTrue());
+
+      ts_document_parse(document);
+      AssertThat(events, Equals(expected_events()));
+    });
+  });
+
+  describe("parse_with_options(options) with a tree_builder", [&]() {
+    struct BuiltNode {
+      TSSymbol symbol;
+      uint32_t start_byte;
+      uint32_t end_byte;
+      vector<BuiltNode *> children;
+    };
+
+    struct Builder {
+      size_t live_count;
+      BuiltNode *root;
+    };
+
+    Builder builder;
+    TSParseOptions options;
+
+    before_each([&]() {
+      builder = {0, nullptr};
+      options = {};
+      options.tree_builder.payload = &builder;
+      options.tree_builder.leaf = [](void *payload, TSSymbol symbol, uint32_t start_byte, uint32_t end_byte) -> void * {
+        static_cast<Builder *>(payload)->live_count++;
+        return new BuiltNode{symbol, start_byte, end_byte, {}};
+      };
+      options.tree_builder.node = [](void *payload, TSSymbol symbol, uint32_t start_byte, uint32_t end_byte,
+                                     void **children, uint32_t child_count) -> void * {
+        static_cast<Builder *>(payload)->live_count++;
+        BuiltNode *node = new BuiltNode{symbol, start_byte, end_byte, {}};
+        for (uint32_t i = 0; i < child_count; i++) {
+          node->children.push_back(static_cast<BuiltNode *>(children[i]));
+        }
+        return node;
+      };
+      options.tree_builder.release = [](void *payload, void *object) {
+        static_cast<Builder *>(payload)->live_count--;
+        delete static_cast<BuiltNode *>(object);
+      };
+      options.tree_builder.accept = [](void *payload, void *root) {
+        static_cast<Builder *>(payload)->root = static_cast<BuiltNode *>(root);
+      };
+    });
+
+    std::function<void(BuiltNode *)> delete_built_node = [&](BuiltNode *node) {
+      for (BuiltNode *child : node->children) delete_built_node(child);
+      builder.live_count--;
+      delete node;
+    };
+
+    std::function<void(TSNode, BuiltNode *)> assert_same_tree = [&](TSNode node, BuiltNode *built_node) {
+      AssertThat(built_node->symbol, Equals(ts_node_symbol(node)));
+      AssertThat(built_node->start_byte, Equals(ts_node_start_byte(node)));
+      AssertThat(built_node->end_byte, Equals(ts_node_end_byte(node)));
+      AssertThat(built_node->children.size(), Equals(ts_node_child_count(node)));
+      for (uint32_t i = 0; i < built_node->children.size(); i++) {
+        assert_same_tree(ts_node_child(node, i), built_node->children[i]);
+      }
+    };
+
+    it("passes the caller's own tree to the accept callback", [&]() {
+      ts_document_set_language(document, load_real_language("json"));
+      ts_document_set_input_string(document, "[1, [2, 3], {\"a\": true}]");
+      AssertThat(ts_document_parse_with_options(document, options), IsTrue());
+      AssertThat(builder.root, !Equals<BuiltNode *>(nullptr));
+      AssertThat(ts_document_root_node(document).data, Equals<const void *>(nullptr));
+
+      ts_document_parse(document);
+      assert_same_tree(ts_document_root_node(document), builder.root);
+      delete_built_node(builder.root);
+      AssertThat(builder.live_count, Equals<size_t>(0));
+    });
+
+    it("releases the objects that were built for discarded interpretations", [&]() {
+      ts_document_set_language(document, load_real_language("javascript"));
+      ts_document_set_input_string(document, "a = (b, c) => d; e = (f, g); h(i)(j);");
+      AssertThat(ts_document_parse_with_options(document, options), IsTrue());
+
+      ts_document_parse(document);
+      assert_same_tree(ts_document_root_node(document), builder.root);
+      delete_built_node(builder.root);
+      AssertThat(builder.live_count, Equals<size_t>(0));
+    });
+  });
+
+  describe("edit_batch(edits, count)", [&]() {
+    it("applies all of the edits before the next parse", [&]() {
+      string text = "[";
+      for (unsigned i = 0; i < 200; i++) {
+        text += "1, \"a\", " + to_string(i) + ",\n";
+      }
+      text += "2]";
+
+      SpyInput input(text, 64);
+      ts_document_set_language(document, load_real_language("json"));
+      ts_document_set_input(document, input.input());
+      ts_document_parse(document);
+
+      // Replace every string with `null`, and insert `, true` right after
+      // every other replacement, positioning each edit within the text as it
+      // is after the preceding edits.
+      vector<TSInputEdit> edits;
+      size_t position = 0;
+      for (unsigned i = 0;; i++) {
+        position = input.content.find("\"a\"", position);
+        if (position == string::npos) break;
+        edits.push_back(input.replace(position, 3, "null"));
+        position += 4;
+        if (i % 2 == 0) {
+          edits.push_back(input.replace(position, 0, ", true"));
+          position += 6;
+        }
+      }
+      AssertThat(edits.size(), Equals(300u));
+
+      ts_document_edit_batch(document, edits.data(), edits.size());
+      ts_document_parse(document);
+      char *incremental_tree = ts_node_string(ts_document_root_node(document), document);
+
+      ts_document_invalidate(document);
+      ts_document_parse(document);
+      char *fresh_tree = ts_node_string(ts_document_root_node(document), document);
+
+      AssertThat(string(incremental_tree), Equals(string(fresh_tree)));
+      AssertThat(string(fresh_tree), !Contains("string"));
+      AssertThat(ts_node_end_byte(ts_document_root_node(document)), Equals(input.content.size()));
+      ts_free(incremental_tree);
+      ts_free(fresh_tree);
+    });
+  });
+
+  describe("edit_text(old_text, old_length, new_text, new_length, compare_lines)", [&]() {
+    string old_text, new_text;
+
+    before_each([&]() {
+      old_text = "[";
+      for (unsigned i = 0; i < 200; i++) old_text += to_string(i) + ",\n";
+      old_text += "200]";
+      new_text = old_text;
+      new_text.replace(new_text.find("\n150,"), 5, "\n\"a\", true,");
+      new_text.replace(new_text.find("\n10,"), 4, "");
+    });
+
+    // Returns the number of bytes that the incremental parse read.
+    auto assert_incremental_parse_matches_fresh_parse = [&](SpyInput &input) -> size_t {
+      ts_document_parse(document);
+      char *incremental_tree = ts_node_string(ts_document_root_node(document), document);
+      size_t byte_read_count = 0;
+      for (const string &string_read : input.strings_read()) byte_read_count += string_read.size();
+
+      ts_document_invalidate(document);
+      ts_document_parse(document);
+      char *fresh_tree = ts_node_string(ts_document_root_node(document), document);
+      AssertThat(string(incremental_tree), Equals(string(fresh_tree)));
+      ts_free(incremental_tree);
+      ts_free(fresh_tree);
+      return byte_read_count;
+    };
+
+    it("edits the text between the common start and end of the two texts", [&]() {
+      SpyInput input(old_text, 16);
+      ts_document_set_language(document, load_real_language("json"));
+      ts_document_set_input(document, input.input());
+      ts_document_parse(document);
+
+      uint32_t edit_count = ts_document_edit_text(
+        document, old_text.data(), old_text.size(), new_text.data(), new_text.size(), false);
+      AssertThat(edit_count, Equals(1u));
+      input.content = new_text;
+      input.clear();
+      AssertThat(assert_incremental_parse_matches_fresh_parse(input), IsLessThan(new_text.size()));
+    });
+
+    it("leaves out the lines that were kept between the changes when comparing lines", [&]() {
+      SpyInput input(old_text, 16);
+      ts_document_set_language(document, load_real_language("json"));
+      ts_document_set_input(document, input.input());
+      ts_document_parse(document);
+
+      uint32_t edit_count = ts_document_edit_text(
+        document, old_text.data(), old_text.size(), new_text.data(), new_text.size(), true);
+      AssertThat(edit_count, Equals(2u));
+      input.content = new_text;
+      input.clear();
+      AssertThat(assert_incremental_parse_matches_fresh_parse(input), IsLessThan(new_text.size() / 4));
+    });
+  });
+
+  describe("token_for_byte(byte), token_for_point(point)", [&]() {
+    auto token_string = [&](TSDocument *document, uint32_t byte) -> string {
+      TSToken token;
+      if (!ts_document_token_for_byte(document, byte, &token)) return "none";
+      return string(ts_language_symbol_name(ts_document_language(document), token.symbol)) + " " +
+        to_string(token.start_byte) + " " + to_string(token.end_byte);
+    };
+
+    auto assert_same_tokens_as_fresh_parse = [&](const string &text) {
+      TSDocument *fresh_document = ts_document_new();
+      ts_document_set_language(fresh_document, ts_document_language(document));
+      ts_document_set_input_string(fresh_document, text.c_str());
+      ts_document_parse(fresh_document);
+      for (uint32_t byte = 0; byte <= text.size(); byte++) {
+        AssertThat(token_string(document, byte), Equals(token_string(fresh_document, byte)));
+      }
+      ts_document_free(fresh_document);
+    };
+
+    it("finds the token that contains a byte or a point", [&]() {
+      string text = "[\n  123,\n  \"four\"\n]";
+      ts_document_set_language(document, load_real_language("json"));
+      ts_document_set_input_string(document, text.c_str());
+      ts_document_parse(document);
+
+      AssertThat(token_string(document, text.find("123") + 1), Equals("number 4 7"));
+      AssertThat(token_string(document, text.find("123") - 1), Equals("none"));
+
+      TSToken token;
+      AssertThat(ts_document_token_for_point(document, {2, 3}, &token), IsTrue());
+      AssertThat(token.start_byte, Equals(text.find("\"four\"")));
+      AssertThat(token.end_byte, Equals(text.find("\"four\"") + 6));
+    });
+
+    it("keeps the tokens up to date through edits and parses", [&]() {
+      SpyInput input("[\n  1,\n\n  \"two\",\n  3\n]", 5);
+      ts_document_set_language(document, load_real_language("json"));
+      ts_document_set_input(document, input.input());
+      ts_document_parse(document);
+      assert_same_tokens_as_fresh_parse(input.content);
+
+      vector<pair<size_t, pair<size_t, string>>> replacements({
+        {2, {2, "4"}},
+        {0, {0, "\n\n"}},
+        {6, {5, "5,\n6,\n7"}},
+        {input.content.size() - 1, {0, "\n"}},
+        {3, {8, ""}},
+      });
+      for (auto &replacement : replacements) {
+        ts_document_edit(document, input.replace(replacement.first, replacement.second.first, replacement.second.second));
+        ts_document_parse(document);
+        assert_same_tokens_as_fresh_parse(input.content);
+      }
+    });
+  });
+
+  describe("point_for_byte(byte), byte_for_point(point)", [&]() {
+    auto assert_consistent_with_text = [&](const string &text) {
+      TSPoint point = {0, 0};
+      for (uint32_t byte = 0; byte <= text.size(); byte++) {
+        AssertThat(ts_document_point_for_byte(document, byte), Equals<TSPoint>(point));
+        AssertThat(ts_document_byte_for_point(document, point), Equals(byte));
+        if (byte == text.size()) break;
+        if (text[byte] == '\n') {
+          AssertThat(ts_document_byte_for_point(document, {point.row, point.column + 10}), Equals(byte));
+          point = {point.row + 1, 0};
+        } else {
+          point.column++;
+        }
+      }
+      AssertThat(ts_document_point_for_byte(document, text.size() + 10), Equals<TSPoint>(point));
+      AssertThat(ts_document_byte_for_point(document, {point.row + 1, 0}), Equals<uint32_t>(text.size()));
+    };
+
+    it("converts between the byte offsets and points of the document's text", [&]() {
+      SpyInput input("[\n  1,\n\n  \"two\",\n  3\n]", 5);
+      ts_document_set_language(document, load_real_language("json"));
+      ts_document_set_input(document, input.input());
+      assert_consistent_with_text(input.content);
+
+      ts_document_parse(document);
+      assert_consistent_with_text(input.content);
+
+      vector<pair<size_t, pair<size_t, string>>> replacements({
+        {2, {2, "4"}},
+        {0, {0, "\n\n"}},
+        {6, {5, "5,\n6,\n7"}},
+        {input.content.size() - 1, {0, "\n"}},
+        {3, {8, ""}},
+      });
+      for (auto &replacement : replacements) {
+        ts_document_edit(document, input.replace(replacement.first, replacement.second.first, replacement.second.second));
+        assert_consistent_with_text(input.content);
+        ts_document_parse(document);
+      }
+
+      // Only the inserted text is read again, and several edits can be made
+      // before it is read.
+      input.clear();
+      ts_document_edit(document, input.replace(1, 4, "\n[\n"));
+      ts_document_edit(document, input.replace(8, 0, "8,\n"));
+      ts_document_edit(document, input.replace(2, 3, ""));
+      assert_consistent_with_text(input.content);
+      size_t byte_read_count = 0;
+      for (const string &string_read : input.strings_read()) byte_read_count += string_read.size();
+      AssertThat(byte_read_count, IsLessThan(input.content.size()));
+    });
+
+    it("measures UTF16 text in bytes", [&]() {
+      const char16_t content[] = u"[1,\n\u00e9\n]";
+      SpyInput input(string((const char *)content, sizeof(content) - sizeof(char16_t)), 3);
+      input.encoding = TSInputEncodingUTF16;
+      ts_document_set_language(document, load_real_language("json"));
+      ts_document_set_input(document, input.input());
+      ts_document_parse(document);
+
+      AssertThat(ts_document_point_for_byte(document, 6), Equals<TSPoint>({0, 6}));
+      AssertThat(ts_document_point_for_byte(document, 8), Equals<TSPoint>({1, 0}));
+      AssertThat(ts_document_point_for_byte(document, 12), Equals<TSPoint>({2, 0}));
+      AssertThat(ts_document_byte_for_point(document, {1, 2}), Equals<uint32_t>(10));
+      AssertThat(ts_document_byte_for_point(document, {1, 5}), Equals<uint32_t>(10));
+      AssertThat(ts_document_byte_for_point(document, {2, 5}), Equals<uint32_t>(14));
+    });
+  });
+
+  describe("start_edit_log(), translate_position(byte, point)", [&]() {
+    it("translates positions from before the edits into the current text", [&]() {
+      SpyInput input("[\n  1,\n  \"two\",\n  3\n]", 5);
+      ts_document_set_language(document, load_real_language("json"));
+      ts_document_set_input(document, input.input());
+      ts_document_parse(document);
+      ts_document_start_edit_log(document);
+
+      TSNode array = ts_node_named_child(ts_document_root_node(document), 0);
+      TSNode one = ts_node_named_child(array, 0);
+      TSNode two = ts_node_named_child(array, 1);
+      TSNode three = ts_node_named_child(array, 2);
+      uint32_t bytes[] = {ts_node_start_byte(one), ts_node_start_byte(two) + 1, ts_node_start_byte(three)};
+      TSPoint points[] = {ts_node_start_point(one), {2, 3}, ts_node_start_point(three)};
+
+      ts_document_edit(document, input.replace(0, 0, "\n\n"));
+      ts_document_edit(document, input.replace(11, 5, "0"));
+      ts_document_parse(document);
+      AssertThat(input.content, Equals("\n\n[\n  1,\n  0,\n  3\n]"));
+
+      uint32_t byte = bytes[0];
+      TSPoint point = points[0];
+      AssertThat(ts_document_translate_position(document, &byte, &point), IsTrue());
+      AssertThat(byte, Equals<uint32_t>(6));
+      AssertThat(point, Equals<TSPoint>({3, 2}));
+
+      // A position inside the removed string is moved to its replacement.
+      byte = bytes[1];
+      point = points[1];
+      AssertThat(ts_document_translate_position(document, &byte, &point), IsFalse());
+      AssertThat(byte, Equals<uint32_t>(11));
+      AssertThat(point, Equals<TSPoint>({4, 2}));
+
+      ts_document_translate_positions(document, bytes, points, 3);
+      AssertThat(vector<uint32_t>(bytes, bytes + 3), Equals(vector<uint32_t>({6, 11, 16})));
+      AssertThat(vector<TSPoint>(points, points + 3), Equals(vector<TSPoint>({{3, 2}, {4, 2}, {5, 2}})));
+
+      // Edits are only recorded while the log is started.
+      ts_document_stop_edit_log(document);
+      ts_document_edit(document, input.replace(0, 2, ""));
+      byte = 6;
+      point = {3, 2};
+      AssertThat(ts_document_translate_position(document, &byte, &point), IsTrue());
+      AssertThat(byte, Equals<uint32_t>(6));
+    });
+  });
+
+  describe("snapshot()", [&]() {
+    it("is unaffected by subsequent edits and parses", [&]() {
+      SpyInput input("[1, 2]", 3);
+      ts_document_set_language(document, load_real_language("json"));
+      ts_document_set_input(document, input.input());
+      ts_document_parse(document);
+
+      TSDocumentSnapshot *snapshot = ts_document_snapshot(document);
+      TSNode snapshot_root = ts_document_snapshot_root_node(snapshot);
+      assert_node_string_equals(snapshot_root, "(value (array (number) (number)))");
+
+      ts_document_edit(document, input.replace(1, 0, "null, "));
+      TSNode snapshot_number = ts_node_named_child(ts_node_named_child(snapshot_root, 0), 0);
+      AssertThat(ts_node_start_byte(snapshot_number), Equals(1u));
+      AssertThat(ts_node_has_changes(snapshot_root), IsFalse());
+      AssertThat(ts_node_has_changes(ts_document_root_node(document)), IsTrue());
+
+      ts_document_parse(document);
+      assert_node_string_equals(
+        ts_document_root_node(document),
+        "(value (array (null) (number) (number)))");
+      assert_node_string_equals(snapshot_root, "(value (array (number) (number)))");
+      AssertThat(ts_node_end_byte(snapshot_root), Equals(6u));
+
+      ts_document_snapshot_delete(snapshot);
+      ts_document_edit(document, input.undo());
+      ts_document_parse(document);
+      assert_node_string_equals(
+        ts_document_root_node(document),
+        "(value (array (number) (number)))");
+    });
+  });
+
+  describe("node_for_id(id)", [&]() {
+    it("finds the nodes whose trees were reused by later parses, at their new positions", [&]() {
+      SpyInput input("[{\"a\": 1}, [2, 3]]", 3);
+      ts_document_set_language(document, load_real_language("json"));
+      ts_document_set_input(document, input.input());
+      ts_document_parse(document);
+
+      TSNode array = ts_node_named_child(ts_document_root_node(document), 0);
+      TSNodeId object_id = ts_node_id(ts_node_named_child(array, 0));
+      TSNodeId inner_array_id = ts_node_id(ts_node_named_child(array, 1));
+      TSNodeId number_id = ts_node_id(ts_node_named_child(ts_node_named_child(array, 1), 1));
+      AssertThat(ts_node_start_byte(ts_document_node_for_id(document, inner_array_id)), Equals(11u));
+
+      ts_document_edit(document, input.replace(1, 0, "null, "));
+      ts_document_parse(document);
+      assert_node_string_equals(
+        ts_document_root_node(document),
+        "(value (array (null) (object (pair (string) (number))) (array (number) (number))))");
+
+      TSNode object = ts_document_node_for_id(document, object_id);
+      AssertThat(ts_node_type(object, document), Equals("object"));
+      AssertThat(ts_node_start_byte(object), Equals(7u));
+      TSNode number = ts_document_node_for_id(document, number_id);
+      AssertThat(ts_node_type(number, document), Equals("number"));
+      AssertThat(ts_node_start_byte(number), Equals(21u));
+      AssertThat(ts_node_id(number).tree, Equals(number_id.tree));
+    });
+
+    it("returns a null node for nodes that were replaced", [&]() {
+      SpyInput input("[1, [2, 3]]", 3);
+      ts_document_set_language(document, load_real_language("json"));
+      ts_document_set_input(document, input.input());
+      ts_document_parse(document);
+
+      TSNode array = ts_node_named_child(ts_document_root_node(document), 0);
+      TSNodeId inner_array_id = ts_node_id(ts_node_named_child(array, 1));
+      TSNodeId first_number_id = ts_node_id(ts_node_named_child(array, 0));
+
+      ts_document_edit(document, input.replace(8, 1, "4"));
+      ts_document_parse(document);
+
+      AssertThat(ts_document_node_for_id(document, inner_array_id).data, Equals<void *>(nullptr));
+      AssertThat(ts_document_node_for_id(document, first_number_id).data, !Equals<void *>(nullptr));
+
+      TSNodeId null_id = {};
+      AssertThat(ts_document_node_for_id(document, null_id).data, Equals<void *>(nullptr));
+    });
+  });
+
+  describe("node_parent(node)", [&]() {
+    auto assert_parents_match = [&]() {
+      TSNode root = ts_document_root_node(document);
+      AssertThat(ts_document_node_parent(document, root).data, Equals<void *>(nullptr));
+
+      vector<TSNode> nodes({root});
+      while (!nodes.empty()) {
+        TSNode node = nodes.back();
+        nodes.pop_back();
+        for (uint32_t i = 0, n = ts_node_child_count(node); i < n; i++) {
+          TSNode child = ts_node_child(node, i);
+          TSNode parent = ts_document_node_parent(document, child);
+          TSNode expected_parent = ts_node_parent(child);
+          AssertThat(parent.data, Equals(expected_parent.data));
+          AssertThat(parent.data, Equals(node.data));
+          AssertThat(ts_node_start_byte(parent), Equals(ts_node_start_byte(expected_parent)));
+          AssertThat(parent.alias_symbol, Equals(expected_parent.alias_symbol));
+          nodes.push_back(child);
+        }
+      }
+    };
+
+    it("finds the same parents as ts_node_parent, through the invisible nodes", [&]() {
+      SpyInput input("x = function(a) { b(c, [d, e], {f: g}); };", 3);
+      ts_document_set_language(document, load_real_language("javascript"));
+      ts_document_set_input(document, input.input());
+      ts_document_parse(document);
+      assert_parents_match();
+
+      ts_document_edit(document, input.replace(input.content.find("d"), 1, "h(i)"));
+      ts_document_parse(document);
+      assert_parents_match();
+    });
+
+    it("finds the parents of nodes from other trees by descending from their roots", [&]() {
+      ts_document_set_language(document, load_real_language("json"));
+      ts_document_set_input_string(document, "[1, [2]]");
+      ts_document_parse(document);
+
+      TSDocument *other_document = ts_document_new();
+      ts_document_set_language(other_document, load_real_language("json"));
+      ts_document_set_input_string(other_document, "[3, [4]]");
+      ts_document_parse(other_document);
+
+      TSNode inner_array = ts_node_named_child(ts_node_named_child(ts_document_root_node(other_document), 0), 1);
+      TSNode number = ts_node_named_child(inner_array, 0);
+      AssertThat(ts_document_node_parent(document, number).data, Equals(inner_array.data));
+      ts_document_free(other_document);
+    });
+  });
+
+  describe("serialize() and deserialize(data, length)", [&]() {
+    string text;
+    char *data;
+    uint32_t length;
+
+    before_each([&]() {
+      text = "[";
+      for (unsigned i = 0; i < 100; i++) {
+        text += "{\"key\": [1, 2.5, \"three\"], \"other\": null},\n";
+      }
+      text += "{]";
+
+      ts_document_set_language(document, load_real_language("json"));
+      ts_document_set_input_string(document, text.c_str());
+      ts_document_parse(document);
+      data = ts_document_serialize(document, &length);
+    });
+
+    after_each([&]() {
+      ts_free(data);
+    });
+
+    it("restores the tree in another document", [&]() {
+      TSDocument *other_document = ts_document_new();
+      ts_document_set_language(other_document, load_real_language("json"));
+      ts_document_set_input_string(other_document, text.c_str());
+      AssertThat(ts_document_deserialize(other_document, data, length), IsTrue());
+
+      char *original_tree = ts_node_string(ts_document_root_node(document), document);
+      char *restored_tree = ts_node_string(ts_document_root_node(other_document), other_document);
+      AssertThat(string(restored_tree), Equals(string(original_tree)));
+      AssertThat(string(restored_tree), Contains("MISSING"));
+      AssertThat(ts_node_end_byte(ts_document_root_node(other_document)), Equals(text.size()));
+      ts_free(original_tree);
+      ts_free(restored_tree);
+
+      ts_document_parse(other_document);
+      AssertThat(ts_document_parse_count(other_document), Equals(0u));
+      ts_document_free(other_document);
+    });
+
+    it("allows the restored tree to be reused by an incremental parse", [&]() {
+      SpyInput input(text, 64);
+      ts_document_set_input(document, input.input());
+      AssertThat(ts_document_deserialize(document, data, length), IsTrue());
+
+      size_t position = text.find("2.5", text.size() / 2);
+      ts_document_edit(document, input.replace(position, 3, "true"));
+      ts_document_parse(document);
+      AssertThat(ts_document_parse_stats(document).reused_tree_count, IsGreaterThan(0u));
+      size_t byte_read_count = 0;
+      for (const string &string_read : input.strings_read()) byte_read_count += string_read.size();
+      AssertThat(byte_read_count, IsLessThan(text.size() / 10));
+      char *incremental_tree = ts_node_string(ts_document_root_node(document), document);
+
+      ts_document_invalidate(document);
+      ts_document_parse(document);
+      char *fresh_tree = ts_node_string(ts_document_root_node(document), document);
+
+      AssertThat(string(incremental_tree), Equals(string(fresh_tree)));
+      AssertThat(string(fresh_tree), Contains("true"));
+      ts_free(incremental_tree);
+      ts_free(fresh_tree);
+    });
+
+    it("rejects data that is malformed or was written for another language", [&]() {
+      TSNode original_root = ts_document_root_node(document);
+      AssertThat(ts_document_deserialize(document, data, length - 1), IsFalse());
+      AssertThat(ts_document_deserialize(document, data + 1, length - 1), IsFalse());
+      AssertThat(ts_document_deserialize(document, "", 0), IsFalse());
+      AssertThat(ts_node_eq(ts_document_root_node(document), original_root), IsTrue());
+
+      TSLanguage language = *load_real_language("json");
+      language.state_count++;
+      ts_document_set_language(document, &language);
+      AssertThat(ts_document_deserialize(document, data, length), IsFalse());
+
+      ts_document_set_language(document, load_real_language("json"));
+      AssertThat(ts_document_deserialize(document, data, length), IsTrue());
+      AssertThat(ts_node_end_byte(ts_document_root_node(document)), Equals(text.size()));
+    });
+
+    it("rejects data that was cut short, and safely reads data whose records are corrupt", [&]() {
+      for (uint32_t i = 0; i < length; i++) {
+        AssertThat(ts_document_deserialize(document, data, i), IsFalse());
+      }
+
+      string corrupt_data(data, length);
+      for (uint32_t i = 0; i < length; i++) {
+        for (char byte : {'\x00', '\x7f', '\xff'}) {
+          char original_byte = corrupt_data[i];
+          corrupt_data[i] = byte;
+          if (ts_document_deserialize(document, corrupt_data.data(), length)) {
+            char *restored_tree = ts_node_string(ts_document_root_node(document), document);
+            AssertThat(string(restored_tree), !Equals(""));
+            ts_free(restored_tree);
+          }
+          corrupt_data[i] = original_byte;
+        }
+      }
+    });
+  });
+
+  describe("set_parse_cache(cache)", [&]() {
+    struct MemoryParseCache {
+      std::map<uint64_t, string> entries;
+      size_t load_count = 0;
+      size_t hit_count = 0;
+
+      static const char *load(void *payload, uint64_t key, uint32_t *length) {
+        auto self = static_cast<MemoryParseCache *>(payload);
+        self->load_count++;
+        auto entry = self->entries.find(key);
+        if (entry == self->entries.end()) return nullptr;
+        self->hit_count++;
+        *length = entry->second.size();
+        return entry->second.data();
+      }
+
+      static void store(void *payload, uint64_t key, const char *data, uint32_t length) {
+        static_cast<MemoryParseCache *>(payload)->entries[key] = string(data, length);
+      }
+
+      TSParseCache cache() {
+        return TSParseCache{this, load, nullptr, store};
+      }
+    };
+
+    MemoryParseCache memory_cache;
+    string text = "[1, {\"a\": [true, null]}, \"b\"]";
+
+    before_each([&]() {
+      memory_cache = MemoryParseCache();
+      ts_document_set_language(document, load_real_language("json"));
+      ts_document_set_parse_cache(document, memory_cache.cache());
+      ts_document_set_input_string(document, text.c_str());
+      ts_document_parse(document);
+    });
+
+    auto parse_in_new_document = [&](const TSLanguage *language, const string &text, TSParseCache cache) {
+      TSDocument *other_document = ts_document_new();
+      ts_document_set_language(other_document, language);
+      ts_document_set_parse_cache(other_document, cache);
+      ts_document_set_input_string(other_document, text.c_str());
+      ts_document_parse(other_document);
+      return other_document;
+    };
+
+    it("stores the tree produced by a full parse", [&]() {
+      AssertThat(ts_document_parse_count(document), Equals(1u));
+      AssertThat(memory_cache.entries.size(), Equals<size_t>(1));
+    });
+
+    it("restores the tree for the same text instead of parsing it again", [&]() {
+      TSDocument *other_document = parse_in_new_document(load_real_language("json"), text, memory_cache.cache());
+      AssertThat(ts_document_parse_count(other_document), Equals(0u));
+      AssertThat(memory_cache.hit_count, Equals<size_t>(1));
+
+      char *original_tree = ts_node_string(ts_document_root_node(document), document);
+      char *cached_tree = ts_node_string(ts_document_root_node(other_document), other_document);
+      AssertThat(string(cached_tree), Equals(string(original_tree)));
+      ts_free(original_tree);
+      ts_free(cached_tree);
+      ts_document_free(other_document);
+    });
+
+    it("parses text or languages that haven't been cached", [&]() {
+      TSDocument *other_document = parse_in_new_document(load_real_language("json"), "[1, 2]", memory_cache.cache());
+      AssertThat(ts_document_parse_count(other_document), Equals(1u));
+      ts_document_free(other_document);
+
+      TSLanguage language = *load_real_language("json");
+      language.state_count++;
+      other_document = parse_in_new_document(&language, text, memory_cache.cache());
+      AssertThat(ts_document_parse_count(other_document), Equals(1u));
+      ts_document_free(other_document);
+
+      AssertThat(memory_cache.hit_count, Equals<size_t>(0));
+      AssertThat(memory_cache.entries.size(), Equals<size_t>(3));
+    });
+
+    it("parses the text when a cached tree is invalid", [&]() {
+      for (auto &entry : memory_cache.entries) entry.second.resize(entry.second.size() / 2);
+
+      TSDocument *other_document = parse_in_new_document(load_real_language("json"), text, memory_cache.cache());
+      AssertThat(ts_document_parse_count(other_document), Equals(1u));
+      AssertThat(ts_node_end_byte(ts_document_root_node(other_document)), Equals(text.size()));
+      ts_document_free(other_document);
+    });
+
+    it("doesn't consult the cache for incremental parses", [&]() {
+      SpyInput input(text, 3);
+      ts_document_set_input(document, input.input());
+      ts_document_edit(document, input.replace(text.find("true"), 4, "false"));
+      ts_document_parse(document);
+
+      AssertThat(memory_cache.load_count, Equals<size_t>(1));
+      AssertThat(ts_document_parse_count(document), Equals(2u));
+      assert_node_string_equals(
+        ts_document_root_node(document),
+        "(value (array (number) (object (pair (string) (array (false) (null)))) (string)))");
+    });
+
+    it("caches the tree of a parse that is resumed", [&]() {
+      string long_text = "[";
+      for (unsigned i = 0; i < 200; i++) long_text += "{\"a\": [true, " + to_string(i) + "]}, ";
+      long_text += "null]";
+
+      memory_cache = MemoryParseCache();
+      SpyInput input(long_text, 5);
+      ts_document_set_input(document, input.input());
+      TSParseOptions options = {};
+      options.max_bytes_per_call = 64;
+      unsigned parse_call_count = 1;
+      while (!ts_document_parse_with_options(document, options)) parse_call_count++;
+
+      AssertThat(parse_call_count, IsGreaterThan(1u));
+      AssertThat(memory_cache.load_count, Equals<size_t>(1));
+      AssertThat(memory_cache.entries.size(), Equals<size_t>(1));
+      TSNode root = ts_document_root_node(document);
+      AssertThat(ts_node_end_byte(root), Equals(long_text.size()));
+      AssertThat(ts_node_has_error(root), IsFalse());
+
+      TSDocument *other_document = parse_in_new_document(load_real_language("json"), long_text, memory_cache.cache());
+      AssertThat(ts_document_parse_count(other_document), Equals(0u));
+      AssertThat(memory_cache.hit_count, Equals<size_t>(1));
+
+      char *resumed_tree = ts_node_string(root, document);
+      char *cached_tree = ts_node_string(ts_document_root_node(other_document), other_document);
+      AssertThat(string(cached_tree), Equals(string(resumed_tree)));
+      ts_free(resumed_tree);
+      ts_free(cached_tree);
+      ts_document_free(other_document);
+    });
+
+    it("can keep the cached trees in a directory", [&]() {
+      string path = join_path({"out", "tmp", "parse-cache"});
+      TSParseCache directory_cache = ts_parse_cache_directory_new(path.c_str());
+      TSDocument *first_document = parse_in_new_document(load_real_language("json"), text, directory_cache);
+      TSDocument *second_document = parse_in_new_document(load_real_language("json"), text, directory_cache);
+      AssertThat(ts_document_parse_count(second_document), Equals(0u));
+
+      char *first_tree = ts_node_string(ts_document_root_node(first_document), first_document);
+      char *second_tree = ts_node_string(ts_document_root_node(second_document), second_document);
+      AssertThat(string(second_tree), Equals(string(first_tree)));
+      ts_free(first_tree);
+      ts_free(second_tree);
+      ts_document_free(first_document);
+      ts_document_free(second_document);
+      ts_parse_cache_directory_delete(directory_cache);
+    });
+
+    it("never exposes a partially written entry when several threads store the same key", [&]() {
+      string path = join_path({"out", "tmp", "parse-cache-threads"});
+      TSParseCache directory_cache = ts_parse_cache_directory_new(path.c_str());
+      uint64_t key = 0x7465737431;
+
+      // Each thread's entries have their own length and are filled with their
+      // own character.
+      vector<string> entries;
+      for (unsigned i = 0; i < 4; i++) entries.push_back(string(64 * 1024 + i * 4096, 'a' + i));
+
+      std::atomic<bool> is_done(false);
+      std::atomic<unsigned> invalid_entry_count(0);
+      std::thread reader([&]() {
+        while (!is_done) {
+          uint32_t length;
+          const char *data = directory_cache.load(directory_cache.payload, key, &length);
+          if (!data) continue;
+          bool is_valid = false;
+          for (const string &entry : entries) {
+            if (string(data, length) == entry) is_valid = true;
+          }
+          if (!is_valid) invalid_entry_count++;
+          directory_cache.release(directory_cache.payload, data, length);
+        }
+      });
+
+      vector<std::thread> writers;
+      for (const string &entry : entries) {
+        writers.push_back(std::thread([&]() {
+          for (unsigned i = 0; i < 50; i++) {
+            directory_cache.store(directory_cache.payload, key, entry.data(), entry.size());
+          }
+        }));
+      }
+      for (std::thread &writer : writers) writer.join();
+      is_done = true;
+      reader.join();
+
+      AssertThat(invalid_entry_count.load(), Equals(0u));
+      uint32_t length;
+      const char *data = directory_cache.load(directory_cache.payload, key, &length);
+      AssertThat((void *)data, !Equals<void *>(nullptr));
+      AssertThat(entries, Contains(string(data, length)));
+      directory_cache.release(directory_cache.payload, data, length);
+      ts_parse_cache_directory_delete(directory_cache);
+
+      // Every temporary file was either renamed into place or removed.
+      AssertThat(list_directory(path), Equals(vector<string>({"0000007465737431"})));
+    });
+  });
+
+  describe("start_background_parse(options)", [&]() {
+    string input_string;
+
+    before_each([&]() {
+      input_string = "[";
+      for (unsigned i = 0; i < 500; i++) {
+        input_string += "{\"key\": [1, 2, 3], \"other\": null},\n";
+      }
+      input_string += "{}]";
+
+      ts_document_set_language(document, load_real_language("json"));
+      ts_document_set_input_string(document, "[1, 2]");
+      ts_document_parse(document);
+    });
+
+    it("keeps acquired nodes valid after the new tree is published", [&]() {
+      TSNode old_root = ts_document_acquire_root_node(document);
+
+      ts_document_set_input_string(document, input_string.c_str());
+      ts_document_start_background_parse(document, TSParseOptions{});
+      AssertThat(ts_document_finish_background_parse(document), IsTrue());
+
+      root = ts_document_root_node(document);
+      AssertThat(ts_node_end_byte(root), Equals(input_string.size()));
+      AssertThat(root.root, !Equals(old_root.root));
+      assert_node_string_equals(old_root, "(value (array (number) (number)))");
+      ts_document_release_root_node(document, old_root);
+
+      // The replaced tree is freed by the next parse.
+      ts_document_set_input_string(document, "[true]");
+      ts_document_parse(document);
+      assert_node_string_equals(ts_document_root_node(document), "(value (array (true)))");
+    });
+
+    it("allows other threads to read the current tree during the parse", [&]() {
+      ts_document_set_input_string(document, input_string.c_str());
+      ts_document_start_background_parse(document, TSParseOptions{});
+
+      vector<std::thread> readers;
+      vector<unsigned> valid_read_counts(4, 0);
+      for (unsigned i = 0; i < 4; i++) {
+        readers.push_back(std::thread([&, i]() {
+          for (unsigned j = 0; j < 200; j++) {
+            TSNode node = ts_document_acquire_root_node(document);
+            uint32_t end_byte = ts_node_end_byte(node);
+            uint32_t element_count = ts_node_named_child_count(ts_node_named_child(node, 0));
+            if ((end_byte == 6 && element_count == 2) ||
+                (end_byte == input_string.size() && element_count == 501)) {
+              valid_read_counts[i]++;
+            }
+            ts_document_release_root_node(document, node);
+          }
+        }));
+      }
+
+      for (std::thread &reader : readers) reader.join();
+      AssertThat(ts_document_finish_background_parse(document), IsTrue());
+      AssertThat(valid_read_counts, Equals(vector<unsigned>(4, 200)));
+      AssertThat(ts_node_end_byte(ts_document_root_node(document)), Equals(input_string.size()));
+    });
+  });
+
+  describe("parse_with_parser(parser, options)", [&]() {
+    TSParser *parser;
+    TSDocument *other_document;
+
+    before_each([&]() {
+      parser = ts_parser_new();
+      other_document = ts_document_new();
+      ts_document_set_language(document, load_real_language("json"));
+
+      TSCompileResult compile_result = ts_compile_grammar(R"JSON({
+        "name": "words",
+
+        "extras": [
+          {"type": "PATTERN", "value": "\\s"}
+        ],
+
+        "rules": {
+          "program": {
+            "type": "REPEAT",
+            "content": {"type": "SYMBOL", "name": "word"}
+          },
+
+          "word": {"type": "PATTERN", "value": "[a-z]+"}
+        }
+      })JSON");
+
+      ts_document_set_language(other_document, load_test_language("words", compile_result));
+    });
+
+    after_each([&]() {
+      ts_document_free(other_document);
+      if (parser) ts_parser_delete(parser);
+    });
+
+    it("parses documents in different languages with the same parser", [&]() {
+      ts_document_set_input_string(document, "[1, null]");
+      ts_document_set_input_string(other_document, "abc def");
+      AssertThat(ts_document_parse_with_parser(document, parser, TSParseOptions{}), IsTrue());
+      AssertThat(ts_document_parse_with_parser(other_document, parser, TSParseOptions{}), IsTrue());
+
+      // The documents' trees outlive the parser that produced them.
+      ts_parser_delete(parser);
+      parser = nullptr;
+      assert_node_string_equals(ts_document_root_node(document), "(value (array (number) (null)))");
+      char *str = ts_node_string(ts_document_root_node(other_document), other_document);
+      AssertThat(string(str), Equals("(program (word) (word))"));
+      ts_free(str);
+    });
+
+    it("reuses the document's tree when it is parsed again after an edit", [&]() {
+      SpyInput input("[1, null]", 3);
+      ts_document_set_input(document, input.input());
+      ts_document_parse_with_parser(document, parser, TSParseOptions{});
+      ts_document_set_input_string(other_document, "abc");
+      ts_document_parse_with_parser(other_document, parser, TSParseOptions{});
+
+      ts_document_edit(document, input.replace(1, 1, "true"));
+      input.clear();
+      AssertThat(ts_document_parse_with_parser(document, parser, TSParseOptions{}), IsTrue());
+      assert_node_string_equals(ts_document_root_node(document), "(value (array (true) (null)))");
+      AssertThat(ts_document_parse_stats(document).reused_tree_count, IsGreaterThan(0u));
+      AssertThat(ts_document_has_unfinished_parse(document), IsFalse());
+    });
+
+    it("parses documents whose language was generated for an older version with the same parser", [&]() {
+      vector<uint16_t> parse_table;
+      vector<TSLexMode> lex_modes;
+      TSLanguage old_language = make_version_8_language(
+        load_state_change_tracking_language(), &parse_table, &lex_modes
+      );
+      string expected_tree =
+        "(program (marker) (word) (marker) (toggle) (group (key)) (marker) (marker) (toggle) (marker))";
+
+      // Each document has its own upgraded copy of the language, which is freed
+      // along with the document, while the parser lives on.
+      TSDocument *third_document = ts_document_new();
+      for (TSDocument *old_document : vector<TSDocument *>({other_document, third_document})) {
+        ts_document_set_language(old_document, &old_language);
+        ts_document_set_input_string(old_document, "; a ; ! (b) ; ; ! ;");
+        AssertThat(ts_document_parse_with_parser(old_document, parser, TSParseOptions{}), IsTrue());
+        assert_document_tree_equals(old_document, expected_tree);
+      }
+      ts_document_free(third_document);
+
+      third_document = ts_document_new();
+      ts_document_set_language(third_document, &old_language);
+      ts_document_set_input_string(third_document, "; a ; ! (b) ; ; ! ;");
+      AssertThat(ts_document_parse_with_parser(third_document, parser, TSParseOptions{}), IsTrue());
+      assert_document_tree_equals(third_document, expected_tree);
+      ts_document_free(third_document);
+
+      ts_document_set_input_string(other_document, "; a ; ! (b) ; ; ! ;");
+      AssertThat(ts_document_parse_with_parser(other_document, parser, TSParseOptions{}), IsTrue());
+      assert_document_tree_equals(other_document, expected_tree);
+    });
+
+    it("parses a document with the same parser after it switches to and from an older language", [&]() {
+      const TSLanguage *words_language = ts_document_language(other_document);
+      vector<uint16_t> parse_table;
+      vector<TSLexMode> lex_modes;
+      TSLanguage old_language = make_version_8_language(
+        load_state_change_tracking_language(), &parse_table, &lex_modes
+      );
+
+      for (unsigned i = 0; i < 3; i++) {
+        ts_document_set_language(other_document, &old_language);
+        ts_document_set_input_string(other_document, "; a ; ! (b) ; ; ! ;");
+        AssertThat(ts_document_parse_with_parser(other_document, parser, TSParseOptions{}), IsTrue());
+        assert_document_tree_equals(
+          other_document,
+          "(program (marker) (word) (marker) (toggle) (group (key)) (marker) (marker) (toggle) (marker))"
+        );
+
+        ts_document_set_language(other_document, words_language);
+        ts_document_set_input_string(other_document, "abc def");
+        AssertThat(ts_document_parse_with_parser(other_document, parser, TSParseOptions{}), IsTrue());
+        assert_document_tree_equals(other_document, "(program (word) (word))");
+      }
+    });
+
+    it("discards a parse that is cancelled instead of resuming it", [&]() {
+      ts_document_set_input_string(document, "[1, null]");
+      bool cancelled = true;
+      TSParseOptions options = {};
+      options.cancellation_flag = &cancelled;
+      AssertThat(ts_document_parse_with_parser(document, parser, options), IsFalse());
+      AssertThat(ts_document_has_unfinished_parse(document), IsFalse());
+
+      cancelled = false;
+      AssertThat(ts_document_parse_with_parser(document, parser, options), IsTrue());
+      assert_node_string_equals(ts_document_root_node(document), "(value (array (number) (null)))");
+    });
+  });
+
+  describe("ts_parse_batch(jobs, count, options, callback, payload)", [&]() {
+    vector<string> texts;
+    vector<TSParseJob> jobs;
+
+    before_each([&]() {
+      texts.clear();
+      jobs.clear();
+      for (unsigned i = 0; i < 40; i++) {
+        string text = "[";
+        for (unsigned j = 0; j < i % 7 * 50; j++) text += "1, ";
+        text += "\"" + to_string(i) + "\"]";
+        texts.push_back(text);
+      }
+      for (const string &text : texts) {
+        jobs.push_back({load_real_language("json"), ts_string_input_make(text.c_str())});
+      }
+    });
+
+    after_each([&]() {
+      for (TSParseJob &job : jobs) ts_free(job.input.payload);
+    });
+
+    auto job_callback = [](void *payload, uint32_t job_index, TSDocument *document) {
+      vector<string> *results = static_cast<vector<string> *>(payload);
+      TSNode array = ts_node_named_child(ts_document_root_node(document), 0);
+      uint32_t element_count = ts_node_named_child_count(array);
+      TSNode last_element = ts_node_named_child(array, element_count - 1);
+      (*results)[job_index] = to_string(element_count) + " " + ts_node_type(last_element, document);
+    };
+
+    it("parses every job, across several threads", [&]() {
+      vector<string> results(jobs.size());
+      TSParseOptions options = {};
+      options.thread_count = 4;
+      uint32_t parsed_count = ts_parse_batch(jobs.data(), jobs.size(), options, job_callback, &results);
+
+      AssertThat(parsed_count, Equals(jobs.size()));
+      for (unsigned i = 0; i < jobs.size(); i++) {
+        AssertThat(results[i], Equals(to_string(i % 7 * 50 + 1) + " string"));
+      }
+    });
+
+    it("parses jobs whose language was generated for an older version", [&]() {
+      vector<uint16_t> parse_table;
+      vector<TSLexMode> lex_modes;
+      TSLanguage old_language = make_version_8_language(
+        load_real_language("json"), &parse_table, &lex_modes
+      );
+      for (unsigned i = 0; i < jobs.size(); i += 2) jobs[i].language = &old_language;
+
+      vector<string> results(jobs.size());
+      TSParseOptions options = {};
+      options.thread_count = 4;
+      uint32_t parsed_count = ts_parse_batch(jobs.data(), jobs.size(), options, job_callback, &results);
+
+      AssertThat(parsed_count, Equals(jobs.size()));
+      for (unsigned i = 0; i < jobs.size(); i++) {
+        AssertThat(results[i], Equals(to_string(i % 7 * 50 + 1) + " string"));
+      }
+    });
+
+    it("skips jobs that have no language", [&]() {
+      jobs[3].language = nullptr;
+      vector<string> results(jobs.size());
+      TSParseOptions options = {};
+      uint32_t parsed_count = ts_parse_batch(jobs.data(), jobs.size(), options, job_callback, &results);
+
+      AssertThat(parsed_count, Equals(jobs.size() - 1));
+      AssertThat(results[3], Equals(""));
+      AssertThat(results[4], Equals("201 string"));
+    });
+  });
+
+  describe("memory_usage()", [&]() {
+    string input_string;
+
+    before_each([&]() {
+      input_string = "[";
+      for (unsigned i = 0; i < 500; i++) {
+        input_string += "{\"key\": [1, 2, 3], \"other\": null},\n";
+      }
+      input_string += "{}]";
+      ts_document_set_language(document, load_real_language("json"));
+    });
+
+    it("reports the memory held by the tree, the tree pool and the parser's stack", [&]() {
+      TSMemoryUsage usage = ts_document_memory_usage(document);
+      AssertThat(usage.tree_bytes, Equals(0u));
+      AssertThat(usage.stack_bytes, Equals(0u));
+
+      ts_document_set_input_string(document, input_string.c_str());
+      ts_document_parse(document);
+      TSMemoryUsage large_usage = ts_document_memory_usage(document);
+      AssertThat(large_usage.tree_bytes, IsGreaterThan(input_string.size()));
+      AssertThat(large_usage.stack_bytes, IsGreaterThan(0u));
+
+      ts_document_set_input_string(document, "[1, 2]");
+      ts_document_parse(document);
+      TSMemoryUsage small_usage = ts_document_memory_usage(document);
+      AssertThat(small_usage.tree_bytes, IsLessThan(large_usage.tree_bytes / 100));
+      AssertThat(small_usage.free_tree_bytes, IsGreaterThan(0u));
+      AssertThat(small_usage.stack_bytes, Equals(large_usage.stack_bytes));
+    });
+
+    it("gives back the memory kept for later parses when the document is trimmed", [&]() {
+      ts_document_set_input_string(document, input_string.c_str());
+      ts_document_parse(document);
+      TSMemoryUsage large_usage = ts_document_memory_usage(document);
+
+      ts_document_set_input_string(document, "[1, 2]");
+      ts_document_parse(document);
+      TSMemoryUsage small_usage = ts_document_memory_usage(document);
+      ts_document_trim_memory(document);
+      TSMemoryUsage trimmed_usage = ts_document_memory_usage(document);
+      AssertThat(trimmed_usage.stack_bytes, !IsGreaterThan(large_usage.stack_bytes));
+      AssertThat(trimmed_usage.free_tree_bytes, !IsGreaterThan(small_usage.free_tree_bytes));
+      assert_node_string_equals(ts_document_root_node(document), "(value (array (number) (number)))");
+
+      ts_document_set_input_string(document, input_string.c_str());
+      ts_document_parse(document);
+      AssertThat(ts_node_end_byte(ts_document_root_node(document)), Equals(input_string.size()));
+    });
+
+    it("stops a parse that exceeds the memory limit, leaving the previous tree in place", [&]() {
+      ts_document_set_input_string(document, "[1, 2]");
+      ts_document_parse(document);
+
+      ts_document_set_input_string(document, input_string.c_str());
+      TSParseOptions options = {};
+      options.max_memory_bytes = 128 * 1024;
+      AssertThat(ts_document_parse_with_options(document, options), IsFalse());
+      AssertThat(ts_document_parse_stats(document).exceeded_memory_limit, IsTrue());
+      AssertThat(ts_document_has_unfinished_parse(document), IsFalse());
+      assert_node_string_equals(ts_document_root_node(document), "(value (array (number) (number)))");
+
+      options.max_memory_bytes = 0;
+      AssertThat(ts_document_parse_with_options(document, options), IsTrue());
+      AssertThat(ts_document_parse_stats(document).exceeded_memory_limit, IsFalse());
+      AssertThat(ts_node_end_byte(ts_document_root_node(document)), Equals(input_string.size()));
+    });
+
+    it("shares identical leaves between positions when interning is enabled", [&]() {
+      ts_document_set_input_string(document, input_string.c_str());
+      ts_document_parse(document);
+      TSMemoryUsage usage = ts_document_memory_usage(document);
+      char *node_string = ts_node_string(ts_document_root_node(document), document);
+
+      TSDocument *interned_document = ts_document_new();
+      ts_document_set_language(interned_document, load_real_language("json"));
+      ts_document_set_input_string(interned_document, input_string.c_str());
+      TSParseOptions options = {};
+      options.intern_leaves = true;
+      AssertThat(ts_document_parse_with_options(interned_document, options), IsTrue());
+      TSMemoryUsage interned_usage = ts_document_memory_usage(interned_document);
+      AssertThat(interned_usage.tree_bytes, IsLessThan(usage.tree_bytes));
+
+      // The array within the first pair of the object at the given index.
+      auto inner_array = [&](uint32_t index) {
+        TSNode array = ts_node_named_child(ts_document_root_node(interned_document), 0);
+        return ts_node_named_child(ts_node_named_child(ts_node_named_child(array, index), 0), 1);
+      };
+
+      char *interned_node_string = ts_node_string(ts_document_root_node(interned_document), interned_document);
+      AssertThat(string(interned_node_string), Equals(string(node_string)));
+      ts_free(interned_node_string);
+      ts_free(node_string);
+
+      TSNode number1 = ts_node_named_child(inner_array(0), 0);
+      TSNode number2 = ts_node_named_child(inner_array(1), 0);
+      AssertThat(number1.data, Equals(number2.data));
+      AssertThat(ts_node_start_byte(number2), Equals(ts_node_start_byte(number1) + strlen("{\"key\": [1, 2, 3], \"other\": null},\n")));
+
+      // Replace '2' with 'null' in the first object.
+      TSInputEdit edit = {};
+      edit.start_point.column = edit.start_byte = strlen("[{\"key\": [1, ");
+      edit.extent_added.column = edit.bytes_added = 4;
+      edit.extent_removed.column = edit.bytes_removed = 1;
+      input_string.replace(edit.start_byte, 1, "null");
+      ts_document_set_input_string(interned_document, input_string.c_str());
+      ts_document_edit(interned_document, edit);
+      AssertThat(ts_document_parse_with_options(interned_document, options), IsTrue());
+
+      assert_node_string_equals(inner_array(0), "(array (number) (null) (number))");
+      assert_node_string_equals(inner_array(1), "(array (number) (number) (number))");
+      ts_document_free(interned_document);
+    });
+  });
+
+  describe("tree_stats()", [&]() {
+    before_each([&]() {
+      ts_document_set_language(document, load_real_language("json"));
+    });
+
+    it("describes the shape of the tree", [&]() {
+      TSTreeStats stats = ts_document_tree_stats(document);
+      AssertThat(stats.node_count, Equals(0u));
+      AssertThat(stats.memory_usage.tree_bytes, Equals(0u));
+
+      ts_document_set_input_string(document, "[1, [2, 3]]");
+      ts_document_parse(document);
+      stats = ts_document_tree_stats(document);
+      AssertThat(stats.leaf_count, IsGreaterThan(8u));
+      AssertThat(stats.node_count, IsGreaterThan(stats.leaf_count + 2));
+      AssertThat(stats.max_depth, IsGreaterThan(3u));
+      AssertThat(stats.error_count, Equals(0u));
+      AssertThat(stats.missing_count, Equals(0u));
+      AssertThat(stats.error_cost, Equals(0u));
+      AssertThat(stats.memory_usage.tree_bytes, Equals(ts_document_memory_usage(document).tree_bytes));
+    });
+
+    it("counts errors and missing tokens", [&]() {
+      ts_document_set_input_string(document, "[1, null, 3");
+      ts_document_parse(document);
+      TSTreeStats stats = ts_document_tree_stats(document);
+      AssertThat(stats.missing_count, Equals(1u));
+      AssertThat(stats.error_cost, IsGreaterThan(0u));
+
+      ts_document_set_input_string(document, "[1, @@, 3]");
+      ts_document_parse(document);
+      stats = ts_document_tree_stats(document);
+      AssertThat(stats.error_count, IsGreaterThan(0u));
+      AssertThat(stats.error_cost, IsGreaterThan(0u));
+    });
+  });
+
+  describe("compact()", [&]() {
+    string input_string;
+
+    before_each([&]() {
+      input_string = "[";
+      for (unsigned i = 0; i < 200; i++) {
+        input_string += "{\"key\": [1, 2, 3], \"other\": null},\n";
+      }
+      input_string += "{}]";
+      ts_document_set_language(document, load_real_language("json"));
+      ts_document_set_input_string(document, input_string.c_str());
+      ts_document_parse(document);
+    });
+
+    it("moves the tree's nodes without changing the tree", [&]() {
+      char *node_string = ts_node_string(ts_document_root_node(document), document);
+      const void *root_data = ts_document_root_node(document).data;
+
+      ts_document_compact(document);
+      AssertThat(ts_document_root_node(document).data, !Equals(root_data));
+      char *compacted_node_string = ts_node_string(ts_document_root_node(document), document);
+      AssertThat(string(compacted_node_string), Equals(string(node_string)));
+      ts_free(compacted_node_string);
+      ts_free(node_string);
+
+      // Replace '2' with 'null' in the first object.
+      TSInputEdit edit = {};
+      edit.start_point.column = edit.start_byte = strlen("[{\"key\": [1, ");
+      edit.extent_added.column = edit.bytes_added = 4;
+      edit.extent_removed.column = edit.bytes_removed = 1;
+      input_string.replace(edit.start_byte, 1, "null");
+      ts_document_set_input_string(document, input_string.c_str());
+      ts_document_edit(document, edit);
+      ts_document_parse(document);
+
+      TSNode array = ts_node_named_child(ts_document_root_node(document), 0);
+      TSNode inner_array = ts_node_named_child(ts_node_named_child(ts_node_named_child(array, 0), 0), 1);
+      assert_node_string_equals(inner_array, "(array (number) (null) (number))");
+      AssertThat(ts_document_parse_stats(document).reused_tree_count, IsGreaterThan(0u));
+    });
+
+    it("leaves the tree in place while a reader retains it", [&]() {
+      TSNode root_node = ts_document_acquire_root_node(document);
+      ts_document_compact(document);
+      AssertThat(ts_document_root_node(document).data, Equals(root_node.data));
+      ts_document_release_root_node(document, root_node);
+    });
+  });
+
+  describe("ts_set_allocator(allocator)", [&]() {
+    struct AllocationCounts {
+      std::atomic<size_t> allocations;
+      std::atomic<size_t> frees;
+    };
+
+    after_each([&]() {
+      ts_set_allocator(TSAllocator{});
+    });
+
+    it("makes the runtime's allocations with the given functions", [&]() {
+      static AllocationCounts counts;
+      counts.allocations = 0;
+      counts.frees = 0;
+
+      TSAllocator allocator = {};
+      allocator.payload = &counts;
+      allocator.malloc = [](void *payload, size_t size) {
+        static_cast<AllocationCounts *>(payload)->allocations++;
+        return malloc(size);
+      };
+      allocator.calloc = [](void *payload, size_t count, size_t size) {
+        static_cast<AllocationCounts *>(payload)->allocations++;
+        return calloc(count, size);
+      };
+      allocator.realloc = [](void *payload, void *buffer, size_t size) {
+        static_cast<AllocationCounts *>(payload)->allocations++;
+        return realloc(buffer, size);
+      };
+      allocator.free = [](void *payload, void *buffer) {
+        static_cast<AllocationCounts *>(payload)->frees++;
+        free(buffer);
+      };
+      ts_set_allocator(allocator);
+
+      TSDocument *other_document = ts_document_new();
+      ts_document_set_language(other_document, load_real_language("json"));
+      ts_document_set_input_string(other_document, "[1, {\"a\": true}]");
+      ts_document_parse(other_document);
+      ts_document_free(other_document);
+      ts_set_allocator(TSAllocator{});
+
+      AssertThat(counts.allocations.load(), IsGreaterThan(0u));
+      AssertThat(counts.frees.load(), IsGreaterThan(0u));
+
+      size_t allocation_count = counts.allocations;
+      ts_free(ts_malloc(16));
+      AssertThat(counts.allocations.load(), Equals(allocation_count));
+    });
+
+    it("ignores allocators that are missing any of their functions", [&]() {
+      TSAllocator allocator = {};
+      allocator.malloc = [](void *, size_t) -> void * { return nullptr; };
+      ts_set_allocator(allocator);
+      void *buffer = ts_malloc(16);
+      AssertThat(buffer, !Equals<void *>(nullptr));
+      ts_free(buffer);
+    });
   });
 });
 
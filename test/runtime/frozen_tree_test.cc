@@ -0,0 +1,121 @@
+#include "test_helper.h"
+#include "helpers/load_language.h"
+#include "helpers/record_alloc.h"
+
+START_TEST
+
+describe("FrozenTree", [&]() {
+  TSDocument *document;
+  TSFrozenTree *frozen_tree;
+  string text = "[1, [2, 3], {\"a\": true}]";
+
+  before_each([&]() {
+    record_alloc::start();
+    document = ts_document_new();
+    ts_document_set_language(document, load_real_language("json"));
+    ts_document_set_input_string(document, text.c_str());
+    ts_document_parse(document);
+    frozen_tree = nullptr;
+  });
+
+  after_each([&]() {
+    if (frozen_tree) ts_frozen_tree_delete(frozen_tree);
+    ts_document_free(document);
+    record_alloc::stop();
+    AssertThat(record_alloc::outstanding_allocation_indices(), IsEmpty());
+  });
+
+  std::function<void(TSNode, TSFrozenNode)> assert_same_tree = [&](TSNode node, TSFrozenNode frozen_node) {
+    AssertThat(ts_frozen_node_is_null(frozen_node), IsFalse());
+    AssertThat(ts_frozen_node_type(frozen_node), Equals(ts_node_type(node, document)));
+    AssertThat(ts_frozen_node_symbol(frozen_node), Equals(ts_node_symbol(node)));
+    AssertThat(ts_frozen_node_start_byte(frozen_node), Equals(ts_node_start_byte(node)));
+    AssertThat(ts_frozen_node_end_byte(frozen_node), Equals(ts_node_end_byte(node)));
+    AssertThat(ts_frozen_node_is_named(frozen_node), Equals(ts_node_is_named(node)));
+    AssertThat(ts_frozen_node_is_missing(frozen_node), Equals(ts_node_is_missing(node)));
+    AssertThat(ts_frozen_node_has_error(frozen_node), Equals(ts_node_has_error(node)));
+    AssertThat(ts_frozen_node_child_count(frozen_node), Equals(ts_node_child_count(node)));
+
+    TSFrozenNode frozen_child = ts_frozen_node_first_child(frozen_node);
+    for (uint32_t i = 0, n = ts_node_child_count(node); i < n; i++) {
+      assert_same_tree(ts_node_child(node, i), frozen_child);
+      AssertThat(ts_frozen_node_child(frozen_node, i).index, Equals(frozen_child.index));
+      frozen_child = ts_frozen_node_next_sibling(frozen_child);
+    }
+    AssertThat(ts_frozen_node_is_null(frozen_child), IsTrue());
+  };
+
+  it("copies the visible nodes of a tree", [&]() {
+    TSNode root_node = ts_document_root_node(document);
+    frozen_tree = ts_frozen_tree_new(root_node);
+    assert_same_tree(root_node, ts_frozen_tree_root_node(frozen_tree));
+  });
+
+  it("can copy a subtree", [&]() {
+    TSNode array_node = ts_node_child(ts_node_child(ts_document_root_node(document), 0), 3);
+    AssertThat(ts_node_type(array_node, document), Equals("array"));
+    frozen_tree = ts_frozen_tree_new(array_node);
+    assert_same_tree(array_node, ts_frozen_tree_root_node(frozen_tree));
+    AssertThat(ts_frozen_node_start_byte(ts_frozen_tree_root_node(frozen_tree)), Equals(text.find("[2")));
+  });
+
+  it("can be read back from its bytes without copying them", [&]() {
+    TSNode root_node = ts_document_root_node(document);
+    frozen_tree = ts_frozen_tree_new(root_node);
+
+    uint32_t length;
+    const char *bytes = ts_frozen_tree_bytes(frozen_tree, &length);
+    AssertThat(length, Equals(16 + 16 * ts_frozen_tree_node_count(frozen_tree)));
+
+    TSFrozenTree *reloaded_tree = ts_frozen_tree_new_from_bytes(load_real_language("json"), bytes, length);
+    AssertThat(reloaded_tree, !Equals<TSFrozenTree *>(nullptr));
+    uint32_t reloaded_length;
+    AssertThat(ts_frozen_tree_bytes(reloaded_tree, &reloaded_length), Equals(bytes));
+    assert_same_tree(root_node, ts_frozen_tree_root_node(reloaded_tree));
+    ts_frozen_tree_delete(reloaded_tree);
+  });
+
+  it("rejects bytes that are truncated or corrupted", [&]() {
+    frozen_tree = ts_frozen_tree_new(ts_document_root_node(document));
+
+    uint32_t length;
+    const char *bytes = ts_frozen_tree_bytes(frozen_tree, &length);
+    const TSLanguage *language = load_real_language("json");
+    AssertThat(ts_frozen_tree_new_from_bytes(language, bytes, length - 1), Equals<TSFrozenTree *>(nullptr));
+    AssertThat(ts_frozen_tree_new_from_bytes(language, bytes, 8), Equals<TSFrozenTree *>(nullptr));
+
+    vector<uint32_t> corrupted(length / sizeof(uint32_t));
+    memcpy(corrupted.data(), bytes, length);
+    corrupted[0] = 0;
+    AssertThat(
+      ts_frozen_tree_new_from_bytes(language, (const char *)corrupted.data(), length),
+      Equals<TSFrozenTree *>(nullptr)
+    );
+
+    memcpy(corrupted.data(), bytes, length);
+    corrupted[4 + 4 + 2] = 1;
+    AssertThat(
+      ts_frozen_tree_new_from_bytes(language, (const char *)corrupted.data(), length),
+      Equals<TSFrozenTree *>(nullptr)
+    );
+
+    // The second node's symbol is stored before its flags, in its last word.
+    memcpy(corrupted.data(), bytes, length);
+    uint16_t symbol_count = ts_language_symbol_count(language);
+    uint16_t *symbol = (uint16_t *)&corrupted[4 + 4 + 3];
+    *symbol = symbol_count - 1;
+    TSFrozenTree *tree_with_last_symbol = ts_frozen_tree_new_from_bytes(
+      language, (const char *)corrupted.data(), length
+    );
+    AssertThat(tree_with_last_symbol, !Equals<TSFrozenTree *>(nullptr));
+    ts_frozen_tree_delete(tree_with_last_symbol);
+
+    *symbol = symbol_count;
+    AssertThat(
+      ts_frozen_tree_new_from_bytes(language, (const char *)corrupted.data(), length),
+      Equals<TSFrozenTree *>(nullptr)
+    );
+  });
+});
+
+END_TEST
@@ -0,0 +1,102 @@
+#include "test_helper.h"
+#include "runtime/alloc.h"
+#include "helpers/file_helpers.h"
+#include "helpers/load_language.h"
+
+static const TSLanguage *json_language;
+static unsigned json_load_count;
+
+static const TSLanguage *load_json() {
+  json_load_count++;
+  return json_language;
+}
+
+START_TEST
+
+describe("LanguageRegistry", [&]() {
+  TSLanguageRegistry *registry;
+  TSCompileResult compile_result;
+  uint32_t length;
+
+  string grammar = R"JSON({
+    "name": "registry_language",
+    "extras": [{"type": "PATTERN", "value": "\\s"}],
+    "rules": {
+      "program": {"type": "REPEAT", "content": {"type": "SYMBOL", "name": "word"}},
+      "word": {"type": "PATTERN", "value": "[a-z]+"}
+    }
+  })JSON";
+
+  auto parse = [&](const TSLanguage *language, const string &text) {
+    TSDocument *document = ts_document_new();
+    ts_document_set_language(document, language);
+    ts_document_set_input_string(document, text.c_str());
+    ts_document_parse(document);
+    char *tree_string = ts_node_string(ts_document_root_node(document), document);
+    string result(tree_string);
+    ts_free(tree_string);
+    ts_document_free(document);
+    return result;
+  };
+
+  before_each([&]() {
+    json_language = load_real_language("json");
+    json_load_count = 0;
+    compile_result = ts_compile_grammar_binary(grammar.c_str(), &length);
+    registry = ts_language_registry_new();
+  });
+
+  after_each([&]() {
+    ts_language_registry_delete(registry);
+    free(compile_result.code);
+  });
+
+  it("loads each language the first time it is looked up, and then reuses it", [&]() {
+    AssertThat(ts_language_registry_add_function(registry, "json", load_json), IsTrue());
+    AssertThat(ts_language_registry_add_binary(registry, "words", compile_result.code, length), IsTrue());
+    AssertThat(json_load_count, Equals(0u));
+
+    AssertThat(ts_language_registry_language(registry, "json"), Equals(json_language));
+    AssertThat(ts_language_registry_language(registry, "json"), Equals(json_language));
+    AssertThat(json_load_count, Equals(1u));
+
+    const TSLanguage *language = ts_language_registry_language(registry, "words");
+    AssertThat((void *)language, !Equals<void *>(nullptr));
+    AssertThat(ts_language_registry_language(registry, "words"), Equals(language));
+    AssertThat(parse(language, "ab cd"), Equals("(program (word) (word))"));
+  });
+
+  it("maps files' extensions to their languages", [&]() {
+    ts_language_registry_add_function(registry, "json", load_json);
+    AssertThat(ts_language_registry_add_file_extension(registry, "json", "json"), IsTrue());
+    AssertThat(ts_language_registry_add_file_extension(registry, "other", "txt"), IsFalse());
+
+    AssertThat(ts_language_registry_language_for_path(registry, "a/b.c/file.json"), Equals(json_language));
+    AssertThat((void *)ts_language_registry_language_for_path(registry, "a/b.json/file"), Equals<void *>(nullptr));
+    AssertThat(ts_language_registry_language_for_path(registry, "C:\\a\\b.c\\file.json"), Equals(json_language));
+    AssertThat((void *)ts_language_registry_language_for_path(registry, "C:\\a\\b.json\\file"), Equals<void *>(nullptr));
+    AssertThat((void *)ts_language_registry_language_for_path(registry, "a\\b.json/file"), Equals<void *>(nullptr));
+    AssertThat((void *)ts_language_registry_language_for_path(registry, "file.txt"), Equals<void *>(nullptr));
+  });
+
+  it("maps binary languages' files into memory when they are first used", [&]() {
+    string path = join_path({"out", "tmp", "registry_language.bin"});
+    write_file(path, string(compile_result.code, length));
+    ts_language_registry_add_binary_file(registry, "words", path.c_str());
+    ts_language_registry_add_binary_file(registry, "missing", "out/tmp/nonexistent.bin");
+
+    const TSLanguage *language = ts_language_registry_language(registry, "words");
+    AssertThat((void *)language, !Equals<void *>(nullptr));
+    AssertThat(parse(language, "ab"), Equals("(program (word))"));
+    AssertThat((void *)ts_language_registry_language(registry, "missing"), Equals<void *>(nullptr));
+  });
+
+  it("returns null for languages that aren't registered, and rejects duplicate names", [&]() {
+    AssertThat((void *)ts_language_registry_language(registry, "json"), Equals<void *>(nullptr));
+    AssertThat(ts_language_registry_add_function(registry, "json", load_json), IsTrue());
+    AssertThat(ts_language_registry_add_binary(registry, "json", compile_result.code, length), IsFalse());
+    AssertThat(ts_language_registry_language(registry, "json"), Equals(json_language));
+  });
+});
+
+END_TEST
@@ -1,6 +1,9 @@
 #include "test_helper.h"
 #include "runtime/alloc.h"
+#include "runtime/language.h"
+#include "tree_sitter/parser.h"
 #include "helpers/load_language.h"
+#include "helpers/spy_input.h"
 
 START_TEST
 
@@ -49,6 +52,761 @@ describe("Language", []() {
       ts_free(string);
       ts_document_free(document);
     });
+
+    it("returns the correct name for aliased nodes when the alias sequences have different lengths", [&]() {
+      TSCompileResult compile_result = ts_compile_grammar(R"JSON({
+        "name": "aliased_rules_of_different_lengths",
+
+        "extras": [
+          {"type": "PATTERN", "value": "\\s"}
+        ],
+
+        "rules": {
+          "program": {
+            "type": "REPEAT",
+            "content": {
+              "type": "CHOICE",
+              "members": [
+                {"type": "SYMBOL", "name": "long"},
+                {"type": "SYMBOL", "name": "short"}
+              ]
+            }
+          },
+
+          "long": {
+            "type": "SEQ",
+            "members": [
+              {"type": "STRING", "value": "("},
+              {"type": "STRING", "value": ","},
+              {"type": "STRING", "value": ","},
+              {"type": "STRING", "value": ","},
+              {"type": "STRING", "value": ","},
+              {"type": "STRING", "value": ","},
+              {"type": "STRING", "value": ","},
+              {"type": "STRING", "value": ","},
+              {
+                "type": "ALIAS",
+                "value": "last",
+                "named": true,
+                "content": {"type": "SYMBOL", "name": "identifier"}
+              },
+              {"type": "STRING", "value": ")"}
+            ]
+          },
+
+          "short": {
+            "type": "SEQ",
+            "members": [
+              {
+                "type": "ALIAS",
+                "value": "first",
+                "named": true,
+                "content": {"type": "SYMBOL", "name": "identifier"}
+              },
+              {"type": "STRING", "value": ";"}
+            ]
+          },
+
+          "identifier": {"type": "PATTERN", "value": "[a-z]+"}
+        }
+      })JSON");
+
+      // One sequence is much longer than the other, so each one is stored
+      // without its trailing unaliased children.
+      AssertThat(string(compile_result.code), Contains("ts_alias_sequence_offsets[] = {"));
+
+      TSDocument *document = ts_document_new();
+      const TSLanguage *language = load_test_language("aliased_rules_of_different_lengths", compile_result);
+      AssertThat((void *)language->alias_sequence_offsets, !Equals<void *>(nullptr));
+      ts_document_set_language(document, language);
+      ts_document_set_input_string(document, "(,,,,,,, x) y; z;");
+      ts_document_parse(document);
+
+      TSNode root_node = ts_document_root_node(document);
+      char *string = ts_node_string(root_node, document);
+      AssertThat(string, Equals("(program (long (last)) (short (first)) (short (first)))"));
+
+      TSNode long_node = ts_node_named_child(root_node, 0);
+      AssertThat(ts_node_type(ts_node_child(long_node, 8), document), Equals("last"));
+      AssertThat(ts_node_type(ts_node_child(long_node, 9), document), Equals(")"));
+
+      ts_free(string);
+      ts_document_free(document);
+    });
+  });
+
+  describe("symbol_for_name(name, length, is_named)", [&]() {
+    string grammar = R"JSON({
+      "name": "symbol_names",
+      "extras": [{"type": "PATTERN", "value": "\\s"}],
+      "rules": {
+        "program": {
+          "type": "REPEAT",
+          "content": {
+            "type": "CHOICE",
+            "members": [
+              {"type": "SYMBOL", "name": "word"},
+              {"type": "ALIAS", "value": "word", "named": true, "content": {"type": "SYMBOL", "name": "number"}},
+              {"type": "STRING", "value": "word"},
+              {"type": "ALIAS", "value": "digits", "named": true, "content": {"type": "SYMBOL", "name": "_hex"}}
+            ]
+          }
+        },
+        "word": {"type": "PATTERN", "value": "[a-z]+"},
+        "number": {"type": "PATTERN", "value": "\\d+"},
+        "_hex": {"type": "PATTERN", "value": "0x\\d+"}
+      }
+    })JSON";
+
+    auto assert_finds_symbols = [&](const TSLanguage *language) {
+      auto find = [&](string name, bool is_named) {
+        return ts_language_symbol_for_name(language, name.c_str(), name.size(), is_named);
+      };
+
+      TSSymbol word = find("word", true);
+      AssertThat(word, !Equals<TSSymbol>(0));
+      AssertThat(ts_language_symbol_name(language, word), Equals("word"));
+      AssertThat(ts_language_symbol_type(language, word), Equals(TSSymbolTypeRegular));
+
+      // The rule is found rather than the alias that shares its name, because
+      // aliases are numbered after every rule.
+      AssertThat(word, IsLessThan(language->symbol_count));
+
+      TSSymbol word_token = find("word", false);
+      AssertThat(word_token, !Equals<TSSymbol>(0));
+      AssertThat(word_token, !Equals(word));
+      AssertThat(ts_language_symbol_type(language, word_token), Equals(TSSymbolTypeAnonymous));
+
+      TSSymbol digits = find("digits", true);
+      AssertThat(ts_language_symbol_name(language, digits), Equals("digits"));
+      AssertThat(find("program", true), !Equals<TSSymbol>(0));
+      AssertThat(find("ERROR", true), Equals(ts_builtin_sym_error));
+
+      AssertThat(find("number", false), Equals<TSSymbol>(0));
+      AssertThat(find("_hex", true), Equals<TSSymbol>(0));
+      AssertThat(find("wor", true), Equals<TSSymbol>(0));
+      AssertThat(find("words", true), Equals<TSSymbol>(0));
+      AssertThat(find("", true), Equals<TSSymbol>(0));
+    };
+
+    it("finds visible symbols by their name and kind", [&]() {
+      const TSLanguage *language = load_test_language("symbol_names", ts_compile_grammar(grammar.c_str()));
+      AssertThat((void *)language->symbols_by_name, !Equals<void *>(nullptr));
+      assert_finds_symbols(language);
+    });
+
+    it("finds symbols in languages that don't list them by name", [&]() {
+      uint32_t length;
+      TSCompileResult compile_result = ts_compile_grammar_binary(grammar.c_str(), &length);
+      const TSLanguage *language = ts_language_load(compile_result.code, length);
+      AssertThat((void *)language->symbols_by_name, Equals<void *>(nullptr));
+      assert_finds_symbols(language);
+
+      ts_language_delete(language);
+      free(compile_result.code);
+    });
+  });
+
+  describe("load(data, length)", [&]() {
+    string grammar = R"JSON({
+      "name": "binary_language",
+      "extras": [{"type": "PATTERN", "value": "\\s"}],
+      "rules": {
+        "program": {"type": "REPEAT", "content": {"type": "SYMBOL", "name": "statement"}},
+        "statement": {
+          "type": "CHOICE",
+          "members": [
+            {"type": "SYMBOL", "name": "if_statement"},
+            {"type": "SEQ", "members": [
+              {"type": "ALIAS", "value": "name", "named": true, "content": {"type": "SYMBOL", "name": "identifier"}},
+              {"type": "STRING", "value": ";"}
+            ]}
+          ]
+        },
+        "if_statement": {
+          "type": "SEQ",
+          "members": [
+            {"type": "STRING", "value": "if"},
+            {"type": "SYMBOL", "name": "identifier"},
+            {"type": "STRING", "value": "then"},
+            {"type": "SYMBOL", "name": "statement"}
+          ]
+        },
+        "identifier": {"type": "PATTERN", "value": "[a-zα-ω]+"}
+      }
+    })JSON";
+
+    auto parse = [&](const TSLanguage *language, const string &text) {
+      TSDocument *document = ts_document_new();
+      ts_document_set_language(document, language);
+      ts_document_set_input_string(document, text.c_str());
+      ts_document_parse(document);
+      char *tree_string = ts_node_string(ts_document_root_node(document), document);
+      string result(tree_string);
+      ts_free(tree_string);
+      ts_document_free(document);
+      return result;
+    };
+
+    it("parses in the same way as the language's generated C code", [&]() {
+      const TSLanguage *c_language = load_test_language(
+        "binary_language",
+        ts_compile_grammar(grammar.c_str())
+      );
+
+      uint32_t length;
+      TSCompileResult compile_result = ts_compile_grammar_binary(grammar.c_str(), &length);
+      AssertThat((void *)compile_result.error_message, Equals<void *>(nullptr));
+      const TSLanguage *language = ts_language_load(compile_result.code, length);
+      AssertThat((void *)language, !Equals<void *>(nullptr));
+      AssertThat((void *)language->keyword_lex_table, !Equals<void *>(nullptr));
+
+      vector<string> texts({
+        "if x then if yε then zzz;",
+        "iffy; if then;",
+        "αβγ; if ; x;",
+        "x;\n\n  if %",
+      });
+      for (const string &text : texts) {
+        AssertThat(parse(language, text), Equals(parse(c_language, text)));
+      }
+      AssertThat(parse(language, texts[0]), Equals(
+        "(program (statement (if_statement (identifier) (statement (if_statement (identifier) (statement (name)))))))"
+      ));
+
+      ts_language_delete(language);
+      free(compile_result.code);
+    });
+
+    it("stores the generated C code's tables as bytes when every value fits in one", [&]() {
+      const TSLanguage *c_language = load_test_language(
+        "binary_language",
+        ts_compile_grammar(grammar.c_str())
+      );
+      AssertThat((void *)c_language->byte_parse_table, !Equals<void *>(nullptr));
+      AssertThat((void *)c_language->parse_table, Equals<void *>(nullptr));
+      AssertThat(c_language->byte_lex_modes || c_language->byte_lex_mode_ids, IsTrue());
+      AssertThat(parse(c_language, "if x then y;"), Equals(
+        "(program (statement (if_statement (identifier) (statement (name)))))"
+      ));
+    });
+
+    it("finds each state's lex mode in the same way with or without the table of distinct modes", [&]() {
+      const TSLanguage *c_language = load_test_language(
+        "binary_language",
+        ts_compile_grammar(grammar.c_str())
+      );
+
+      vector<TSLexMode> lex_modes;
+      for (TSStateId state = 0; state < c_language->state_count; state++) {
+        lex_modes.push_back(ts_language_lex_mode(c_language, state));
+      }
+      TSLanguage language_with_dense_modes = *c_language;
+      language_with_dense_modes.lex_modes = lex_modes.data();
+      language_with_dense_modes.lex_mode_ids = nullptr;
+      language_with_dense_modes.byte_lex_mode_ids = nullptr;
+      language_with_dense_modes.byte_lex_modes = nullptr;
+      for (const string &text : vector<string>({
+        "if x then y;",
+        "x; if then %% y;",
+      })) {
+        AssertThat(parse(c_language, text), Equals(parse(&language_with_dense_modes, text)));
+      }
+    });
+
+    it("lists the characters that can begin a token in the error state", [&]() {
+      const TSLanguage *c_language = load_test_language(
+        "binary_language",
+        ts_compile_grammar(grammar.c_str())
+      );
+      AssertThat((void *)c_language->error_start_characters, !Equals<void *>(nullptr));
+      AssertThat(ts_language_can_start_error_token(c_language, 'x'), IsTrue());
+      AssertThat(ts_language_can_start_error_token(c_language, ';'), IsTrue());
+      AssertThat(ts_language_can_start_error_token(c_language, ' '), IsTrue());
+      AssertThat(ts_language_can_start_error_token(c_language, '%'), IsFalse());
+      AssertThat(ts_language_can_start_error_token(c_language, 0x3b1), IsTrue());
+
+      TSLanguage language_without_characters = *c_language;
+      language_without_characters.error_start_characters = nullptr;
+      for (const string &text : vector<string>({
+        "x; %%%% y;",
+        "if %%&&** then x; %%",
+        "x;\n\n%% *& y; ^^",
+      })) {
+        AssertThat(parse(c_language, text), Equals(parse(&language_without_characters, text)));
+      }
+    });
+
+    it("finds the state after each terminal symbol without decoding the parse actions", [&]() {
+      const TSLanguage *c_language = load_test_language(
+        "binary_language",
+        ts_compile_grammar(grammar.c_str())
+      );
+
+      uint32_t length;
+      TSCompileResult compile_result = ts_compile_grammar_binary(grammar.c_str(), &length);
+      const TSLanguage *binary_language = ts_language_load(compile_result.code, length);
+
+      for (const TSLanguage *language : {c_language, binary_language}) {
+        AssertThat((void *)language->parse_action_next_states, !Equals<void *>(nullptr));
+        TSLanguage language_without_table = *language;
+        language_without_table.parse_action_next_states = nullptr;
+
+        unsigned shift_count = 0;
+        for (TSStateId state = 0; state < language->state_count; state++) {
+          for (TSSymbol symbol = 0; symbol < language->token_count; symbol++) {
+            TSStateId next_state = ts_language_next_state(language, state, symbol);
+            AssertThat(next_state, Equals(ts_language_next_state(&language_without_table, state, symbol)));
+            if (next_state != 0) shift_count++;
+          }
+        }
+        AssertThat(shift_count, IsGreaterThan(0u));
+      }
+
+      ts_language_delete(binary_language);
+      free(compile_result.code);
+    });
+
+    it("reports the size of the tables that each compilation phase produces", [&]() {
+      TSCompileResult compile_result = ts_compile_grammar(grammar.c_str());
+      const TSLanguage *language = load_test_language("binary_language", compile_result);
+      TSCompileProfile profile = compile_result.profile;
+      AssertThat(profile.parse_state_count, Equals(language->state_count));
+      AssertThat(profile.item_set_count, !IsLessThan(profile.parse_state_count));
+      AssertThat(profile.parse_item_count, IsGreaterThan(profile.item_set_count));
+      AssertThat(profile.lex_state_count, IsGreaterThan(0u));
+      AssertThat(profile.keyword_lex_state_count, IsGreaterThan(0u));
+
+      compile_result = ts_compile_grammar(R"JSON({"name": "invalid", "rules": {"a": {"type": "SYMBOL", "name": "b"}}})JSON");
+      AssertThat(compile_result.error_type, Equals(TSCompileErrorTypeUndefinedSymbol));
+      AssertThat(compile_result.profile.parse_state_count, Equals(0u));
+      free(compile_result.error_message);
+    });
+
+    // Each statement keyword leads to a separate state, so that there are
+    // enough states in the queue at once for them to be split up.
+    auto many_statements_grammar = [&](unsigned statement_count) {
+      string statements, statement_rules;
+      for (unsigned i = 0; i < statement_count; i++) {
+        string name = "statement_" + to_string(i);
+        if (i > 0) statements += ",";
+        statements += R"JSON({"type": "SYMBOL", "name": ")JSON" + name + R"JSON("})JSON";
+        statement_rules += ",\"" + name + R"JSON(": {"type": "SEQ", "members": [
+          {"type": "STRING", "value": "k)JSON" + to_string(i) + R"JSON("},
+          {"type": "SYMBOL", "name": "expression"},
+          {"type": "STRING", "value": ";"}
+        ]})JSON";
+      }
+
+      return R"JSON({
+        "name": "many_statements",
+        "rules": {
+          "program": {
+            "type": "REPEAT",
+            "content": {"type": "CHOICE", "members": [)JSON" + statements + R"JSON(]}
+          },
+          "expression": {
+            "type": "CHOICE",
+            "members": [
+              {"type": "PATTERN", "value": "[a-z]+"},
+              {"type": "SEQ", "members": [
+                {"type": "STRING", "value": "("},
+                {"type": "SYMBOL", "name": "expression"},
+                {"type": "STRING", "value": ")"}
+              ]}
+            ]
+          }
+          )JSON" + statement_rules + R"JSON(
+        }
+      })JSON";
+    };
+
+    it("produces the same code when its parse states are built on several threads", [&]() {
+      string grammar = many_statements_grammar(64);
+      TSCompileResult serial_result = ts_compile_grammar(grammar.c_str());
+      AssertThat(serial_result.error_type, Equals(TSCompileErrorTypeNone));
+      TSCompileOptions options = {};
+      options.thread_count = 4;
+      TSCompileResult parallel_result = ts_compile_grammar_with_options(grammar.c_str(), options);
+      AssertThat(parallel_result.error_type, Equals(TSCompileErrorTypeNone));
+      AssertThat(string(parallel_result.code), Equals(string(serial_result.code)));
+      AssertThat(parallel_result.profile.item_set_count, Equals(serial_result.profile.item_set_count));
+      free(serial_result.code);
+      free(parallel_result.code);
+    });
+
+    it("can write its C code in chunks as it is generated", [&]() {
+      string grammar = many_statements_grammar(64);
+      TSCompileOptions options = {};
+      TSCompileResult compile_result = ts_compile_grammar_with_options(grammar.c_str(), options);
+      string code(compile_result.code);
+      free(compile_result.code);
+
+      vector<string> chunks;
+      compile_result = ts_compile_grammar_to_writer(grammar.c_str(), options, [](void *payload, const char *text, uint32_t length) {
+        static_cast<vector<string> *>(payload)->push_back(string(text, length));
+      }, &chunks);
+      AssertThat(compile_result.error_type, Equals(TSCompileErrorTypeNone));
+      AssertThat((void *)compile_result.code, Equals<void *>(nullptr));
+      AssertThat(chunks.size(), IsGreaterThan(1u));
+      string written_code;
+      for (const string &chunk : chunks) written_code += chunk;
+      AssertThat(written_code, Equals(code));
+
+      FILE *file = tmpfile();
+      compile_result = ts_compile_grammar_to_file(grammar.c_str(), options, file);
+      AssertThat(compile_result.error_type, Equals(TSCompileErrorTypeNone));
+      rewind(file);
+      string file_contents;
+      char buffer[4096];
+      size_t length;
+      while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) file_contents.append(buffer, length);
+      fclose(file);
+      AssertThat(file_contents, Equals(code));
+
+      bool wrote_code = false;
+      compile_result = ts_compile_grammar_to_writer(R"JSON({"name": "invalid", "rules": {"a": {"type": "SYMBOL", "name": "b"}}})JSON", options, [](void *payload, const char *, uint32_t) {
+        *static_cast<bool *>(payload) = true;
+      }, &wrote_code);
+      AssertThat(compile_result.error_type, Equals(TSCompileErrorTypeUndefinedSymbol));
+      AssertThat(wrote_code, IsFalse());
+      free(compile_result.error_message);
+    });
+
+    it("can be written as C code with a table-driven lexer", [&]() {
+      const TSLanguage *c_language = load_test_language(
+        "binary_language",
+        ts_compile_grammar(grammar.c_str())
+      );
+
+      TSCompileOptions options = {};
+      options.use_lex_tables = true;
+      TSCompileResult compile_result = ts_compile_grammar_with_options(grammar.c_str(), options);
+      AssertThat(string(compile_result.code), Contains("TSLexTable ts_lex_table ="));
+      const TSLanguage *language = load_test_language("binary_language", compile_result);
+      AssertThat((void *)language->lex_fn, Equals<void *>(nullptr));
+
+      vector<string> texts({
+        "if x then if yε then zzz;",
+        "iffy; if then;",
+        "αβγ; if ; x;",
+      });
+      for (const string &text : texts) {
+        AssertThat(parse(language, text), Equals(parse(c_language, text)));
+      }
+    });
+
+    it("can be written as compact C code", [&]() {
+      const TSLanguage *c_language = load_test_language(
+        "binary_language",
+        ts_compile_grammar(grammar.c_str())
+      );
+
+      TSCompileOptions options = {};
+      options.compact_code = true;
+      TSCompileResult compile_result = ts_compile_grammar_with_options(grammar.c_str(), options);
+      AssertThat(string(compile_result.code), !Contains("ACTIONS("));
+      AssertThat(string(compile_result.code), !Contains("SMALL_STATE("));
+      const TSLanguage *language = load_test_language("binary_language", compile_result);
+
+      vector<string> texts({
+        "if x then if yε then zzz;",
+        "iffy; if then;",
+        "αβγ; if ; x;",
+      });
+      for (const string &text : texts) {
+        AssertThat(parse(language, text), Equals(parse(c_language, text)));
+      }
+    });
+
+    it("writes lex functions that jump directly to the next lex state", [&]() {
+      TSCompileOptions options = {};
+      TSCompileResult compile_result = ts_compile_grammar_with_options(grammar.c_str(), options);
+      string code(compile_result.code);
+      AssertThat(code, Contains("START_DIRECT_LEXER();"));
+      AssertThat(code, Contains("LEX_STATE("));
+      AssertThat(code, Contains("ADVANCE_TO("));
+      AssertThat(code, !Contains("ADVANCE("));
+      AssertThat(code, !Contains("START_LEXER();"));
+      free(compile_result.code);
+
+      options.compact_code = true;
+      compile_result = ts_compile_grammar_with_options(grammar.c_str(), options);
+      AssertThat(string(compile_result.code), Contains("LEX_STATE("));
+      free(compile_result.code);
+    });
+
+    it("writes lex functions that test the ASCII part of large character sets with a lookup", [&]() {
+      TSCompileResult compile_result = ts_compile_grammar(R"JSON({
+        "name": "ascii_classes",
+        "extras": [{"type": "PATTERN", "value": "\\s"}],
+        "rules": {
+          "program": {"type": "REPEAT", "content": {
+            "type": "CHOICE",
+            "members": [
+              {"type": "SYMBOL", "name": "identifier"},
+              {"type": "SYMBOL", "name": "string"}
+            ]
+          }},
+          "identifier": {"type": "PATTERN", "value": "[a-zA-Z_α-ω][a-zA-Z_0-9α-ω]*"},
+          "string": {"type": "PATTERN", "value": "'[^'\\\\\\n\u2028]*'"}
+        }
+      })JSON");
+      AssertThat(string(compile_result.code), Contains("ASCII_CLASS_CONTAINS("));
+
+      const TSLanguage *language = load_test_language("ascii_classes", compile_result);
+      AssertThat(parse(language, "a_Z9 'x y\"' αβ_1"), Equals("(program (identifier) (string) (identifier))"));
+      AssertThat(parse(language, "'a\\b'"), Contains("ERROR"));
+    });
+
+    it("can be written as C code with table lookups that are specialized for the grammar", [&]() {
+      const TSLanguage *c_language = load_test_language(
+        "binary_language",
+        ts_compile_grammar(grammar.c_str())
+      );
+      AssertThat((void *)c_language->parse_actions_fn, Equals<void *>(nullptr));
+
+      TSCompileOptions options = {};
+      options.specialize_table_lookups = true;
+      TSCompileResult compile_result = ts_compile_grammar_with_options(grammar.c_str(), options);
+      AssertThat(string(compile_result.code), Contains("ts_parse_actions_for(TSStateId state, TSSymbol symbol)"));
+      AssertThat(string(compile_result.code), Contains("switch (state) {"));
+      const TSLanguage *language = load_test_language("binary_language", compile_result);
+      AssertThat((void *)language->parse_actions_fn, !Equals<void *>(nullptr));
+
+      vector<string> texts({
+        "if x then if yε then zzz;",
+        "iffy; if then;",
+        "αβγ; if ; x;",
+        "x;\n\n  if %",
+      });
+      for (const string &text : texts) {
+        AssertThat(parse(language, text), Equals(parse(c_language, text)));
+      }
+    });
+
+    it("can order its parse states so that each state is followed by the state it shifts to", [&]() {
+      const TSLanguage *c_language = load_test_language(
+        "binary_language",
+        ts_compile_grammar(grammar.c_str())
+      );
+
+      TSCompileOptions options = {};
+      options.reorder_parse_states = true;
+      const TSLanguage *language = load_test_language(
+        "binary_language",
+        ts_compile_grammar_with_options(grammar.c_str(), options)
+      );
+      AssertThat(language->state_count, Equals(c_language->state_count));
+      AssertThat(language->large_state_count, !IsLessThan(c_language->large_state_count));
+
+      vector<string> texts({
+        "if x then if yε then zzz;",
+        "iffy; if then;",
+        "αβγ; if ; x;",
+        "x;\n\n  if %",
+      });
+      for (const string &text : texts) {
+        AssertThat(parse(language, text), Equals(parse(c_language, text)));
+      }
+    });
+
+    it("can renumber its symbols so that the rows of its parse table are narrower", [&]() {
+      const TSLanguage *c_language = load_test_language(
+        "binary_language",
+        ts_compile_grammar(grammar.c_str())
+      );
+
+      TSCompileOptions options = {};
+      options.narrow_parse_table_rows = true;
+      const TSLanguage *language = load_test_language(
+        "binary_language",
+        ts_compile_grammar_with_options(grammar.c_str(), options)
+      );
+      AssertThat(language->symbol_count, Equals(c_language->symbol_count));
+      AssertThat((void *)language->parse_table_row_offsets, !Equals<void *>(nullptr));
+      AssertThat(
+        language->parse_table_row_offsets[language->large_state_count],
+        IsLessThan(c_language->large_state_count * c_language->symbol_count)
+      );
+
+      vector<string> texts({
+        "if x then if yε then zzz;",
+        "iffy; if then;",
+        "αβγ; if ; x;",
+        "x;\n\n  if %",
+      });
+      for (const string &text : texts) {
+        AssertThat(parse(language, text), Equals(parse(c_language, text)));
+      }
+    });
+
+    it("can be written as C code that looks up keywords in a hash table", [&]() {
+      uint32_t length;
+      TSCompileResult compile_result = ts_compile_grammar_binary(grammar.c_str(), &length);
+      const TSLanguage *binary_language = ts_language_load(compile_result.code, length);
+      AssertThat((void *)binary_language->keyword_table, Equals<void *>(nullptr));
+
+      TSCompileResult c_compile_result = ts_compile_grammar(grammar.c_str());
+      AssertThat(string(c_compile_result.code), Contains("TSKeywordTable ts_keyword_table ="));
+      const TSLanguage *language = load_test_language("binary_language", c_compile_result);
+      AssertThat((void *)language->keyword_table, !Equals<void *>(nullptr));
+
+      vector<string> texts({
+        "if x then if yε then zzz;",
+        "iffy; if then; i; thenx;",
+        "αβγ; if ; x;",
+      });
+      for (const string &text : texts) {
+        AssertThat(parse(language, text), Equals(parse(binary_language, text)));
+      }
+
+      // Keywords that span chunks of the input are recognized by the keyword lex function.
+      SpyInput input("if xy then if z then w;", 3);
+      TSDocument *document = ts_document_new();
+      ts_document_set_language(document, language);
+      ts_document_set_input(document, input.input());
+      ts_document_parse(document);
+      char *tree_string = ts_node_string(ts_document_root_node(document), document);
+      AssertThat(string(tree_string), Equals(parse(language, "if xy then if z then w;")));
+      ts_free(tree_string);
+      ts_document_free(document);
+
+      ts_language_delete(binary_language);
+      free(compile_result.code);
+    });
+
+    it("merges lex states that recognize the same strings", [&]() {
+      uint32_t length;
+      TSCompileResult compile_result = ts_compile_grammar_binary(R"JSON({
+        "name": "equivalent_lex_states",
+        "extras": [{"type": "PATTERN", "value": "\\s"}],
+        "rules": {
+          "program": {"type": "REPEAT", "content": {"type": "SYMBOL", "name": "word"}},
+          "word": {"type": "PATTERN", "value": "a(bc)*|d(bcbc)*(bc)?"}
+        }
+      })JSON", &length);
+      const TSLanguage *language = ts_language_load(compile_result.code, length);
+      AssertThat((void *)language, !Equals<void *>(nullptr));
+      AssertThat(language->lex_table->state_count, Equals<uint32_t>(4));
+      AssertThat(parse(language, "abcbc dbcbcbc d a"), Equals("(program (word) (word) (word) (word))"));
+
+      ts_language_delete(language);
+      free(compile_result.code);
+    });
+
+    it("merges parse states whose actions lead to each other", [&]() {
+      uint32_t length;
+      TSCompileResult compile_result = ts_compile_grammar_binary(R"JSON({
+        "name": "nested_blocks",
+        "extras": [{"type": "PATTERN", "value": "\\s"}],
+        "rules": {
+          "program": {"type": "REPEAT", "content": {"type": "SYMBOL", "name": "block"}},
+          "block": {"type": "SEQ", "members": [
+            {"type": "STRING", "value": "{"},
+            {"type": "REPEAT", "content": {"type": "SYMBOL", "name": "block"}},
+            {"type": "STRING", "value": "}"}
+          ]}
+        }
+      })JSON", &length);
+      const TSLanguage *language = ts_language_load(compile_result.code, length);
+      AssertThat((void *)language, !Equals<void *>(nullptr));
+      AssertThat(language->state_count, Equals<uint32_t>(9));
+      AssertThat(parse(language, "{} {{} {{}}}"), Equals("(program (block) (block (block) (block (block))))"));
+
+      ts_language_delete(language);
+      free(compile_result.code);
+    });
+
+    it("rejects data that is malformed", [&]() {
+      uint32_t length;
+      TSCompileResult compile_result = ts_compile_grammar_binary(grammar.c_str(), &length);
+
+      AssertThat((void *)ts_language_load(compile_result.code, 0), Equals<void *>(nullptr));
+      AssertThat((void *)ts_language_load(compile_result.code, length - 4), Equals<void *>(nullptr));
+      compile_result.code[length - 8] ^= 0x7F;
+      AssertThat((void *)ts_language_load(compile_result.code, length), Equals<void *>(nullptr));
+      compile_result.code[length - 8] ^= 0x7F;
+      compile_result.code[0] = 'X';
+      AssertThat((void *)ts_language_load(compile_result.code, length), Equals<void *>(nullptr));
+
+      free(compile_result.code);
+    });
+
+    it("rejects data whose header has counts that are out of range", [&]() {
+      uint32_t length;
+      TSCompileResult compile_result = ts_compile_grammar_binary(grammar.c_str(), &length);
+
+      // The header's counts follow the magic number and the format and
+      // language versions.
+      enum {
+        SYMBOL_COUNT = 3,
+        ALIAS_COUNT = 4,
+        STATE_COUNT = 7,
+        LARGE_STATE_COUNT = 8,
+        MAX_ALIAS_SEQUENCE_LENGTH = 9,
+      };
+      auto header_field = [&](unsigned index) {
+        uint32_t result;
+        memcpy(&result, compile_result.code + index * sizeof(uint32_t), sizeof(result));
+        return result;
+      };
+      auto set_header_field = [&](unsigned index, uint32_t value) {
+        memcpy(compile_result.code + index * sizeof(uint32_t), &value, sizeof(value));
+      };
+
+      uint32_t symbol_count = header_field(SYMBOL_COUNT);
+      uint32_t alias_count = header_field(ALIAS_COUNT);
+      uint32_t state_count = header_field(STATE_COUNT);
+      uint32_t large_state_count = header_field(LARGE_STATE_COUNT);
+      uint32_t max_alias_sequence_length = header_field(MAX_ALIAS_SEQUENCE_LENGTH);
+      AssertThat(large_state_count % 2, Equals(0u));
+
+      vector<vector<pair<unsigned, uint32_t>>> corruptions({
+        // States must fit in a `TSStateId`.
+        {{STATE_COUNT, state_count + 0x10000}},
+        {{STATE_COUNT, state_count + 0x10000}, {LARGE_STATE_COUNT, large_state_count + 0x10000}},
+
+        // The symbol count's sum with the alias count, and its product with
+        // the (even) large state count, both wrap around to their real values
+        // in 32 bits.
+        {{SYMBOL_COUNT, symbol_count + 0x80000000u}, {ALIAS_COUNT, alias_count - 0x80000000u}},
+
+        // The length would be truncated to its real value in 16 bits.
+        {{MAX_ALIAS_SEQUENCE_LENGTH, max_alias_sequence_length + 0x10000}},
+
+        {{LARGE_STATE_COUNT, UINT32_MAX}},
+        {{SYMBOL_COUNT, UINT32_MAX}},
+      });
+
+      for (auto &corruption : corruptions) {
+        for (auto &field : corruption) set_header_field(field.first, field.second);
+        AssertThat((void *)ts_language_load(compile_result.code, length), Equals<void *>(nullptr));
+        set_header_field(SYMBOL_COUNT, symbol_count);
+        set_header_field(ALIAS_COUNT, alias_count);
+        set_header_field(STATE_COUNT, state_count);
+        set_header_field(LARGE_STATE_COUNT, large_state_count);
+        set_header_field(MAX_ALIAS_SEQUENCE_LENGTH, max_alias_sequence_length);
+      }
+
+      const TSLanguage *language = ts_language_load(compile_result.code, length);
+      AssertThat((void *)language, !Equals<void *>(nullptr));
+      ts_language_delete(language);
+      free(compile_result.code);
+    });
+
+    it("can't be generated for grammars with external tokens", [&]() {
+      uint32_t length;
+      TSCompileResult compile_result = ts_compile_grammar_binary(R"JSON({
+        "name": "external_tokens",
+        "externals": [{"type": "SYMBOL", "name": "a"}],
+        "rules": {"program": {"type": "SYMBOL", "name": "a"}}
+      })JSON", &length);
+
+      AssertThat((void *)compile_result.code, Equals<void *>(nullptr));
+      AssertThat(compile_result.error_type, Equals(TSCompileErrorTypeInvalidExternalToken));
+      free(compile_result.error_message);
+    });
   });
 });
 
@@ -1,10 +1,13 @@
 #include "test_helper.h"
 #include "runtime/alloc.h"
+#include "runtime/document.h"
+#include "runtime/node.h"
 #include "helpers/tree_helpers.h"
 #include "helpers/point_helpers.h"
 #include "helpers/load_language.h"
 #include "helpers/record_alloc.h"
 #include "helpers/stream_methods.h"
+#include "helpers/spy_input.h"
 
 START_TEST
 
@@ -92,6 +95,151 @@ describe("Node", [&]() {
     ts_free(node_string);
   });
 
+  describe("write_string(callback, payload), print_string(file)", [&]() {
+    it("writes the same string as ts_node_string, in pieces of bounded size", [&]() {
+      string large_json_string = "[";
+      for (unsigned i = 0; i < 1000; i++) large_json_string += "{\"a\": [1, null]}, ";
+      large_json_string += "{}]";
+      ts_document_set_input_string(document, large_json_string.c_str());
+      ts_document_parse(document);
+      TSNode node = ts_document_root_node(document);
+
+      vector<string> pieces;
+      ts_node_write_string(node, document, [](void *payload, const char *text, uint32_t length) {
+        static_cast<vector<string> *>(payload)->push_back(string(text, length));
+      }, &pieces);
+
+      string written;
+      for (const string &piece : pieces) {
+        AssertThat(piece.size(), IsLessThan(4097u));
+        written += piece;
+      }
+      AssertThat(pieces.size(), IsGreaterThan(1u));
+
+      char *node_string = ts_node_string(node, document);
+      AssertThat(written, Equals(string(node_string)));
+      ts_free(node_string);
+    });
+
+    it("prints the string to a file", [&]() {
+      FILE *file = tmpfile();
+      ts_node_print_string(root_node, document, file);
+      rewind(file);
+      char buffer[256] = {};
+      fread(buffer, 1, sizeof(buffer) - 1, file);
+      fclose(file);
+
+      char *node_string = ts_node_string(root_node, document);
+      AssertThat(string(buffer), Equals(string(node_string)));
+      ts_free(node_string);
+    });
+  });
+
+  describe("export(format, callback, payload)", [&]() {
+    struct ExportedNode {
+      uint32_t symbol;
+      bool named;
+      uint32_t start_byte;
+      uint32_t end_byte;
+      uint32_t child_count;
+    };
+
+    vector<ExportedNode> expected_nodes;
+    string output;
+
+    auto append_output = [](void *payload, const char *text, uint32_t length) {
+      static_cast<string *>(payload)->append(text, length);
+    };
+
+    before_each([&]() {
+      output.clear();
+      expected_nodes.clear();
+      std::function<void(TSNode)> visit = [&](TSNode node) {
+        expected_nodes.push_back({
+          ts_node_symbol(node),
+          ts_node_is_named(node),
+          ts_node_start_byte(node),
+          ts_node_end_byte(node),
+          ts_node_child_count(node),
+        });
+        for (uint32_t i = 0; i < ts_node_child_count(node); i++) visit(ts_node_child(node, i));
+      };
+      visit(root_node);
+    });
+
+    it("writes one JSON object per node, in pre-order", [&]() {
+      ts_node_export(root_node, TSExportFormatJSONLines, append_output, &output);
+
+      vector<string> lines;
+      size_t line_start = 0, line_end;
+      while ((line_end = output.find('\n', line_start)) != string::npos) {
+        lines.push_back(output.substr(line_start, line_end - line_start));
+        line_start = line_end + 1;
+      }
+      AssertThat(line_start, Equals(output.size()));
+      AssertThat(lines.size(), Equals(expected_nodes.size()));
+      for (size_t i = 0; i < lines.size(); i++) {
+        const ExportedNode &node = expected_nodes[i];
+        AssertThat(lines[i].find("{\"symbol\":" + to_string(node.symbol) + ",\"type\":\""), Equals(0u));
+        string suffix =
+          string("\",\"named\":") + (node.named ? "true" : "false") +
+          ",\"start_byte\":" + to_string(node.start_byte) +
+          ",\"end_byte\":" + to_string(node.end_byte) +
+          ",\"child_count\":" + to_string(node.child_count) + "}";
+        AssertThat(lines[i].substr(lines[i].size() - suffix.size()), Equals(suffix));
+      }
+
+      AssertThat(lines[0], Equals(
+        "{\"symbol\":" + to_string(ts_node_symbol(root_node)) + ",\"type\":\"array\",\"named\":true,"
+        "\"start_byte\":" + to_string(array_index) + ",\"end_byte\":" + to_string(array_end_index) +
+        ",\"child_count\":7}"));
+      AssertThat(lines[1], Equals(
+        "{\"symbol\":" + to_string(ts_node_symbol(ts_node_child(root_node, 0))) +
+        ",\"type\":\"[\",\"named\":false,"
+        "\"start_byte\":" + to_string(array_index) + ",\"end_byte\":" + to_string(array_index + 1) +
+        ",\"child_count\":0}"));
+      AssertThat(lines.back(), Equals(
+        "{\"symbol\":" + to_string(expected_nodes.back().symbol) + ",\"type\":\"]\",\"named\":false,"
+        "\"start_byte\":" + to_string(array_end_index - 1) + ",\"end_byte\":" + to_string(array_end_index) +
+        ",\"child_count\":0}"));
+    });
+
+    it("writes one record of varints per node, in pre-order", [&]() {
+      ts_node_export(root_node, TSExportFormatBinary, append_output, &output);
+
+      size_t position = 0;
+      auto read_varint = [&]() {
+        uint32_t result = 0;
+        for (unsigned shift = 0; position < output.size(); shift += 7) {
+          uint8_t byte = output[position++];
+          result |= (uint32_t)(byte & 0x7f) << shift;
+          if (!(byte & 0x80)) break;
+        }
+        return result;
+      };
+
+      vector<ExportedNode> nodes;
+      while (position < output.size()) {
+        ExportedNode node;
+        node.symbol = read_varint();
+        node.named = read_varint();
+        node.start_byte = read_varint();
+        node.end_byte = node.start_byte + read_varint();
+        node.child_count = read_varint();
+        nodes.push_back(node);
+      }
+
+      AssertThat(nodes.size(), Equals(expected_nodes.size()));
+      for (size_t i = 0; i < nodes.size(); i++) {
+        AssertThat(nodes[i].symbol, Equals(expected_nodes[i].symbol));
+        AssertThat(nodes[i].named, Equals(expected_nodes[i].named));
+        AssertThat(nodes[i].start_byte, Equals(expected_nodes[i].start_byte));
+        AssertThat(nodes[i].end_byte, Equals(expected_nodes[i].end_byte));
+        AssertThat(nodes[i].child_count, Equals(expected_nodes[i].child_count));
+      }
+    });
+  });
+
   describe("named_child_count(), named_child(i)", [&]() {
     it("returns the named child node at the given index", [&]() {
       AssertThat(ts_node_type(root_node, document), Equals("array"));
@@ -253,6 +401,28 @@ describe("Node", [&]() {
       AssertThat(ts_node_child_index(ts_node_child(root_node, 5)), Equals(5u));
       AssertThat(ts_node_child_index(ts_node_child(root_node, 6)), Equals(6u));
     });
+
+    it("returns the index of nodes that were reached in other ways", [&]() {
+      TSNode false_node = ts_node_named_child(root_node, 1);
+      AssertThat(ts_node_child_index(false_node), Equals(3u));
+      AssertThat(ts_node_child_index(ts_node_next_sibling(false_node)), Equals(4u));
+      AssertThat(ts_node_child_index(ts_node_prev_named_sibling(false_node)), Equals(1u));
+      AssertThat(ts_node_child_index(ts_node_first_child_for_byte(root_node, object_index)), Equals(5u));
+
+      TSNode null_node = ts_node_descendant_for_byte_range(root_node, null_index, null_index);
+      AssertThat(ts_node_child_index(null_node), Equals(2u));
+      AssertThat(ts_node_child_index(ts_node_parent(ts_node_parent(null_node))), Equals(5u));
+
+      TSNode children[7];
+      AssertThat(ts_node_children(root_node, children, 7), Equals(7u));
+      for (uint32_t i = 0; i < 7; i++) {
+        AssertThat(ts_node_child_index(children[i]), Equals(i));
+      }
+    });
+
+    it("returns UINT32_MAX for the root node", [&]() {
+      AssertThat(ts_node_child_index(ts_document_root_node(document)), Equals(UINT32_MAX));
+    });
   });
 
   describe("child_count(), child(i)", [&]() {
@@ -339,6 +509,34 @@ describe("Node", [&]() {
     });
   });
 
+  describe("children(buffer, size), named_children(buffer, size)", [&]() {
+    it("fills the buffer with the same nodes as child(i) and named_child(i)", [&]() {
+      vector<TSNode> children(ts_node_child_count(root_node));
+      AssertThat(ts_node_children(root_node, children.data(), children.size()), Equals(children.size()));
+      for (uint32_t i = 0; i < children.size(); i++) {
+        AssertThat(children[i], Equals(ts_node_child(root_node, i)));
+      }
+
+      vector<TSNode> named_children(ts_node_named_child_count(root_node));
+      AssertThat(ts_node_named_children(root_node, named_children.data(), named_children.size()), Equals(3u));
+      AssertThat(ts_node_type(named_children[0], document), Equals("number"));
+      AssertThat(ts_node_type(named_children[1], document), Equals("false"));
+      AssertThat(ts_node_type(named_children[2], document), Equals("object"));
+      AssertThat(ts_node_start_byte(named_children[2]), Equals(object_index));
+      AssertThat(ts_node_parent(named_children[2]), Equals(root_node));
+    });
+
+    it("stops when the buffer is full", [&]() {
+      TSNode children[2];
+      AssertThat(ts_node_children(root_node, children, 2), Equals(2u));
+      AssertThat(children[0], Equals(ts_node_child(root_node, 0)));
+      AssertThat(children[1], Equals(ts_node_child(root_node, 1)));
+
+      TSNode leaf = ts_node_named_child(root_node, 0);
+      AssertThat(ts_node_children(leaf, children, 2), Equals(0u));
+    });
+  });
+
   describe("next_sibling(), prev_sibling()", [&]() {
     it("returns the node's next and previous sibling, including anonymous nodes", [&]() {
       TSNode bracket_node1 = ts_node_child(root_node, 0);
@@ -526,6 +724,353 @@ describe("Node", [&]() {
       AssertThat(ts_node_end_point(node2), Equals<TSPoint>({ 6, 13 }));
     });
   });
+
+  describe("position queries on a node with many children", [&]() {
+    it("finds the same descendants as a linear search would", [&]() {
+      string members;
+      for (unsigned i = 0; i < 40; i++) {
+        if (i > 0) members += ",";
+        if (i % 4 == 1) {
+          members += R"JSON({"type": "ALIAS", "value": "B", "named": true, "content": {"type": "SYMBOL", "name": "b"}})JSON";
+        } else {
+          members += R"JSON({"type": "SYMBOL", "name": "b"})JSON";
+        }
+      }
+      string grammar = R"JSON({
+        "name": "wide_node",
+        "extras": [{"type": "PATTERN", "value": "\\s+"}, {"type": "SYMBOL", "name": "comment"}],
+        "rules": {
+          "a": {"type": "SEQ", "members": [)JSON" + members + R"JSON(]},
+          "b": {"type": "STRING", "value": "b"},
+          "comment": {"type": "STRING", "value": "..."}
+        }
+      })JSON";
+
+      string text;
+      vector<TSPoint> points;
+      vector<uint32_t> bytes;
+      TSPoint point = {0, 0};
+      for (unsigned i = 0; i < 40; i++) {
+        string separator = i % 7 == 6 ? "\n" : i % 5 == 4 ? " ... " : " ";
+        bytes.push_back(text.size());
+        points.push_back(point);
+        text += "b" + separator;
+        if (separator == "\n") {
+          point = {point.row + 1, 0};
+        } else {
+          point.column += 1 + separator.size();
+        }
+      }
+
+      ts_document_set_language(document, load_test_language("wide_node", ts_compile_grammar(grammar.c_str())));
+      ts_document_set_input_string(document, text.c_str());
+      ts_document_parse(document);
+      TSNode root = ts_document_root_node(document);
+      AssertThat(ts_node_child_count(root), Equals<size_t>(47));
+      AssertThat(((const Tree *)root.data)->has_child_offsets, IsTrue());
+
+      for (unsigned i = 0; i < 40; i++) {
+        const char *type = i % 4 == 1 ? "B" : "b";
+
+        TSNode node = ts_node_descendant_for_byte_range(root, bytes[i], bytes[i]);
+        AssertThat(ts_node_type(node, document), Equals(type));
+        AssertThat(ts_node_start_byte(node), Equals(bytes[i]));
+
+        node = ts_node_descendant_for_point_range(root, points[i], points[i]);
+        AssertThat(ts_node_type(node, document), Equals(type));
+        AssertThat(ts_node_start_point(node), Equals(points[i]));
+
+        node = ts_node_first_child_for_byte(root, bytes[i]);
+        AssertThat(ts_node_type(node, document), Equals(type));
+        AssertThat(ts_node_start_byte(node), Equals(bytes[i]));
+      }
+    });
+  });
+
+  describe("when a subtree is shared between two trees", [&]() {
+    it("reports the subtree's parent separately within each tree", [&]() {
+      Tree *old_tree = document->tree;
+      ts_tree_retain(old_tree);
+
+      string inserted_text = "0, ";
+      TSInputEdit edit = {};
+      edit.start_byte = number_index;
+      edit.start_point = {3, 2};
+      edit.extent_added.column = edit.bytes_added = inserted_text.size();
+      ts_document_edit(document, edit);
+      string new_json_string = json_string;
+      new_json_string.insert(number_index, inserted_text);
+      SpyInput input(new_json_string, 3);
+      ts_document_set_input(document, input.input());
+      ts_document_parse(document);
+
+      TSNode old_array = ts_node_child(ts_node_make_root(old_tree, document->language), 0);
+      TSNode new_array = ts_node_child(ts_document_root_node(document), 0);
+      AssertThat(ts_node_type(old_array, document), Equals("array"));
+      AssertThat(ts_node_type(new_array, document), Equals("array"));
+      AssertThat(old_array.data, !Equals(new_array.data));
+
+      TSNode old_object = ts_node_named_child(old_array, 2);
+      TSNode new_object = ts_node_named_child(new_array, 3);
+      AssertThat(old_object.data, Equals(new_object.data));
+
+      AssertThat(ts_node_parent(old_object), Equals(old_array));
+      AssertThat(ts_node_parent(new_object), Equals(new_array));
+      AssertThat(ts_node_start_byte(old_object), Equals(object_index));
+      AssertThat(ts_node_start_byte(new_object), Equals(object_index + inserted_text.size()));
+      AssertThat(ts_node_start_point(new_object), Equals<TSPoint>({ 5, 2 }));
+
+      ts_tree_release(document->tree_pool, old_tree);
+    });
+  });
+
+  describe("diff(old_node, new_node, callback, payload)", [&]() {
+    vector<string> entries;
+
+    auto record_entry = [](void *payload, const TSNodeDiffEntry *entry) {
+      auto recorded = static_cast<vector<pair<TSNodeDiffEntry, string>> *>(payload);
+      TSNode node = entry->type == TSNodeDiffRemoved ? entry->old_node : entry->new_node;
+      recorded->push_back({*entry, ts_language_symbol_name(node.language, ts_node_symbol(node))});
+      return recorded->size() < 100;
+    };
+
+    auto diff = [&](TSNode old_node, TSNode new_node) {
+      vector<pair<TSNodeDiffEntry, string>> recorded;
+      AssertThat(ts_node_diff(old_node, new_node, record_entry, &recorded), IsTrue());
+      const char *type_names[] = {"retained", "changed", "inserted", "removed"};
+      entries.clear();
+      for (auto &entry : recorded) {
+        entries.push_back(string(type_names[entry.first.type]) + " " + entry.second);
+      }
+      return recorded;
+    };
+
+    it("reports a node that is shared by both trees as retained, without its descendants", [&]() {
+      diff(root_node, root_node);
+      AssertThat(entries, Equals(vector<string>({ "retained array" })));
+    });
+
+    it("reports the changed nodes, and the nodes that were inserted and removed", [&]() {
+      TSDocumentSnapshot *snapshot = ts_document_snapshot(document);
+      TSNode old_array = ts_node_child(ts_document_snapshot_root_node(snapshot), 0);
+
+      string inserted_text = "0, ";
+      TSInputEdit edit = {};
+      edit.start_byte = number_index;
+      edit.start_point = {3, 2};
+      edit.extent_added.column = edit.bytes_added = inserted_text.size();
+      ts_document_edit(document, edit);
+      string new_json_string = json_string;
+      new_json_string.insert(number_index, inserted_text);
+      SpyInput input(new_json_string, 3);
+      ts_document_set_input(document, input.input());
+      ts_document_parse(document);
+      TSNode new_array = ts_node_child(ts_document_root_node(document), 0);
+
+      auto recorded = diff(old_array, new_array);
+      AssertThat(entries.front(), Equals("changed array"));
+      AssertThat(entries, Contains("retained object"));
+      AssertThat(entries, !Contains("retained pair"));
+      AssertThat(entries, !Contains("changed pair"));
+
+      int inserted_count = 0;
+      for (auto &entry : recorded) {
+        if (entry.first.type == TSNodeDiffInserted) inserted_count++;
+        if (entry.first.type == TSNodeDiffRemoved) inserted_count--;
+        if (entry.first.type == TSNodeDiffRetained) {
+          AssertThat(entry.first.old_node.data, Equals(entry.first.new_node.data));
+          AssertThat(
+            ts_node_start_byte(entry.first.new_node) - ts_node_start_byte(entry.first.old_node),
+            Equals<uint32_t>(entry.second == "[" ? 0 : inserted_text.size())
+          );
+        }
+      }
+      AssertThat(inserted_count, Equals(2));
+
+      ts_document_snapshot_delete(snapshot);
+    });
+
+    it("stops when the callback returns false", [&]() {
+      auto stop = [](void *payload, const TSNodeDiffEntry *entry) {
+        (*static_cast<int *>(payload))++;
+        return false;
+      };
+      int count = 0;
+      AssertThat(ts_node_diff(ts_document_root_node(document), root_node, stop, &count), IsFalse());
+      AssertThat(count, Equals(1));
+    });
+  });
+
+  describe("fingerprint()", [&]() {
+    it("is the same for subtrees with the same structure and text, regardless of their position", [&]() {
+      ts_document_set_input_string(document, "[[1, true], [1, true], [1, false], [2, true]]");
+      ts_document_parse(document);
+      TSNode array = ts_node_child(ts_document_root_node(document), 0);
+
+      AssertThat(ts_node_fingerprint(ts_node_named_child(array, 0)), Equals(ts_node_fingerprint(ts_node_named_child(array, 1))));
+      AssertThat(ts_node_fingerprint(ts_node_named_child(array, 0)), !Equals(ts_node_fingerprint(ts_node_named_child(array, 2))));
+      AssertThat(ts_node_fingerprint(ts_node_named_child(array, 0)), !Equals(ts_node_fingerprint(ts_node_named_child(array, 3))));
+    });
+
+    it("changes when the text of a descendant changes, even if its length doesn't", [&]() {
+      uint64_t old_object_fingerprint = ts_node_fingerprint(ts_node_named_child(root_node, 2));
+      uint64_t old_number_fingerprint = ts_node_fingerprint(ts_node_named_child(root_node, 0));
+
+      string new_json_string = json_string;
+      new_json_string.replace(string_index + 1, 1, "y");
+      ts_document_set_input_string(document, new_json_string.c_str());
+      ts_document_parse(document);
+      TSNode new_array = ts_node_child(ts_document_root_node(document), 0);
+
+      AssertThat(ts_node_fingerprint(ts_node_named_child(new_array, 2)), !Equals(old_object_fingerprint));
+      AssertThat(ts_node_fingerprint(ts_node_named_child(new_array, 0)), Equals(old_number_fingerprint));
+    });
+
+    it("is preserved for subtrees that are reused after an edit", [&]() {
+      uint64_t array_fingerprint = ts_node_fingerprint(root_node);
+      uint64_t object_fingerprint = ts_node_fingerprint(ts_node_named_child(root_node, 2));
+
+      string inserted_text = "0, ";
+      TSInputEdit edit = {};
+      edit.start_byte = number_index;
+      edit.start_point = {3, 2};
+      edit.extent_added.column = edit.bytes_added = inserted_text.size();
+      ts_document_edit(document, edit);
+      string new_json_string = json_string;
+      new_json_string.insert(number_index, inserted_text);
+      SpyInput input(new_json_string, 3);
+      ts_document_set_input(document, input.input());
+      ts_document_parse(document);
+      TSNode new_array = ts_node_child(ts_document_root_node(document), 0);
+
+      AssertThat(ts_node_fingerprint(ts_node_named_child(new_array, 3)), Equals(object_fingerprint));
+      AssertThat(ts_node_fingerprint(new_array), !Equals(array_fingerprint));
+    });
+  });
+});
+
+
+describe("TreeCursor", [&]() {
+  TSDocument *document;
+  TSTreeCursor *cursor;
+
+  before_each([&]() {
+    record_alloc::start();
+
+    document = ts_document_new();
+    ts_document_set_language(document, load_real_language("json"));
+    ts_document_set_input_string(document, json_string.c_str());
+    ts_document_parse(document);
+    cursor = ts_tree_cursor_new(ts_document_root_node(document));
+  });
+
+  after_each([&]() {
+    ts_tree_cursor_delete(cursor);
+    ts_document_free(document);
+
+    record_alloc::stop();
+    AssertThat(record_alloc::outstanding_allocation_indices(), IsEmpty());
+  });
+
+  auto walk_with_nodes = [&](TSNode node, vector<TSNode> *nodes) {
+    std::function<void(TSNode)> visit = [&](TSNode node) {
+      nodes->push_back(node);
+      for (uint32_t i = 0, n = ts_node_child_count(node); i < n; i++) {
+        visit(ts_node_child(node, i));
+      }
+    };
+    visit(node);
+  };
+
+  auto walk_with_cursor = [&](TSTreeCursor *cursor, vector<TSNode> *nodes) {
+    for (;;) {
+      nodes->push_back(ts_tree_cursor_current_node(cursor));
+      if (ts_tree_cursor_goto_first_child(cursor)) continue;
+      while (!ts_tree_cursor_goto_next_sibling(cursor)) {
+        if (!ts_tree_cursor_goto_parent(cursor)) return;
+      }
+    }
+  };
+
+  it("visits the same nodes as the node API, in the same order", [&]() {
+    vector<TSNode> expected_nodes, actual_nodes;
+    walk_with_nodes(ts_document_root_node(document), &expected_nodes);
+    walk_with_cursor(cursor, &actual_nodes);
+
+    AssertThat(actual_nodes.size(), Equals(expected_nodes.size()));
+    for (size_t i = 0; i < expected_nodes.size(); i++) {
+      AssertThat(actual_nodes[i], Equals(expected_nodes[i]));
+      AssertThat(ts_node_start_point(actual_nodes[i]), Equals(ts_node_start_point(expected_nodes[i])));
+      AssertThat(ts_node_type(actual_nodes[i], document), Equals(ts_node_type(expected_nodes[i], document)));
+
+      // Compare with the index that is found by searching from the parent.
+      TSNode unindexed_node = expected_nodes[i];
+      unindexed_node.child_index = TS_NODE_CHILD_INDEX_UNKNOWN;
+      AssertThat(ts_node_child_index(expected_nodes[i]), Equals(ts_node_child_index(unindexed_node)));
+      AssertThat(ts_node_child_index(actual_nodes[i]), Equals(ts_node_child_index(unindexed_node)));
+    }
+  });
+
+  it("moves between a node's children and back to the node", [&]() {
+    AssertThat(ts_tree_cursor_goto_parent(cursor), IsFalse());
+    AssertThat(ts_tree_cursor_goto_next_sibling(cursor), IsFalse());
+
+    AssertThat(ts_tree_cursor_goto_first_child(cursor), IsTrue());
+    TSNode array_node = ts_tree_cursor_current_node(cursor);
+    AssertThat(ts_node_type(array_node, document), Equals("array"));
+    AssertThat(ts_node_start_byte(array_node), Equals(array_index));
+
+    AssertThat(ts_tree_cursor_goto_first_child(cursor), IsTrue());
+    AssertThat(ts_node_type(ts_tree_cursor_current_node(cursor), document), Equals("["));
+    AssertThat(ts_tree_cursor_goto_next_sibling(cursor), IsTrue());
+    AssertThat(ts_node_type(ts_tree_cursor_current_node(cursor), document), Equals("number"));
+    AssertThat(ts_node_start_byte(ts_tree_cursor_current_node(cursor)), Equals(number_index));
+    AssertThat(ts_tree_cursor_goto_first_child(cursor), IsFalse());
+    AssertThat(ts_tree_cursor_goto_next_sibling(cursor), IsTrue());
+    AssertThat(ts_node_type(ts_tree_cursor_current_node(cursor), document), Equals(","));
+    AssertThat(ts_tree_cursor_goto_next_sibling(cursor), IsTrue());
+    AssertThat(ts_node_type(ts_tree_cursor_current_node(cursor), document), Equals("false"));
+    AssertThat(ts_node_start_byte(ts_tree_cursor_current_node(cursor)), Equals(false_index));
+
+    AssertThat(ts_tree_cursor_goto_parent(cursor), IsTrue());
+    AssertThat(ts_tree_cursor_current_node(cursor), Equals(array_node));
+    AssertThat(ts_tree_cursor_goto_next_sibling(cursor), IsFalse());
+    AssertThat(ts_tree_cursor_goto_parent(cursor), IsTrue());
+    AssertThat(ts_tree_cursor_goto_parent(cursor), IsFalse());
+  });
+
+  it("does not move outside of the node that it was created from", [&]() {
+    TSNode array_node = ts_node_child(ts_document_root_node(document), 0);
+    TSNode object_node = ts_node_named_child(array_node, 2);
+    TSTreeCursor *object_cursor = ts_tree_cursor_new(object_node);
+
+    vector<TSNode> expected_nodes, actual_nodes;
+    walk_with_nodes(object_node, &expected_nodes);
+    walk_with_cursor(object_cursor, &actual_nodes);
+    AssertThat(actual_nodes, Equals(expected_nodes));
+    AssertThat(ts_tree_cursor_current_node(object_cursor), Equals(object_node));
+
+    ts_tree_cursor_delete(object_cursor);
+  });
+
+  it("reports aliased children and extras", [&]() {
+    TSCompileResult compile_result = ts_compile_grammar(grammar_with_aliases_and_extras.c_str());
+    const TSLanguage *language = load_test_language("aliases_and_extras", compile_result);
+    ts_document_set_language(document, language);
+    ts_document_set_input_string(document, "b ... b ... b");
+    ts_document_parse(document);
+
+    ts_tree_cursor_delete(cursor);
+    cursor = ts_tree_cursor_new(ts_document_root_node(document));
+
+    vector<string> types;
+    AssertThat(ts_tree_cursor_goto_first_child(cursor), IsTrue());
+    do {
+      types.push_back(ts_node_type(ts_tree_cursor_current_node(cursor), document));
+    } while (ts_tree_cursor_goto_next_sibling(cursor));
+
+    AssertThat(types, Equals(vector<string>({ "b", "comment", "B", "comment", "b" })));
+  });
 });
 
 END_TEST
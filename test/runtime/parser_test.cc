@@ -7,6 +7,8 @@
 #include "helpers/point_helpers.h"
 #include "helpers/stderr_logger.h"
 #include "helpers/dedent.h"
+#include "helpers/file_helpers.h"
+#include "runtime/document.h"
 
 START_TEST
 
@@ -155,6 +157,47 @@ describe("Parser", [&]() {
       });
     });
 
+    describe("when there is a long run of unexpected tokens", [&]() {
+      it("collapses them into a single error leaf that spans their text", [&]() {
+        ts_document_set_language(document, load_real_language("json"));
+        string garbage;
+        for (unsigned i = 0; i < 300; i++) garbage += "false ";
+        set_text("  [123, " + garbage + "true]");
+
+        assert_root_node(
+          "(value (array (ERROR (number) (false) (ERROR)) (true)))");
+
+        TSNode error = ts_node_named_child(ts_node_child(root, 0), 0);
+        AssertThat(ts_node_child_count(error), Equals<size_t>(4));
+
+        TSNode skipped_tokens = ts_node_child(error, 3);
+        AssertThat(ts_node_type(skipped_tokens, document), Equals("ERROR"));
+        AssertThat(ts_node_child_count(skipped_tokens), Equals<size_t>(0));
+        AssertThat(get_node_text(skipped_tokens), Equals(garbage.substr(6, garbage.size() - 7)));
+      });
+
+      it("gives the error leaf a fingerprint of the tokens that it replaced", [&]() {
+        ts_document_set_language(document, load_real_language("json"));
+        string garbage, other_garbage;
+        for (unsigned i = 0; i < 300; i++) {
+          garbage += "false ";
+          other_garbage += (i == 150) ? "12345 " : "false ";
+        }
+
+        set_text("  [123, " + garbage + "true]");
+        TSNode error = ts_node_named_child(ts_node_child(root, 0), 0);
+        uint64_t fingerprint = ts_node_fingerprint(ts_node_child(error, 3));
+
+        delete input;
+        ts_document_invalidate(document);
+        set_text("  [123, " + other_garbage + "true]");
+        error = ts_node_named_child(ts_node_child(root, 0), 0);
+        TSNode skipped_tokens = ts_node_child(error, 3);
+        AssertThat(ts_node_child_count(skipped_tokens), Equals<size_t>(0));
+        AssertThat(ts_node_fingerprint(skipped_tokens), !Equals(fingerprint));
+      });
+    });
+
     describe("when there is an unexpected string at the end of a token", [&]() {
       it("computes the error's size and position correctly", [&]() {
         ts_document_set_language(document, load_real_language("json"));
@@ -448,6 +491,84 @@ describe("Parser", [&]() {
             "(print_statement (identifier))) "
           "(return_statement (expression_list (identifier))))");
       });
+
+      it("reuses nodes whose scanner states differ when the scanner declares them equivalent", [&]() {
+        string grammar_dir = join_path({"test", "fixtures", "test_grammars", "external_state_equivalence"});
+        TSCompileResult compile_result = ts_compile_grammar(read_file(join_path({grammar_dir, "grammar.json"})).c_str());
+        ts_document_set_language(document, load_test_language(
+          "external_state_equivalence",
+          compile_result,
+          join_path({grammar_dir, "scanner.c"})
+        ));
+
+        set_text("{ a b c d e f }");
+
+        // Opening another block first changes the scanner's count of opened
+        // blocks, but not its depth, for all of the text that follows.
+        insert_text(0, "{ } ");
+        assert_root_node(
+          "(program "
+            "(block (open_brace) (close_brace)) "
+            "(block (open_brace) (word) (word) (word) (word) (word) (word) (close_brace)))");
+
+        TSParseStats stats = ts_document_parse_stats(document);
+        AssertThat(stats.external_scanner_state_rejection_count, Equals(0u));
+        AssertThat(stats.reused_tree_count, IsGreaterThan(0u));
+      });
+
+      it("only serializes the scanner's state when the scanner reports a change", [&]() {
+        string grammar_dir = join_path({"test", "fixtures", "test_grammars", "external_state_change_tracking"});
+        TSCompileResult compile_result = ts_compile_grammar(read_file(join_path({grammar_dir, "grammar.json"})).c_str());
+        ts_document_set_language(document, load_test_language(
+          "external_state_change_tracking",
+          compile_result,
+          join_path({grammar_dir, "scanner.c"})
+        ));
+
+        ts_document_set_input_string(document, "; a ; ! b ; ; ! ;");
+        TSParseOptions options = {};
+        options.enable_profiling = true;
+        ts_document_parse_with_options(document, options);
+        assert_root_node(
+          "(program (marker) (word) (marker) (toggle) (word) (marker) (marker) (toggle) (marker))");
+
+        TSParseProfile profile = ts_document_parse_profile(document);
+        AssertThat(profile.external_serialize.count, Equals(2u));
+
+        // The markers after a new toggle can't be reused, because their
+        // shared states are now different from the scanner's.
+        insert_text(0, "! ");
+        assert_root_node(
+          "(program (toggle) (marker) (word) (marker) (toggle) (word) (marker) (marker) (toggle) (marker))");
+      });
+
+      it("creates the scanner's shared data once for all of the documents", [&]() {
+        string grammar_dir = join_path({"test", "fixtures", "test_grammars", "external_shared_data"});
+        TSCompileResult compile_result = ts_compile_grammar(read_file(join_path({grammar_dir, "grammar.json"})).c_str());
+        const TSLanguage *language = load_test_language(
+          "external_shared_data",
+          compile_result,
+          join_path({grammar_dir, "scanner.c"})
+        );
+        TSExternalScannerSharedData *shared_data = language->external_scanner.shared_data;
+
+        ts_document_set_language(document, language);
+        set_text("if a then b end");
+        assert_root_node("(program (keyword) (word) (keyword) (word) (keyword))");
+        void *data = shared_data->data;
+        AssertThat(data, !Equals<void *>(nullptr));
+
+        TSDocument *other_document = ts_document_new();
+        ts_document_set_language(other_document, language);
+        ts_document_set_input_string(other_document, "while c do d end");
+        ts_document_parse(other_document);
+        char *node_string = ts_node_string(ts_document_root_node(other_document), other_document);
+        AssertThat(node_string, Equals("(program (keyword) (word) (keyword) (word) (keyword))"));
+        AssertThat(shared_data->data, Equals(data));
+
+        ts_free(node_string);
+        ts_document_free(other_document);
+      });
     });
 
     it("does not try to reuse nodes that are within the edited region", [&]() {
@@ -504,6 +625,84 @@ describe("Parser", [&]() {
       AssertThat(ts_node_end_byte(root), Equals(strlen("'\u03A9\u03A9\u03A9 \u2014 \u0394\u0394';")));
     });
 
+    it("reuses tokens that were already lexed by other stack versions", [&]() {
+      TSCompileResult compile_result = ts_compile_grammar(R"JSON({
+        "name": "ambiguous_prefix",
+
+        "conflicts": [["a", "b"]],
+
+        "rules": {
+          "program": {
+            "type": "CHOICE",
+            "members": [
+              {
+                "type": "SEQ",
+                "members": [
+                  {"type": "SYMBOL", "name": "a"},
+                  {"type": "STRING", "value": "!"},
+                  {"type": "STRING", "value": "?"}
+                ]
+              },
+              {
+                "type": "SEQ",
+                "members": [
+                  {"type": "SYMBOL", "name": "b"},
+                  {"type": "STRING", "value": "!"},
+                  {"type": "STRING", "value": "?"},
+                  {"type": "STRING", "value": "?"}
+                ]
+              }
+            ]
+          },
+
+          "a": {"type": "STRING", "value": "x"},
+          "b": {"type": "STRING", "value": "x"}
+        }
+      })JSON");
+
+      ts_document_set_language(document, load_test_language("ambiguous_prefix", compile_result));
+      set_text("x!?");
+      assert_root_node("(program (a))");
+
+      TokenCache *token_cache = &document->parser->token_cache;
+      AssertThat(token_cache->hit_count, IsGreaterThan(0u));
+
+      // Each of the tokens 'x', '!', '?' and the end of input is lexed only once.
+      AssertThat(token_cache->miss_count, Equals(4u));
+    });
+
+    it("tracks positions correctly when skipping long runs of whitespace", [&]() {
+      TSCompileResult compile_result = ts_compile_grammar(R"JSON({
+        "name": "whitespace_runs",
+
+        "extras": [
+          {"type": "PATTERN", "value": "\\s"}
+        ],
+
+        "rules": {
+          "program": {
+            "type": "REPEAT",
+            "content": {"type": "SYMBOL", "name": "word"}
+          },
+
+          "word": {"type": "PATTERN", "value": "[a-z]+"}
+        }
+      })JSON");
+
+      ts_document_set_language(document, load_test_language("whitespace_runs", compile_result));
+      set_text("   \n\t\t    abc      \n\n        defghijklmnop \u03A9");
+
+      assert_root_node("(program (word) (word) (ERROR (UNEXPECTED 937)))");
+
+      TSNode word1 = ts_node_named_child(root, 0);
+      TSNode word2 = ts_node_named_child(root, 1);
+      AssertThat(ts_node_start_byte(word1), Equals(strlen("   \n\t\t    ")));
+      AssertThat(ts_node_start_point(word1), Equals<TSPoint>({1, 6}));
+      AssertThat(ts_node_start_byte(word2), Equals(strlen("   \n\t\t    abc      \n\n        ")));
+      AssertThat(ts_node_start_point(word2), Equals<TSPoint>({3, 8}));
+      AssertThat(ts_node_end_point(word2), Equals<TSPoint>({3, 21}));
+    });
+
     it("handles non-UTF8 characters", [&]() {
       const char *string = "cons\xeb\x00e=ls\x83l6hi');\x0a";
 
@@ -515,6 +714,687 @@ describe("Parser", [&]() {
       AssertThat(ts_node_end_byte(root), Equals(strlen(string)));
     });
   });
+  describe("limiting the number of stack versions", [&]() {
+    before_each([&]() {
+      TSCompileResult compile_result = ts_compile_grammar(R"JSON({
+        "name": "ambiguous_words",
+
+        "extras": [
+          {"type": "PATTERN", "value": "\\s"}
+        ],
+
+        "conflicts": [
+          ["a", "b"]
+        ],
+
+        "rules": {
+          "program": {
+            "type": "REPEAT",
+            "content": {
+              "type": "CHOICE",
+              "members": [
+                {"type": "SYMBOL", "name": "c"},
+                {"type": "SYMBOL", "name": "d"}
+              ]
+            }
+          },
+
+          "c": {
+            "type": "SEQ",
+            "members": [
+              {"type": "SYMBOL", "name": "a"},
+              {"type": "STRING", "value": "!"}
+            ]
+          },
+
+          "d": {
+            "type": "SEQ",
+            "members": [
+              {"type": "SYMBOL", "name": "b"},
+              {"type": "STRING", "value": "!"}
+            ]
+          },
+
+          "a": {
+            "type": "PREC_DYNAMIC",
+            "value": 1,
+            "content": {"type": "STRING", "value": "x"}
+          },
+
+          "b": {"type": "STRING", "value": "x"}
+        }
+      })JSON");
+
+      ts_document_set_language(document, load_test_language("ambiguous_words", compile_result));
+      input = new SpyInput("x! x! x!", chunk_size);
+      ts_document_set_input(document, input->input());
+    });
+
+    it("keeps every stack version within the default budget", [&]() {
+      ts_document_parse(document);
+      assert_root_node("(program (c (a)) (c (a)) (c (a)))");
+
+      TSParseStats stats = ts_document_parse_stats(document);
+      AssertThat(stats.peak_version_count, IsGreaterThan(1u));
+      AssertThat(stats.prune_count, Equals(0u));
+      AssertThat(stats.pruned_version_count, Equals(0u));
+    });
+
+    it("discards the versions with the lowest dynamic precedence when the budget is exceeded", [&]() {
+      TSParseOptions options = {};
+      options.max_version_count = 1;
+      ts_document_parse_with_options(document, options);
+      assert_root_node("(program (c (a)) (c (a)) (c (a)))");
+
+      TSParseStats stats = ts_document_parse_stats(document);
+      AssertThat(stats.prune_count, IsGreaterThan(0u));
+      AssertThat(stats.pruned_version_count, IsGreaterThan(0u));
+    });
+  });
+
+  describe("recording statistics about the reuse of subtrees", [&]() {
+    before_each([&]() {
+      ts_document_set_language(document, load_real_language("json"));
+    });
+
+    it("counts nothing as reused in an initial parse", [&]() {
+      set_text("[1, 2, 3]");
+
+      TSParseStats stats = ts_document_parse_stats(document);
+      AssertThat(stats.reused_tree_count, Equals(0u));
+      AssertThat(stats.reused_byte_count, Equals(0u));
+      AssertThat(stats.lexed_token_count, Equals(8u));
+    });
+
+    it("counts the subtrees that are reused and rejected in an incremental parse", [&]() {
+      string text = "[";
+      for (unsigned i = 0; i < 50; i++) text += "[" + to_string(i) + "], ";
+      text += "[50]]";
+      set_text(text);
+
+      replace_text(text.find("25"), 2, "null");
+      char *tree_string = ts_node_string(root, document);
+      AssertThat(string(tree_string), Contains("(number)) (array (null)) (array (number)"));
+      ts_free(tree_string);
+
+      TSParseStats stats = ts_document_parse_stats(document);
+      AssertThat(stats.reused_tree_count, IsGreaterThan(0u));
+      AssertThat(stats.reused_byte_count, IsGreaterThan<uint32_t>(text.size() / 2));
+      AssertThat(stats.reused_byte_count, IsLessThan<uint32_t>(text.size()));
+      AssertThat(stats.changed_tree_rejection_count, IsGreaterThan(0u));
+      AssertThat(stats.lexed_token_count, IsLessThan(10u));
+    });
+
+    it("reuses subtrees while there are several stack versions, if their states match", [&]() {
+      TSCompileResult compile_result = ts_compile_grammar(R"JSON({
+        "name": "ambiguous_head",
+
+        "extras": [
+          {"type": "PATTERN", "value": "\\s"}
+        ],
+
+        "conflicts": [["a", "b"]],
+
+        "rules": {
+          "program": {
+            "type": "CHOICE",
+            "members": [
+              {
+                "type": "SEQ",
+                "members": [
+                  {"type": "SYMBOL", "name": "head"},
+                  {"type": "REPEAT", "content": {"type": "SYMBOL", "name": "group"}},
+                  {"type": "STRING", "value": "!"}
+                ]
+              },
+              {
+                "type": "SEQ",
+                "members": [
+                  {"type": "SYMBOL", "name": "b"},
+                  {"type": "REPEAT", "content": {"type": "SYMBOL", "name": "group"}},
+                  {"type": "STRING", "value": "?"}
+                ]
+              }
+            ]
+          },
+
+          "head": {
+            "type": "CHOICE",
+            "members": [
+              {"type": "SYMBOL", "name": "a"},
+              {"type": "STRING", "value": "y"}
+            ]
+          },
+
+          "group": {
+            "type": "SEQ",
+            "members": [
+              {"type": "STRING", "value": "("},
+              {"type": "REPEAT", "content": {"type": "SYMBOL", "name": "word"}},
+              {"type": "STRING", "value": ")"}
+            ]
+          },
+
+          "word": {"type": "PATTERN", "value": "[0-9]+"},
+          "a": {"type": "STRING", "value": "x"},
+          "b": {"type": "STRING", "value": "x"}
+        }
+      })JSON");
+
+      ts_document_set_language(document, load_test_language("ambiguous_head", compile_result));
+      set_text("y (1 2) (3 4) (5 6) !");
+      assert_root_node("(program (head) (group (word) (word)) (group (word) (word)) (group (word) (word)))");
+
+      ts_document_set_trace_capacity(document, 256);
+      replace_text(0, 1, "x");
+      assert_root_node("(program (head (a)) (group (word) (word)) (group (word) (word)) (group (word) (word)))");
+
+      // The groups are reused whole, rather than one token at a time.
+      vector<TSTraceEvent> events(256);
+      events.resize(ts_document_drain_trace(document, events.data(), events.size(), nullptr));
+      unsigned reused_group_count = 0;
+      for (const TSTraceEvent &event : events) {
+        if (event.type == TSTraceEventReuse && event.detail >= strlen(" (1 2)")) reused_group_count++;
+      }
+      AssertThat(reused_group_count, IsGreaterThan(0u));
+      AssertThat(ts_document_parse_stats(document).peak_version_count, IsGreaterThan(1u));
+    });
+
+    it("reuses fragile subtrees when the text that they depend on is unchanged", [&]() {
+      TSCompileResult compile_result = ts_compile_grammar(R"JSON({
+        "name": "fragile_statements",
+
+        "extras": [
+          {"type": "PATTERN", "value": "\\s"}
+        ],
+
+        "conflicts": [["a", "b"]],
+
+        "rules": {
+          "program": {"type": "REPEAT", "content": {"type": "SYMBOL", "name": "statement"}},
+
+          "statement": {
+            "type": "CHOICE",
+            "members": [
+              {
+                "type": "SEQ",
+                "members": [
+                  {"type": "SYMBOL", "name": "a"},
+                  {"type": "STRING", "value": "!"}
+                ]
+              },
+              {
+                "type": "SEQ",
+                "members": [
+                  {"type": "SYMBOL", "name": "b"},
+                  {"type": "STRING", "value": "!"}
+                ]
+              }
+            ]
+          },
+
+          "a": {"type": "STRING", "value": "x"},
+          "b": {"type": "STRING", "value": "x"}
+        }
+      })JSON");
+
+      // Each statement is reduced while there are two stack versions, so it
+      // is fragile.
+      ts_document_set_language(document, load_test_language("fragile_statements", compile_result));
+      string text = "x ! x ! x !";
+      set_text(text);
+      AssertThat(ts_node_child_count(root), Equals(3u));
+
+      ts_document_set_trace_capacity(document, 256);
+      replace_text(text.size(), 0, " x !");
+      AssertThat(ts_node_child_count(root), Equals(4u));
+      AssertThat(ts_node_has_error(root), IsFalse());
+
+      vector<TSTraceEvent> events(256);
+      events.resize(ts_document_drain_trace(document, events.data(), events.size(), nullptr));
+      unsigned reused_statement_count = 0;
+      for (const TSTraceEvent &event : events) {
+        if (event.type == TSTraceEventReuse && event.detail >= strlen("x !")) reused_statement_count++;
+      }
+      AssertThat(reused_statement_count, IsGreaterThan(0u));
+    });
+
+    it("relexes only the tokens next to an edit at the end of an identifier", [&]() {
+      TSCompileResult compile_result = ts_compile_grammar(R"JSON({
+        "name": "assignments",
+
+        "extras": [
+          {"type": "PATTERN", "value": "\\s"}
+        ],
+
+        "rules": {
+          "program": {
+            "type": "REPEAT",
+            "content": {"type": "SYMBOL", "name": "assignment"}
+          },
+
+          "assignment": {
+            "type": "SEQ",
+            "members": [
+              {"type": "SYMBOL", "name": "identifier"},
+              {"type": "STRING", "value": "="},
+              {"type": "SYMBOL", "name": "_expression"},
+              {"type": "STRING", "value": ";"}
+            ]
+          },
+
+          "_expression": {
+            "type": "CHOICE",
+            "members": [
+              {"type": "SYMBOL", "name": "identifier"},
+              {"type": "SYMBOL", "name": "number"},
+              {"type": "SYMBOL", "name": "list"}
+            ]
+          },
+
+          "list": {
+            "type": "SEQ",
+            "members": [
+              {"type": "STRING", "value": "["},
+              {
+                "type": "REPEAT",
+                "content": {
+                  "type": "SEQ",
+                  "members": [
+                    {"type": "SYMBOL", "name": "_expression"},
+                    {"type": "STRING", "value": ","}
+                  ]
+                }
+              },
+              {"type": "STRING", "value": "]"}
+            ]
+          },
+
+          "identifier": {"type": "PATTERN", "value": "[a-z]+"},
+          "number": {"type": "PATTERN", "value": "\\d+"}
+        }
+      })JSON");
+
+      ts_document_set_language(document, load_test_language("assignments", compile_result));
+      string text = "a = [1, 2,]; b = [3, 4,]; c = d; e = [5, 6,]; f = 7;";
+      set_text(text);
+
+      // Only the identifier and the `;` that its lexer looked at are lexed
+      // again. The statements on either side, including the ones that were
+      // the lookahead of the nodes reduced around the edit, are reused.
+      insert_text(text.find("d;") + 1, "x");
+      assert_root_node("(program "
+        "(assignment (identifier) (list (number) (number))) "
+        "(assignment (identifier) (list (number) (number))) "
+        "(assignment (identifier) (identifier)) "
+        "(assignment (identifier) (list (number) (number))) "
+        "(assignment (identifier) (number)))");
+
+      TSParseStats stats = ts_document_parse_stats(document);
+      AssertThat(stats.lexed_token_count, Equals(2u));
+      AssertThat(stats.reused_byte_count, IsGreaterThan<uint32_t>(text.size() - strlen("c = dx;")));
+
+      size_t byte_read_count = 0;
+      for (const string &string_read : input->strings_read()) byte_read_count += string_read.size();
+      AssertThat(byte_read_count, IsLessThan(text.size() / 2));
+    });
+  });
+
+  describe("profiling the phases of a parse", [&]() {
+    before_each([&]() {
+      ts_document_set_language(document, load_real_language("json"));
+      input = new SpyInput("[1, @, {\"a\": 2}]", chunk_size);
+      ts_document_set_input(document, input->input());
+    });
+
+    it("records nothing unless profiling is enabled", [&]() {
+      ts_document_parse(document);
+
+      TSParseProfile profile = ts_document_parse_profile(document);
+      AssertThat(profile.lex.count, Equals(0u));
+      AssertThat(profile.shift.count, Equals(0u));
+      AssertThat(profile.reduce.count, Equals(0u));
+      AssertThat(profile.step_count, Equals(0u));
+    });
+
+    it("counts the calls made in each phase, and the stack versions at each step", [&]() {
+      TSParseOptions options = {};
+      options.enable_profiling = true;
+      ts_document_parse_with_options(document, options);
+      assert_root_node("(value (array (number) (ERROR (UNEXPECTED '@')) (object (pair (string) (number)))))");
+
+      TSParseProfile profile = ts_document_parse_profile(document);
+      AssertThat(profile.lex.count, Equals(ts_document_parse_stats(document).lexed_token_count));
+      AssertThat(profile.shift.count, IsGreaterThan(0u));
+      AssertThat(profile.reduce.count, IsGreaterThan(0u));
+      AssertThat(profile.recover.count, IsGreaterThan(0u));
+      AssertThat(profile.condense.count, Equals(profile.step_count));
+      AssertThat(profile.max_version_count, IsGreaterThan(0u));
+      AssertThat(profile.total_version_count, IsGreaterThan<uint64_t>(0));
+      AssertThat(profile.external_scan.count, Equals(0u));
+    });
+
+    it("counts the calls into the external scanner", [&]() {
+      ts_document_set_language(document, load_real_language("python"));
+      ts_document_set_input_string(document, "if a:\n  if b:\n    c\nd\n");
+      TSParseOptions options = {};
+      options.enable_profiling = true;
+      ts_document_parse_with_options(document, options);
+
+      TSParseProfile profile = ts_document_parse_profile(document);
+      AssertThat(profile.external_scan.count, IsGreaterThan(0u));
+      AssertThat(profile.external_serialize.count, IsGreaterThan(0u));
+      AssertThat(profile.external_serialize.count, IsLessThan(profile.external_scan.count + 1));
+    });
+  });
+
+  describe("profiling parse states", [&]() {
+    it("records nothing unless state profiling is enabled", [&]() {
+      ts_document_set_language(document, load_real_language("json"));
+      set_text("[1, 2]");
+
+      TSStateProfile profile = ts_document_state_profile(document);
+      AssertThat(profile.parse_state_count, Equals(0u));
+      AssertThat(profile.lex_state_count, Equals(0u));
+      AssertThat(profile.symbol_count, Equals(0u));
+    });
+
+    it("counts the entries, splits and reductions in each state", [&]() {
+      TSCompileResult compile_result = ts_compile_grammar(R"JSON({
+        "name": "profiled_ambiguity",
+
+        "conflicts": [["a", "b"]],
+
+        "rules": {
+          "program": {
+            "type": "CHOICE",
+            "members": [
+              {
+                "type": "SEQ",
+                "members": [
+                  {"type": "SYMBOL", "name": "a"},
+                  {"type": "STRING", "value": "!"}
+                ]
+              },
+              {
+                "type": "SEQ",
+                "members": [
+                  {"type": "SYMBOL", "name": "b"},
+                  {"type": "STRING", "value": "!"},
+                  {"type": "STRING", "value": "?"}
+                ]
+              }
+            ]
+          },
+
+          "a": {"type": "STRING", "value": "x"},
+          "b": {"type": "STRING", "value": "x"}
+        }
+      })JSON");
+
+      const TSLanguage *language = load_test_language("profiled_ambiguity", compile_result);
+      ts_document_set_language(document, language);
+      input = new SpyInput("x!", chunk_size);
+      ts_document_set_input(document, input->input());
+      TSParseOptions options = {};
+      options.enable_state_profiling = true;
+      ts_document_parse_with_options(document, options);
+      assert_root_node("(program (a))");
+
+      TSStateProfile profile = ts_document_state_profile(document);
+      AssertThat(profile.parse_state_count, IsGreaterThan(0u));
+      AssertThat(profile.lex_state_count, IsGreaterThan(0u));
+      AssertThat(profile.symbol_count, Equals(ts_language_symbol_count(language)));
+
+      uint32_t entry_count = 0, split_count = 0, reduction_count = 0;
+      for (uint32_t i = 0; i < profile.parse_state_count; i++) {
+        entry_count += profile.parse_states[i].entry_count;
+        split_count += profile.parse_states[i].split_count;
+        reduction_count += profile.parse_states[i].reduction_count;
+      }
+      AssertThat(entry_count, IsGreaterThan(reduction_count));
+      AssertThat(split_count, Equals(1u));
+
+      TSSymbol a = ts_language_symbol_for_name(language, "a", 1, true);
+      TSSymbol b = ts_language_symbol_for_name(language, "b", 1, true);
+      AssertThat(profile.symbol_reduction_counts[a], Equals(1u));
+      AssertThat(profile.symbol_reduction_counts[b], Equals(1u));
+
+      uint32_t symbol_reduction_count = 0;
+      for (uint32_t i = 0; i < profile.symbol_count; i++) {
+        symbol_reduction_count += profile.symbol_reduction_counts[i];
+      }
+      AssertThat(symbol_reduction_count, Equals(reduction_count));
+    });
+
+    it("numbers the states in the same way as the compiler's conflict report", [&]() {
+      const char *grammar = R"JSON({
+        "name": "reordered_ambiguity",
+
+        "extras": [
+          {"type": "PATTERN", "value": "\\s"}
+        ],
+
+        "conflicts": [["a", "b"]],
+
+        "rules": {
+          "program": {"type": "REPEAT", "content": {"type": "SYMBOL", "name": "_statement"}},
+
+          "_statement": {
+            "type": "CHOICE",
+            "members": [
+              {
+                "type": "SEQ",
+                "members": [
+                  {"type": "SYMBOL", "name": "a"},
+                  {"type": "STRING", "value": "!"}
+                ]
+              },
+              {
+                "type": "SEQ",
+                "members": [
+                  {"type": "SYMBOL", "name": "b"},
+                  {"type": "STRING", "value": "!"},
+                  {"type": "STRING", "value": "?"}
+                ]
+              },
+              {"type": "SYMBOL", "name": "group"}
+            ]
+          },
+
+          "group": {
+            "type": "SEQ",
+            "members": [
+              {"type": "STRING", "value": "("},
+              {"type": "REPEAT", "content": {"type": "SYMBOL", "name": "_statement"}},
+              {"type": "STRING", "value": ")"}
+            ]
+          },
+
+          "a": {"type": "STRING", "value": "x"},
+          "b": {"type": "STRING", "value": "x"}
+        }
+      })JSON";
+
+      // Reordering the states moves the one where the parser splits.
+      TSCompileOptions options = {};
+      options.reorder_parse_states = true;
+      TSCompileResult report_result = ts_compile_grammar_conflict_report(grammar, options);
+      AssertThat(report_result.error_type, Equals(TSCompileErrorTypeNone));
+      string report(report_result.code);
+      free(report_result.code);
+
+      ts_document_set_language(document, load_test_language(
+        "reordered_ambiguity",
+        ts_compile_grammar_with_options(grammar, options)
+      ));
+      input = new SpyInput("x!", chunk_size);
+      ts_document_set_input(document, input->input());
+      TSParseOptions parse_options = {};
+      parse_options.enable_state_profiling = true;
+      ts_document_parse_with_options(document, parse_options);
+      assert_root_node("(program (a))");
+
+      TSStateProfile profile = ts_document_state_profile(document);
+      vector<uint32_t> split_states;
+      for (uint32_t i = 0; i < profile.parse_state_count; i++) {
+        if (profile.parse_states[i].split_count > 0) split_states.push_back(i);
+      }
+      AssertThat(split_states.size(), Equals<size_t>(1));
+      AssertThat(report, Contains("State " + to_string(split_states[0]) + ", lookahead '!':\n"));
+    });
+  });
+
+  describe("limiting the work done to recover from errors", [&]() {
+    string text;
+
+    before_each([&]() {
+      text = "[";
+      for (unsigned i = 0; i < 1000; i++) text += "{[: 1, }]\"a";
+      ts_document_set_language(document, load_real_language("json"));
+      input = new SpyInput(text, chunk_size);
+      ts_document_set_input(document, input->input());
+    });
+
+    it("searches for the best recovery when there is no budget", [&]() {
+      ts_document_parse(document);
+
+      TSParseStats stats = ts_document_parse_stats(document);
+      AssertThat(stats.limited_recovery_count, Equals(0u));
+      AssertThat(stats.recovery_step_count, IsGreaterThan<uint32_t>(4 * text.size()));
+    });
+
+    it("skips tokens instead of searching once the budget is spent", [&]() {
+      TSParseOptions options = {};
+      options.max_recovery_steps_per_byte = 2;
+      ts_document_parse_with_options(document, options);
+
+      root = ts_document_root_node(document);
+      AssertThat(ts_node_end_byte(root), Equals(text.size()));
+      AssertThat(ts_node_has_error(root), IsTrue());
+
+      TSParseStats stats = ts_document_parse_stats(document);
+      AssertThat(stats.limited_recovery_count, IsGreaterThan(0u));
+      AssertThat(stats.recovery_step_count, IsLessThan<uint32_t>(3 * text.size()));
+    });
+
+    it("searches shallower stack summaries once the budget is nearly spent", [&]() {
+      ts_document_parse(document);
+      uint32_t unlimited_summary_depth = ts_document_parse_stats(document).max_summary_depth;
+      AssertThat(unlimited_summary_depth, IsGreaterThan(0u));
+
+      TSParseOptions options = {};
+      options.max_recovery_steps_per_byte = 1;
+      ts_document_invalidate(document);
+      ts_document_parse_with_options(document, options);
+      AssertThat(ts_document_parse_stats(document).max_summary_depth, IsLessThan(unlimited_summary_depth));
+    });
+
+    it("keeps the default summary depth when errors are recovered from near the top of the stack", [&]() {
+      string shallow_text = "[";
+      for (unsigned i = 0; i < 100; i++) shallow_text += "1 2, ";
+      delete input;
+      set_text(shallow_text + "3]");
+
+      TSParseStats stats = ts_document_parse_stats(document);
+      AssertThat(stats.limited_recovery_count, Equals(0u));
+      AssertThat(stats.max_summary_depth, Equals(16u));
+    });
+
+    it("deepens the summaries when errors can only be recovered from far down the stack", [&]() {
+      string deep_text = "[";
+      for (unsigned i = 0; i < 20; i++) deep_text += "{\"a\": " + string(24, '[') + "1}, ";
+      delete input;
+      set_text(deep_text + "2]");
+
+      TSParseStats stats = ts_document_parse_stats(document);
+      AssertThat(stats.limited_recovery_count, Equals(0u));
+      AssertThat(stats.max_summary_depth, Equals(64u));
+    });
+  });
+
+  describe("reserving the arrays of tree pools", [&]() {
+    it("reserves each pool that a shared parser parses into at the sizes its earlier pools grew to", [&]() {
+      string text = "[";
+      for (unsigned i = 0; i < 500; i++) text += "[1, 2, [3]], ";
+      text += "4]";
+
+      TSParser *parser = ts_parser_new();
+      ts_document_set_language(document, load_real_language("json"));
+      ts_document_set_input_string(document, text.c_str());
+      ts_document_parse_with_parser(document, parser, TSParseOptions{});
+      ts_document_invalidate(document);
+      ts_document_parse_with_parser(document, parser, TSParseOptions{});
+      TreePoolCapacity capacity = ts_tree_pool_capacity(document->tree_pool);
+      AssertThat(capacity.free_node_count, IsGreaterThan(8u));
+
+      TSDocument *other_document = ts_document_new();
+      ts_document_set_language(other_document, load_real_language("json"));
+      ts_document_set_input_string(other_document, "[]");
+      ts_document_parse_with_parser(other_document, parser, TSParseOptions{});
+      TreePoolCapacity other_capacity = ts_tree_pool_capacity(other_document->tree_pool);
+      AssertThat(other_capacity.free_leaf_count, !IsLessThan(capacity.free_leaf_count));
+      AssertThat(other_capacity.free_node_count, !IsLessThan(capacity.free_node_count));
+      AssertThat(other_capacity.tree_stack_size, !IsLessThan(capacity.tree_stack_size));
+
+      ts_document_free(other_document);
+      ts_parser_delete(parser);
+    });
+  });
+
+  describe("tracing", [&]() {
+    before_each([&]() {
+      ts_document_set_language(document, load_real_language("json"));
+    });
+
+    auto drain_trace = [&](uint32_t *dropped_count) {
+      vector<TSTraceEvent> events(64);
+      events.resize(ts_document_drain_trace(document, events.data(), events.size(), dropped_count));
+      return events;
+    };
+
+    it("records nothing unless the trace buffer has a capacity", [&]() {
+      set_text("[1, 2]");
+      uint32_t dropped_count = 1;
+      AssertThat(drain_trace(&dropped_count).size(), Equals(0u));
+      AssertThat(dropped_count, Equals(0u));
+    });
+
+    it("records each step of the parse", [&]() {
+      ts_document_set_trace_capacity(document, 64);
+      set_text("[1, 2]");
+
+      uint32_t dropped_count;
+      vector<TSTraceEvent> events = drain_trace(&dropped_count);
+      AssertThat(dropped_count, Equals(0u));
+      AssertThat(events.front().type, Equals(TSTraceEventStartParse));
+      AssertThat(events.back().type, Equals(TSTraceEventDone));
+      AssertThat(events.back().detail, Equals(6u));
+
+      vector<uint32_t> lexed_token_bytes;
+      unsigned shift_count = 0, reduce_count = 0;
+      for (const TSTraceEvent &event : events) {
+        if (event.type == TSTraceEventLex) lexed_token_bytes.push_back(event.byte);
+        if (event.type == TSTraceEventShift) shift_count++;
+        if (event.type == TSTraceEventReduce) reduce_count++;
+      }
+      AssertThat(lexed_token_bytes, Equals(vector<uint32_t>({0, 1, 2, 3, 5, 6})));
+      AssertThat(shift_count, Equals(5u));
+      AssertThat(reduce_count, IsGreaterThan(0u));
+      AssertThat(drain_trace(nullptr).size(), Equals(0u));
+    });
+
+    it("keeps only the most recent events when the buffer is full", [&]() {
+      ts_document_set_trace_capacity(document, 4);
+      set_text("[1, 2]");
+
+      uint32_t dropped_count;
+      vector<TSTraceEvent> events = drain_trace(&dropped_count);
+      AssertThat(events.size(), Equals(4u));
+      AssertThat(dropped_count, IsGreaterThan(0u));
+      AssertThat(events.back().type, Equals(TSTraceEventDone));
+    });
+  });
 });
 
 END_TEST
@@ -0,0 +1,231 @@
+#include "test_helper.h"
+#include "helpers/load_language.h"
+#include "helpers/record_alloc.h"
+
+START_TEST
+
+describe("PatternSet", [&]() {
+  TSDocument *document;
+  TSPatternSet *pattern_set;
+  string source_code;
+
+  before_each([&]() {
+    record_alloc::start();
+    document = ts_document_new();
+    ts_document_set_language(document, load_real_language("json"));
+    pattern_set = nullptr;
+  });
+
+  after_each([&]() {
+    if (pattern_set) ts_pattern_set_delete(pattern_set);
+    ts_document_free(document);
+    record_alloc::stop();
+    AssertThat(record_alloc::outstanding_allocation_indices(), IsEmpty());
+  });
+
+  auto parse = [&](const string &text) {
+    source_code = text;
+    ts_document_set_input_string(document, source_code.c_str());
+    ts_document_parse(document);
+  };
+
+  auto compile = [&](const string &patterns) {
+    uint32_t error_offset;
+    pattern_set = ts_pattern_set_new(
+      ts_document_language(document), patterns.c_str(), patterns.size(), &error_offset
+    );
+    AssertThat(pattern_set, !Equals<TSPatternSet *>(nullptr));
+  };
+
+  // Describe each match as its pattern index followed by its captures, and
+  // stop after the given number of matches, if any.
+  struct MatchStringsPayload {
+    vector<string> results;
+    const string *source_code;
+    const TSPatternSet *pattern_set;
+    size_t max_match_count;
+  };
+
+  auto record_match_string = [](void *payload, const TSPatternMatch *match) {
+    MatchStringsPayload *self = static_cast<MatchStringsPayload *>(payload);
+    string result = to_string(match->pattern_index);
+    for (uint32_t i = 0; i < match->capture_count; i++) {
+      TSNode node = match->captures[i].node;
+      result += string(" ") + ts_pattern_set_capture_name(self->pattern_set, match->captures[i].index);
+      result += "=" + self->source_code->substr(
+        ts_node_start_byte(node), ts_node_end_byte(node) - ts_node_start_byte(node)
+      );
+    }
+    self->results.push_back(result);
+    return self->max_match_count == 0 || self->results.size() < self->max_match_count;
+  };
+
+  auto match_strings = [&](uint32_t start_byte, uint32_t end_byte) {
+    MatchStringsPayload payload = {{}, &source_code, pattern_set};
+    ts_pattern_set_match_in_range(
+      pattern_set, ts_document_root_node(document), start_byte, end_byte,
+      record_match_string, &payload
+    );
+    return payload.results;
+  };
+
+  auto all_match_strings = [&]() {
+    return match_strings(0, UINT32_MAX);
+  };
+
+  it("matches a node and some of its children, capturing the marked nodes", [&]() {
+    parse("{\"a\": 1, \"b\": [2], \"c\": 3}");
+    compile("(pair (string) @key (number) @value)");
+
+    AssertThat(ts_pattern_set_pattern_count(pattern_set), Equals<uint32_t>(1));
+    AssertThat(ts_pattern_set_capture_count(pattern_set), Equals<uint32_t>(2));
+    AssertThat(all_match_strings(), Equals(vector<string>({
+      "0 key=\"a\" value=1",
+      "0 key=\"c\" value=3",
+    })));
+  });
+
+  it("matches every pattern in a single traversal, in the order of the nodes and then the patterns", [&]() {
+    parse("[1, [2, true], {\"x\": 3}]");
+    compile(
+      "; Comments and whitespace are ignored\n"
+      "(number) @number\n"
+      "(array (number) @first)\n"
+      "(_ (true) @true)\n"
+    );
+
+    AssertThat(ts_pattern_set_pattern_count(pattern_set), Equals<uint32_t>(3));
+    AssertThat(all_match_strings(), Equals(vector<string>({
+      "1 first=1",
+      "0 number=1",
+      "1 first=2",
+      "2 true=true",
+      "0 number=2",
+      "0 number=3",
+    })));
+  });
+
+  it("matches children in order, skipping the ones in between", [&]() {
+    parse("[1, true, \"x\"]");
+    compile(
+      "(array (number) @number (string) @string)\n"
+      "(array (string) (number))\n"
+      "(array \"[\" _ @first)\n"
+    );
+
+    AssertThat(all_match_strings(), Equals(vector<string>({
+      "0 number=1 string=\"x\"",
+      "2 first=1",
+    })));
+  });
+
+  it("discards the captures of children that only partially matched", [&]() {
+    parse("[[1], [2, \"y\"]]");
+    compile("(array (array (number) @number (string) @string))");
+
+    AssertThat(all_match_strings(), Equals(vector<string>({
+      "0 number=2 string=\"y\"",
+    })));
+  });
+
+  it("only visits the nodes that intersect the given byte range", [&]() {
+    parse("[1, 2, [3, 4], 5]");
+    compile("(number) @number");
+
+    size_t start = source_code.find("2");
+    size_t end = source_code.find("4");
+    AssertThat(match_strings(start, end), Equals(vector<string>({
+      "0 number=2",
+      "0 number=3",
+    })));
+  });
+
+  it("stops matching when the callback returns false", [&]() {
+    parse("[1, 2, 3]");
+    compile("(number)");
+
+    uint32_t match_count = 0;
+    bool finished = ts_pattern_set_match(
+      pattern_set, ts_document_root_node(document),
+      [](void *payload, const TSPatternMatch *) {
+        return ++*static_cast<uint32_t *>(payload) < 2;
+      },
+      &match_count
+    );
+    AssertThat(finished, IsFalse());
+    AssertThat(match_count, Equals<uint32_t>(2));
+  });
+
+  it("finds the same matches in the same order when matching on several threads", [&]() {
+    string text = "[";
+    for (unsigned i = 0; i < 500; i++) {
+      if (i > 0) text += ", ";
+      text += "{\"a\": [" + to_string(i) + ", true], \"b\": {\"c\": " + to_string(i) + "}}";
+    }
+    parse(text + "]");
+    compile(
+      "(pair (string) @key (number) @value)\n"
+      "(array (number) @first (true))\n"
+      "(object) @object\n"
+    );
+
+    vector<string> expected_matches = all_match_strings();
+    AssertThat(expected_matches.size(), Equals<size_t>(2000));
+
+    for (uint32_t thread_count : vector<uint32_t>({2, 4, 16})) {
+      MatchStringsPayload payload = {{}, &source_code, pattern_set};
+      bool finished = ts_pattern_set_match_in_parallel(
+        pattern_set, ts_document_root_node(document), thread_count,
+        record_match_string, &payload
+      );
+      AssertThat(finished, IsTrue());
+      AssertThat(payload.results, Equals(expected_matches));
+    }
+  });
+
+  it("stops matching on several threads when the callback returns false", [&]() {
+    string text = "[";
+    for (unsigned i = 0; i < 500; i++) {
+      if (i > 0) text += ", ";
+      text += "{\"a\": " + to_string(i) + "}";
+    }
+    parse(text + "]");
+    compile("(pair (string) @key (number) @value)");
+
+    vector<string> expected_matches = all_match_strings();
+    AssertThat(expected_matches.size(), Equals<size_t>(500));
+    expected_matches.resize(300);
+
+    for (uint32_t thread_count : vector<uint32_t>({2, 4, 16})) {
+      MatchStringsPayload payload = {{}, &source_code, pattern_set, 300};
+      bool finished = ts_pattern_set_match_in_parallel(
+        pattern_set, ts_document_root_node(document), thread_count,
+        record_match_string, &payload
+      );
+      AssertThat(finished, IsFalse());
+      AssertThat(payload.results, Equals(expected_matches));
+    }
+  });
+
+  it("reports the position of unknown node types and malformed patterns", [&]() {
+    const TSLanguage *language = ts_document_language(document);
+    vector<pair<string, uint32_t>> invalid_patterns({
+      {"(array (numbr))", 8},
+      {"(array \"]]\")", 7},
+      {"(array (number)", 15},
+      {"(pair) @", 8},
+      {"(pair) )", 7},
+    });
+
+    for (auto &entry : invalid_patterns) {
+      uint32_t error_offset = 0;
+      AssertThat(
+        ts_pattern_set_new(language, entry.first.c_str(), entry.first.size(), &error_offset),
+        Equals<TSPatternSet *>(nullptr)
+      );
+      AssertThat(error_offset, Equals(entry.second));
+    }
+  });
+});
+
+END_TEST
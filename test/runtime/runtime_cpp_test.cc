@@ -0,0 +1,128 @@
+#include "test_helper.h"
+#include "runtime/alloc.h"
+#include "helpers/load_language.h"
+#include "helpers/record_alloc.h"
+#include "tree_sitter/runtime_cpp.h"
+
+START_TEST
+
+describe("the C++ wrapper", [&]() {
+  string text = "[1, [2, 3], {\"a\": true, \"b\": 4}]";
+
+  before_each([&]() {
+    record_alloc::start();
+  });
+
+  after_each([&]() {
+    record_alloc::stop();
+    AssertThat(record_alloc::outstanding_allocation_indices(), IsEmpty());
+  });
+
+  it("frees the objects that it owns, including ones that were moved", [&]() {
+    tree_sitter::Document document;
+    document.set_language(load_real_language("json"));
+    document.set_input_string(text);
+    document.parse();
+
+    tree_sitter::Document other_document = std::move(document);
+    AssertThat((bool)document, IsFalse());
+    AssertThat((bool)other_document, IsTrue());
+
+    tree_sitter::TreeCursor cursor(other_document.root_node());
+    AssertThat(cursor.goto_first_child(), IsTrue());
+    AssertThat(ts_node_start_byte(cursor.current_node()), Equals(0u));
+
+    tree_sitter::Parser parser;
+    other_document = tree_sitter::Document();
+    AssertThat((bool)other_document, IsTrue());
+  });
+
+  it("calls the handler for each node's type, in the order in which the nodes start", [&]() {
+    tree_sitter::Document document;
+    document.set_language(load_real_language("json"));
+    document.set_input_string(text);
+    document.parse();
+
+    vector<string> events;
+    auto visitor = tree_sitter::make_visitor(
+      document.language(),
+      tree_sitter::on("number", [&](TSNode node) {
+        events.push_back("number " + to_string(ts_node_start_byte(node)));
+      }),
+      tree_sitter::on("object", [&](TSNode node) {
+        events.push_back("object " + to_string(ts_node_named_child_count(node)));
+      }),
+      tree_sitter::on_anonymous("[", [&](TSNode node) {
+        events.push_back("[ " + to_string(ts_node_start_byte(node)));
+      }),
+      tree_sitter::on("number", [&](TSNode node) {
+        events.push_back("second number handler");
+      }),
+      tree_sitter::on("not_a_node_type", [&](TSNode node) {
+        events.push_back("not_a_node_type");
+      })
+    );
+    visitor.walk(document.root_node());
+
+    AssertThat(events, Equals(vector<string>({
+      "[ 0",
+      "number 1",
+      "[ 4",
+      "number 5",
+      "number 8",
+      "object 2",
+      "number 29",
+    })));
+  });
+
+  it("parses in slices, replacing the tree only when the parse is done", [&]() {
+    string long_text = "[";
+    for (unsigned i = 0; i < 100; i++) long_text += text + ", ";
+    long_text += "null]";
+
+    tree_sitter::Document document;
+    document.set_language(load_real_language("json"));
+    document.set_input_string(long_text);
+
+    TSParseOptions options = {};
+    options.max_bytes_per_call = 200;
+    tree_sitter::SlicedParse parse(document, options);
+    unsigned slice_count = 1;
+    while (!parse.step()) {
+      AssertThat(ts_document_has_unfinished_parse(document.get()), IsTrue());
+      slice_count++;
+    }
+    AssertThat(slice_count, IsGreaterThan(10u));
+    AssertThat(parse.step(), IsTrue());
+
+    tree_sitter::Document other_document;
+    other_document.set_language(load_real_language("json"));
+    other_document.set_input_string(long_text);
+    other_document.parse();
+    char *node_string = ts_node_string(document.root_node(), document.get());
+    char *other_node_string = ts_node_string(other_document.root_node(), other_document.get());
+    AssertThat(string(node_string), Equals(string(other_node_string)));
+    ts_free(node_string);
+    ts_free(other_node_string);
+  });
+
+  it("stops parsing in slices when it is cancelled", [&]() {
+    tree_sitter::Document document;
+    document.set_language(load_real_language("json"));
+    document.set_input_string(text);
+
+    volatile bool is_cancelled = false;
+    TSParseOptions options = {};
+    options.max_bytes_per_call = 4;
+    options.cancellation_flag = &is_cancelled;
+    tree_sitter::SlicedParse parse(document, options);
+    AssertThat(parse.step(), IsFalse());
+
+    is_cancelled = true;
+    AssertThat(parse.step(), IsFalse());
+    AssertThat(parse.is_cancelled(), IsTrue());
+    AssertThat(ts_document_has_unfinished_parse(document.get()), IsTrue());
+  });
+});
+
+END_TEST
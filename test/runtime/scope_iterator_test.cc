@@ -0,0 +1,99 @@
+#include "test_helper.h"
+#include "helpers/load_language.h"
+#include "helpers/record_alloc.h"
+#include "helpers/scope_sequence.h"
+#include "helpers/stream_methods.h"
+
+START_TEST
+
+describe("ScopeIterator", [&]() {
+  TSDocument *document;
+  TSScopeIterator *iterator;
+  string text = "{\"a\": [1, true],\n  \"bc\": {\"d\": null}}";
+
+  before_each([&]() {
+    record_alloc::start();
+    document = ts_document_new();
+    ts_document_set_language(document, load_real_language("json"));
+    ts_document_set_input_string(document, text.c_str());
+    ts_document_parse(document);
+    iterator = nullptr;
+  });
+
+  after_each([&]() {
+    if (iterator) ts_scope_iterator_delete(iterator);
+    ts_document_free(document);
+    record_alloc::stop();
+    AssertThat(record_alloc::outstanding_allocation_indices(), IsEmpty());
+  });
+
+  // Expand the spans into a scope stack for each byte, in the same form as the
+  // scope sequence helper, which walks the whole tree.
+  auto read_spans = [&](vector<TSScopeSpan> *spans) {
+    ScopeSequence sequence;
+    TSScopeSpan span;
+    while (ts_scope_iterator_next(iterator, &span)) {
+      if (spans) spans->push_back(span);
+      for (uint32_t i = span.start_byte; i < span.end_byte; i++) {
+        ScopeStack scopes;
+        for (uint32_t j = 0; j < span.scope_count; j++) {
+          scopes.push_back(ts_language_symbol_name(ts_document_language(document), span.scopes[j]));
+        }
+        scopes.push_back("'" + string(1, text[i]) + "'");
+        sequence.push_back(scopes);
+      }
+    }
+    return sequence;
+  };
+
+  it("yields the same scopes for each byte as a walk over the whole tree", [&]() {
+    iterator = ts_scope_iterator_new(ts_document_root_node(document), 0, UINT32_MAX);
+    vector<TSScopeSpan> spans;
+    ScopeSequence sequence = read_spans(&spans);
+
+    AssertThat(sequence, Equals(build_scope_sequence(document, text)));
+    for (size_t i = 1; i < spans.size(); i++) {
+      AssertThat(spans[i].start_byte, Equals(spans[i - 1].end_byte));
+      AssertThat(spans[i].start_byte, IsLessThan(spans[i].end_byte));
+    }
+  });
+
+  it("yields only the spans within the given window, clipped to its bounds", [&]() {
+    uint32_t start_byte = text.find("true") + 2;
+    uint32_t end_byte = text.find("null") + 1;
+    iterator = ts_scope_iterator_new(ts_document_root_node(document), start_byte, end_byte);
+    vector<TSScopeSpan> spans;
+    ScopeSequence sequence = read_spans(&spans);
+
+    ScopeSequence full_sequence = build_scope_sequence(document, text);
+    AssertThat(sequence, Equals(ScopeSequence(
+      full_sequence.begin() + start_byte,
+      full_sequence.begin() + end_byte
+    )));
+    AssertThat(spans.front().start_byte, Equals(start_byte));
+    AssertThat(spans.back().end_byte, Equals(end_byte));
+  });
+
+  it("can be reset to a new window", [&]() {
+    iterator = ts_scope_iterator_new(ts_document_root_node(document), 0, 5);
+    read_spans(nullptr);
+
+    uint32_t start_byte = text.find("\"bc\"");
+    ts_scope_iterator_reset(iterator, start_byte, UINT32_MAX);
+    ScopeSequence sequence = read_spans(nullptr);
+
+    ScopeSequence full_sequence = build_scope_sequence(document, text);
+    AssertThat(sequence, Equals(ScopeSequence(
+      full_sequence.begin() + start_byte,
+      full_sequence.end()
+    )));
+  });
+
+  it("yields nothing for a window outside of the tree", [&]() {
+    iterator = ts_scope_iterator_new(ts_document_root_node(document), text.size(), text.size() + 10);
+    TSScopeSpan span;
+    AssertThat(ts_scope_iterator_next(iterator, &span), IsFalse());
+  });
+});
+
+END_TEST
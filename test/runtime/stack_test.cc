@@ -64,6 +64,15 @@ vector<StackEntry> get_stack_entries(Stack *stack, StackVersion version) {
   return result;
 }
 
+vector<StackEntry> get_summary_entries(Stack *stack, StackVersion version) {
+  vector<StackEntry> result;
+  StackSummary *summary = ts_stack_get_summary(stack, version);
+  for (uint32_t i = 0; i < summary->size; i++) {
+    result.push_back({summary->contents[i].state, summary->contents[i].depth});
+  }
+  return result;
+}
+
 START_TEST
 
 describe("Stack", [&]() {
@@ -283,6 +292,27 @@ describe("Stack", [&]() {
       free_slice_array(&pool,&pop);
     });
 
+    it("returns no slices when the stack has fewer entries than the given count", [&]() {
+      StackSliceArray pop = ts_stack_pop_count(stack, 0, 5);
+      AssertThat(pop.size, Equals<size_t>(0));
+      AssertThat(ts_stack_version_count(stack), Equals<size_t>(1));
+    });
+
+    it("writes the trees into the given storage when they fit", [&]() {
+      Tree *buffer[2];
+      TreeArray storage = {0, 2, buffer};
+      StackSliceArray pop = ts_stack_pop_count_into(stack, 0, 2, storage);
+      AssertThat(pop.size, Equals<size_t>(1));
+
+      StackSlice slice = pop.contents[0];
+      AssertThat(slice.trees.contents, Equals(buffer));
+      AssertThat(slice.trees, Equals(vector<Tree *>({ trees[1], trees[2] })));
+      AssertThat(ts_stack_state(stack, 1), Equals(stateA));
+
+      ts_tree_release(&pool, trees[1]);
+      ts_tree_release(&pool, trees[2]);
+    });
+
     describe("when the version has been merged", [&]() {
       before_each([&]() {
         // . <──0── A <──1── B <──2── C <──3── D <──10── I*
@@ -524,6 +554,170 @@ describe("Stack", [&]() {
     });
   });
 
+  describe("record_summary(version, max_depth)", [&]() {
+    before_each([&]() {
+      // . <──0── A <──1── B <──2── C <──3── D*
+      push(0, trees[0], stateA);
+      push(0, trees[1], stateB);
+      push(0, trees[2], stateC);
+      push(0, trees[3], stateD);
+    });
+
+    it("records the states near the top of the stack", [&]() {
+      ts_stack_record_summary(stack, 0, 2);
+      AssertThat(get_summary_entries(stack, 0), Equals(vector<StackEntry>({
+        {stateD, 0},
+        {stateC, 1},
+        {stateB, 2},
+      })));
+    });
+
+    it("extends the previous summary when the stack shares its nodes", [&]() {
+      ts_stack_record_summary(stack, 0, 10);
+
+      // . <──0── A <──1── B <──2── C <──3── D*
+      //                            ↑
+      //                            └───4─── E <──5── F*
+      StackSliceArray pop = ts_stack_pop_count(stack, 0, 1);
+      free_slice_array(&pool, &pop);
+      push(1, trees[4], stateE);
+      push(1, trees[5], stateF);
+
+      ts_stack_record_summary(stack, 1, 10);
+      AssertThat(get_summary_entries(stack, 1), Equals(vector<StackEntry>({
+        {stateF, 0},
+        {stateE, 1},
+        {stateC, 2},
+        {stateB, 3},
+        {stateA, 4},
+        {1, 5},
+      })));
+    });
+
+    it("does not extend the previous summary beyond its maximum depth", [&]() {
+      ts_stack_record_summary(stack, 0, 2);
+
+      // . <──0── A <──1── B <──2── C <──3── D*
+      //                   ↑
+      //                   └─*
+      StackSliceArray pop = ts_stack_pop_count(stack, 0, 2);
+      free_slice_array(&pool, &pop);
+
+      ts_stack_record_summary(stack, 1, 2);
+      AssertThat(get_summary_entries(stack, 1), Equals(vector<StackEntry>({
+        {stateB, 0},
+        {stateA, 1},
+        {1, 2},
+      })));
+    });
+
+    it("does not extend the previous summary after its nodes gain new links", [&]() {
+      ts_stack_record_summary(stack, 0, 10);
+
+      // . <──0── A <──1── B <──2── C <──3── D*
+      //          ↑                 |
+      //          └───4─── E <──2───┘
+      StackSliceArray pop = ts_stack_pop_count(stack, 0, 3);
+      free_slice_array(&pool, &pop);
+      push(1, trees[4], stateE);
+      push(1, trees[2], stateC);
+      push(1, trees[3], stateD);
+      AssertThat(ts_stack_merge(stack, 0, 1), IsTrue());
+
+      ts_stack_record_summary(stack, 0, 10);
+      AssertThat(get_summary_entries(stack, 0), Equals(vector<StackEntry>({
+        {stateD, 0},
+        {stateC, 1},
+        {stateB, 2},
+        {stateE, 2},
+        {stateA, 3},
+        {1, 4},
+      })));
+    });
+
+    it("reuses the memory of the summaries that it released", [&]() {
+      ts_stack_record_summary(stack, 0, 10);
+      ts_stack_record_summary(stack, 0, 10);
+      size_t allocation_count = record_alloc::allocation_count();
+
+      for (unsigned i = 0; i < 5; i++) {
+        ts_stack_record_summary(stack, 0, 10);
+      }
+      AssertThat(record_alloc::allocation_count(), Equals(allocation_count));
+    });
+  });
+
+  describe("clear()", [&]() {
+    it("reuses the memory of the nodes that it released", [&]() {
+      auto push_and_merge = [&]() {
+        for (size_t i = 0; i < 200; i++) {
+          push(0, trees[i % tree_count], stateA);
+          if (i % 10 == 0) {
+            // . <──0── A <──1── B <──3── D*
+            //          ↑                 |
+            //          └───2─── C <──4───┘
+            ts_stack_copy_version(stack, 0);
+            push(0, trees[1], stateB);
+            push(1, trees[2], stateC);
+            push(0, trees[3], stateD);
+            push(1, trees[4], stateD);
+            AssertThat(ts_stack_merge(stack, 0, 1), IsTrue());
+          }
+        }
+      };
+
+      push_and_merge();
+      ts_stack_clear(stack);
+      size_t allocation_count = record_alloc::allocation_count();
+
+      push_and_merge();
+      ts_stack_clear(stack);
+      AssertThat(record_alloc::allocation_count(), Equals(allocation_count));
+    });
+  });
+
+  describe("trim()", [&]() {
+    it("frees the nodes and links that a cleared stack has kept for later use", [&]() {
+      size_t initial_bytes = ts_stack_allocated_bytes(stack);
+      for (size_t i = 0; i < 500; i++) {
+        push(0, trees[i % tree_count], stateA);
+        if (i % 10 == 0) {
+          ts_stack_copy_version(stack, 0);
+          push(0, trees[1], stateB);
+          push(1, trees[2], stateC);
+          push(0, trees[3], stateD);
+          push(1, trees[4], stateD);
+          AssertThat(ts_stack_merge(stack, 0, 1), IsTrue());
+        }
+      }
+      ts_stack_clear(stack);
+      AssertThat(ts_stack_allocated_bytes(stack), IsGreaterThan(initial_bytes));
+
+      ts_stack_trim(stack);
+      AssertThat(ts_stack_allocated_bytes(stack), Equals(initial_bytes));
+
+      // . <──0── A <──1── B*
+      push(0, trees[0], stateA);
+      push(0, trees[1], stateB);
+      AssertThat(get_stack_entries(stack, 0), Equals(vector<StackEntry>({
+        {stateB, 0},
+        {stateA, 1},
+        {1, 2},
+      })));
+    });
+
+    it("keeps the nodes that are in use", [&]() {
+      push(0, trees[0], stateA);
+      push(0, trees[1], stateB);
+      ts_stack_trim(stack);
+      AssertThat(get_stack_entries(stack, 0), Equals(vector<StackEntry>({
+        {stateB, 0},
+        {stateA, 1},
+        {1, 2},
+      })));
+    });
+  });
+
   describe("setting external token state", [&]() {
     before_each([&]() {
       trees[1]->has_external_tokens = true;
@@ -0,0 +1,158 @@
+#include "test_helper.h"
+#include "runtime/language.h"
+#include "tree_sitter/parser.h"
+#include "helpers/load_language.h"
+#include "helpers/record_alloc.h"
+
+START_TEST
+
+describe("SymbolIterator", [&]() {
+  TSDocument *document;
+  TSSymbolIterator *iterator;
+  const TSLanguage *language;
+  string text = "[1, {\"a\": [2, {\"b\": null}]}, \"c\", {\"d\": true}]";
+
+  before_each([&]() {
+    record_alloc::start();
+    language = load_real_language("json");
+    document = ts_document_new();
+    ts_document_set_language(document, language);
+    ts_document_set_input_string(document, text.c_str());
+    ts_document_parse(document);
+    iterator = nullptr;
+  });
+
+  after_each([&]() {
+    if (iterator) ts_symbol_iterator_delete(iterator);
+    ts_document_free(document);
+    record_alloc::stop();
+    AssertThat(record_alloc::outstanding_allocation_indices(), IsEmpty());
+  });
+
+  auto symbol = [&](const string &name) {
+    return ts_language_symbol_for_name(language, name.c_str(), name.size(), true);
+  };
+
+  auto read_nodes = [&](bool should_skip_children) {
+    vector<string> result;
+    TSNode node;
+    while (ts_symbol_iterator_next(iterator, &node)) {
+      result.push_back(
+        string(ts_node_type(node, document)) + " " +
+        to_string(ts_node_start_byte(node)) + " " + to_string(ts_node_end_byte(node))
+      );
+      if (should_skip_children) ts_symbol_iterator_skip_children(iterator);
+    }
+    return result;
+  };
+
+  it("visits the nodes with the given symbols, in document order", [&]() {
+    TSSymbol symbols[] = {symbol("pair"), symbol("null")};
+    iterator = ts_symbol_iterator_new(ts_document_root_node(document), symbols, 2);
+    AssertThat(read_nodes(false), Equals(vector<string>({
+      "pair 5 26",
+      "pair 15 24",
+      "null 20 24",
+      "pair 35 44",
+    })));
+  });
+
+  it("can skip the descendants of the nodes that it visits", [&]() {
+    TSSymbol symbols[] = {symbol("pair")};
+    iterator = ts_symbol_iterator_new(ts_document_root_node(document), symbols, 1);
+    AssertThat(read_nodes(true), Equals(vector<string>({
+      "pair 5 26",
+      "pair 35 44",
+    })));
+
+    ts_symbol_iterator_reset(iterator, ts_node_named_child(ts_document_root_node(document), 0));
+    AssertThat(read_nodes(true), Equals(vector<string>({
+      "pair 5 26",
+      "pair 35 44",
+    })));
+  });
+
+  it("doesn't visit the subtrees that the language says can't contain the given symbols", [&]() {
+    // In JSON, any object or array can contain every symbol, so a copy of the
+    // language is given sets that say that objects contain nothing.
+    uint32_t nonterminal_count = language->symbol_count - language->token_count;
+    uint32_t word_count = (language->symbol_count + language->alias_count + 31) / 32;
+    vector<uint32_t> sets;
+    vector<uint16_t> set_ids;
+    for (uint32_t i = 0; i < nonterminal_count; i++) {
+      TSSymbol nonterminal = language->token_count + i;
+      const uint32_t *descendant_symbols = ts_language_descendant_symbols(language, nonterminal);
+      for (uint32_t j = 0; j < word_count; j++) {
+        sets.push_back(nonterminal == symbol("object") ? 0 : descendant_symbols[j]);
+      }
+      set_ids.push_back(i);
+    }
+
+    TSLanguage language_without_objects = *language;
+    language_without_objects.descendant_symbol_sets = sets.data();
+    language_without_objects.descendant_symbol_set_ids = set_ids.data();
+
+    TSDocument *other_document = ts_document_new();
+    ts_document_set_language(other_document, &language_without_objects);
+    ts_document_set_input_string(other_document, text.c_str());
+    ts_document_parse(other_document);
+
+    TSSymbol symbols[] = {symbol("number"), symbol("null")};
+    iterator = ts_symbol_iterator_new(ts_document_root_node(document), symbols, 2);
+    AssertThat(read_nodes(false), Equals(vector<string>({
+      "number 1 2",
+      "number 11 12",
+      "null 20 24",
+    })));
+    ts_symbol_iterator_delete(iterator);
+
+    iterator = ts_symbol_iterator_new(ts_document_root_node(other_document), symbols, 2);
+    AssertThat(read_nodes(false), Equals(vector<string>({
+      "number 1 2",
+    })));
+    ts_symbol_iterator_delete(iterator);
+    iterator = nullptr;
+
+    ts_document_free(other_document);
+  });
+
+  it("visits the same nodes as a walk that doesn't skip any subtrees, including ones with errors", [&]() {
+    TSLanguage language_without_sets = *language;
+    language_without_sets.descendant_symbol_sets = nullptr;
+    language_without_sets.descendant_symbol_set_ids = nullptr;
+
+    TSDocument *other_document = ts_document_new();
+    ts_document_set_language(other_document, &language_without_sets);
+
+    for (const string &other_text : vector<string>({
+      text,
+      "[1, {\"a\": [2, {\"b\" null}]}, \"c\" {\"d\": true}]",
+      "{\"a\": [1, 2 3], \"b\": {\"c\": %%}}",
+    })) {
+      ts_document_set_input_string(document, other_text.c_str());
+      ts_document_parse(document);
+      ts_document_set_input_string(other_document, other_text.c_str());
+      ts_document_parse(other_document);
+
+      for (TSSymbol searched_symbol : vector<TSSymbol>({
+        symbol("pair"),
+        symbol("number"),
+        symbol("string"),
+        symbol("true"),
+        ts_builtin_sym_error,
+      })) {
+        iterator = ts_symbol_iterator_new(ts_document_root_node(document), &searched_symbol, 1);
+        vector<string> nodes = read_nodes(false);
+        ts_symbol_iterator_delete(iterator);
+        iterator = ts_symbol_iterator_new(ts_document_root_node(other_document), &searched_symbol, 1);
+        AssertThat(read_nodes(false), Equals(nodes));
+        ts_symbol_iterator_delete(iterator);
+        iterator = nullptr;
+      }
+    }
+
+    ts_document_free(other_document);
+  });
+});
+
+END_TEST
@@ -0,0 +1,100 @@
+#include "test_helper.h"
+#include "helpers/load_language.h"
+#include "helpers/record_alloc.h"
+#include "helpers/stream_methods.h"
+
+START_TEST
+
+describe("TokenIterator", [&]() {
+  TSDocument *document;
+  TSTokenIterator *iterator;
+  string text = "{\"a\": [1, true],\n  \"bc\": {\"d\": null}}";
+
+  before_each([&]() {
+    record_alloc::start();
+    document = ts_document_new();
+    ts_document_set_language(document, load_real_language("json"));
+    ts_document_set_input_string(document, text.c_str());
+    ts_document_parse(document);
+    iterator = nullptr;
+  });
+
+  after_each([&]() {
+    if (iterator) ts_token_iterator_delete(iterator);
+    ts_document_free(document);
+    record_alloc::stop();
+    AssertThat(record_alloc::outstanding_allocation_indices(), IsEmpty());
+  });
+
+  auto read_tokens = [&]() {
+    vector<string> result;
+    TSToken token;
+    while (ts_token_iterator_next(iterator, &token)) {
+      result.push_back(
+        string(ts_language_symbol_name(ts_document_language(document), token.symbol)) + " " +
+        to_string(token.start_byte) + " " + to_string(token.end_byte) +
+        (token.is_extra ? " extra" : "")
+      );
+    }
+    return result;
+  };
+
+  it("visits the same leaves as a walk over the whole tree, in document order", [&]() {
+    vector<string> leaves;
+    TSTreeCursor *cursor = ts_tree_cursor_new(ts_document_root_node(document));
+    for (;;) {
+      TSNode node = ts_tree_cursor_current_node(cursor);
+      if (ts_node_child_count(node) == 0) {
+        leaves.push_back(
+          string(ts_node_type(node, document)) + " " +
+          to_string(ts_node_start_byte(node)) + " " + to_string(ts_node_end_byte(node))
+        );
+      }
+      if (ts_tree_cursor_goto_first_child(cursor)) continue;
+      while (!ts_tree_cursor_goto_next_sibling(cursor) && ts_tree_cursor_goto_parent(cursor)) {}
+      if (ts_tree_cursor_current_node(cursor).data == ts_document_root_node(document).data) break;
+    }
+    ts_tree_cursor_delete(cursor);
+
+    iterator = ts_token_iterator_new(ts_document_root_node(document), 0, UINT32_MAX);
+    AssertThat(read_tokens(), Equals(leaves));
+  });
+
+  it("only visits the tokens that overlap its window", [&]() {
+    uint32_t start_byte = text.find("1");
+    uint32_t end_byte = text.find("bc");
+    iterator = ts_token_iterator_new(ts_document_root_node(document), start_byte, end_byte);
+    AssertThat(read_tokens(), Equals(vector<string>({
+      "number " + to_string(start_byte) + " " + to_string(start_byte + 1),
+      ", " + to_string(text.find(", t")) + " " + to_string(text.find(", t") + 1),
+      "true " + to_string(text.find("true")) + " " + to_string(text.find("true") + 4),
+      "] " + to_string(text.find("]")) + " " + to_string(text.find("]") + 1),
+      ", " + to_string(text.find(",\n")) + " " + to_string(text.find(",\n") + 1),
+      "string " + to_string(end_byte - 1) + " " + to_string(end_byte + 3),
+    })));
+  });
+
+  it("can be reset to visit a different window", [&]() {
+    iterator = ts_token_iterator_new(ts_document_root_node(document), 0, UINT32_MAX);
+    vector<string> tokens = read_tokens();
+    ts_token_iterator_reset(iterator, text.find("null"), text.size());
+    AssertThat(read_tokens(), Equals(vector<string>(tokens.end() - 3, tokens.end())));
+  });
+
+  it("marks the tokens that are extras", [&]() {
+    ts_document_set_language(document, load_real_language("javascript"));
+    ts_document_set_input_string(document, "a; // b\nc;");
+    ts_document_parse(document);
+
+    iterator = ts_token_iterator_new(ts_document_root_node(document), 0, UINT32_MAX);
+    AssertThat(read_tokens(), Equals(vector<string>({
+      "identifier 0 1",
+      "; 1 2",
+      "comment 3 7 extra",
+      "identifier 8 9",
+      "; 9 10",
+    })));
+  });
+});
+
+END_TEST
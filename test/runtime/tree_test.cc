@@ -3,21 +3,26 @@
 #include "helpers/point_helpers.h"
 #include "runtime/tree.h"
 #include "runtime/length.h"
+#include <thread>
 
 void assert_consistent(const Tree *tree) {
-  if (tree->child_count == 0)
+  if (tree->children.size == 0)
     return;
   AssertThat(tree->children.contents[0]->padding, Equals<Length>(tree->padding));
 
   Length total_children_size = length_zero();
+  uint16_t structure_hash = ts_tree_symbol_hash(tree->symbol);
   for (size_t i = 0; i < tree->children.size; i++) {
     Tree *child = tree->children.contents[i];
-    AssertThat(child->context.offset, Equals(total_children_size));
     assert_consistent(child);
     total_children_size = length_add(total_children_size, ts_tree_total_size(child));
+    if (tree->symbol != ts_builtin_sym_error) {
+      structure_hash = ts_tree_structure_hash_add(structure_hash, child);
+    }
   }
 
   AssertThat(total_children_size, Equals<Length>(ts_tree_total_size(tree)));
+  AssertThat(tree->structure_hash, Equals(structure_hash));
 };
 
 START_TEST
@@ -105,6 +110,19 @@ describe("Tree", []() {
       AssertThat(parent1->padding.bytes, Equals<size_t>(tree1->padding.bytes));
     });
 
+    it("defers counting its visible children until its counts are resolved", [&]() {
+      tree1->visible = true;
+      tree1->named = true;
+      tree2->visible = true;
+      AssertThat(parent1->has_pending_child_counts, IsTrue());
+
+      ts_tree_resolve_child_counts(parent1, &pool.tree_stack, &language);
+      AssertThat(parent1->has_pending_child_counts, IsFalse());
+      AssertThat(parent1->visible_child_count, Equals(2u));
+      AssertThat(parent1->named_child_count, Equals(1u));
+      AssertThat(pool.tree_stack.size, Equals(0u));
+    });
+
     describe("when the first node is fragile on the left side", [&]() {
       Tree *parent;
 
@@ -206,7 +224,7 @@ describe("Tree", []() {
         edit.start_point = {0, 1};
         edit.extent_removed = {0, 0};
         edit.extent_added = {0, 1};
-        ts_tree_edit(tree, &edit);
+        tree = ts_tree_edit(&pool, tree, &edit);
         assert_consistent(tree);
 
         AssertThat(tree->has_changes, IsTrue());
@@ -232,7 +250,7 @@ describe("Tree", []() {
         edit.start_point = {0, 1};
         edit.extent_removed = {0, 3};
         edit.extent_added = {0, 4};
-        ts_tree_edit(tree, &edit);
+        tree = ts_tree_edit(&pool, tree, &edit);
         assert_consistent(tree);
 
         AssertThat(tree->has_changes, IsTrue());
@@ -254,7 +272,7 @@ describe("Tree", []() {
         edit.start_point = {0, 2};
         edit.extent_removed = {0, 0};
         edit.extent_added = {0, 2};
-        ts_tree_edit(tree, &edit);
+        tree = ts_tree_edit(&pool, tree, &edit);
         assert_consistent(tree);
 
         assert_consistent(tree);
@@ -280,7 +298,7 @@ describe("Tree", []() {
         edit.start_point = {0, 2};
         edit.extent_removed = {0, 2};
         edit.extent_added = {0, 5};
-        ts_tree_edit(tree, &edit);
+        tree = ts_tree_edit(&pool, tree, &edit);
         assert_consistent(tree);
 
         AssertThat(tree->has_changes, IsTrue());
@@ -304,7 +322,7 @@ describe("Tree", []() {
         edit.start_point = {0, 1};
         edit.extent_removed = {0, 10};
         edit.extent_added = {0, 3};
-        ts_tree_edit(tree, &edit);
+        tree = ts_tree_edit(&pool, tree, &edit);
         assert_consistent(tree);
 
         assert_consistent(tree);
@@ -338,12 +356,169 @@ describe("Tree", []() {
         edit.start_point = {0, 6};
         edit.extent_removed = {0, 1};
         edit.extent_added = {0, 1};
-        ts_tree_edit(tree, &edit);
+        tree = ts_tree_edit(&pool, tree, &edit);
         assert_consistent(tree);
 
         AssertThat(tree->children.contents[0]->has_changes, IsTrue());
       });
     });
+
+    describe("batches of edits", [&]() {
+      it("has the same effect as applying the edits one at a time", [&]() {
+        auto make_tree = [&]() {
+          return ts_tree_make_node(&pool, symbol1, tree_array({
+            ts_tree_make_node(&pool, symbol2, tree_array({
+              ts_tree_make_leaf(&pool, symbol3, {2, {0, 2}}, {3, {0, 3}}, &language),
+              ts_tree_make_leaf(&pool, symbol4, {1, {1, 0}}, {3, {0, 3}}, &language),
+            }), 0, &language),
+            ts_tree_make_leaf(&pool, symbol5, {2, {0, 2}}, {3, {0, 3}}, &language),
+            ts_tree_make_node(&pool, symbol6, tree_array({
+              ts_tree_make_leaf(&pool, symbol7, {2, {0, 2}}, {3, {0, 3}}, &language),
+              ts_tree_make_leaf(&pool, symbol8, {2, {0, 2}}, {3, {0, 3}}, &language),
+            }), 0, &language),
+          }), 0, &language);
+        };
+
+        vector<TSInputEdit> edits({
+          // Insert two characters in the first leaf's padding.
+          {1, 0, 2, {0, 1}, {0, 0}, {0, 2}},
+          // Replace text spanning the second leaf, the third leaf and the
+          // fourth leaf's padding.
+          {10, 7, 1, {1, 2}, {0, 7}, {0, 1}},
+          // Insert text right at the end of the previous edit.
+          {11, 0, 2, {1, 3}, {0, 0}, {0, 2}},
+          // Delete the end of the last leaf.
+          {20, 2, 0, {1, 12}, {0, 2}, {0, 0}},
+        });
+
+        Tree *tree1 = make_tree();
+        Tree *tree2 = make_tree();
+        for (const TSInputEdit &edit : edits) {
+          tree1 = ts_tree_edit(&pool, tree1, &edit);
+        }
+        tree2 = ts_tree_edit_batch(&pool, tree2, edits.data(), edits.size());
+        assert_consistent(tree1);
+        assert_consistent(tree2);
+
+        std::function<void(const Tree *, const Tree *)> assert_same_lengths =
+          [&](const Tree *left, const Tree *right) {
+            AssertThat(right->padding, Equals<Length>(left->padding));
+            AssertThat(right->size, Equals<Length>(left->size));
+            AssertThat(right->has_changes, Equals(left->has_changes));
+            AssertThat(right->children.size, Equals(left->children.size));
+            for (uint32_t i = 0; i < left->children.size; i++) {
+              assert_same_lengths(left->children.contents[i], right->children.contents[i]);
+            }
+          };
+        assert_same_lengths(tree1, tree2);
+        AssertThat(tree2->padding, Equals<Length>({4, {0, 4}}));
+        AssertThat(tree2->size, Equals<Length>({16, {1, 12}}));
+
+        ts_tree_release(&pool, tree1);
+        ts_tree_release(&pool, tree2);
+      });
+    });
+
+    describe("edits to a node with many children", [&]() {
+      Tree *wide_tree;
+
+      before_each([&]() {
+        TreeArray children = array_new();
+        for (unsigned i = 0; i < 40; i++) {
+          array_push(&children, ts_tree_make_leaf(&pool, symbol2, {1, {0, 1}}, {2, {0, 2}}, &language));
+        }
+        wide_tree = ts_tree_make_node(&pool, symbol1, &children, 0, &language);
+      });
+
+      after_each([&]() {
+        ts_tree_release(&pool, wide_tree);
+      });
+
+      auto insert = [&](uint32_t start_byte) {
+        TSInputEdit edit = {start_byte, 0, 1, {0, start_byte}, {0, 0}, {0, 1}};
+        wide_tree = ts_tree_edit(&pool, wide_tree, &edit);
+        assert_consistent(wide_tree);
+      };
+
+      it("edits only the children that contain each edit", [&]() {
+        // Insert a character into the content of the 31st child.
+        insert(30 * 3 + 2);
+        AssertThat(wide_tree->size, Equals<Length>({120, {0, 120}}));
+        AssertThat(wide_tree->children.contents[30]->size, Equals<Length>({3, {0, 3}}));
+        AssertThat(wide_tree->children.contents[30]->has_changes, IsTrue());
+        AssertThat(wide_tree->children.contents[29]->has_changes, IsFalse());
+        AssertThat(wide_tree->children.contents[31]->has_changes, IsFalse());
+
+        // Insert a character into the content of the 11th child.
+        insert(10 * 3 + 2);
+        AssertThat(wide_tree->children.contents[10]->size, Equals<Length>({3, {0, 3}}));
+        AssertThat(wide_tree->children.contents[10]->has_changes, IsTrue());
+        AssertThat(wide_tree->children.contents[11]->has_changes, IsFalse());
+
+        // Insert a character into the padding of the 36th child, whose position
+        // has been shifted by both of the previous edits.
+        insert(35 * 3 + 3);
+        AssertThat(wide_tree->children.contents[35]->padding, Equals<Length>({2, {0, 2}}));
+        AssertThat(wide_tree->children.contents[35]->size, Equals<Length>({2, {0, 2}}));
+        AssertThat(wide_tree->children.contents[34]->has_changes, IsFalse());
+        AssertThat(wide_tree->children.contents[36]->has_changes, IsFalse());
+
+        // Delete text spanning the 21st through 23rd children.
+        TSInputEdit edit = {20 * 3 + 2, 7, 0, {0, 20 * 3 + 2}, {0, 7}, {0, 0}};
+        wide_tree = ts_tree_edit(&pool, wide_tree, &edit);
+        assert_consistent(wide_tree);
+        AssertThat(wide_tree->size, Equals<Length>({115, {0, 115}}));
+        AssertThat(wide_tree->children.contents[20]->size, Equals<Length>({0, {0, 0}}));
+        AssertThat(wide_tree->children.contents[21]->padding, Equals<Length>({0, {0, 0}}));
+        AssertThat(wide_tree->children.contents[21]->size, Equals<Length>({0, {0, 0}}));
+        AssertThat(wide_tree->children.contents[22]->padding, Equals<Length>({0, {0, 0}}));
+        AssertThat(wide_tree->children.contents[22]->size, Equals<Length>({1, {0, 1}}));
+        AssertThat(wide_tree->children.contents[19]->has_changes, IsFalse());
+        AssertThat(wide_tree->children.contents[23]->has_changes, IsFalse());
+      });
+
+      it("invalidates distant children whose lookahead reaches an edit", [&]() {
+        wide_tree->children.contents[2]->bytes_scanned = 90;
+        ts_tree_set_children(wide_tree, &wide_tree->children, &language);
+
+        insert(30 * 3 + 2);
+        AssertThat(wide_tree->children.contents[2]->has_changes, IsTrue());
+        AssertThat(wide_tree->children.contents[3]->has_changes, IsFalse());
+        AssertThat(wide_tree->children.contents[29]->has_changes, IsFalse());
+      });
+    });
+
+    describe("edits to a tree that is shared", [&]() {
+      it("copies the nodes that are changed, leaving the original tree intact", [&]() {
+        Tree *old_tree = tree;
+        ts_tree_retain(old_tree);
+
+        TSInputEdit edit;
+        edit.start_byte = 1;
+        edit.bytes_removed = 0;
+        edit.bytes_added = 1;
+        edit.start_point = {0, 1};
+        edit.extent_removed = {0, 0};
+        edit.extent_added = {0, 1};
+        tree = ts_tree_edit(&pool, tree, &edit);
+        assert_consistent(tree);
+
+        AssertThat(tree, !Equals(old_tree));
+        AssertThat(tree->has_changes, IsTrue());
+        AssertThat(tree->padding, Equals<Length>({3, {0, 3}}));
+        AssertThat(tree->children.contents[0], !Equals(old_tree->children.contents[0]));
+        AssertThat(tree->children.contents[0]->padding, Equals<Length>({3, {0, 3}}));
+        AssertThat(tree->children.contents[1], Equals(old_tree->children.contents[1]));
+        AssertThat(tree->children.contents[2], Equals(old_tree->children.contents[2]));
+
+        AssertThat(old_tree->has_changes, IsFalse());
+        AssertThat(old_tree->padding, Equals<Length>({2, {0, 2}}));
+        AssertThat(old_tree->children.contents[0]->has_changes, IsFalse());
+        AssertThat(old_tree->children.contents[0]->padding, Equals<Length>({2, {0, 2}}));
+
+        ts_tree_release(&pool, old_tree);
+      });
+    });
   });
 
   describe("eq", [&]() {
@@ -436,6 +611,242 @@ describe("Tree", []() {
       ts_tree_release(&pool, parent);
       ts_tree_release(&pool, different_parent);
     });
+
+    it("gives equal trees the same structure hash, and hashes children in order", [&]() {
+      Tree *leaf2 = ts_tree_make_leaf(&pool, symbol2, {1, {0, 1}}, {3, {0, 3}}, &language);
+      Tree *leaf_copy = ts_tree_make_leaf(&pool, symbol1, {2, {1, 1}}, {5, {1, 4}}, &language);
+
+      Tree *parent = ts_tree_make_node(&pool, symbol3, tree_array({
+        leaf,
+        leaf2,
+      }), 0, &language);
+      ts_tree_retain(leaf);
+      ts_tree_retain(leaf2);
+
+      Tree *parent_copy = ts_tree_make_node(&pool, symbol3, tree_array({
+        leaf_copy,
+        leaf2,
+      }), 0, &language);
+      ts_tree_retain(leaf2);
+
+      Tree *different_parent = ts_tree_make_node(&pool, symbol3, tree_array({
+        leaf2,
+        leaf,
+      }), 0, &language);
+      ts_tree_retain(leaf2);
+      ts_tree_retain(leaf);
+
+      AssertThat(ts_tree_eq(parent, parent_copy), IsTrue());
+      AssertThat(parent->structure_hash, Equals(parent_copy->structure_hash));
+      AssertThat(parent->structure_hash, !Equals(different_parent->structure_hash));
+      AssertThat(ts_tree_compare(parent, parent), Equals(0));
+      AssertThat(ts_tree_compare(parent, parent_copy), Equals(0));
+      AssertThat(ts_tree_compare(parent, different_parent), Equals(-ts_tree_compare(different_parent, parent)));
+
+      ts_tree_release(&pool, leaf2);
+      ts_tree_release(&pool, parent);
+      ts_tree_release(&pool, parent_copy);
+      ts_tree_release(&pool, different_parent);
+    });
+  });
+
+  describe("balance", [&]() {
+    Length padding = {1, {0, 1}};
+    Length size = {2, {0, 2}};
+
+    auto make_repetition = [&](unsigned depth) {
+      Tree *tree = ts_tree_make_leaf(&pool, symbol1, padding, size, &language);
+      for (unsigned i = 0; i < depth; i++) {
+        tree = ts_tree_make_node(&pool, symbol1, tree_array({
+          tree,
+          ts_tree_make_leaf(&pool, symbol1, padding, size, &language),
+        }), 0, &language);
+      }
+      return tree;
+    };
+
+    it("rotates repetitions into balanced trees, only once", [&]() {
+      Tree *tree = make_repetition(16);
+      AssertThat(ts_tree_repeat_depth(tree), Equals(16u));
+      AssertThat(tree->is_balanced, IsFalse());
+
+      ts_tree_balance(tree, &pool, &language);
+      uint32_t balanced_depth = ts_tree_repeat_depth(tree);
+      AssertThat(balanced_depth, IsLessThan(16u));
+      AssertThat(tree->is_balanced, IsTrue());
+      AssertThat(ts_tree_total_bytes(tree), Equals(17u * 3));
+      assert_consistent(tree);
+
+      ts_tree_balance(tree, &pool, &language);
+      AssertThat(ts_tree_repeat_depth(tree), Equals(balanced_depth));
+
+      ts_tree_release(&pool, tree);
+    });
+
+    it("updates the hashes and fingerprints of the trees above the repetitions that it rotates", [&]() {
+      // The elements differ, so that the rotations change the hashes.
+      Tree *repetition = ts_tree_make_leaf(&pool, symbol1, padding, size, &language);
+      for (unsigned i = 0; i < 16; i++) {
+        repetition = ts_tree_make_node(&pool, symbol1, tree_array({
+          repetition,
+          ts_tree_make_node(&pool, symbol1, tree_array({
+            ts_tree_make_leaf(&pool, symbol5 + i % 3, padding, size, &language),
+          }), 0, &language),
+        }), 0, &language);
+      }
+
+      Tree *tree = ts_tree_make_node(&pool, symbol2, tree_array({
+        ts_tree_make_node(&pool, symbol3, tree_array({repetition}), 0, &language),
+        ts_tree_make_leaf(&pool, symbol4, padding, size, &language),
+      }), 0, &language);
+
+      ts_tree_balance(tree, &pool, &language);
+      AssertThat(ts_tree_repeat_depth(repetition), IsLessThan(16u));
+      assert_consistent(tree);
+
+      // A tree that is built in the balanced shape to begin with is equal to
+      // the balanced one.
+      std::function<Tree *(const Tree *)> copy_tree = [&](const Tree *tree) {
+        if (tree->children.size == 0) {
+          return ts_tree_make_leaf(&pool, tree->symbol, tree->padding, tree->size, &language);
+        }
+        vector<Tree *> children;
+        for (uint32_t i = 0; i < tree->children.size; i++) {
+          children.push_back(copy_tree(tree->children.contents[i]));
+        }
+        return ts_tree_make_node(&pool, tree->symbol, tree_array(children), 0, &language);
+      };
+      Tree *copy = copy_tree(tree);
+      AssertThat(copy->structure_hash, Equals(tree->structure_hash));
+      AssertThat(copy->fingerprint, Equals(tree->fingerprint));
+      AssertThat(ts_tree_eq(tree, copy), IsTrue());
+
+      ts_tree_release(&pool, tree);
+      ts_tree_release(&pool, copy);
+    });
+
+    it("leaves trees that are shared unchanged", [&]() {
+      Tree *tree = make_repetition(16);
+      ts_tree_retain(tree);
+
+      ts_tree_balance(tree, &pool, &language);
+      AssertThat(ts_tree_repeat_depth(tree), Equals(16u));
+      AssertThat(tree->is_balanced, IsFalse());
+
+      ts_tree_release(&pool, tree);
+      ts_tree_release(&pool, tree);
+    });
+  });
+
+  describe("push_repetition", [&]() {
+    Length padding = {1, {0, 1}};
+    Length size = {2, {0, 2}};
+
+    auto make_element = [&]() {
+      return ts_tree_make_node(&pool, symbol1, tree_array({
+        ts_tree_make_leaf(&pool, symbol2, padding, size, &language),
+      }), 0, &language);
+    };
+
+    it("adds elements to wide nodes, growing the repetition's depth logarithmically", [&]() {
+      Tree *tree = ts_tree_make_node(&pool, symbol1, tree_array({
+        make_element(),
+        make_element(),
+      }), 0, &language);
+
+      // Once the whole repetition is full, it becomes the first child of a
+      // new node, as it would if the parser couldn't add the element to it.
+      unsigned new_root_count = 0;
+      for (unsigned i = 2; i < 2000; i++) {
+        Tree *element = make_element();
+        if (!ts_tree_push_repetition(&pool, tree, element, &language)) {
+          tree = ts_tree_make_node(&pool, symbol1, tree_array({tree, element}), 0, &language);
+          new_root_count++;
+        }
+      }
+
+      AssertThat(new_root_count, IsLessThan(4u));
+      AssertThat(ts_tree_total_bytes(tree), Equals(2000u * 3));
+      AssertThat(ts_tree_node_count(tree), IsLessThan(2000u * 2 + 200));
+      AssertThat(ts_tree_repeat_depth(tree), IsLessThan(8u));
+      AssertThat(tree->children.contents[0]->children.size, Equals(32u));
+      assert_consistent(tree);
+
+      ts_tree_release(&pool, tree);
+    });
+
+    it("doesn't add elements that are themselves repetitions", [&]() {
+      Tree *tree = ts_tree_make_node(&pool, symbol1, tree_array({
+        make_element(),
+        make_element(),
+      }), 0, &language);
+      Tree *other_tree = ts_tree_make_node(&pool, symbol1, tree_array({
+        make_element(),
+        make_element(),
+      }), 0, &language);
+
+      AssertThat(ts_tree_push_repetition(&pool, tree, other_tree, &language), IsFalse());
+      AssertThat(tree->children.size, Equals(2u));
+
+      ts_tree_release(&pool, tree);
+      ts_tree_release(&pool, other_tree);
+    });
+  });
+
+  describe("release", [&]() {
+    it("frees the slabs of a large tree, except for the nodes that are still shared", [&]() {
+      Length padding = {1, {0, 1}};
+      Length size = {2, {0, 2}};
+      vector<Tree *> elements;
+      for (unsigned i = 0; i < 5000; i++) {
+        elements.push_back(ts_tree_make_node(&pool, symbol1, tree_array({
+          ts_tree_make_leaf(&pool, symbol2, padding, size, &language),
+        }), 0, &language));
+      }
+      Tree *tree = ts_tree_make_node(&pool, symbol3, tree_array(elements), 0, &language);
+      Tree *shared_element = elements[2500];
+      ts_tree_retain(shared_element);
+
+      size_t allocated_bytes = ts_tree_pool_allocated_bytes(&pool);
+      ts_tree_release(&pool, tree);
+      AssertThat(ts_tree_pool_allocated_bytes(&pool), IsLessThan(allocated_bytes / 10));
+      AssertThat(shared_element->ref_count, Equals(1u));
+      AssertThat(shared_element->children.contents[0]->ref_count, Equals(1u));
+      AssertThat(ts_tree_total_bytes(shared_element), Equals(3u));
+
+      ts_tree_release(&pool, shared_element);
+    });
+  });
+
+  describe("release_remotely", [&]() {
+    it("drops the references handed back by other threads once the pool is drained", [&]() {
+      Length padding = {1, {0, 1}};
+      Length size = {2, {0, 2}};
+      Tree *leaf = ts_tree_make_leaf(&pool, symbol1, padding, size, &language);
+      Tree *tree = ts_tree_make_node(&pool, symbol2, tree_array({leaf}), 0, &language);
+      for (unsigned i = 0; i < 400; i++) ts_tree_retain(tree);
+
+      vector<std::thread> threads;
+      for (unsigned i = 0; i < 4; i++) {
+        threads.push_back(std::thread([&]() {
+          for (unsigned j = 0; j < 100; j++) ts_tree_pool_release_remotely(&pool, tree);
+        }));
+      }
+      for (std::thread &thread : threads) thread.join();
+
+      // With atomic reference counts, only the last reference is queued.
+#ifdef TREE_SITTER_ATOMIC_REF_COUNTS
+      AssertThat(tree->ref_count, Equals(1u));
+#else
+      AssertThat(tree->ref_count, Equals(401u));
+#endif
+
+      ts_tree_pool_drain_remote_releases(&pool);
+      AssertThat(tree->ref_count, Equals(1u));
+      AssertThat(leaf->ref_count, Equals(1u));
+
+      ts_tree_pool_release_remotely(&pool, tree);
+    });
   });
 
   describe("last_external_token", [&]() {
@@ -470,6 +881,55 @@ describe("Tree", []() {
       ts_tree_release(&pool, tree1);
     });
   });
+
+  describe("external token states", [&]() {
+    Length padding = {1, {0, 1}};
+    Length size = {2, {0, 2}};
+    string long_state(64, 'x');
+    string other_state(64, 'y');
+
+    auto make_external = [&](const string &state, const TSExternalTokenState *existing) {
+      Tree *tree = ts_tree_make_leaf(&pool, symbol1, padding, size, &language);
+      tree->has_external_tokens = true;
+      ts_external_token_state_intern(&tree->external_token_state, state.data(), state.size(), existing);
+      return tree;
+    };
+
+    it("shares the storage of identical states", [&]() {
+      Tree *tree1 = make_external(long_state, nullptr);
+      Tree *tree2 = make_external(long_state, &tree1->external_token_state);
+      Tree *tree3 = make_external(other_state, &tree2->external_token_state);
+
+      const char *data1 = ts_external_token_state_data(&tree1->external_token_state);
+      const char *data2 = ts_external_token_state_data(&tree2->external_token_state);
+      const char *data3 = ts_external_token_state_data(&tree3->external_token_state);
+      AssertThat((const void *)data2, Equals<const void *>(data1));
+      AssertThat((const void *)data3, !Equals<const void *>(data1));
+      AssertThat(string(data3, 64), Equals(other_state));
+
+      ts_tree_release(&pool, tree1);
+      AssertThat(string(data2, 64), Equals(long_state));
+      ts_tree_release(&pool, tree2);
+      ts_tree_release(&pool, tree3);
+    });
+
+    it("shares the storage of the state when a token is copied for editing", [&]() {
+      Tree *tree1 = make_external(long_state, nullptr);
+      ts_tree_retain(tree1);
+      Tree *tree2 = ts_tree_make_mut(&pool, tree1);
+      AssertThat(tree2, !Equals(tree1));
+      AssertThat(
+        (const void *)ts_external_token_state_data(&tree2->external_token_state),
+        Equals<const void *>(ts_external_token_state_data(&tree1->external_token_state))
+      );
+
+      ts_tree_release(&pool, tree1);
+      Tree *tree3 = make_external(long_state, nullptr);
+      AssertThat(ts_tree_external_token_state_eq(tree2, tree3), IsTrue());
+      ts_tree_release(&pool, tree2);
+      ts_tree_release(&pool, tree3);
+    });
+  });
 });
 
 END_TEST
@@ -0,0 +1,311 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "tree_sitter/runtime.h"
+#include "helpers/benchmark_helpers.h"
+#include "helpers/load_language.h"
+#include "helpers/read_test_entries.h"
+
+using std::string;
+using std::vector;
+
+// Each language's corpus entries and example files are concatenated into
+// inputs that grow by a constant factor, from a kilobyte up to a maximum size.
+// Each input is parsed from scratch, then edited in the middle and reparsed,
+// and then broken in the middle so that the reparse has to recover from an
+// error. Between each pair of consecutive sizes, the growth of each
+// measurement is expressed as an exponent of the growth of the input, so a
+// full parse should stay near 1, and the reparses near 0. Growth beyond the
+// expected exponent is flagged, since it usually means that some path is
+// superlinear in the size of the document.
+
+const size_t MIN_SIZE = 1024;
+const size_t SIZE_FACTOR = 4;
+const size_t DEFAULT_MAX_SIZE = 100 * 1024 * 1024;
+
+// Measurements on inputs smaller than this are too noisy to be compared.
+const size_t MIN_COMPARED_SIZE = 64 * 1024;
+const double MAX_PARSE_EXPONENT = 1.25;
+const double MAX_REPARSE_EXPONENT = 0.75;
+
+vector<string> language_names({
+  "c",
+  "cpp",
+  "javascript",
+  "python",
+  "bash",
+});
+
+struct SizeResult {
+  size_t byte_count;
+  bool has_errors;
+  double parse_ms;
+  double edit_ms;
+  double recovery_ms;
+  size_t memory_bytes;
+  size_t node_count;
+};
+
+struct LanguageResult {
+  string name;
+  vector<SizeResult> sizes;
+};
+
+// Entries whose expected trees contain errors are left out, so that the
+// generated inputs are mostly valid.
+vector<string> input_units_for_language(const string &language_name) {
+  vector<string> result;
+  for (auto &entry : read_real_language_corpus(language_name)) {
+    if (entry.tree_string.find("ERROR") != string::npos) continue;
+    if (entry.tree_string.find("MISSING") != string::npos) continue;
+    result.push_back(entry.input);
+  }
+  for (auto &example : examples_for_language(language_name)) {
+    result.push_back(example.input);
+  }
+  return result;
+}
+
+// The units are appended in turn, skipping any that would make the input
+// larger than the given size. Returns an empty string if none fit.
+string generate_input(const vector<string> &units, size_t size) {
+  string result;
+  result.reserve(size);
+  size_t skipped_count = 0;
+  for (size_t i = 0; skipped_count < units.size(); i = (i + 1) % units.size()) {
+    const string &unit = units[i];
+    if (result.size() + unit.size() + 2 > size) {
+      skipped_count++;
+      continue;
+    }
+    skipped_count = 0;
+    result += unit;
+    result += "\n\n";
+  }
+  return result;
+}
+
+// The position at which the middle line of the input starts.
+size_t middle_line_start(const string &input) {
+  size_t result = input.rfind('\n', input.size() / 2);
+  return result == string::npos ? 0 : result + 1;
+}
+
+TSPoint point_for_byte(const string &input, size_t byte) {
+  TSPoint result = {0, 0};
+  for (size_t i = 0; i < byte; i++) {
+    if (input[i] == '\n') {
+      result.row++;
+      result.column = 0;
+    } else {
+      result.column++;
+    }
+  }
+  return result;
+}
+
+// The input reads the text in place, since replacing the document's input
+// with a new string would invalidate its tree.
+struct StringInput {
+  const string *text;
+  size_t position;
+
+  static const char *read(void *payload, uint32_t *length) {
+    auto self = static_cast<StringInput *>(payload);
+    size_t remaining = self->text->size() - std::min(self->position, self->text->size());
+    *length = static_cast<uint32_t>(std::min<size_t>(remaining, 1024));
+    const char *result = self->text->data() + self->text->size() - remaining;
+    self->position += *length;
+    return result;
+  }
+
+  static int seek(void *payload, uint32_t byte, TSPoint) {
+    auto self = static_cast<StringInput *>(payload);
+    self->position = byte;
+    return byte < self->text->size();
+  }
+
+  TSInput input() {
+    return {this, read, seek, TSInputEncodingUTF8};
+  }
+};
+
+// Insert the given text at the start of the middle line, and time the edit
+// and the reparse. The text is removed again afterward.
+double measure_reparse(TSDocument *document, string &input, const string &text) {
+  size_t position = middle_line_start(input);
+  TSPoint point = point_for_byte(input, position);
+  TSPoint extent = point_for_byte(text, text.size());
+
+  input.insert(position, text);
+  auto start_time = std::chrono::steady_clock::now();
+  ts_document_edit(document, {
+    static_cast<uint32_t>(position), 0, static_cast<uint32_t>(text.size()), point, {0, 0}, extent
+  });
+  ts_document_parse(document);
+  double result = milliseconds_between(start_time, std::chrono::steady_clock::now());
+
+  input.erase(position, text.size());
+  ts_document_edit(document, {
+    static_cast<uint32_t>(position), static_cast<uint32_t>(text.size()), 0, point, extent, {0, 0}
+  });
+  ts_document_parse(document);
+  return result;
+}
+
+// Large inputs are parsed fewer times, so that the largest sizes finish in a
+// reasonable time.
+SizeResult measure_size(TSDocument *document, string input, unsigned run_count) {
+  size_t runs = std::max<size_t>(1, std::min<size_t>(run_count, (16 * 1024 * 1024) / input.size()));
+  vector<double> parse_durations, edit_durations, recovery_durations;
+  StringInput string_input{&input, 0};
+  ts_document_set_input(document, string_input.input());
+  for (size_t i = 0; i < runs; i++) {
+    ts_document_invalidate(document);
+    auto start_time = std::chrono::steady_clock::now();
+    ts_document_parse(document);
+    parse_durations.push_back(milliseconds_between(start_time, std::chrono::steady_clock::now()));
+  }
+
+  TSNode root = ts_document_root_node(document);
+  TSMemoryUsage memory_usage = ts_document_memory_usage(document);
+  TSTreeStats tree_stats = ts_document_tree_stats(document);
+  SizeResult result{
+    input.size(),
+    ts_node_has_error(root),
+    percentile(parse_durations, 0.5),
+    0,
+    0,
+    memory_usage.tree_bytes + memory_usage.free_tree_bytes + memory_usage.stack_bytes,
+    tree_stats.node_count,
+  };
+
+  for (size_t i = 0; i < runs; i++) {
+    edit_durations.push_back(measure_reparse(document, input, "\n"));
+    recovery_durations.push_back(measure_reparse(document, input, "}}{{)(\n"));
+  }
+  result.edit_ms = percentile(edit_durations, 0.5);
+  result.recovery_ms = percentile(recovery_durations, 0.5);
+  ts_document_set_input_string(document, "");
+  ts_document_parse(document);
+  return result;
+}
+
+double growth_exponent(double previous_value, double value, size_t previous_size, size_t size) {
+  if (previous_value <= 0 || value <= 0) return 0;
+  return std::log(value / previous_value) / std::log(static_cast<double>(size) / previous_size);
+}
+
+// Returns the number of measurements that grew faster than expected.
+unsigned print_size(const SizeResult &result, const SizeResult *previous) {
+  unsigned flag_count = 0;
+  printf(
+    "  %10lu bytes%s\tparse %.3f ms\tedit %.3f ms\trecovery %.3f ms\t%lu bytes of memory\t%lu nodes",
+    result.byte_count,
+    result.has_errors ? " (with errors)" : "",
+    result.parse_ms,
+    result.edit_ms,
+    result.recovery_ms,
+    result.memory_bytes,
+    result.node_count
+  );
+
+  if (previous && previous->byte_count >= MIN_COMPARED_SIZE) {
+    struct {
+      const char *name;
+      double previous_value;
+      double value;
+      double max_exponent;
+    } measurements[] = {
+      {"parse", previous->parse_ms, result.parse_ms, MAX_PARSE_EXPONENT},
+      {"edit", previous->edit_ms, result.edit_ms, MAX_REPARSE_EXPONENT},
+      {"recovery", previous->recovery_ms, result.recovery_ms, MAX_REPARSE_EXPONENT},
+      {"memory", static_cast<double>(previous->memory_bytes), static_cast<double>(result.memory_bytes),
+       MAX_PARSE_EXPONENT},
+    };
+    for (auto &measurement : measurements) {
+      double exponent = growth_exponent(
+        measurement.previous_value, measurement.value, previous->byte_count, result.byte_count
+      );
+      if (exponent > measurement.max_exponent) {
+        printf("\tSUPERLINEAR %s (n^%.2f)", measurement.name, exponent);
+        flag_count++;
+      }
+    }
+  }
+  printf("\n");
+  return flag_count;
+}
+
+// One row per language and size, for plotting.
+void write_csv(FILE *file, const vector<LanguageResult> &languages) {
+  fprintf(file, "language,bytes,has_errors,parse_ms,edit_ms,recovery_ms,memory_bytes,nodes\n");
+  for (auto &language : languages) {
+    for (auto &size : language.sizes) {
+      fprintf(
+        file, "%s,%lu,%d,%.4f,%.4f,%.4f,%lu,%lu\n",
+        language.name.c_str(),
+        size.byte_count,
+        size.has_errors,
+        size.parse_ms,
+        size.edit_ms,
+        size.recovery_ms,
+        size.memory_bytes,
+        size.node_count
+      );
+    }
+  }
+}
+
+int main() {
+  auto language_filter = getenv("TREE_SITTER_BENCHMARK_LANGUAGE");
+  auto csv_path = getenv("TREE_SITTER_BENCHMARK_CSV");
+  unsigned run_count = env_unsigned("TREE_SITTER_BENCHMARK_RUNS", 5);
+  if (run_count == 0) run_count = 1;
+  size_t max_size = env_unsigned("TREE_SITTER_BENCHMARK_MAX_SIZE", 0);
+  if (max_size == 0) max_size = DEFAULT_MAX_SIZE;
+
+  vector<LanguageResult> results;
+  unsigned flag_count = 0;
+  TSDocument *document = ts_document_new();
+
+  for (auto &language_name : language_names) {
+    if (language_filter && language_name != language_filter) continue;
+    ts_document_set_language(document, load_real_language(language_name));
+    results.push_back({language_name, {}});
+    LanguageResult &result = results.back();
+    printf("%s\n", language_name.c_str());
+
+    vector<string> units = input_units_for_language(language_name);
+    for (size_t size = MIN_SIZE; size <= max_size; size *= SIZE_FACTOR) {
+      string input = generate_input(units, size);
+      if (input.empty()) continue;
+      const SizeResult *previous = result.sizes.empty() ? nullptr : &result.sizes.back();
+      SizeResult size_result = measure_size(document, input, run_count);
+      flag_count += print_size(size_result, previous);
+      result.sizes.push_back(size_result);
+    }
+    puts("");
+  }
+
+  if (csv_path) {
+    FILE *file = fopen(csv_path, "w");
+    if (!file) {
+      fprintf(stderr, "Could not open %s\n", csv_path);
+      return 1;
+    }
+    write_csv(file, results);
+    fclose(file);
+  }
+
+  ts_document_free(document);
+  if (flag_count > 0) {
+    printf("%u measurements grew superlinearly\n", flag_count);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "runtime/alloc.h"
+#include "runtime/length.h"
+#include "runtime/stack.h"
+#include "runtime/tree.h"
+#include "helpers/benchmark_helpers.h"
+
+using std::string;
+using std::vector;
+
+// Each benchmark drives a stack through a synthetic pattern of versions and
+// merges, like the ones that the parser produces for ambiguous grammars, and
+// returns the number of stack operations that it performed. A benchmark is run
+// a number of times, and the time per operation is reported for the median
+// and the fastest run, so that changes to the stack's layout can be compared
+// without the noise of a full parse.
+
+const uint32_t TREE_COUNT = 16;
+const TSStateId STATE_COUNT = 64;
+
+struct Fixture {
+  TreePool pool;
+  Stack *stack;
+  Tree *trees[TREE_COUNT];
+};
+
+struct BenchmarkResult {
+  string name;
+  size_t operation_count;
+  vector<double> nanos_per_operation;
+};
+
+typedef size_t (*Benchmark)(Fixture *);
+
+void push(Fixture *fixture, StackVersion version, uint32_t tree_index, TSStateId state) {
+  Tree *tree = fixture->trees[tree_index % TREE_COUNT];
+  ts_tree_retain(tree);
+  ts_stack_push(fixture->stack, version, tree, false, state);
+}
+
+// Slices that were popped from merged versions may share their tree arrays.
+void release_slices(Fixture *fixture, StackSliceArray *slices) {
+  for (uint32_t i = 0; i < slices->size; i++) {
+    TreeArray trees = slices->contents[i].trees;
+    bool is_shared = false;
+    for (uint32_t j = 0; j < i; j++) {
+      if (slices->contents[j].trees.contents == trees.contents) is_shared = true;
+    }
+    if (!is_shared) ts_tree_array_delete(&fixture->pool, &trees);
+  }
+}
+
+// Remove every version except the first.
+void remove_other_versions(Fixture *fixture) {
+  while (ts_stack_version_count(fixture->stack) > 1) {
+    ts_stack_remove_version(fixture->stack, ts_stack_version_count(fixture->stack) - 1);
+  }
+}
+
+// A single version, onto which trees are pushed, as in an unambiguous parse.
+size_t benchmark_push(Fixture *fixture) {
+  const uint32_t depth = 4096;
+  for (uint32_t i = 0; i < depth; i++) {
+    push(fixture, 0, i, 1 + i % STATE_COUNT);
+  }
+  ts_stack_clear(fixture->stack);
+  return depth;
+}
+
+// Pairs of trees are popped and replaced, as in a sequence of reductions.
+size_t benchmark_pop_count(Fixture *fixture) {
+  const uint32_t depth = 256, reduction_count = 4096;
+  for (uint32_t i = 0; i < depth; i++) {
+    push(fixture, 0, i, 1 + i % STATE_COUNT);
+  }
+  for (uint32_t i = 0; i < reduction_count; i++) {
+    StackSliceArray pop = ts_stack_pop_count(fixture->stack, 0, 2);
+    StackVersion version = pop.contents[0].version;
+    release_slices(fixture, &pop);
+    ts_stack_renumber_version(fixture->stack, version, 0);
+    push(fixture, 0, i, 1 + i % STATE_COUNT);
+    push(fixture, 0, i + 1, 2 + i % STATE_COUNT);
+  }
+  ts_stack_clear(fixture->stack);
+  return reduction_count * 3;
+}
+
+// A version is split into several, each of which shifts a different tree into
+// the same state, after which they are merged back together.
+size_t benchmark_split_and_merge(Fixture *fixture) {
+  const uint32_t round_count = 512, width = 4;
+  for (uint32_t i = 0; i < round_count; i++) {
+    TSStateId state = 1 + i % STATE_COUNT;
+    for (uint32_t j = 1; j < width; j++) ts_stack_copy_version(fixture->stack, 0);
+    for (uint32_t j = 0; j < width; j++) push(fixture, j, i + j, state);
+    for (uint32_t j = width - 1; j > 0; j--) ts_stack_merge(fixture->stack, 0, j);
+  }
+  ts_stack_clear(fixture->stack);
+  return round_count * (3 * width - 2);
+}
+
+// Trees are popped across a few levels of merges, so that each pop has to
+// follow every path through the merged nodes.
+size_t benchmark_pop_across_merges(Fixture *fixture) {
+  const uint32_t round_count = 256, level_count = 3, width = 3;
+  size_t operation_count = 0;
+  for (uint32_t i = 0; i < round_count; i++) {
+    for (uint32_t level = 0; level < level_count; level++) {
+      TSStateId state = 1 + (i + level) % STATE_COUNT;
+      for (uint32_t j = 1; j < width; j++) ts_stack_copy_version(fixture->stack, 0);
+      for (uint32_t j = 0; j < width; j++) push(fixture, j, level * width + j, state);
+      for (uint32_t j = width - 1; j > 0; j--) ts_stack_merge(fixture->stack, 0, j);
+    }
+    StackSliceArray pop = ts_stack_pop_count(fixture->stack, 0, level_count);
+    operation_count += pop.size;
+    StackVersion version = pop.contents[0].version;
+    release_slices(fixture, &pop);
+    ts_stack_renumber_version(fixture->stack, version, 0);
+    remove_other_versions(fixture);
+  }
+  ts_stack_clear(fixture->stack);
+  return operation_count;
+}
+
+// The states below the top of a deep stack with occasional merges are
+// summarized and iterated, as they are during error recovery.
+size_t benchmark_summary_and_iterate(Fixture *fixture) {
+  const uint32_t depth = 512, iteration_count = 64;
+  for (uint32_t i = 0; i < depth; i++) {
+    TSStateId state = 1 + i % STATE_COUNT;
+    if (i % 16 == 0) {
+      ts_stack_copy_version(fixture->stack, 0);
+      push(fixture, 0, i, state);
+      push(fixture, 1, i + 1, state);
+      ts_stack_merge(fixture->stack, 0, 1);
+    } else {
+      push(fixture, 0, i, state);
+    }
+  }
+
+  size_t state_count = 0;
+  for (uint32_t i = 0; i < iteration_count; i++) {
+    ts_stack_record_summary(fixture->stack, 0, 32);
+    ts_stack_iterate(fixture->stack, 0, [](void *payload, TSStateId, uint32_t) {
+      (*static_cast<size_t *>(payload))++;
+    }, &state_count);
+    push(fixture, 0, i, 1 + i % STATE_COUNT);
+  }
+  ts_stack_clear(fixture->stack);
+  return iteration_count * 2;
+}
+
+BenchmarkResult run_benchmark(const char *name, Benchmark benchmark, unsigned warmup_run_count,
+                              unsigned run_count) {
+  Fixture fixture;
+  ts_tree_pool_init(&fixture.pool);
+  fixture.stack = ts_stack_new(&fixture.pool);
+  TSLanguage language;
+  TSSymbolMetadata symbol_metadata[TREE_COUNT] = {};
+  language.symbol_metadata = symbol_metadata;
+  for (uint32_t i = 0; i < TREE_COUNT; i++) {
+    fixture.trees[i] = ts_tree_make_leaf(&fixture.pool, i, length_zero(), {1, {0, 1}}, &language);
+  }
+
+  BenchmarkResult result{name, 0, {}};
+  for (unsigned i = 0; i < warmup_run_count + run_count; i++) {
+    auto start_time = std::chrono::steady_clock::now();
+    size_t operation_count = benchmark(&fixture);
+    auto end_time = std::chrono::steady_clock::now();
+    if (i < warmup_run_count) continue;
+    double nanos = std::chrono::duration<double, std::nano>(end_time - start_time).count();
+    result.operation_count = operation_count;
+    result.nanos_per_operation.push_back(nanos / operation_count);
+  }
+
+  ts_stack_delete(fixture.stack);
+  for (uint32_t i = 0; i < TREE_COUNT; i++) ts_tree_release(&fixture.pool, fixture.trees[i]);
+  ts_tree_pool_delete(&fixture.pool);
+  return result;
+}
+
+int main() {
+  auto name_filter = getenv("TREE_SITTER_BENCHMARK_FILE_NAME");
+  auto json_path = getenv("TREE_SITTER_BENCHMARK_JSON");
+  unsigned warmup_run_count = env_unsigned("TREE_SITTER_BENCHMARK_WARMUP_RUNS", 2);
+  unsigned run_count = env_unsigned("TREE_SITTER_BENCHMARK_RUNS", 10);
+  if (run_count == 0) run_count = 1;
+
+  struct {
+    const char *name;
+    Benchmark benchmark;
+  } benchmarks[] = {
+    {"push", benchmark_push},
+    {"pop_count", benchmark_pop_count},
+    {"split_and_merge", benchmark_split_and_merge},
+    {"pop_across_merges", benchmark_pop_across_merges},
+    {"summary_and_iterate", benchmark_summary_and_iterate},
+  };
+
+  vector<BenchmarkResult> results;
+  for (auto &entry : benchmarks) {
+    if (name_filter && string(entry.name) != name_filter) continue;
+    results.push_back(run_benchmark(entry.name, entry.benchmark, warmup_run_count, run_count));
+    const BenchmarkResult &result = results.back();
+    printf(
+      "  %-30s\t%lu operations\tp50 %.1f ns/op\tbest %.1f ns/op\n",
+      result.name.c_str(),
+      static_cast<unsigned long>(result.operation_count),
+      percentile(result.nanos_per_operation, 0.5),
+      percentile(result.nanos_per_operation, 0)
+    );
+  }
+
+  if (json_path) {
+    FILE *file = fopen(json_path, "w");
+    if (!file) {
+      fprintf(stderr, "Could not open %s\n", json_path);
+      return 1;
+    }
+    fprintf(file, "{\n  \"warmup_runs\": %u,\n  \"runs\": %u,\n  \"benchmarks\": [", warmup_run_count, run_count);
+    for (size_t i = 0; i < results.size(); i++) {
+      fprintf(
+        file,
+        "%s\n    {\"name\": \"%s\", \"operations\": %lu, \"p50_ns_per_operation\": %.2f, "
+        "\"best_ns_per_operation\": %.2f}",
+        i > 0 ? "," : "",
+        results[i].name.c_str(),
+        static_cast<unsigned long>(results[i].operation_count),
+        percentile(results[i].nanos_per_operation, 0.5),
+        percentile(results[i].nanos_per_operation, 0)
+      );
+    }
+    fprintf(file, "\n  ]\n}\n");
+    fclose(file);
+  }
+
+  return 0;
+}
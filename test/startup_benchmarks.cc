@@ -0,0 +1,190 @@
+#include <dlfcn.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+#include "tree_sitter/runtime.h"
+#include "helpers/benchmark_helpers.h"
+#include "helpers/load_language.h"
+
+using std::map;
+using std::string;
+using std::vector;
+
+// Each run goes through everything that a short-lived process does before it
+// can use a language: opening the language's library and calling its language
+// function, creating a document, setting its language, and parsing a tiny
+// input, which also creates the external scanner. Afterward the document is
+// freed and the library is closed, so that the next run has to open it again.
+// The libraries are compiled beforehand, so the compilation isn't measured.
+// The first run of each language is reported separately, since it is the only
+// one that may have to read the library from disk.
+
+vector<string> language_names({
+  "c",
+  "cpp",
+  "javascript",
+  "python",
+  "bash",
+});
+
+map<string, string> tiny_inputs({
+  {"c", "int x;\n"},
+  {"cpp", "int x;\n"},
+  {"javascript", "x;\n"},
+  {"python", "x\n"},
+  {"bash", "x\n"},
+});
+
+enum Phase {
+  PhaseLoad,
+  PhaseNew,
+  PhaseSetLanguage,
+  PhaseFirstParse,
+  PhaseFree,
+  PhaseCount,
+};
+
+const char *phase_names[PhaseCount] = {
+  "load",
+  "new",
+  "set_language",
+  "first_parse",
+  "free",
+};
+
+struct RunResult {
+  double phase_ms[PhaseCount];
+
+  double total_ms() const {
+    double result = 0;
+    for (double duration : phase_ms) result += duration;
+    return result;
+  }
+};
+
+// Returns false if the library or its language function can't be loaded.
+bool measure_run(const string &language_name, const string &lib_filename, RunResult *result) {
+  const string &input = tiny_inputs[language_name];
+  string language_function_name = "tree_sitter_" + language_name;
+
+  auto load_time = std::chrono::steady_clock::now();
+  void *library = dlopen(lib_filename.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (!library) {
+    fprintf(stderr, "Could not open %s: %s\n", lib_filename.c_str(), dlerror());
+    return false;
+  }
+  void *language_function = dlsym(library, language_function_name.c_str());
+  if (!language_function) {
+    fprintf(stderr, "Could not find %s in %s\n", language_function_name.c_str(), lib_filename.c_str());
+    dlclose(library);
+    return false;
+  }
+  const TSLanguage *language = reinterpret_cast<TSLanguage *(*)()>(language_function)();
+
+  auto new_time = std::chrono::steady_clock::now();
+  TSDocument *document = ts_document_new();
+
+  auto set_language_time = std::chrono::steady_clock::now();
+  ts_document_set_language(document, language);
+
+  auto parse_time = std::chrono::steady_clock::now();
+  ts_document_set_input_string_with_length(document, input.c_str(), input.size());
+  ts_document_parse(document);
+
+  auto free_time = std::chrono::steady_clock::now();
+  ts_document_free(document);
+
+  auto end_time = std::chrono::steady_clock::now();
+  dlclose(library);
+
+  result->phase_ms[PhaseLoad] = milliseconds_between(load_time, new_time);
+  result->phase_ms[PhaseNew] = milliseconds_between(new_time, set_language_time);
+  result->phase_ms[PhaseSetLanguage] = milliseconds_between(set_language_time, parse_time);
+  result->phase_ms[PhaseFirstParse] = milliseconds_between(parse_time, free_time);
+  result->phase_ms[PhaseFree] = milliseconds_between(free_time, end_time);
+  return true;
+}
+
+void print_runs(const char *name, const RunResult &first_run, const vector<RunResult> &runs) {
+  printf("  %-12s\tfirst %.3f ms", name, first_run.total_ms());
+  vector<double> totals;
+  for (auto &run : runs) totals.push_back(run.total_ms());
+  printf("\tp50 %.3f ms\tp99 %.3f ms\n", percentile(totals, 0.5), percentile(totals, 0.99));
+
+  for (unsigned phase = 0; phase < PhaseCount; phase++) {
+    vector<double> durations;
+    for (auto &run : runs) durations.push_back(run.phase_ms[phase]);
+    printf(
+      "    %-12s\tfirst %.3f ms\tp50 %.3f ms\tp99 %.3f ms\n",
+      phase_names[phase],
+      first_run.phase_ms[phase],
+      percentile(durations, 0.5),
+      percentile(durations, 0.99)
+    );
+  }
+}
+
+int main() {
+  auto language_filter = getenv("TREE_SITTER_BENCHMARK_LANGUAGE");
+  unsigned run_count = env_unsigned("TREE_SITTER_BENCHMARK_RUNS", 100);
+  if (run_count == 0) run_count = 1;
+
+  vector<string> selected_language_names;
+  vector<string> lib_filenames;
+  for (auto &language_name : language_names) {
+    if (language_filter && language_name != language_filter) continue;
+    string lib_filename = build_real_language(language_name);
+    if (lib_filename.empty()) {
+      fprintf(stderr, "Could not compile %s\n", language_name.c_str());
+      return 1;
+    }
+    selected_language_names.push_back(language_name);
+    lib_filenames.push_back(lib_filename);
+  }
+  if (selected_language_names.empty()) {
+    fprintf(stderr, "No languages to load\n");
+    return 1;
+  }
+  printf("%u runs per language\n\n", run_count);
+
+  // Every run starts all of the languages in turn, like a process that needs
+  // several of them, and the runs are also summed across the languages.
+  size_t language_count = selected_language_names.size();
+  vector<RunResult> first_runs(language_count);
+  vector<vector<RunResult>> runs(language_count);
+  RunResult all_first_run = {};
+  vector<RunResult> all_runs;
+  for (unsigned i = 0; i <= run_count; i++) {
+    RunResult all_run = {};
+    for (size_t j = 0; j < language_count; j++) {
+      RunResult run;
+      if (!measure_run(selected_language_names[j], lib_filenames[j], &run)) return 1;
+      for (unsigned phase = 0; phase < PhaseCount; phase++) {
+        all_run.phase_ms[phase] += run.phase_ms[phase];
+      }
+      if (i == 0) {
+        first_runs[j] = run;
+      } else {
+        runs[j].push_back(run);
+      }
+    }
+    if (i == 0) {
+      all_first_run = all_run;
+    } else {
+      all_runs.push_back(all_run);
+    }
+  }
+
+  for (size_t j = 0; j < language_count; j++) {
+    print_runs(selected_language_names[j].c_str(), first_runs[j], runs[j]);
+  }
+  if (language_count > 1) {
+    puts("");
+    print_runs("all", all_first_run, all_runs);
+  }
+  return 0;
+}
@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include "tree_sitter/runtime.h"
+#include "helpers/benchmark_helpers.h"
+#include "helpers/load_language.h"
+#include "helpers/read_test_entries.h"
+
+using std::string;
+using std::vector;
+
+// Each thread parses the whole corpus with a document of its own, starting at
+// a different example, so that the threads share nothing but the allocator,
+// the languages' tables and the caches. The threads are released together,
+// and the aggregate throughput is measured from their release until the last
+// one finishes. A thread count's efficiency is its throughput divided by the
+// throughput of a single thread times the number of threads, so a runtime that
+// scales perfectly stays at 100%.
+
+vector<string> language_names({
+  "c",
+  "cpp",
+  "javascript",
+  "python",
+  "bash",
+});
+
+struct Job {
+  const TSLanguage *language;
+  string input;
+};
+
+struct ThreadResult {
+  size_t byte_count;
+  double duration_ms;
+};
+
+struct ThreadCountResult {
+  unsigned thread_count;
+  double duration_ms;
+  size_t byte_count;
+  vector<ThreadResult> threads;
+};
+
+ThreadResult parse_jobs(const vector<Job> &jobs, unsigned first_job, unsigned round_count,
+                        std::atomic<bool> *is_released) {
+  TSDocument *document = ts_document_new();
+  ThreadResult result{0, 0};
+  while (!is_released->load()) std::this_thread::yield();
+
+  auto start_time = std::chrono::steady_clock::now();
+  for (unsigned i = 0; i < round_count; i++) {
+    for (size_t j = 0; j < jobs.size(); j++) {
+      const Job &job = jobs[(first_job + j) % jobs.size()];
+      if (ts_document_language(document) != job.language) {
+        ts_document_set_language(document, job.language);
+      }
+      ts_document_invalidate(document);
+      ts_document_set_input_string_with_length(document, job.input.c_str(), job.input.size());
+      ts_document_parse(document);
+      result.byte_count += job.input.size();
+    }
+  }
+  result.duration_ms = milliseconds_between(start_time, std::chrono::steady_clock::now());
+
+  ts_document_free(document);
+  return result;
+}
+
+ThreadCountResult measure_thread_count(const vector<Job> &jobs, unsigned thread_count,
+                                       unsigned round_count) {
+  ThreadCountResult result{thread_count, 0, 0, vector<ThreadResult>(thread_count)};
+  std::atomic<bool> is_released(false);
+  vector<std::thread> threads;
+  for (unsigned i = 0; i < thread_count; i++) {
+    unsigned first_job = static_cast<unsigned>(i * jobs.size() / thread_count);
+    threads.emplace_back([&, i, first_job]() {
+      result.threads[i] = parse_jobs(jobs, first_job, round_count, &is_released);
+    });
+  }
+
+  auto start_time = std::chrono::steady_clock::now();
+  is_released.store(true);
+  for (auto &thread : threads) thread.join();
+  result.duration_ms = milliseconds_between(start_time, std::chrono::steady_clock::now());
+
+  for (auto &thread : result.threads) result.byte_count += thread.byte_count;
+  return result;
+}
+
+double throughput(const ThreadCountResult &result) {
+  return result.duration_ms > 0 ? result.byte_count / result.duration_ms : 0;
+}
+
+double thread_throughput(const ThreadResult &result) {
+  return result.duration_ms > 0 ? result.byte_count / result.duration_ms : 0;
+}
+
+void print_thread_count(const ThreadCountResult &result, const ThreadCountResult &single_thread_result) {
+  double slowest = thread_throughput(result.threads[0]), fastest = slowest;
+  for (auto &thread : result.threads) {
+    slowest = std::min(slowest, thread_throughput(thread));
+    fastest = std::max(fastest, thread_throughput(thread));
+  }
+  double ideal = throughput(single_thread_result) * result.thread_count;
+  printf(
+    "  %3u threads\t%.1f bytes/ms\t%.1f%% efficiency\tslowest thread %.1f bytes/ms\tfastest thread %.1f bytes/ms\n",
+    result.thread_count,
+    throughput(result),
+    ideal > 0 ? throughput(result) / ideal * 100 : 0,
+    slowest,
+    fastest
+  );
+}
+
+int main() {
+  auto language_filter = getenv("TREE_SITTER_BENCHMARK_LANGUAGE");
+  unsigned round_count = env_unsigned("TREE_SITTER_BENCHMARK_RUNS", 3);
+  if (round_count == 0) round_count = 1;
+  unsigned max_thread_count = env_unsigned("TREE_SITTER_BENCHMARK_THREADS", std::thread::hardware_concurrency());
+  if (max_thread_count == 0) max_thread_count = 1;
+
+  vector<Job> jobs;
+  size_t corpus_byte_count = 0;
+  for (auto &language_name : language_names) {
+    if (language_filter && language_name != language_filter) continue;
+    const TSLanguage *language = load_real_language(language_name);
+    for (auto &example : examples_for_language(language_name)) {
+      if (example.input.size() < 256) continue;
+      jobs.push_back({language, example.input});
+      corpus_byte_count += example.input.size();
+    }
+  }
+  if (jobs.empty()) {
+    fprintf(stderr, "No examples to parse\n");
+    return 1;
+  }
+  printf("%lu examples, %lu bytes, %u rounds per thread\n", jobs.size(), corpus_byte_count, round_count);
+
+  // The thread counts double up to the maximum, which is always included.
+  vector<unsigned> thread_counts;
+  for (unsigned thread_count = 1; thread_count < max_thread_count; thread_count *= 2) {
+    thread_counts.push_back(thread_count);
+  }
+  thread_counts.push_back(max_thread_count);
+
+  // A round on one thread warms up the languages' tables and the allocator.
+  measure_thread_count(jobs, 1, 1);
+
+  ThreadCountResult single_thread_result = measure_thread_count(jobs, 1, round_count);
+  for (unsigned thread_count : thread_counts) {
+    ThreadCountResult result = thread_count == 1
+      ? single_thread_result
+      : measure_thread_count(jobs, thread_count, round_count);
+    print_thread_count(result, single_thread_result);
+  }
+  return 0;
+}
@@ -15,12 +15,113 @@
       ],
       'sources': [
         'test/benchmarks.cc',
+        'test/helpers/benchmark_helpers.cc',
+        'test/helpers/encoding_helpers.cc',
         'test/helpers/file_helpers.cc',
         'test/helpers/load_language.cc',
+        'test/helpers/perf_counters.cc',
         'test/helpers/read_test_entries.cc',
+        'test/helpers/spy_input.cc',
         'test/helpers/stderr_logger.cc',
       ],
     },
+    {
+      'target_name': 'compile_benchmarks',
+      'default_configuration': 'Release',
+      'type': 'executable',
+      'dependencies': [
+        'project.gyp:compiler'
+      ],
+      'include_dirs': [
+        'src',
+        'test',
+      ],
+      'sources': [
+        'test/compile_benchmarks.cc',
+        'test/helpers/benchmark_helpers.cc',
+        'test/helpers/file_helpers.cc',
+      ],
+    },
+    {
+      'target_name': 'stack_benchmarks',
+      'default_configuration': 'Release',
+      'type': 'executable',
+      'dependencies': [
+        'project.gyp:runtime'
+      ],
+      'include_dirs': [
+        'src',
+        'test',
+      ],
+      'sources': [
+        'test/stack_benchmarks.cc',
+        'test/helpers/benchmark_helpers.cc',
+      ],
+    },
+    {
+      'target_name': 'scaling_benchmarks',
+      'default_configuration': 'Release',
+      'type': 'executable',
+      'dependencies': [
+        'project.gyp:runtime',
+        'project.gyp:compiler'
+      ],
+      'include_dirs': [
+        'src',
+        'test',
+        'externals/utf8proc',
+      ],
+      'sources': [
+        'test/scaling_benchmarks.cc',
+        'test/helpers/benchmark_helpers.cc',
+        'test/helpers/encoding_helpers.cc',
+        'test/helpers/file_helpers.cc',
+        'test/helpers/load_language.cc',
+        'test/helpers/read_test_entries.cc',
+      ],
+    },
+    {
+      'target_name': 'thread_benchmarks',
+      'default_configuration': 'Release',
+      'type': 'executable',
+      'dependencies': [
+        'project.gyp:runtime',
+        'project.gyp:compiler'
+      ],
+      'include_dirs': [
+        'src',
+        'test',
+        'externals/utf8proc',
+      ],
+      'sources': [
+        'test/thread_benchmarks.cc',
+        'test/helpers/benchmark_helpers.cc',
+        'test/helpers/encoding_helpers.cc',
+        'test/helpers/file_helpers.cc',
+        'test/helpers/load_language.cc',
+        'test/helpers/read_test_entries.cc',
+      ],
+    },
+    {
+      'target_name': 'startup_benchmarks',
+      'default_configuration': 'Release',
+      'type': 'executable',
+      'dependencies': [
+        'project.gyp:runtime',
+        'project.gyp:compiler'
+      ],
+      'include_dirs': [
+        'src',
+        'test',
+        'externals/utf8proc',
+      ],
+      'sources': [
+        'test/startup_benchmarks.cc',
+        'test/helpers/benchmark_helpers.cc',
+        'test/helpers/file_helpers.cc',
+        'test/helpers/load_language.cc',
+      ],
+    },
     {
       'target_name': 'tests',
       'default_configuration': 'Test',
@@ -38,8 +139,12 @@
       ],
       'sources': [
         'test/compiler/build_tables/lex_item_test.cc',
+        'test/compiler/build_tables/lookahead_set_test.cc',
         'test/compiler/build_tables/parse_item_set_builder_test.cc',
         'test/compiler/build_tables/rule_can_be_blank_test.cc',
+        'test/compiler/compile_cache_test.cc',
+        'test/compiler/compile_session_test.cc',
+        'test/compiler/conflict_report_test.cc',
         'test/compiler/prepare_grammar/expand_repeats_test.cc',
         'test/compiler/prepare_grammar/expand_tokens_test.cc',
         'test/compiler/prepare_grammar/extract_choices_test.cc',
@@ -66,11 +171,19 @@
         'test/integration/fuzzing-examples.cc',
         'test/integration/real_grammars.cc',
         'test/integration/test_grammars.cc',
+        'test/runtime/changed_node_iterator_test.cc',
         'test/runtime/document_test.cc',
+        'test/runtime/frozen_tree_test.cc',
+        'test/runtime/language_registry_test.cc',
         'test/runtime/language_test.cc',
         'test/runtime/node_test.cc',
         'test/runtime/parser_test.cc',
+        'test/runtime/pattern_set_test.cc',
+        'test/runtime/runtime_cpp_test.cc',
+        'test/runtime/scope_iterator_test.cc',
         'test/runtime/stack_test.cc',
+        'test/runtime/symbol_iterator_test.cc',
+        'test/runtime/token_iterator_test.cc',
         'test/runtime/tree_test.cc',
         'test/tests.cc',
       ],
@@ -97,7 +210,15 @@
   ],
 
   'target_defaults': {
-    'configurations': {'Test': {}, 'Release': {}},
+    'configurations': {
+      'Test': {},
+      'TestThreads': {
+        'defines': ['TREE_SITTER_ATOMIC_REF_COUNTS'],
+        'cflags': ['-fsanitize=thread'],
+        'ldflags': ['-fsanitize=thread'],
+      },
+      'Release': {},
+    },
     'cflags_cc': ['-std=c++14'],
     'conditions': [
       ['OS=="linux"', {